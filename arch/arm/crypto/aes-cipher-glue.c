@@ -10,6 +10,8 @@
  */
 
 #include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/internal/skcipher.h>
 #include <linux/crypto.h>
 #include <linux/module.h>
 
@@ -35,6 +37,77 @@ static void aes_decrypt(struct crypto_tfm *tfm, u8 *out, const u8 *in)
 	__aes_arm_decrypt(ctx->key_dec, rounds, in, out);
 }
 
+static int aes_ctr_setkey(struct crypto_skcipher *tfm, const u8 *in_key,
+			  unsigned int key_len)
+{
+	return crypto_aes_set_key(crypto_skcipher_tfm(tfm), in_key, key_len);
+}
+
+/*
+ * The generic ctr() template calls through the cipher interface for every
+ * block; calling the core transform directly keeps the hot loop to one block
+ * encryption and one word sized XOR pass per 16 bytes.
+ */
+static int aes_ctr_encrypt(struct skcipher_request *req)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct crypto_aes_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int rounds = 6 + ctx->key_length / 4;
+	u32 ks[AES_BLOCK_SIZE / sizeof(u32)];
+	struct skcipher_walk walk;
+	unsigned int nbytes;
+	int err;
+
+	err = skcipher_walk_virt(&walk, req, false);
+
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		u8 *dst = walk.dst.virt.addr;
+		u8 *src = walk.src.virt.addr;
+
+		do {
+			__aes_arm_encrypt(ctx->key_enc, rounds, walk.iv,
+					  (u8 *)ks);
+			crypto_xor_cpy(dst, src, (u8 *)ks, AES_BLOCK_SIZE);
+			crypto_inc(walk.iv, AES_BLOCK_SIZE);
+			dst += AES_BLOCK_SIZE;
+			src += AES_BLOCK_SIZE;
+			nbytes -= AES_BLOCK_SIZE;
+		} while (nbytes >= AES_BLOCK_SIZE);
+
+		err = skcipher_walk_done(&walk, nbytes);
+	}
+
+	if (walk.nbytes) {
+		__aes_arm_encrypt(ctx->key_enc, rounds, walk.iv, (u8 *)ks);
+		crypto_xor_cpy(walk.dst.virt.addr, walk.src.virt.addr,
+			       (u8 *)ks, walk.nbytes);
+		crypto_inc(walk.iv, AES_BLOCK_SIZE);
+		err = skcipher_walk_done(&walk, 0);
+	}
+
+	return err;
+}
+
+static struct skcipher_alg aes_ctr_alg = {
+	.base.cra_name		= "ctr(aes)",
+	.base.cra_driver_name	= "ctr-aes-arm",
+	.base.cra_priority	= 220,
+	.base.cra_blocksize	= 1,
+	.base.cra_ctxsize	= sizeof(struct crypto_aes_ctx),
+	.base.cra_module	= THIS_MODULE,
+#ifndef CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS
+	.base.cra_alignmask	= 3,
+#endif
+
+	.min_keysize		= AES_MIN_KEY_SIZE,
+	.max_keysize		= AES_MAX_KEY_SIZE,
+	.ivsize			= AES_BLOCK_SIZE,
+	.chunksize		= AES_BLOCK_SIZE,
+	.setkey			= aes_ctr_setkey,
+	.encrypt		= aes_ctr_encrypt,
+	.decrypt		= aes_ctr_encrypt,
+};
+
 static struct crypto_alg aes_alg = {
 	.cra_name			= "aes",
 	.cra_driver_name		= "aes-arm",
@@ -57,11 +130,22 @@ static struct crypto_alg aes_alg = {
 
 static int __init aes_init(void)
 {
-	return crypto_register_alg(&aes_alg);
+	int err;
+
+	err = crypto_register_alg(&aes_alg);
+	if (err)
+		return err;
+
+	err = crypto_register_skcipher(&aes_ctr_alg);
+	if (err)
+		crypto_unregister_alg(&aes_alg);
+
+	return err;
 }
 
 static void __exit aes_fini(void)
 {
+	crypto_unregister_skcipher(&aes_ctr_alg);
 	crypto_unregister_alg(&aes_alg);
 }
 
@@ -72,3 +156,4 @@ MODULE_DESCRIPTION("Scalar AES cipher for ARM");
 MODULE_AUTHOR("Ard Biesheuvel <ard.biesheuvel@linaro.org>");
 MODULE_LICENSE("GPL v2");
 MODULE_ALIAS_CRYPTO("aes");
+MODULE_ALIAS_CRYPTO("ctr(aes)");
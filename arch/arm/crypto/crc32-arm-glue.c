@@ -0,0 +1,176 @@
+/*
+ * CRC32(C) using slice-by-4 tables, for ARM cores without CRC instructions
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Based on crc32-ce-glue.c:
+ *
+ * Copyright (C) 2016 Linaro Ltd <ard.biesheuvel@linaro.org>
+ */
+
+#include <linux/cache.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include <crypto/internal/hash.h>
+
+#include <asm/unaligned.h>
+
+#define CRC32_POLY_LE		0xedb88320
+#define CRC32C_POLY_LE		0x82f63b78
+
+asmlinkage u32 crc32_arm_le(u32 init_crc, const u8 buf[], u32 len,
+			    const u32 *tables);
+
+static u32 crc32_table[4][256] __cacheline_aligned;
+static u32 crc32c_table[4][256] __cacheline_aligned;
+
+static void __init crc32_arm_init_table(u32 table[4][256], u32 poly)
+{
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		u32 crc = i;
+
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? poly : 0);
+		table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 4; j++)
+			table[j][i] = (table[j - 1][i] >> 8) ^
+				      table[0][table[j - 1][i] & 0xff];
+}
+
+static int crc32_cra_init(struct crypto_tfm *tfm)
+{
+	u32 *key = crypto_tfm_ctx(tfm);
+
+	*key = 0;
+	return 0;
+}
+
+static int crc32c_cra_init(struct crypto_tfm *tfm)
+{
+	u32 *key = crypto_tfm_ctx(tfm);
+
+	*key = ~0;
+	return 0;
+}
+
+static int crc32_setkey(struct crypto_shash *hash, const u8 *key,
+			unsigned int keylen)
+{
+	u32 *mctx = crypto_shash_ctx(hash);
+
+	if (keylen != sizeof(u32)) {
+		crypto_shash_set_flags(hash, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	*mctx = le32_to_cpup((__le32 *)key);
+	return 0;
+}
+
+static int crc32_init(struct shash_desc *desc)
+{
+	u32 *mctx = crypto_shash_ctx(desc->tfm);
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = *mctx;
+	return 0;
+}
+
+static int crc32_update(struct shash_desc *desc, const u8 *data,
+			unsigned int length)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = crc32_arm_le(*crc, data, length, &crc32_table[0][0]);
+	return 0;
+}
+
+static int crc32c_update(struct shash_desc *desc, const u8 *data,
+			 unsigned int length)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = crc32_arm_le(*crc, data, length, &crc32c_table[0][0]);
+	return 0;
+}
+
+static int crc32_final(struct shash_desc *desc, u8 *out)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	put_unaligned_le32(*crc, out);
+	return 0;
+}
+
+static int crc32c_final(struct shash_desc *desc, u8 *out)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	put_unaligned_le32(~*crc, out);
+	return 0;
+}
+
+static struct shash_alg crc32_arm_algs[] = { {
+	.setkey			= crc32_setkey,
+	.init			= crc32_init,
+	.update			= crc32_update,
+	.final			= crc32_final,
+	.descsize		= sizeof(u32),
+	.digestsize		= sizeof(u32),
+
+	.base.cra_ctxsize	= sizeof(u32),
+	.base.cra_init		= crc32_cra_init,
+	.base.cra_name		= "crc32",
+	.base.cra_driver_name	= "crc32-arm",
+	.base.cra_priority	= 150,
+	.base.cra_flags		= CRYPTO_ALG_OPTIONAL_KEY,
+	.base.cra_blocksize	= 1,
+	.base.cra_module	= THIS_MODULE,
+}, {
+	.setkey			= crc32_setkey,
+	.init			= crc32_init,
+	.update			= crc32c_update,
+	.final			= crc32c_final,
+	.descsize		= sizeof(u32),
+	.digestsize		= sizeof(u32),
+
+	.base.cra_ctxsize	= sizeof(u32),
+	.base.cra_init		= crc32c_cra_init,
+	.base.cra_name		= "crc32c",
+	.base.cra_driver_name	= "crc32c-arm",
+	.base.cra_priority	= 150,
+	.base.cra_flags		= CRYPTO_ALG_OPTIONAL_KEY,
+	.base.cra_blocksize	= 1,
+	.base.cra_module	= THIS_MODULE,
+} };
+
+static int __init crc32_arm_mod_init(void)
+{
+	crc32_arm_init_table(crc32_table, CRC32_POLY_LE);
+	crc32_arm_init_table(crc32c_table, CRC32C_POLY_LE);
+
+	return crypto_register_shashes(crc32_arm_algs,
+				       ARRAY_SIZE(crc32_arm_algs));
+}
+
+static void __exit crc32_arm_mod_exit(void)
+{
+	crypto_unregister_shashes(crc32_arm_algs,
+				  ARRAY_SIZE(crc32_arm_algs));
+}
+
+module_init(crc32_arm_mod_init);
+module_exit(crc32_arm_mod_exit);
+
+MODULE_DESCRIPTION("Slice-by-4 CRC32 and CRC32C for ARM");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("crc32");
+MODULE_ALIAS_CRYPTO("crc32c");
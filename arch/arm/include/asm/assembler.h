@@ -64,9 +64,14 @@
 #endif
 
 /*
- * Data preload for architectures that support it
+ * Data preload for architectures that support it.  Of the ARMv5 cores, only
+ * XScale, XSC3, Feroceon and Mohawk do anything with pld, the ARM9 and ARM10
+ * cores treat it as a nop.  Kernels for those only run the loop overhead
+ * that comes with the preloads, so they are left out there.
  */
-#if __LINUX_ARM_ARCH__ >= 5
+#if __LINUX_ARM_ARCH__ >= 6 || defined(CONFIG_CPU_XSCALE) || \
+	defined(CONFIG_CPU_XSC3) || defined(CONFIG_CPU_FEROCEON) || \
+	defined(CONFIG_CPU_MOHAWK)
 #define PLD(code...)	code
 #else
 #define PLD(code...)
@@ -80,8 +85,11 @@
  * is used).
  *
  * On Feroceon there is much to gain however, regardless of cache mode.
+ *
+ * The ARM926 is read-allocate only, but aligning the destination keeps each
+ * 32 byte stm burst within one line of its write buffer as well.
  */
-#ifdef CONFIG_CPU_FEROCEON
+#if defined(CONFIG_CPU_FEROCEON) || defined(CONFIG_CPU_ARM926T)
 #define CALGN(code...) code
 #else
 #define CALGN(code...)
@@ -36,11 +36,18 @@ struct fiq_handler {
 
 typedef void (*fiq_c_handler_t)(void);
 
+/*
+ * Code run from the FIQ can be put in this section so that it is contiguous
+ * in memory, e.g. for cache lockdown. See __fiq_text_start/__fiq_text_end.
+ */
+#define __fiq_text	__attribute__((section(".fiq.text")))
+
 extern int claim_fiq(struct fiq_handler *f);
 extern void release_fiq(struct fiq_handler *f);
 extern void set_fiq_handler(void *start, unsigned int length);
 extern fiq_c_handler_t get_fiq_c_handler(void);
 extern void set_fiq_c_handler(fiq_c_handler_t);
+extern void set_fiq_c_handler_stack(fiq_c_handler_t, void *stack_top);
 extern void enable_fiq(int fiq);
 extern void disable_fiq(int fiq);
 
@@ -5,5 +5,6 @@
 #include <asm-generic/sections.h>
 
 extern char _exiprom[];
+extern char __fiq_text_start[], __fiq_text_end[];
 
 #endif	/* _ASM_ARM_SECTIONS_H */
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Code linked to run from on-chip SRAM
+ *
+ * Functions tagged __sramfunc are placed in .sram.text, which is linked at
+ * SRAM_TEXT_OFFSET and copied there by the platform before interrupts are
+ * enabled. This is meant for short, hot interrupt paths that should not
+ * wait for the DDR controller when DMA masters keep it busy.
+ *
+ * Calls between SRAM and normal kernel text are out of BL range; the
+ * linker inserts long branch veneers for those, and __sramfunc also marks
+ * the function long_call for callers in other translation units.
+ */
+#ifndef __ASM_ARM_SRAM_TEXT_H
+#define __ASM_ARM_SRAM_TEXT_H
+
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+/* start of the DA8xx shared RAM, at its static mapping DA8XX_SHARED_RAM_VIRT */
+#define SRAM_TEXT_OFFSET	0xfebdd000
+#define SRAM_TEXT_SIZE		0x4000
+#endif
+
+#ifndef __ASSEMBLY__
+
+#include <linux/compiler.h>
+
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+#define __sramfunc	__attribute__((long_call)) __section(.sram.text) noinline
+#define __sramlocalfunc	__section(.sram.text)
+
+extern char __sram_text_load[], __ssram_text[], __esram_text[];
+#else
+#define __sramfunc
+#define __sramlocalfunc
+#endif
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_ARM_SRAM_TEXT_H */
@@ -146,39 +146,32 @@ static void (*current_fiq_c_isr)(void);
 
 #define FIQ_C_ISR_STACK_SIZE 	256
 
+/* in fiqasm.S, entered with r9 = handler and sp = its stack */
+extern void __fiq_c_entry(void);
+
 static void __attribute__((naked)) __jump_to_isr(void)
 {
 	asm __volatile__ ("mov pc, r8");
 }
 
-
-static void __attribute__((naked)) __actual_isr(void)
-{
-	asm __volatile__ (
-		"stmdb	sp!, {r0-r12, lr};"
-		"mov     fp, sp;"
-	);
-
-	current_fiq_c_isr();
-
-	asm __volatile__ (
-		"ldmia	sp!, {r0-r12, lr};"
-		"subs	pc, lr, #4;"
-	);
-}
-
 fiq_c_handler_t get_fiq_c_handler(void)
 {
 	return current_fiq_c_isr;
 }
 
-void set_fiq_c_handler(fiq_c_handler_t isr)
+/*
+ * Same as set_fiq_c_handler(), but runs the handler on the given stack
+ * instead of the small one in the vector page. The stack must be mapped in
+ * every page table, e.g. lowmem or a static I/O mapping.
+ */
+void set_fiq_c_handler_stack(fiq_c_handler_t isr, void *stack_top)
 {
 	struct pt_regs regs;
 
 	memset(&regs, 0, sizeof(regs));
-	regs.ARM_r8 = (unsigned long) __actual_isr;
-	regs.ARM_sp = 0xffff001c + FIQ_C_ISR_STACK_SIZE;
+	regs.ARM_r8 = (unsigned long) __fiq_c_entry;
+	regs.ARM_r9 = (unsigned long) isr;
+	regs.ARM_sp = (unsigned long) stack_top;
 
 	set_fiq_handler(__jump_to_isr, 4);
 
@@ -186,6 +179,15 @@ void set_fiq_c_handler(fiq_c_handler_t isr)
 
 	set_fiq_regs(&regs);
 }
+
+/*
+ * The default stack lives in the vector page right behind the 4 byte FIQ
+ * vector, which keeps its top 8 byte aligned as the AAPCS wants.
+ */
+void set_fiq_c_handler(fiq_c_handler_t isr)
+{
+	set_fiq_c_handler_stack(isr, (void *)(0xffff0020 + FIQ_C_ISR_STACK_SIZE));
+}
 /* ---------------------------- FIQ handler in C ---------------------------- */
 
 int claim_fiq(struct fiq_handler *f)
@@ -236,6 +238,7 @@ void disable_fiq(int fiq)
 EXPORT_SYMBOL(set_fiq_handler);
 EXPORT_SYMBOL(get_fiq_c_handler);
 EXPORT_SYMBOL(set_fiq_c_handler);
+EXPORT_SYMBOL(set_fiq_c_handler_stack);
 EXPORT_SYMBOL(__set_fiq_regs);	/* defined in fiqasm.S */
 EXPORT_SYMBOL(__get_fiq_regs);	/* defined in fiqasm.S */
 EXPORT_SYMBOL(claim_fiq);
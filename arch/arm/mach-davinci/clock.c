@@ -144,14 +144,24 @@ long clk_round_rate(struct clk *clk, unsigned long rate)
 }
 EXPORT_SYMBOL(clk_round_rate);
 
-/* Propagate rate to children */
+/*
+ * Propagate rate to children. Rates only depend on the parent rate and on
+ * cached dividers, so a subtree whose root keeps its rate is left alone.
+ */
 static void propagate_rate(struct clk *root)
 {
 	struct clk *clk;
+	unsigned long rate;
 
 	list_for_each_entry(clk, &root->children, childnode) {
-		if (clk->recalc)
-			clk->rate = clk->recalc(clk);
+		if (!clk->recalc)
+			continue;
+
+		rate = clk->recalc(clk);
+		if (rate == clk->rate)
+			continue;
+
+		clk->rate = rate;
 		propagate_rate(clk);
 	}
 }
@@ -340,14 +350,20 @@ static unsigned long clk_sysclk_recalc(struct clk *clk)
 	if (!clk->div_reg)
 		return rate;
 
-	v = __raw_readl(pll->base + clk->div_reg);
-	if (v & PLLDIV_EN) {
-		plldiv = (v & pll->div_ratio_mask) + 1;
-		if (plldiv)
-			rate /= plldiv;
+	/*
+	 * Only davinci_set_sysclk_rate() changes the divider, so the register
+	 * is read once and further recalculations, e.g. on every PLL rate
+	 * change, are a plain division.
+	 */
+	if (!clk->div_ratio) {
+		v = __raw_readl(pll->base + clk->div_reg);
+		plldiv = 1;
+		if (v & PLLDIV_EN)
+			plldiv = (v & pll->div_ratio_mask) + 1;
+		clk->div_ratio = plldiv;
 	}
 
-	return rate;
+	return rate / clk->div_ratio;
 }
 
 int davinci_set_sysclk_rate(struct clk *clk, unsigned long rate)
@@ -419,6 +435,8 @@ int davinci_set_sysclk_rate(struct clk *clk, unsigned long rate)
 		v = __raw_readl(pll->base + PLLSTAT);
 	} while (v & PLLSTAT_GOSTAT);
 
+	clk->div_ratio = ratio + 1;
+
 	return 0;
 }
 EXPORT_SYMBOL(davinci_set_sysclk_rate);
@@ -444,9 +462,24 @@ static unsigned long clk_pllclk_recalc(struct clk *clk)
 	struct pll_data *pll = clk->pll_data;
 	unsigned long rate = clk->rate;
 
-	ctrl = __raw_readl(pll->base + PLLCTL);
 	rate = pll->input_rate = clk->parent->rate;
 
+	/*
+	 * The configuration only changes through davinci_set_pllrate(), which
+	 * updates the cache, so only the first call has to read it back.
+	 */
+	if (pll->cfg_valid) {
+		if (!pll->bypass) {
+			rate /= pll->prediv;
+			rate *= pll->mult;
+			rate /= pll->postdiv;
+		}
+
+		return rate;
+	}
+
+	ctrl = __raw_readl(pll->base + PLLCTL);
+
 	if (ctrl & PLLCTL_PLLEN) {
 		bypass = 0;
 		mult = __raw_readl(pll->base + PLLM);
@@ -477,6 +510,12 @@ static unsigned long clk_pllclk_recalc(struct clk *clk)
 			postdiv = 1;
 	}
 
+	pll->bypass = bypass;
+	pll->prediv = prediv;
+	pll->mult = mult;
+	pll->postdiv = postdiv;
+	pll->cfg_valid = true;
+
 	if (!bypass) {
 		rate /= prediv;
 		rate *= mult;
@@ -498,6 +537,27 @@ static unsigned long clk_pllclk_recalc(struct clk *clk)
 	return rate;
 }
 
+/*
+ *  PLL lock time required per OMAP-L138 datasheet is
+ * (2000 * prediv)/sqrt(pllm) OSCIN cycles. We approximate sqrt(pllm)
+ * as 4 and OSCIN cycle as 25 MHz.
+ */
+static unsigned int davinci_pll_locktime(unsigned int prediv)
+{
+	return prediv ? (2000 * prediv) / 100 : PLL_LOCK_TIME;
+}
+
+/**
+ * davinci_pll_relock_time - time spent waiting in davinci_set_pllrate()
+ * @prediv: The pre divider value that will be passed to davinci_set_pllrate()
+ *
+ * Returns the delay in microseconds during which the PLL output is bypassed.
+ */
+unsigned int davinci_pll_relock_time(unsigned int prediv)
+{
+	return PLL_BYPASS_TIME + PLL_RESET_TIME + davinci_pll_locktime(prediv);
+}
+
 /**
  * davinci_set_pllrate - set the output rate of a given PLL.
  *
@@ -513,22 +573,17 @@ int davinci_set_pllrate(struct pll_data *pll, unsigned int prediv,
 {
 	u32 ctrl;
 	unsigned int locktime;
+	unsigned int cfg_prediv = prediv ?: 1;
+	unsigned int cfg_mult = mult ?: 1;
+	unsigned int cfg_postdiv = postdiv ?: 1;
 	unsigned long flags;
 
 	if (pll->base == NULL)
 		return -EINVAL;
 
-	/*
-	 *  PLL lock time required per OMAP-L138 datasheet is
-	 * (2000 * prediv)/sqrt(pllm) OSCIN cycles. We approximate sqrt(pllm)
-	 * as 4 and OSCIN cycle as 25 MHz.
-	 */
-	if (prediv) {
-		locktime = ((2000 * prediv) / 100);
+	locktime = davinci_pll_locktime(prediv);
+	if (prediv)
 		prediv = (prediv - 1) | PLLDIV_EN;
-	} else {
-		locktime = PLL_LOCK_TIME;
-	}
 	if (postdiv)
 		postdiv = (postdiv - 1) | PLLDIV_EN;
 	if (mult)
@@ -569,6 +624,13 @@ int davinci_set_pllrate(struct pll_data *pll, unsigned int prediv,
 	ctrl |= PLLCTL_PLLEN;
 	__raw_writel(ctrl, pll->base + PLLCTL);
 
+	pll->bypass = false;
+	pll->prediv = (pll->flags & PLL_HAS_PREDIV) ? cfg_prediv : 1;
+	pll->mult = cfg_mult;
+	pll->postdiv = (pll->flags & PLL_HAS_POSTDIV) ? cfg_postdiv : 1;
+	/* these encode the multiplier differently, read it back instead */
+	pll->cfg_valid = !cpu_is_davinci_dm355() && !cpu_is_davinci_dm365();
+
 	spin_unlock_irqrestore(&clockfw_lock, flags);
 
 	return 0;
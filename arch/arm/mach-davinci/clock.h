@@ -80,6 +80,13 @@ struct pll_data {
 	u32 flags;
 	u32 input_rate;
 	u32 div_ratio_mask;
+
+	/* Last configuration read or set, see clk_pllclk_recalc() */
+	bool cfg_valid;
+	bool bypass;
+	u32 prediv;
+	u32 mult;
+	u32 postdiv;
 };
 #define PLL_HAS_PREDIV          0x01
 #define PLL_HAS_POSTDIV         0x02
@@ -100,6 +107,7 @@ struct clk {
 	struct list_head	childnode;	/* parent's child list node */
 	struct pll_data         *pll_data;
 	u32                     div_reg;
+	u32			div_ratio;	/* cached divider or 0 */
 	unsigned long (*recalc) (struct clk *);
 	int (*set_rate) (struct clk *clk, unsigned long rate);
 	int (*round_rate) (struct clk *clk, unsigned long rate);
@@ -128,6 +136,7 @@ struct clk {
 int davinci_clk_init(struct clk_lookup *clocks);
 int davinci_set_pllrate(struct pll_data *pll, unsigned int prediv,
 				unsigned int mult, unsigned int postdiv);
+unsigned int davinci_pll_relock_time(unsigned int prediv);
 int davinci_set_sysclk_rate(struct clk *clk, unsigned long rate);
 int davinci_set_refclk_rate(unsigned long rate);
 int davinci_simple_set_rate(struct clk *clk, unsigned long rate);
@@ -9,17 +9,26 @@
  * kind, whether express or implied.
  */
 
+#include <linux/debugfs.h>
 #include <linux/export.h>
 #include <linux/init.h>
 #include <linux/irq.h>
 #include <linux/irqchip.h>
 #include <linux/irqdomain.h>
 #include <linux/io.h>
+#include <linux/math64.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
+#include <linux/pstore_ram.h>
+#include <linux/seq_file.h>
+
+#include <asm/exception.h>
+#include <asm/sram-text.h>
+#include <asm/mach/irq.h>
 
 #include <mach/common.h>
+#include <mach/time.h>
 #include "cp_intc.h"
 
 static inline unsigned int cp_intc_read(unsigned offset)
@@ -113,6 +122,92 @@ static const struct irq_domain_ops cp_intc_host_ops = {
 	.xlate = irq_domain_xlate_onetwocell,
 };
 
+#ifdef CONFIG_CP_INTC_STATS
+#define CP_INTC_STATS_NR_IRQ	128
+
+/* all times in ticks of the free-running counter */
+struct cp_intc_irq_stats {
+	u32 count;
+	u32 max;
+	u32 max_wait;
+	u64 sum;
+};
+
+static struct cp_intc_irq_stats cp_intc_stats[CP_INTC_STATS_NR_IRQ];
+
+static inline u32 cp_intc_stats_now(void)
+{
+	return davinci_timer_read_freerun();
+}
+
+/*
+ * @entry is when the IRQ exception started dispatching and @start when the
+ * handlers for @hwirq were called, so the difference is the time spent on
+ * higher priority interrupts first.
+ */
+static inline void cp_intc_stats_account(u32 hwirq, u32 entry, u32 start)
+{
+	struct cp_intc_irq_stats *stats;
+	u32 ticks = davinci_timer_read_freerun() - start;
+
+	if (hwirq >= CP_INTC_STATS_NR_IRQ)
+		return;
+
+	stats = &cp_intc_stats[hwirq];
+	stats->count++;
+	stats->sum += ticks;
+	stats->max = max(stats->max, ticks);
+	stats->max_wait = max(stats->max_wait, start - entry);
+}
+#else
+static inline u32 cp_intc_stats_now(void)
+{
+	return 0;
+}
+
+static inline void cp_intc_stats_account(u32 hwirq, u32 entry, u32 start)
+{
+}
+#endif
+
+#ifdef CONFIG_MULTI_IRQ_HANDLER
+/*
+ * Uses the prioritized index of the nIRQ host interrupt, so it only ever
+ * sees interrupts on channels 2-31, highest priority first, and keeps going
+ * until nothing is left instead of returning to the exception entry code
+ * for each interrupt.
+ */
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+#define __cp_intc_irq_entry	__sramfunc
+#else
+#define __cp_intc_irq_entry	__exception_irq_entry
+#endif
+
+static void __cp_intc_irq_entry cp_intc_handle_irq(struct pt_regs *regs)
+{
+	struct ramoops_irqtrace *trace;
+	u32 entry = cp_intc_stats_now();
+	u32 idx, start;
+
+	trace = ramoops_irqtrace_get(RAMOOPS_IRQTRACE_IRQ);
+
+	for (;;) {
+		idx = cp_intc_read(CP_INTC_HOST_PRIO_IDX(CP_INTC_HOST_IRQ));
+		if (idx & CP_INTC_PRIO_IDX_NONE)
+			break;
+		idx &= CP_INTC_PRIO_IDX_MASK;
+		/* the interrupted pc and lr show what the IRQ held up */
+		if (trace)
+			ramoops_irqtrace_add(trace,
+					     davinci_timer_read_freerun(), idx,
+					     regs->ARM_pc, regs->ARM_lr);
+		start = cp_intc_stats_now();
+		handle_domain_irq(cp_intc_domain, idx, regs);
+		cp_intc_stats_account(idx, entry, start);
+	}
+}
+#endif
+
 int __init cp_intc_of_init(struct device_node *node, struct device_node *parent)
 {
 	u32 num_irq		= davinci_soc_info.intc_irq_num;
@@ -201,6 +296,10 @@ int __init cp_intc_of_init(struct device_node *node, struct device_node *parent)
 		return -EINVAL;
 	}
 
+#ifdef CONFIG_MULTI_IRQ_HANDLER
+	set_handle_irq(cp_intc_handle_irq);
+#endif
+
 	/* Enable global interrupt */
 	cp_intc_write(1, CP_INTC_GLOBAL_ENABLE);
 
@@ -222,4 +321,123 @@ void cp_intc_fiq_disable(void)
 	cp_intc_write(0, CP_INTC_HOST_ENABLE_IDX_CLR);
 }
 
+static DEFINE_RAW_SPINLOCK(cp_intc_chan_lock);
+
+/*
+ * Each system interrupt is mapped to one of 32 channels. Lower channels have
+ * higher priority and channels 0 and 1 go to nFIQ.
+ */
+unsigned cp_intc_get_channel(unsigned hwirq)
+{
+	return (cp_intc_read(CP_INTC_CHAN_MAP(hwirq >> 2))
+		>> ((hwirq & 3) * 8)) & 0xff;
+}
+
+void cp_intc_set_channel(unsigned hwirq, unsigned channel)
+{
+	unsigned shift = (hwirq & 3) * 8;
+	unsigned long flags;
+	u32 val;
+
+	raw_spin_lock_irqsave(&cp_intc_chan_lock, flags);
+	val = cp_intc_read(CP_INTC_CHAN_MAP(hwirq >> 2));
+	val &= ~(0xff << shift);
+	val |= (channel & 0xff) << shift;
+	cp_intc_write(val, CP_INTC_CHAN_MAP(hwirq >> 2));
+	raw_spin_unlock_irqrestore(&cp_intc_chan_lock, flags);
+}
+
 IRQCHIP_DECLARE(cp_intc, "ti,cp-intc", cp_intc_of_init);
+
+#ifdef CONFIG_CP_INTC_STATS
+static u64 cp_intc_stats_ticks_to_ns(u64 ticks)
+{
+	return mul_u64_u32_div(ticks, NSEC_PER_SEC,
+			       davinci_timer_get_tick_rate());
+}
+
+static int cp_intc_stats_show(struct seq_file *s, void *v)
+{
+	struct cp_intc_irq_stats stats;
+	struct irq_desc *desc;
+	unsigned long flags;
+	unsigned int irq;
+	int i;
+
+	seq_printf(s, "%5s %5s %10s %12s %10s %10s %10s  %s\n", "hwirq",
+		   "irq", "count", "total(us)", "avg(ns)", "max(ns)",
+		   "wait(ns)", "name");
+
+	for (i = 0; i < CP_INTC_STATS_NR_IRQ; i++) {
+		local_irq_save(flags);
+		stats = cp_intc_stats[i];
+		local_irq_restore(flags);
+		if (!stats.count)
+			continue;
+
+		irq = irq_find_mapping(cp_intc_domain, i);
+		seq_printf(s, "%5d %5u %10u %12llu %10llu %10llu %10llu  ", i,
+			   irq, stats.count,
+			   div_u64(cp_intc_stats_ticks_to_ns(stats.sum),
+				   NSEC_PER_USEC),
+			   cp_intc_stats_ticks_to_ns(div_u64(stats.sum,
+							     stats.count)),
+			   cp_intc_stats_ticks_to_ns(stats.max),
+			   cp_intc_stats_ticks_to_ns(stats.max_wait));
+
+		desc = irq_to_desc(irq);
+		if (desc) {
+			raw_spin_lock_irqsave(&desc->lock, flags);
+			if (desc->action)
+				seq_puts(s, desc->action->name);
+			raw_spin_unlock_irqrestore(&desc->lock, flags);
+		}
+		seq_putc(s, '\n');
+	}
+
+	return 0;
+}
+
+static int cp_intc_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cp_intc_stats_show, inode->i_private);
+}
+
+static ssize_t cp_intc_stats_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	memset(cp_intc_stats, 0, sizeof(cp_intc_stats));
+	local_irq_restore(flags);
+
+	return count;
+}
+
+static const struct file_operations cp_intc_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= cp_intc_stats_open,
+	.read		= seq_read,
+	.write		= cp_intc_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cp_intc_stats_init(void)
+{
+	struct dentry *dir;
+
+	if (!cp_intc_domain)
+		return -ENODEV;
+
+	dir = debugfs_create_dir("cp_intc", NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return -ENOMEM;
+
+	debugfs_create_file("irq_stats", 0644, dir, NULL, &cp_intc_stats_fops);
+
+	return 0;
+}
+late_initcall(cp_intc_stats_init);
+#endif
@@ -51,10 +51,19 @@
 #define CP_INTC_HOST_PRIO_VECTOR(n)	(0x1600 + (n << 2))
 #define CP_INTC_VECTOR_ADDR(n)		(0x2000 + (n << 2))
 
+/* Fields of the prioritized index registers */
+#define CP_INTC_PRIO_IDX_MASK		0x3ff
+#define CP_INTC_PRIO_IDX_NONE		BIT(31)
+
+/* Host interrupt 0 is nFIQ, host interrupt 1 is nIRQ */
+#define CP_INTC_HOST_IRQ		1
+
 void cp_intc_init(void);
 int cp_intc_of_init(struct device_node *, struct device_node *);
 
 void cp_intc_fiq_enable(void);
 void cp_intc_fiq_disable(void);
+unsigned cp_intc_get_channel(unsigned hwirq);
+void cp_intc_set_channel(unsigned hwirq, unsigned channel);
 
 #endif	/* __ASM_HARDWARE_CP_INTC_H */
@@ -19,13 +19,23 @@
 #include <linux/export.h>
 #include <asm/cpuidle.h>
 
+#include <mach/time.h>
+
 #include "cpuidle.h"
 #include "ddr2.h"
+#include "sram.h"
+
+#define DAVINCI_CPUIDLE_MAX_STATES	3
+
+/* Number of self-refresh round trips timed to get the exit latency */
+#define DAVINCI_SR_CALIBRATE_LOOPS	16
 
-#define DAVINCI_CPUIDLE_MAX_STATES	2
+/* Minimum time in self-refresh that is worth the round trip */
+#define DAVINCI_SR_MIN_RESIDENCY	100U
 
 static void __iomem *ddr2_reg_base;
 static bool ddr2_pdown;
+static void (*davinci_sram_idle_sr)(void __iomem *ddr2_ctlr_base, int wait);
 
 static void davinci_save_ddr_power(int enter, bool pdown)
 {
@@ -57,6 +67,20 @@ static int davinci_enter_idle(struct cpuidle_device *dev,
 	return index;
 }
 
+/*
+ * The FIQ handler may run from DDR, so it is held off until the DDR is out
+ * of self-refresh again. A pending FIQ still ends the WFI.
+ */
+static int davinci_enter_idle_sr(struct cpuidle_device *dev,
+				 struct cpuidle_driver *drv, int index)
+{
+	local_fiq_disable();
+	davinci_sram_idle_sr(ddr2_reg_base, 1);
+	local_fiq_enable();
+
+	return index;
+}
+
 static struct cpuidle_driver davinci_idle_driver = {
 	.name			= "cpuidle-davinci",
 	.owner			= THIS_MODULE,
@@ -68,9 +92,53 @@ static struct cpuidle_driver davinci_idle_driver = {
 		.name			= "DDR SR",
 		.desc			= "WFI and DDR Self Refresh",
 	},
+	.states[2]		= {
+		.enter			= davinci_enter_idle_sr,
+		.name			= "DDR SR SRAM",
+		.desc			= "WFI from SRAM with DDR in Self Refresh",
+	},
 	.state_count = DAVINCI_CPUIDLE_MAX_STATES,
 };
 
+/*
+ * Times a round trip through self-refresh without the WFI. The worst case
+ * becomes the exit latency of the state, so PM QoS requests see what it
+ * really costs on this board instead of a guess. The governor expects the
+ * states to get deeper in order, so neither value goes below the one of the
+ * shallower state.
+ */
+static void __init davinci_calibrate_idle_sr(struct cpuidle_state *state,
+					     struct cpuidle_state *prev)
+{
+	unsigned int rate = davinci_timer_get_tick_rate();
+	unsigned long flags;
+	u32 start, ticks, max_ticks = 0;
+	unsigned int latency;
+	int i;
+
+	for (i = 0; i < DAVINCI_SR_CALIBRATE_LOOPS; i++) {
+		local_irq_save(flags);
+		local_fiq_disable();
+		start = davinci_timer_read_freerun();
+		davinci_sram_idle_sr(ddr2_reg_base, 0);
+		/* this is the first DDR access after leaving self-refresh */
+		ticks = davinci_timer_read_freerun() - start;
+		local_fiq_enable();
+		local_irq_restore(flags);
+
+		max_ticks = max(max_ticks, ticks);
+	}
+
+	latency = rate ? DIV_ROUND_UP_ULL((u64)max_ticks * USEC_PER_SEC, rate)
+		       : 1;
+	pr_info("cpuidle-davinci: DDR self-refresh exit latency %u us\n",
+		latency);
+
+	state->exit_latency = max(latency, prev->exit_latency);
+	state->target_residency = max3(4 * latency, DAVINCI_SR_MIN_RESIDENCY,
+				       prev->target_residency);
+}
+
 static int __init davinci_cpuidle_probe(struct platform_device *pdev)
 {
 	struct davinci_cpuidle_config *pdata = pdev->dev.platform_data;
@@ -84,6 +152,17 @@ static int __init davinci_cpuidle_probe(struct platform_device *pdev)
 
 	ddr2_pdown = pdata->ddr2_pdown;
 
+	davinci_sram_idle_sr = sram_alloc(davinci_cpu_idle_sr_sz, NULL);
+	if (davinci_sram_idle_sr) {
+		davinci_sram_push(davinci_sram_idle_sr, davinci_cpu_idle_sr,
+				  davinci_cpu_idle_sr_sz);
+		davinci_calibrate_idle_sr(&davinci_idle_driver.states[2],
+					  &davinci_idle_driver.states[1]);
+	} else {
+		dev_warn(&pdev->dev, "no SRAM, DDR self-refresh state disabled\n");
+		davinci_idle_driver.state_count = DAVINCI_CPUIDLE_MAX_STATES - 1;
+	}
+
 	return cpuidle_register(&davinci_idle_driver, NULL);
 }
 
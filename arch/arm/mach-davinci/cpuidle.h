@@ -15,4 +15,8 @@ struct davinci_cpuidle_config {
 	void __iomem *ddr2_ctlr_base;
 };
 
+/* in cpuidle-sr.S, copied to SRAM before use */
+extern void davinci_cpu_idle_sr(void __iomem *ddr2_ctlr_base, int wait);
+extern unsigned int davinci_cpu_idle_sr_sz;
+
 #endif
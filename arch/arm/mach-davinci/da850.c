@@ -21,6 +21,7 @@
 #include <linux/platform_data/gpio-davinci.h>
 
 #include <asm/mach/map.h>
+#include <asm/sram-text.h>
 
 #include "psc.h"
 #include <mach/irqs.h>
@@ -33,13 +34,14 @@
 
 #include "clock.h"
 #include "mux.h"
+#include "sram.h"
 
 #define DA850_PLL1_BASE		0x01e1a000
-#define DA850_TIMER64P2_BASE	0x01f0c000
-#define DA850_TIMER64P3_BASE	0x01f0d000
 
 #define DA850_REF_FREQ		24000000
 
+#define DA850_TIMER64_CMP12_0	0x60
+
 #define CFGCHIP3_ASYNC3_CLKSRC	BIT(4)
 #define CFGCHIP3_PLL1_MASTER_LOCK	BIT(5)
 #define CFGCHIP0_PLL_MASTER_LOCK	BIT(4)
@@ -199,6 +201,19 @@ static struct clk timerp64_1_clk = {
 	.parent		= &pll0_aux_clk,
 };
 
+/* Timer64P2 and Timer64P3 are in the ASYNC3 clock domain */
+static struct clk timerp64_2_clk = {
+	.name		= "timer2",
+	.parent		= &async3_clk,
+	.flags		= ALWAYS_ENABLED,
+};
+
+static struct clk timerp64_3_clk = {
+	.name		= "timer3",
+	.parent		= &async3_clk,
+	.flags		= ALWAYS_ENABLED,
+};
+
 static struct clk arm_rom_clk = {
 	.name		= "arm_rom",
 	.parent		= &pll0_sysclk2,
@@ -537,6 +552,8 @@ static struct clk_lookup da850_clks[] = {
 	CLK("i2c_davinci.1",	NULL,		&i2c0_clk),
 	CLK(NULL,		"timer0",	&timerp64_0_clk),
 	CLK("davinci-wdt",	NULL,		&timerp64_1_clk),
+	CLK("legoev3-fiq",	"uart_timer",	&timerp64_2_clk),
+	CLK(NULL,		"timer3",	&timerp64_3_clk),
 	CLK(NULL,		"arm_rom",	&arm_rom_clk),
 	CLK(NULL,		"tpcc0",	&tpcc0_clk),
 	CLK(NULL,		"tptc0",	&tptc0_clk),
@@ -1035,7 +1052,12 @@ const short da850_vpif_display_pins[] __initconst = {
 	-1
 };
 
-/* FIQ are pri 0-1; otherwise 2-7, with 7 lowest priority */
+/*
+ * Channels 0 and 1 go to nFIQ, 2-8 to nIRQ with 8 lowest priority. On nIRQ,
+ * the clockevent comes first, then the throughput critical EDMA, USB and
+ * UART interrupts. The GPIO banks go last, on channel 8, since they are
+ * shared by many slow peripherals.
+ */
 static u8 da850_default_priorities[DA850_N_CP_INTC_IRQ] = {
 	[IRQ_DA8XX_COMMTX]		= 7,
 	[IRQ_DA8XX_COMMRX]		= 7,
@@ -1048,9 +1070,9 @@ static u8 da850_default_priorities[DA850_N_CP_INTC_IRQ] = {
 	[IRQ_DA8XX_EVTOUT5]		= 7,
 	[IRQ_DA8XX_EVTOUT6]		= 7,
 	[IRQ_DA8XX_EVTOUT7]		= 7,
-	[IRQ_DA8XX_CCINT0]		= 7,
-	[IRQ_DA8XX_CCERRINT]		= 7,
-	[IRQ_DA8XX_TCERRINT0]		= 7,
+	[IRQ_DA8XX_CCINT0]		= 3,
+	[IRQ_DA8XX_CCERRINT]		= 3,
+	[IRQ_DA8XX_TCERRINT0]		= 3,
 	[IRQ_DA8XX_AEMIFINT]		= 7,
 	[IRQ_DA8XX_I2CINT0]		= 7,
 	[IRQ_DA8XX_MMCSDINT0]		= 7,
@@ -1062,7 +1084,7 @@ static u8 da850_default_priorities[DA850_N_CP_INTC_IRQ] = {
 	[IRQ_DA8XX_TINT34_0]		= 7,
 	[IRQ_DA8XX_TINT12_1]		= 7,
 	[IRQ_DA8XX_TINT34_1]		= 1, /* Uses FIQ for EV3 input port i2c */
-	[IRQ_DA8XX_UARTINT0]		= 7,
+	[IRQ_DA8XX_UARTINT0]		= 3,
 	[IRQ_DA8XX_KEYMGRINT]		= 7,
 	[IRQ_DA8XX_SECINT]		= 7,
 	[IRQ_DA8XX_SECKEYERR]		= 7,
@@ -1090,7 +1112,7 @@ static u8 da850_default_priorities[DA850_N_CP_INTC_IRQ] = {
 	[IRQ_DA8XX_CHIPINT1]		= 7,
 	[IRQ_DA8XX_CHIPINT2]		= 7,
 	[IRQ_DA8XX_CHIPINT3]		= 7,
-	[IRQ_DA8XX_TCERRINT1]		= 7,
+	[IRQ_DA8XX_TCERRINT1]		= 3,
 	[IRQ_DA8XX_C0_RX_THRESH_PULSE]	= 7,
 	[IRQ_DA8XX_C0_RX_PULSE]		= 7,
 	[IRQ_DA8XX_C0_TX_PULSE]		= 7,
@@ -1100,26 +1122,26 @@ static u8 da850_default_priorities[DA850_N_CP_INTC_IRQ] = {
 	[IRQ_DA8XX_C1_TX_PULSE]		= 7,
 	[IRQ_DA8XX_C1_MISC_PULSE]	= 7,
 	[IRQ_DA8XX_MEMERR]		= 7,
-	[IRQ_DA8XX_GPIO0]		= 7,
-	[IRQ_DA8XX_GPIO1]		= 7,
-	[IRQ_DA8XX_GPIO2]		= 7,
-	[IRQ_DA8XX_GPIO3]		= 7,
-	[IRQ_DA8XX_GPIO4]		= 7,
-	[IRQ_DA8XX_GPIO5]		= 7,
-	[IRQ_DA8XX_GPIO6]		= 7,
-	[IRQ_DA8XX_GPIO7]		= 7,
-	[IRQ_DA8XX_GPIO8]		= 7,
+	[IRQ_DA8XX_GPIO0]		= 8,
+	[IRQ_DA8XX_GPIO1]		= 8,
+	[IRQ_DA8XX_GPIO2]		= 8,
+	[IRQ_DA8XX_GPIO3]		= 8,
+	[IRQ_DA8XX_GPIO4]		= 8,
+	[IRQ_DA8XX_GPIO5]		= 8,
+	[IRQ_DA8XX_GPIO6]		= 8,
+	[IRQ_DA8XX_GPIO7]		= 8,
+	[IRQ_DA8XX_GPIO8]		= 8,
 	[IRQ_DA8XX_I2CINT1]		= 7,
 	[IRQ_DA8XX_LCDINT]		= 7,
-	[IRQ_DA8XX_UARTINT1]		= 7,
+	[IRQ_DA8XX_UARTINT1]		= 3,
 	[IRQ_DA8XX_MCASPINT]		= 7,
 	[IRQ_DA8XX_ALLINT1]		= 7,
 	[IRQ_DA8XX_SPINT1]		= 7,
 	[IRQ_DA8XX_UHPI_INT1]		= 7,
-	[IRQ_DA8XX_USB_INT]		= 7,
-	[IRQ_DA8XX_IRQN]		= 7,
+	[IRQ_DA8XX_USB_INT]		= 3,
+	[IRQ_DA8XX_IRQN]		= 3,
 	[IRQ_DA8XX_RWAKEUP]		= 7,
-	[IRQ_DA8XX_UARTINT2]		= 7,
+	[IRQ_DA8XX_UARTINT2]		= 3,
 	[IRQ_DA8XX_DFTSSINT]		= 7,
 	[IRQ_DA8XX_EHRPWM0]		= 0, /* Uses FIQ for EV3 sound playback */
 	[IRQ_DA8XX_EHRPWM0TZ]		= 7,
@@ -1142,7 +1164,7 @@ static u8 da850_default_priorities[DA850_N_CP_INTC_IRQ] = {
 	[IRQ_DA850_T12CMPINT5_2]	= 7,
 	[IRQ_DA850_T12CMPINT6_2]	= 7,
 	[IRQ_DA850_T12CMPINT7_2]	= 7,
-	[IRQ_DA850_T12CMPINT0_3]	= 7,
+	[IRQ_DA850_T12CMPINT0_3]	= 2,
 	[IRQ_DA850_T12CMPINT1_3]	= 7,
 	[IRQ_DA850_T12CMPINT2_3]	= 7,
 	[IRQ_DA850_T12CMPINT3_3]	= 7,
@@ -1152,9 +1174,9 @@ static u8 da850_default_priorities[DA850_N_CP_INTC_IRQ] = {
 	[IRQ_DA850_T12CMPINT7_3]	= 7,
 	[IRQ_DA850_RPIINT]		= 7,
 	[IRQ_DA850_VPIFINT]		= 7,
-	[IRQ_DA850_CCINT1]		= 7,
-	[IRQ_DA850_CCERRINT1]		= 7,
-	[IRQ_DA850_TCERRINT2]		= 7,
+	[IRQ_DA850_CCINT1]		= 3,
+	[IRQ_DA850_CCERRINT1]		= 3,
+	[IRQ_DA850_TCERRINT2]		= 3,
 	[IRQ_DA850_TINT12_3]		= 7,
 	[IRQ_DA850_TINT34_3]		= 7,
 	[IRQ_DA850_TINTALL_3]		= 7,
@@ -1178,8 +1200,42 @@ static struct map_desc da850_io_desc[] = {
 		.length		= DA8XX_CP_INTC_SIZE,
 		.type		= MT_DEVICE
 	},
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+	/*
+	 * Cacheable for .sram.text and the SRAM pool, executable only for the
+	 * former. The pool uses this mapping instead of an ioremap().
+	 */
+	{
+		.virtual	= DA8XX_SHARED_RAM_VIRT,
+		.pfn		= __phys_to_pfn(DA8XX_SHARED_RAM_BASE),
+		.length		= SRAM_TEXT_SIZE,
+		.type		= MT_MEMORY_RWX
+	},
+	{
+		.virtual	= DA8XX_SHARED_RAM_VIRT + SRAM_TEXT_SIZE,
+		.pfn		= __phys_to_pfn(DA8XX_SHARED_RAM_BASE +
+						SRAM_TEXT_SIZE),
+		.length		= DA8XX_SHARED_RAM_SIZE - SRAM_TEXT_SIZE,
+		.type		= MT_MEMORY_RW
+	},
+#else
+	/* cacheable, the SRAM pool uses this mapping instead of an ioremap() */
+	{
+		.virtual	= DA8XX_SHARED_RAM_VIRT,
+		.pfn		= __phys_to_pfn(DA8XX_SHARED_RAM_BASE),
+		.length		= DA8XX_SHARED_RAM_SIZE,
+		.type		= MT_MEMORY_RW
+	},
+#endif
 };
 
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+#define DA850_SRAM_RESV	SRAM_TEXT_SIZE
+#else
+#define DA850_SRAM_RESV	0
+#endif
+#define DA850_SRAM_POOL_VIRT	(DA8XX_SHARED_RAM_VIRT + DA850_SRAM_RESV)
+
 static u32 da850_psc_bases[] = { DA8XX_PSC0_BASE, DA8XX_PSC1_BASE };
 
 /* Contents of JTAG ID register used to identify exact cpu type */
@@ -1220,20 +1276,28 @@ static struct davinci_timer_instance da850_timer_instance[4] = {
 		.base		= DA850_TIMER64P3_BASE,
 		.bottom_irq	= IRQ_DA850_TINT12_3,
 		.top_irq	= IRQ_DA850_TINT34_3,
+		.cmp_off	= DA850_TIMER64_CMP12_0,
+		.cmp_irq	= IRQ_DA850_T12CMPINT0_3,
 	},
 };
 
 /*
- * T0_BOT: Timer 0, bottom		: Used for clock_event
  * T0_TOP: Timer 0, top			: Used for clocksource
  * T1_TOP: Timer 1, bottom		: Used for fiqsource - see legoev3-fiq.c
  * T1_BOT and T1_TOP are also used for watchdog
+ * T2_BOT: Timer 2, bottom		: Used by the legoev3-fiq software UART
+ * T3_TOP: Timer 3, top			: Used for the control loop timer
+ * T3_BOT: Timer 3, bottom		: Used for clock_event. Only Timer64P2
+ *					  and P3 have compare interrupts on
+ *					  DA850, so this one runs free and
+ *					  each event is a compare match.
  */
 static struct davinci_timer_info da850_timer_info = {
 	.timers		= da850_timer_instance,
-	.clockevent_id	= T0_BOT,
+	.clockevent_id	= T3_BOT,
 	.clocksource_id	= T0_TOP,
 	.fiqsource_id	= T1_TOP,
+	.looptimer_id	= T3_TOP,
 };
 
 #ifdef CONFIG_CPU_FREQ
@@ -1356,12 +1420,28 @@ static int da850_set_voltage(unsigned int index)
 
 static int da850_regulator_init(void)
 {
+	struct cpufreq_frequency_table *pos;
+	unsigned int uv_min = UINT_MAX, uv_max = 0;
+	struct da850_opp *opp;
+	int ramp;
+
 	cvdd = regulator_get(NULL, "cvdd");
 	if (WARN(IS_ERR(cvdd), "Unable to obtain voltage regulator for CVDD;"
 					" voltage scaling unsupported\n")) {
 		return PTR_ERR(cvdd);
 	}
 
+	/* worst case ramp is between the extremes of the usable OPPs */
+	cpufreq_for_each_entry(pos, cpufreq_info.freq_table) {
+		opp = (struct da850_opp *)pos->driver_data;
+		uv_min = min(uv_min, opp->cvdd_min);
+		uv_max = max(uv_max, opp->cvdd_max);
+	}
+
+	ramp = regulator_set_voltage_time(cvdd, uv_min, uv_max);
+	if (ramp > 0)
+		cpufreq_info.transition_latency += ramp * NSEC_PER_USEC;
+
 	return 0;
 }
 #endif
@@ -1378,6 +1458,9 @@ unsigned int da850_max_speed = 300000;
 
 int da850_register_cpufreq(char *async_clk)
 {
+	struct cpufreq_frequency_table *pos;
+	struct da850_opp *opp;
+	unsigned int relock;
 	int i;
 
 	/* cpufreq driver can help keep an "async" clock constant */
@@ -1391,6 +1474,13 @@ int da850_register_cpufreq(char *async_clk)
 		}
 	}
 
+	cpufreq_for_each_entry(pos, cpufreq_info.freq_table) {
+		opp = (struct da850_opp *)pos->driver_data;
+		relock = davinci_pll_relock_time(opp->prediv) * NSEC_PER_USEC;
+		cpufreq_info.transition_latency =
+			max(cpufreq_info.transition_latency, relock);
+	}
+
 	return platform_device_register(&da850_cpufreq_device);
 }
 
@@ -1589,8 +1679,9 @@ static struct davinci_soc_info davinci_soc_info_da850 = {
 	.intc_irq_num		= DA850_N_CP_INTC_IRQ,
 	.timer_info		= &da850_timer_info,
 	.emac_pdata		= &da8xx_emac_pdata,
-	.sram_dma		= DA8XX_SHARED_RAM_BASE,
-	.sram_len		= SZ_128K,
+	.sram_dma		= DA8XX_SHARED_RAM_BASE + DA850_SRAM_RESV,
+	.sram_virt		= (void *)DA850_SRAM_POOL_VIRT,
+	.sram_len		= DA8XX_SHARED_RAM_SIZE - DA850_SRAM_RESV,
 };
 
 void __init da850_init(void)
@@ -1599,6 +1690,11 @@ void __init da850_init(void)
 
 	davinci_common_init(&davinci_soc_info_da850);
 
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+	BUILD_BUG_ON(SRAM_TEXT_OFFSET != DA8XX_SHARED_RAM_VIRT);
+#endif
+	davinci_sram_text_init();
+
 	da8xx_syscfg0_base = ioremap(DA8XX_SYSCFG0_BASE, SZ_4K);
 	if (WARN(!da8xx_syscfg0_base, "Unable to map syscfg0 module"))
 		return;
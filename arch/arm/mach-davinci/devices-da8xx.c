@@ -141,6 +141,19 @@ static s8 da850_queue_priority_mapping[][2] = {
 	{-1, -1}
 };
 
+/*
+ * Audio and the SPI0 converters run on the high priority queue so that they
+ * are not held up behind bulk MMC and SPI1 flash transfers on queue 1.
+ */
+static const s16 da850_edma0_chan_queue_mapping[][2] = {
+	/* {channel, event queue no} */
+	{0, EVENTQ_0},	/* McASP0 rx */
+	{1, EVENTQ_0},	/* McASP0 tx */
+	{14, EVENTQ_0},	/* SPI0 rx */
+	{15, EVENTQ_0},	/* SPI0 tx */
+	{-1, -1}
+};
+
 static struct edma_soc_info da8xx_edma0_pdata = {
 	.queue_priority_mapping	= da8xx_queue_priority_mapping,
 	.default_queue		= EVENTQ_1,
@@ -268,6 +281,10 @@ static const struct dma_slave_map da850_edma0_map[] = {
 	{ "da830-mmc.0", "tx", EDMA_FILTER_PARAM(0, 17) },
 	{ "spi_davinci.1", "rx", EDMA_FILTER_PARAM(0, 18) },
 	{ "spi_davinci.1", "tx", EDMA_FILTER_PARAM(0, 19) },
+	{ "i2c_davinci.1", "rx", EDMA_FILTER_PARAM(0, 24) },
+	{ "i2c_davinci.1", "tx", EDMA_FILTER_PARAM(0, 25) },
+	{ "i2c_davinci.2", "rx", EDMA_FILTER_PARAM(0, 26) },
+	{ "i2c_davinci.2", "tx", EDMA_FILTER_PARAM(0, 27) },
 };
 
 static const struct dma_slave_map da850_edma1_map[] = {
@@ -286,6 +303,7 @@ int __init da850_register_edma(struct edma_rsv_info *rsv[2])
 
 	da8xx_edma0_pdata.slave_map = da850_edma0_map;
 	da8xx_edma0_pdata.slavecnt = ARRAY_SIZE(da850_edma0_map);
+	da8xx_edma0_pdata.chan_queue_mapping = da850_edma0_chan_queue_mapping;
 
 	edma_pdev = platform_device_register_full(&da8xx_edma0_device);
 	if (IS_ERR(edma_pdev)) {
@@ -664,6 +682,22 @@ int __init da8xx_register_uio_pruss(void)
 	return platform_device_register(&da8xx_uio_pruss_dev);
 }
 
+/* shares the PRUSS with pruss_uio, boards must register only one of them */
+static struct platform_device da8xx_pru_rproc_dev = {
+	.name		= "da8xx-pru-rproc",
+	.id		= -1,
+	.num_resources	= ARRAY_SIZE(da8xx_pruss_resources),
+	.resource	= da8xx_pruss_resources,
+	.dev		= {
+		.coherent_dma_mask	= DMA_BIT_MASK(32),
+	}
+};
+
+int __init da8xx_register_pru_rproc(void)
+{
+	return platform_device_register(&da8xx_pru_rproc_dev);
+}
+
 static struct lcd_ctrl_config lcd_cfg = {
 	.panel_shade		= COLOR_ACTIVE,
 	.bpp			= 16,
@@ -35,6 +35,7 @@ struct davinci_timer_info {
 	unsigned int			clockevent_id;
 	unsigned int			clocksource_id;
 	unsigned int			fiqsource_id;
+	unsigned int			looptimer_id;	/* 0 if none */
 };
 
 struct davinci_gpio_controller;
@@ -75,6 +76,8 @@ struct davinci_soc_info {
 	int				gpio_ctlrs_num;
 	struct emac_platform_data	*emac_pdata;
 	dma_addr_t			sram_dma;
+	/* static mapping of sram_dma, if NULL it is ioremap()ed */
+	void				*sram_virt;
 	unsigned			sram_len;
 };
 
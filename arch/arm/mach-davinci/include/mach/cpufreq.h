@@ -17,10 +17,20 @@
 
 #include <linux/cpufreq.h>
 
+/**
+ * struct davinci_cpufreq_config - platform data for davinci-cpufreq
+ * @freq_table: supported OPPs, fastest first
+ * @set_voltage: switch the CPU supply to the voltage of an OPP
+ * @init: platform specific setup, run before the policy is initialized
+ * @transition_latency: worst case time for a switch between any two OPPs,
+ *	PLL relock and voltage ramp included, in ns. The driver refines it
+ *	with the switches it times and falls back to 2 ms when this is 0.
+ */
 struct davinci_cpufreq_config {
 	struct cpufreq_frequency_table *freq_table;
 	int (*set_voltage) (unsigned int index);
 	int (*init) (void);
+	unsigned int transition_latency;
 };
 
 #endif
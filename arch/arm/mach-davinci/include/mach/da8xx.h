@@ -72,6 +72,8 @@ extern unsigned int da850_max_speed;
 #define DA8XX_PLL0_BASE		0x01c11000
 #define DA8XX_TIMER64P0_BASE	0x01c20000
 #define DA8XX_TIMER64P1_BASE	0x01c21000
+#define DA850_TIMER64P2_BASE	0x01f0c000
+#define DA850_TIMER64P3_BASE	0x01f0d000
 #define DA8XX_VPIF_BASE		0x01e17000
 #define DA8XX_GPIO_BASE		0x01e26000
 #define DA8XX_PSC1_BASE		0x01e27000
@@ -84,6 +86,12 @@ extern unsigned int da850_max_speed;
 #define DA8XX_AEMIF_CS3_BASE	0x62000000
 #define DA8XX_AEMIF_CTL_BASE	0x68000000
 #define DA8XX_SHARED_RAM_BASE	0x80000000
+#define DA8XX_SHARED_RAM_SIZE	SZ_128K
+/*
+ * The shared RAM is statically mapped just below the cp_intc so that it is
+ * present in every page table and can be used from FIQ context.
+ */
+#define DA8XX_SHARED_RAM_VIRT	(DA8XX_CP_INTC_VIRT - DA8XX_SHARED_RAM_SIZE)
 #define DA8XX_ARM_RAM_BASE	0xffff0000
 
 void da830_init(void);
@@ -103,6 +111,7 @@ int da8xx_register_usb11_phy_clk(bool use_usb_refclkin);
 int da850_register_sata_refclk(int rate);
 int da8xx_register_emac(void);
 int da8xx_register_uio_pruss(void);
+int da8xx_register_pru_rproc(void);
 int da8xx_register_lcdc(struct da8xx_lcdc_platform_data *pdata);
 int da8xx_register_mmcsd0(struct davinci_mmc_config *config);
 int da850_register_mmcsd1(struct davinci_mmc_config *config);
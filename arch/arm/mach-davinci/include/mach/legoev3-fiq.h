@@ -14,6 +14,7 @@
 #define __MACH_LEGOEV3_FIQ_H
 
 #include <linux/i2c.h>
+#include <linux/legoev3_fiq.h>
 #include <mach/legoev3.h>
 #include <sound/pcm.h>
 
@@ -27,6 +28,10 @@
  * @ehrowm_mem_size: Size of EHROWM memory.
  * @timer_irq: Timer interrupt for I2C callback.
  * @ehrpwm_irq: EHRPWM interrupt for sound callback.
+ * @uart_timer_mem_base: Base memory address of the timer used for the
+ *	software UART. 0 if there is none.
+ * @uart_timer_mem_size: Size of UART timer memory.
+ * @uart_timer_irq: Interrupt of the UART timer.
  * @status_gpio: GPIO that is not physically connected that can be used to
  *	to generate interrupts so that the FIQ can notify external code
  *	that its status has changed.
@@ -40,26 +45,90 @@ struct legoev3_fiq_platform_data {
 	unsigned ehrpwm_mem_size;
 	unsigned timer_irq;
 	unsigned ehrpwm_irq;
+	unsigned uart_timer_mem_base;
+	unsigned uart_timer_mem_size;
+	unsigned uart_timer_irq;
 	int status_gpio;
 };
 
+/* Number of cp_intc channels that are routed to nFIQ */
+#define LEGOEV3_FIQ_NUM_CHANNELS	2
+
+typedef void (*legoev3_fiq_handler_t)(void *data);
+
+extern int legoev3_fiq_request_irq(unsigned irq, unsigned channel,
+				   legoev3_fiq_handler_t handler, void *data);
+extern void legoev3_fiq_free_irq(unsigned irq);
+extern void legoev3_fiq_enable_irq(unsigned irq);
+extern void legoev3_fiq_disable_irq(unsigned irq);
+extern int legoev3_fiq_get_busy_ns(u64 *ns);
+
+/* Maximum number of messages in a single legoev3_fiq_start_xfer() call. */
+#define LEGOEV3_FIQ_I2C_MAX_MSGS	4
+/* Maximum message length for legoev3_fiq_start_periodic(). */
+#define LEGOEV3_FIQ_I2C_PERIODIC_MAX_LEN	LEGOEV3_FIQ_PERIODIC_MAX_LEN
+
+/* Flags for legoev3_fiq_ehrpwm_set_filter() */
+#define LEGOEV3_FIQ_EHRPWM_INTERPOLATE	BIT(0)
+#define LEGOEV3_FIQ_EHRPWM_NOISE_SHAPE	BIT(1)
+
 extern int legoev3_fiq_request_port(enum legoev3_input_port_id port_id,
 				    int sda_pin, int scl_pin);
 extern void legoev3_fiq_release_port(enum legoev3_input_port_id port_id);
+extern int legoev3_fiq_set_clock_div(enum legoev3_input_port_id port_id,
+				     unsigned clock_div);
+extern int legoev3_fiq_set_clock_stretch(enum legoev3_input_port_id port_id,
+					 unsigned timeout_us);
+extern int legoev3_fiq_set_retries(enum legoev3_input_port_id port_id,
+				   unsigned retries);
 extern int legoev3_fiq_start_xfer(enum legoev3_input_port_id port_id,
 				  struct i2c_msg msgs[], int num_msg,
 				  void (*complete)(int, void *), void *context);
 extern void legoev3_fiq_cancel_xfer(enum legoev3_input_port_id port_id);
+extern int legoev3_fiq_start_periodic(enum legoev3_input_port_id port_id,
+				      struct i2c_msg msgs[], int num_msg,
+				      unsigned period_us);
+extern void legoev3_fiq_stop_periodic(enum legoev3_input_port_id port_id);
+extern int legoev3_fiq_read_periodic(enum legoev3_input_port_id port_id,
+				     u8 *buf, unsigned len, unsigned *seq);
+extern const struct legoev3_fiq_periodic_slot *
+legoev3_fiq_get_periodic_slot(enum legoev3_input_port_id port_id);
+typedef void (*legoev3_fiq_periodic_notify_t)(void *context, unsigned seq,
+					      u32 age_ns);
+extern int legoev3_fiq_set_periodic_notify(enum legoev3_input_port_id port_id,
+					   legoev3_fiq_periodic_notify_t notify,
+					   void *context);
+extern int legoev3_fiq_request_encoder(enum legoev3_output_port_id port_id,
+				       int int_pin, int dir_pin);
+extern void legoev3_fiq_release_encoder(enum legoev3_output_port_id port_id);
+extern int legoev3_fiq_read_encoder(enum legoev3_output_port_id port_id,
+				    s32 *position, u32 *timestamp, u32 *missed);
+/* Baud rates supported by the software UART */
+#define LEGOEV3_FIQ_UART_MIN_BAUD	2400
+#define LEGOEV3_FIQ_UART_MAX_BAUD	57600
+
+extern int legoev3_fiq_uart_request(enum legoev3_input_port_id port_id,
+				    int rx_pin, unsigned baud,
+				    void (*rx_callback)(void *), void *context);
+extern void legoev3_fiq_uart_release(enum legoev3_input_port_id port_id);
+extern int legoev3_fiq_uart_set_baud(enum legoev3_input_port_id port_id,
+				     unsigned baud);
+extern int legoev3_fiq_uart_read(enum legoev3_input_port_id port_id, u8 *buf,
+				 unsigned len);
 extern int legoev3_fiq_ehrpwm_request(void);
 extern void legoev3_fiq_ehrpwm_release(void);
 extern int legoev3_fiq_ehrpwm_prepare(struct snd_pcm_substream *substream,
 				      int volume, unsigned char int_period,
 				      void (*period_elapsed)(void *),
 				      void *context);
+extern int legoev3_fiq_ehrpwm_set_filter(unsigned flags);
+extern int legoev3_fiq_ehrpwm_set_decimate(unsigned factor);
 extern void legoev3_fiq_ehrpwm_ramp(struct snd_pcm_substream *substream,
 				    int direction, unsigned ramp_ms);
 extern unsigned legoev3_fiq_ehrpwm_get_playback_ptr(void);
 extern void legoev3_fiq_ehrpwm_set_volume(int volume);
+extern unsigned legoev3_fiq_ehrpwm_get_period_ticks(void);
+extern phys_addr_t legoev3_fiq_ehrpwm_get_duty_reg(void);
 extern int legoev3_fiq_ehrpwm_int_enable(void);
 extern int legoev3_fiq_ehrpwm_int_disable(void);
 extern bool legoev3_fiq_ehrpwm_int_is_enabled(void);
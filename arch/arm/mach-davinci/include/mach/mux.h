@@ -1174,10 +1174,29 @@ enum davinci_da850_index {
 
 #define PINMUX(x)		(4 * (x))
 
+/**
+ * struct davinci_mux_state - pin mux setting resolved ahead of time
+ * @reg: Offset of the PINMUX register.
+ * @mask: Bits of the register that belong to the pin.
+ * @val: Value of these bits for the setting.
+ *
+ * Filled by davinci_mux_state_init() from a mux table index, so that
+ * davinci_mux_state_apply() is a single register update without any
+ * table lookup, e.g. for pins that are switched at run time.
+ */
+struct davinci_mux_state {
+	unsigned int reg;
+	u32 mask;
+	u32 val;
+};
+
 #ifdef CONFIG_DAVINCI_MUX
 /* setup pin muxing */
 extern int davinci_cfg_reg(unsigned long reg_cfg);
 extern int davinci_cfg_reg_list(const short pins[]);
+extern int davinci_mux_state_init(struct davinci_mux_state *state,
+				  unsigned long reg_cfg);
+extern void davinci_mux_state_apply(const struct davinci_mux_state *state);
 #else
 /* boot loader does it all (no warnings from CONFIG_DAVINCI_MUX_WARNINGS) */
 static inline int davinci_cfg_reg(unsigned long reg_cfg) { return 0; }
@@ -1185,6 +1204,16 @@ static inline int davinci_cfg_reg_list(const short pins[])
 {
 	return 0;
 }
+static inline int davinci_mux_state_init(struct davinci_mux_state *state,
+					 unsigned long reg_cfg)
+{
+	state->mask = 0;
+	return 0;
+}
+static inline void
+davinci_mux_state_apply(const struct davinci_mux_state *state)
+{
+}
 #endif
 
 #endif /* __INC_MACH_MUX_H */
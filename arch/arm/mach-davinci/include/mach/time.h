@@ -11,6 +11,8 @@
 #ifndef __ARCH_ARM_MACH_DAVINCI_TIME_H
 #define __ARCH_ARM_MACH_DAVINCI_TIME_H
 
+#include <linux/errno.h>
+
 #define DAVINCI_TIMER0_BASE		(IO_PHYS + 0x21400)
 #define DAVINCI_TIMER1_BASE		(IO_PHYS + 0x21800)
 #define DAVINCI_WDOG_BASE		(IO_PHYS + 0x21C00)
@@ -20,16 +22,49 @@ enum {
 	T0_TOP,
 	T1_BOT,
 	T1_TOP,
+	T2_BOT,
+	T2_TOP,
+	T3_BOT,
+	T3_TOP,
 	NUM_TIMERS
 };
 
-#define IS_TIMER1(id)		(id & 0x2)
-#define IS_TIMER0(id)		(!IS_TIMER1(id))
 #define IS_TIMER_TOP(id)	((id & 0x1))
 #define IS_TIMER_BOT(id)	(!IS_TIMER_TOP(id))
 
-#define ID_TO_TIMER(id)		(IS_TIMER1(id) != 0)
+#define ID_TO_TIMER(id)		((id) >> 1)
+#define NUM_TIMER64		(NUM_TIMERS / 2)
 
 extern struct davinci_timer_instance davinci_timer_instance[];
 
+extern u32 davinci_timer_read_freerun(void);
+extern u32 davinci_timer_read_fiqsource(void);
+extern unsigned int davinci_timer_get_tick_rate(void);
+
+#ifdef CONFIG_DAVINCI_LOOP_TIMER
+extern int davinci_looptimer_dma_request(void);
+extern void davinci_looptimer_dma_release(void);
+extern int davinci_looptimer_request_irq(void (*handler)(void *), void *data);
+extern void davinci_looptimer_free_irq(void);
+extern int davinci_looptimer_start(unsigned int hz);
+extern void davinci_looptimer_stop(void);
+#else
+static inline int davinci_looptimer_dma_request(void)
+{
+	return -ENODEV;
+}
+static inline void davinci_looptimer_dma_release(void) { }
+static inline int davinci_looptimer_request_irq(void (*handler)(void *),
+						void *data)
+{
+	return -ENODEV;
+}
+static inline void davinci_looptimer_free_irq(void) { }
+static inline int davinci_looptimer_start(unsigned int hz)
+{
+	return -ENODEV;
+}
+static inline void davinci_looptimer_stop(void) { }
+#endif
+
 #endif /* __ARCH_ARM_MACH_DAVINCI_TIME_H */
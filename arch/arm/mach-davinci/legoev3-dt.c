@@ -7,10 +7,19 @@
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
  */
+#include <linux/init.h>
+#include <linux/interrupt.h>
 #include <linux/io.h>
+#include <linux/irq.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
 #include <linux/of_irq.h>
 #include <linux/of_platform.h>
 #include <linux/irqdomain.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/sched/types.h>
 #include <linux/platform_data/legoev3.h>
 #include <linux/platform_data/legoev3_i2c.h>
 
@@ -27,6 +36,44 @@
 
 #define DA8XX_EHRPWM0_BASE	0x01F00000
 
+#define EV3_INPUT_PORT(n, tty) {				\
+	.id		= EV3_PORT_IN##n,			\
+	.pin1_gpio	= EV3_IN##n##_PIN1_PIN,			\
+	.pin2_gpio	= EV3_IN##n##_PIN2_PIN,			\
+	.pin5_gpio	= EV3_IN##n##_PIN5_PIN,			\
+	.pin6_gpio	= EV3_IN##n##_PIN6_PIN,			\
+	.buf_ena_gpio	= EV3_IN##n##_BUF_ENA_PIN,		\
+	.i2c_clk_gpio	= EV3_IN##n##_I2C_CLK_PIN,		\
+	.i2c_pin_mux	= EV3_IN##n##_I2C_CLK,			\
+	.uart_pin_mux	= EV3_IN##n##_UART_TXD,			\
+	.uart_tty	= tty,					\
+}
+
+#define EV3_OUTPUT_PORT(n) {					\
+	.id		= EV3_PORT_OUT##n,			\
+	.pin1_gpio	= EV3_OUT##n##_PIN1_PIN,		\
+	.pin2_gpio	= EV3_OUT##n##_PIN2_PIN,		\
+	.pin5_gpio	= EV3_OUT##n##_PIN5_PIN,		\
+	.pin5_int_gpio	= EV3_OUT##n##_PIN5_INT_PIN,	\
+	.pin6_dir_gpio	= EV3_OUT##n##_PIN6_DIR_PIN,	\
+}
+
+/* the UARTs of ports 3 and 4 are on McASP pins, for a PRU soft UART */
+static struct legoev3_ports_platform_data legoev3_ports_data = {
+	.input_port_data = {
+		[EV3_PORT_IN1] = EV3_INPUT_PORT(1, "ttyS1"),
+		[EV3_PORT_IN2] = EV3_INPUT_PORT(2, "ttyS0"),
+		[EV3_PORT_IN3] = EV3_INPUT_PORT(3, NULL),
+		[EV3_PORT_IN4] = EV3_INPUT_PORT(4, NULL),
+	},
+	.output_port_data = {
+		[EV3_PORT_OUT1] = EV3_OUTPUT_PORT(1),
+		[EV3_PORT_OUT2] = EV3_OUTPUT_PORT(2),
+		[EV3_PORT_OUT3] = EV3_OUTPUT_PORT(3),
+		[EV3_PORT_OUT4] = EV3_OUTPUT_PORT(4),
+	},
+};
+
 static struct of_dev_auxdata da850_auxdata_lookup[] __initdata = {
 	OF_DEV_AUXDATA("ti,davinci-i2c", 0x01c22000, "i2c_davinci.1", NULL),
 	OF_DEV_AUXDATA("ti,davinci-wdt", 0x01c21000, "davinci-wdt", NULL),
@@ -46,6 +93,8 @@ static struct of_dev_auxdata da850_auxdata_lookup[] __initdata = {
 	OF_DEV_AUXDATA("ti,da830-ohci", 0x01e25000, "ohci-da8xx", NULL),
 	OF_DEV_AUXDATA("ti,da830-musb", 0x01e00000, "musb-da8xx", NULL),
 	OF_DEV_AUXDATA("ti,da830-usb-phy", 0x01c1417c, "da8xx-usb-phy", NULL),
+	OF_DEV_AUXDATA("lego,ev3-ports", 0, "legoev3-ports",
+		       &legoev3_ports_data),
 	{}
 };
 
@@ -58,6 +107,9 @@ static struct legoev3_fiq_platform_data legoev3_in_port_i2c_platform_data = {
 	.ehrpwm_mem_size	= 0x1FFF,
 	.timer_irq		= IRQ_DA8XX_TINT34_1,
 	.ehrpwm_irq		= IRQ_DA8XX_EHRPWM0,
+	.uart_timer_mem_base	= DA850_TIMER64P2_BASE,
+	.uart_timer_mem_size	= 0x100,
+	.uart_timer_irq		= IRQ_DA850_TINTALL_2,
 	.status_gpio		= EV3_FIQ_STAT_PIN,
 };
 
@@ -69,61 +121,127 @@ static struct platform_device legoev3_in_port_i2c_fiq = {
 	},
 };
 
-static struct i2c_legoev3_platform_data legoev3_i2c3_data = {
-	.sda_pin	= EV3_IN1_PIN6_PIN,
-	.scl_pin	= EV3_IN1_I2C_CLK_PIN,
-	.port_id	= EV3_PORT_IN1,
-};
-
-static struct platform_device legoev3_i2c3_device = {
-	.name	= "i2c-legoev3",
-	.dev	= {
-		.platform_data	= &legoev3_i2c3_data,
+static const struct i2c_legoev3_platform_data
+legoev3_in_port_i2c_data[NUM_EV3_PORT_IN] = {
+	[EV3_PORT_IN1] = {
+		.sda_pin	= EV3_IN1_PIN6_PIN,
+		.scl_pin	= EV3_IN1_I2C_CLK_PIN,
+		.port_id	= EV3_PORT_IN1,
+		.class		= I2C_CLASS_LEGOEV3,
+	},
+	[EV3_PORT_IN2] = {
+		.sda_pin	= EV3_IN2_PIN6_PIN,
+		.scl_pin	= EV3_IN2_I2C_CLK_PIN,
+		.port_id	= EV3_PORT_IN2,
+		.class		= I2C_CLASS_LEGOEV3,
+	},
+	[EV3_PORT_IN3] = {
+		.sda_pin	= EV3_IN3_PIN6_PIN,
+		.scl_pin	= EV3_IN3_I2C_CLK_PIN,
+		.port_id	= EV3_PORT_IN3,
+		.class		= I2C_CLASS_LEGOEV3,
+	},
+	[EV3_PORT_IN4] = {
+		.sda_pin	= EV3_IN4_PIN6_PIN,
+		.scl_pin	= EV3_IN4_I2C_CLK_PIN,
+		.port_id	= EV3_PORT_IN4,
+		.class		= I2C_CLASS_LEGOEV3,
 	},
-	.id	= 3,
 };
 
-static struct i2c_legoev3_platform_data legoev3_i2c4_data = {
-	.sda_pin	= EV3_IN2_PIN6_PIN,
-	.scl_pin	= EV3_IN2_I2C_CLK_PIN,
-	.port_id	= EV3_PORT_IN2,
-};
+/* The adapters keep the bus numbers they had when they were static. */
+#define LEGOEV3_IN_PORT_I2C_BUS(port_id)	((port_id) + 3)
 
-static struct platform_device legoev3_i2c4_device = {
-	.name	= "i2c-legoev3",
-	.dev	= {
-		.platform_data	= &legoev3_i2c4_data,
-	},
-	.id	= 4,
-};
+static struct platform_device *legoev3_in_port_i2c_devices[NUM_EV3_PORT_IN];
+static DEFINE_MUTEX(legoev3_in_port_i2c_lock);
 
-static struct i2c_legoev3_platform_data legoev3_i2c5_data = {
-	.sda_pin	= EV3_IN3_PIN6_PIN,
-	.scl_pin	= EV3_IN3_I2C_CLK_PIN,
-	.port_id	= EV3_PORT_IN3,
-};
+/**
+ * legoev3_register_in_port_i2c - Create the I2C adapter of an input port.
+ * @port_id: The input port identifier.
+ *
+ * Each i2c-legoev3 adapter owns its FIQ port for as long as it exists, so
+ * they are only created once a sensor has been detected on the port. That
+ * way, empty ports don't take any FIQ time.
+ *
+ * Returns 0 on success, -EBUSY if the adapter already exists or another
+ * negative error code.
+ */
+int legoev3_register_in_port_i2c(enum legoev3_input_port_id port_id)
+{
+	struct platform_device *pdev;
+	int ret = 0;
 
-static struct platform_device legoev3_i2c5_device = {
-	.name	= "i2c-legoev3",
-	.dev	= {
-		.platform_data	= &legoev3_i2c5_data,
-	},
-	.id	= 5,
-};
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
 
-static struct i2c_legoev3_platform_data legoev3_i2c6_data = {
-	.sda_pin	= EV3_IN4_PIN6_PIN,
-	.scl_pin	= EV3_IN4_I2C_CLK_PIN,
-	.port_id	= EV3_PORT_IN4,
-};
+	mutex_lock(&legoev3_in_port_i2c_lock);
+	if (legoev3_in_port_i2c_devices[port_id]) {
+		ret = -EBUSY;
+		goto out;
+	}
+	pdev = platform_device_register_data(NULL, "i2c-legoev3",
+				LEGOEV3_IN_PORT_I2C_BUS(port_id),
+				&legoev3_in_port_i2c_data[port_id],
+				sizeof(legoev3_in_port_i2c_data[port_id]));
+	if (IS_ERR(pdev)) {
+		ret = PTR_ERR(pdev);
+		goto out;
+	}
+	legoev3_in_port_i2c_devices[port_id] = pdev;
+out:
+	mutex_unlock(&legoev3_in_port_i2c_lock);
 
-static struct platform_device legoev3_i2c6_device = {
-	.name	= "i2c-legoev3",
-	.dev	= {
-		.platform_data	= &legoev3_i2c6_data,
-	},
-	.id	= 6,
-};
+	return ret;
+}
+EXPORT_SYMBOL_GPL(legoev3_register_in_port_i2c);
+
+/**
+ * legoev3_unregister_in_port_i2c - Remove the I2C adapter of an input port.
+ * @port_id: The input port identifier.
+ *
+ * This is called when the sensor has been disconnected. It is safe to call
+ * if the adapter does not exist.
+ */
+void legoev3_unregister_in_port_i2c(enum legoev3_input_port_id port_id)
+{
+	if (port_id >= NUM_EV3_PORT_IN)
+		return;
+
+	mutex_lock(&legoev3_in_port_i2c_lock);
+	if (legoev3_in_port_i2c_devices[port_id]) {
+		platform_device_unregister(legoev3_in_port_i2c_devices[port_id]);
+		legoev3_in_port_i2c_devices[port_id] = NULL;
+	}
+	mutex_unlock(&legoev3_in_port_i2c_lock);
+}
+EXPORT_SYMBOL_GPL(legoev3_unregister_in_port_i2c);
+
+/*
+ * The adapters are only created on demand by legoev3-ports, which needs a
+ * "lego,ev3-ports" node in the device tree. Without it, all four are
+ * created at boot like they used to be.
+ */
+static void __init legoev3_register_in_port_i2c_all(void)
+{
+	struct device_node *np;
+	int i, ret;
+
+	if (IS_ENABLED(CONFIG_LEGOEV3_PORTS)) {
+		np = of_find_compatible_node(NULL, NULL, "lego,ev3-ports");
+		if (np && of_device_is_available(np)) {
+			of_node_put(np);
+			return;
+		}
+		of_node_put(np);
+	}
+
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		ret = legoev3_register_in_port_i2c(i);
+		if (ret)
+			pr_warn("%s: in%d I2C adapter registration failed: %d\n",
+				__func__, i + 1, ret);
+	}
+}
 
 static struct legoev3_bluetooth_platform_data legoev3_bt_pdata = {
 	.pic_ena_gpio		= EV3_PIC_ENA_PIN,
@@ -143,12 +261,227 @@ static struct platform_device legoev3_bt_device = {
 
 static struct pwm_lookup legoev3_pwm_lookup[] = {
 	PWM_LOOKUP("ecap.2",   0, "legoev3-bluetooth", NULL, 0, PWM_POLARITY_INVERSED),
+	/* motor H-bridges, 10 kHz */
+	PWM_LOOKUP("ehrpwm.1", 1, "legoev3-motor.0", NULL, 100000, PWM_POLARITY_NORMAL),
+	PWM_LOOKUP("ehrpwm.1", 0, "legoev3-motor.1", NULL, 100000, PWM_POLARITY_NORMAL),
+	PWM_LOOKUP("ecap.0",   0, "legoev3-motor.2", NULL, 100000, PWM_POLARITY_NORMAL),
+	PWM_LOOKUP("ecap.1",   0, "legoev3-motor.3", NULL, 100000, PWM_POLARITY_NORMAL),
+};
+
+/*
+ * The motors are children of the ports device, if there is one, so that they
+ * can get the pin 5 ADC channels listed in its node.
+ */
+static void __init legoev3_register_motors(void)
+{
+	const struct ev3_output_port_platform_data *pdata;
+	struct platform_device *ports = NULL;
+	struct platform_device *pdev;
+	struct device_node *np;
+	int i;
+
+	np = of_find_compatible_node(NULL, NULL, "lego,ev3-ports");
+	if (np) {
+		ports = of_find_device_by_node(np);
+		of_node_put(np);
+	}
+
+	for (i = 0; i < NUM_EV3_PORT_OUT; i++) {
+		pdata = &legoev3_ports_data.output_port_data[i];
+		pdev = platform_device_register_resndata(
+				ports ? &ports->dev : NULL, "legoev3-motor", i,
+				NULL, 0, pdata, sizeof(*pdata));
+		if (IS_ERR(pdev))
+			pr_warn("%s: registering motor %d failed: %ld\n",
+				__func__, i, PTR_ERR(pdev));
+	}
+
+	/* the children hold their own references */
+	if (ports)
+		put_device(&ports->dev);
+}
+
+#ifdef CONFIG_LEGOEV3_IRQ_THREADS
+/*
+ * SCHED_FIFO priorities of the interrupt threads, by prefix of the name the
+ * handler was requested with. The core creates all of them at 50, so the
+ * sensor path goes above that and bulk I/O below.
+ */
+static const struct {
+	const char *name;
+	int prio;
+} legoev3_irq_thread_prios[] __initconst = {
+	{ "legoev3-fiq",	85 },	/* input port status GPIO */
+	{ "spi_davinci.0",	80 },	/* analog inputs on the ADC */
+	{ "1c00000.edma_ccint",	75 },	/* EDMA0, used by SPI0 */
+	{ "ttyS",		60 },	/* UART sensors */
+	{ "mmc",		30 },
+	{ "musb-hdrc",		25 },
+	{ "ohci_hcd",		25 },
 };
 
+static void __init legoev3_set_irq_thread_prio(struct task_struct *thread,
+					       int prio)
+{
+	struct sched_param param = { .sched_priority = prio };
+
+	if (thread)
+		sched_setscheduler_nocheck(thread, SCHED_FIFO, &param);
+}
+
+static int __init legoev3_irq_threads_init(void)
+{
+	struct irqaction *action;
+	struct irq_desc *desc;
+	unsigned int irq;
+	int i;
+
+	if (!of_machine_is_compatible("lego,ev3"))
+		return 0;
+
+	for_each_irq_desc(irq, desc) {
+		/* keeps the actions and their threads from going away */
+		mutex_lock(&desc->request_mutex);
+		for (action = desc->action; action; action = action->next) {
+			for (i = 0; i < ARRAY_SIZE(legoev3_irq_thread_prios);
+			     i++) {
+				const char *name =
+					legoev3_irq_thread_prios[i].name;
+				int prio = legoev3_irq_thread_prios[i].prio;
+
+				if (strncmp(action->name, name, strlen(name)))
+					continue;
+				legoev3_set_irq_thread_prio(action->thread,
+							    prio);
+				if (action->secondary)
+					legoev3_set_irq_thread_prio(
+						action->secondary->thread,
+						prio);
+				break;
+			}
+		}
+		mutex_unlock(&desc->request_mutex);
+	}
+
+	return 0;
+}
+late_initcall_sync(legoev3_irq_threads_init);
+#endif
+
+static void legoev3_register_bt_device(void)
+{
+	int ret;
+
+	ret = platform_device_register(&legoev3_bt_device);
+	if (ret)
+		pr_warn("%s: registering on-board bluetooth failed: %d\n",
+			__func__, ret);
+}
+
+#ifdef CONFIG_LEGOEV3_DEFER_DEVICES
+/*
+ * Bluetooth and the USB 1.1 host aren't needed to start a program, but
+ * resetting the Bluetooth module and bringing up the OHCI root hub take a
+ * good part of the boot. They are registered from a work item once the
+ * initcalls are done instead, while init is already starting.
+ */
+static unsigned int defer_ms = 1000;
+module_param(defer_ms, uint, 0444);
+MODULE_PARM_DESC(defer_ms,
+	"Delay after the initcalls before Bluetooth and USB 1.1 host are registered (ms)");
+
+static struct device_node *legoev3_ohci_np;
+
+/* Keeps of_platform_default_populate() from creating the OHCI device */
+static void __init legoev3_defer_ohci(void)
+{
+	struct device_node *np;
+
+	np = of_find_compatible_node(NULL, NULL, "ti,da830-ohci");
+	if (!np)
+		return;
+
+	if (!of_device_is_available(np)) {
+		of_node_put(np);
+		return;
+	}
+
+	of_node_set_flag(np, OF_POPULATED);
+	legoev3_ohci_np = np;
+}
+
+static void legoev3_register_ohci_device(void)
+{
+	struct device_node *np = legoev3_ohci_np;
+	struct platform_device *bus;
+
+	if (!np)
+		return;
+
+	bus = of_find_device_by_node(np->parent);
+
+	of_node_clear_flag(np, OF_POPULATED);
+	if (!of_platform_device_create(np, "ohci-da8xx",
+				       bus ? &bus->dev : NULL))
+		pr_warn("%s: registering USB 1.1 host failed\n", __func__);
+
+	if (bus)
+		put_device(&bus->dev);
+	of_node_put(np);
+	legoev3_ohci_np = NULL;
+}
+
+static void legoev3_deferred_devices_work_fn(struct work_struct *work)
+{
+	legoev3_register_ohci_device();
+	legoev3_register_bt_device();
+}
+
+static DECLARE_DELAYED_WORK(legoev3_deferred_devices_work,
+			    legoev3_deferred_devices_work_fn);
+
+static int __init legoev3_deferred_devices_init(void)
+{
+	if (!of_machine_is_compatible("lego,ev3"))
+		return 0;
+
+	queue_delayed_work(system_unbound_wq, &legoev3_deferred_devices_work,
+			   msecs_to_jiffies(defer_ms));
+
+	return 0;
+}
+late_initcall_sync(legoev3_deferred_devices_init);
+#else
+static inline void legoev3_defer_ohci(void)
+{
+}
+#endif
+
+/*
+ * With initcall_debug, the steps of legoev3_init_machine() are timed next to
+ * the initcall and probe times reported by the core.
+ */
+static ktime_t __init legoev3_boot_step(const char *step, ktime_t start)
+{
+	ktime_t now = ktime_get();
+
+	if (initcall_debug)
+		pr_info("legoev3: %s took %lld usecs\n", step,
+			ktime_us_delta(now, start));
+
+	return now;
+}
+
 static void __init legoev3_init_machine(void)
 {
+	ktime_t t = ktime_get();
 	int ret;
 
+#ifdef CONFIG_LEGOEV3_IRQ_THREADS
+	/* before any driver requests its interrupt */
+	force_irqthreads = true;
+#endif
+
 	ret = da8xx_register_usb20_phy_clk(false);
 	if (ret)
 		pr_warn("%s: registering USB 2.0 PHY clock failed: %d",
@@ -157,41 +490,42 @@ static void __init legoev3_init_machine(void)
 	if (ret)
 		pr_warn("%s: registering USB 1.1 PHY clock failed: %d",
 			__func__, ret);
+	t = legoev3_boot_step("USB PHY clocks", t);
 
+	legoev3_defer_ohci();
 	of_platform_default_populate(NULL, da850_auxdata_lookup, NULL);
-	davinci_pm_init();
+	t = legoev3_boot_step("device tree population", t);
 
-	pwm_add_table(legoev3_pwm_lookup, ARRAY_SIZE(legoev3_pwm_lookup));
+	davinci_pm_init();
 
-	ret = platform_device_register(&legoev3_in_port_i2c_fiq);
+	ret = da8xx_register_cpuidle();
 	if (ret)
-		pr_warn("%s: FIQ I2C backend registration failed: %d\n", 
+		pr_warn("%s: cpuidle registration failed: %d\n",
 			__func__, ret);
+	t = legoev3_boot_step("power management", t);
 
-	ret = platform_device_register(&legoev3_i2c3_device);
-	if (ret)
-		pr_warn("%s: Input port 1 I2C registration failed: %d\n", 
-			__func__, ret);
+	pwm_add_table(legoev3_pwm_lookup, ARRAY_SIZE(legoev3_pwm_lookup));
 
-	ret = platform_device_register(&legoev3_i2c4_device);
+	ret = platform_device_register(&legoev3_in_port_i2c_fiq);
 	if (ret)
-		pr_warn("%s: Input port 2 I2C registration failed: %d\n", 
+		pr_warn("%s: FIQ I2C backend registration failed: %d\n", 
 			__func__, ret);
+	else
+		legoev3_register_in_port_i2c_all();
 
-	ret = platform_device_register(&legoev3_i2c5_device);
-	if (ret)
-		pr_warn("%s: Input port 3 I2C registration failed: %d\n", 
-			__func__, ret);
+	if (IS_ENABLED(CONFIG_LEGOEV3_PRU_I2C)) {
+		ret = da8xx_register_pru_rproc();
+		if (ret)
+			pr_warn("%s: PRU remoteproc registration failed: %d\n",
+				__func__, ret);
+	}
 
-	ret = platform_device_register(&legoev3_i2c6_device);
-	if (ret)
-		pr_warn("%s: Input port 4 I2C registration failed: %d\n", 
-			__func__, ret);
+	if (IS_ENABLED(CONFIG_LEGOEV3_MOTOR))
+		legoev3_register_motors();
 
-	ret = platform_device_register(&legoev3_bt_device);
-	if (ret)
-		pr_warn("%s: registering on-board bluetooth failed: %d\n",
-			__func__, ret);
+	if (!IS_ENABLED(CONFIG_LEGOEV3_DEFER_DEVICES))
+		legoev3_register_bt_device();
+	legoev3_boot_step("FIQ, motor and bluetooth devices", t);
 }
 
 static const char *const legoev3_dt_compat[] __initconst = {
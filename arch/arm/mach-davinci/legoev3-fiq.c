@@ -23,33 +23,72 @@
 #include <linux/module.h>
 #include <linux/interrupt.h>
 #include <linux/platform_device.h>
+#include <linux/clk.h>
 #include <linux/gpio.h>
+#include <linux/debugfs.h>
+#include <linux/genalloc.h>
+#include <linux/legoev3_perf.h>
+#include <linux/mm.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/pstore_ram.h>
+#include <linux/hrtimer.h>
+#include <linux/perf_event.h>
+#include <linux/sched.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/legoev3_fiq.h>
 
 #include <asm/io.h>
+#include <asm/pgtable.h>
+#include <asm/sections.h>
+#include <asm/cacheflush.h>
 #include <asm/fiq.h>
 #include <mach/legoev3-fiq.h>
+#include <mach/time.h>
 
 #include "cp_intc.h"
+#include "legoev3-pru-i2c.h"
+#include "sram.h"
 
 enum transfer_states {
 	TRANSFER_IDLE,
 	TRANSFER_START,
-	TRANSFER_START2,
-	TRANSFER_ADDR,
-	TRANSFER_WRITE,
-	TRANSFER_READ,
-	TRANSFER_WBIT,
-	TRANSFER_RBIT,
-	TRANSFER_WACK,
-	TRANSFER_RACK,
-	TRANSFER_STOP,
-	TRANSFER_STOP2,
-	TRANSFER_STOP3,
-	TRANSFER_RESTART,
-	TRANSFER_WAIT,
+	TRANSFER_RUN,
 	TRANSFER_COMPLETE,
 };
 
+/*
+ * Each I2C transaction is compiled by legoev3_fiq_i2c_compile() into a
+ * program with one opcode per timer tick (half of a clock cycle), so the FIQ
+ * does not have to work out what to do next on every tick.
+ */
+#define FIQ_OP_SCL		BIT(7)	/* level of SCL during this tick */
+#define FIQ_OP_NEXT_MSG		BIT(6)	/* move on to the next message */
+#define FIQ_OP_MASK		0x0F
+
+enum fiq_i2c_op {
+	FIQ_OP_NONE,		/* just clock */
+	FIQ_OP_SDA_LOW,		/* drive SDA low */
+	FIQ_OP_SDA_HIGH,	/* drive SDA high */
+	FIQ_OP_SDA_IN,		/* release SDA */
+	FIQ_OP_SAMPLE,		/* shift SDA into the data byte */
+	FIQ_OP_STORE,		/* same as FIQ_OP_SAMPLE, then store the byte */
+	FIQ_OP_ACK,		/* check for ACK, abort the transaction on NACK */
+	FIQ_OP_END,		/* release SDA, transaction is finished */
+	FIQ_OP_STRETCH,		/* wait while a slave holds SCL low */
+	FIQ_OP_STORE_LEN,	/* store the count of a block read */
+	FIQ_OP_SDA_ACK,		/* ACK, or NACK at the end of a block */
+	FIQ_OP_LOOP,		/* next byte of a block read */
+	FIQ_OP_RETRY,		/* end of bus recovery, retry or give up */
+};
+
+/*
+ * Enough for about 43 bytes, counting one address byte for each message and
+ * the bus recovery sequence at the end
+ */
+#define FIQ_I2C_PROG_LEN	1024
+
 enum fiq_timer_restart {
 	FIQ_TIMER_NORESTART,
 	FIQ_TIMER_RESTART,
@@ -61,7 +100,16 @@ enum fiq_i2c_pin {
 	NUM_FIQ_I2C_PIN
 };
 
+/* Each set of GPIO registers covers two banks of 16 pins */
+#define FIQ_GPIO_NUM_BANK_REGS	5
+#define FIQ_GPIO_BANK_STRIDE	0x28
+#define FIQ_GPIO_DIR		0x10
+#define FIQ_GPIO_SET_DATA	0x18
+#define FIQ_GPIO_CLR_DATA	0x1C
+#define FIQ_GPIO_IN_DATA	0x20
+
 struct legoev3_fiq_gpio {
+	int bank;
 	int dir_reg;
 	int set_reg;
 	int clr_reg;
@@ -69,57 +117,320 @@ struct legoev3_fiq_gpio {
 	int reg_mask;
 };
 
-struct legoev3_fiq_port_i2c_data {
-	struct legoev3_fiq_gpio gpio[NUM_FIQ_I2C_PIN];
-	void (*complete)(int, void *);
-	void *context;
-	struct i2c_msg msgs[2];
+/* TINT34_1 period, see timers[TID_FIQSOURCE] in time.c */
+#define FIQ_TIMER_TICK_US	50
+
+/* Number of transactions that can be queued per port. Must be a power of 2. */
+#define FIQ_I2C_QUEUE_LEN	4
+#define FIQ_I2C_QUEUE_MASK	(FIQ_I2C_QUEUE_LEN - 1)
+
+struct legoev3_fiq_i2c_xfer {
+	struct i2c_msg msgs[LEGOEV3_FIQ_I2C_MAX_MSGS];
 	struct i2c_msg *xfer_msgs;
 	unsigned num_msg;
+	void (*complete)(int, void *);
+	void *context;
+	int xfer_result;
+	u32 queued_ts;
+	u32 start_ts;
+	u32 end_ts;
+	u16 num_bytes;
+	u16 recv_len;
+	u16 stop_pc;
+	u16 loop_pc;
+	u16 recover_pc;
+	u8 prog[FIQ_I2C_PROG_LEN];
+};
+
+/*
+ * A transaction that is re-issued by the FIQ every period. The data read back
+ * goes straight into the double buffered slot, see struct
+ * legoev3_fiq_periodic_slot, so consumers can read it without any interrupt,
+ * lock or copy by the FIQ.
+ */
+struct legoev3_fiq_i2c_periodic {
+	struct legoev3_fiq_i2c_xfer xfer;
+	struct legoev3_fiq_periodic_slot *slot;
+	u8 wbuf[LEGOEV3_FIQ_I2C_PERIODIC_MAX_LEN];
+	int read_msg;
+	unsigned period;
+	unsigned countdown;
+	unsigned enabled:1;
+	legoev3_fiq_periodic_notify_t notify;
+	void *notify_context;
+	unsigned notify_seq;
+};
+
+#ifdef CONFIG_LEGOEV3_FIQ_STATS
+/*
+ * Per-port transfer accounting. Only written by the FIQ, so readers may see
+ * a partially updated set of counters.
+ */
+struct legoev3_fiq_i2c_stats {
+	u32 xfers;
+	u32 nacks;
+	u32 timeouts;
+	u32 retries;
+	u32 bytes;
+	u32 start;
+	u64 busy_ticks;
+};
+#endif
+
+/*
+ * The transaction queue is a lock-free ring. queue_head is only advanced by
+ * legoev3_fiq_start_xfer(), queue_tail is only advanced by the FIQ when a
+ * transaction is finished and queue_done is only advanced by the gpio irq
+ * handler after the complete() callback has been called.
+ */
+struct legoev3_fiq_port_i2c_data {
+	struct legoev3_fiq_gpio gpio[NUM_FIQ_I2C_PIN];
+	struct legoev3_fiq_i2c_xfer queue[FIQ_I2C_QUEUE_LEN];
+	unsigned queue_head;
+	unsigned queue_tail;
+	unsigned queue_done;
+	struct legoev3_fiq_i2c_periodic periodic;
+	struct legoev3_fiq_i2c_xfer *cur_xfer;
 	unsigned cur_msg;
-	unsigned wait_cycles;
 	int xfer_result;
+	u16 pc;
 	u16 buf_offset;
-	u8 bit_mask;
 	u8 data_byte;
+	u8 clock_div;
+	u8 clock_skip;
+	u16 stretch_timeout;
+	u16 stretch_count;
+	u8 retries;
+	u8 retry_count;
+	u8 recv_remaining;
+	u8 port_id;
 	enum transfer_states transfer_state;
-	unsigned clock_state:1;
-	unsigned nacked:1;
+#ifdef CONFIG_LEGOEV3_FIQ_STATS
+	struct legoev3_fiq_i2c_stats stats;
+#endif
+};
+
+enum fiq_ehrpwm_format {
+	FIQ_EHRPWM_FORMAT_S16,		/* S16_LE mono */
+	FIQ_EHRPWM_FORMAT_U8,		/* U8 mono */
+	FIQ_EHRPWM_FORMAT_S16_STEREO,	/* S16_LE stereo, mixed down to mono */
 };
 
+/* ramp_gain is a 16.16 fixed point number */
+#define FIQ_EHRPWM_RAMP_UNITY	0x10000
+
 struct legoev3_fiq_ehrpwm_data {
 	u8 *dma_area;
+	struct snd_pcm_runtime *runtime;
+	snd_pcm_uframes_t hw_frames;
+	enum fiq_ehrpwm_format format;
 	int volume;
+	int ramp_gain;
+	int ramp_step;
+	unsigned filter_flags;
+	unsigned decimate;
+	unsigned oversample;
+	unsigned oversample_recip;
+	unsigned sub_count;
+	int prev_sample;
+	int cur_sample;
+	int interp_step;
+	unsigned long shape_error;
 	unsigned playback_ptr;
 	size_t frame_bytes;
 	size_t buffer_bytes;
 	snd_pcm_uframes_t period_size;
 	unsigned callback_count;
+	u32 notify_ts;
 	void (*period_elapsed)(void *);
 	void *period_elapsed_data;
 	unsigned requested_flag:1;
-	unsigned period_elapsed_flag:1;
+	unsigned starved_flag:1;
+};
+
+enum fiq_encoder_pin {
+	FIQ_ENCODER_PIN_INT,
+	FIQ_ENCODER_PIN_DIR,
+	NUM_FIQ_ENCODER_PIN
+};
+
+/*
+ * Motor tachometer, sampled on every timer tick. Only written by the FIQ,
+ * which increments seq after each update so that readers can tell if they
+ * were interrupted.
+ */
+struct legoev3_fiq_encoder_data {
+	struct legoev3_fiq_gpio gpio[NUM_FIQ_ENCODER_PIN];
+	s32 position;
+	u32 timestamp;
+	u32 missed;
+	unsigned seq;
+	u8 state;
+};
+
+enum fiq_uart_state {
+	FIQ_UART_IDLE,		/* waiting for a start bit */
+	FIQ_UART_RX,		/* receiving a frame */
+	FIQ_UART_BREAK,		/* framing error, waiting for the line to idle */
+};
+
+/* Timer ticks per bit at the highest baud rate in use */
+#define FIQ_UART_OVERSAMPLE	4
+/* Must be a power of 2 */
+#define FIQ_UART_RING_LEN	256
+#define FIQ_UART_RING_MASK	(FIQ_UART_RING_LEN - 1)
+
+/*
+ * Software UART receiver, 8N1. The bit clock is a 16.16 fixed point phase
+ * that advances by step (bits per timer tick) so that ports with different
+ * baud rates can share one timer. The ring is lock-free: only the FIQ
+ * advances ring_head and only legoev3_fiq_uart_read() advances ring_tail.
+ */
+struct legoev3_fiq_uart_data {
+	struct legoev3_fiq_gpio rx;
+	u8 ring[FIQ_UART_RING_LEN];
+	unsigned ring_head;
+	unsigned ring_tail;
+	unsigned overruns;
+	unsigned framing_errors;
+	unsigned baud;
+	u32 step;
+	u32 phase;
+	u32 next_sample;
+	u8 bit;
+	u8 byte;
+	enum fiq_uart_state state;
+	void (*rx_callback)(void *);
+	void *context;
+};
+
+/* bit in legoev3_fiq_data.notify_mask, the I2C ports use BIT(port_id) */
+#define FIQ_NOTIFY_EHRPWM	BIT(NUM_EV3_PORT_IN)
+#define FIQ_NOTIFY_UART(port)	BIT(NUM_EV3_PORT_IN + 1 + (port))
+
+#ifdef CONFIG_LEGOEV3_FIQ_STATS
+/* bucket n counts values in [2^(n-1), 2^n) timer ticks */
+#define FIQ_STATS_NUM_BUCKETS	20
+
+enum fiq_stats_source {
+	FIQ_STATS_I2C_TIMER,
+	FIQ_STATS_EHRPWM,
+	FIQ_STATS_DURATION,
+	NUM_FIQ_STATS
+};
+
+/*
+ * Only written by the FIQ. Readers may see a partially updated entry, which
+ * is fine for statistics.
+ */
+struct legoev3_fiq_stats {
+	u32 count;
+	u32 min;
+	u32 max;
+	u64 sum;
+	u32 buckets[FIQ_STATS_NUM_BUCKETS];
+};
+#endif
+
+#ifdef CONFIG_LEGOEV3_FIQ_PERF
+/* entries in the sample ring, must be a power of 2 */
+#define FIQ_PERF_RING_SIZE	64
+#define FIQ_PERF_MAX_DEPTH	8
+/* how often the ring is emptied into the perf buffer */
+#define FIQ_PERF_DRAIN_MS	4
+
+/* What the I2C timer FIQ saw of the code it interrupted */
+struct legoev3_fiq_perf_sample {
+	u32 pc;
+	u32 lr;
+	u32 cpsr;
+	pid_t pid;
+	pid_t tid;
+	u32 timestamp;
+	u32 period;
+	u32 nr;
+	u32 callchain[FIQ_PERF_MAX_DEPTH];
+};
+
+/*
+ * Single producer, single consumer: only the FIQ writes @head and only the
+ * drain writes @tail. The FIQ takes a sample every @period timer ticks
+ * while @period is not 0.
+ */
+struct legoev3_fiq_perf {
+	struct legoev3_fiq_perf_sample *ring;
+	u32 head;
+	u32 tail;
+	u32 period;
+	u32 countdown;
+	u32 dropped;
+};
+#endif
+
+#define FIQ_STACK_SIZE		512
+
+/* Number of cp_intc system interrupts that can be dispatched */
+#define FIQ_NUM_IRQ		DA850_N_CP_INTC_IRQ
+
+struct legoev3_fiq_client {
+	legoev3_fiq_handler_t handler;
+	void *data;
+	u8 prev_channel;
+};
+
+/*
+ * The requested ports of one kind, in the order the FIQ visits them, so that
+ * it doesn't have to test every bit of the request flags on every tick.
+ * Rebuilt with the FIQ disabled whenever the flags change.
+ */
+struct fiq_port_list {
+	u8 num;
+	u8 port[NUM_EV3_PORT_IN];	/* same as NUM_EV3_PORT_OUT */
 };
 
+/*
+ * This is allocated from the on-chip SRAM when possible so that the FIQ does
+ * not have to wait for DDR when the caches miss.
+ */
 struct legoev3_fiq_data {
+	u64 fiq_stack[FIQ_STACK_SIZE / sizeof(u64)];
 	struct legoev3_fiq_port_i2c_data port_data[NUM_EV3_PORT_IN];
 	struct legoev3_fiq_ehrpwm_data ehrpwm_data;
+	struct legoev3_fiq_encoder_data encoder_data[NUM_EV3_PORT_OUT];
+	struct legoev3_fiq_uart_data uart_data[NUM_EV3_PORT_IN];
+	struct legoev3_fiq_client clients[FIQ_NUM_IRQ];
+	struct legoev3_fiq_periodic_page periodic_fallback;
+	struct legoev3_fiq_periodic_page *periodic_page;
+	phys_addr_t periodic_page_phys;
 	struct platform_device *pdev;
 	struct fiq_handler fiq_handler;
 	struct legoev3_fiq_gpio status_gpio;
 	void __iomem *gpio_base;
 	void __iomem *intc_base;
 	void __iomem *ehrpwm_base;
+	phys_addr_t ehrpwm_phys;
+	void __iomem *uart_timer_base;
+	struct clk *uart_timer_clk;
 	int timer_irq;
 	int ehrpwm_irq;
+	int uart_timer_irq;
 	int status_gpio_irq;
 	int port_req_flags;
-};
-
-static struct legoev3_fiq_data legoev3_fiq_init_data = {
-	.fiq_handler = {
-		.name = "legoev3-fiq-handler",
-	},
+	int encoder_req_flags;
+	int uart_req_flags;
+	struct fiq_port_list i2c_ports;
+	struct fiq_port_list encoder_ports;
+	struct fiq_port_list uart_ports;
+	unsigned notify_mask;
+	unsigned in_sram:1;
+#ifdef CONFIG_LEGOEV3_FIQ_STATS
+	struct legoev3_fiq_stats stats[NUM_FIQ_STATS];
+	u32 ehrpwm_last_timestamp;
+	struct dentry *debugfs;
+#endif
+#ifdef CONFIG_LEGOEV3_FIQ_PERF
+	struct legoev3_fiq_perf perf;
+#endif
 };
 
 static struct legoev3_fiq_data *legoev3_fiq_data;
@@ -166,6 +477,98 @@ static inline void fiq_gpio_dir_out(struct legoev3_fiq_gpio *gpio, bool value)
 	__raw_writel(dir, legoev3_fiq_data->gpio_base + gpio->dir_reg);
 }
 
+/*
+ * Pin changes for one timer tick, collected per set of bank registers, so
+ * that all ports together need at most one access per register instead of
+ * one per pin. Inputs are read once per tick before any of the outputs are
+ * changed, i.e. they return the level at the end of the previous tick.
+ */
+struct fiq_gpio_batch {
+	u32 set[FIQ_GPIO_NUM_BANK_REGS];
+	u32 clr[FIQ_GPIO_NUM_BANK_REGS];
+	u32 dir_in[FIQ_GPIO_NUM_BANK_REGS];
+	u32 dir_out[FIQ_GPIO_NUM_BANK_REGS];
+	u32 in[FIQ_GPIO_NUM_BANK_REGS];
+	u8 touched;
+	u8 in_valid;
+};
+
+static inline void fiq_batch_touch(struct fiq_gpio_batch *b, int bank)
+{
+	if (b->touched & BIT(bank))
+		return;
+	b->touched |= BIT(bank);
+	b->set[bank] = b->clr[bank] = 0;
+	b->dir_in[bank] = b->dir_out[bank] = 0;
+}
+
+static inline bool fiq_batch_get_value(struct fiq_gpio_batch *b,
+				       struct legoev3_fiq_gpio *gpio)
+{
+	if (!(b->in_valid & BIT(gpio->bank))) {
+		b->in[gpio->bank] = __raw_readl(legoev3_fiq_data->gpio_base
+						+ gpio->in_reg);
+		b->in_valid |= BIT(gpio->bank);
+	}
+
+	return (b->in[gpio->bank] & gpio->reg_mask) ? 1 : 0;
+}
+
+static inline void fiq_batch_set_value(struct fiq_gpio_batch *b,
+				       struct legoev3_fiq_gpio *gpio,
+				       bool value)
+{
+	fiq_batch_touch(b, gpio->bank);
+	if (value) {
+		b->set[gpio->bank] |= gpio->reg_mask;
+		b->clr[gpio->bank] &= ~gpio->reg_mask;
+	} else {
+		b->clr[gpio->bank] |= gpio->reg_mask;
+		b->set[gpio->bank] &= ~gpio->reg_mask;
+	}
+}
+
+static inline void fiq_batch_dir_in(struct fiq_gpio_batch *b,
+				    struct legoev3_fiq_gpio *gpio)
+{
+	fiq_batch_touch(b, gpio->bank);
+	b->dir_in[gpio->bank] |= gpio->reg_mask;
+	b->dir_out[gpio->bank] &= ~gpio->reg_mask;
+}
+
+static inline void fiq_batch_dir_out(struct fiq_gpio_batch *b,
+				     struct legoev3_fiq_gpio *gpio, bool value)
+{
+	fiq_batch_set_value(b, gpio, value);
+	b->dir_out[gpio->bank] |= gpio->reg_mask;
+	b->dir_in[gpio->bank] &= ~gpio->reg_mask;
+}
+
+/* Output levels are written before directions, like fiq_gpio_dir_out(). */
+static inline void fiq_batch_flush(struct fiq_gpio_batch *b)
+{
+	void __iomem *base;
+	u32 dir;
+	int i;
+
+	for (i = 0; b->touched; i++) {
+		if (!(b->touched & BIT(i)))
+			continue;
+		b->touched &= ~BIT(i);
+		base = legoev3_fiq_data->gpio_base + i * FIQ_GPIO_BANK_STRIDE;
+		if (b->set[i])
+			__raw_writel(b->set[i], base + FIQ_GPIO_SET_DATA);
+		if (b->clr[i])
+			__raw_writel(b->clr[i], base + FIQ_GPIO_CLR_DATA);
+		if (b->dir_in[i] | b->dir_out[i]) {
+			dir = __raw_readl(base + FIQ_GPIO_DIR);
+			dir |= b->dir_in[i];
+			dir &= ~b->dir_out[i];
+			__raw_writel(dir, base + FIQ_GPIO_DIR);
+		}
+	}
+}
+
 #define SICR 0x24 /* System Interrupt Status Indexed Clear Register */
 static inline void legoev3_fiq_ack(int irq)
 {
@@ -185,7 +588,8 @@ static inline void legoev3_fiq_disable(int irq)
 }
 
 #define GPIR 0x80 /* Global Prioritized Index Register */
-static inline int legoev3_fiq_get_irq(void)
+#define GPIR_NONE BIT(31) /* no interrupt is pending */
+static inline u32 legoev3_fiq_get_irq(void)
 {
 	return __raw_readl(legoev3_fiq_data->intc_base + GPIR);
 }
@@ -241,10 +645,22 @@ static inline void fiq_ehrpwm_et_int_set_period(unsigned char period)
 	__raw_writew(dir, legoev3_fiq_data->ehrpwm_base + ETPS);
 }
 
+#define TBCTR 0x8 /* Time-Base Counter Register */
 #define ETFLG 0x36 /* Event-Trigger Flag Register */
-static inline int fiq_ehrpwm_test_irq(void)
+
+/*
+ * Leaves a trace of the FIQ in ramoops, along with where the I2C timer and
+ * the sound ePWM were at that point, for looking at after a hang.
+ */
+static inline void __fiq_text
+fiq_irqtrace_add(struct ramoops_irqtrace *trace, u32 irq)
 {
-	return __raw_readw(legoev3_fiq_data->ehrpwm_base + ETFLG) & 0x1;
+	void __iomem *ehrpwm_base = legoev3_fiq_data->ehrpwm_base;
+
+	ramoops_irqtrace_add(trace, davinci_timer_read_freerun(), irq,
+			     davinci_timer_read_fiqsource(),
+			     __raw_readw(ehrpwm_base + ETFLG) << 16 |
+			     __raw_readw(ehrpwm_base + TBCTR));
 }
 
 #define ETCLR 0x38 /* Event-Trigger Clear Register */
@@ -253,12 +669,122 @@ static inline void fiq_ehrpwm_clear_irq(void)
 	__raw_writew(0x1, legoev3_fiq_data->ehrpwm_base + ETCLR);
 }
 
-static enum fiq_timer_restart
-legoev3_fiq_timer_callback(struct legoev3_fiq_port_i2c_data *data)
+#ifdef CONFIG_LEGOEV3_FIQ_STATS
+static inline u32 fiq_stats_timestamp(void)
+{
+	return davinci_timer_read_freerun();
+}
+
+static inline void __fiq_text
+fiq_stats_add(enum fiq_stats_source source, u32 ticks)
+{
+	struct legoev3_fiq_stats *stats = &legoev3_fiq_data->stats[source];
+
+	if (!stats->count || ticks < stats->min)
+		stats->min = ticks;
+	if (ticks > stats->max)
+		stats->max = ticks;
+	stats->sum += ticks;
+	stats->count++;
+	stats->buckets[min(fls(ticks), FIQ_STATS_NUM_BUCKETS - 1)]++;
+}
+
+/*
+ * The sound ePWM runs at a fixed rate, so the time between two of its FIQs
+ * shows how much it is being delayed.
+ */
+static inline void fiq_stats_ehrpwm(u32 timestamp)
+{
+	if (legoev3_fiq_data->ehrpwm_last_timestamp)
+		fiq_stats_add(FIQ_STATS_EHRPWM,
+			timestamp - legoev3_fiq_data->ehrpwm_last_timestamp);
+	legoev3_fiq_data->ehrpwm_last_timestamp = timestamp;
+}
+
+static inline void __fiq_text
+fiq_i2c_stats_start(struct legoev3_fiq_port_i2c_data *data)
+{
+	data->stats.start = fiq_stats_timestamp();
+}
+
+static inline void __fiq_text
+fiq_i2c_stats_retry(struct legoev3_fiq_port_i2c_data *data)
+{
+	data->stats.retries++;
+}
+
+static inline void __fiq_text
+fiq_i2c_stats_end(struct legoev3_fiq_port_i2c_data *data,
+		  struct legoev3_fiq_i2c_xfer *xfer)
+{
+	struct legoev3_fiq_i2c_stats *stats = &data->stats;
+
+	stats->xfers++;
+	if (data->xfer_result == -ENXIO)
+		stats->nacks++;
+	else if (data->xfer_result)
+		stats->timeouts++;
+	else
+		stats->bytes += xfer->num_bytes;
+	stats->busy_ticks += fiq_stats_timestamp() - stats->start;
+}
+#else
+/* the arguments are evaluated so that the callers' timestamps are used */
+static inline u32 fiq_stats_timestamp(void) { return 0; }
+#define fiq_stats_add(source, ticks) ((void)(ticks))
+#define fiq_stats_ehrpwm(timestamp) ((void)(timestamp))
+#define fiq_i2c_stats_start(data) ((void)(data))
+#define fiq_i2c_stats_retry(data) ((void)(data))
+#define fiq_i2c_stats_end(data, xfer) ((void)(data), (void)(xfer))
+#endif
+
+/*
+ * Tells the non-FIQ code that something happened. The status gpio is only
+ * driven high on the first event after the irq handler has collected the
+ * previous ones, so there is exactly one rising edge per batch no matter how
+ * many ports finish at the same time.
+ */
+static inline void __fiq_text fiq_notify(unsigned mask)
+{
+	if (!legoev3_fiq_data->notify_mask)
+		fiq_gpio_set_value(&legoev3_fiq_data->status_gpio, 1);
+	legoev3_fiq_data->notify_mask |= mask;
+}
+
+/* Hands the result of a transaction, after any retries, to the irq handler. */
+static inline void __fiq_text
+fiq_i2c_finish(struct legoev3_fiq_port_i2c_data *data,
+	       struct legoev3_fiq_i2c_xfer *xfer)
+{
+	xfer->xfer_result = data->xfer_result;
+	xfer->end_ts = davinci_timer_read_freerun();
+	fiq_i2c_stats_end(data, xfer);
+	data->retry_count = 0;
+	if (xfer == &data->periodic.xfer) {
+		struct legoev3_fiq_periodic_slot *slot = data->periodic.slot;
+
+		/* publish the back buffer */
+		slot->result[(slot->seq + 1) & 1] = data->xfer_result;
+		slot->seq++;
+		if (data->periodic.notify)
+			fiq_notify(BIT(data->port_id));
+	} else {
+		data->queue_tail++;
+		fiq_notify(BIT(data->port_id));
+	}
+	data->transfer_state = TRANSFER_COMPLETE;
+}
+
+static enum fiq_timer_restart __fiq_text
+legoev3_fiq_timer_callback(struct legoev3_fiq_port_i2c_data *data,
+			   struct fiq_gpio_batch *b)
 {
-	struct i2c_msg *msg = &data->msgs[data->cur_msg];
+	struct legoev3_fiq_i2c_xfer *xfer = data->cur_xfer;
+	struct i2c_msg *msg;
+	u8 op;
 
-	fiq_gpio_set_value(&data->gpio[FIQ_I2C_PIN_SCL], data->clock_state);
+	if (data->periodic.countdown)
+		data->periodic.countdown--;
 
 	switch (data->transfer_state)
 	{
@@ -267,171 +793,164 @@ legoev3_fiq_timer_callback(struct legoev3_fiq_port_i2c_data *data)
 		 * Make sure to SYNC into Timer settings
 		 * to ensure first bit time having full length
 		 */
+		fiq_batch_set_value(b, &data->gpio[FIQ_I2C_PIN_SCL], 1);
+		data->pc = 0;
 		data->cur_msg = 0;
-		data->xfer_result = 0;
-		data->transfer_state = TRANSFER_START2;
-		break;
-
-	case TRANSFER_START2:
-		/* Generate start condition - sda low to high while clk high */
-		fiq_gpio_dir_out(&data->gpio[FIQ_I2C_PIN_SDA], 0);
-		data->clock_state = 0;
-		data->nacked = false;
-		data->transfer_state = TRANSFER_ADDR;
-		break;
-
-	case TRANSFER_ADDR:
-		data->data_byte = (msg->addr << 1);
-		if (msg->flags & I2C_M_RD)
-			data->data_byte |= 1;
 		data->buf_offset = 0;
-		/* no break */
-
-	case TRANSFER_WRITE:
-		if (data->transfer_state == TRANSFER_WRITE)
-			data->data_byte = msg->buf[data->buf_offset++];
-		data->transfer_state = TRANSFER_WBIT;
-		data->bit_mask  = 0x80;
-		/* no break */
-
-	case TRANSFER_WBIT:
-		if (!data->clock_state) {
-			fiq_gpio_dir_out(&data->gpio[FIQ_I2C_PIN_SDA],
-					 data->data_byte & data->bit_mask);
-			data->bit_mask >>= 1;
+		data->xfer_result = 0;
+		data->transfer_state = TRANSFER_RUN;
+		/* retries count towards the time on the bus */
+		if (!data->retry_count) {
+			xfer->start_ts = davinci_timer_read_freerun();
+			fiq_i2c_stats_start(data);
 		}
-
-		if (!data->bit_mask && data->clock_state)
-			data->transfer_state = TRANSFER_RACK;
-		data->clock_state ^= 1;
 		break;
 
-	case TRANSFER_READ:
-		fiq_gpio_dir_in(&data->gpio[FIQ_I2C_PIN_SDA]);
-		data->transfer_state = TRANSFER_RBIT;
-		data->bit_mask  = 0x80;
-		data->data_byte = 0;
-		/* no break */
-
-	case TRANSFER_RBIT:
-		if (data->clock_state) {
-			data->data_byte |= fiq_gpio_get_value(&data->gpio[FIQ_I2C_PIN_SDA])
-					   ? data->bit_mask : 0;
-			data->bit_mask >>= 1;
-
-			if (!data->bit_mask) {
-				msg->buf[data->buf_offset++] = data->data_byte;
-				data->transfer_state = TRANSFER_WACK;
-			}
+	case TRANSFER_RUN:
+		op = xfer->prog[data->pc++];
+		fiq_batch_set_value(b, &data->gpio[FIQ_I2C_PIN_SCL],
+				    op & FIQ_OP_SCL);
+		if (op & FIQ_OP_NEXT_MSG) {
+			data->cur_msg++;
+			data->buf_offset = 0;
 		}
-		data->clock_state ^= 1;
-		break;
 
-	case TRANSFER_RACK:
-		if (!data->clock_state)
-			fiq_gpio_dir_in(&data->gpio[FIQ_I2C_PIN_SDA]);
-		else {
-			if (!fiq_gpio_get_value(&data->gpio[FIQ_I2C_PIN_SDA])) {
-				if (data->buf_offset < msg->len) {
-					data->wait_cycles = 4;
-					data->transfer_state = TRANSFER_WAIT;
-				}
-				else
-					data->transfer_state = TRANSFER_STOP;
-			} else {
-				data->nacked = true;
+		switch (op & FIQ_OP_MASK) {
+		case FIQ_OP_SDA_LOW:
+			fiq_batch_dir_out(b, &data->gpio[FIQ_I2C_PIN_SDA], 0);
+			break;
+		case FIQ_OP_SDA_HIGH:
+			fiq_batch_dir_out(b, &data->gpio[FIQ_I2C_PIN_SDA], 1);
+			break;
+		case FIQ_OP_SDA_IN:
+			fiq_batch_dir_in(b, &data->gpio[FIQ_I2C_PIN_SDA]);
+			break;
+		case FIQ_OP_SAMPLE:
+			data->data_byte <<= 1;
+			data->data_byte |= fiq_batch_get_value(b,
+						&data->gpio[FIQ_I2C_PIN_SDA]);
+			break;
+		case FIQ_OP_STORE:
+			data->data_byte <<= 1;
+			data->data_byte |= fiq_batch_get_value(b,
+						&data->gpio[FIQ_I2C_PIN_SDA]);
+			msg = &xfer->msgs[data->cur_msg];
+			msg->buf[data->buf_offset++] = data->data_byte;
+			break;
+		case FIQ_OP_STORE_LEN:
+			data->data_byte <<= 1;
+			data->data_byte |= fiq_batch_get_value(b,
+						&data->gpio[FIQ_I2C_PIN_SDA]);
+			msg = &xfer->msgs[data->cur_msg];
+			msg->buf[data->buf_offset++] = data->data_byte;
+			if (!data->data_byte ||
+			    data->data_byte > I2C_SMBUS_BLOCK_MAX) {
+				data->xfer_result = -EPROTO;
+				data->pc = xfer->stop_pc;
+				break;
+			}
+			/*
+			 * The count, plus the extra bytes asked for (PEC).
+			 * Relative to the initial length, a retry may get
+			 * here again.
+			 */
+			data->recv_remaining = data->data_byte +
+					       xfer->recv_len - 1;
+			xfer->num_bytes += xfer->recv_len + data->data_byte -
+					   msg->len;
+			msg->len = xfer->recv_len + data->data_byte;
+			break;
+		case FIQ_OP_SDA_ACK:
+			fiq_batch_dir_out(b, &data->gpio[FIQ_I2C_PIN_SDA],
+					  data->recv_remaining <= 1);
+			break;
+		case FIQ_OP_LOOP:
+			if (--data->recv_remaining)
+				data->pc = xfer->loop_pc;
+			break;
+		case FIQ_OP_ACK:
+			if (fiq_batch_get_value(b, &data->gpio[FIQ_I2C_PIN_SDA])) {
 				data->xfer_result = -ENXIO;
-				data->transfer_state = TRANSFER_STOP;
+				data->pc = xfer->stop_pc;
 			}
-		}
-		data->clock_state ^= 1;
-		break;
-
-	case TRANSFER_WACK:
-		if (!data->clock_state)
-			/* ACK (or NACK the last byte read) */
-			fiq_gpio_dir_out(&data->gpio[FIQ_I2C_PIN_SDA],
-					 data->buf_offset == msg->len);
-		else {
-			if (data->buf_offset < msg->len) {
-				data->wait_cycles = 2;
-				data->transfer_state = TRANSFER_WAIT;
-			} else
-				data->transfer_state = TRANSFER_STOP;
-		}
-		data->clock_state ^= 1;
-		break;
-
-	case TRANSFER_WAIT:
-		if (data->wait_cycles--)
 			break;
-		else if (msg->flags & I2C_M_RD)
-			data->transfer_state = TRANSFER_READ;
-		else
-			data->transfer_state = TRANSFER_WRITE;
-		break;
-
-	case TRANSFER_STOP:
-		/*
-		 * Note: The official LEGO firmware does not generate stop
-		 * condition except for in the middle of reads (see below).
-		 * We are going by the book and doing a stop when we are
-		 * supposed to. We can change it back if there are problems.
-		 */
-		fiq_gpio_dir_out(&data->gpio[FIQ_I2C_PIN_SDA], 0);
-
-		if (data->clock_state)
-			data->transfer_state = TRANSFER_STOP2;
-		data->clock_state = 1;
-		break;
-
-	case TRANSFER_STOP2:
-		if ((data->cur_msg + 1) < data->num_msg && !data->nacked)
-		{
+		case FIQ_OP_STRETCH:
+			/* SCL was released on the previous tick */
+			if (fiq_batch_get_value(b, &data->gpio[FIQ_I2C_PIN_SCL])) {
+				data->stretch_count = 0;
+			} else if (++data->stretch_count < data->stretch_timeout) {
+				data->pc--;
+			} else {
+				data->stretch_count = 0;
+				data->xfer_result = -ETIMEDOUT;
+				data->pc = xfer->stop_pc;
+			}
+			break;
+		case FIQ_OP_END:
 			/*
-			 * This is some non-standard i2c weirdness for
-			 * compatibility with the NXT ultrasonic sensor.
-			 *
-			 * Normal i2c would just send a restart (sda high
-			 * to low while clk is high) between writing the
-			 * address and reading the data. Instead, we send
-			 * a stop (sda low to high while clk is high) and
-			 * then do an extra clock cycle (low then high)
-			 * before sending a start and reading the data.
+			 * Generate stop condition - sda low to high while clock
+			 * is high. Leave sda in input position when not in use
+			 * so that we can detect when a sensor is disconnected.
+			 * (Device detection is implemented in the
+			 * ev3-input-ports driver.)
+			 */
+			fiq_batch_dir_in(b, &data->gpio[FIQ_I2C_PIN_SDA]);
+			/*
+			 * A sensor that was unplugged in the middle of a
+			 * transaction may still be holding SDA low when it
+			 * comes back, so clean up the bus before retrying or
+			 * giving up.
 			 */
-			fiq_gpio_dir_out(&data->gpio[FIQ_I2C_PIN_SDA], 1);
-			data->clock_state ^= 1;
-			if  (data->clock_state) {
-				data->cur_msg++;
-				data->transfer_state = TRANSFER_RESTART;
+			if (unlikely(data->xfer_result) && data->retries) {
+				data->pc = xfer->recover_pc;
+				break;
 			}
-		} else
-			data->transfer_state = TRANSFER_STOP3;
-		break;
-
-	case TRANSFER_RESTART:
-		data->transfer_state = TRANSFER_START2;
+			fiq_i2c_finish(data, xfer);
+			goto transfer_complete;
+		case FIQ_OP_RETRY:
+			if (data->retry_count < data->retries) {
+				data->retry_count++;
+				fiq_i2c_stats_retry(data);
+				data->transfer_state = TRANSFER_START;
+				break;
+			}
+			fiq_i2c_finish(data, xfer);
+			goto transfer_complete;
+		default:
+			break;
+		}
 		break;
 
-	case TRANSFER_STOP3:
-		/*
-		 * Generate stop condition - sda low to high while clock
-		 * is high. Leave sda in input position when not in use so
-		 * that we can detect when a sensor is disconnected. (Device
-		 * detection is implemented in the ev3-input-ports driver.)
-		 */
-		fiq_gpio_dir_in(&data->gpio[FIQ_I2C_PIN_SDA]);
-		data->transfer_state = TRANSFER_COMPLETE;
-		/* no break */
-
 	case TRANSFER_COMPLETE:
+	transfer_complete:
 		/*
-		 * Keep toggling the status gpio until the gpio irq handler
-		 * acks it by setting transfer_state to TRANSFER_IDLE.
+		 * Chain the next queued transaction right away instead of
+		 * waiting for the gpio irq handler to collect this one.
+		 * Queued transactions take priority over the periodic one.
 		 */
-		fiq_gpio_set_value(&legoev3_fiq_data->status_gpio,
-			!fiq_gpio_get_value(&legoev3_fiq_data->status_gpio));
+		if (data->queue_tail != data->queue_head) {
+			data->cur_xfer =
+				&data->queue[data->queue_tail & FIQ_I2C_QUEUE_MASK];
+			data->transfer_state = TRANSFER_START;
+		} else if (data->periodic.enabled) {
+			if (!data->periodic.countdown) {
+				struct legoev3_fiq_i2c_periodic *periodic =
+							&data->periodic;
+
+				if (periodic->read_msg >= 0)
+					periodic->xfer.msgs[periodic->read_msg].buf =
+						periodic->slot->buf[
+						(periodic->slot->seq + 1) & 1];
+				periodic->countdown = periodic->period;
+				data->cur_xfer = &periodic->xfer;
+				data->transfer_state = TRANSFER_START;
+			}
+		} else if (data->queue_done == data->queue_tail) {
+			data->transfer_state = TRANSFER_IDLE;
+			return FIQ_TIMER_NORESTART;
+		}
 		break;
+
 	case TRANSFER_IDLE:
 		return FIQ_TIMER_NORESTART;
 
@@ -442,436 +961,3018 @@ legoev3_fiq_timer_callback(struct legoev3_fiq_port_i2c_data *data)
 	return FIQ_TIMER_RESTART;
 }
 
-static void legoev3_fiq_ehrpwm_callback(struct legoev3_fiq_ehrpwm_data *data)
+/* Returns the current frame as a signed 16-bit mono sample. */
+static inline int __fiq_text
+fiq_ehrpwm_fetch_sample(struct legoev3_fiq_ehrpwm_data *data)
 {
-	int sample;
-	unsigned long duty_ticks, period_ticks;
+	u8 *frame = data->dma_area + data->playback_ptr;
+	short *frame16 = (short *)frame;
+
+	switch (data->format) {
+	case FIQ_EHRPWM_FORMAT_U8:
+		return (*frame - 0x80) << 8;
+	case FIQ_EHRPWM_FORMAT_S16_STEREO:
+		return (frame16[0] + frame16[1]) >> 1;
+	default:
+		return *frame16;
+	}
+}
 
-	if (unlikely(!data->requested_flag || !data->dma_area))
-		return;
+/*
+ * Returns true if there is no more data written by the application, i.e. we
+ * have caught up with appl_ptr at the end of the stream or on underrun.
+ */
+static inline bool fiq_ehrpwm_is_starved(struct legoev3_fiq_ehrpwm_data *data)
+{
+	return data->runtime->control->appl_ptr == data->hw_frames;
+}
 
-	period_ticks = fiq_ehrpwm_get_period_ticks();
+/* Reads the next sample from the DMA buffer and applies volume and ramp. */
+static inline int __fiq_text
+fiq_ehrpwm_next_sample(struct legoev3_fiq_ehrpwm_data *data)
+{
+	int sample;
 
-	sample = *(short *)(data->dma_area + data->playback_ptr);
+	sample = fiq_ehrpwm_fetch_sample(data);
 	sample = (sample * data->volume) >> 8;
-	duty_ticks = ((sample + 0x7FFF) * period_ticks) >> 16;
-
-	fiq_ehrpwm_set_duty_ticks(duty_ticks);
 
-	/*
-	 * FIXME: Setting the buffer data to 0 here because there is a tendency
-	 * to replay part of a sample at the end of playback. If we can figure
-	 * out how to detect the end of playback, we wouldn't need to do this.
-	 */
-	*(short *)(data->dma_area + data->playback_ptr) = 0;
+	if (unlikely(data->ramp_gain != FIQ_EHRPWM_RAMP_UNITY)) {
+		sample = (sample * (data->ramp_gain >> 8)) >> 8;
+		data->ramp_gain += data->ramp_step;
+		if (data->ramp_gain >= FIQ_EHRPWM_RAMP_UNITY) {
+			data->ramp_gain = FIQ_EHRPWM_RAMP_UNITY;
+			data->ramp_step = 0;
+		} else if (data->ramp_gain <= 0) {
+			/* stay silent until the next ramp up */
+			data->ramp_gain = 0;
+			data->ramp_step = 0;
+		}
+	}
 
 	data->playback_ptr += data->frame_bytes;
 	if (data->playback_ptr >= data->buffer_bytes)
 		data->playback_ptr = 0;
+	/* same wrap-around as appl_ptr */
+	if (++data->hw_frames >= data->runtime->boundary)
+		data->hw_frames = 0;
 
 	if (++data->callback_count >= data->period_size)
 	{
 		data->callback_count =  0;
-		data->period_elapsed_flag = 1;
+		data->notify_ts = davinci_timer_read_freerun();
+		fiq_notify(FIQ_NOTIFY_EHRPWM);
 	}
 
-	/* toggle gpio to trigger callback */
-	if (data->period_elapsed_flag)
-		fiq_gpio_set_value(&legoev3_fiq_data->status_gpio,
-			!fiq_gpio_get_value(&legoev3_fiq_data->status_gpio));
+	return sample;
 }
 
-void legoev3_fiq_handler(void)
+/*
+ * Averages the next decimate frames into one sample, which is a crude low
+ * pass filter ahead of dropping the rate. Stops early at appl_ptr so that
+ * the FIQ never plays data that hasn't been written yet.
+ */
+static inline int __fiq_text
+fiq_ehrpwm_next_decimated(struct legoev3_fiq_ehrpwm_data *data)
 {
-	int irq = legoev3_fiq_get_irq();
-
-	if (irq == legoev3_fiq_data->timer_irq) {
-		struct legoev3_fiq_port_i2c_data *port_data;
-		int restart_timer = 0;
-		int i;
-
-		for (i = 0; i < NUM_EV3_PORT_IN; i++) {
-			if (!(legoev3_fiq_data->port_req_flags & BIT(i)))
-				continue;
-			port_data = &legoev3_fiq_data->port_data[i];
-			if (port_data != TRANSFER_IDLE)
-				restart_timer |= legoev3_fiq_timer_callback(port_data);
-		}
+	int sum = fiq_ehrpwm_next_sample(data);
+	unsigned n = 1;
 
-		if (!restart_timer)
-			legoev3_fiq_disable(legoev3_fiq_data->timer_irq);
-
-		legoev3_fiq_ack(legoev3_fiq_data->timer_irq);
+	while (n < data->decimate && !fiq_ehrpwm_is_starved(data)) {
+		sum += fiq_ehrpwm_next_sample(data);
+		n++;
 	}
-	if (fiq_ehrpwm_test_irq()) {
-		legoev3_fiq_ehrpwm_callback(&legoev3_fiq_data->ehrpwm_data);
-		legoev3_fiq_ack(legoev3_fiq_data->ehrpwm_irq);
-		fiq_ehrpwm_clear_irq();
+
+	switch (n) {
+	case 3:
+		return (sum * 0x5555) >> 16;
+	case 2:
+		return sum >> 1;
+	default:
+		return sum;
 	}
 }
 
-/* --------------- END OF CODE THAT IS CALLED IN FIQ CONTEXT -----------------*/
-
-static void legoev3_fiq_set_gpio(int gpio_pin, struct legoev3_fiq_gpio *gpio)
+static void __fiq_text
+legoev3_fiq_ehrpwm_callback(struct legoev3_fiq_ehrpwm_data *data)
 {
-	int bank = gpio_pin >> 4;
-	int bank_offset = (bank >> 1) * 0x28;
-	int index = gpio_pin & 0xF;
-
-	gpio->dir_reg	= bank_offset + 0x10;
-	gpio->set_reg	= bank_offset + 0x18;
-	gpio->clr_reg	= bank_offset + 0x1C;
-	gpio->in_reg	= bank_offset + 0x20;
-	gpio->reg_mask	= BIT(index + (bank & 1) * 16);
-}
+	int sample;
+	unsigned long duty_ticks, period_ticks;
 
-static irqreturn_t legoev3_fiq_gpio_irq_i2c_port_callback(int irq, void *port_data)
-{
-	struct legoev3_fiq_port_i2c_data *data = port_data;
-	int i;
+	if (unlikely(!data->requested_flag || !data->dma_area))
+		return;
 
-	local_fiq_disable();
+	period_ticks = fiq_ehrpwm_get_period_ticks();
 
-	if (data->transfer_state == TRANSFER_COMPLETE) {
-		for (i = 0; i < data->num_msg; i++)
-			memcpy(&data->xfer_msgs[i], &data->msgs[i],
-			       sizeof(struct i2c_msg));
-		fiq_gpio_set_value(&legoev3_fiq_data->status_gpio, 0);
-		data->transfer_state = TRANSFER_IDLE;
-		if (data->complete)
-			data->complete(data->xfer_result, data->context);
+	/*
+	 * Output silence instead of replaying stale data from the ring buffer
+	 * once we run out of data. Let ALSA know the first time this happens
+	 * so that a drain can complete without waiting for a full period.
+	 */
+	if (unlikely(!data->sub_count && fiq_ehrpwm_is_starved(data))) {
+		fiq_ehrpwm_set_duty_ticks((0x7FFF * period_ticks) >> 16);
+		if (!data->starved_flag) {
+			data->starved_flag = 1;
+			data->notify_ts = davinci_timer_read_freerun();
+			fiq_notify(FIQ_NOTIFY_EHRPWM);
+		}
+		return;
 	}
-	local_fiq_enable();
+	data->starved_flag = 0;
 
-	return IRQ_HANDLED;
-}
+	if (data->decimate > 1) {
+		sample = fiq_ehrpwm_next_decimated(data);
+	} else if (!(data->filter_flags & LEGOEV3_FIQ_EHRPWM_INTERPOLATE)) {
+		sample = fiq_ehrpwm_next_sample(data);
+	} else {
+		/*
+		 * The interrupt fires on every PWM period and each sample is
+		 * spread over oversample periods, ramping linearly from the
+		 * previous sample. This delays the output by one sample.
+		 */
+		if (!data->sub_count) {
+			data->prev_sample = data->cur_sample;
+			data->cur_sample = fiq_ehrpwm_next_sample(data);
+			data->interp_step = ((data->cur_sample - data->prev_sample)
+					     * (int)data->oversample_recip) >> 16;
+		}
+		if (++data->sub_count >= data->oversample) {
+			data->sub_count = 0;
+			sample = data->cur_sample;
+		} else
+			sample = data->prev_sample
+				 + data->interp_step * (int)data->sub_count;
+	}
+
+	if (data->filter_flags & LEGOEV3_FIQ_EHRPWM_NOISE_SHAPE) {
+		/*
+		 * First order noise shaping: carry the part of the duty cycle
+		 * that was lost to truncation over to the next period.
+		 */
+		duty_ticks = (sample + 0x8000) * period_ticks + data->shape_error;
+		data->shape_error = duty_ticks & 0xFFFF;
+		duty_ticks >>= 16;
+	} else
+		duty_ticks = ((sample + 0x8000) * period_ticks) >> 16;
+
+	fiq_ehrpwm_set_duty_ticks(duty_ticks);
+}
+
+/*
+ * Change of position for each (previous state << 2 | new state), where the
+ * state is (int << 1 | dir). 0 means that both pins changed at once, so an
+ * edge was missed.
+ */
+static const s8 fiq_encoder_delta[16] = {
+	[0x1] = 1, [0x7] = 1, [0xe] = 1, [0x8] = 1,
+	[0x2] = -1, [0xb] = -1, [0xd] = -1, [0x4] = -1,
+};
+
+static inline u8 fiq_encoder_read_state(struct legoev3_fiq_encoder_data *enc)
+{
+	return fiq_gpio_get_value(&enc->gpio[FIQ_ENCODER_PIN_INT]) << 1
+		| fiq_gpio_get_value(&enc->gpio[FIQ_ENCODER_PIN_DIR]);
+}
+
+static inline void __fiq_text
+fiq_encoder_sample(struct legoev3_fiq_encoder_data *enc,
+		   struct fiq_gpio_batch *b)
+{
+	u8 state = fiq_batch_get_value(b, &enc->gpio[FIQ_ENCODER_PIN_INT]) << 1
+		   | fiq_batch_get_value(b, &enc->gpio[FIQ_ENCODER_PIN_DIR]);
+	s8 delta;
+
+	if (state == enc->state)
+		return;
+
+	delta = fiq_encoder_delta[enc->state << 2 | state];
+	enc->state = state;
+	if (delta)
+		enc->position += delta;
+	else
+		enc->missed++;
+	enc->timestamp = davinci_timer_read_freerun();
+	enc->seq++;
+}
+
+#ifdef CONFIG_LEGOEV3_FIQ_PERF
+/*
+ * Reads sp, lr and fp of another mode. The operands are pinned to r0-r3
+ * because r8-r12 are banked in FIQ mode, so using them here would clobber
+ * the ones of the interrupted code.
+ */
+static inline void __fiq_text
+fiq_perf_banked_regs(u32 mode, u32 *sp, u32 *lr, u32 *fp)
+{
+	register u32 r0 asm("r0") = mode | PSR_I_BIT | PSR_F_BIT;
+	register u32 r1 asm("r1");
+	register u32 r2 asm("r2");
+	register u32 r3 asm("r3");
+
+	asm volatile(
+	"	msr	cpsr_c, %3\n"
+	"	mov	%0, sp\n"
+	"	mov	%1, lr\n"
+	"	mov	%2, fp\n"
+	"	msr	cpsr_c, %4\n"
+	: "=r" (r1), "=r" (r2), "=r" (r3)
+	: "r" (r0), "I" (PSR_I_BIT | PSR_F_BIT | FIQ_MODE));
+
+	*sp = r1;
+	*lr = r2;
+	*fp = r3;
+}
+
+/*
+ * Takes a perf sample of the code this FIQ interrupted, which may well have
+ * IRQs disabled. Returns true while sampling, so that the timer keeps
+ * running.
+ */
+static bool __fiq_text fiq_perf_tick(struct legoev3_fiq_data *fiq_data)
+{
+	struct legoev3_fiq_perf *perf = &fiq_data->perf;
+	struct legoev3_fiq_perf_sample *s;
+	struct thread_info *ti;
+	u32 *frame = (u32 *)((u8 *)fiq_data->fiq_stack + FIQ_STACK_SIZE);
+	u32 mode, sp, fp, sp_svc, unused;
+
+	if (!perf->period)
+		return false;
+	if (--perf->countdown)
+		return true;
+	perf->countdown = perf->period;
+
+	if (perf->head - perf->tail >= FIQ_PERF_RING_SIZE) {
+		perf->dropped++;
+		return true;
+	}
+	s = &perf->ring[perf->head & (FIQ_PERF_RING_SIZE - 1)];
+
+	/* __fiq_c_entry pushed the return address last, on top of our stack */
+	s->pc = frame[-1];
+	asm volatile("mrs %0, spsr" : "=r" (s->cpsr));
+	mode = s->cpsr & MODE_MASK;
+	fiq_perf_banked_regs(mode == USR_MODE ? SYSTEM_MODE : mode,
+			     &sp, &s->lr, &fp);
+	if (mode == SVC_MODE)
+		sp_svc = sp;
+	else
+		fiq_perf_banked_regs(SVC_MODE, &sp_svc, &unused, &unused);
+
+	/* current is meaningless in FIQ mode, go by the SVC stack instead */
+	ti = (struct thread_info *)(sp_svc & ~(THREAD_SIZE - 1));
+	s->pid = ti->task->tgid;
+	s->tid = ti->task->pid;
+	s->timestamp = davinci_timer_read_freerun();
+	s->period = perf->period;
+
+	s->callchain[0] = s->pc;
+	s->nr = 1;
+#ifndef CONFIG_ARM_UNWIND
+	/* same frame pointer walk as unwind_frame(), kernel only */
+	if (mode != USR_MODE) {
+		u32 high = ALIGN(sp, THREAD_SIZE);
+
+		while (s->nr < FIQ_PERF_MAX_DEPTH &&
+		       fp >= sp + 12 && fp <= high - 4) {
+			s->callchain[s->nr++] = *(u32 *)(fp - 4);
+			sp = *(u32 *)(fp - 8);
+			fp = *(u32 *)(fp - 12);
+		}
+	}
+#endif
+
+	/* the sample must be complete before the drain can see it */
+	barrier();
+	perf->head++;
+
+	return true;
+}
+#else
+static inline bool fiq_perf_tick(struct legoev3_fiq_data *fiq_data)
+{
+	return false;
+}
+#endif
+
+/*
+ * The timer handler, specialized by legoev3_fiq_timer_update() for the
+ * features in use. encoders and i2c are constants in each of the variants
+ * below, so the compiler drops the parts that are not needed.
+ */
+static __always_inline void
+fiq_timer_run(struct legoev3_fiq_data *fiq_data, bool encoders, bool i2c)
+{
+	struct legoev3_fiq_port_i2c_data *port_data;
+	struct fiq_gpio_batch batch;
+	int restart_timer = 0;
+	int i;
+
+	batch.touched = 0;
+	batch.in_valid = 0;
+
+	/* the fiqsource counter restarts at 0 when the irq is raised */
+	fiq_stats_add(FIQ_STATS_I2C_TIMER, davinci_timer_read_fiqsource());
+
+	if (encoders) {
+		for (i = 0; i < fiq_data->encoder_ports.num; i++)
+			fiq_encoder_sample(&fiq_data->encoder_data[
+					   fiq_data->encoder_ports.port[i]],
+					   &batch);
+		restart_timer = 1;
+	}
+
+	for (i = 0; i2c && i < fiq_data->i2c_ports.num; i++) {
+		port_data = &fiq_data->port_data[fiq_data->i2c_ports.port[i]];
+		if (port_data->transfer_state == TRANSFER_IDLE)
+			continue;
+		/* slow ports only run on every clock_div'th tick */
+		if (port_data->clock_skip) {
+			port_data->clock_skip--;
+			restart_timer = 1;
+			continue;
+		}
+		port_data->clock_skip = port_data->clock_div - 1;
+		restart_timer |= legoev3_fiq_timer_callback(port_data, &batch);
+	}
+	fiq_batch_flush(&batch);
+
+	if (fiq_perf_tick(fiq_data))
+		restart_timer = 1;
+
+	if (!restart_timer)
+		legoev3_fiq_disable(fiq_data->timer_irq);
+}
+
+static void __fiq_text legoev3_fiq_timer_handler(void *data)
+{
+	fiq_timer_run(data, true, true);
+}
+
+static void __fiq_text legoev3_fiq_timer_handler_i2c(void *data)
+{
+	fiq_timer_run(data, false, true);
+}
+
+static void __fiq_text legoev3_fiq_timer_handler_encoder(void *data)
+{
+	fiq_timer_run(data, true, false);
+}
+
+static void __fiq_text legoev3_fiq_ehrpwm_handler(void *data)
+{
+	fiq_stats_ehrpwm(fiq_stats_timestamp());
+	legoev3_fiq_ehrpwm_callback(data);
+	fiq_ehrpwm_clear_irq();
+}
+
+static inline void __fiq_text
+fiq_uart_sample(struct legoev3_fiq_uart_data *uart, int port_id)
+{
+	bool level = fiq_gpio_get_value(&uart->rx);
+
+	switch (uart->state) {
+	case FIQ_UART_IDLE:
+		if (level)
+			return;
+		/* on average, the start edge was half a tick ago */
+		uart->phase = uart->step >> 1;
+		uart->next_sample = 0x8000;
+		uart->bit = 0;
+		uart->state = FIQ_UART_RX;
+		return;
+	case FIQ_UART_RX:
+		uart->phase += uart->step;
+		if (uart->phase < uart->next_sample)
+			return;
+		uart->next_sample += 0x10000;
+		break;
+	case FIQ_UART_BREAK:
+		if (level)
+			uart->state = FIQ_UART_IDLE;
+		return;
+	}
+
+	/* sampling in the middle of a bit */
+	if (uart->bit == 0) {
+		if (level)
+			uart->state = FIQ_UART_IDLE;	/* just a glitch */
+	} else if (uart->bit <= 8) {
+		uart->byte = uart->byte >> 1 | level << 7;
+	} else {
+		if (!level) {
+			uart->framing_errors++;
+			uart->state = FIQ_UART_BREAK;
+			return;
+		}
+		if (uart->ring_head - uart->ring_tail < FIQ_UART_RING_LEN) {
+			uart->ring[uart->ring_head & FIQ_UART_RING_MASK] =
+				uart->byte;
+			uart->ring_head++;
+			fiq_notify(FIQ_NOTIFY_UART(port_id));
+		} else
+			uart->overruns++;
+		uart->state = FIQ_UART_IDLE;
+	}
+	uart->bit++;
+}
+
+static void __fiq_text legoev3_fiq_uart_handler(void *data)
+{
+	struct legoev3_fiq_data *fiq_data = data;
+	int i, port;
+
+	for (i = 0; i < fiq_data->uart_ports.num; i++) {
+		port = fiq_data->uart_ports.port[i];
+		fiq_uart_sample(&fiq_data->uart_data[port], port);
+	}
+}
+
+/*
+ * Runs the handler of each pending FIQ in priority order. The cp_intc status
+ * is cleared after the handler returns, so handlers only have to clear the
+ * interrupt in their peripheral.
+ */
+void __fiq_text legoev3_fiq_handler(void)
+{
+	u32 timestamp = fiq_stats_timestamp();
+	struct ramoops_irqtrace *trace;
+	struct legoev3_fiq_client *client;
+	u32 irq;
+
+	trace = ramoops_irqtrace_get(RAMOOPS_IRQTRACE_FIQ);
+
+	for (;;) {
+		irq = legoev3_fiq_get_irq();
+		if (irq & GPIR_NONE || unlikely(irq >= FIQ_NUM_IRQ))
+			break;
+		client = &legoev3_fiq_data->clients[irq];
+		if (unlikely(!client->handler))
+			break;
+		if (trace)
+			fiq_irqtrace_add(trace, irq);
+		client->handler(client->data);
+		legoev3_fiq_ack(irq);
+	}
+
+	fiq_stats_add(FIQ_STATS_DURATION, fiq_stats_timestamp() - timestamp);
+}
+
+/**
+ * legoev3_fiq_enable_irq - Enable an interrupt that is handled by the FIQ.
+ * @irq: The cp_intc system interrupt.
+ *
+ * This is safe to call from any context, including FIQ handlers.
+ */
+void __fiq_text legoev3_fiq_enable_irq(unsigned irq)
+{
+	legoev3_fiq_enable(irq);
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_enable_irq);
+
+/**
+ * legoev3_fiq_disable_irq - Disable an interrupt that is handled by the FIQ.
+ * @irq: The cp_intc system interrupt.
+ *
+ * This is safe to call from any context, including FIQ handlers.
+ */
+void __fiq_text legoev3_fiq_disable_irq(unsigned irq)
+{
+	legoev3_fiq_disable(irq);
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_disable_irq);
+
+/* --------------- END OF CODE THAT IS CALLED IN FIQ CONTEXT -----------------*/
+
+static void legoev3_fiq_set_gpio(int gpio_pin, struct legoev3_fiq_gpio *gpio)
+{
+	int bank = gpio_pin >> 4;
+	int bank_offset = (bank >> 1) * FIQ_GPIO_BANK_STRIDE;
+	int index = gpio_pin & 0xF;
+
+	gpio->bank	= bank >> 1;
+	gpio->dir_reg	= bank_offset + FIQ_GPIO_DIR;
+	gpio->set_reg	= bank_offset + FIQ_GPIO_SET_DATA;
+	gpio->clr_reg	= bank_offset + FIQ_GPIO_CLR_DATA;
+	gpio->in_reg	= bank_offset + FIQ_GPIO_IN_DATA;
+	gpio->reg_mask	= BIT(index + (bank & 1) * 16);
+}
+
+static void fiq_port_list_build(struct fiq_port_list *list, int flags)
+{
+	int i;
+
+	list->num = 0;
+	for (i = 0; i < ARRAY_SIZE(list->port); i++) {
+		if (flags & BIT(i))
+			list->port[list->num++] = i;
+	}
+}
+
+/*
+ * Rebuilds the lists of I2C ports and encoders and picks the variant of the
+ * timer handler that only does what they need. Must be called with the FIQ
+ * disabled, after changing port_req_flags or encoder_req_flags.
+ */
+static void legoev3_fiq_timer_update(struct legoev3_fiq_data *fiq_data)
+{
+	legoev3_fiq_handler_t handler = legoev3_fiq_timer_handler;
+
+	fiq_port_list_build(&fiq_data->i2c_ports, fiq_data->port_req_flags);
+	fiq_port_list_build(&fiq_data->encoder_ports,
+			    fiq_data->encoder_req_flags);
+	if (!fiq_data->encoder_req_flags)
+		handler = legoev3_fiq_timer_handler_i2c;
+	else if (!fiq_data->port_req_flags)
+		handler = legoev3_fiq_timer_handler_encoder;
+	fiq_data->clients[fiq_data->timer_irq].handler = handler;
+}
+
+struct legoev3_fiq_i2c_builder {
+	u8 *prog;
+	unsigned len;
+	bool overflow;
+	bool stretch;
+};
+
+static void legoev3_fiq_i2c_emit(struct legoev3_fiq_i2c_builder *b, u8 op)
+{
+	if (b->len < FIQ_I2C_PROG_LEN)
+		b->prog[b->len++] = op;
+	else
+		b->overflow = true;
+}
+
+static void legoev3_fiq_i2c_emit_wait(struct legoev3_fiq_i2c_builder *b,
+				      unsigned ticks)
+{
+	while (ticks--)
+		legoev3_fiq_i2c_emit(b, FIQ_OP_NONE);
+}
+
+/*
+ * The gap before each data byte. Without clock stretching this is a fixed
+ * delay that is long enough for the slowest known sensor. With it, SCL is
+ * released for the first bit of the byte right away and the FIQ waits for as
+ * long as the slave holds it low. The wait has to be part of that first
+ * clock pulse, a pulse of its own would shift the byte by one bit whenever
+ * the slave doesn't stretch.
+ */
+static void legoev3_fiq_i2c_emit_gap(struct legoev3_fiq_i2c_builder *b,
+				     unsigned ticks, bool stretch)
+{
+	if (stretch) {
+		legoev3_fiq_i2c_emit(b, FIQ_OP_NONE);
+		b->stretch = true;
+	} else {
+		legoev3_fiq_i2c_emit_wait(b, ticks);
+	}
+}
+
+/* Waits for SCL to go high after it was released for a gap. */
+static void legoev3_fiq_i2c_emit_stretch(struct legoev3_fiq_i2c_builder *b)
+{
+	if (b->stretch) {
+		legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_STRETCH);
+		b->stretch = false;
+	}
+}
+
+static void legoev3_fiq_i2c_emit_write(struct legoev3_fiq_i2c_builder *b,
+				       u8 byte)
+{
+	u8 mask;
+
+	for (mask = 0x80; mask; mask >>= 1) {
+		legoev3_fiq_i2c_emit(b, (byte & mask) ? FIQ_OP_SDA_HIGH
+						      : FIQ_OP_SDA_LOW);
+		legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_NONE);
+		legoev3_fiq_i2c_emit_stretch(b);
+	}
+	/* read ACK from slave */
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SDA_IN);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_ACK);
+}
+
+static void legoev3_fiq_i2c_emit_read_bits(struct legoev3_fiq_i2c_builder *b,
+					   u8 store_op)
+{
+	int i;
+
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SDA_IN);
+	if (b->stretch) {
+		/* only sample once the slave has let go of SCL */
+		legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_NONE);
+		legoev3_fiq_i2c_emit_stretch(b);
+	}
+	for (i = 0; i < 8; i++) {
+		if (i)
+			legoev3_fiq_i2c_emit(b, FIQ_OP_NONE);
+		legoev3_fiq_i2c_emit(b, FIQ_OP_SCL |
+				     (i == 7 ? store_op : FIQ_OP_SAMPLE));
+	}
+}
+
+static void legoev3_fiq_i2c_emit_read(struct legoev3_fiq_i2c_builder *b,
+				      bool last)
+{
+	legoev3_fiq_i2c_emit_read_bits(b, FIQ_OP_STORE);
+	/* ACK (or NACK the last byte read) */
+	legoev3_fiq_i2c_emit(b, last ? FIQ_OP_SDA_HIGH : FIQ_OP_SDA_LOW);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_NONE);
+}
+
+/*
+ * I2C_M_RECV_LEN: the first byte read is the number of bytes that follow.
+ * Those are read by one loop in the program that the FIQ runs until the
+ * count is used up, so the length of the program does not depend on it.
+ */
+static void
+legoev3_fiq_i2c_emit_read_block(struct legoev3_fiq_i2c_builder *b,
+				struct legoev3_fiq_i2c_xfer *xfer, bool stretch)
+{
+	legoev3_fiq_i2c_emit_gap(b, 5, stretch);
+	legoev3_fiq_i2c_emit_read_bits(b, FIQ_OP_STORE_LEN);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SDA_LOW);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_NONE);
+
+	xfer->loop_pc = b->len;
+	legoev3_fiq_i2c_emit_gap(b, 3, stretch);
+	legoev3_fiq_i2c_emit_read_bits(b, FIQ_OP_STORE);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SDA_ACK);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_LOOP);
+}
+
+/*
+ * Bus recovery, run after a failed transaction if retries are enabled, see
+ * legoev3_fiq_set_retries(). Nine clock pulses with SDA released make any
+ * slave that is still in the middle of a byte finish it and let go of SDA,
+ * then a stop condition puts every slave back into the idle state.
+ */
+static void legoev3_fiq_i2c_emit_recover(struct legoev3_fiq_i2c_builder *b)
+{
+	int i;
+
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SDA_IN);
+	for (i = 0; i < 9; i++) {
+		legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_NONE);
+		legoev3_fiq_i2c_emit(b, FIQ_OP_NONE);
+	}
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SDA_LOW);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_NONE);
+	/* let the pull-up raise SDA, a slave may still be pulling it low */
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_SDA_IN);
+	legoev3_fiq_i2c_emit(b, FIQ_OP_SCL | FIQ_OP_RETRY);
+}
+
+/*
+ * Translates the messages of a transaction into the program that is run by
+ * the FIQ. This produces exactly the same waveform as the original per-tick
+ * state machine from lms2012, unless clock stretching is enabled for the
+ * port. At most one message can be an I2C_M_RECV_LEN read, its buffer must
+ * have room for I2C_SMBUS_BLOCK_MAX more bytes than the initial len, which
+ * must be at least 1 for the count.
+ */
+static int legoev3_fiq_i2c_compile(struct legoev3_fiq_port_i2c_data *data,
+				   struct legoev3_fiq_i2c_xfer *xfer)
+{
+	bool stretch = data->stretch_timeout;
+	struct legoev3_fiq_i2c_builder b = { .prog = xfer->prog };
+	struct i2c_msg *msg;
+	bool recv_len = false;
+	int i, j;
+
+	xfer->num_bytes = 0;
+	xfer->recv_len = 0;
+	for (i = 0; i < xfer->num_msg; i++) {
+		msg = &xfer->msgs[i];
+		xfer->num_bytes += msg->len;
+
+		if (msg->flags & I2C_M_RECV_LEN) {
+			if (recv_len || !(msg->flags & I2C_M_RD) || !msg->len)
+				return -EINVAL;
+			recv_len = true;
+			xfer->recv_len = msg->len;
+		}
+
+		if (i == 0) {
+			/* start condition - sda high to low while clk high */
+			legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_SDA_LOW);
+		} else {
+			/*
+			 * This is some non-standard i2c weirdness for
+			 * compatibility with the NXT ultrasonic sensor.
+			 *
+			 * Normal i2c would just send a restart (sda high
+			 * to low while clk is high) between writing the
+			 * address and reading the data. Instead, we send
+			 * a stop (sda low to high while clk is high) and
+			 * then do an extra clock cycle (low then high)
+			 * before sending a start and reading the data.
+			 */
+			legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_SDA_HIGH);
+			legoev3_fiq_i2c_emit(&b, FIQ_OP_SDA_HIGH);
+			legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_NONE);
+			legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_NEXT_MSG
+						 | FIQ_OP_SDA_LOW);
+		}
+
+		legoev3_fiq_i2c_emit_write(&b, (msg->addr << 1)
+					   | ((msg->flags & I2C_M_RD) ? 1 : 0));
+
+		for (j = 0; j < msg->len; j++) {
+			if (msg->flags & I2C_M_RECV_LEN) {
+				legoev3_fiq_i2c_emit_read_block(&b, xfer,
+								stretch);
+				break;
+			} else if (msg->flags & I2C_M_RD) {
+				legoev3_fiq_i2c_emit_gap(&b, j ? 3 : 5, stretch);
+				legoev3_fiq_i2c_emit_read(&b, j == msg->len - 1);
+			} else {
+				legoev3_fiq_i2c_emit_gap(&b, 5, stretch);
+				legoev3_fiq_i2c_emit_write(&b, msg->buf[j]);
+			}
+		}
+
+		/*
+		 * Note: The official LEGO firmware does not generate stop
+		 * condition except for in the middle of reads (see above).
+		 * We are going by the book and doing a stop when we are
+		 * supposed to. We can change it back if there are problems.
+		 */
+		if (i == xfer->num_msg - 1)
+			break;
+		legoev3_fiq_i2c_emit(&b, FIQ_OP_SDA_LOW);
+		legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_SDA_LOW);
+	}
+
+	/* a NACK anywhere jumps straight to the final stop condition */
+	xfer->stop_pc = b.len;
+	legoev3_fiq_i2c_emit(&b, FIQ_OP_SDA_LOW);
+	legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_SDA_LOW);
+	legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_NONE);
+	legoev3_fiq_i2c_emit(&b, FIQ_OP_SCL | FIQ_OP_END);
+
+	xfer->recover_pc = b.len;
+	legoev3_fiq_i2c_emit_recover(&b);
+
+	return b.overflow ? -EINVAL : 0;
+}
+
+/* Total length of the write or read messages, for the tracepoints */
+static unsigned legoev3_fiq_i2c_len(const struct i2c_msg *msgs, int num_msg,
+				    bool read)
+{
+	unsigned len = 0;
+	int i;
+
+	for (i = 0; i < num_msg; i++) {
+		if (!(msgs[i].flags & I2C_M_RD) == !read)
+			len += msgs[i].len;
+	}
+
+	return len;
+}
+
+static void legoev3_fiq_i2c_port_drain(struct legoev3_fiq_port_i2c_data *data)
+{
+	struct legoev3_fiq_i2c_periodic *periodic = &data->periodic;
+	struct legoev3_fiq_i2c_xfer *xfer;
+	void (*complete)(int, void *);
+	legoev3_fiq_periodic_notify_t notify;
+	void *context;
+	unsigned num_msg, wlen, rlen, seq;
+	u32 queued_ts, start_ts, end_ts, now;
+	int result;
+
+	local_fiq_disable();
+	/* Drain every transaction that the FIQ finished since the last edge. */
+	while (data->queue_done != data->queue_tail) {
+		xfer = &data->queue[data->queue_done & FIQ_I2C_QUEUE_MASK];
+		memcpy(xfer->xfer_msgs, xfer->msgs,
+		       xfer->num_msg * sizeof(struct i2c_msg));
+		complete = xfer->complete;
+		context = xfer->context;
+		result = xfer->xfer_result;
+		num_msg = xfer->num_msg;
+		wlen = legoev3_fiq_i2c_len(xfer->msgs, num_msg, false);
+		rlen = legoev3_fiq_i2c_len(xfer->msgs, num_msg, true);
+		queued_ts = xfer->queued_ts;
+		start_ts = xfer->start_ts;
+		end_ts = xfer->end_ts;
+		/* the slot may be reused as soon as queue_done moves past it */
+		data->queue_done++;
+
+		/*
+		 * complete() is called with the FIQ enabled so that it can
+		 * queue the next transaction without stalling the other ports.
+		 */
+		local_fiq_enable();
+		now = davinci_timer_read_freerun();
+		if (result == -ENXIO)
+			trace_legoev3_fiq_i2c_nack(data->port_id, num_msg, wlen,
+						   rlen, result, queued_ts,
+						   start_ts, end_ts, now);
+		else
+			trace_legoev3_fiq_i2c_complete(data->port_id, num_msg,
+						       wlen, rlen, result,
+						       queued_ts, start_ts,
+						       end_ts, now);
+		if (complete)
+			complete(result, context);
+		local_fiq_disable();
+	}
+
+	/* the periodic transfer shares the notify bit of its port */
+	notify = periodic->notify;
+	seq = periodic->slot->seq;
+	if (notify && seq != periodic->notify_seq) {
+		periodic->notify_seq = seq;
+		end_ts = periodic->xfer.end_ts;
+		context = periodic->notify_context;
+		local_fiq_enable();
+		now = davinci_timer_read_freerun();
+		notify(context, seq, div_u64((u64)(now - end_ts) * NSEC_PER_SEC,
+					     davinci_timer_get_tick_rate()));
+		return;
+	}
+	local_fiq_enable();
+}
+
+static void legoev3_fiq_ehrpwm_period_elapsed(struct legoev3_fiq_ehrpwm_data *data)
+{
+	local_fiq_disable();
+	if (data->requested_flag && data->period_elapsed) {
+		trace_legoev3_fiq_period_elapsed(data->hw_frames,
+						 data->starved_flag,
+						 data->notify_ts,
+						 davinci_timer_read_freerun());
+		data->period_elapsed(data->period_elapsed_data);
+	}
+	local_fiq_enable();
+}
+
+static irqreturn_t legoev3_fiq_status_gpio_irq_callback(int irq, void *dev_id)
+{
+	struct legoev3_fiq_data *fiq_data = dev_id;
+	unsigned pending;
+	int i;
+
+	/*
+	 * Collect all events and lower the status gpio in one go so that the
+	 * next event from the FIQ is guaranteed to produce a new edge.
+	 */
+	local_fiq_disable();
+	pending = fiq_data->notify_mask;
+	fiq_data->notify_mask = 0;
+	fiq_gpio_set_value(&fiq_data->status_gpio, 0);
+	local_fiq_enable();
+
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		if (pending & BIT(i))
+			legoev3_fiq_i2c_port_drain(&fiq_data->port_data[i]);
+	}
+	if (pending & FIQ_NOTIFY_EHRPWM)
+		legoev3_fiq_ehrpwm_period_elapsed(&fiq_data->ehrpwm_data);
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		struct legoev3_fiq_uart_data *uart = &fiq_data->uart_data[i];
+
+		if ((pending & FIQ_NOTIFY_UART(i)) && uart->rx_callback)
+			uart->rx_callback(uart->context);
+	}
+
+	return pending ? IRQ_HANDLED : IRQ_NONE;
+}
+
+static int __legoev3_fiq_request_irq(struct legoev3_fiq_data *fiq_data,
+				     unsigned irq, unsigned channel,
+				     legoev3_fiq_handler_t handler, void *data)
+{
+	struct legoev3_fiq_client *client;
+
+	if (irq >= FIQ_NUM_IRQ || channel >= LEGOEV3_FIQ_NUM_CHANNELS ||
+	    !handler)
+		return -EINVAL;
+
+	client = &fiq_data->clients[irq];
+	if (client->handler)
+		return -EBUSY;
+
+	local_fiq_disable();
+	client->data = data;
+	client->handler = handler;
+	client->prev_channel = cp_intc_get_channel(irq);
+	cp_intc_set_channel(irq, channel);
+	local_fiq_enable();
+
+	return 0;
+}
+
+/**
+ * legoev3_fiq_request_irq - Handle a cp_intc interrupt in the FIQ.
+ * @irq: The cp_intc system interrupt.
+ * @channel: 0 or 1. Pending FIQs on channel 0 are handled first.
+ * @handler: Function called in FIQ context each time the interrupt fires.
+ * @data: Pointer that is passed as an argument to handler.
+ *
+ * The interrupt is routed to nFIQ, but it is not enabled, see
+ * legoev3_fiq_enable_irq(). The handler is subject to the same restrictions
+ * as all other FIQ code in this file and should be marked __fiq_text. It must
+ * clear the interrupt in its peripheral, the cp_intc status is cleared by the
+ * caller.
+ *
+ * Returns 0 on success, -ENODEV if the FIQ backend is not loaded, -EINVAL on
+ * bad arguments or -EBUSY if the interrupt already has a FIQ handler.
+ */
+int legoev3_fiq_request_irq(unsigned irq, unsigned channel,
+			    legoev3_fiq_handler_t handler, void *data)
+{
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+
+	return __legoev3_fiq_request_irq(legoev3_fiq_data, irq, channel,
+					 handler, data);
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_request_irq);
+
+/**
+ * legoev3_fiq_free_irq - Stop handling a cp_intc interrupt in the FIQ.
+ * @irq: The interrupt that was passed to legoev3_fiq_request_irq().
+ *
+ * The interrupt is disabled and routed back to its previous channel.
+ */
+void legoev3_fiq_free_irq(unsigned irq)
+{
+	struct legoev3_fiq_client *client;
+
+	if (!legoev3_fiq_data || irq >= FIQ_NUM_IRQ)
+		return;
+
+	client = &legoev3_fiq_data->clients[irq];
+	if (WARN_ON(!client->handler))
+		return;
+
+	local_fiq_disable();
+	legoev3_fiq_disable(irq);
+	legoev3_fiq_ack(irq);
+	cp_intc_set_channel(irq, client->prev_channel);
+	client->handler = NULL;
+	client->data = NULL;
+	local_fiq_enable();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_free_irq);
+
+/**
+ * legoev3_fiq_request_port - Requests ownership of the I2C backend for the
+ *	specified port.
+ * @port_id: The port identifier.
+ * @sda_pin: The GPIO pin to use for the I2C data line. This GPIO should
+ *	already be requested and set high by the calling code and not
+ *	touched again until legoev3_fiq_release_port is called.
+ * @scl_pin: The GPIO pin to use for the I2C clock line. Same notes apply
+ *	as on the sda_pin.
+ *
+ * With CONFIG_LEGOEV3_PRU_I2C, the port is handed to the PRU backend when its
+ * firmware can be booted, which may sleep, and all port functions below are
+ * passed on to it. Periodic transfers are only available on the FIQ.
+ *
+ * Returns 0 if the port is available or -EBUSY if it has already be requested.
+ */
+int legoev3_fiq_request_port(enum legoev3_input_port_id port_id, int sda_pin,
+			     int scl_pin)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+	int ret;
+
+	ret = legoev3_pru_i2c_request_port(port_id, sda_pin, scl_pin);
+	if (ret != -ENODEV)
+		return ret;
+
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (legoev3_fiq_data->port_req_flags & BIT(port_id))
+		return -EBUSY;
+
+	data = &legoev3_fiq_data->port_data[port_id];
+	legoev3_fiq_set_gpio(sda_pin, &data->gpio[FIQ_I2C_PIN_SDA]);
+	legoev3_fiq_set_gpio(scl_pin, &data->gpio[FIQ_I2C_PIN_SCL]);
+
+	data->port_id = port_id;
+	data->transfer_state = TRANSFER_IDLE;
+	data->queue_head = data->queue_tail = data->queue_done = 0;
+	data->cur_xfer = &data->queue[0];
+	data->periodic.enabled = 0;
+	data->periodic.notify = NULL;
+	data->clock_div = 1;
+	data->clock_skip = 0;
+	data->stretch_timeout = 0;
+	data->stretch_count = 0;
+	data->retries = 0;
+	data->retry_count = 0;
+
+	local_fiq_disable();
+	legoev3_fiq_data->port_req_flags |= BIT(port_id);
+	legoev3_fiq_timer_update(legoev3_fiq_data);
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_request_port);
+
+/**
+ * legoev3_fiq_set_clock_div - Set the I2C bit clock divider for a port.
+ * @port_id: The port identifier that was previously requested.
+ * @clock_div: Number of FIQ timer ticks per half clock cycle. 0 and 1 both
+ *	select the full timer rate.
+ *
+ * All ports share the TINT34_1 timer, so this lets slow sensors run at a
+ * lower speed without slowing down the other ports.
+ */
+int legoev3_fiq_set_clock_div(enum legoev3_input_port_id port_id,
+			      unsigned clock_div)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+
+	if (legoev3_pru_i2c_owns_port(port_id))
+		return legoev3_pru_i2c_set_clock_div(port_id, clock_div);
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (clock_div > U8_MAX)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->port_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	data = &legoev3_fiq_data->port_data[port_id];
+	local_fiq_disable();
+	data->clock_div = clock_div ? clock_div : 1;
+	data->clock_skip = 0;
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_set_clock_div);
+
+/**
+ * legoev3_fiq_set_clock_stretch - Let slaves on a port stretch the clock.
+ * @port_id: The port identifier that was previously requested.
+ * @timeout_us: How long a slave may hold SCL low before the transfer fails
+ *	with -ETIMEDOUT, or 0 to use the fixed delays instead.
+ *
+ * Normally, there is a fixed delay before each data byte that is long enough
+ * for the slowest known sensor. With clock stretching, the FIQ reads back SCL
+ * and only waits while the slave actually holds it low, which makes transfers
+ * to fast sensors shorter. Like the period of periodic transfers, the timeout
+ * is converted using the current clock divider. This only affects transfers
+ * that are started afterwards.
+ */
+int legoev3_fiq_set_clock_stretch(enum legoev3_input_port_id port_id,
+				  unsigned timeout_us)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+	unsigned ticks;
+
+	if (legoev3_pru_i2c_owns_port(port_id))
+		return legoev3_pru_i2c_set_clock_stretch(port_id, timeout_us);
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->port_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	data = &legoev3_fiq_data->port_data[port_id];
+	ticks = DIV_ROUND_UP(timeout_us, FIQ_TIMER_TICK_US * data->clock_div);
+	if (ticks > U16_MAX)
+		return -EINVAL;
+
+	local_fiq_disable();
+	data->stretch_timeout = ticks;
+	data->stretch_count = 0;
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_set_clock_stretch);
+
+/**
+ * legoev3_fiq_set_retries - Let the FIQ retry failed transactions on a port.
+ * @port_id: The port identifier that was previously requested.
+ * @retries: How many times a transaction that fails with -ENXIO, -ETIMEDOUT
+ *	or -EPROTO is started over before it completes with that error, or 0
+ *	to complete it right away.
+ *
+ * With retries enabled, every failed attempt is followed by bus recovery,
+ * nine clock pulses and a stop condition, so that a sensor that was unplugged
+ * in the middle of a transaction and is stuck driving SDA can't make the
+ * next one fail too. This is all done by the FIQ, so the complete() callback
+ * and the periodic slot only see the result of the last attempt and the
+ * transaction keeps its place in the queue. Retried transactions are sent
+ * again from the start, including any messages that were written before the
+ * failure. Takes effect with the next attempt.
+ */
+int legoev3_fiq_set_retries(enum legoev3_input_port_id port_id,
+			    unsigned retries)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+
+	if (legoev3_pru_i2c_owns_port(port_id))
+		return -EOPNOTSUPP;
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (retries > U8_MAX)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->port_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	data = &legoev3_fiq_data->port_data[port_id];
+	local_fiq_disable();
+	data->retries = retries;
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_set_retries);
+
+/**
+ * legoev3_fiq_release_port- Releases ownership of the I2C backend for the
+ *	specified port.
+ * @port_id: The port identifier.
+ */
+void legoev3_fiq_release_port(enum legoev3_input_port_id port_id)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+
+	if (legoev3_pru_i2c_owns_port(port_id)) {
+		legoev3_pru_i2c_release_port(port_id);
+		return;
+	}
+	if (!legoev3_fiq_data)
+		return;
+
+	data =  &legoev3_fiq_data->port_data[port_id];
+	local_fiq_disable();
+	data->transfer_state = TRANSFER_IDLE;
+	data->queue_head = data->queue_tail = data->queue_done = 0;
+	data->periodic.enabled = 0;
+	data->periodic.notify = NULL;
+	legoev3_fiq_data->port_req_flags &= ~BIT(port_id);
+	legoev3_fiq_timer_update(legoev3_fiq_data);
+	local_fiq_enable();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_release_port);
+
+/**
+ * legoev3_fiq_start_xfer- Start an I2C transfer on the specified port.
+ * @port_id: The port identifier that was previously requested.
+ * @msgs: The message data to transfer.
+ * @num_msg: Number of messages in msgs[].
+ * @complete: Function to call when transfer is complete.
+ * @context: Pointer that is passed as an argument to the complete function.
+ *
+ * You should only call this for a port that returned successfully from
+ * legoev3_fiq_request_port.
+ *
+ * Transfers are queued, so this can be called again before the previous
+ * transfer has completed. The FIQ runs queued transfers back to back and
+ * the complete functions of all transfers that have finished are called
+ * in one pass from the status gpio interrupt.
+ *
+ * An I2C_M_RECV_LEN read takes the count from the first byte read, the
+ * same transaction then reads that many more bytes and updates the len of
+ * the message in @msgs.
+ *
+ * Returns 0 on success, -EBUSY if the queue for this port is full or -EINVAL
+ * if the messages are too long for the FIQ program buffer. A block read with
+ * a count of 0 or more than I2C_SMBUS_BLOCK_MAX completes with -EPROTO.
+ */
+int legoev3_fiq_start_xfer(enum legoev3_input_port_id port_id,
+			   struct i2c_msg msgs[], int num_msg,
+			   void (*complete)(int, void *), void *context)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+	struct legoev3_fiq_i2c_xfer *xfer;
+	int ret;
+
+	if (legoev3_pru_i2c_owns_port(port_id))
+		return legoev3_pru_i2c_start_xfer(port_id, msgs, num_msg,
+						  complete, context);
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (num_msg < 1 || num_msg > LEGOEV3_FIQ_I2C_MAX_MSGS)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->port_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	data = &legoev3_fiq_data->port_data[port_id];
+	if (data->queue_head - data->queue_done >= FIQ_I2C_QUEUE_LEN)
+		return -EBUSY;
+
+	/*
+	 * The slot at queue_head is not visible to the fiq until queue_head
+	 * is incremented, so it can be filled in without disabling the fiq.
+	 */
+	xfer = &data->queue[data->queue_head & FIQ_I2C_QUEUE_MASK];
+	/* copy the messages so that fiq has exclusive access */
+	memcpy(xfer->msgs, msgs, num_msg * sizeof(struct i2c_msg));
+	/*
+	 * we also have to hang on to the real messages so that we can
+	 * copy any data read back to them when the transfer is complete.
+	 */
+	xfer->xfer_msgs = msgs;
+	xfer->num_msg = num_msg;
+	xfer->complete = complete;
+	xfer->context = context;
+	ret = legoev3_fiq_i2c_compile(data, xfer);
+	if (ret < 0)
+		return ret;
+	xfer->queued_ts = davinci_timer_read_freerun();
+
+	local_fiq_disable();
+	data->queue_head++;
+	if (data->transfer_state == TRANSFER_IDLE) {
+		data->cur_xfer = xfer;
+		data->transfer_state = TRANSFER_START;
+		legoev3_fiq_enable(legoev3_fiq_data->timer_irq);
+	}
+	local_fiq_enable();
+
+	trace_legoev3_fiq_i2c_start(port_id, num_msg,
+				    legoev3_fiq_i2c_len(msgs, num_msg, false),
+				    legoev3_fiq_i2c_len(msgs, num_msg, true),
+				    data->queue_head - data->queue_done,
+				    xfer->queued_ts);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_start_xfer);
+
+void legoev3_fiq_cancel_xfer(enum legoev3_input_port_id port_id)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+	unsigned pending;
+	bool active;
+
+	if (legoev3_pru_i2c_owns_port(port_id)) {
+		legoev3_pru_i2c_cancel_xfer(port_id);
+		return;
+	}
+	if (!legoev3_fiq_data)
+		return;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return;
+
+	data = &legoev3_fiq_data->port_data[port_id];
+	local_fiq_disable();
+	pending = data->queue_head - data->queue_done;
+	active = data->transfer_state != TRANSFER_IDLE;
+	data->transfer_state = TRANSFER_IDLE;
+	data->retry_count = 0;
+	/* drop everything that is still queued */
+	data->queue_head = data->queue_tail = data->queue_done = 0;
+	data->periodic.enabled = 0;
+	local_fiq_enable();
+
+	trace_legoev3_fiq_i2c_cancel(port_id, pending, active);
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_cancel_xfer);
+
+/**
+ * legoev3_fiq_start_periodic - Have the FIQ repeat a transfer on its own.
+ * @port_id: The port identifier that was previously requested.
+ * @msgs: The messages to transfer. At most one write message and one read
+ *	message. The data of the write message is copied, so msgs can be
+ *	freed as soon as this function returns.
+ * @num_msg: Number of messages in msgs[] (1 or 2).
+ * @period_us: Time between the start of each transfer in microseconds.
+ *
+ * The period is converted to timer ticks using the clock divider of the port
+ * at the time this is called. Transfers queued with legoev3_fiq_start_xfer()
+ * are still allowed and take priority over the periodic transfer. The data
+ * read back is retrieved with legoev3_fiq_read_periodic(), callers that want
+ * to know when there is new data use legoev3_fiq_set_periodic_notify().
+ *
+ * Returns 0 on success or -EBUSY if a periodic transfer is already running.
+ */
+int legoev3_fiq_start_periodic(enum legoev3_input_port_id port_id,
+			       struct i2c_msg msgs[], int num_msg,
+			       unsigned period_us)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+	struct legoev3_fiq_i2c_periodic *periodic;
+	bool have_write = false;
+	int i, ret = 0;
+
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (num_msg < 1 || num_msg > 2)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->port_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	data = &legoev3_fiq_data->port_data[port_id];
+	periodic = &data->periodic;
+
+	local_fiq_disable();
+
+	if (periodic->enabled || (data->cur_xfer == &periodic->xfer
+	    && data->transfer_state != TRANSFER_COMPLETE
+	    && data->transfer_state != TRANSFER_IDLE)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	periodic->read_msg = -1;
+	for (i = 0; i < num_msg; i++) {
+		/* the slots have a fixed length */
+		if (msgs[i].len > LEGOEV3_FIQ_I2C_PERIODIC_MAX_LEN ||
+		    msgs[i].flags & I2C_M_RECV_LEN) {
+			ret = -EINVAL;
+			goto out;
+		}
+		memcpy(&periodic->xfer.msgs[i], &msgs[i],
+		       sizeof(struct i2c_msg));
+		if (msgs[i].flags & I2C_M_RD) {
+			if (periodic->read_msg >= 0) {
+				ret = -EINVAL;
+				goto out;
+			}
+			periodic->read_msg = i;
+		} else {
+			if (have_write) {
+				ret = -EINVAL;
+				goto out;
+			}
+			have_write = true;
+			memcpy(periodic->wbuf, msgs[i].buf, msgs[i].len);
+			periodic->xfer.msgs[i].buf = periodic->wbuf;
+		}
+	}
+	periodic->xfer.xfer_msgs = NULL;
+	periodic->xfer.num_msg = num_msg;
+	periodic->xfer.complete = NULL;
+	ret = legoev3_fiq_i2c_compile(data, &periodic->xfer);
+	if (ret < 0)
+		goto out;
+	periodic->period = DIV_ROUND_UP(period_us,
+					FIQ_TIMER_TICK_US * data->clock_div);
+	periodic->countdown = 0;
+	periodic->slot->seq = 0;
+	periodic->slot->len = periodic->read_msg >= 0
+			      ? periodic->xfer.msgs[periodic->read_msg].len : 0;
+	periodic->enabled = 1;
+
+	if (data->transfer_state == TRANSFER_IDLE) {
+		data->transfer_state = TRANSFER_COMPLETE;
+		legoev3_fiq_enable(legoev3_fiq_data->timer_irq);
+	}
+out:
+	local_fiq_enable();
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_start_periodic);
+
+/**
+ * legoev3_fiq_stop_periodic - Stop a transfer started with
+ *	legoev3_fiq_start_periodic().
+ * @port_id: The port identifier.
+ *
+ * A transfer that is in progress is allowed to finish.
+ */
+void legoev3_fiq_stop_periodic(enum legoev3_input_port_id port_id)
+{
+	if (!legoev3_fiq_data)
+		return;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return;
+
+	legoev3_fiq_data->port_data[port_id].periodic.enabled = 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_stop_periodic);
+
+/**
+ * legoev3_fiq_read_periodic - Get the latest data from a periodic transfer.
+ * @port_id: The port identifier.
+ * @buf: Buffer to copy data to.
+ * @len: Size of buf. Only the length of the read message is copied if
+ *	it is smaller.
+ * @seq: If not NULL, returns the sequence number of the data so callers can
+ *	tell if it has changed since the last call.
+ *
+ * This does not take any locks or disable the FIQ, so it is safe to call
+ * from any context.
+ *
+ * Returns the result of that transfer (0 or a negative error code) or
+ * -EAGAIN if no transfer has completed yet.
+ */
+int legoev3_fiq_read_periodic(enum legoev3_input_port_id port_id, u8 *buf,
+			      unsigned len, unsigned *seq)
+{
+	struct legoev3_fiq_periodic_slot *slot;
+	unsigned start_seq;
+	int ret;
+
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+
+	slot = legoev3_fiq_data->port_data[port_id].periodic.slot;
+	do {
+		start_seq = READ_ONCE(slot->seq);
+		barrier();
+		if (!start_seq)
+			return -EAGAIN;
+		memcpy(buf, slot->buf[start_seq & 1], min(len, slot->len));
+		ret = slot->result[start_seq & 1];
+		barrier();
+	} while (READ_ONCE(slot->seq) != start_seq);
+
+	if (seq)
+		*seq = start_seq;
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_read_periodic);
+
+/**
+ * legoev3_fiq_get_periodic_slot - Get the buffers of a periodic transfer.
+ * @port_id: The port identifier.
+ *
+ * The FIQ reads the data of the periodic transfer directly into the returned
+ * slot, so callers that only need a few bytes can read them in place instead
+ * of copying the whole message with legoev3_fiq_read_periodic(). See struct
+ * legoev3_fiq_periodic_slot for how to get a consistent read. The slot stays
+ * valid for as long as the port is requested.
+ *
+ * Returns NULL if the FIQ is not available.
+ */
+const struct legoev3_fiq_periodic_slot *
+legoev3_fiq_get_periodic_slot(enum legoev3_input_port_id port_id)
+{
+	if (!legoev3_fiq_data || port_id >= NUM_EV3_PORT_IN)
+		return NULL;
+
+	return legoev3_fiq_data->port_data[port_id].periodic.slot;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_get_periodic_slot);
+
+/**
+ * legoev3_fiq_set_periodic_notify - Get called when a periodic transfer ends.
+ * @port_id: The port identifier that was previously requested.
+ * @notify: Called in interrupt context with @context, the sequence number of
+ *	the new data and how long ago the transfer ended in nanoseconds. NULL
+ *	stops the notifications.
+ * @context: Pointer that is passed as an argument to notify.
+ *
+ * The FIQ raises the status gpio interrupt after each periodic transfer for
+ * as long as @notify is set. The data is still read with
+ * legoev3_fiq_read_periodic() or from the slot; if the FIQ has finished
+ * another transfer in the meantime, the calls for the older ones are merged
+ * into one. After this returns with @notify set to NULL, the previous notify
+ * is no longer called.
+ *
+ * Returns 0 on success or -EINVAL if the port has not been requested.
+ */
+int legoev3_fiq_set_periodic_notify(enum legoev3_input_port_id port_id,
+				    legoev3_fiq_periodic_notify_t notify,
+				    void *context)
+{
+	struct legoev3_fiq_i2c_periodic *periodic;
+
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->port_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	periodic = &legoev3_fiq_data->port_data[port_id].periodic;
+
+	local_fiq_disable();
+	periodic->notify = notify;
+	periodic->notify_context = context;
+	periodic->notify_seq = periodic->slot->seq;
+	local_fiq_enable();
+
+	if (!notify)
+		synchronize_irq(legoev3_fiq_data->status_gpio_irq);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_set_periodic_notify);
+
+static ssize_t periodic_read(struct file *filp, struct kobject *kobj,
+			     struct bin_attribute *attr, char *buf,
+			     loff_t off, size_t count)
+{
+	struct legoev3_fiq_data *fiq_data = attr->private;
+
+	return memory_read_from_buffer(buf, count, &off, fiq_data->periodic_page,
+				       sizeof(*fiq_data->periodic_page));
+}
+
+static int periodic_mmap(struct file *filp, struct kobject *kobj,
+			 struct bin_attribute *attr, struct vm_area_struct *vma)
+{
+	struct legoev3_fiq_data *fiq_data = attr->private;
+
+	/* the fallback copy in fiq_data is not page aligned */
+	if (!fiq_data->periodic_page_phys)
+		return -ENODEV;
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	/* same attributes as the kernel mapping of the SRAM, so no aliases */
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       fiq_data->periodic_page_phys >> PAGE_SHIFT,
+			       PAGE_SIZE, vma->vm_page_prot);
+}
+
+static struct bin_attribute legoev3_fiq_periodic_attr = {
+	.attr	= {
+		.name = "periodic",
+		.mode = 0444,
+	},
+	.size	= sizeof(struct legoev3_fiq_periodic_page),
+	.read	= periodic_read,
+	.mmap	= periodic_mmap,
+};
+
+/*
+ * The result page is shared with user space, so it needs a page of its own.
+ * The FIQ writes it through the uncached mapping of the on-chip RAM, which
+ * also means that user space mappings can't see stale cache lines, which
+ * would be a real problem with the aliasing VIVT cache of the ARM926.
+ */
+static void legoev3_fiq_alloc_periodic_page(struct legoev3_fiq_data *fiq_data)
+{
+	struct gen_pool *pool = sram_get_gen_pool();
+	struct genpool_data_align align = { .align = PAGE_SIZE };
+	unsigned long addr = 0;
+	int i;
+
+	if (pool)
+		addr = gen_pool_alloc_algo(pool, PAGE_SIZE,
+					   gen_pool_first_fit_align, &align);
+	if (addr) {
+		fiq_data->periodic_page = (void *)addr;
+		fiq_data->periodic_page_phys = gen_pool_virt_to_phys(pool, addr);
+		memset(fiq_data->periodic_page, 0, PAGE_SIZE);
+	} else {
+		dev_warn(&fiq_data->pdev->dev,
+			 "Not enough SRAM, periodic results can't be mapped.\n");
+		fiq_data->periodic_page = &fiq_data->periodic_fallback;
+	}
+
+	for (i = 0; i < NUM_EV3_PORT_IN; i++)
+		fiq_data->port_data[i].periodic.slot =
+			&fiq_data->periodic_page->port[i];
+}
+
+static void legoev3_fiq_free_periodic_page(struct legoev3_fiq_data *fiq_data)
+{
+	if (fiq_data->periodic_page_phys)
+		gen_pool_free(sram_get_gen_pool(),
+			      (unsigned long)fiq_data->periodic_page, PAGE_SIZE);
+}
+
+/**
+ * legoev3_fiq_request_encoder - Have the FIQ count motor tachometer edges.
+ * @port_id: The output port identifier.
+ * @int_pin: The GPIO connected to the tachometer interrupt line (pin 5).
+ * @dir_pin: The GPIO connected to the tachometer direction line (pin 6).
+ *
+ * Both GPIOs should already be requested as inputs by the calling code. They
+ * are sampled on every FIQ timer tick and each change of either one is
+ * counted, so one full quadrature cycle moves the position by 4. The
+ * position starts at 0.
+ *
+ * Returns 0 on success or -EBUSY if the port has already been requested.
+ */
+int legoev3_fiq_request_encoder(enum legoev3_output_port_id port_id,
+				int int_pin, int dir_pin)
+{
+	struct legoev3_fiq_encoder_data *enc;
+
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_OUT)
+		return -EINVAL;
+	if (legoev3_fiq_data->encoder_req_flags & BIT(port_id))
+		return -EBUSY;
+
+	enc = &legoev3_fiq_data->encoder_data[port_id];
+	legoev3_fiq_set_gpio(int_pin, &enc->gpio[FIQ_ENCODER_PIN_INT]);
+	legoev3_fiq_set_gpio(dir_pin, &enc->gpio[FIQ_ENCODER_PIN_DIR]);
+	enc->position = 0;
+	enc->timestamp = davinci_timer_read_freerun();
+	enc->missed = 0;
+	enc->seq = 0;
+	enc->state = fiq_encoder_read_state(enc);
+
+	local_fiq_disable();
+	legoev3_fiq_data->encoder_req_flags |= BIT(port_id);
+	legoev3_fiq_timer_update(legoev3_fiq_data);
+	legoev3_fiq_enable(legoev3_fiq_data->timer_irq);
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_request_encoder);
+
+/**
+ * legoev3_fiq_release_encoder - Stop counting tachometer edges.
+ * @port_id: The output port identifier.
+ */
+void legoev3_fiq_release_encoder(enum legoev3_output_port_id port_id)
+{
+	if (!legoev3_fiq_data)
+		return;
+	if (port_id >= NUM_EV3_PORT_OUT)
+		return;
+
+	local_fiq_disable();
+	legoev3_fiq_data->encoder_req_flags &= ~BIT(port_id);
+	legoev3_fiq_timer_update(legoev3_fiq_data);
+	local_fiq_enable();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_release_encoder);
+
+/**
+ * legoev3_fiq_read_encoder - Get the tachometer position of a port.
+ * @port_id: The output port identifier.
+ * @position: Returns the position in edges.
+ * @timestamp: If not NULL, returns the time of the last edge in
+ *	davinci_timer_read_freerun() ticks, see davinci_timer_get_tick_rate().
+ * @missed: If not NULL, returns the number of times that both lines changed
+ *	between two samples, i.e. edges were lost.
+ *
+ * This does not take any locks or disable the FIQ, so it is safe to call
+ * from any context.
+ */
+int legoev3_fiq_read_encoder(enum legoev3_output_port_id port_id,
+			     s32 *position, u32 *timestamp, u32 *missed)
+{
+	struct legoev3_fiq_encoder_data *enc;
+	unsigned start_seq;
+
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_OUT)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->encoder_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	enc = &legoev3_fiq_data->encoder_data[port_id];
+	do {
+		start_seq = READ_ONCE(enc->seq);
+		barrier();
+		*position = enc->position;
+		if (timestamp)
+			*timestamp = enc->timestamp;
+		if (missed)
+			*missed = enc->missed;
+		barrier();
+	} while (READ_ONCE(enc->seq) != start_seq);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_read_encoder);
+
+#define TIM12	0x10 /* Timer Counter Register 12 */
+#define PRD12	0x18 /* Timer Period Register 12 */
+#define TCR	0x20 /* Timer Control Register */
+#define TGCR	0x24 /* Timer Global Control Register */
+#define TCR_ENAMODE12_PERIODIC	(0x2 << 6)
+#define TGCR_32BIT_UNCHAINED	(0x1 << 2)
+#define TGCR_UNRESET		(BIT(1) | BIT(0))
+
+/*
+ * Runs the UART timer at FIQ_UART_OVERSAMPLE times the highest baud rate in
+ * use, works out the bit clock step of each port and rebuilds the list of
+ * ports the FIQ samples. Must be called with the FIQ disabled.
+ */
+static void legoev3_fiq_uart_update_timer(struct legoev3_fiq_data *fiq_data)
+{
+	unsigned long rate = clk_get_rate(fiq_data->uart_timer_clk);
+	unsigned max_baud = 0;
+	u32 period;
+	int i;
+
+	fiq_port_list_build(&fiq_data->uart_ports, fiq_data->uart_req_flags);
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		if (fiq_data->uart_req_flags & BIT(i))
+			max_baud = max(max_baud, fiq_data->uart_data[i].baud);
+	}
+
+	__raw_writel(0, fiq_data->uart_timer_base + TCR);
+	if (!max_baud) {
+		legoev3_fiq_disable(fiq_data->uart_timer_irq);
+		return;
+	}
+
+	period = DIV_ROUND_CLOSEST(rate, max_baud * FIQ_UART_OVERSAMPLE);
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		struct legoev3_fiq_uart_data *uart = &fiq_data->uart_data[i];
+
+		uart->step = div_u64((u64)uart->baud * period << 16, rate);
+	}
+
+	__raw_writel(0, fiq_data->uart_timer_base + TIM12);
+	__raw_writel(period, fiq_data->uart_timer_base + PRD12);
+	__raw_writel(TCR_ENAMODE12_PERIODIC, fiq_data->uart_timer_base + TCR);
+	legoev3_fiq_enable(fiq_data->uart_timer_irq);
+}
+
+/**
+ * legoev3_fiq_uart_request - Receive 8N1 serial data on a GPIO in the FIQ.
+ * @port_id: The input port identifier.
+ * @rx_pin: The GPIO connected to the sensor TX line. It should already be
+ *	requested as an input by the calling code.
+ * @baud: LEGOEV3_FIQ_UART_MIN_BAUD to LEGOEV3_FIQ_UART_MAX_BAUD.
+ * @rx_callback: Called in interrupt context when new data has been received.
+ * @context: Pointer that is passed as an argument to rx_callback.
+ *
+ * Data is read with legoev3_fiq_uart_read(). The port can be used for this
+ * and for I2C at the same time, but that does not make sense for a sensor.
+ *
+ * Returns 0 on success, -ENODEV if there is no UART timer, -EINVAL on a bad
+ * baud rate or -EBUSY if the port has already been requested.
+ */
+int legoev3_fiq_uart_request(enum legoev3_input_port_id port_id, int rx_pin,
+			     unsigned baud, void (*rx_callback)(void *),
+			     void *context)
+{
+	struct legoev3_fiq_uart_data *uart;
+
+	if (!legoev3_fiq_data || !legoev3_fiq_data->uart_timer_base)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (baud < LEGOEV3_FIQ_UART_MIN_BAUD || baud > LEGOEV3_FIQ_UART_MAX_BAUD)
+		return -EINVAL;
+	if (legoev3_fiq_data->uart_req_flags & BIT(port_id))
+		return -EBUSY;
+
+	uart = &legoev3_fiq_data->uart_data[port_id];
+	legoev3_fiq_set_gpio(rx_pin, &uart->rx);
+	uart->ring_head = uart->ring_tail = 0;
+	uart->overruns = 0;
+	uart->framing_errors = 0;
+	uart->baud = baud;
+	uart->state = FIQ_UART_BREAK;
+	uart->rx_callback = rx_callback;
+	uart->context = context;
+
+	local_fiq_disable();
+	legoev3_fiq_data->uart_req_flags |= BIT(port_id);
+	legoev3_fiq_uart_update_timer(legoev3_fiq_data);
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_uart_request);
+
+/**
+ * legoev3_fiq_uart_release - Stop receiving data on a port.
+ * @port_id: The input port identifier.
+ *
+ * After this returns, rx_callback is no longer called.
+ */
+void legoev3_fiq_uart_release(enum legoev3_input_port_id port_id)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->uart_timer_base)
+		return;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return;
+
+	local_fiq_disable();
+	legoev3_fiq_data->uart_req_flags &= ~BIT(port_id);
+	legoev3_fiq_data->uart_data[port_id].rx_callback = NULL;
+	legoev3_fiq_uart_update_timer(legoev3_fiq_data);
+	local_fiq_enable();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_uart_release);
+
+/**
+ * legoev3_fiq_uart_set_baud - Change the baud rate of a port.
+ * @port_id: The input port identifier that was previously requested.
+ * @baud: LEGOEV3_FIQ_UART_MIN_BAUD to LEGOEV3_FIQ_UART_MAX_BAUD.
+ *
+ * A frame that is being received is dropped.
+ */
+int legoev3_fiq_uart_set_baud(enum legoev3_input_port_id port_id,
+			      unsigned baud)
+{
+	struct legoev3_fiq_uart_data *uart;
+
+	if (!legoev3_fiq_data || !legoev3_fiq_data->uart_timer_base)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (baud < LEGOEV3_FIQ_UART_MIN_BAUD || baud > LEGOEV3_FIQ_UART_MAX_BAUD)
+		return -EINVAL;
+	if (!(legoev3_fiq_data->uart_req_flags & BIT(port_id)))
+		return -EINVAL;
+
+	uart = &legoev3_fiq_data->uart_data[port_id];
+	local_fiq_disable();
+	uart->baud = baud;
+	uart->state = FIQ_UART_BREAK;
+	legoev3_fiq_uart_update_timer(legoev3_fiq_data);
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_uart_set_baud);
+
+/**
+ * legoev3_fiq_uart_read - Get received data.
+ * @port_id: The input port identifier.
+ * @buf: Buffer to copy the data to.
+ * @len: Size of buf.
+ *
+ * Only one context may read from a port at a time. It does not need to
+ * disable the FIQ.
+ *
+ * Returns the number of bytes copied.
+ */
+int legoev3_fiq_uart_read(enum legoev3_input_port_id port_id, u8 *buf,
+			  unsigned len)
+{
+	struct legoev3_fiq_uart_data *uart;
+	unsigned head, tail, count = 0;
+
+	if (!legoev3_fiq_data)
+		return -ENODEV;
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+
+	uart = &legoev3_fiq_data->uart_data[port_id];
+	head = READ_ONCE(uart->ring_head);
+	tail = uart->ring_tail;
+	while (tail != head && count < len)
+		buf[count++] = uart->ring[tail++ & FIQ_UART_RING_MASK];
+	barrier();
+	WRITE_ONCE(uart->ring_tail, tail);
+
+	return count;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_uart_read);
+
+int legoev3_fiq_ehrpwm_int_enable(void)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return -ENODEV;
+
+	fiq_ehrpwm_et_int_enable();
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_int_enable);
+
+int legoev3_fiq_ehrpwm_int_disable(void)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return -ENODEV;
 
-/**
- * legoev3_fiq_request_port - Requests ownership of the I2C backend for the
- *	specified port.
- * @port_id: The port identifier.
- * @sda_pin: The GPIO pin to use for the I2C data line. This GPIO should
- *	already be requested and set high by the calling code and not
- *	touched again until legoev3_fiq_release_port is called.
- * @scl_pin: The GPIO pin to use for the I2C clock line. Same notes apply
- *	as on the sda_pin.
- *
- * Returns 0 if the port is available or -EBUSY if it has already be requested.
+	fiq_ehrpwm_et_int_disable();
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_int_disable);
+
+bool legoev3_fiq_ehrpwm_int_is_enabled(void)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return false;
+
+	return fiq_ehrpwm_et_int_is_enabled();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_int_is_enabled);
+
+/*
+ * Only called when the ehrpwm interrupt is configured as regular IRQ and
+ * not as a FIQ. In other words, this is for debugging (when assigned to IRQ)
+ * and serves as a dummy callback during normal usage (when assigned to FIQ).
  */
-int legoev3_fiq_request_port(enum legoev3_input_port_id port_id, int sda_pin,
-			     int scl_pin)
+static irqreturn_t legoev3_fiq_ehrpwm_et_callback(int irq, void *data)
 {
-	struct legoev3_fiq_port_i2c_data *data;
-	int ret;
+	fiq_c_handler_t handler = get_fiq_c_handler();
+
+	if (handler)
+		handler();
+
+	return IRQ_HANDLED;
+}
+
+int legoev3_fiq_ehrpwm_request(void)
+{
+	int err;
 
 	if (!legoev3_fiq_data)
 		return -ENODEV;
-	if (legoev3_fiq_data->port_req_flags & BIT(port_id))
+
+	if (legoev3_fiq_data->ehrpwm_data.requested_flag)
 		return -EBUSY;
+	legoev3_fiq_data->ehrpwm_data.requested_flag = 1;
+
+	err = request_irq(legoev3_fiq_data->ehrpwm_irq,
+			  legoev3_fiq_ehrpwm_et_callback, 0,
+			  "legoev3_fiq_ehrpwm_debug",
+			  &legoev3_fiq_data->ehrpwm_data);
+	if (err)
+		dev_warn(&legoev3_fiq_data->pdev->dev,
+			 "Failed to request ehrpwm irq.");
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_request);
+
+void legoev3_fiq_ehrpwm_release(void)
+{
+	if (!legoev3_fiq_data)
+		return;
+
+	local_fiq_disable();
+	free_irq(legoev3_fiq_data->ehrpwm_irq, &legoev3_fiq_data->ehrpwm_data);
+	legoev3_fiq_data->ehrpwm_data.requested_flag = 0;
+	local_fiq_enable();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_release);
+
+/**
+ * legoev3_fiq_ehrpwm_prepare - Set up the FIQ for playback of a substream.
+ * @substream: The substream to play. Supported formats are U8 mono, S16_LE
+ *	mono and S16_LE stereo (mixed down to mono by the FIQ).
+ * @volume: Initial volume (256 is full scale).
+ * @int_period: Number of PWM periods per sample (0 to 3, see ETPS).
+ * @period_elapsed: Function to call each time a period has been played.
+ * @context: Pointer that is passed as an argument to period_elapsed.
+ *
+ * Returns 0 on success or -EINVAL if the format is not supported.
+ */
+int legoev3_fiq_ehrpwm_prepare(struct snd_pcm_substream *substream, int volume,
+			       unsigned char int_period,
+			       void (*period_elapsed)(void *), void *context)
+{
+	struct legoev3_fiq_ehrpwm_data *data;
+	enum fiq_ehrpwm_format format;
+
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return -ENODEV;
+
+	if (int_period > 3)
+		return -EINVAL;
+
+	switch (substream->runtime->format) {
+	case SNDRV_PCM_FORMAT_U8:
+		if (substream->runtime->channels != 1)
+			return -EINVAL;
+		format = FIQ_EHRPWM_FORMAT_U8;
+		break;
+	case SNDRV_PCM_FORMAT_S16_LE:
+		if (substream->runtime->channels == 1)
+			format = FIQ_EHRPWM_FORMAT_S16;
+		else if (substream->runtime->channels == 2)
+			format = FIQ_EHRPWM_FORMAT_S16_STEREO;
+		else
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	data = &legoev3_fiq_data->ehrpwm_data;
+
+	local_fiq_disable();
+
+	data->dma_area			= substream->runtime->dma_area;
+	data->runtime			= substream->runtime;
+	data->hw_frames			= 0;
+	data->starved_flag		= 0;
+	data->format			= format;
+	data->playback_ptr		= 0;
+	data->volume			= volume;
+	data->frame_bytes		= frames_to_bytes(substream->runtime, 1);
+	data->buffer_bytes		= snd_pcm_lib_buffer_bytes(substream);
+	data->period_size		= substream->runtime->period_size;
+	data->callback_count		= 0;
+	data->period_elapsed		= period_elapsed;
+	data->period_elapsed_data	= context;
+	data->ramp_gain			= FIQ_EHRPWM_RAMP_UNITY;
+	data->ramp_step			= 0;
+	data->sub_count			= 0;
+	data->prev_sample		= 0;
+	data->cur_sample		= 0;
+	data->shape_error		= 0;
+	if (data->decimate > 1) {
+		/* one PWM period per frame, decimate frames per interrupt */
+		fiq_ehrpwm_et_int_set_period(data->decimate);
+	} else if (data->filter_flags & LEGOEV3_FIQ_EHRPWM_INTERPOLATE) {
+		/* interrupt on every PWM period and interpolate in between */
+		data->oversample	= max_t(unsigned, int_period, 1);
+		data->oversample_recip	= 0x10000 / data->oversample;
+		fiq_ehrpwm_et_int_set_period(1);
+	} else
+		fiq_ehrpwm_et_int_set_period(int_period);
+
+	local_fiq_enable();
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_prepare);
+
+/**
+ * legoev3_fiq_ehrpwm_set_filter - Select output filtering for the next stream.
+ * @flags: Any of LEGOEV3_FIQ_EHRPWM_INTERPOLATE and
+ *	LEGOEV3_FIQ_EHRPWM_NOISE_SHAPE.
+ *
+ * With LEGOEV3_FIQ_EHRPWM_INTERPOLATE, the int_period passed to
+ * legoev3_fiq_ehrpwm_prepare() becomes the oversampling factor: the FIQ runs
+ * on every PWM period and interpolates linearly between samples instead of
+ * holding each sample for int_period periods. This costs int_period times as
+ * many FIQs. LEGOEV3_FIQ_EHRPWM_NOISE_SHAPE feeds the duty cycle rounding
+ * error back into the next period.
+ *
+ * Takes effect at the next call to legoev3_fiq_ehrpwm_prepare().
+ */
+int legoev3_fiq_ehrpwm_set_filter(unsigned flags)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return -ENODEV;
+
+	if (flags & ~(LEGOEV3_FIQ_EHRPWM_INTERPOLATE
+		      | LEGOEV3_FIQ_EHRPWM_NOISE_SHAPE))
+		return -EINVAL;
+
+	legoev3_fiq_data->ehrpwm_data.filter_flags = flags;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_set_filter);
+
+/**
+ * legoev3_fiq_ehrpwm_set_decimate - Play several frames per FIQ.
+ * @factor: Number of frames averaged into each duty cycle update (1 to 3,
+ *	0 and 1 turn decimation off).
+ *
+ * For high sample rates, the PWM is expected to run at the sample rate
+ * while the FIQ only fires every @factor PWM periods and averages that many
+ * frames. This divides the number of FIQs by @factor at the cost of a low
+ * pass at rate / @factor. The int_period passed to
+ * legoev3_fiq_ehrpwm_prepare() and LEGOEV3_FIQ_EHRPWM_INTERPOLATE are
+ * ignored while decimating.
+ *
+ * Takes effect at the next call to legoev3_fiq_ehrpwm_prepare().
+ */
+int legoev3_fiq_ehrpwm_set_decimate(unsigned factor)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return -ENODEV;
+
+	if (factor > 3)
+		return -EINVAL;
+
+	legoev3_fiq_data->ehrpwm_data.decimate = factor;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_set_decimate);
+
+/**
+ * legoev3_fiq_ehrpwm_ramp - Fade the sound output in or out.
+ * @substream: The substream that was passed to legoev3_fiq_ehrpwm_prepare().
+ * @direction: > 0 ramps up to full volume, < 0 ramps down to silence and 0
+ *	cancels any ramp and goes back to full volume. Ramps start at the
+ *	current level, except that ramping up from full volume (e.g. right
+ *	after prepare) starts from silence.
+ * @ramp_ms: Duration of the ramp in milliseconds. 0 changes the volume
+ *	immediately.
+ *
+ * The ramp is applied to each sample in the FIQ, on top of the volume set
+ * with legoev3_fiq_ehrpwm_set_volume(), so the PCM data does not have to be
+ * changed. After ramping down, the output stays silent until the next ramp
+ * up or legoev3_fiq_ehrpwm_prepare().
+ */
+void legoev3_fiq_ehrpwm_ramp(struct snd_pcm_substream *substream,
+			     int direction, unsigned ramp_ms)
+{
+	struct legoev3_fiq_ehrpwm_data *data;
+	unsigned samples;
+	int step;
+
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return;
+
+	data = &legoev3_fiq_data->ehrpwm_data;
+	samples = DIV_ROUND_UP(substream->runtime->rate * ramp_ms, 1000);
+	step = samples ? DIV_ROUND_UP(FIQ_EHRPWM_RAMP_UNITY, samples)
+		       : FIQ_EHRPWM_RAMP_UNITY;
+
+	local_fiq_disable();
+	if (direction > 0) {
+		if (!samples)
+			data->ramp_gain = FIQ_EHRPWM_RAMP_UNITY;
+		else if (data->ramp_gain == FIQ_EHRPWM_RAMP_UNITY)
+			data->ramp_gain = 0;
+		data->ramp_step = step;
+	} else if (direction < 0) {
+		if (!samples)
+			data->ramp_gain = 0;
+		data->ramp_step = -step;
+	} else {
+		data->ramp_gain = FIQ_EHRPWM_RAMP_UNITY;
+		data->ramp_step = 0;
+	}
+	local_fiq_enable();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_ramp);
+
+unsigned legoev3_fiq_ehrpwm_get_playback_ptr(void)
+{
+	return legoev3_fiq_data->ehrpwm_data.playback_ptr;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_get_playback_ptr);
+
+void legoev3_fiq_ehrpwm_set_volume(int volume)
+{
+	legoev3_fiq_data->ehrpwm_data.volume = volume;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_set_volume);
+
+/**
+ * legoev3_fiq_ehrpwm_get_period_ticks - Get the current PWM period.
+ *
+ * Returns the period in time base ticks, which is the full scale of the
+ * duty cycle register, or 0 if the ePWM has not been requested.
+ */
+unsigned legoev3_fiq_ehrpwm_get_period_ticks(void)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return 0;
+
+	return fiq_ehrpwm_get_period_ticks();
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_get_period_ticks);
+
+/**
+ * legoev3_fiq_ehrpwm_get_duty_reg - Get the address of the duty register.
+ *
+ * Returns the physical address of the 16-bit compare register that sets the
+ * duty cycle of the speaker output, for DMA to write samples to, or 0 if
+ * the ePWM has not been requested.
+ */
+phys_addr_t legoev3_fiq_ehrpwm_get_duty_reg(void)
+{
+	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
+		return 0;
+
+	return legoev3_fiq_data->ehrpwm_phys + CMPB;
+}
+EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_get_duty_reg);
+
+#ifdef CONFIG_LEGOEV3_FIQ_STATS
+static const char * const legoev3_fiq_stats_names[NUM_FIQ_STATS] = {
+	[FIQ_STATS_I2C_TIMER]	= "i2c-timer-latency",
+	[FIQ_STATS_EHRPWM]	= "ehrpwm-period",
+	[FIQ_STATS_DURATION]	= "fiq-duration",
+};
+
+static u64 legoev3_fiq_stats_ticks_to_ns(u64 ticks)
+{
+	unsigned int rate = davinci_timer_get_tick_rate();
+
+	if (!rate)
+		return 0;
+
+	return div_u64(ticks * NSEC_PER_SEC, rate);
+}
+
+/* Returns the upper bound of the bucket that contains the given percentile. */
+static u64 legoev3_fiq_stats_percentile(struct legoev3_fiq_stats *stats,
+					unsigned pct)
+{
+	u64 target = div_u64((u64)stats->count * pct + 99, 100);
+	u64 sum = 0;
+	int i;
+
+	for (i = 0; i < FIQ_STATS_NUM_BUCKETS; i++) {
+		sum += stats->buckets[i];
+		if (sum >= target)
+			break;
+	}
+
+	return legoev3_fiq_stats_ticks_to_ns(1ULL << i);
+}
+
+static void legoev3_fiq_stats_print(struct seq_file *s,
+				    struct legoev3_fiq_data *fiq_data)
+{
+	struct legoev3_fiq_stats stats;
+	int i, j;
+
+	seq_printf(s, "%-20s %10s %10s %10s %10s %10s %10s %10s\n", "source",
+		   "count", "min(ns)", "avg(ns)", "max(ns)", "p50(ns)",
+		   "p90(ns)", "p99(ns)");
+
+	for (i = 0; i < NUM_FIQ_STATS; i++) {
+		stats = fiq_data->stats[i];
+		if (!stats.count) {
+			seq_printf(s, "%-20s %10u\n", legoev3_fiq_stats_names[i],
+				   0);
+			continue;
+		}
+		seq_printf(s, "%-20s %10u %10llu %10llu %10llu %10llu %10llu %10llu\n",
+			   legoev3_fiq_stats_names[i], stats.count,
+			   legoev3_fiq_stats_ticks_to_ns(stats.min),
+			   legoev3_fiq_stats_ticks_to_ns(div_u64(stats.sum,
+								 stats.count)),
+			   legoev3_fiq_stats_ticks_to_ns(stats.max),
+			   legoev3_fiq_stats_percentile(&stats, 50),
+			   legoev3_fiq_stats_percentile(&stats, 90),
+			   legoev3_fiq_stats_percentile(&stats, 99));
+	}
+
+	for (i = 0; i < NUM_FIQ_STATS; i++) {
+		seq_printf(s, "\n%s histogram (upper bound in ns: count)\n",
+			   legoev3_fiq_stats_names[i]);
+		for (j = 0; j < FIQ_STATS_NUM_BUCKETS; j++) {
+			if (!fiq_data->stats[i].buckets[j])
+				continue;
+			seq_printf(s, "%10llu: %u\n",
+				   legoev3_fiq_stats_ticks_to_ns(1ULL << j),
+				   fiq_data->stats[i].buckets[j]);
+		}
+	}
+}
+
+static void legoev3_fiq_stats_reset(struct legoev3_fiq_data *fiq_data)
+{
+	local_fiq_disable();
+	memset(fiq_data->stats, 0, sizeof(fiq_data->stats));
+	fiq_data->ehrpwm_last_timestamp = 0;
+	local_fiq_enable();
+}
+
+static int legoev3_fiq_stats_show(struct seq_file *s, void *v)
+{
+	legoev3_fiq_stats_print(s, s->private);
+
+	return 0;
+}
+
+static int legoev3_fiq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, legoev3_fiq_stats_show, inode->i_private);
+}
+
+static ssize_t legoev3_fiq_stats_write(struct file *file,
+				       const char __user *buf, size_t count,
+				       loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+
+	legoev3_fiq_stats_reset(s->private);
+
+	return count;
+}
+
+static const struct file_operations legoev3_fiq_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= legoev3_fiq_stats_open,
+	.read		= seq_read,
+	.write		= legoev3_fiq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void legoev3_fiq_i2c_stats_print(struct seq_file *s,
+					struct legoev3_fiq_data *fiq_data)
+{
+	struct legoev3_fiq_i2c_stats stats;
+	u64 busy_ns;
+	int i;
+
+	seq_printf(s, "%-6s %10s %10s %10s %10s %10s %12s %10s\n", "port",
+		   "xfers", "nacks", "timeouts", "retries", "bytes", "busy(us)",
+		   "bytes/s");
+
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		stats = fiq_data->port_data[i].stats;
+		busy_ns = legoev3_fiq_stats_ticks_to_ns(stats.busy_ticks);
+		seq_printf(s, "in%-4d %10u %10u %10u %10u %10u %12llu %10llu\n",
+			   i + 1, stats.xfers, stats.nacks, stats.timeouts,
+			   stats.retries, stats.bytes,
+			   div_u64(busy_ns, NSEC_PER_USEC),
+			   busy_ns ? div64_u64((u64)stats.bytes * NSEC_PER_SEC,
+					       busy_ns) : 0);
+	}
+}
+
+static void legoev3_fiq_i2c_stats_reset(struct legoev3_fiq_data *fiq_data)
+{
+	int i;
+
+	local_fiq_disable();
+	for (i = 0; i < NUM_EV3_PORT_IN; i++)
+		memset(&fiq_data->port_data[i].stats, 0,
+		       sizeof(fiq_data->port_data[i].stats));
+	local_fiq_enable();
+}
+
+static int legoev3_fiq_i2c_stats_show(struct seq_file *s, void *v)
+{
+	legoev3_fiq_i2c_stats_print(s, s->private);
+
+	return 0;
+}
+
+static int legoev3_fiq_i2c_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, legoev3_fiq_i2c_stats_show, inode->i_private);
+}
+
+static ssize_t legoev3_fiq_i2c_stats_write(struct file *file,
+					   const char __user *buf,
+					   size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+
+	legoev3_fiq_i2c_stats_reset(s->private);
 
-	data = &legoev3_fiq_data->port_data[port_id];
-	legoev3_fiq_set_gpio(sda_pin, &data->gpio[FIQ_I2C_PIN_SDA]);
-	legoev3_fiq_set_gpio(scl_pin, &data->gpio[FIQ_I2C_PIN_SCL]);
+	return count;
+}
 
-	ret = request_irq(legoev3_fiq_data->status_gpio_irq,
-			  legoev3_fiq_gpio_irq_i2c_port_callback,
-			  IRQF_TRIGGER_RISING | IRQF_SHARED,
-			  legoev3_fiq_data->pdev->name, data);
-	if (ret < 0) {
-		dev_err(&legoev3_fiq_data->pdev->dev,
-			"Unable to claim irq %d; error %d\n",
-			legoev3_fiq_data->status_gpio_irq, ret);
-		return ret;
-	}
+static const struct file_operations legoev3_fiq_i2c_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= legoev3_fiq_i2c_stats_open,
+	.read		= seq_read,
+	.write		= legoev3_fiq_i2c_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	data->transfer_state = TRANSFER_IDLE;
-	data->clock_state = 1;
-	legoev3_fiq_data->port_req_flags |= BIT(port_id);
+static void legoev3_fiq_perf_show(struct seq_file *s, void *data,
+				  u64 interval_ns)
+{
+	legoev3_fiq_stats_print(s, data);
+	seq_putc(s, '\n');
+	legoev3_fiq_i2c_stats_print(s, data);
+}
 
-	return 0;
+static void legoev3_fiq_perf_reset(void *data)
+{
+	legoev3_fiq_stats_reset(data);
+	legoev3_fiq_i2c_stats_reset(data);
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_request_port);
 
-/**
- * legoev3_fiq_release_port- Releases ownership of the I2C backend for the
- *	specified port.
- * @port_id: The port identifier.
- */
-void legoev3_fiq_release_port(enum legoev3_input_port_id port_id)
+/* not in fiq_data, which may be in SRAM */
+static struct legoev3_perf_source legoev3_fiq_perf_source = {
+	.name	= "fiq",
+	.show	= legoev3_fiq_perf_show,
+	.reset	= legoev3_fiq_perf_reset,
+};
+
+static void legoev3_fiq_stats_init(struct legoev3_fiq_data *fiq_data)
 {
-	struct legoev3_fiq_port_i2c_data *data;
+	legoev3_fiq_perf_source.data = fiq_data;
+	legoev3_perf_register(&legoev3_fiq_perf_source);
 
-	if (!legoev3_fiq_data)
+	fiq_data->debugfs = debugfs_create_dir("legoev3-fiq", NULL);
+	if (IS_ERR_OR_NULL(fiq_data->debugfs))
 		return;
 
-	data =  &legoev3_fiq_data->port_data[port_id];
-	data->transfer_state = TRANSFER_IDLE;
-	legoev3_fiq_data->port_req_flags &= ~BIT(port_id);
-	free_irq(legoev3_fiq_data->status_gpio_irq, data);
+	debugfs_create_file("latency", 0644, fiq_data->debugfs, fiq_data,
+			    &legoev3_fiq_stats_fops);
+	debugfs_create_file("i2c", 0644, fiq_data->debugfs, fiq_data,
+			    &legoev3_fiq_i2c_stats_fops);
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_release_port);
 
 /**
- * legoev3_fiq_start_xfer- Start an I2C transfer on the specified port.
- * @port_id: The port identifier that was previously requested.
- * @msgs: The message data to transfer.
- * @num_msg: Number of messages in msgs[].
- * @complete: Function to call when transfer is complete.
- * @context: Pointer that is passed as an argument to the complete function.
+ * legoev3_fiq_get_busy_ns - Total time spent in the FIQ handler.
+ * @ns: Returns the time in nanoseconds.
  *
- * You should only call this for a port that returned successfully from
- * legoev3_fiq_request_port.
+ * The total goes back to 0 when the latency statistics are cleared, callers
+ * that take the difference of two readings should check for that.
+ *
+ * Returns 0 on success, -ENODEV if the FIQ backend is not loaded or
+ * -EOPNOTSUPP without CONFIG_LEGOEV3_FIQ_STATS.
  */
-int legoev3_fiq_start_xfer(enum legoev3_input_port_id port_id,
-			   struct i2c_msg msgs[], int num_msg,
-			   void (*complete)(int, void *), void *context)
+int legoev3_fiq_get_busy_ns(u64 *ns)
 {
-	struct legoev3_fiq_port_i2c_data *data;
-	int i;
+	u64 ticks;
 
 	if (!legoev3_fiq_data)
 		return -ENODEV;
-	if (port_id >= NUM_EV3_PORT_IN)
-		return -EINVAL;
-	if (num_msg < 1 || num_msg > 2)
-		return -EINVAL;
-	if (!(legoev3_fiq_data->port_req_flags & BIT(port_id)))
-		return -EINVAL;
 
-	data = &legoev3_fiq_data->port_data[port_id];
-	if (data->transfer_state != TRANSFER_IDLE)
-		return -EBUSY;
+	local_fiq_disable();
+	ticks = legoev3_fiq_data->stats[FIQ_STATS_DURATION].sum;
+	local_fiq_enable();
 
-	/* copy the messages so that fiq has exclusive access */
-	for (i = 0; i < num_msg; i++)
-		memcpy(&data->msgs[i], &msgs[i], sizeof(struct i2c_msg));
-	/*
-	 * we also have to hang on to the real messages so that we can
-	 * copy any data read back to them when the transfer is complete.
-	 */
-	data->xfer_msgs = msgs;
-	data->num_msg = num_msg;
-	data->complete = complete;
-	data->context = context;
-	data->transfer_state = TRANSFER_START;
-	legoev3_fiq_enable(legoev3_fiq_data->timer_irq);
+	*ns = div_u64(ticks * NSEC_PER_SEC, davinci_timer_get_tick_rate());
 
 	return 0;
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_start_xfer);
+#else
+static inline void legoev3_fiq_stats_init(struct legoev3_fiq_data *fiq_data)
+{
+}
 
-void legoev3_fiq_cancel_xfer(enum legoev3_input_port_id port_id)
+int legoev3_fiq_get_busy_ns(u64 *ns)
 {
-	struct legoev3_fiq_port_i2c_data *data;
+	return -EOPNOTSUPP;
+}
+#endif
+EXPORT_SYMBOL_GPL(legoev3_fiq_get_busy_ns);
 
-	if (!legoev3_fiq_data)
-		return;
-	if (port_id >= NUM_EV3_PORT_IN)
-		return;
+#ifdef CONFIG_LEGOEV3_FIQ_LOCKDOWN
+/*
+ * ARM926EJ-S cache and TLB lockdown, see CP15 c9 and c10 in the TRM. Cache
+ * lines are locked by letting the cache allocate only into way 0, loading
+ * them and then taking way 0 out of the replacement policy. So everything
+ * that is locked has to fit into one way, which is 4k on the AM1808.
+ */
+#define ARM926_CACHE_LOCK_SBO		0xfff0
+#define ARM926_CACHE_LOCK_LOAD		(ARM926_CACHE_LOCK_SBO | 0xe)
+#define ARM926_CACHE_LOCK_WAY0		(ARM926_CACHE_LOCK_SBO | 0x1)
+#define ARM926_TLB_LOCK_ENTRIES		8
+#define ARM926_TLB_LOCK_VICTIM_SHIFT	26
+#define ARM926_TLB_LOCK_PRESERVE	BIT(0)
+
+struct fiq_lockdown_dcache {
+	unsigned line;
+	unsigned way_size;
+	unsigned locked;
+	unsigned skipped;
+	DECLARE_BITMAP(sets, 256);
+};
 
-	data = &legoev3_fiq_data->port_data[port_id];
-	data->transfer_state = TRANSFER_IDLE;
+struct fiq_lockdown_tlb {
+	unsigned long base[ARM926_TLB_LOCK_ENTRIES];
+	unsigned long size[ARM926_TLB_LOCK_ENTRIES];
+	unsigned count;
+	unsigned skipped;
+};
+
+/* type is the 12-bit Isize or Dsize field of the cache type register */
+static void fiq_lockdown_cache_geometry(u32 type, unsigned *line,
+					unsigned *way_size)
+{
+	unsigned size = 512 << ((type >> 6) & 0xf);
+	unsigned assoc = 1 << ((type >> 3) & 0x7);
+
+	*line = 8 << (type & 0x3);
+	*way_size = size / assoc;
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_cancel_xfer);
 
-static irqreturn_t
-legoev3_fiq_gpio_irq_period_elapsed_callback(int irq, void *ehrpwm_data)
+/*
+ * This is in .fiq.text itself, so fetching it while only way 0 can allocate
+ * does not evict any of the lines that are being locked.
+ */
+static noinline void __fiq_text
+fiq_lockdown_icache(unsigned long start, unsigned long end, unsigned line)
 {
-	struct legoev3_fiq_ehrpwm_data *data = ehrpwm_data;
+	unsigned long addr;
+
+	asm volatile("mcr p15, 0, %0, c9, c0, 1"
+		     : : "r" (ARM926_CACHE_LOCK_LOAD));
+	for (addr = start; addr < end; addr += line)
+		asm volatile("mcr p15, 0, %0, c7, c13, 1" : : "r" (addr));
+	asm volatile("mcr p15, 0, %0, c9, c0, 1"
+		     : : "r" (ARM926_CACHE_LOCK_WAY0));
+}
 
-	local_fiq_disable();
-	if (data->period_elapsed) {
-		data->period_elapsed(data->period_elapsed_data);
-		data->period_elapsed_flag = 0;
-		fiq_gpio_set_value(&legoev3_fiq_data->status_gpio, 0);
+/*
+ * Lines that map to a set that is already taken in way 0 are left out, so
+ * the most important ranges have to be locked first.
+ */
+static void fiq_lockdown_dcache(struct fiq_lockdown_dcache *d,
+				const void *start, size_t len)
+{
+	unsigned long addr = (unsigned long)start & ~(d->line - 1);
+	unsigned long end = (unsigned long)start + len;
+	unsigned long tmp;
+
+	for (; addr < end; addr += d->line) {
+		if (test_and_set_bit((addr & (d->way_size - 1)) / d->line,
+				     d->sets)) {
+			d->skipped++;
+			continue;
+		}
+		asm volatile(
+			"mcr	p15, 0, %1, c7, c14, 1\n"	/* clean+inv line */
+			"mcr	p15, 0, %2, c9, c0, 0\n"
+			"ldr	%0, [%1]\n"
+			"mcr	p15, 0, %3, c9, c0, 0\n"
+			: "=&r" (tmp)
+			: "r" (addr), "r" (ARM926_CACHE_LOCK_LOAD),
+			  "r" (ARM926_CACHE_LOCK_WAY0)
+			: "memory");
+		d->locked++;
 	}
-	local_fiq_enable();
-
-	return IRQ_HANDLED;
 }
 
-int legoev3_fiq_ehrpwm_int_enable(void)
+/* size of the hardware translation (section or small page) for addr */
+static unsigned long fiq_lockdown_map_size(unsigned long addr)
 {
-	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
-		return -ENODEV;
+	pmd_t *pmd = pmd_offset(pud_offset(pgd_offset_k(addr), addr), addr);
 
-	fiq_ehrpwm_et_int_enable();
-	return 0;
+	if (addr & SECTION_SIZE)
+		pmd++;
+	if ((pmd_val(*pmd) & PMD_TYPE_MASK) == PMD_TYPE_SECT)
+		return SECTION_SIZE;
+
+	return PAGE_SIZE;
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_int_enable);
 
-int legoev3_fiq_ehrpwm_int_disable(void)
+/*
+ * Reads from each mapping to load it into the next TLB lockdown entry, so
+ * only pass addresses where reading has no side effects.
+ */
+static void fiq_lockdown_tlb(struct fiq_lockdown_tlb *t, const void *start,
+			     size_t len)
 {
-	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
-		return -ENODEV;
-
-	fiq_ehrpwm_et_int_disable();
-	return 0;
+	unsigned long addr = (unsigned long)start;
+	unsigned long end = addr + len;
+	unsigned long size, tmp;
+	unsigned i;
+
+	while (addr < end) {
+		size = fiq_lockdown_map_size(addr);
+		for (i = 0; i < t->count; i++) {
+			if (addr >= t->base[i] && addr - t->base[i] < t->size[i])
+				break;
+		}
+		if (i < t->count) {
+			/* already locked */
+		} else if (t->count < ARM926_TLB_LOCK_ENTRIES) {
+			asm volatile(
+				"mcr	p15, 0, %1, c8, c7, 1\n" /* inv entry */
+				"mcr	p15, 0, %2, c10, c0, 0\n"
+				"ldr	%0, [%1]\n"
+				"mcr	p15, 0, %3, c10, c0, 0\n"
+				: "=&r" (tmp)
+				: "r" (addr),
+				  "r" (t->count << ARM926_TLB_LOCK_VICTIM_SHIFT
+				       | ARM926_TLB_LOCK_PRESERVE),
+				  "r" ((t->count + 1)
+				       << ARM926_TLB_LOCK_VICTIM_SHIFT)
+				: "memory");
+			t->base[t->count] = addr & ~(size - 1);
+			t->size[t->count] = size;
+			t->count++;
+		} else {
+			t->skipped++;
+		}
+		addr = (addr & ~(size - 1)) + size;
+	}
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_int_disable);
 
-bool legoev3_fiq_ehrpwm_int_is_enabled(void)
+static void legoev3_fiq_lockdown(struct legoev3_fiq_data *fiq_data)
 {
-	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
-		return false;
+	struct device *dev = &fiq_data->pdev->dev;
+	struct fiq_lockdown_dcache *d;
+	struct fiq_lockdown_tlb *t;
+	u8 *stack_top = (u8 *)fiq_data->fiq_stack + FIQ_STACK_SIZE;
+	unsigned long text_start = (unsigned long)__fiq_text_start;
+	unsigned long text_end = (unsigned long)__fiq_text_end;
+	unsigned long flags;
+	unsigned iline, iway_size;
+	bool icache_locked = false;
+	u32 cache_type;
+	int i;
 
-	return fiq_ehrpwm_et_int_is_enabled();
+	d = kzalloc(sizeof(*d), GFP_KERNEL);
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!d || !t)
+		goto out;
+
+	asm("mrc p15, 0, %0, c0, c0, 1" : "=r" (cache_type));
+	fiq_lockdown_cache_geometry(cache_type >> 12, &d->line, &d->way_size);
+	fiq_lockdown_cache_geometry(cache_type, &iline, &iway_size);
+	if (WARN_ON(d->way_size / d->line > 256))
+		goto out;
+
+	local_irq_save(flags);
+	local_fiq_disable();
+
+	/* start with empty caches so that way 0 only has our lines */
+	flush_cache_all();
+
+	if (text_end - text_start <= iway_size) {
+		fiq_lockdown_icache(text_start, text_end, iline);
+		icache_locked = true;
+	}
+
+	fiq_lockdown_dcache(d, &legoev3_fiq_data, sizeof(legoev3_fiq_data));
+	/*
+	 * Whether fiq_data is in SRAM or DDR, both are cacheable. The stack
+	 * grows down, so the top of it is the hot end.
+	 */
+	fiq_lockdown_dcache(d, stack_top - FIQ_STACK_SIZE / 2,
+			    FIQ_STACK_SIZE / 2);
+	fiq_lockdown_dcache(d, &fiq_data->status_gpio,
+			    (void *)(&fiq_data->notify_mask + 1)
+			    - (void *)&fiq_data->status_gpio);
+	fiq_lockdown_dcache(d, &fiq_data->ehrpwm_data,
+			    sizeof(fiq_data->ehrpwm_data));
+	fiq_lockdown_dcache(d, fiq_data->encoder_data,
+			    sizeof(fiq_data->encoder_data));
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		struct legoev3_fiq_port_i2c_data *port =
+			&fiq_data->port_data[i];
+
+		fiq_lockdown_dcache(d, port->gpio, sizeof(port->gpio));
+		fiq_lockdown_dcache(d, &port->queue_head,
+				    (void *)&port->periodic
+				    - (void *)&port->queue_head);
+		fiq_lockdown_dcache(d, &port->cur_xfer,
+				    (void *)(port + 1)
+				    - (void *)&port->cur_xfer);
+		fiq_lockdown_dcache(d, &port->periodic.read_msg,
+				    (void *)(&port->periodic.countdown + 1)
+				    - (void *)&port->periodic.read_msg);
+	}
+	if (!fiq_data->periodic_page_phys)
+		fiq_lockdown_dcache(d, fiq_data->periodic_page,
+				    sizeof(*fiq_data->periodic_page));
+
+	/* the FIQ vector itself, then the registers, then code and data */
+	fiq_lockdown_tlb(t, (void *)0xffff0000, sizeof(u32));
+	fiq_lockdown_tlb(t, (void __force *)fiq_data->intc_base, sizeof(u32));
+	fiq_lockdown_tlb(t, (void __force *)fiq_data->gpio_base, sizeof(u32));
+	fiq_lockdown_tlb(t, (void __force *)fiq_data->ehrpwm_base,
+			 sizeof(u32));
+	fiq_lockdown_tlb(t, (void *)text_start, text_end - text_start);
+	fiq_lockdown_tlb(t, &legoev3_fiq_data, sizeof(legoev3_fiq_data));
+	fiq_lockdown_tlb(t, stack_top - sizeof(u64), sizeof(u64));
+	fiq_lockdown_tlb(t, fiq_data, sizeof(*fiq_data));
+	fiq_lockdown_tlb(t, fiq_data->periodic_page,
+			 sizeof(*fiq_data->periodic_page));
+
+	local_fiq_enable();
+	local_irq_restore(flags);
+
+	if (icache_locked)
+		dev_info(dev, "Locked %lu bytes of FIQ code into the I-cache\n",
+			 text_end - text_start);
+	else
+		dev_warn(dev, "%lu bytes of FIQ code do not fit in one I-cache way\n",
+			 text_end - text_start);
+	dev_info(dev, "Locked %u D-cache lines (%u skipped), %u TLB entries (%u skipped)\n",
+		 d->locked, d->skipped, t->count, t->skipped);
+out:
+	kfree(t);
+	kfree(d);
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_int_is_enabled);
+#else
+static inline void legoev3_fiq_lockdown(struct legoev3_fiq_data *fiq_data)
+{
+}
+#endif
+
+#ifdef CONFIG_LEGOEV3_FIQ_PERF
+#define FIQ_TIMER_HZ	(USEC_PER_SEC / FIQ_TIMER_TICK_US)
 
 /*
- * Only called when the ehrpwm interrupt is configured as regular IRQ and
- * not as a FIQ. In other words, this is for debugging (when assigned to IRQ)
- * and serves as a dummy callback during normal usage (when assigned to FIQ).
+ * A perf event that samples from the I2C timer FIQ instead of an IRQ, so
+ * that code running with IRQs disabled shows up in the profile. The period
+ * is in FIQ timer ticks. Only one event can be active at a time.
  */
-static irqreturn_t legoev3_fiq_ehrpwm_et_callback(int irq, void *data)
+static struct legoev3_fiq_pmu {
+	struct pmu pmu;
+	struct perf_event *event;
+	struct hrtimer timer;
+	/* a struct perf_callchain_entry with room for a context marker */
+	u64 chain[2 + FIQ_PERF_MAX_DEPTH];
+} legoev3_fiq_pmu;
+
+static void legoev3_fiq_perf_output(struct perf_event *event,
+				    struct legoev3_fiq_perf_sample *s,
+				    u32 now)
 {
-	fiq_c_handler_t handler = get_fiq_c_handler();
+	struct perf_callchain_entry *chain =
+		(struct perf_callchain_entry *)legoev3_fiq_pmu.chain;
+	u64 sample_type = event->attr.sample_type;
+	bool user = (s->cpsr & MODE_MASK) == USR_MODE;
+	struct perf_output_handle handle;
+	struct perf_event_header header;
+	struct perf_sample_data data;
+	struct pt_regs regs;
+	int i;
 
-	if (handler)
-		handler();
+	local64_add(s->period, &event->count);
 
-	return IRQ_HANDLED;
+	if (user ? event->attr.exclude_user : event->attr.exclude_kernel)
+		return;
+	if (event->attr.exclude_idle && !user && !s->tid)
+		return;
+
+	/*
+	 * The stack has moved on since the sample was taken, so sp and fp are
+	 * left at 0 to keep perf from walking it. The callchain recorded by
+	 * the FIQ replaces the one perf comes up with.
+	 */
+	memset(&regs, 0, sizeof(regs));
+	regs.ARM_pc = s->pc;
+	regs.ARM_lr = s->lr;
+	regs.ARM_cpsr = s->cpsr;
+
+	perf_sample_data_init(&data, 0, s->period);
+
+	rcu_read_lock();
+
+	perf_prepare_sample(&header, &data, event, &regs);
+
+	/* the sample belongs to the interrupted task, not to current */
+	if (sample_type & PERF_SAMPLE_TID) {
+		data.tid_entry.pid = s->pid;
+		data.tid_entry.tid = s->tid;
+	}
+	if (sample_type & PERF_SAMPLE_TIME)
+		data.time -= div_u64((u64)(now - s->timestamp) * NSEC_PER_SEC,
+				     davinci_timer_get_tick_rate());
+	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
+		if (data.callchain)
+			header.size -= data.callchain->nr * sizeof(u64);
+		chain->nr = 0;
+		chain->ip[chain->nr++] = user ? PERF_CONTEXT_USER
+					      : PERF_CONTEXT_KERNEL;
+		for (i = 0; i < s->nr; i++)
+			chain->ip[chain->nr++] = s->callchain[i];
+		data.callchain = chain;
+		header.size += chain->nr * sizeof(u64);
+	}
+
+	if (!perf_output_begin(&handle, event, header.size)) {
+		perf_output_sample(&handle, &header, &data, event);
+		perf_output_end(&handle);
+	}
+
+	rcu_read_unlock();
 }
 
-int legoev3_fiq_ehrpwm_request(void)
+static void legoev3_fiq_perf_drain(struct legoev3_fiq_data *fiq_data)
 {
-	int err;
+	struct legoev3_fiq_perf *perf = &fiq_data->perf;
+	struct perf_event *event = legoev3_fiq_pmu.event;
+	struct legoev3_fiq_perf_sample *s;
+	u32 head = READ_ONCE(perf->head);
+	u32 now = davinci_timer_read_freerun();
+
+	/* pairs with the barrier() before the FIQ advances head */
+	barrier();
+	while (perf->tail != head) {
+		s = &perf->ring[perf->tail & (FIQ_PERF_RING_SIZE - 1)];
+		legoev3_fiq_perf_output(event, s, now);
+		barrier();
+		WRITE_ONCE(perf->tail, perf->tail + 1);
+	}
+}
 
-	if (!legoev3_fiq_data)
-		return -ENODEV;
+static enum hrtimer_restart legoev3_fiq_perf_timer(struct hrtimer *timer)
+{
+	legoev3_fiq_perf_drain(legoev3_fiq_data);
+	hrtimer_forward_now(timer, ms_to_ktime(FIQ_PERF_DRAIN_MS));
 
-	if (legoev3_fiq_data->ehrpwm_data.requested_flag)
-		return -EBUSY;
-	legoev3_fiq_data->ehrpwm_data.requested_flag = 1;
+	return HRTIMER_RESTART;
+}
 
-	err = request_irq(legoev3_fiq_data->status_gpio_irq,
-			  legoev3_fiq_gpio_irq_period_elapsed_callback,
-			  IRQF_TRIGGER_RISING | IRQF_SHARED,
-			  legoev3_fiq_data->pdev->name,
-			  &legoev3_fiq_data->ehrpwm_data);
-	if (err) {
-		dev_err(&legoev3_fiq_data->pdev->dev,
-			"Unable to claim irq %d; error %d\n",
-			legoev3_fiq_data->status_gpio_irq, err);
-		legoev3_fiq_data->ehrpwm_data.requested_flag = 0;
-		return err;
-	}
+static int legoev3_fiq_perf_event_init(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
 
-	err = request_irq(legoev3_fiq_data->ehrpwm_irq,
-			  legoev3_fiq_ehrpwm_et_callback, 0,
-			  "legoev3_fiq_ehrpwm_debug",
-			  &legoev3_fiq_data->ehrpwm_data);
-	if (err)
-		dev_warn(&legoev3_fiq_data->pdev->dev,
-			 "Failed to request ehrpwm irq.");
+	if (event->attr.type != event->pmu->type)
+		return -ENOENT;
+	if (event->attr.config || event->cpu < 0)
+		return -EINVAL;
+	if (!is_sampling_event(event))
+		return -EOPNOTSUPP;
+	/* user stacks and registers are gone by the time the sample is sent */
+	if (event->attr.sample_type & (PERF_SAMPLE_REGS_USER |
+				       PERF_SAMPLE_STACK_USER |
+				       PERF_SAMPLE_BRANCH_STACK))
+		return -EOPNOTSUPP;
+
+	/* the core adjusts the period from the count in ticks later on */
+	if (event->attr.freq)
+		hwc->sample_period = max_t(u64, 1, FIQ_TIMER_HZ /
+					   event->attr.sample_freq);
+	hwc->sample_period = min_t(u64, hwc->sample_period, U32_MAX);
+	hwc->last_period = hwc->sample_period;
+	local64_set(&hwc->period_left, hwc->sample_period);
 
 	return 0;
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_request);
 
-void legoev3_fiq_ehrpwm_release(void)
+static void legoev3_fiq_perf_start(struct perf_event *event, int flags)
 {
-	if (!legoev3_fiq_data)
-		return;
+	struct legoev3_fiq_data *fiq_data = legoev3_fiq_data;
+	struct hw_perf_event *hwc = &event->hw;
+
+	hwc->state = 0;
+	hwc->last_period = hwc->sample_period;
 
 	local_fiq_disable();
-	free_irq(legoev3_fiq_data->status_gpio_irq,
-		 &legoev3_fiq_data->ehrpwm_data);
-	free_irq(legoev3_fiq_data->ehrpwm_irq, &legoev3_fiq_data->ehrpwm_data);
-	legoev3_fiq_data->ehrpwm_data.period_elapsed_flag = 0;
-	legoev3_fiq_data->ehrpwm_data.requested_flag = 0;
+	fiq_data->perf.period = hwc->sample_period;
+	fiq_data->perf.countdown = hwc->sample_period;
+	legoev3_fiq_enable(fiq_data->timer_irq);
 	local_fiq_enable();
+
+	hrtimer_start(&legoev3_fiq_pmu.timer, ms_to_ktime(FIQ_PERF_DRAIN_MS),
+		      HRTIMER_MODE_REL_PINNED);
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_release);
 
-int legoev3_fiq_ehrpwm_prepare(struct snd_pcm_substream *substream, int volume,
-			       unsigned char int_period,
-			       void (*period_elapsed)(void *), void *context)
+static void legoev3_fiq_perf_stop(struct perf_event *event, int flags)
 {
-	struct legoev3_fiq_ehrpwm_data *data;
+	struct legoev3_fiq_data *fiq_data = legoev3_fiq_data;
+	struct hw_perf_event *hwc = &event->hw;
 
-	if (!legoev3_fiq_data || !legoev3_fiq_data->ehrpwm_data.requested_flag)
-		return -ENODEV;
+	if (hwc->state & PERF_HES_STOPPED)
+		return;
 
-	if (int_period > 3)
-		return -EINVAL;
+	/* the timer stops by itself if nobody else needs it */
+	local_fiq_disable();
+	fiq_data->perf.period = 0;
+	local_fiq_enable();
 
-	data = &legoev3_fiq_data->ehrpwm_data;
+	hrtimer_cancel(&legoev3_fiq_pmu.timer);
+	legoev3_fiq_perf_drain(fiq_data);
 
-	local_fiq_disable();
+	hwc->state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
 
-	data->dma_area			= substream->runtime->dma_area;
-	data->playback_ptr		= 0;
-	data->volume			= volume;
-	data->frame_bytes		= frames_to_bytes(substream->runtime, 1);
-	data->buffer_bytes		= snd_pcm_lib_buffer_bytes(substream);
-	data->period_size		= substream->runtime->period_size;
-	data->callback_count		= 0;
-	data->period_elapsed		= period_elapsed;
-	data->period_elapsed_data	= context;
-	data->period_elapsed_flag	= 0;
-	fiq_ehrpwm_et_int_set_period(int_period);
+static int legoev3_fiq_perf_add(struct perf_event *event, int flags)
+{
+	struct legoev3_fiq_data *fiq_data = legoev3_fiq_data;
 
-	local_fiq_enable();
+	if (legoev3_fiq_pmu.event)
+		return -EBUSY;
+
+	legoev3_fiq_pmu.event = event;
+	fiq_data->perf.dropped = 0;
+	event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+	if (flags & PERF_EF_START)
+		legoev3_fiq_perf_start(event, PERF_EF_RELOAD);
 
 	return 0;
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_prepare);
 
-unsigned legoev3_fiq_ehrpwm_get_playback_ptr(void)
+static void legoev3_fiq_perf_del(struct perf_event *event, int flags)
 {
-	return legoev3_fiq_data->ehrpwm_data.playback_ptr;
+	struct legoev3_fiq_data *fiq_data = legoev3_fiq_data;
+
+	legoev3_fiq_perf_stop(event, PERF_EF_UPDATE);
+	legoev3_fiq_pmu.event = NULL;
+
+	if (fiq_data->perf.dropped)
+		dev_warn(&fiq_data->pdev->dev,
+			 "perf: dropped %u samples, use a longer period\n",
+			 fiq_data->perf.dropped);
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_get_playback_ptr);
 
-void legoev3_fiq_ehrpwm_set_volume(int volume)
+/* the count is brought up to date each time the ring is drained */
+static void legoev3_fiq_perf_read(struct perf_event *event)
 {
-	legoev3_fiq_data->ehrpwm_data.volume = volume;
 }
-EXPORT_SYMBOL_GPL(legoev3_fiq_ehrpwm_set_volume);
+
+static void legoev3_fiq_perf_init(struct legoev3_fiq_data *fiq_data)
+{
+	struct legoev3_fiq_perf_sample *ring;
+	int ret;
+
+	ring = kcalloc(FIQ_PERF_RING_SIZE, sizeof(*ring), GFP_KERNEL);
+	if (!ring) {
+		dev_warn(&fiq_data->pdev->dev,
+			 "Unable to allocate perf ring.\n");
+		return;
+	}
+	fiq_data->perf.ring = ring;
+
+	hrtimer_init(&legoev3_fiq_pmu.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	legoev3_fiq_pmu.timer.function = legoev3_fiq_perf_timer;
+
+	legoev3_fiq_pmu.pmu = (struct pmu) {
+		.task_ctx_nr	= perf_invalid_context,
+		.event_init	= legoev3_fiq_perf_event_init,
+		.add		= legoev3_fiq_perf_add,
+		.del		= legoev3_fiq_perf_del,
+		.start		= legoev3_fiq_perf_start,
+		.stop		= legoev3_fiq_perf_stop,
+		.read		= legoev3_fiq_perf_read,
+	};
+	ret = perf_pmu_register(&legoev3_fiq_pmu.pmu, "legoev3_fiq", -1);
+	if (ret < 0) {
+		dev_warn(&fiq_data->pdev->dev,
+			 "Unable to register perf PMU, error %d\n", ret);
+		fiq_data->perf.ring = NULL;
+		kfree(ring);
+	}
+}
+#else
+static inline void legoev3_fiq_perf_init(struct legoev3_fiq_data *fiq_data)
+{
+}
+#endif
 
 static int legoev3_fiq_probe(struct platform_device *pdev)
 {
 	struct legoev3_fiq_data *fiq_data;
 	struct legoev3_fiq_platform_data *pdata;
-	int ret;
+	int ret, irq;
 
 	if (legoev3_fiq_data)
 		return -EINVAL;
 
-	fiq_data = &legoev3_fiq_init_data;
-
 	pdata = pdev->dev.platform_data;
 	if (!pdata) {
 		dev_err(&pdev->dev, "Missing platform data.\n");
 		return -EINVAL;
 	}
 
+	fiq_data = sram_alloc(sizeof(*fiq_data), NULL);
+	if (fiq_data) {
+		memset(fiq_data, 0, sizeof(*fiq_data));
+		fiq_data->in_sram = 1;
+	} else {
+		dev_warn(&pdev->dev, "Not enough SRAM, using DDR for FIQ data.\n");
+		fiq_data = devm_kzalloc(&pdev->dev, sizeof(*fiq_data),
+					GFP_KERNEL);
+		if (!fiq_data)
+			return -ENOMEM;
+	}
+	fiq_data->fiq_handler.name = "legoev3-fiq-handler";
+	fiq_data->pdev = pdev;
+	legoev3_fiq_alloc_periodic_page(fiq_data);
+
+	ret = -EADDRNOTAVAIL;
+
 	fiq_data->gpio_base = devm_ioremap(&pdev->dev, pdata->gpio_mem_base,
 					   pdata->gpio_mem_size);
 	if (WARN_ON(!fiq_data->gpio_base))
-		return -EADDRNOTAVAIL;
+		goto err_ioremap;
 
 	fiq_data->intc_base = devm_ioremap(&pdev->dev, pdata->intc_mem_base,
 					   pdata->intc_mem_size);
 	if (WARN_ON(!fiq_data->intc_base))
-		return -EADDRNOTAVAIL;
+		goto err_ioremap;
 
 	fiq_data->ehrpwm_base = devm_ioremap(&pdev->dev, pdata->ehrpwm_mem_base,
 					     pdata->ehrpwm_mem_size);
 	if (WARN_ON(!fiq_data->ehrpwm_base))
-		return -EADDRNOTAVAIL;
+		goto err_ioremap;
+	fiq_data->ehrpwm_phys = pdata->ehrpwm_mem_base;
+
+	if (pdata->uart_timer_mem_base) {
+		fiq_data->uart_timer_base = devm_ioremap(&pdev->dev,
+						pdata->uart_timer_mem_base,
+						pdata->uart_timer_mem_size);
+		if (WARN_ON(!fiq_data->uart_timer_base))
+			goto err_ioremap;
+
+		fiq_data->uart_timer_clk = devm_clk_get(&pdev->dev,
+							"uart_timer");
+		if (IS_ERR(fiq_data->uart_timer_clk)) {
+			ret = PTR_ERR(fiq_data->uart_timer_clk);
+			goto err_ioremap;
+		}
+		ret = clk_prepare_enable(fiq_data->uart_timer_clk);
+		if (ret < 0)
+			goto err_ioremap;
+
+		/* 32-bit unchained, the software UART only uses TIM12 */
+		__raw_writel(0, fiq_data->uart_timer_base + TCR);
+		__raw_writel(0, fiq_data->uart_timer_base + TGCR);
+		__raw_writel(TGCR_32BIT_UNCHAINED,
+			     fiq_data->uart_timer_base + TGCR);
+		__raw_writel(TGCR_32BIT_UNCHAINED | TGCR_UNRESET,
+			     fiq_data->uart_timer_base + TGCR);
+	}
 
 	fiq_data->timer_irq = pdata->timer_irq;
 	fiq_data->ehrpwm_irq = pdata->ehrpwm_irq;
+	fiq_data->uart_timer_irq = pdata->uart_timer_irq;
 
 	ret = gpio_request_one(pdata->status_gpio, GPIOF_INIT_LOW, "fiq status");
 	if (ret < 0) {
 		dev_err(&pdev->dev,
 			"Unable to request GPIO %d, error %d\n",
 			pdata->status_gpio, ret);
-		return ret;
+		goto err_gpio_request;
 	}
 	legoev3_fiq_set_gpio(pdata->status_gpio, &fiq_data->status_gpio);
 
@@ -884,21 +3985,81 @@ static int legoev3_fiq_probe(struct platform_device *pdev)
 	}
 	fiq_data->status_gpio_irq = ret;
 
+	/*
+	 * Only the FIQ drives the status gpio, so there can't be any edges
+	 * before the FIQ is enabled below.
+	 */
+	ret = devm_request_irq(&pdev->dev, fiq_data->status_gpio_irq,
+			       legoev3_fiq_status_gpio_irq_callback,
+			       IRQF_TRIGGER_RISING, pdev->name, fiq_data);
+	if (ret < 0) {
+		dev_err(&pdev->dev, "Unable to claim irq %d; error %d\n",
+			fiq_data->status_gpio_irq, ret);
+		goto err_request_irq;
+	}
+
+	/* same channels as in da850_default_priorities, sound goes first */
+	ret = __legoev3_fiq_request_irq(fiq_data, fiq_data->timer_irq, 1,
+					legoev3_fiq_timer_handler, fiq_data);
+	if (ret < 0)
+		goto err_request_fiq_irq;
+	ret = __legoev3_fiq_request_irq(fiq_data, fiq_data->ehrpwm_irq, 0,
+					legoev3_fiq_ehrpwm_handler,
+					&fiq_data->ehrpwm_data);
+	if (ret < 0)
+		goto err_request_fiq_irq;
+	if (fiq_data->uart_timer_base) {
+		ret = __legoev3_fiq_request_irq(fiq_data,
+						fiq_data->uart_timer_irq, 0,
+						legoev3_fiq_uart_handler,
+						fiq_data);
+		if (ret < 0)
+			goto err_request_fiq_irq;
+	}
+
 	ret = claim_fiq(&fiq_data->fiq_handler);
 	if (ret < 0)
 		goto err_claim_fiq;
-	set_fiq_c_handler(legoev3_fiq_handler);
+	set_fiq_c_handler_stack(legoev3_fiq_handler,
+				(u8 *)fiq_data->fiq_stack + FIQ_STACK_SIZE);
 
-	fiq_data->pdev = pdev;
 	legoev3_fiq_data = fiq_data;
 
+	legoev3_fiq_stats_init(fiq_data);
+	legoev3_fiq_lockdown(fiq_data);
+	legoev3_fiq_perf_init(fiq_data);
+
 	cp_intc_fiq_enable();
 
+	legoev3_fiq_periodic_attr.private = fiq_data;
+	if (device_create_bin_file(&pdev->dev, &legoev3_fiq_periodic_attr))
+		dev_warn(&pdev->dev, "Unable to create periodic attribute.\n");
+
 	return 0;
 
 err_claim_fiq:
+err_request_fiq_irq:
+	/* none of them has been enabled yet, just route them back */
+	for (irq = 0; irq < FIQ_NUM_IRQ; irq++) {
+		struct legoev3_fiq_client *client = &fiq_data->clients[irq];
+
+		if (!client->handler)
+			continue;
+		cp_intc_set_channel(irq, client->prev_channel);
+		client->handler = NULL;
+		client->data = NULL;
+	}
+	devm_free_irq(&pdev->dev, fiq_data->status_gpio_irq, fiq_data);
+err_request_irq:
 err_gpio_to_irq:
 	gpio_free(pdata->status_gpio);
+err_gpio_request:
+	if (fiq_data->uart_timer_base)
+		clk_disable_unprepare(fiq_data->uart_timer_clk);
+err_ioremap:
+	legoev3_fiq_free_periodic_page(fiq_data);
+	if (fiq_data->in_sram)
+		sram_free(fiq_data, sizeof(*fiq_data));
 
 	return ret;
 }
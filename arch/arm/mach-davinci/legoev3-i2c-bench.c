@@ -0,0 +1,203 @@
+/*
+ * Throughput benchmark for the LEGO MINDSTORMS EV3 FIQ soft-I2C
+ *
+ * Runs once when the module is loaded. For each transfer size in sizes[] and
+ * each message count from 1 to max_msgs, xfers transactions are sent with
+ * i2c_transfer() to addr on the i2c-legoev3 adapter of the given input port:
+ *
+ *   1 message   read size bytes
+ *   2 messages  write reg, then read size bytes (repeated start)
+ *   3+ messages more write/read pairs in front, an odd count starts with a
+ *               plain read
+ *
+ * Any I2C sensor that answers register reads works as the target. The LEGO
+ * protocol puts the firmware version at register 0 of address 1, which is
+ * the default. Without a sensor every transaction is NACKed on the address
+ * byte, which still measures the per transaction overhead.
+ *
+ * Each combination prints one line of key=value pairs, wrapped here:
+ *
+ *   legoev3_i2c_bench: port=1 size=8 msgs=2 xfers=200 ok=200 nack=0 err=0
+ *	us=123456 xfers_per_s=1620 bytes_per_s=12960 fiq_permille=85
+ *
+ * bytes_per_s only counts the payload that was read.
+ * fiq_permille is the share of the CPU spent in the FIQ handler, or -1 if
+ * CONFIG_LEGOEV3_FIQ_STATS is disabled. The benchmark loads the CPU with
+ * interrupt handling of its own, so compare runs with each other rather than
+ * reading it as an absolute figure.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/i2c.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include <mach/legoev3-fiq.h>
+
+/* i2c-legoev3 adapter numbers, see legoev3_register_in_port_i2c() */
+#define BENCH_FIRST_BUS		3
+#define BENCH_MAX_SIZE		32
+#define BENCH_MAX_SIZES		8
+
+static unsigned port = 1;
+module_param(port, uint, 0444);
+MODULE_PARM_DESC(port, "Input port 1-4");
+
+static unsigned short addr = 0x01;
+module_param(addr, ushort, 0444);
+MODULE_PARM_DESC(addr, "7-bit address of the target");
+
+static unsigned char reg;
+module_param(reg, byte, 0444);
+MODULE_PARM_DESC(reg, "First register to read");
+
+static unsigned sizes[BENCH_MAX_SIZES] = { 1, 2, 4, 8, 16 };
+static int num_sizes = 5;
+module_param_array(sizes, uint, &num_sizes, 0444);
+MODULE_PARM_DESC(sizes, "Read lengths to sweep, 1-32 bytes");
+
+static unsigned max_msgs = 2;
+module_param(max_msgs, uint, 0444);
+MODULE_PARM_DESC(max_msgs, "Sweep 1 to this many messages per transaction");
+
+static unsigned xfers = 200;
+module_param(xfers, uint, 0444);
+MODULE_PARM_DESC(xfers, "Transactions per combination");
+
+struct bench_result {
+	unsigned ok;
+	unsigned nack;
+	unsigned err;
+	u64 ns;
+	u64 fiq_ns;
+	bool fiq_valid;
+};
+
+static void bench_build(struct i2c_msg *msgs, unsigned num_msgs, u8 *wbuf,
+			u8 *rbuf, unsigned size)
+{
+	unsigned i;
+
+	for (i = 0; i < num_msgs; i++) {
+		msgs[i].addr = addr;
+		/* the last message is always a read, preceded by its write */
+		if ((num_msgs - i) & 1) {
+			msgs[i].flags = I2C_M_RD;
+			msgs[i].len = size;
+			msgs[i].buf = rbuf;
+		} else {
+			msgs[i].flags = 0;
+			msgs[i].len = 1;
+			msgs[i].buf = wbuf;
+		}
+	}
+}
+
+static void bench_run(struct i2c_adapter *adap, struct i2c_msg *msgs,
+		      unsigned num_msgs, struct bench_result *res)
+{
+	u64 fiq_start, fiq_end;
+	ktime_t start;
+	unsigned i;
+	int ret;
+
+	memset(res, 0, sizeof(*res));
+	res->fiq_valid = !legoev3_fiq_get_busy_ns(&fiq_start);
+	start = ktime_get();
+
+	for (i = 0; i < xfers; i++) {
+		ret = i2c_transfer(adap, msgs, num_msgs);
+		if (ret == num_msgs)
+			res->ok++;
+		else if (ret == -ENXIO)
+			res->nack++;
+		else
+			res->err++;
+	}
+
+	res->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (res->fiq_valid && !legoev3_fiq_get_busy_ns(&fiq_end) &&
+	    fiq_end >= fiq_start)
+		res->fiq_ns = fiq_end - fiq_start;
+	else
+		res->fiq_valid = false;
+}
+
+static void bench_report(unsigned size, unsigned num_msgs,
+			 const struct bench_result *res)
+{
+	u64 ns = max_t(u64, res->ns, 1);
+	unsigned reads = (num_msgs + 1) / 2;
+	int fiq_permille = -1;
+
+	if (res->fiq_valid)
+		fiq_permille = div64_u64(res->fiq_ns * 1000, ns);
+
+	pr_info("legoev3_i2c_bench: port=%u size=%u msgs=%u xfers=%u ok=%u nack=%u err=%u us=%llu xfers_per_s=%llu bytes_per_s=%llu fiq_permille=%d\n",
+		port, size, num_msgs, xfers, res->ok, res->nack, res->err,
+		div_u64(res->ns, NSEC_PER_USEC),
+		div64_u64((u64)xfers * NSEC_PER_SEC, ns),
+		div64_u64((u64)res->ok * reads * size * NSEC_PER_SEC, ns),
+		fiq_permille);
+}
+
+static int __init legoev3_i2c_bench_init(void)
+{
+	struct i2c_msg msgs[LEGOEV3_FIQ_I2C_MAX_MSGS];
+	struct bench_result res;
+	struct i2c_adapter *adap;
+	u8 *buf;
+	unsigned num_msgs;
+	int i;
+
+	if (port < 1 || port > NUM_EV3_PORT_IN || !xfers || !max_msgs ||
+	    max_msgs > LEGOEV3_FIQ_I2C_MAX_MSGS)
+		return -EINVAL;
+	for (i = 0; i < num_sizes; i++) {
+		if (!sizes[i] || sizes[i] > BENCH_MAX_SIZE)
+			return -EINVAL;
+	}
+
+	adap = i2c_get_adapter(BENCH_FIRST_BUS + port - 1);
+	if (!adap) {
+		pr_err("legoev3_i2c_bench: no I2C adapter on input port %u\n",
+		       port);
+		return -ENODEV;
+	}
+
+	/* the register number, followed by the read buffer */
+	buf = kmalloc(1 + BENCH_MAX_SIZE, GFP_KERNEL);
+	if (!buf) {
+		i2c_put_adapter(adap);
+		return -ENOMEM;
+	}
+	buf[0] = reg;
+
+	for (i = 0; i < num_sizes; i++) {
+		for (num_msgs = 1; num_msgs <= max_msgs; num_msgs++) {
+			bench_build(msgs, num_msgs, buf, buf + 1, sizes[i]);
+			bench_run(adap, msgs, num_msgs, &res);
+			bench_report(sizes[i], num_msgs, &res);
+		}
+	}
+
+	kfree(buf);
+	i2c_put_adapter(adap);
+
+	return 0;
+}
+module_init(legoev3_i2c_bench_init);
+
+static void __exit legoev3_i2c_bench_exit(void)
+{
+}
+module_exit(legoev3_i2c_bench_exit);
+
+MODULE_DESCRIPTION("LEGO MINDSTORMS EV3 FIQ soft-I2C benchmark");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,472 @@
+/*
+ * IIO devices for the I2C sensors on the LEGO MINDSTORMS EV3 input ports
+ *
+ * NXT style I2C sensors answer at address 0x01 and carry their vendor and
+ * product id as 8 character strings at registers 0x08 and 0x10. When an
+ * i2c-legoev3 adapter is created for a port (see legoev3-ports.c), the I2C
+ * core has this driver detect the sensor, and one IIO device is registered
+ * for each sensor in legoev3_i2c_iio_sensors[].
+ *
+ * While the buffer is enabled, the data registers of the sensor are read by
+ * the FIQ on its own every 1/sampling_frequency seconds with
+ * legoev3_fiq_start_periodic(). Each transfer raises the status gpio
+ * interrupt, and the notify callback copies the result slot as it is into
+ * the buffer, so the channels are laid out the way the sensor sends them and
+ * the IIO core demuxes the scan for smaller channel masks. The timestamp is
+ * taken when the FIQ finished the transfer, not when the interrupt ran.
+ * Transfers that fail, e.g. while the sensor is being unplugged, are dropped.
+ *
+ * Reads of the raw attributes go to the sensor with a regular I2C transfer
+ * while the buffer is disabled and are answered from the latest periodic
+ * result while it is enabled.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/ctype.h>
+#include <linux/i2c.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/kfifo_buf.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/platform_data/legoev3_i2c.h>
+#include <linux/string.h>
+
+#include <asm/unaligned.h>
+
+#include <mach/legoev3-fiq.h>
+
+#define LEGOEV3_I2C_IIO_ADDR		0x01
+#define LEGOEV3_I2C_IIO_VENDOR_REG	0x08
+#define LEGOEV3_I2C_IIO_PRODUCT_REG	0x10
+#define LEGOEV3_I2C_IIO_ID_LEN		8
+
+#define LEGOEV3_I2C_IIO_MIN_PERIOD_US	1000
+#define LEGOEV3_I2C_IIO_MAX_PERIOD_US	1000000
+
+/**
+ * struct legoev3_i2c_iio_sensor - a supported sensor
+ * @vendor: Vendor id, compared up to the first space.
+ * @product: Product id, compared up to the first space.
+ * @name: Name of the IIO device.
+ * @reg: First data register.
+ * @len: Number of data registers read by each transfer.
+ * @period_us: Default time between two transfers.
+ * @channels: The data channels followed by the timestamp, in register order.
+ *	The address of a data channel is its offset from @reg.
+ * @num_channels: Number of entries in @channels, including the timestamp.
+ */
+struct legoev3_i2c_iio_sensor {
+	const char *vendor;
+	const char *product;
+	const char *name;
+	u8 reg;
+	u8 len;
+	unsigned period_us;
+	const struct iio_chan_spec *channels;
+	int num_channels;
+};
+
+#define LEGOEV3_I2C_IIO_CHAN(_type, _mod, _index, _offset, _bits, _endian) { \
+	.type = (_type),						\
+	.modified = !!(_mod),						\
+	.channel2 = (_mod),						\
+	.address = (_offset),						\
+	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),			\
+	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),		\
+	.info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),	\
+	.scan_index = (_index),						\
+	.scan_type = {							\
+		.sign = 'u',						\
+		.realbits = (_bits),					\
+		.storagebits = (_bits),					\
+		.endianness = (_endian),				\
+	},								\
+}
+
+/* LEGO ultrasonic sensor, distance in cm */
+static const struct iio_chan_spec legoev3_i2c_iio_us_channels[] = {
+	LEGOEV3_I2C_IIO_CHAN(IIO_DISTANCE, 0, 0, 0, 8, IIO_CPU),
+	IIO_CHAN_SOFT_TIMESTAMP(1),
+};
+
+/* HiTechnic compass, heading in degrees at register 0x44 */
+static const struct iio_chan_spec legoev3_i2c_iio_compass_channels[] = {
+	LEGOEV3_I2C_IIO_CHAN(IIO_ROT, IIO_MOD_NORTH_MAGN, 0, 0, 16, IIO_LE),
+	IIO_CHAN_SOFT_TIMESTAMP(1),
+};
+
+/* HiTechnic color sensor, 8-bit RGB at registers 0x43 to 0x45 */
+static const struct iio_chan_spec legoev3_i2c_iio_color_channels[] = {
+	LEGOEV3_I2C_IIO_CHAN(IIO_INTENSITY, IIO_MOD_LIGHT_RED, 0, 0, 8,
+			     IIO_CPU),
+	LEGOEV3_I2C_IIO_CHAN(IIO_INTENSITY, IIO_MOD_LIGHT_GREEN, 1, 1, 8,
+			     IIO_CPU),
+	LEGOEV3_I2C_IIO_CHAN(IIO_INTENSITY, IIO_MOD_LIGHT_BLUE, 2, 2, 8,
+			     IIO_CPU),
+	IIO_CHAN_SOFT_TIMESTAMP(3),
+};
+
+static const struct legoev3_i2c_iio_sensor legoev3_i2c_iio_sensors[] = {
+	{
+		.vendor		= "LEGO",
+		.product	= "Sonar",
+		.name		= "lego-nxt-us",
+		.reg		= 0x42,
+		.len		= 1,
+		.period_us	= 50000,
+		.channels	= legoev3_i2c_iio_us_channels,
+		.num_channels	= ARRAY_SIZE(legoev3_i2c_iio_us_channels),
+	},
+	{
+		.vendor		= "HiTechnc",
+		.product	= "Compass",
+		.name		= "ht-nxt-compass",
+		.reg		= 0x44,
+		.len		= 2,
+		.period_us	= 10000,
+		.channels	= legoev3_i2c_iio_compass_channels,
+		.num_channels	=
+			ARRAY_SIZE(legoev3_i2c_iio_compass_channels),
+	},
+	{
+		.vendor		= "HiTechnc",
+		.product	= "Color",
+		.name		= "ht-nxt-color",
+		.reg		= 0x43,
+		.len		= 3,
+		.period_us	= 10000,
+		.channels	= legoev3_i2c_iio_color_channels,
+		.num_channels	=
+			ARRAY_SIZE(legoev3_i2c_iio_color_channels),
+	},
+};
+
+struct legoev3_i2c_iio {
+	struct i2c_client *client;
+	const struct legoev3_i2c_iio_sensor *sensor;
+	enum legoev3_input_port_id port_id;
+	unsigned period_us;
+	unsigned seq;
+	/* the raw data, padded for the timestamp */
+	u8 scan[ALIGN(LEGOEV3_FIQ_I2C_PERIODIC_MAX_LEN, sizeof(s64))
+		+ sizeof(s64)] __aligned(sizeof(s64));
+};
+
+static const struct legoev3_i2c_iio_sensor *
+legoev3_i2c_iio_find(const char *vendor, const char *product)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(legoev3_i2c_iio_sensors); i++) {
+		const struct legoev3_i2c_iio_sensor *s =
+						&legoev3_i2c_iio_sensors[i];
+
+		if (!strcmp(vendor, s->vendor) && !strcmp(product, s->product))
+			return s;
+	}
+
+	return NULL;
+}
+
+/* Reads an id string and cuts it at the first space or non-printable char. */
+static int legoev3_i2c_iio_read_id(struct i2c_client *client, u8 reg,
+				   char *id)
+{
+	int i, ret;
+
+	ret = i2c_smbus_read_i2c_block_data(client, reg,
+					    LEGOEV3_I2C_IIO_ID_LEN, (u8 *)id);
+	if (ret < 0)
+		return ret;
+	if (ret != LEGOEV3_I2C_IIO_ID_LEN)
+		return -EIO;
+
+	for (i = 0; i < LEGOEV3_I2C_IIO_ID_LEN; i++) {
+		if (id[i] == ' ' || !isprint(id[i]))
+			break;
+	}
+	id[i] = 0;
+
+	return 0;
+}
+
+static const struct legoev3_i2c_iio_sensor *
+legoev3_i2c_iio_identify(struct i2c_client *client)
+{
+	char vendor[LEGOEV3_I2C_IIO_ID_LEN + 1];
+	char product[LEGOEV3_I2C_IIO_ID_LEN + 1];
+	const struct legoev3_i2c_iio_sensor *sensor;
+
+	if (legoev3_i2c_iio_read_id(client, LEGOEV3_I2C_IIO_VENDOR_REG,
+				    vendor) ||
+	    legoev3_i2c_iio_read_id(client, LEGOEV3_I2C_IIO_PRODUCT_REG,
+				    product))
+		return NULL;
+
+	sensor = legoev3_i2c_iio_find(vendor, product);
+	if (!sensor)
+		dev_dbg(&client->adapter->dev, "unsupported sensor %s %s\n",
+			vendor, product);
+
+	return sensor;
+}
+
+static enum legoev3_input_port_id
+legoev3_i2c_iio_port_id(struct i2c_adapter *adap)
+{
+	struct device *parent = adap->dev.parent;
+	const struct i2c_legoev3_platform_data *pdata;
+
+	if (!parent || parent->bus != &platform_bus_type ||
+	    strcmp(to_platform_device(parent)->name, "i2c-legoev3"))
+		return NUM_EV3_PORT_IN;
+
+	pdata = dev_get_platdata(parent);
+
+	return pdata ? pdata->port_id : NUM_EV3_PORT_IN;
+}
+
+static int legoev3_i2c_iio_detect(struct i2c_client *client,
+				  struct i2c_board_info *info)
+{
+	if (legoev3_i2c_iio_port_id(client->adapter) >= NUM_EV3_PORT_IN)
+		return -ENODEV;
+	if (!legoev3_i2c_iio_identify(client))
+		return -ENODEV;
+
+	strlcpy(info->type, "legoev3-i2c-iio", I2C_NAME_SIZE);
+
+	return 0;
+}
+
+static void legoev3_i2c_iio_notify(void *context, unsigned seq, u32 age_ns)
+{
+	struct iio_dev *indio_dev = context;
+	struct legoev3_i2c_iio *data = iio_priv(indio_dev);
+	int ret;
+
+	ret = legoev3_fiq_read_periodic(data->port_id, data->scan,
+					data->sensor->len, &data->seq);
+	if (ret < 0)
+		return;
+
+	/* newer data may have arrived since the notification was raised */
+	if (data->seq != seq)
+		age_ns = 0;
+
+	iio_push_to_buffers_with_timestamp(indio_dev, data->scan,
+					   iio_get_time_ns(indio_dev) - age_ns);
+}
+
+static int legoev3_i2c_iio_postenable(struct iio_dev *indio_dev)
+{
+	struct legoev3_i2c_iio *data = iio_priv(indio_dev);
+	const struct legoev3_i2c_iio_sensor *sensor = data->sensor;
+	u8 reg = sensor->reg;
+	struct i2c_msg msgs[2] = {
+		{
+			.addr	= data->client->addr,
+			.len	= 1,
+			.buf	= &reg,
+		},
+		{
+			.addr	= data->client->addr,
+			.flags	= I2C_M_RD,
+			.len	= sensor->len,
+			.buf	= data->scan,
+		},
+	};
+	int ret;
+
+	ret = legoev3_fiq_set_periodic_notify(data->port_id,
+					      legoev3_i2c_iio_notify,
+					      indio_dev);
+	if (ret < 0)
+		return ret;
+
+	ret = legoev3_fiq_start_periodic(data->port_id, msgs, ARRAY_SIZE(msgs),
+					 data->period_us);
+	if (ret < 0)
+		legoev3_fiq_set_periodic_notify(data->port_id, NULL, NULL);
+
+	return ret;
+}
+
+static int legoev3_i2c_iio_predisable(struct iio_dev *indio_dev)
+{
+	struct legoev3_i2c_iio *data = iio_priv(indio_dev);
+
+	legoev3_fiq_stop_periodic(data->port_id);
+	legoev3_fiq_set_periodic_notify(data->port_id, NULL, NULL);
+
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops legoev3_i2c_iio_buffer_ops = {
+	.postenable	= legoev3_i2c_iio_postenable,
+	.predisable	= legoev3_i2c_iio_predisable,
+};
+
+static int legoev3_i2c_iio_read_raw(struct iio_dev *indio_dev,
+				    struct iio_chan_spec const *chan,
+				    int *val, int *val2, long mask)
+{
+	struct legoev3_i2c_iio *data = iio_priv(indio_dev);
+	const struct legoev3_i2c_iio_sensor *sensor = data->sensor;
+	u8 buf[LEGOEV3_FIQ_I2C_PERIODIC_MAX_LEN];
+	int ret;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		if (!iio_device_claim_direct_mode(indio_dev)) {
+			ret = i2c_smbus_read_i2c_block_data(data->client,
+							    sensor->reg,
+							    sensor->len, buf);
+			iio_device_release_direct_mode(indio_dev);
+			if (ret >= 0 && ret != sensor->len)
+				ret = -EIO;
+		} else {
+			ret = legoev3_fiq_read_periodic(data->port_id, buf,
+							sensor->len, NULL);
+		}
+		if (ret < 0)
+			return ret;
+
+		if (chan->scan_type.storagebits == 16)
+			*val = get_unaligned_le16(&buf[chan->address]);
+		else
+			*val = buf[chan->address];
+
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SCALE:
+		if (chan->type == IIO_DISTANCE) {
+			/* cm, the ABI is in meters */
+			*val = 0;
+			*val2 = 10000;
+
+			return IIO_VAL_INT_PLUS_MICRO;
+		}
+		*val = 1;
+
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		*val = USEC_PER_SEC / data->period_us;
+		*val2 = div_u64((u64)(USEC_PER_SEC % data->period_us) *
+				USEC_PER_SEC, data->period_us);
+
+		return IIO_VAL_INT_PLUS_MICRO;
+	}
+
+	return -EINVAL;
+}
+
+static int legoev3_i2c_iio_write_raw(struct iio_dev *indio_dev,
+				     struct iio_chan_spec const *chan,
+				     int val, int val2, long mask)
+{
+	struct legoev3_i2c_iio *data = iio_priv(indio_dev);
+	u64 uhz;
+	int ret;
+
+	if (mask != IIO_CHAN_INFO_SAMP_FREQ)
+		return -EINVAL;
+	if (val < 0 || val2 < 0 || (!val && !val2))
+		return -EINVAL;
+
+	uhz = (u64)val * USEC_PER_SEC + val2;
+	ret = iio_device_claim_direct_mode(indio_dev);
+	if (ret)
+		return ret;
+	data->period_us = clamp_t(u64, div64_u64((u64)USEC_PER_SEC *
+						 USEC_PER_SEC, uhz),
+				  LEGOEV3_I2C_IIO_MIN_PERIOD_US,
+				  LEGOEV3_I2C_IIO_MAX_PERIOD_US);
+	iio_device_release_direct_mode(indio_dev);
+
+	return 0;
+}
+
+static const struct iio_info legoev3_i2c_iio_info = {
+	.read_raw	= legoev3_i2c_iio_read_raw,
+	.write_raw	= legoev3_i2c_iio_write_raw,
+};
+
+static int legoev3_i2c_iio_probe(struct i2c_client *client,
+				 const struct i2c_device_id *id)
+{
+	const struct legoev3_i2c_iio_sensor *sensor;
+	struct legoev3_i2c_iio *data;
+	struct iio_dev *indio_dev;
+	struct iio_buffer *buffer;
+	unsigned long *scan_mask;
+
+	sensor = legoev3_i2c_iio_identify(client);
+	if (!sensor)
+		return -ENODEV;
+
+	indio_dev = devm_iio_device_alloc(&client->dev, sizeof(*data));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	data = iio_priv(indio_dev);
+	data->client = client;
+	data->sensor = sensor;
+	data->port_id = legoev3_i2c_iio_port_id(client->adapter);
+	data->period_us = sensor->period_us;
+	if (data->port_id >= NUM_EV3_PORT_IN)
+		return -ENODEV;
+
+	/* the slot is always pushed as a whole, see the comment at the top */
+	scan_mask = devm_kcalloc(&client->dev, 2, sizeof(*scan_mask),
+				 GFP_KERNEL);
+	if (!scan_mask)
+		return -ENOMEM;
+	*scan_mask = GENMASK(sensor->num_channels - 2, 0);
+
+	indio_dev->dev.parent = &client->dev;
+	indio_dev->name = sensor->name;
+	indio_dev->info = &legoev3_i2c_iio_info;
+	indio_dev->channels = sensor->channels;
+	indio_dev->num_channels = sensor->num_channels;
+	indio_dev->available_scan_masks = scan_mask;
+	indio_dev->modes = INDIO_DIRECT_MODE | INDIO_BUFFER_SOFTWARE;
+	indio_dev->setup_ops = &legoev3_i2c_iio_buffer_ops;
+
+	buffer = devm_iio_kfifo_allocate(&client->dev);
+	if (!buffer)
+		return -ENOMEM;
+	iio_device_attach_buffer(indio_dev, buffer);
+
+	return devm_iio_device_register(&client->dev, indio_dev);
+}
+
+static const struct i2c_device_id legoev3_i2c_iio_id[] = {
+	{ "legoev3-i2c-iio", 0 },
+	{ }
+};
+MODULE_DEVICE_TABLE(i2c, legoev3_i2c_iio_id);
+
+static const unsigned short legoev3_i2c_iio_addrs[] = {
+	LEGOEV3_I2C_IIO_ADDR, I2C_CLIENT_END
+};
+
+static struct i2c_driver legoev3_i2c_iio_driver = {
+	.class		= I2C_CLASS_LEGOEV3,
+	.driver		= {
+		.name	= "legoev3-i2c-iio",
+	},
+	.probe		= legoev3_i2c_iio_probe,
+	.id_table	= legoev3_i2c_iio_id,
+	.detect		= legoev3_i2c_iio_detect,
+	.address_list	= legoev3_i2c_iio_addrs,
+};
+module_i2c_driver(legoev3_i2c_iio_driver);
+
+MODULE_DESCRIPTION("LEGO MINDSTORMS EV3 I2C sensor IIO driver");
+MODULE_LICENSE("GPL v2");
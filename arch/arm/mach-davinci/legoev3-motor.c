@@ -0,0 +1,950 @@
+/*
+ * Tacho motor regulation for the LEGO MINDSTORMS EV3 output ports
+ *
+ * One "legoev3-motor" device is registered per output port. The H-bridge of
+ * a port is driven by the pin1/pin2 direction GPIOs and a PWM output, and
+ * the motor tachometer on pin5/pin6 is counted by the FIQ (see
+ * legoev3_fiq_request_encoder()), 4 counts per quadrature cycle.
+ *
+ * All motors are regulated from one SCHED_FIFO thread paced by an absolute
+ * hrtimer sleep, every period_us microseconds (1 ms by default). The PWM
+ * drivers may sleep when a duty cycle is changed, so this can't be done from
+ * the hrtimer callback itself. On each tick the thread reads the positions,
+ * estimates the speeds over the last SPEED_WINDOW ticks and, depending on
+ * the mode of each motor:
+ *
+ *   off       coasts (both bridge inputs low)
+ *   brake     shorts the motor (both bridge inputs high)
+ *   duty      applies duty_cycle_sp (percent, negative for reverse)
+ *   speed     runs a PID loop on the speed error, towards speed_sp
+ *   position  does the same with a speed setpoint proportional to the
+ *             distance to position_sp, and holds it once there
+ *
+ * In the closed loop modes the speed setpoint is limited to max_speed and
+ * ramped, going from 0 to max_speed over ramp_ms. Speeds are in counts per
+ * second, kp/ki/kd are in 1/1000 permille of duty cycle per count/s, count
+ * and count/s per ms respectively.
+ *
+ * A motor is stalled when it has been driven with at least stall_duty
+ * percent for stall_ms without reaching stall_speed, and overloaded when
+ * the level of its pin 5 on the ADC (out<N>_pin5 io-channel of the parent
+ * "lego,ev3-ports" device, sampled every LOAD_SAMPLE_TICKS) has been above
+ * overcurrent_mv for overcurrent_ms. An overloaded motor is switched off
+ * and stays "overloaded" until a mode is written to it, by sysfs or by a
+ * queued command. Changes of either condition are reported through the
+ * pollable "state" attribute and a KOBJ_CHANGE uevent.
+ *
+ * Coordinated moves are queued on /dev/legoev3-motor with
+ * LEGOEV3_MOTOR_IOC_QUEUE: each command carries the setpoints of several
+ * ports and a time on the DaVinci free-running counter. The thread applies
+ * all setpoints of a command on the first tick at or after that time,
+ * before it updates any motor, so the ports switch within the same tick.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/gpio.h>
+#include <linux/hrtimer.h>
+#include <linux/iio/consumer.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/legoev3_motor.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/platform_device.h>
+#include <linux/platform_data/legoev3.h>
+#include <linux/pwm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/sched/types.h>
+
+#include <mach/legoev3-fiq.h>
+#include <mach/time.h>
+
+#define SPEED_WINDOW		16
+#define DUTY_MAX		1000	/* permille */
+#define LOAD_SAMPLE_TICKS	10
+
+/* speed setpoint in count/s per count of position error */
+#define POSITION_GAIN		8
+
+static unsigned int period_us = 1000;
+module_param(period_us, uint, 0444);
+MODULE_PARM_DESC(period_us, "Regulation period (us)");
+
+static int thread_prio = 90;
+module_param(thread_prio, int, 0444);
+MODULE_PARM_DESC(thread_prio, "SCHED_FIFO priority of the regulation thread");
+
+enum legoev3_motor_mode {
+	LEGOEV3_MOTOR_OFF	= LEGOEV3_MOTOR_MODE_OFF,
+	LEGOEV3_MOTOR_BRAKE	= LEGOEV3_MOTOR_MODE_BRAKE,
+	LEGOEV3_MOTOR_DUTY	= LEGOEV3_MOTOR_MODE_DUTY,
+	LEGOEV3_MOTOR_SPEED	= LEGOEV3_MOTOR_MODE_SPEED,
+	LEGOEV3_MOTOR_POSITION	= LEGOEV3_MOTOR_MODE_POSITION,
+	NUM_LEGOEV3_MOTOR_MODES
+};
+
+static const char *const legoev3_motor_mode_names[] = {
+	[LEGOEV3_MOTOR_OFF]		= "off",
+	[LEGOEV3_MOTOR_BRAKE]		= "brake",
+	[LEGOEV3_MOTOR_DUTY]		= "duty",
+	[LEGOEV3_MOTOR_SPEED]		= "speed",
+	[LEGOEV3_MOTOR_POSITION]	= "position",
+};
+
+enum legoev3_motor_state {
+	LEGOEV3_MOTOR_STATE_OK,
+	LEGOEV3_MOTOR_STATE_STALLED,
+	LEGOEV3_MOTOR_STATE_OVERLOADED,
+};
+
+static const char *const legoev3_motor_state_names[] = {
+	[LEGOEV3_MOTOR_STATE_OK]		= "ok",
+	[LEGOEV3_MOTOR_STATE_STALLED]		= "stalled",
+	[LEGOEV3_MOTOR_STATE_OVERLOADED]	= "overloaded",
+};
+
+struct legoev3_motor {
+	struct list_head list;
+	struct device *dev;
+	const struct ev3_output_port_platform_data *pdata;
+	struct pwm_device *pwm;
+	unsigned int pwm_period;
+	struct iio_channel *pin5;
+	struct work_struct notify_work;
+
+	/* setpoints, written from sysfs */
+	enum legoev3_motor_mode mode;
+	int duty_cycle_sp;
+	int speed_sp;
+	int position_sp;
+	int max_speed;
+	int ramp_ms;
+	int kp;
+	int ki;
+	int kd;
+	int stall_speed;
+	int stall_duty;
+	int stall_ms;
+	int overcurrent_mv;
+	int overcurrent_ms;
+
+	/* state of the regulation thread */
+	s32 position_offset;
+	s32 history[SPEED_WINDOW];
+	unsigned int history_idx;
+	int position;
+	int speed;
+	int speed_ref;
+	int prev_err;
+	s64 integral;
+	int duty_cycle;
+	enum legoev3_motor_mode applied_mode;
+	int applied_duty;
+	unsigned int stall_us;
+	unsigned int overcurrent_us;
+	unsigned int load_tick;
+	int pin5_mv;
+	enum legoev3_motor_state state;
+};
+
+/* protects everything below, the setpoints and the regulation of all motors */
+static DEFINE_MUTEX(legoev3_motor_lock);
+static LIST_HEAD(legoev3_motor_list);
+static struct legoev3_motor *legoev3_motors[NUM_EV3_PORT_OUT];
+static struct task_struct *legoev3_motor_task;
+
+/* ring of commands queued with LEGOEV3_MOTOR_IOC_QUEUE */
+static struct legoev3_motor_cmd legoev3_motor_cmds[LEGOEV3_MOTOR_QUEUE_LEN];
+static unsigned int legoev3_motor_cmd_head;
+static unsigned int legoev3_motor_cmd_count;
+
+static void legoev3_motor_reset_regulation(struct legoev3_motor *motor)
+{
+	motor->speed_ref = motor->speed;
+	motor->prev_err = 0;
+	motor->integral = 0;
+}
+
+static void legoev3_motor_set_mode(struct legoev3_motor *motor,
+				   enum legoev3_motor_mode mode)
+{
+	if (mode == motor->mode)
+		return;
+
+	legoev3_motor_reset_regulation(motor);
+	motor->mode = mode;
+}
+
+/* Returns the duty cycle, in permille, that brings the speed towards @target */
+static int legoev3_motor_regulate(struct legoev3_motor *motor, s64 target)
+{
+	int max_speed = motor->max_speed;
+	int step, err, deriv;
+	s64 out;
+
+	target = clamp_t(s64, target, -max_speed, max_speed);
+
+	if (motor->ramp_ms) {
+		step = div_u64((u64)max_speed * period_us,
+			       motor->ramp_ms * USEC_PER_MSEC);
+		step = max(step, 1);
+	} else {
+		step = max_speed;
+	}
+	if (target > motor->speed_ref)
+		motor->speed_ref = min_t(s64, motor->speed_ref + step, target);
+	else
+		motor->speed_ref = max_t(s64, motor->speed_ref - step, target);
+
+	err = motor->speed_ref - motor->speed;
+	deriv = (err - motor->prev_err) * (int)USEC_PER_MSEC / (int)period_us;
+	motor->prev_err = err;
+
+	out = (s64)motor->kp * err + (s64)motor->kd * deriv +
+	      div_s64((s64)motor->ki * motor->integral, USEC_PER_SEC);
+	out = div_s64(out, 1000);
+
+	/* don't wind up the integral while the output is saturated */
+	if (abs(out) < DUTY_MAX || (out < 0) != (err < 0))
+		motor->integral += (s64)err * period_us;
+
+	return clamp_t(s64, out, -DUTY_MAX, DUTY_MAX);
+}
+
+static void legoev3_motor_apply(struct legoev3_motor *motor,
+				enum legoev3_motor_mode mode, int duty)
+{
+	const struct ev3_output_port_platform_data *pdata = motor->pdata;
+
+	if (mode == motor->applied_mode && duty == motor->applied_duty)
+		return;
+
+	switch (mode) {
+	case LEGOEV3_MOTOR_OFF:
+		gpio_set_value(pdata->pin1_gpio, 0);
+		gpio_set_value(pdata->pin2_gpio, 0);
+		break;
+	case LEGOEV3_MOTOR_BRAKE:
+		gpio_set_value(pdata->pin1_gpio, 1);
+		gpio_set_value(pdata->pin2_gpio, 1);
+		break;
+	default:
+		gpio_set_value(pdata->pin1_gpio, duty >= 0);
+		gpio_set_value(pdata->pin2_gpio, duty < 0);
+		break;
+	}
+
+	pwm_config(motor->pwm, DIV_ROUND_CLOSEST_ULL((u64)abs(duty) *
+			motor->pwm_period, DUTY_MAX), motor->pwm_period);
+
+	motor->applied_mode = mode;
+	motor->applied_duty = duty;
+	motor->duty_cycle = duty;
+}
+
+static void legoev3_motor_notify_work(struct work_struct *work)
+{
+	struct legoev3_motor *motor = container_of(work, struct legoev3_motor,
+						   notify_work);
+	char state_env[32];
+	char *envp[] = { state_env, NULL };
+
+	snprintf(state_env, sizeof(state_env), "EV3_MOTOR_STATE=%s",
+		 legoev3_motor_state_names[READ_ONCE(motor->state)]);
+	sysfs_notify(&motor->dev->kobj, NULL, "state");
+	kobject_uevent_env(&motor->dev->kobj, KOBJ_CHANGE, envp);
+}
+
+static inline unsigned int legoev3_motor_add_us(unsigned int t,
+						unsigned int us)
+{
+	return min(t + us, UINT_MAX / 2);
+}
+
+/* Updates the stall and overload state after a tick driven with @duty */
+static void legoev3_motor_check_load(struct legoev3_motor *motor, int duty)
+{
+	enum legoev3_motor_state state = LEGOEV3_MOTOR_STATE_OK;
+
+	if (motor->stall_speed && duty &&
+	    abs(duty) >= motor->stall_duty * (DUTY_MAX / 100) &&
+	    abs(motor->speed) < motor->stall_speed)
+		motor->stall_us = legoev3_motor_add_us(motor->stall_us,
+						       period_us);
+	else
+		motor->stall_us = 0;
+
+	if (motor->pin5 && ++motor->load_tick >= LOAD_SAMPLE_TICKS) {
+		motor->load_tick = 0;
+		if (iio_read_channel_processed(motor->pin5,
+					       &motor->pin5_mv) < 0)
+			motor->pin5_mv = 0;
+		if (motor->overcurrent_mv &&
+		    motor->pin5_mv > motor->overcurrent_mv)
+			motor->overcurrent_us = legoev3_motor_add_us(
+					motor->overcurrent_us,
+					LOAD_SAMPLE_TICKS * period_us);
+		else
+			motor->overcurrent_us = 0;
+	}
+
+	/* latched, the zero duty of the stopped motor doesn't clear it */
+	if (motor->state == LEGOEV3_MOTOR_STATE_OVERLOADED)
+		return;
+
+	if (motor->overcurrent_mv &&
+	    motor->overcurrent_us >= motor->overcurrent_ms * USEC_PER_MSEC)
+		state = LEGOEV3_MOTOR_STATE_OVERLOADED;
+	else if (motor->stall_speed &&
+		 motor->stall_us >= motor->stall_ms * USEC_PER_MSEC)
+		state = LEGOEV3_MOTOR_STATE_STALLED;
+
+	if (state == motor->state)
+		return;
+
+	if (state == LEGOEV3_MOTOR_STATE_OVERLOADED) {
+		dev_warn(motor->dev, "overcurrent, switching the motor off\n");
+		legoev3_motor_set_mode(motor, LEGOEV3_MOTOR_OFF);
+		motor->overcurrent_us = 0;
+	}
+	WRITE_ONCE(motor->state, state);
+	schedule_work(&motor->notify_work);
+}
+
+/* Userspace gave the motor a new mode, which acknowledges an overload */
+static void legoev3_motor_clear_overload(struct legoev3_motor *motor)
+{
+	if (motor->state != LEGOEV3_MOTOR_STATE_OVERLOADED)
+		return;
+
+	motor->overcurrent_us = 0;
+	motor->stall_us = 0;
+	WRITE_ONCE(motor->state, LEGOEV3_MOTOR_STATE_OK);
+	schedule_work(&motor->notify_work);
+}
+
+static void legoev3_motor_step(struct legoev3_motor *motor)
+{
+	enum legoev3_motor_mode mode = motor->mode;
+	s32 raw, pos, old;
+	int duty = 0;
+
+	if (legoev3_fiq_read_encoder(motor->pdata->id, &raw, NULL, NULL))
+		return;
+
+	pos = raw - motor->position_offset;
+	old = motor->history[motor->history_idx];
+	motor->history[motor->history_idx] = pos;
+	motor->history_idx = (motor->history_idx + 1) % SPEED_WINDOW;
+	motor->speed = div_s64((s64)(pos - old) * USEC_PER_SEC,
+			       SPEED_WINDOW * period_us);
+	motor->position = pos;
+
+	switch (mode) {
+	case LEGOEV3_MOTOR_DUTY:
+		duty = motor->duty_cycle_sp * (DUTY_MAX / 100);
+		/* fall through */
+	case LEGOEV3_MOTOR_OFF:
+	case LEGOEV3_MOTOR_BRAKE:
+		legoev3_motor_reset_regulation(motor);
+		break;
+	case LEGOEV3_MOTOR_SPEED:
+		duty = legoev3_motor_regulate(motor, motor->speed_sp);
+		break;
+	case LEGOEV3_MOTOR_POSITION:
+		duty = legoev3_motor_regulate(motor, POSITION_GAIN *
+					((s64)motor->position_sp - pos));
+		break;
+	default:
+		break;
+	}
+
+	legoev3_motor_check_load(motor, duty);
+	if (motor->mode != mode) {
+		/* switched off for overcurrent */
+		mode = motor->mode;
+		duty = 0;
+	}
+
+	legoev3_motor_apply(motor, mode, duty);
+}
+
+static void legoev3_motor_run_cmd(const struct legoev3_motor_cmd *cmd)
+{
+	const struct legoev3_motor_setpoint *sp;
+	struct legoev3_motor *motor;
+	unsigned int i;
+
+	for (i = 0; i < cmd->num_setpoints; i++) {
+		sp = &cmd->setpoints[i];
+		motor = legoev3_motors[sp->port];
+		if (!motor)
+			continue;
+
+		switch (sp->mode) {
+		case LEGOEV3_MOTOR_DUTY:
+			motor->duty_cycle_sp = sp->value;
+			break;
+		case LEGOEV3_MOTOR_SPEED:
+			motor->speed_sp = sp->value;
+			break;
+		case LEGOEV3_MOTOR_POSITION:
+			motor->position_sp = sp->value;
+			break;
+		default:
+			break;
+		}
+		legoev3_motor_clear_overload(motor);
+		legoev3_motor_set_mode(motor, sp->mode);
+	}
+}
+
+/* Applies the queued commands that are due */
+static void legoev3_motor_run_queue(void)
+{
+	struct legoev3_motor_cmd *cmd;
+	u32 now;
+
+	if (!legoev3_motor_cmd_count)
+		return;
+
+	now = davinci_timer_read_freerun();
+	while (legoev3_motor_cmd_count) {
+		cmd = &legoev3_motor_cmds[legoev3_motor_cmd_head];
+		if ((s32)(now - cmd->time) < 0)
+			break;
+
+		legoev3_motor_run_cmd(cmd);
+		legoev3_motor_cmd_head = (legoev3_motor_cmd_head + 1) %
+					 LEGOEV3_MOTOR_QUEUE_LEN;
+		legoev3_motor_cmd_count--;
+	}
+}
+
+static int legoev3_motor_thread(void *data)
+{
+	ktime_t next = ktime_get();
+	struct legoev3_motor *motor;
+	ktime_t now;
+
+	while (!kthread_should_stop()) {
+		next = ktime_add_us(next, period_us);
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+
+		mutex_lock(&legoev3_motor_lock);
+		legoev3_motor_run_queue();
+		list_for_each_entry(motor, &legoev3_motor_list, list)
+			legoev3_motor_step(motor);
+		mutex_unlock(&legoev3_motor_lock);
+
+		/* after an overrun, restart from now rather than catching up */
+		now = ktime_get();
+		if (ktime_after(now, ktime_add_us(next, period_us)))
+			next = now;
+	}
+
+	return 0;
+}
+
+static int legoev3_motor_start_thread(void)
+{
+	struct sched_param param = { .sched_priority = thread_prio };
+	struct task_struct *task;
+
+	task = kthread_run(legoev3_motor_thread, NULL, "legoev3-motor");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	sched_setscheduler_nocheck(task, SCHED_FIFO, &param);
+	legoev3_motor_task = task;
+
+	return 0;
+}
+
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct legoev3_motor *motor = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n",
+		       legoev3_motor_mode_names[READ_ONCE(motor->mode)]);
+}
+
+static ssize_t mode_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct legoev3_motor *motor = dev_get_drvdata(dev);
+	int mode;
+
+	mode = sysfs_match_string(legoev3_motor_mode_names, buf);
+	if (mode < 0)
+		return mode;
+
+	mutex_lock(&legoev3_motor_lock);
+	legoev3_motor_clear_overload(motor);
+	legoev3_motor_set_mode(motor, mode);
+	mutex_unlock(&legoev3_motor_lock);
+
+	return count;
+}
+static DEVICE_ATTR_RW(mode);
+
+#define LEGOEV3_MOTOR_ATTR_RO(_name)					\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct legoev3_motor *motor = dev_get_drvdata(dev);		\
+									\
+	return sprintf(buf, "%d\n", READ_ONCE(motor->_name));		\
+}									\
+static DEVICE_ATTR_RO(_name)
+
+#define LEGOEV3_MOTOR_ATTR_RW(_name, _min, _max)			\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct legoev3_motor *motor = dev_get_drvdata(dev);		\
+									\
+	return sprintf(buf, "%d\n", READ_ONCE(motor->_name));		\
+}									\
+									\
+static ssize_t _name##_store(struct device *dev,			\
+			     struct device_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	struct legoev3_motor *motor = dev_get_drvdata(dev);		\
+	int val, ret;							\
+									\
+	ret = kstrtoint(buf, 0, &val);					\
+	if (ret)							\
+		return ret;						\
+	if (val < (_min) || val > (_max))				\
+		return -EINVAL;						\
+									\
+	mutex_lock(&legoev3_motor_lock);				\
+	motor->_name = val;						\
+	mutex_unlock(&legoev3_motor_lock);				\
+									\
+	return count;							\
+}									\
+static DEVICE_ATTR_RW(_name)
+
+LEGOEV3_MOTOR_ATTR_RW(duty_cycle_sp, -100, 100);
+LEGOEV3_MOTOR_ATTR_RW(speed_sp, INT_MIN, INT_MAX);
+LEGOEV3_MOTOR_ATTR_RW(position_sp, INT_MIN, INT_MAX);
+LEGOEV3_MOTOR_ATTR_RW(max_speed, 1, 1000000);
+LEGOEV3_MOTOR_ATTR_RW(ramp_ms, 0, 60000);
+LEGOEV3_MOTOR_ATTR_RW(kp, 0, 1000000);
+LEGOEV3_MOTOR_ATTR_RW(ki, 0, 1000000);
+LEGOEV3_MOTOR_ATTR_RW(kd, 0, 1000000);
+LEGOEV3_MOTOR_ATTR_RW(stall_speed, 0, 1000000);
+LEGOEV3_MOTOR_ATTR_RW(stall_duty, 0, 100);
+LEGOEV3_MOTOR_ATTR_RW(stall_ms, 0, 60000);
+LEGOEV3_MOTOR_ATTR_RW(overcurrent_mv, 0, 100000);
+LEGOEV3_MOTOR_ATTR_RW(overcurrent_ms, 0, 60000);
+LEGOEV3_MOTOR_ATTR_RO(speed);
+LEGOEV3_MOTOR_ATTR_RO(pin5_mv);
+
+static ssize_t state_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct legoev3_motor *motor = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n",
+		       legoev3_motor_state_names[READ_ONCE(motor->state)]);
+}
+static DEVICE_ATTR_RO(state);
+
+static ssize_t duty_cycle_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct legoev3_motor *motor = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n",
+		       READ_ONCE(motor->duty_cycle) / (DUTY_MAX / 100));
+}
+static DEVICE_ATTR_RO(duty_cycle);
+
+static ssize_t position_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct legoev3_motor *motor = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", READ_ONCE(motor->position));
+}
+
+/* Writing the position moves the origin, the motor doesn't move */
+static ssize_t position_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct legoev3_motor *motor = dev_get_drvdata(dev);
+	int val, ret, i;
+	s32 delta;
+
+	ret = kstrtoint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&legoev3_motor_lock);
+	delta = motor->position - val;
+	motor->position_offset += delta;
+	for (i = 0; i < SPEED_WINDOW; i++)
+		motor->history[i] -= delta;
+	motor->position = val;
+	mutex_unlock(&legoev3_motor_lock);
+
+	return count;
+}
+static DEVICE_ATTR_RW(position);
+
+static struct attribute *legoev3_motor_attrs[] = {
+	&dev_attr_mode.attr,
+	&dev_attr_duty_cycle_sp.attr,
+	&dev_attr_speed_sp.attr,
+	&dev_attr_position_sp.attr,
+	&dev_attr_max_speed.attr,
+	&dev_attr_ramp_ms.attr,
+	&dev_attr_kp.attr,
+	&dev_attr_ki.attr,
+	&dev_attr_kd.attr,
+	&dev_attr_stall_speed.attr,
+	&dev_attr_stall_duty.attr,
+	&dev_attr_stall_ms.attr,
+	&dev_attr_overcurrent_mv.attr,
+	&dev_attr_overcurrent_ms.attr,
+	&dev_attr_position.attr,
+	&dev_attr_speed.attr,
+	&dev_attr_duty_cycle.attr,
+	&dev_attr_pin5_mv.attr,
+	&dev_attr_state.attr,
+	NULL
+};
+
+static const struct attribute_group legoev3_motor_attr_group = {
+	.attrs = legoev3_motor_attrs,
+};
+
+static void legoev3_motor_release_channel(void *data)
+{
+	iio_channel_release(data);
+}
+
+static int legoev3_motor_probe(struct platform_device *pdev)
+{
+	const struct ev3_output_port_platform_data *pdata;
+	struct device *dev = &pdev->dev;
+	struct legoev3_motor *motor;
+	struct pwm_args args;
+	int ret;
+
+	pdata = dev_get_platdata(dev);
+	if (!pdata)
+		return -EINVAL;
+
+	motor = devm_kzalloc(dev, sizeof(*motor), GFP_KERNEL);
+	if (!motor)
+		return -ENOMEM;
+
+	motor->dev = dev;
+	motor->pdata = pdata;
+	motor->mode = LEGOEV3_MOTOR_OFF;
+	motor->applied_mode = NUM_LEGOEV3_MOTOR_MODES;
+	motor->max_speed = 1000;
+	motor->ramp_ms = 100;
+	motor->kp = 1000;
+	motor->ki = 2000;
+	motor->stall_duty = 60;
+	motor->stall_ms = 200;
+	motor->overcurrent_ms = 100;
+	INIT_WORK(&motor->notify_work, legoev3_motor_notify_work);
+
+	ret = devm_gpio_request_one(dev, pdata->pin1_gpio, GPIOF_OUT_INIT_LOW,
+				    dev_name(dev));
+	if (ret)
+		return ret;
+	ret = devm_gpio_request_one(dev, pdata->pin2_gpio, GPIOF_OUT_INIT_LOW,
+				    dev_name(dev));
+	if (ret)
+		return ret;
+	ret = devm_gpio_request_one(dev, pdata->pin5_int_gpio, GPIOF_IN,
+				    dev_name(dev));
+	if (ret)
+		return ret;
+	ret = devm_gpio_request_one(dev, pdata->pin6_dir_gpio, GPIOF_IN,
+				    dev_name(dev));
+	if (ret)
+		return ret;
+
+	motor->pwm = devm_pwm_get(dev, NULL);
+	if (IS_ERR(motor->pwm)) {
+		ret = PTR_ERR(motor->pwm);
+		if (ret != -EPROBE_DEFER)
+			dev_err(dev, "Failed to get PWM: %d\n", ret);
+		return ret;
+	}
+
+	/* current sensing is optional, it needs the ports device as parent */
+	if (dev->parent && dev->parent->of_node) {
+		char name[12];
+
+		snprintf(name, sizeof(name), "out%d_pin5", pdata->id + 1);
+		motor->pin5 = iio_channel_get(dev->parent, name);
+		if (IS_ERR(motor->pin5)) {
+			if (PTR_ERR(motor->pin5) == -EPROBE_DEFER)
+				return -EPROBE_DEFER;
+			motor->pin5 = NULL;
+		} else {
+			ret = devm_add_action_or_reset(dev,
+					legoev3_motor_release_channel,
+					motor->pin5);
+			if (ret)
+				return ret;
+		}
+	}
+
+	pwm_get_args(motor->pwm, &args);
+	motor->pwm_period = args.period;
+	ret = pwm_config(motor->pwm, 0, motor->pwm_period);
+	if (!ret)
+		ret = pwm_enable(motor->pwm);
+	if (ret)
+		return ret;
+
+	ret = legoev3_fiq_request_encoder(pdata->id, pdata->pin5_int_gpio,
+					  pdata->pin6_dir_gpio);
+	if (ret == -ENODEV)
+		ret = -EPROBE_DEFER;
+	if (ret)
+		goto err_disable_pwm;
+
+	platform_set_drvdata(pdev, motor);
+
+	ret = sysfs_create_group(&dev->kobj, &legoev3_motor_attr_group);
+	if (ret)
+		goto err_release_encoder;
+
+	mutex_lock(&legoev3_motor_lock);
+	if (!legoev3_motor_task)
+		ret = legoev3_motor_start_thread();
+	if (!ret) {
+		list_add_tail(&motor->list, &legoev3_motor_list);
+		legoev3_motors[pdata->id] = motor;
+	}
+	mutex_unlock(&legoev3_motor_lock);
+	if (ret)
+		goto err_remove_group;
+
+	return 0;
+
+err_remove_group:
+	sysfs_remove_group(&dev->kobj, &legoev3_motor_attr_group);
+err_release_encoder:
+	legoev3_fiq_release_encoder(pdata->id);
+err_disable_pwm:
+	pwm_disable(motor->pwm);
+
+	return ret;
+}
+
+static int legoev3_motor_remove(struct platform_device *pdev)
+{
+	struct legoev3_motor *motor = platform_get_drvdata(pdev);
+	struct task_struct *task = NULL;
+
+	mutex_lock(&legoev3_motor_lock);
+	list_del(&motor->list);
+	legoev3_motors[motor->pdata->id] = NULL;
+	if (list_empty(&legoev3_motor_list)) {
+		task = legoev3_motor_task;
+		legoev3_motor_task = NULL;
+	}
+	legoev3_motor_apply(motor, LEGOEV3_MOTOR_OFF, 0);
+	mutex_unlock(&legoev3_motor_lock);
+
+	if (task)
+		kthread_stop(task);
+	cancel_work_sync(&motor->notify_work);
+
+	sysfs_remove_group(&pdev->dev.kobj, &legoev3_motor_attr_group);
+	legoev3_fiq_release_encoder(motor->pdata->id);
+	pwm_disable(motor->pwm);
+
+	return 0;
+}
+
+static int legoev3_motor_check_cmd(const struct legoev3_motor_cmd *cmd)
+{
+	const struct legoev3_motor_setpoint *sp;
+	unsigned long ports = 0;
+	unsigned int i;
+
+	if (cmd->num_setpoints > LEGOEV3_MOTOR_NUM_PORTS)
+		return -EINVAL;
+
+	for (i = 0; i < cmd->num_setpoints; i++) {
+		sp = &cmd->setpoints[i];
+		if (sp->reserved || sp->port >= NUM_EV3_PORT_OUT ||
+		    sp->mode >= NUM_LEGOEV3_MOTOR_MODES)
+			return -EINVAL;
+		if (sp->mode == LEGOEV3_MOTOR_DUTY &&
+		    (sp->value < -100 || sp->value > 100))
+			return -EINVAL;
+		if (__test_and_set_bit(sp->port, &ports))
+			return -EINVAL;
+		if (!legoev3_motors[sp->port])
+			return -ENODEV;
+	}
+
+	return 0;
+}
+
+static long legoev3_motor_queue_cmds(struct legoev3_motor_queue *q)
+{
+	struct legoev3_motor_cmd __user *ucmd = u64_to_user_ptr(q->cmds);
+	struct legoev3_motor_cmd *cmds;
+	unsigned int i, tail;
+	long ret = 0;
+
+	if (q->flags & ~LEGOEV3_MOTOR_QUEUE_REPLACE)
+		return -EINVAL;
+	if (q->num_cmds > LEGOEV3_MOTOR_QUEUE_LEN)
+		return -E2BIG;
+
+	cmds = memdup_user(ucmd, q->num_cmds * sizeof(*cmds));
+	if (IS_ERR(cmds))
+		return PTR_ERR(cmds);
+
+	for (i = 1; i < q->num_cmds; i++) {
+		if ((s32)(cmds[i].time - cmds[i - 1].time) < 0) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	mutex_lock(&legoev3_motor_lock);
+	for (i = 0; i < q->num_cmds; i++) {
+		ret = legoev3_motor_check_cmd(&cmds[i]);
+		if (ret)
+			goto out_unlock;
+	}
+
+	if (q->flags & LEGOEV3_MOTOR_QUEUE_REPLACE)
+		legoev3_motor_cmd_count = 0;
+	if (legoev3_motor_cmd_count + q->num_cmds > LEGOEV3_MOTOR_QUEUE_LEN) {
+		ret = -EAGAIN;
+		goto out_unlock;
+	}
+
+	/*
+	 * The thread stops at the first command that is not due yet, so an
+	 * earlier one behind it would be held back.
+	 */
+	if (legoev3_motor_cmd_count && q->num_cmds) {
+		tail = (legoev3_motor_cmd_head + legoev3_motor_cmd_count - 1) %
+		       LEGOEV3_MOTOR_QUEUE_LEN;
+		if ((s32)(cmds[0].time - legoev3_motor_cmds[tail].time) < 0) {
+			ret = -EINVAL;
+			goto out_unlock;
+		}
+	}
+
+	for (i = 0; i < q->num_cmds; i++) {
+		tail = (legoev3_motor_cmd_head + legoev3_motor_cmd_count) %
+		       LEGOEV3_MOTOR_QUEUE_LEN;
+		legoev3_motor_cmds[tail] = cmds[i];
+		legoev3_motor_cmd_count++;
+	}
+out_unlock:
+	mutex_unlock(&legoev3_motor_lock);
+out:
+	kfree(cmds);
+
+	return ret;
+}
+
+static long legoev3_motor_ioctl(struct file *file, unsigned int cmd,
+				unsigned long arg)
+{
+	struct legoev3_motor_queue q;
+
+	switch (cmd) {
+	case LEGOEV3_MOTOR_IOC_QUEUE:
+		if (copy_from_user(&q, (void __user *)arg, sizeof(q)))
+			return -EFAULT;
+		return legoev3_motor_queue_cmds(&q);
+	case LEGOEV3_MOTOR_IOC_FLUSH:
+		mutex_lock(&legoev3_motor_lock);
+		legoev3_motor_cmd_count = 0;
+		mutex_unlock(&legoev3_motor_lock);
+		return 0;
+	}
+
+	return -ENOTTY;
+}
+
+static const struct file_operations legoev3_motor_fops = {
+	.owner		= THIS_MODULE,
+	.unlocked_ioctl	= legoev3_motor_ioctl,
+	.compat_ioctl	= legoev3_motor_ioctl,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice legoev3_motor_miscdev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "legoev3-motor",
+	.fops	= &legoev3_motor_fops,
+};
+
+static struct platform_driver legoev3_motor_driver = {
+	.probe	= legoev3_motor_probe,
+	.remove	= legoev3_motor_remove,
+	.driver	= {
+		.name	= "legoev3-motor",
+	},
+};
+
+static int __init legoev3_motor_init(void)
+{
+	int ret;
+
+	/* the regulation and the speed measurement divide by it */
+	if (!period_us) {
+		pr_err("legoev3-motor: period_us must not be 0\n");
+		return -EINVAL;
+	}
+
+	ret = platform_driver_register(&legoev3_motor_driver);
+	if (ret)
+		return ret;
+
+	ret = misc_register(&legoev3_motor_miscdev);
+	if (ret)
+		platform_driver_unregister(&legoev3_motor_driver);
+
+	return ret;
+}
+module_init(legoev3_motor_init);
+
+static void __exit legoev3_motor_exit(void)
+{
+	misc_deregister(&legoev3_motor_miscdev);
+	platform_driver_unregister(&legoev3_motor_driver);
+}
+module_exit(legoev3_motor_exit);
+
+MODULE_DESCRIPTION("LEGO MINDSTORMS EV3 tacho motor regulation");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("platform:legoev3-motor");
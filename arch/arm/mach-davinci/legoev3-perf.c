@@ -0,0 +1,265 @@
+/*
+ * Performance dashboard for the LEGO MINDSTORMS EV3
+ *
+ * The FIQ, EDMA, SPI, display, MMC and USB DMA drivers each keep their own
+ * counters. They register them here as sources, and every source gets a
+ * file in ev3/perf in debugfs that prints its counters when read and clears
+ * them when written to. On top of that:
+ *
+ *   snapshot  prints all sources one after the other, with the dashboard
+ *             locked so that no source is reset in between. The text is
+ *             produced at the first read(), later reads return the rest of
+ *             the same snapshot.
+ *   reset     clears all sources when written to, with the same timestamp,
+ *             so that the next snapshot covers the same interval everywhere.
+ *
+ * Each section starts with the name of the source and the time since it was
+ * last cleared, which is what rates like bytes/s or fps are computed over.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/legoev3_perf.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+
+/* protects the list, the files and the reset_ns of all sources */
+static DEFINE_MUTEX(legoev3_perf_mutex);
+static LIST_HEAD(legoev3_perf_sources);
+static struct dentry *legoev3_perf_dir;
+
+static void legoev3_perf_show_source(struct seq_file *s,
+				     struct legoev3_perf_source *src, u64 now)
+{
+	u64 interval_ns = now - src->reset_ns;
+
+	seq_printf(s, "[%s]\ninterval(ms): %llu\n", src->name,
+		   div_u64(interval_ns, NSEC_PER_MSEC));
+	src->show(s, src->data, interval_ns);
+}
+
+static void legoev3_perf_reset_source(struct legoev3_perf_source *src,
+				      u64 now)
+{
+	/* without a reset the counters run since registration */
+	if (!src->reset)
+		return;
+
+	src->reset(src->data);
+	src->reset_ns = now;
+}
+
+static int legoev3_perf_source_show(struct seq_file *s, void *v)
+{
+	struct legoev3_perf_source *src = s->private;
+
+	mutex_lock(&legoev3_perf_mutex);
+	legoev3_perf_show_source(s, src, ktime_get_ns());
+	mutex_unlock(&legoev3_perf_mutex);
+
+	return 0;
+}
+
+static int legoev3_perf_source_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, legoev3_perf_source_show, inode->i_private);
+}
+
+static ssize_t legoev3_perf_source_write(struct file *file,
+					 const char __user *buf, size_t count,
+					 loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+
+	mutex_lock(&legoev3_perf_mutex);
+	legoev3_perf_reset_source(s->private, ktime_get_ns());
+	mutex_unlock(&legoev3_perf_mutex);
+
+	return count;
+}
+
+static const struct file_operations legoev3_perf_source_fops = {
+	.owner		= THIS_MODULE,
+	.open		= legoev3_perf_source_open,
+	.read		= seq_read,
+	.write		= legoev3_perf_source_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int legoev3_perf_snapshot_show(struct seq_file *s, void *v)
+{
+	struct legoev3_perf_source *src;
+	u64 now;
+
+	mutex_lock(&legoev3_perf_mutex);
+	now = ktime_get_ns();
+	seq_printf(s, "timestamp(ns): %llu\n", now);
+	list_for_each_entry(src, &legoev3_perf_sources, node) {
+		seq_putc(s, '\n');
+		legoev3_perf_show_source(s, src, now);
+	}
+	mutex_unlock(&legoev3_perf_mutex);
+
+	return 0;
+}
+
+static int legoev3_perf_snapshot_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, legoev3_perf_snapshot_show, NULL);
+}
+
+static const struct file_operations legoev3_perf_snapshot_fops = {
+	.owner		= THIS_MODULE,
+	.open		= legoev3_perf_snapshot_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t legoev3_perf_reset_write(struct file *file,
+					const char __user *buf, size_t count,
+					loff_t *ppos)
+{
+	struct legoev3_perf_source *src;
+	u64 now;
+
+	mutex_lock(&legoev3_perf_mutex);
+	now = ktime_get_ns();
+	list_for_each_entry(src, &legoev3_perf_sources, node)
+		legoev3_perf_reset_source(src, now);
+	mutex_unlock(&legoev3_perf_mutex);
+
+	return count;
+}
+
+static const struct file_operations legoev3_perf_reset_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.write		= legoev3_perf_reset_write,
+	.llseek		= noop_llseek,
+};
+
+static void legoev3_perf_create_file(struct legoev3_perf_source *src)
+{
+	src->dentry = debugfs_create_file(src->name, src->reset ? 0644 : 0444,
+					  legoev3_perf_dir, src,
+					  &legoev3_perf_source_fops);
+}
+
+/**
+ * legoev3_perf_register - Add a source to the dashboard.
+ * @src: The source, with @name, @show and optionally @reset and @data set.
+ *	It must stay around until legoev3_perf_unregister() is called.
+ *
+ * The counters are taken to start now, drivers should register once they
+ * have cleared them. Sources can be registered before debugfs is up, their
+ * files are created later on.
+ *
+ * Returns 0 on success, -EINVAL if @show is missing or -EEXIST if there
+ * already is a source with the same name.
+ */
+int legoev3_perf_register(struct legoev3_perf_source *src)
+{
+	struct legoev3_perf_source *other;
+	int ret = 0;
+
+	/* so that unregistering after a failure does no harm */
+	INIT_LIST_HEAD(&src->node);
+	src->dentry = NULL;
+
+	if (WARN_ON(!src->show || !src->name[0]))
+		return -EINVAL;
+
+	mutex_lock(&legoev3_perf_mutex);
+
+	list_for_each_entry(other, &legoev3_perf_sources, node) {
+		if (!strcmp(other->name, src->name)) {
+			ret = -EEXIST;
+			goto out;
+		}
+	}
+
+	src->reset_ns = ktime_get_ns();
+	list_add_tail(&src->node, &legoev3_perf_sources);
+	if (legoev3_perf_dir)
+		legoev3_perf_create_file(src);
+
+out:
+	mutex_unlock(&legoev3_perf_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(legoev3_perf_register);
+
+/**
+ * legoev3_perf_unregister - Remove a source from the dashboard.
+ * @src: A source that was passed to legoev3_perf_register(), whether
+ *	that succeeded or not.
+ *
+ * Once this returns, @show and @reset are not called any more.
+ */
+void legoev3_perf_unregister(struct legoev3_perf_source *src)
+{
+	struct dentry *dentry;
+
+	mutex_lock(&legoev3_perf_mutex);
+	list_del_init(&src->node);
+	dentry = src->dentry;
+	src->dentry = NULL;
+	mutex_unlock(&legoev3_perf_mutex);
+
+	/* waits for readers of the file, which take the mutex */
+	debugfs_remove(dentry);
+}
+EXPORT_SYMBOL_GPL(legoev3_perf_unregister);
+
+static int __init legoev3_perf_init(void)
+{
+	struct legoev3_perf_source *src;
+	struct dentry *ev3;
+	int ret = 0;
+
+	mutex_lock(&legoev3_perf_mutex);
+
+	ev3 = debugfs_create_dir("ev3", NULL);
+	if (IS_ERR_OR_NULL(ev3)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	legoev3_perf_dir = debugfs_create_dir("perf", ev3);
+	if (IS_ERR_OR_NULL(legoev3_perf_dir)) {
+		legoev3_perf_dir = NULL;
+		debugfs_remove(ev3);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	debugfs_create_file("snapshot", 0444, legoev3_perf_dir, NULL,
+			    &legoev3_perf_snapshot_fops);
+	debugfs_create_file("reset", 0200, legoev3_perf_dir, NULL,
+			    &legoev3_perf_reset_fops);
+
+	/* the ones that were registered before debugfs was up */
+	list_for_each_entry(src, &legoev3_perf_sources, node)
+		legoev3_perf_create_file(src);
+
+out:
+	mutex_unlock(&legoev3_perf_mutex);
+
+	return ret;
+}
+/* debugfs itself is set up at core_initcall */
+postcore_initcall(legoev3_perf_init);
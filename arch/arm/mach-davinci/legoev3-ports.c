@@ -0,0 +1,388 @@
+/*
+ * Input port detection for LEGO MINDSTORMS EV3
+ *
+ * Each input port is sampled every poll_ms milliseconds: pin 1 and pin 6
+ * through the analog/digital converter, pin 2 and pin 5 as GPIOs. The ADC
+ * channels are read with iio_read_channel_processed(), so while the
+ * buffered ADC scan is running they are answered from the latest scan
+ * instead of causing conversions of their own.
+ *
+ * The samples are classified as follows, with the board pull-ups on pin 1
+ * and pin 2 and the pull-downs on pin 5 and pin 6:
+ *
+ *   pin 2 low                        EV3 UART sensor (pin 2 is its ground)
+ *   pin 5 high and pin 6 high        NXT I2C sensor (bus pull-ups)
+ *   pin 1 loaded or pin 6 not low    analog sensor
+ *   otherwise                        nothing connected
+ *
+ * A new classification has to be seen DEBOUNCE_POLLS times in a row
+ * before the port switches to it. Once a UART or I2C sensor is connected,
+ * pins 5 and 6 belong to its driver, so only pin 1 and pin 2 are watched
+ * for the port to go back to its idle levels.
+ *
+ * On a switch, the pin shared by the UART TXD and the I2C clock is muxed
+ * for the new mode, the input buffer is enabled for digital sensors and the
+ * I2C adapter of the port is created or removed. Both mux settings are
+ * resolved at probe time, so a switch is a single PINMUX register update,
+ * done only while the input buffer is disabled. The UART tty is always
+ * there: the mode and its name are reported in a KOBJ_CHANGE uevent so that
+ * userspace can attach the sensor line discipline, and in the inN_mode
+ * sysfs attributes of this device.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/device.h>
+#include <linux/gpio.h>
+#include <linux/iio/consumer.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/platform_data/legoev3.h>
+#include <linux/platform_data/legoev3_i2c.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include <mach/mux.h>
+
+/* ADC input levels, in mV */
+#define PIN1_NEAR_5V_MV		4800
+#define PIN6_NEAR_GND_MV	150
+#define PIN6_I2C_HIGH_MV	3000
+
+#define DEBOUNCE_POLLS		4
+
+static unsigned int poll_ms = 25;
+module_param(poll_ms, uint, 0644);
+MODULE_PARM_DESC(poll_ms, "Input port sampling period (ms)");
+
+enum legoev3_port_mode {
+	LEGOEV3_PORT_NONE,
+	LEGOEV3_PORT_ANALOG,
+	LEGOEV3_PORT_I2C,
+	LEGOEV3_PORT_UART,
+	LEGOEV3_PORT_ERROR,
+};
+
+static const char *const legoev3_port_mode_names[] = {
+	[LEGOEV3_PORT_NONE]	= "none",
+	[LEGOEV3_PORT_ANALOG]	= "analog",
+	[LEGOEV3_PORT_I2C]	= "i2c",
+	[LEGOEV3_PORT_UART]	= "uart",
+	[LEGOEV3_PORT_ERROR]	= "error",
+};
+
+struct legoev3_in_port {
+	const struct ev3_input_port_platform_data *pdata;
+	struct iio_channel *pin1;
+	struct iio_channel *pin6;
+	struct davinci_mux_state i2c_mux;
+	struct davinci_mux_state uart_mux;
+	enum legoev3_port_mode mode;
+	enum legoev3_port_mode candidate;
+	unsigned int count;
+};
+
+struct legoev3_ports {
+	struct device *dev;
+	struct delayed_work work;
+	struct legoev3_in_port in[NUM_EV3_PORT_IN];
+};
+
+static enum legoev3_port_mode
+legoev3_in_port_classify(struct legoev3_in_port *port)
+{
+	const struct ev3_input_port_platform_data *pdata = port->pdata;
+	int pin1, pin6, ret;
+	bool pin2;
+
+	ret = iio_read_channel_processed(port->pin1, &pin1);
+	if (ret < 0)
+		return port->mode;
+	pin2 = gpio_get_value(pdata->pin2_gpio);
+
+	switch (port->mode) {
+	case LEGOEV3_PORT_I2C:
+	case LEGOEV3_PORT_UART:
+	case LEGOEV3_PORT_ERROR:
+		if (pin1 > PIN1_NEAR_5V_MV && pin2)
+			return LEGOEV3_PORT_NONE;
+		return port->mode;
+	default:
+		break;
+	}
+
+	if (!pin2)
+		return LEGOEV3_PORT_UART;
+
+	ret = iio_read_channel_processed(port->pin6, &pin6);
+	if (ret < 0)
+		return port->mode;
+
+	if (gpio_get_value(pdata->pin5_gpio) && pin6 > PIN6_I2C_HIGH_MV)
+		return LEGOEV3_PORT_I2C;
+	if (pin1 < PIN1_NEAR_5V_MV || pin6 > PIN6_NEAR_GND_MV)
+		return LEGOEV3_PORT_ANALOG;
+
+	return LEGOEV3_PORT_NONE;
+}
+
+static void legoev3_in_port_notify(struct legoev3_ports *ports,
+				   struct legoev3_in_port *port)
+{
+	char port_env[16], mode_env[24], tty_env[32];
+	char *envp[] = { port_env, mode_env, NULL, NULL };
+	char attr[12];
+
+	snprintf(port_env, sizeof(port_env), "EV3_PORT=in%d",
+		 port->pdata->id + 1);
+	snprintf(mode_env, sizeof(mode_env), "EV3_PORT_MODE=%s",
+		 legoev3_port_mode_names[port->mode]);
+	if (port->mode == LEGOEV3_PORT_UART && port->pdata->uart_tty) {
+		snprintf(tty_env, sizeof(tty_env), "EV3_PORT_TTY=%s",
+			 port->pdata->uart_tty);
+		envp[2] = tty_env;
+	}
+
+	snprintf(attr, sizeof(attr), "in%d_mode", port->pdata->id + 1);
+	sysfs_notify(&ports->dev->kobj, NULL, attr);
+	kobject_uevent_env(&ports->dev->kobj, KOBJ_CHANGE, envp);
+}
+
+static void legoev3_in_port_set_mode(struct legoev3_ports *ports,
+				     struct legoev3_in_port *port,
+				     enum legoev3_port_mode mode)
+{
+	const struct ev3_input_port_platform_data *pdata = port->pdata;
+	int ret;
+
+	if (port->mode == LEGOEV3_PORT_I2C)
+		legoev3_unregister_in_port_i2c(pdata->id);
+
+	switch (mode) {
+	case LEGOEV3_PORT_I2C:
+		davinci_mux_state_apply(&port->i2c_mux);
+		/* the buffer enable is active low */
+		gpio_set_value(pdata->buf_ena_gpio, 0);
+		ret = legoev3_register_in_port_i2c(pdata->id);
+		if (ret) {
+			dev_err(ports->dev,
+				"in%d: creating the I2C adapter failed: %d\n",
+				pdata->id + 1, ret);
+			mode = LEGOEV3_PORT_ERROR;
+		}
+		break;
+	case LEGOEV3_PORT_UART:
+		davinci_mux_state_apply(&port->uart_mux);
+		gpio_set_value(pdata->buf_ena_gpio, 0);
+		break;
+	default:
+		gpio_set_value(pdata->buf_ena_gpio, 1);
+		davinci_mux_state_apply(&port->i2c_mux);
+		break;
+	}
+
+	WRITE_ONCE(port->mode, mode);
+	dev_dbg(ports->dev, "in%d: %s\n", pdata->id + 1,
+		legoev3_port_mode_names[mode]);
+	legoev3_in_port_notify(ports, port);
+}
+
+static void legoev3_ports_work(struct work_struct *work)
+{
+	struct legoev3_ports *ports = container_of(to_delayed_work(work),
+						   struct legoev3_ports, work);
+	enum legoev3_port_mode mode;
+	int i;
+
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		struct legoev3_in_port *port = &ports->in[i];
+
+		mode = legoev3_in_port_classify(port);
+		if (mode == port->mode) {
+			port->count = 0;
+			continue;
+		}
+		if (mode != port->candidate) {
+			port->candidate = mode;
+			port->count = 1;
+			continue;
+		}
+		if (++port->count < DEBOUNCE_POLLS)
+			continue;
+
+		port->count = 0;
+		legoev3_in_port_set_mode(ports, port, mode);
+	}
+
+	schedule_delayed_work(&ports->work,
+			      msecs_to_jiffies(max(READ_ONCE(poll_ms), 1U)));
+}
+
+static ssize_t legoev3_port_mode_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct dev_ext_attribute *ea = container_of(attr,
+						    struct dev_ext_attribute,
+						    attr);
+	struct legoev3_ports *ports = dev_get_drvdata(dev);
+	struct legoev3_in_port *port = &ports->in[(unsigned long)ea->var];
+
+	return sprintf(buf, "%s\n",
+		       legoev3_port_mode_names[READ_ONCE(port->mode)]);
+}
+
+#define LEGOEV3_PORT_MODE_ATTR(_n)					\
+	struct dev_ext_attribute dev_attr_in##_n##_mode = {		\
+		__ATTR(in##_n##_mode, 0444, legoev3_port_mode_show, NULL), \
+		(void *)(EV3_PORT_IN##_n)				\
+	}
+
+static LEGOEV3_PORT_MODE_ATTR(1);
+static LEGOEV3_PORT_MODE_ATTR(2);
+static LEGOEV3_PORT_MODE_ATTR(3);
+static LEGOEV3_PORT_MODE_ATTR(4);
+
+static struct attribute *legoev3_ports_attrs[] = {
+	&dev_attr_in1_mode.attr.attr,
+	&dev_attr_in2_mode.attr.attr,
+	&dev_attr_in3_mode.attr.attr,
+	&dev_attr_in4_mode.attr.attr,
+	NULL
+};
+
+static const struct attribute_group legoev3_ports_attr_group = {
+	.attrs = legoev3_ports_attrs,
+};
+
+static int
+legoev3_in_port_init(struct legoev3_ports *ports, struct legoev3_in_port *port,
+		     const struct ev3_input_port_platform_data *pdata)
+{
+	struct device *dev = ports->dev;
+	int n = pdata->id + 1;
+	char name[12];
+	int ret;
+
+	port->pdata = pdata;
+
+	snprintf(name, sizeof(name), "in%d_pin1", n);
+	port->pin1 = devm_iio_channel_get(dev, name);
+	if (IS_ERR(port->pin1))
+		return PTR_ERR(port->pin1);
+
+	snprintf(name, sizeof(name), "in%d_pin6", n);
+	port->pin6 = devm_iio_channel_get(dev, name);
+	if (IS_ERR(port->pin6))
+		return PTR_ERR(port->pin6);
+
+	ret = devm_gpio_request_one(dev, pdata->pin2_gpio, GPIOF_IN,
+				    devm_kasprintf(dev, GFP_KERNEL,
+						   "in%d_pin2", n));
+	if (ret)
+		return ret;
+
+	ret = devm_gpio_request_one(dev, pdata->pin5_gpio, GPIOF_IN,
+				    devm_kasprintf(dev, GFP_KERNEL,
+						   "in%d_pin5", n));
+	if (ret)
+		return ret;
+
+	ret = devm_gpio_request_one(dev, pdata->buf_ena_gpio,
+				    GPIOF_OUT_INIT_HIGH,
+				    devm_kasprintf(dev, GFP_KERNEL,
+						   "in%d_buf_ena", n));
+	if (ret)
+		return ret;
+
+	ret = davinci_mux_state_init(&port->i2c_mux, pdata->i2c_pin_mux);
+	if (ret)
+		return ret;
+
+	ret = davinci_mux_state_init(&port->uart_mux, pdata->uart_pin_mux);
+	if (ret)
+		return ret;
+
+	davinci_mux_state_apply(&port->i2c_mux);
+	port->mode = LEGOEV3_PORT_NONE;
+	port->candidate = LEGOEV3_PORT_NONE;
+
+	return 0;
+}
+
+static int legoev3_ports_probe(struct platform_device *pdev)
+{
+	const struct legoev3_ports_platform_data *pdata;
+	struct device *dev = &pdev->dev;
+	struct legoev3_ports *ports;
+	int i, ret;
+
+	pdata = dev_get_platdata(dev);
+	if (!pdata)
+		return -EINVAL;
+
+	ports = devm_kzalloc(dev, sizeof(*ports), GFP_KERNEL);
+	if (!ports)
+		return -ENOMEM;
+
+	ports->dev = dev;
+	INIT_DELAYED_WORK(&ports->work, legoev3_ports_work);
+
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		ret = legoev3_in_port_init(ports, &ports->in[i],
+					   &pdata->input_port_data[i]);
+		if (ret) {
+			if (ret != -EPROBE_DEFER)
+				dev_err(dev, "in%d: setup failed: %d\n",
+					i + 1, ret);
+			return ret;
+		}
+	}
+
+	platform_set_drvdata(pdev, ports);
+
+	ret = sysfs_create_group(&dev->kobj, &legoev3_ports_attr_group);
+	if (ret)
+		return ret;
+
+	schedule_delayed_work(&ports->work, 0);
+
+	return 0;
+}
+
+static int legoev3_ports_remove(struct platform_device *pdev)
+{
+	struct legoev3_ports *ports = platform_get_drvdata(pdev);
+	int i;
+
+	cancel_delayed_work_sync(&ports->work);
+	sysfs_remove_group(&pdev->dev.kobj, &legoev3_ports_attr_group);
+
+	for (i = 0; i < NUM_EV3_PORT_IN; i++)
+		if (ports->in[i].mode == LEGOEV3_PORT_I2C)
+			legoev3_unregister_in_port_i2c(ports->in[i].pdata->id);
+
+	return 0;
+}
+
+static const struct of_device_id legoev3_ports_of_match[] = {
+	{ .compatible = "lego,ev3-ports" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, legoev3_ports_of_match);
+
+static struct platform_driver legoev3_ports_driver = {
+	.probe	= legoev3_ports_probe,
+	.remove	= legoev3_ports_remove,
+	.driver	= {
+		.name		= "legoev3-ports",
+		.of_match_table	= legoev3_ports_of_match,
+	},
+};
+module_platform_driver(legoev3_ports_driver);
+
+MODULE_DESCRIPTION("LEGO MINDSTORMS EV3 input port detection");
+MODULE_LICENSE("GPL v2");
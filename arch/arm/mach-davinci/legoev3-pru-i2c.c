@@ -0,0 +1,476 @@
+/*
+ * PRU backend for I2C bus driver for LEGO MINDSTORMS EV3
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * The two PRUs of the PRUSS bit-bang the I2C buses of the input ports, two
+ * ports each, so the ARM only hands over the messages and no FIQ timer is
+ * needed. This implements the port functions of the FIQ backend: when a port
+ * is requested, it is tried here first and only falls back to the FIQ if the
+ * PRU firmware can't be booted.
+ *
+ * Each port has a mailbox in the data RAM of its PRU, see struct
+ * legoev3_pru_i2c_mbox, which is all of the interface to the firmware:
+ *
+ * - The ARM fills in the messages and the data to write, and then sets cmd
+ *   to PRU_I2C_CMD_XFER.
+ * - The firmware runs the transfer, stores the data read and the result,
+ *   sets cmd back to PRU_I2C_CMD_IDLE and then raises the PRU to ARM event.
+ *
+ * The mailboxes take the upper half of the data RAM, from
+ * PRU_I2C_MBOX_OFFSET on. The lower half is left to the firmware for its own
+ * variables and stack, its image must not have any segments in the upper
+ * half, which is checked after loading. Besides that, the firmware needs a
+ * (possibly empty) resource table for the remoteproc core.
+ */
+
+#include <linux/da8xx_pru_rproc.h>
+#include <linux/i2c.h>
+#include <linux/io.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/remoteproc.h>
+#include <linux/spinlock.h>
+
+#include <mach/legoev3-fiq.h>
+
+#include "legoev3-pru-i2c.h"
+
+static unsigned int half_period_us = 5;
+module_param(half_period_us, uint, 0444);
+MODULE_PARM_DESC(half_period_us,
+		 "Half of the I2C bit clock period at clock divider 1 (default 5, i.e. 100 kHz)");
+
+#define PRU_I2C_NUM_PRUS		2
+#define PRU_I2C_PORTS_PER_PRU		2
+
+#define PRU_I2C_CMD_IDLE		0
+#define PRU_I2C_CMD_XFER		1
+
+#define PRU_I2C_MSG_RD			BIT(0)
+
+#define PRU_I2C_MBOX_SIZE		128
+#define PRU_I2C_MBOX_OFFSET \
+	(DA8XX_PRU_RPROC_DRAM_SIZE - PRU_I2C_PORTS_PER_PRU * PRU_I2C_MBOX_SIZE)
+#define PRU_I2C_BUF_LEN			104
+
+/* Number of transactions that can be queued per port. Must be a power of 2. */
+#define PRU_I2C_QUEUE_LEN		4
+#define PRU_I2C_QUEUE_MASK		(PRU_I2C_QUEUE_LEN - 1)
+
+struct legoev3_pru_i2c_mbox_msg {
+	u8 addr;
+	u8 flags;
+	u8 len;
+	u8 offset;
+} __packed;
+
+/**
+ * struct legoev3_pru_i2c_mbox - shared with the PRU firmware
+ * @cmd: PRU_I2C_CMD_*, the side that is not the owner only reads it
+ * @result: 0 or a negative error code, set by the firmware
+ * @sda_gpio: GPIO number of the data line, bank * 16 + bit
+ * @scl_gpio: GPIO number of the clock line
+ * @num_msg: number of valid entries in @msgs
+ * @half_period_us: duration of one clock phase
+ * @stretch_timeout_us: how long a slave may stretch the clock, 0 to use the
+ *	fixed delays of the FIQ backend instead
+ * @msgs: the messages, their data is at @buf + offset
+ * @buf: the data of all messages
+ *
+ * PRU_I2C_PORTS_PER_PRU of these fill the data RAM of the PRU that handles
+ * the port from PRU_I2C_MBOX_OFFSET on, multi-byte fields are little endian.
+ */
+struct legoev3_pru_i2c_mbox {
+	u8 cmd;
+	s8 result;
+	u8 sda_gpio;
+	u8 scl_gpio;
+	u8 num_msg;
+	u8 half_period_us;
+	u16 stretch_timeout_us;
+	struct legoev3_pru_i2c_mbox_msg msgs[LEGOEV3_FIQ_I2C_MAX_MSGS];
+	u8 buf[PRU_I2C_BUF_LEN];
+} __packed;
+
+struct legoev3_pru_i2c_xfer {
+	struct i2c_msg *msgs;
+	unsigned num_msg;
+	void (*complete)(int, void *);
+	void *context;
+};
+
+/*
+ * queue_head is advanced by legoev3_pru_i2c_start_xfer() and queue_tail by
+ * the event handler, both with the xfer lock held. busy is set as long as
+ * the mailbox belongs to the firmware, stale if the transfer it is running
+ * has been cancelled.
+ */
+struct legoev3_pru_i2c_port {
+	struct legoev3_pru_i2c_mbox __iomem *mbox;
+	struct legoev3_pru_i2c_xfer queue[PRU_I2C_QUEUE_LEN];
+	unsigned queue_head;
+	unsigned queue_tail;
+	u8 half_period_us;
+	u16 stretch_timeout_us;
+	unsigned requested:1;
+	unsigned busy:1;
+	unsigned stale:1;
+};
+
+struct legoev3_pru_i2c_pru {
+	struct rproc *rproc;
+	unsigned int users;
+	unsigned int id;
+};
+
+static struct legoev3_pru_i2c_pru pru_data[PRU_I2C_NUM_PRUS] = {
+	{ .id = 0 },
+	{ .id = 1 },
+};
+static struct legoev3_pru_i2c_port port_data[NUM_EV3_PORT_IN];
+/* protects the rproc references and the requested flags */
+static DEFINE_MUTEX(legoev3_pru_i2c_lock);
+static DEFINE_SPINLOCK(legoev3_pru_i2c_xfer_lock);
+
+static inline struct legoev3_pru_i2c_pru *
+legoev3_pru_i2c_port_pru(enum legoev3_input_port_id port_id)
+{
+	return &pru_data[port_id / PRU_I2C_PORTS_PER_PRU];
+}
+
+/* call with the xfer lock held, the mailbox must be idle */
+static void legoev3_pru_i2c_kick(struct legoev3_pru_i2c_port *port)
+{
+	struct legoev3_pru_i2c_mbox __iomem *mbox = port->mbox;
+	struct legoev3_pru_i2c_xfer *xfer;
+	unsigned offset = 0;
+	int i;
+
+	xfer = &port->queue[port->queue_tail & PRU_I2C_QUEUE_MASK];
+	for (i = 0; i < xfer->num_msg; i++) {
+		struct i2c_msg *msg = &xfer->msgs[i];
+
+		writeb(msg->addr, &mbox->msgs[i].addr);
+		writeb(msg->flags & I2C_M_RD ? PRU_I2C_MSG_RD : 0,
+		       &mbox->msgs[i].flags);
+		writeb(msg->len, &mbox->msgs[i].len);
+		writeb(offset, &mbox->msgs[i].offset);
+		if (!(msg->flags & I2C_M_RD))
+			memcpy_toio(mbox->buf + offset, msg->buf, msg->len);
+		offset += msg->len;
+	}
+	writeb(xfer->num_msg, &mbox->num_msg);
+	writeb(port->half_period_us, &mbox->half_period_us);
+	writew(port->stretch_timeout_us, &mbox->stretch_timeout_us);
+
+	/* the firmware must see all of the above before cmd */
+	wmb();
+	writeb(PRU_I2C_CMD_XFER, &mbox->cmd);
+	port->busy = 1;
+}
+
+static void legoev3_pru_i2c_event(void *data)
+{
+	struct legoev3_pru_i2c_pru *pru = data;
+	struct legoev3_pru_i2c_port *port;
+	struct legoev3_pru_i2c_xfer *xfer;
+	void (*complete)(int, void *);
+	void *context;
+	unsigned long flags;
+	unsigned offset;
+	int result;
+	int i, j;
+
+	for (i = 0; i < PRU_I2C_PORTS_PER_PRU; i++) {
+		port = &port_data[pru->id * PRU_I2C_PORTS_PER_PRU + i];
+
+		spin_lock_irqsave(&legoev3_pru_i2c_xfer_lock, flags);
+		if (!port->busy ||
+		    readb(&port->mbox->cmd) != PRU_I2C_CMD_IDLE) {
+			spin_unlock_irqrestore(&legoev3_pru_i2c_xfer_lock,
+					       flags);
+			continue;
+		}
+		port->busy = 0;
+
+		if (port->stale) {
+			port->stale = 0;
+			if (port->queue_head != port->queue_tail)
+				legoev3_pru_i2c_kick(port);
+			spin_unlock_irqrestore(&legoev3_pru_i2c_xfer_lock,
+					       flags);
+			continue;
+		}
+
+		xfer = &port->queue[port->queue_tail & PRU_I2C_QUEUE_MASK];
+		result = (s8)readb(&port->mbox->result);
+		for (j = 0, offset = 0; !result && j < xfer->num_msg; j++) {
+			struct i2c_msg *msg = &xfer->msgs[j];
+
+			if (msg->flags & I2C_M_RD)
+				memcpy_fromio(msg->buf,
+					      port->mbox->buf + offset,
+					      msg->len);
+			offset += msg->len;
+		}
+		complete = xfer->complete;
+		context = xfer->context;
+		port->queue_tail++;
+
+		/* start the next one before completing so the bus stays busy */
+		if (port->queue_head != port->queue_tail)
+			legoev3_pru_i2c_kick(port);
+		spin_unlock_irqrestore(&legoev3_pru_i2c_xfer_lock, flags);
+
+		if (complete)
+			complete(result, context);
+	}
+}
+
+/* the loader wrote over the mailboxes if they are not all zero any more */
+static bool legoev3_pru_i2c_mbox_clean(void __iomem *mbox)
+{
+	int i;
+
+	for (i = 0; i < PRU_I2C_PORTS_PER_PRU * PRU_I2C_MBOX_SIZE; i++) {
+		if (readb(mbox + i))
+			return false;
+	}
+
+	return true;
+}
+
+static int legoev3_pru_i2c_get_pru(struct legoev3_pru_i2c_pru *pru)
+{
+	void __iomem *mbox;
+	struct rproc *rproc;
+	int ret, i;
+
+	if (pru->users++)
+		return 0;
+
+	rproc = da8xx_pru_rproc_get(pru->id);
+	if (!rproc) {
+		ret = -ENODEV;
+		goto err;
+	}
+
+	/* the firmware must find idle mailboxes when it starts */
+	mbox = da8xx_pru_rproc_dram(rproc) + PRU_I2C_MBOX_OFFSET;
+	memset_io(mbox, 0, PRU_I2C_PORTS_PER_PRU * PRU_I2C_MBOX_SIZE);
+	for (i = 0; i < PRU_I2C_PORTS_PER_PRU; i++) {
+		struct legoev3_pru_i2c_port *port =
+			&port_data[pru->id * PRU_I2C_PORTS_PER_PRU + i];
+
+		port->mbox = mbox + i * PRU_I2C_MBOX_SIZE;
+		port->busy = 0;
+		port->stale = 0;
+	}
+
+	da8xx_pru_rproc_set_event_handler(rproc, legoev3_pru_i2c_event, pru);
+
+	ret = rproc_boot(rproc);
+	if (ret) {
+		pr_info("legoev3-pru-i2c: PRU%u firmware not available (%d), using the FIQ\n",
+			pru->id, ret);
+		da8xx_pru_rproc_set_event_handler(rproc, NULL, NULL);
+		rproc_put(rproc);
+		ret = -ENODEV;
+		goto err;
+	}
+
+	/*
+	 * The firmware does not write to a mailbox before it gets a command,
+	 * so anything but zeroes there came from the image.
+	 */
+	if (!legoev3_pru_i2c_mbox_clean(mbox)) {
+		pr_err("legoev3-pru-i2c: PRU%u firmware overlaps the mailboxes at 0x%x, using the FIQ\n",
+		       pru->id, PRU_I2C_MBOX_OFFSET);
+		rproc_shutdown(rproc);
+		da8xx_pru_rproc_set_event_handler(rproc, NULL, NULL);
+		rproc_put(rproc);
+		ret = -ENODEV;
+		goto err;
+	}
+
+	pru->rproc = rproc;
+
+	return 0;
+
+err:
+	pru->users--;
+	return ret;
+}
+
+static void legoev3_pru_i2c_put_pru(struct legoev3_pru_i2c_pru *pru)
+{
+	if (--pru->users)
+		return;
+
+	rproc_shutdown(pru->rproc);
+	da8xx_pru_rproc_set_event_handler(pru->rproc, NULL, NULL);
+	rproc_put(pru->rproc);
+	pru->rproc = NULL;
+}
+
+bool legoev3_pru_i2c_owns_port(enum legoev3_input_port_id port_id)
+{
+	return port_id < NUM_EV3_PORT_IN && port_data[port_id].requested;
+}
+
+/*
+ * Unlike the FIQ backend, this may sleep because it boots the PRU firmware
+ * when the first port of a PRU is requested.
+ */
+int legoev3_pru_i2c_request_port(enum legoev3_input_port_id port_id,
+				 int sda_pin, int scl_pin)
+{
+	struct legoev3_pru_i2c_port *port;
+	int ret;
+
+	BUILD_BUG_ON(sizeof(struct legoev3_pru_i2c_mbox) != PRU_I2C_MBOX_SIZE);
+
+	if (port_id >= NUM_EV3_PORT_IN)
+		return -EINVAL;
+	if (sda_pin < 0 || sda_pin > U8_MAX || scl_pin < 0 || scl_pin > U8_MAX)
+		return -EINVAL;
+
+	mutex_lock(&legoev3_pru_i2c_lock);
+	port = &port_data[port_id];
+	if (port->requested) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	ret = legoev3_pru_i2c_get_pru(legoev3_pru_i2c_port_pru(port_id));
+	if (ret)
+		goto out;
+
+	spin_lock_irq(&legoev3_pru_i2c_xfer_lock);
+	port->queue_head = port->queue_tail = 0;
+	port->half_period_us = clamp(half_period_us, 1U, (unsigned)U8_MAX);
+	port->stretch_timeout_us = 0;
+	writeb(sda_pin, &port->mbox->sda_gpio);
+	writeb(scl_pin, &port->mbox->scl_gpio);
+	port->requested = 1;
+	spin_unlock_irq(&legoev3_pru_i2c_xfer_lock);
+
+out:
+	mutex_unlock(&legoev3_pru_i2c_lock);
+
+	return ret;
+}
+
+void legoev3_pru_i2c_release_port(enum legoev3_input_port_id port_id)
+{
+	struct legoev3_pru_i2c_port *port = &port_data[port_id];
+
+	mutex_lock(&legoev3_pru_i2c_lock);
+	if (port->requested) {
+		legoev3_pru_i2c_cancel_xfer(port_id);
+		port->requested = 0;
+		legoev3_pru_i2c_put_pru(legoev3_pru_i2c_port_pru(port_id));
+	}
+	mutex_unlock(&legoev3_pru_i2c_lock);
+}
+
+/*
+ * The firmware has no timer tick to divide, so the divider scales the
+ * half_period_us module parameter instead.
+ */
+int legoev3_pru_i2c_set_clock_div(enum legoev3_input_port_id port_id,
+				  unsigned clock_div)
+{
+	struct legoev3_pru_i2c_port *port = &port_data[port_id];
+	unsigned half_period = half_period_us * max(clock_div, 1U);
+
+	if (clock_div > U8_MAX || half_period > U8_MAX)
+		return -EINVAL;
+
+	spin_lock_irq(&legoev3_pru_i2c_xfer_lock);
+	port->half_period_us = half_period;
+	spin_unlock_irq(&legoev3_pru_i2c_xfer_lock);
+
+	return 0;
+}
+
+int legoev3_pru_i2c_set_clock_stretch(enum legoev3_input_port_id port_id,
+				      unsigned timeout_us)
+{
+	struct legoev3_pru_i2c_port *port = &port_data[port_id];
+
+	if (timeout_us > U16_MAX)
+		return -EINVAL;
+
+	spin_lock_irq(&legoev3_pru_i2c_xfer_lock);
+	port->stretch_timeout_us = timeout_us;
+	spin_unlock_irq(&legoev3_pru_i2c_xfer_lock);
+
+	return 0;
+}
+
+int legoev3_pru_i2c_start_xfer(enum legoev3_input_port_id port_id,
+			       struct i2c_msg msgs[], int num_msg,
+			       void (*complete)(int, void *), void *context)
+{
+	struct legoev3_pru_i2c_port *port = &port_data[port_id];
+	struct legoev3_pru_i2c_xfer *xfer;
+	unsigned long flags;
+	unsigned len = 0;
+	int ret = 0;
+	int i;
+
+	if (num_msg < 1 || num_msg > LEGOEV3_FIQ_I2C_MAX_MSGS)
+		return -EINVAL;
+	for (i = 0; i < num_msg; i++) {
+		/* the firmware only does fixed length messages */
+		if (msgs[i].flags & I2C_M_RECV_LEN)
+			return -EOPNOTSUPP;
+		len += msgs[i].len;
+	}
+	if (len > PRU_I2C_BUF_LEN)
+		return -EINVAL;
+
+	spin_lock_irqsave(&legoev3_pru_i2c_xfer_lock, flags);
+	if (port->queue_head - port->queue_tail >= PRU_I2C_QUEUE_LEN) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	/* the messages are only copied to the mailbox when they are started */
+	xfer = &port->queue[port->queue_head & PRU_I2C_QUEUE_MASK];
+	xfer->msgs = msgs;
+	xfer->num_msg = num_msg;
+	xfer->complete = complete;
+	xfer->context = context;
+	port->queue_head++;
+
+	if (!port->busy)
+		legoev3_pru_i2c_kick(port);
+
+out:
+	spin_unlock_irqrestore(&legoev3_pru_i2c_xfer_lock, flags);
+
+	return ret;
+}
+
+/*
+ * A transfer that the firmware has already started runs to its end, but its
+ * result is dropped.
+ */
+void legoev3_pru_i2c_cancel_xfer(enum legoev3_input_port_id port_id)
+{
+	struct legoev3_pru_i2c_port *port = &port_data[port_id];
+	unsigned long flags;
+
+	spin_lock_irqsave(&legoev3_pru_i2c_xfer_lock, flags);
+	port->queue_head = port->queue_tail = 0;
+	if (port->busy)
+		port->stale = 1;
+	spin_unlock_irqrestore(&legoev3_pru_i2c_xfer_lock, flags);
+}
@@ -0,0 +1,79 @@
+/*
+ * PRU backend for I2C bus driver for LEGO MINDSTORMS EV3
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __ARCH_ARM_MACH_DAVINCI_LEGOEV3_PRU_I2C_H
+#define __ARCH_ARM_MACH_DAVINCI_LEGOEV3_PRU_I2C_H
+
+#include <linux/i2c.h>
+#include <mach/legoev3.h>
+
+/*
+ * These back the legoev3_fiq_*() port functions of the same name for the
+ * ports that are owned by the PRU backend.
+ */
+#ifdef CONFIG_LEGOEV3_PRU_I2C
+bool legoev3_pru_i2c_owns_port(enum legoev3_input_port_id port_id);
+int legoev3_pru_i2c_request_port(enum legoev3_input_port_id port_id,
+				 int sda_pin, int scl_pin);
+void legoev3_pru_i2c_release_port(enum legoev3_input_port_id port_id);
+int legoev3_pru_i2c_set_clock_div(enum legoev3_input_port_id port_id,
+				  unsigned clock_div);
+int legoev3_pru_i2c_set_clock_stretch(enum legoev3_input_port_id port_id,
+				      unsigned timeout_us);
+int legoev3_pru_i2c_start_xfer(enum legoev3_input_port_id port_id,
+			       struct i2c_msg msgs[], int num_msg,
+			       void (*complete)(int, void *), void *context);
+void legoev3_pru_i2c_cancel_xfer(enum legoev3_input_port_id port_id);
+#else
+static inline bool
+legoev3_pru_i2c_owns_port(enum legoev3_input_port_id port_id)
+{
+	return false;
+}
+
+static inline int
+legoev3_pru_i2c_request_port(enum legoev3_input_port_id port_id,
+			     int sda_pin, int scl_pin)
+{
+	return -ENODEV;
+}
+
+static inline void
+legoev3_pru_i2c_release_port(enum legoev3_input_port_id port_id)
+{
+}
+
+static inline int
+legoev3_pru_i2c_set_clock_div(enum legoev3_input_port_id port_id,
+			      unsigned clock_div)
+{
+	return -ENODEV;
+}
+
+static inline int
+legoev3_pru_i2c_set_clock_stretch(enum legoev3_input_port_id port_id,
+				  unsigned timeout_us)
+{
+	return -ENODEV;
+}
+
+static inline int
+legoev3_pru_i2c_start_xfer(enum legoev3_input_port_id port_id,
+			   struct i2c_msg msgs[], int num_msg,
+			   void (*complete)(int, void *), void *context)
+{
+	return -ENODEV;
+}
+
+static inline void
+legoev3_pru_i2c_cancel_xfer(enum legoev3_input_port_id port_id)
+{
+}
+#endif
+
+#endif /* __ARCH_ARM_MACH_DAVINCI_LEGOEV3_PRU_I2C_H */
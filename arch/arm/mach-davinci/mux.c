@@ -26,13 +26,13 @@
 #include <mach/common.h>
 
 static void __iomem *pinmux_base;
+static DEFINE_SPINLOCK(mux_spin_lock);
 
 /*
  * Sets the DAVINCI MUX register based on the table
  */
 int davinci_cfg_reg(const unsigned long index)
 {
-	static DEFINE_SPINLOCK(mux_spin_lock);
 	struct davinci_soc_info *soc_info = &davinci_soc_info;
 	unsigned long flags;
 	const struct mux_config *cfg;
@@ -114,3 +114,67 @@ int davinci_cfg_reg_list(const short pins[])
 
 	return error;
 }
+
+/**
+ * davinci_mux_state_init - resolve a pin mux setting for later use
+ * @state: The state to fill in.
+ * @index: Index of the setting in the mux table of the SoC.
+ *
+ * Looks the setting up and maps the PINMUX registers once, so that it can
+ * then be applied by davinci_mux_state_apply() from any context.
+ *
+ * Returns 0 on success, a negative error code otherwise.
+ */
+int davinci_mux_state_init(struct davinci_mux_state *state,
+			   unsigned long index)
+{
+	struct davinci_soc_info *soc_info = &davinci_soc_info;
+	const struct mux_config *cfg;
+
+	if (WARN_ON(!soc_info->pinmux_pins))
+		return -ENODEV;
+
+	if (index >= soc_info->pinmux_pins_num ||
+	    !soc_info->pinmux_pins[index].name) {
+		pr_err("Invalid pin mux index: %lu\n", index);
+		return -ENODEV;
+	}
+
+	if (!pinmux_base) {
+		pinmux_base = ioremap(soc_info->pinmux_base, SZ_4K);
+		if (WARN_ON(!pinmux_base))
+			return -ENOMEM;
+	}
+
+	cfg = &soc_info->pinmux_pins[index];
+	state->reg = cfg->mux_reg;
+	state->mask = cfg->mask << cfg->mask_offset;
+	state->val = cfg->mode << cfg->mask_offset;
+
+	return 0;
+}
+EXPORT_SYMBOL(davinci_mux_state_init);
+
+/**
+ * davinci_mux_state_apply - apply a pin mux setting
+ * @state: A state filled in by davinci_mux_state_init().
+ *
+ * The register is only written if the pin is not already in that
+ * setting, so applying the current setting again does not touch the pin.
+ */
+void davinci_mux_state_apply(const struct davinci_mux_state *state)
+{
+	unsigned long flags;
+	u32 reg;
+
+	if (!state->mask)
+		return;
+
+	spin_lock_irqsave(&mux_spin_lock, flags);
+	reg = __raw_readl(pinmux_base + state->reg);
+	if ((reg & state->mask) != state->val)
+		__raw_writel((reg & ~state->mask) | state->val,
+			     pinmux_base + state->reg);
+	spin_unlock_irqrestore(&mux_spin_lock, flags);
+}
+EXPORT_SYMBOL(davinci_mux_state_apply);
@@ -38,12 +38,6 @@ static struct davinci_pm_config pm_config = {
 	.ddrpsc_num = DA8XX_LPSC1_EMIF3C,
 };
 
-static void davinci_sram_push(void *dest, void *src, unsigned int size)
-{
-	memcpy(dest, src, size);
-	flush_icache_range((unsigned long)dest, (unsigned long)(dest + size));
-}
-
 static void davinci_pm_suspend(void)
 {
 	unsigned val;
@@ -12,24 +12,84 @@
 #include <linux/init.h>
 #include <linux/pm_runtime.h>
 #include <linux/pm_clock.h>
+#include <linux/pm_domain.h>
 #include <linux/platform_device.h>
 
-static struct dev_pm_domain davinci_pm_domain = {
-	.ops = {
-		USE_PM_CLK_RUNTIME_OPS
-		USE_PLATFORM_PM_SLEEP_OPS
-	},
+static const char * const davinci_psc_con_ids[] = {
+	"fck", "master", "slave",
 };
 
-static struct pm_clk_notifier_block platform_bus_notifier = {
-	.pm_domain = &davinci_pm_domain,
-	.con_ids = { "fck", "master", "slave", NULL },
+/*
+ * The clocks of a device are gated when it is runtime suspended, which
+ * disables its LPSC module once no one else uses them. Disabled modules keep
+ * their register contents, so drivers don't need to restore anything beyond
+ * what their runtime PM callbacks already do.
+ */
+static int davinci_psc_attach_dev(struct generic_pm_domain *genpd,
+				  struct device *dev)
+{
+	int i, ret;
+
+	ret = pm_clk_create(dev);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < ARRAY_SIZE(davinci_psc_con_ids); i++)
+		pm_clk_add(dev, davinci_psc_con_ids[i]);
+
+	return 0;
+}
+
+static void davinci_psc_detach_dev(struct generic_pm_domain *genpd,
+				   struct device *dev)
+{
+	pm_clk_destroy(dev);
+}
+
+/*
+ * The LPSCs live in the always-on power domain, so the domain itself never
+ * turns off. The QoS governor keeps a device active when its resume latency
+ * constraint is shorter than the suspend and resume times genpd measured.
+ */
+static struct generic_pm_domain davinci_psc_domain = {
+	.name		= "davinci-psc",
+	.flags		= GENPD_FLAG_PM_CLK | GENPD_FLAG_ALWAYS_ON,
+	.attach_dev	= davinci_psc_attach_dev,
+	.detach_dev	= davinci_psc_detach_dev,
 };
 
-static int __init davinci_pm_runtime_init(void)
+static int davinci_psc_bus_notify(struct notifier_block *nb,
+				  unsigned long action, void *data)
 {
-	pm_clk_add_notifier(&platform_bus_type, &platform_bus_notifier);
+	struct device *dev = data;
+
+	switch (action) {
+	case BUS_NOTIFY_ADD_DEVICE:
+		if (!dev->pm_domain)
+			pm_genpd_add_device(&davinci_psc_domain, dev);
+		break;
+	case BUS_NOTIFY_DEL_DEVICE:
+		if (dev->pm_domain == &davinci_psc_domain.domain)
+			pm_genpd_remove_device(&davinci_psc_domain, dev);
+		break;
+	}
 
 	return 0;
 }
+
+static struct notifier_block platform_bus_notifier = {
+	.notifier_call = davinci_psc_bus_notify,
+};
+
+static int __init davinci_pm_runtime_init(void)
+{
+	int ret;
+
+	ret = pm_genpd_init(&davinci_psc_domain, &simple_qos_governor, false);
+	if (ret)
+		return ret;
+
+	return bus_register_notifier(&platform_bus_type,
+				     &platform_bus_notifier);
+}
 core_initcall(davinci_pm_runtime_init);
@@ -13,6 +13,9 @@
 #include <linux/io.h>
 #include <linux/genalloc.h>
 
+#include <asm/cacheflush.h>
+#include <asm/sram-text.h>
+
 #include <mach/common.h>
 #include "sram.h"
 
@@ -43,6 +46,27 @@ void sram_free(void *addr, size_t len)
 }
 EXPORT_SYMBOL(sram_free);
 
+/* Copies code into SRAM so that it can run while the DDR is unavailable. */
+void davinci_sram_push(void *dest, void *src, unsigned int size)
+{
+	memcpy(dest, src, size);
+	flush_icache_range((unsigned long)dest, (unsigned long)(dest + size));
+}
+
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+/*
+ * Copies .sram.text to the start of the shared RAM. Called from the SoC
+ * map_io code once the static mapping is up, so before anything could run
+ * the code there. The SRAM pool starts behind it.
+ */
+void __init davinci_sram_text_init(void)
+{
+	size_t size = __esram_text - __ssram_text;
+
+	davinci_sram_push(__ssram_text, __sram_text_load, size);
+	pr_info("SRAM: %zu bytes of kernel text at %p\n", size, __ssram_text);
+}
+#endif
 
 /*
  * REVISIT This supports CPU and DMA access to/from SRAM, but it
@@ -55,7 +79,7 @@ static int __init sram_init(void)
 	phys_addr_t phys = davinci_soc_info.sram_dma;
 	unsigned len = davinci_soc_info.sram_len;
 	int status = 0;
-	void __iomem *addr;
+	void *addr;
 
 	if (len) {
 		len = min_t(unsigned, len, SRAM_SIZE);
@@ -65,13 +89,19 @@ static int __init sram_init(void)
 	}
 
 	if (sram_pool) {
-		addr = ioremap(phys, len);
+		/*
+		 * A static mapping is present in every page table, so the pool
+		 * can be used from FIQ context, and may be cacheable.
+		 */
+		addr = davinci_soc_info.sram_virt;
+		if (!addr)
+			addr = (void __force *)ioremap(phys, len);
 		if (!addr)
 			return -ENOMEM;
 		status = gen_pool_add_virt(sram_pool, (unsigned long) addr,
 					   phys, len, -1);
-		if (status < 0)
-			iounmap(addr);
+		if (status < 0 && !davinci_soc_info.sram_virt)
+			iounmap((void __iomem __force *)addr);
 	}
 
 	WARN_ON(status < 0);
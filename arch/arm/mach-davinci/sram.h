@@ -23,6 +23,13 @@
  */
 extern void *sram_alloc(size_t len, dma_addr_t *dma);
 extern void sram_free(void *addr, size_t len);
+extern void davinci_sram_push(void *dest, void *src, unsigned int size);
+
+#ifdef CONFIG_DAVINCI_SRAM_TEXT
+extern void davinci_sram_text_init(void);
+#else
+static inline void davinci_sram_text_init(void) { }
+#endif
 
 /* Get the struct gen_pool * for use in platform data */
 extern struct gen_pool *sram_get_gen_pool(void);
@@ -23,6 +23,11 @@
 #include <linux/platform_device.h>
 #include <linux/sched_clock.h>
 #include <linux/export.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/math64.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
 
 #include <asm/mach/irq.h>
 #include <asm/fiq.h>
@@ -36,6 +41,7 @@
 
 static struct clock_event_device clockevent_davinci;
 static unsigned int davinci_clock_tick_rate;
+static unsigned int davinci_clockevent_rate;
 
 /*
  * This driver configures the 2 64-bit count-up timers as 4 independent
@@ -102,10 +108,14 @@ struct timer_s {
 	void __iomem *base;
 	unsigned long tim_off;
 	unsigned long prd_off;
+	unsigned long cmp_off;
 	unsigned long enamode_shift;
 	struct irqaction irqaction;
 };
 static struct timer_s timers[];
+#ifdef CONFIG_DAVINCI_LOOP_TIMER
+static struct timer_s looptimer;
+#endif
 
 /* values for 'opts' field of struct timer_s */
 #define TIMER_OPTS_DISABLED		0x01
@@ -121,26 +131,29 @@ static char *id_to_name[] = {
 	[T0_TOP]	= "timer0_1",
 	[T1_BOT]	= "timer1_0",
 	[T1_TOP]	= "timer1_1",
+	[T2_BOT]	= "timer2_0",
+	[T2_TOP]	= "timer2_1",
+	[T3_BOT]	= "timer3_0",
+	[T3_TOP]	= "timer3_1",
+};
+
+static const char *timer_clk_name[NUM_TIMER64] = {
+	"timer0", "timer1", "timer2", "timer3",
 };
 
 static int timer32_config(struct timer_s *t)
 {
 	u32 tcr;
-	struct davinci_soc_info *soc_info = &davinci_soc_info;
 
 	if (USING_COMPARE(t)) {
-		struct davinci_timer_instance *dtip =
-				soc_info->timer_info->timers;
-		int event_timer = ID_TO_TIMER(timers[TID_CLOCKEVENT].id);
-
 		/*
 		 * Next interrupt should be the current time reg value plus
 		 * the new period (using 32-bit unsigned addition/wrapping
-		 * to 0 on overflow).  This assumes that the clocksource
-		 * is setup to count to 2^32-1 before wrapping around to 0.
+		 * to 0 on overflow).  This assumes that the counter is set
+		 * up to count to 2^32-1 before wrapping around to 0.
 		 */
 		__raw_writel(__raw_readl(t->base + t->tim_off) + t->period,
-			t->base + dtip[event_timer].cmp_off);
+			t->base + t->cmp_off);
 	} else {
 		tcr = __raw_readl(t->base + TCR);
 
@@ -168,6 +181,26 @@ static inline u32 timer32_read(struct timer_s *t)
 	return __raw_readl(t->base + t->tim_off);
 }
 
+/*
+ * Lets a timer that is not shared with the clocksource count through all
+ * 32 bits, so that the clockevent can use its compare register instead of
+ * being stopped and restarted for every event.
+ */
+static void __init timer32_start_freerun(struct timer_s *t)
+{
+	u32 tcr;
+
+	tcr = __raw_readl(t->base + TCR);
+	tcr &= ~(TCR_ENAMODE_MASK << t->enamode_shift);
+	__raw_writel(tcr, t->base + TCR);
+
+	__raw_writel(0, t->base + t->tim_off);
+	__raw_writel(~0, t->base + t->prd_off);
+
+	tcr |= TCR_ENAMODE_PERIODIC << t->enamode_shift;
+	__raw_writel(tcr, t->base + TCR);
+}
+
 static irqreturn_t timer_interrupt(int irq, void *dev_id)
 {
 	struct clock_event_device *evt = &clockevent_davinci;
@@ -226,17 +259,67 @@ static struct timer_s timers[] = {
 	},
 };
 
+static void __init timer32_init_one(struct timer_s *t,
+				    void __iomem *base[NUM_TIMER64])
+{
+	struct davinci_timer_instance *dtip =
+		davinci_soc_info.timer_info->timers;
+	int timer = ID_TO_TIMER(t->id);
+	u32 irq;
+
+	t->base = base[timer];
+	if (!t->base)
+		return;
+
+	if (IS_TIMER_BOT(t->id)) {
+		t->enamode_shift = 6;
+		t->tim_off = TIM12;
+		t->prd_off = PRD12;
+		irq = dtip[timer].bottom_irq;
+	} else {
+		t->enamode_shift = 22;
+		t->tim_off = TIM34;
+		t->prd_off = PRD34;
+		irq = dtip[timer].top_irq;
+	}
+
+	/* Register interrupt */
+	t->irqaction.name = t->name;
+	t->irqaction.dev_id = (void *)t;
+
+	if (t->irqaction.handler != NULL) {
+		irq = USING_COMPARE(t) ? dtip[timer].cmp_irq : irq;
+		setup_irq(irq, &t->irqaction);
+	}
+}
+
 static void __init timer_init(void)
 {
 	struct davinci_soc_info *soc_info = &davinci_soc_info;
 	struct davinci_timer_instance *dtip = soc_info->timer_info->timers;
-	void __iomem *base[2];
+	void __iomem *base[NUM_TIMER64] = { };
+	bool used[NUM_TIMER64] = { };
 	int i;
 
+	/*
+	 * Timer64P0 and P1 are always set up. Any other timer is only touched
+	 * if it is used here, since it may belong to another driver.
+	 */
+	used[0] = used[1] = true;
+	for (i = 0; i < ARRAY_SIZE(timers); i++)
+		used[ID_TO_TIMER(timers[i].id)] = true;
+#ifdef CONFIG_DAVINCI_LOOP_TIMER
+	if (looptimer.id)
+		used[ID_TO_TIMER(looptimer.id)] = true;
+#endif
+
 	/* Global init of each 64-bit timer as a whole */
-	for(i=0; i<2; i++) {
+	for (i = 0; i < NUM_TIMER64; i++) {
 		u32 tgcr;
 
+		if (!used[i])
+			continue;
+
 		base[i] = ioremap(dtip[i].base, SZ_4K);
 		if (WARN_ON(!base[i]))
 			continue;
@@ -263,36 +346,12 @@ static void __init timer_init(void)
 	}
 
 	/* Init of each timer as a 32-bit timer */
-	for (i=0; i< ARRAY_SIZE(timers); i++) {
-		struct timer_s *t = &timers[i];
-		int timer = ID_TO_TIMER(t->id);
-		u32 irq;
-
-		t->base = base[timer];
-		if (!t->base)
-			continue;
-
-		if (IS_TIMER_BOT(t->id)) {
-			t->enamode_shift = 6;
-			t->tim_off = TIM12;
-			t->prd_off = PRD12;
-			irq = dtip[timer].bottom_irq;
-		} else {
-			t->enamode_shift = 22;
-			t->tim_off = TIM34;
-			t->prd_off = PRD34;
-			irq = dtip[timer].top_irq;
-		}
-
-		/* Register interrupt */
-		t->irqaction.name = t->name;
-		t->irqaction.dev_id = (void *)t;
-
-		if (t->irqaction.handler != NULL) {
-			irq = USING_COMPARE(t) ? dtip[i].cmp_irq : irq;
-			setup_irq(irq, &t->irqaction);
-		}
-	}
+	for (i=0; i< ARRAY_SIZE(timers); i++)
+		timer32_init_one(&timers[i], base);
+#ifdef CONFIG_DAVINCI_LOOP_TIMER
+	if (looptimer.id)
+		timer32_init_one(&looptimer, base);
+#endif
 }
 
 /*
@@ -320,6 +379,379 @@ static u64 notrace davinci_read_sched_clock(void)
 	return timer32_read(&timers[TID_CLOCKSOURCE]);
 }
 
+/*
+ * Direct counter access for the legoev3 FIQ. These only touch the
+ * timer registers, so they are safe to call from FIQ context.
+ */
+u32 notrace davinci_timer_read_freerun(void)
+{
+	return timer32_read(&timers[TID_CLOCKSOURCE]);
+}
+
+/* ticks since the last fiqsource interrupt was raised */
+u32 notrace davinci_timer_read_fiqsource(void)
+{
+	return timer32_read(&timers[TID_FIQSOURCE]);
+}
+
+unsigned int davinci_timer_get_tick_rate(void)
+{
+	return davinci_clock_tick_rate;
+}
+
+#ifdef CONFIG_DAVINCI_FREERUN_MMAP
+/*
+ * User space access to the free-running counter. The page only holds the
+ * registers of one timer and reading them has no side effects, so it is
+ * safe to hand out read-only.
+ */
+static phys_addr_t freerun_phys;
+
+static int freerun_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	return io_remap_pfn_range(vma, vma->vm_start,
+				  freerun_phys >> PAGE_SHIFT, PAGE_SIZE,
+				  vma->vm_page_prot);
+}
+
+static const struct file_operations freerun_fops = {
+	.owner	= THIS_MODULE,
+	.mmap	= freerun_mmap,
+};
+
+static ssize_t counter_offset_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", timers[TID_CLOCKSOURCE].tim_off);
+}
+static DEVICE_ATTR_RO(counter_offset);
+
+static ssize_t rate_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	return sprintf(buf, "%u\n", davinci_clock_tick_rate);
+}
+static DEVICE_ATTR_RO(rate);
+
+static struct attribute *freerun_attrs[] = {
+	&dev_attr_counter_offset.attr,
+	&dev_attr_rate.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(freerun);
+
+static struct miscdevice freerun_miscdev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "davinci-freerun",
+	.fops	= &freerun_fops,
+	.groups	= freerun_groups,
+};
+
+static int __init davinci_freerun_mmap_init(void)
+{
+	struct davinci_soc_info *soc_info = &davinci_soc_info;
+	struct timer_s *t = &timers[TID_CLOCKSOURCE];
+
+	if (!soc_info->timer_info || !t->base)
+		return -ENODEV;
+
+	freerun_phys = soc_info->timer_info->timers[ID_TO_TIMER(t->id)].base;
+
+	return misc_register(&freerun_miscdev);
+}
+device_initcall(davinci_freerun_mmap_init);
+#endif
+
+#ifdef CONFIG_DAVINCI_LOOP_TIMER
+/*
+ * Hardware period for a user space control loop. The timer runs in
+ * periodic mode, so the period is programmed once and every interrupt
+ * comes exactly one period after the previous one: there is no timer
+ * slack and nothing is reprogrammed per cycle. The interrupt only counts
+ * and wakes the reader, which is meant to be a SCHED_FIFO or
+ * SCHED_DEADLINE task with the same period.
+ *
+ * Writing a u64 period in nanoseconds starts the timer (0 stops it).
+ * Reading blocks until the next period and returns, as a u64, the number
+ * of periods that elapsed since the previous read, like a timerfd. Only
+ * one process may have the device open at a time.
+ *
+ * The other half of the 64-bit timer must not rewrite TCR at run time;
+ * on DA850 that is the compare-based clockevent.
+ *
+ * Instead of waking a task, the timer can also pace DMA: the timer event
+ * is an EDMA trigger on DA850 (Timer64P3 event out 34 is EDMA3_1 event 3).
+ * The interrupt is masked meanwhile, so there is no CPU time per period.
+ * Or a driver can have its own function called from the interrupt, e.g.
+ * to fire an IIO trigger.
+ */
+static unsigned int looptimer_rate;
+static atomic_t looptimer_ticks;
+static unsigned long looptimer_busy;
+static DEFINE_MUTEX(looptimer_lock);
+static DECLARE_WAIT_QUEUE_HEAD(looptimer_wait);
+static void (*looptimer_handler)(void *);
+static void *looptimer_handler_data;
+
+static irqreturn_t looptimer_interrupt(int irq, void *dev_id)
+{
+	if (looptimer_handler) {
+		looptimer_handler(looptimer_handler_data);
+		return IRQ_HANDLED;
+	}
+
+	atomic_inc(&looptimer_ticks);
+	wake_up(&looptimer_wait);
+	return IRQ_HANDLED;
+}
+
+static struct timer_s looptimer = {
+	.name      = "control loop timer",
+	.opts      = TIMER_OPTS_DISABLED,
+	.irqaction = {
+		.flags   = IRQF_TIMER,
+		.handler = looptimer_interrupt,
+	}
+};
+
+static void looptimer_start(u32 cycles)
+{
+	struct timer_s *t = &looptimer;
+
+	t->opts &= ~TIMER_OPTS_STATE_MASK;
+	if (cycles) {
+		t->period = cycles;
+		t->opts |= TIMER_OPTS_PERIODIC;
+	} else {
+		t->opts |= TIMER_OPTS_DISABLED;
+	}
+	atomic_set(&looptimer_ticks, 0);
+	timer32_config(t);
+}
+
+static int looptimer_open(struct inode *inode, struct file *file)
+{
+	if (test_and_set_bit(0, &looptimer_busy))
+		return -EBUSY;
+
+	return nonseekable_open(inode, file);
+}
+
+static int looptimer_release(struct inode *inode, struct file *file)
+{
+	mutex_lock(&looptimer_lock);
+	looptimer_start(0);
+	mutex_unlock(&looptimer_lock);
+	clear_bit(0, &looptimer_busy);
+
+	return 0;
+}
+
+static ssize_t looptimer_read(struct file *file, char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	u64 ticks;
+	int ret;
+
+	if (count < sizeof(ticks))
+		return -EINVAL;
+
+	if (!atomic_read(&looptimer_ticks)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(looptimer_wait,
+					       atomic_read(&looptimer_ticks));
+		if (ret)
+			return ret;
+	}
+
+	ticks = atomic_xchg(&looptimer_ticks, 0);
+	if (copy_to_user(buf, &ticks, sizeof(ticks)))
+		return -EFAULT;
+
+	return sizeof(ticks);
+}
+
+static ssize_t looptimer_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	u64 ns, cycles;
+
+	if (count != sizeof(ns))
+		return -EINVAL;
+	if (copy_from_user(&ns, buf, sizeof(ns)))
+		return -EFAULT;
+
+	cycles = mul_u64_u32_div(ns, looptimer_rate, NSEC_PER_SEC);
+	if (ns && (cycles < 2 || cycles > U32_MAX))
+		return -ERANGE;
+
+	mutex_lock(&looptimer_lock);
+	looptimer_start(cycles);
+	mutex_unlock(&looptimer_lock);
+
+	return sizeof(ns);
+}
+
+static unsigned int looptimer_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &looptimer_wait, wait);
+
+	return atomic_read(&looptimer_ticks) ? POLLIN | POLLRDNORM : 0;
+}
+
+/**
+ * davinci_looptimer_dma_request - Take the loop timer over to pace DMA.
+ *
+ * Fails with -ENODEV if there is no loop timer and with -EBUSY if the
+ * device is open. May sleep.
+ */
+int davinci_looptimer_dma_request(void)
+{
+	if (!looptimer.base || !looptimer_rate)
+		return -ENODEV;
+	if (test_and_set_bit(0, &looptimer_busy))
+		return -EBUSY;
+
+	disable_irq(looptimer.irqaction.irq);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(davinci_looptimer_dma_request);
+
+/**
+ * davinci_looptimer_dma_release - Give the loop timer back.
+ */
+void davinci_looptimer_dma_release(void)
+{
+	looptimer_start(0);
+	enable_irq(looptimer.irqaction.irq);
+	clear_bit(0, &looptimer_busy);
+}
+EXPORT_SYMBOL_GPL(davinci_looptimer_dma_release);
+
+/**
+ * davinci_looptimer_request_irq - Take the loop timer over for a driver.
+ * @handler: called in hard interrupt context on every period
+ * @data: argument for @handler
+ *
+ * Fails with -ENODEV if there is no loop timer and with -EBUSY if it is
+ * already in use.
+ */
+int davinci_looptimer_request_irq(void (*handler)(void *), void *data)
+{
+	if (!looptimer.base || !looptimer_rate)
+		return -ENODEV;
+	if (test_and_set_bit(0, &looptimer_busy))
+		return -EBUSY;
+
+	looptimer_handler_data = data;
+	WRITE_ONCE(looptimer_handler, handler);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(davinci_looptimer_request_irq);
+
+/**
+ * davinci_looptimer_free_irq - Give the loop timer back.
+ *
+ * Stops the timer and waits for a running handler to finish. May sleep.
+ */
+void davinci_looptimer_free_irq(void)
+{
+	looptimer_start(0);
+	synchronize_irq(looptimer.irqaction.irq);
+	WRITE_ONCE(looptimer_handler, NULL);
+	clear_bit(0, &looptimer_busy);
+}
+EXPORT_SYMBOL_GPL(davinci_looptimer_free_irq);
+
+/**
+ * davinci_looptimer_start - Run the loop timer at @hz periods per second.
+ * @hz: period rate
+ *
+ * May be called in atomic context, after davinci_looptimer_dma_request()
+ * or davinci_looptimer_request_irq().
+ */
+int davinci_looptimer_start(unsigned int hz)
+{
+	if (!hz || hz > looptimer_rate / 2)
+		return -ERANGE;
+
+	looptimer_start(DIV_ROUND_CLOSEST(looptimer_rate, hz));
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(davinci_looptimer_start);
+
+/**
+ * davinci_looptimer_stop - Stop the loop timer.
+ *
+ * May be called in atomic context.
+ */
+void davinci_looptimer_stop(void)
+{
+	looptimer_start(0);
+}
+EXPORT_SYMBOL_GPL(davinci_looptimer_stop);
+
+static const struct file_operations looptimer_fops = {
+	.owner		= THIS_MODULE,
+	.open		= looptimer_open,
+	.release	= looptimer_release,
+	.read		= looptimer_read,
+	.write		= looptimer_write,
+	.poll		= looptimer_poll,
+	.llseek		= no_llseek,
+};
+
+static ssize_t looptimer_rate_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", looptimer_rate);
+}
+static struct device_attribute dev_attr_looptimer_rate =
+	__ATTR(rate, 0444, looptimer_rate_show, NULL);
+
+static struct attribute *looptimer_attrs[] = {
+	&dev_attr_looptimer_rate.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(looptimer);
+
+static struct miscdevice looptimer_miscdev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "davinci-looptimer",
+	.fops	= &looptimer_fops,
+	.groups	= looptimer_groups,
+};
+
+static int __init davinci_looptimer_init(void)
+{
+	struct clk *clk;
+
+	if (!looptimer.base)
+		return -ENODEV;
+
+	/* timers without a clock of their own run from the one of timer 0 */
+	clk = clk_get(NULL, timer_clk_name[ID_TO_TIMER(looptimer.id)]);
+	if (IS_ERR(clk) || clk_prepare_enable(clk))
+		looptimer_rate = davinci_clock_tick_rate;
+	else
+		looptimer_rate = clk_get_rate(clk);
+
+	return misc_register(&looptimer_miscdev);
+}
+device_initcall(davinci_looptimer_init);
+#endif
+
 /*
  * clockevent
  */
@@ -327,6 +759,20 @@ static int davinci_set_next_event(unsigned long cycles,
 				  struct clock_event_device *evt)
 {
 	struct timer_s *t = &timers[TID_CLOCKEVENT];
+	u32 next;
+
+	if (USING_COMPARE(t)) {
+		/*
+		 * The counter keeps running, so this is a single register
+		 * write. The compare only fires on an exact match, so tell
+		 * the core if the counter has already gone past it.
+		 */
+		next = timer32_read(t) + cycles;
+		__raw_writel(next, t->base + t->cmp_off);
+		if ((s32)(timer32_read(t) - next) >= 0)
+			return -ETIME;
+		return 0;
+	}
 
 	t->period = cycles;
 	timer32_config(t);
@@ -355,7 +801,7 @@ static int davinci_set_periodic(struct clock_event_device *evt)
 {
 	struct timer_s *t = &timers[TID_CLOCKEVENT];
 
-	t->period = davinci_clock_tick_rate / (HZ);
+	t->period = davinci_clockevent_rate / (HZ);
 	t->opts &= ~TIMER_OPTS_STATE_MASK;
 	t->opts |= TIMER_OPTS_PERIODIC;
 	timer32_config(t);
@@ -379,7 +825,9 @@ void __init davinci_timer_init(void)
 	unsigned int clockevent_id;
 	unsigned int clocksource_id;
 	unsigned int fiqsource_id;
-
+	struct clk *event_clk;
+	struct davinci_timer_instance *dtip = soc_info->timer_info->timers;
+	int event_timer;
 	int i;
 
 	clockevent_id = soc_info->timer_info->clockevent_id;
@@ -389,6 +837,11 @@ void __init davinci_timer_init(void)
 	timers[TID_CLOCKEVENT].id = clockevent_id;
 	timers[TID_CLOCKSOURCE].id = clocksource_id;
 	timers[TID_FIQSOURCE].id = fiqsource_id;
+#ifdef CONFIG_DAVINCI_LOOP_TIMER
+	looptimer.id = soc_info->timer_info->looptimer_id;
+#endif
+
+	event_timer = ID_TO_TIMER(clockevent_id);
 
 	/*
 	 * If using same timer for both clock events & clocksource,
@@ -396,10 +849,6 @@ void __init davinci_timer_init(void)
 	 * This is equivalent to a oneshot timer only (not periodic).
 	 */
 	if (clockevent_id == clocksource_id) {
-		struct davinci_timer_instance *dtip =
-				soc_info->timer_info->timers;
-		int event_timer = ID_TO_TIMER(clockevent_id);
-
 		/* Only bottom timers can use compare regs */
 		if (IS_TIMER_TOP(clockevent_id))
 			pr_warn("%s: Invalid use of system timers.  Results unpredictable.\n",
@@ -412,7 +861,16 @@ void __init davinci_timer_init(void)
 			timers[TID_CLOCKEVENT].opts |= TIMER_OPTS_USE_COMPARE;
 			clockevent_davinci.features = CLOCK_EVT_FEAT_ONESHOT;
 		}
+	} else if (IS_TIMER_BOT(clockevent_id) && dtip[event_timer].cmp_off
+		   && dtip[event_timer].cmp_irq) {
+		/*
+		 * A timer of its own with a compare interrupt: let it run
+		 * free and program the compare register for each event.
+		 */
+		timers[TID_CLOCKEVENT].opts = TIMER_OPTS_USE_COMPARE;
+		clockevent_davinci.features = CLOCK_EVT_FEAT_ONESHOT;
 	}
+	timers[TID_CLOCKEVENT].cmp_off = dtip[event_timer].cmp_off;
 
 	timer_clk = clk_get(NULL, "timer0");
 	BUG_ON(IS_ERR(timer_clk));
@@ -422,6 +880,20 @@ void __init davinci_timer_init(void)
 	timer_init();
 
 	davinci_clock_tick_rate = clk_get_rate(timer_clk);
+	davinci_clockevent_rate = davinci_clock_tick_rate;
+
+	/*
+	 * The clockevent may be on a timer in another clock domain, e.g.
+	 * Timer64P2 and P3 on DA850. Timers without a clock of their own
+	 * share the one of timer 0.
+	 */
+	if (event_timer != 0) {
+		event_clk = clk_get(NULL, timer_clk_name[event_timer]);
+		if (!IS_ERR(event_clk)) {
+			clk_prepare_enable(event_clk);
+			davinci_clockevent_rate = clk_get_rate(event_clk);
+		}
+	}
 
 	/* setup clocksource */
 	clocksource_davinci.name = id_to_name[clocksource_id];
@@ -437,11 +909,19 @@ void __init davinci_timer_init(void)
 	clockevent_davinci.name = id_to_name[timers[TID_CLOCKEVENT].id];
 
 	clockevent_davinci.cpumask = cpumask_of(0);
+	if (USING_COMPARE(&timers[TID_CLOCKEVENT]) &&
+	    clockevent_id != clocksource_id)
+		timer32_start_freerun(&timers[TID_CLOCKEVENT]);
+
 	clockevents_config_and_register(&clockevent_davinci,
-					davinci_clock_tick_rate, 1, 0xfffffffe);
+					davinci_clockevent_rate, 1, 0xfffffffe);
 
 	for (i=0; i< ARRAY_SIZE(timers); i++)
 		timer32_config(&timers[i]);
+#ifdef CONFIG_DAVINCI_LOOP_TIMER
+	if (looptimer.base)
+		timer32_config(&looptimer);
+#endif
 }
 
 /* reset board using watchdog timer */
@@ -63,7 +63,9 @@ void v4wb_copy_user_highpage(struct page *to, struct page *from,
 /*
  * ARMv4 optimised clear_user_page
  *
- * Same story as above.
+ * Same story as above.  Each line is written with a single 8 register stm,
+ * so the write buffer gets one burst per line that it can pass on to memory
+ * as a whole, instead of two half line bursts.
  */
 void v4wb_clear_user_highpage(struct page *page, unsigned long vaddr)
 {
@@ -72,20 +74,22 @@ void v4wb_clear_user_highpage(struct page *page, unsigned long vaddr)
 	mov	r1, %2				@ 1\n\
 	mov	r2, #0				@ 1\n\
 	mov	r3, #0				@ 1\n\
+	mov	r4, #0				@ 1\n\
+	mov	r5, #0				@ 1\n\
+	mov	r6, #0				@ 1\n\
+	mov	r7, #0				@ 1\n\
 	mov	ip, #0				@ 1\n\
 	mov	lr, #0				@ 1\n\
 1:	mcr	p15, 0, %0, c7, c6, 1		@ 1   invalidate D line\n\
-	stmia	%0!, {r2, r3, ip, lr}		@ 4\n\
-	stmia	%0!, {r2, r3, ip, lr}		@ 4\n\
+	stmia	%0!, {r2-r7, ip, lr}		@ 8\n\
 	mcr	p15, 0, %0, c7, c6, 1		@ 1   invalidate D line\n\
-	stmia	%0!, {r2, r3, ip, lr}		@ 4\n\
-	stmia	%0!, {r2, r3, ip, lr}		@ 4\n\
+	stmia	%0!, {r2-r7, ip, lr}		@ 8\n\
 	subs	r1, r1, #1			@ 1\n\
 	bne	1b				@ 1\n\
 	mcr	p15, 0, r1, c7, c10, 4		@ 1   drain WB"
 	: "=r" (ptr)
 	: "0" (kaddr), "I" (PAGE_SIZE / 64)
-	: "r1", "r2", "r3", "ip", "lr");
+	: "r1", "r2", "r3", "r4", "r5", "r6", "r7", "ip", "lr", "cc");
 	kunmap_atomic(kaddr);
 }
 
@@ -18,6 +18,7 @@
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/if_vlan.h>
+#include <linux/log2.h>
 
 #include <asm/cacheflush.h>
 #include <asm/hwcap.h>
@@ -328,6 +329,9 @@ static inline void emit_mov_i(const u8 rd, u32 val, struct jit_ctx *ctx)
 
 	if (imm12 >= 0)
 		emit(ARM_MOV_I(rd, imm12), ctx);
+	else if ((imm12 = imm8m(~val)) >= 0)
+		/* masks such as 0xfffff000, without a literal pool load */
+		emit(ARM_MVN_I(rd, imm12), ctx);
 	else
 		emit_mov_i_no8m(rd, val, ctx);
 }
@@ -419,6 +423,26 @@ static inline void emit_udivmod(u8 rd, u8 rm, u8 rn, struct jit_ctx *ctx, u8 op)
 		emit(ARM_MOV_R(ARM_R0, tmp[1]), ctx);
 }
 
+/*
+ * Unsigned division and modulo by a power of two are a shift and a mask,
+ * which saves the helper call on cores without a divide instruction.
+ */
+static inline void emit_udivmod_pow2(u8 rd, u32 imm, struct jit_ctx *ctx,
+				     u8 op)
+{
+	const int shift = ilog2(imm);
+
+	if (op == BPF_DIV) {
+		if (shift)
+			emit(ARM_LSR_I(rd, rd, shift), ctx);
+	} else if (shift) {
+		emit(ARM_LSL_I(rd, rd, 32 - shift), ctx);
+		emit(ARM_LSR_I(rd, rd, 32 - shift), ctx);
+	} else {
+		emit(ARM_MOV_I(rd, 0), ctx);
+	}
+}
+
 /* Checks whether BPF register is on scratch stack space or not. */
 static inline bool is_on_stack(u8 bpf_reg)
 {
@@ -570,6 +594,102 @@ static inline void emit_a32_alu_r64(const bool is64, const u8 dst[],
 		emit_a32_mov_i(dst_hi, 0, dstk, ctx);
 }
 
+/*
+ * dst = dst (op) imm, using the immediate forms of the ARM data processing
+ * instructions instead of first building the sign extended imm in a register
+ * pair. Returns false if @imm can't be encoded for @op.
+ */
+static bool emit_a32_alu_k64(const bool is64, const u8 dst[], s32 imm,
+			     bool dstk, struct jit_ctx *ctx, u8 op)
+{
+	const u8 *tmp = bpf2a32[TMP_REG_1];
+	u8 rd = dstk ? tmp[1] : dst_lo;
+	u8 rm = dstk ? tmp[0] : dst_hi;
+	u32 inst_lo, inst_hi = 0;
+	bool neg = imm < 0;
+	int imm12;
+
+	/* x + -k == x - k, also for the 64 bit sign extended value */
+	if ((op == BPF_ADD || op == BPF_SUB) && neg) {
+		if (imm == S32_MIN)
+			return false;
+		op = op == BPF_ADD ? BPF_SUB : BPF_ADD;
+		imm = -imm;
+		neg = false;
+	}
+	imm12 = imm8m(imm);
+
+	switch (op) {
+	case BPF_ADD:
+		if (imm12 < 0)
+			return false;
+		if (is64) {
+			inst_lo = ARM_ADDS_I(rd, rd, imm12);
+			inst_hi = ARM_ADC_I(rm, rm, 0);
+		} else {
+			inst_lo = ARM_ADD_I(rd, rd, imm12);
+		}
+		break;
+	case BPF_SUB:
+		if (imm12 < 0)
+			return false;
+		if (is64) {
+			inst_lo = ARM_SUBS_I(rd, rd, imm12);
+			inst_hi = ARM_SBC_I(rm, rm, 0);
+		} else {
+			inst_lo = ARM_SUB_I(rd, rd, imm12);
+		}
+		break;
+	case BPF_AND:
+		if (imm12 >= 0)
+			inst_lo = ARM_AND_I(rd, rd, imm12);
+		else if ((imm12 = imm8m(~imm)) >= 0)
+			inst_lo = ARM_BIC_I(rd, rd, imm12);
+		else
+			return false;
+		if (is64 && !neg)
+			inst_hi = ARM_MOV_I(rm, 0);
+		break;
+	case BPF_OR:
+		if (imm12 < 0)
+			return false;
+		inst_lo = ARM_ORR_I(rd, rd, imm12);
+		if (is64 && neg)
+			inst_hi = ARM_MVN_I(rm, 0);
+		break;
+	case BPF_XOR:
+		if (imm12 < 0)
+			return false;
+		inst_lo = ARM_EOR_I(rd, rd, imm12);
+		if (is64 && neg)
+			inst_hi = ARM_MVN_R(rm, rm);
+		break;
+	default:
+		return false;
+	}
+
+	if (dstk) {
+		emit(ARM_LDR_I(rd, ARM_SP, STACK_VAR(dst_lo)), ctx);
+		if (inst_hi)
+			emit(ARM_LDR_I(rm, ARM_SP, STACK_VAR(dst_hi)), ctx);
+	}
+
+	emit(inst_lo, ctx);
+	if (inst_hi)
+		emit(inst_hi, ctx);
+
+	if (dstk) {
+		emit(ARM_STR_I(rd, ARM_SP, STACK_VAR(dst_lo)), ctx);
+		if (inst_hi)
+			emit(ARM_STR_I(rm, ARM_SP, STACK_VAR(dst_hi)), ctx);
+	}
+
+	if (!is64)
+		emit_a32_mov_i(dst_hi, 0, dstk, ctx);
+
+	return true;
+}
+
 /* dst = imm (4 bytes)*/
 static inline void emit_a32_mov_r(const u8 dst, const u8 src,
 				  bool dstk, bool sstk,
@@ -993,6 +1113,40 @@ static inline void emit_ar_r(const u8 rd, const u8 rt, const u8 rm,
 	}
 }
 
+/*
+ * The unsigned and bit test conditions can compare against an encodable,
+ * non-negative imm directly: its sign extended high word is zero.
+ */
+static inline bool is_jmp_imm8m(const u8 op, const s32 imm)
+{
+	if (imm < 0 || imm8m(imm) < 0)
+		return false;
+
+	switch (op) {
+	case BPF_JEQ:
+	case BPF_JNE:
+	case BPF_JGT:
+	case BPF_JGE:
+	case BPF_JLE:
+	case BPF_JLT:
+	case BPF_JSET:
+		return true;
+	}
+	return false;
+}
+
+static inline void emit_ar_i(const u8 rd, const u8 rt, const s32 imm,
+			     struct jit_ctx *ctx, u8 op)
+{
+	if (op == BPF_JSET) {
+		emit(ARM_TST_I(rt, imm8m(imm)), ctx);
+		return;
+	}
+
+	emit(ARM_CMP_I(rd, 0), ctx);
+	_emit(ARM_COND_EQ, ARM_CMP_I(rt, imm8m(imm)), ctx);
+}
+
 static int out_offset = -1; /* initialized on the first pass of build_body() */
 static int emit_bpf_tail_call(struct jit_ctx *ctx)
 {
@@ -1091,20 +1245,14 @@ static inline void emit_rev16(const u8 rd, const u8 rn, struct jit_ctx *ctx)
 static inline void emit_rev32(const u8 rd, const u8 rn, struct jit_ctx *ctx)
 {
 #if __LINUX_ARM_ARCH__ < 6
-	const u8 *tmp2 = bpf2a32[TMP_REG_2];
-
-	emit(ARM_AND_I(tmp2[1], rn, 0xff), ctx);
-	emit(ARM_MOV_SI(tmp2[0], rn, SRTYPE_LSR, 24), ctx);
-	emit(ARM_ORR_SI(ARM_IP, tmp2[0], tmp2[1], SRTYPE_LSL, 24), ctx);
-
-	emit(ARM_MOV_SI(tmp2[1], rn, SRTYPE_LSR, 8), ctx);
-	emit(ARM_AND_I(tmp2[1], tmp2[1], 0xff), ctx);
-	emit(ARM_MOV_SI(tmp2[0], rn, SRTYPE_LSR, 16), ctx);
-	emit(ARM_AND_I(tmp2[0], tmp2[0], 0xff), ctx);
-	emit(ARM_MOV_SI(tmp2[0], tmp2[0], SRTYPE_LSL, 8), ctx);
-	emit(ARM_ORR_SI(tmp2[0], tmp2[0], tmp2[1], SRTYPE_LSL, 16), ctx);
-	emit(ARM_ORR_R(rd, ARM_IP, tmp2[0]), ctx);
-
+	/*
+	 * ip = (rn ^ (rn ror 16)) & ~0x00ff0000
+	 * rd = (rn ror 8) ^ (ip >> 8)
+	 */
+	emit(ARM_EOR_SI(ARM_IP, rn, rn, SRTYPE_ROR, 16), ctx);
+	emit(ARM_BIC_I(ARM_IP, ARM_IP, imm8m(0x00ff0000)), ctx);
+	emit(ARM_MOV_SI(rd, rn, SRTYPE_ROR, 8), ctx);
+	emit(ARM_EOR_SI(rd, rd, ARM_IP, SRTYPE_LSR, 8), ctx);
 #else /* ARMv6+ */
 	emit(ARM_REV(rd, rn), ctx);
 #endif
@@ -1276,6 +1424,9 @@ static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
 					 ctx, BPF_OP(code));
 			break;
 		case BPF_K:
+			if (emit_a32_alu_k64(is64, dst, imm, dstk, ctx,
+					     BPF_OP(code)))
+				break;
 			/* Move immediate value to the temporary register
 			 * and then do the ALU operation on the temporary
 			 * register as this will sign-extend the immediate
@@ -1306,11 +1457,16 @@ static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
 				     ctx);
 			break;
 		case BPF_K:
+			if (is_power_of_2((u32)imm)) {
+				emit_udivmod_pow2(rd, imm, ctx, BPF_OP(code));
+				goto udivmod_done;
+			}
 			rt = tmp2[0];
 			emit_a32_mov_i(rt, imm, false, ctx);
 			break;
 		}
 		emit_udivmod(rd, rd, rt, ctx, BPF_OP(code));
+udivmod_done:
 		if (dstk)
 			emit(ARM_STR_I(rd, ARM_SP, STACK_VAR(dst_lo)), ctx);
 		emit_a32_mov_i(dst_hi, 0, dstk, ctx);
@@ -1419,8 +1575,8 @@ static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
 		case 16:
 			/* zero-extend 16 bits into 64 bits */
 #if __LINUX_ARM_ARCH__ < 6
-			emit_a32_mov_i(tmp2[1], 0xffff, false, ctx);
-			emit(ARM_AND_R(rt, rt, tmp2[1]), ctx);
+			emit(ARM_LSL_I(rt, rt, 16), ctx);
+			emit(ARM_LSR_I(rt, rt, 16), ctx);
 #else /* ARMv6+ */
 			emit(ARM_UXTH(rt, rt), ctx);
 #endif
@@ -1645,6 +1801,8 @@ static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
 			break;
 		rm = tmp2[0];
 		rn = tmp2[1];
+		if (is_jmp_imm8m(BPF_OP(code), imm))
+			goto go_jmp;
 		/* Sign-extend immediate value */
 		emit_a32_mov_i64(true, tmp2, imm, false, ctx);
 go_jmp:
@@ -1657,7 +1815,10 @@ static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
 		}
 
 		/* Check for the condition */
-		emit_ar_r(rd, rt, rm, rn, ctx, BPF_OP(code));
+		if (BPF_SRC(code) == BPF_K && is_jmp_imm8m(BPF_OP(code), imm))
+			emit_ar_i(rd, rt, imm, ctx, BPF_OP(code));
+		else
+			emit_ar_r(rd, rt, rm, rn, ctx, BPF_OP(code));
 
 		/* Setup JUMP instruction */
 		jmp_offset = bpf2a32_offset(i+off, i, ctx);
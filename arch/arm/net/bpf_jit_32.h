@@ -101,6 +101,9 @@
 
 #define ARM_INST_MUL		0x00000090
 
+#define ARM_INST_MVN_R		0x01e00000
+#define ARM_INST_MVN_I		0x03e00000
+
 #define ARM_INST_POP		0x08bd0000
 #define ARM_INST_PUSH		0x092d0000
 
@@ -182,6 +185,8 @@
 
 #define ARM_EOR_R(rd, rn, rm)	_AL3_R(ARM_INST_EOR, rd, rn, rm)
 #define ARM_EOR_I(rd, rn, imm)	_AL3_I(ARM_INST_EOR, rd, rn, imm)
+#define ARM_EOR_SI(rd, rn, rm, type, imm6)	\
+	(ARM_EOR_R(rd, rn, rm) | (type) << 5 | (imm6) << 7)
 
 #define ARM_LDR_I(rt, rn, off)	(ARM_INST_LDR_I | (rt) << 12 | (rn) << 16 \
 				 | ((off) & 0xfff))
@@ -223,6 +228,9 @@
 
 #define ARM_MUL(rd, rm, rn)	(ARM_INST_MUL | (rd) << 16 | (rm) << 8 | (rn))
 
+#define ARM_MVN_R(rd, rm)	_AL3_R(ARM_INST_MVN, rd, 0, rm)
+#define ARM_MVN_I(rd, imm)	_AL3_I(ARM_INST_MVN, rd, 0, imm)
+
 #define ARM_POP(regs)		(ARM_INST_POP | (regs))
 #define ARM_PUSH(regs)		(ARM_INST_PUSH | (regs))
 
@@ -1051,3 +1051,167 @@ void devm_free_percpu(struct device *dev, void __percpu *pdata)
 			       (void *)pdata));
 }
 EXPORT_SYMBOL_GPL(devm_free_percpu);
+
+#ifdef CONFIG_DEVRES_ACCOUNTING
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+
+/* Drivers listed separately; the rest is summed up in the last entry */
+#define DEVRES_USAGE_MAX	64
+#define DEVRES_REPORT_TOP	16
+
+struct devres_usage {
+	char		name[32];
+	size_t		bytes;
+	unsigned int	nodes;
+	unsigned int	devices;
+};
+
+static bool devres_report;
+
+static int __init devres_report_setup(char *str)
+{
+	devres_report = true;
+	return 1;
+}
+__setup("devres_report", devres_report_setup);
+
+/* Memory actually taken by a node, as allocated by kmalloc() */
+static size_t devres_node_size(struct devres_node *node)
+{
+	struct devres_group *grp = node_to_group(node);
+
+	if (grp)
+		return node == &grp->node[0] ? ksize(grp) : 0;
+
+	return ksize(container_of(node, struct devres, node));
+}
+
+static int devres_usage_cmp(const void *a, const void *b)
+{
+	const struct devres_usage *ua = a, *ub = b;
+
+	if (ua->bytes == ub->bytes)
+		return 0;
+	return ua->bytes < ub->bytes ? 1 : -1;
+}
+
+/*
+ * Sum up the devres of every device by the name of its driver (or bus or
+ * class, for devices without one) and sort the result, largest first.
+ * Memory a devres only refers to, like pages or DMA buffers, is not
+ * included.
+ */
+static int devres_usage_collect(struct devres_usage *usage)
+{
+	struct kobject *k;
+	int i, n = 0;
+
+	spin_lock(&devices_kset->list_lock);
+	list_for_each_entry(k, &devices_kset->list, entry) {
+		struct device *dev = kobj_to_dev(k);
+		const char *name = dev_driver_string(dev);
+		struct devres_node *node;
+		unsigned int nodes = 0;
+		unsigned long flags;
+		size_t bytes = 0;
+
+		spin_lock_irqsave(&dev->devres_lock, flags);
+		list_for_each_entry(node, &dev->devres_head, entry) {
+			bytes += devres_node_size(node);
+			nodes++;
+		}
+		spin_unlock_irqrestore(&dev->devres_lock, flags);
+
+		if (!nodes)
+			continue;
+
+		for (i = 0; i < n; i++)
+			if (!strncmp(usage[i].name, name,
+				     sizeof(usage[i].name) - 1))
+				break;
+		if (i == n) {
+			if (n == DEVRES_USAGE_MAX - 1)
+				name = "(others)";
+			if (n == DEVRES_USAGE_MAX)
+				i = n - 1;
+			else
+				strlcpy(usage[n++].name, name,
+					sizeof(usage[i].name));
+		}
+
+		usage[i].bytes += bytes;
+		usage[i].nodes += nodes;
+		usage[i].devices++;
+	}
+	spin_unlock(&devices_kset->list_lock);
+
+	sort(usage, n, sizeof(*usage), devres_usage_cmp, NULL);
+
+	return n;
+}
+
+static int devres_usage_show(struct seq_file *s, void *unused)
+{
+	struct devres_usage *usage;
+	int i, n;
+
+	usage = kcalloc(DEVRES_USAGE_MAX, sizeof(*usage), GFP_KERNEL);
+	if (!usage)
+		return -ENOMEM;
+
+	n = devres_usage_collect(usage);
+	seq_puts(s, "driver                            bytes  nodes devices\n");
+	for (i = 0; i < n; i++)
+		seq_printf(s, "%-31s %8zu %6u %7u\n", usage[i].name,
+			   usage[i].bytes, usage[i].nodes, usage[i].devices);
+
+	kfree(usage);
+	return 0;
+}
+
+static int devres_usage_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, devres_usage_show, NULL);
+}
+
+static const struct file_operations devres_usage_fops = {
+	.open		= devres_usage_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init devres_usage_init(void)
+{
+	struct devres_usage *usage;
+	size_t total = 0;
+	int i, n;
+
+	debugfs_create_file("devres_usage", 0400, NULL, NULL,
+			    &devres_usage_fops);
+
+	if (!devres_report)
+		return 0;
+
+	usage = kcalloc(DEVRES_USAGE_MAX, sizeof(*usage), GFP_KERNEL);
+	if (!usage)
+		return -ENOMEM;
+
+	n = devres_usage_collect(usage);
+	for (i = 0; i < n; i++)
+		total += usage[i].bytes;
+
+	pr_info("devres: %zu bytes managed for %d drivers, largest:\n",
+		total, n);
+	for (i = 0; i < min(n, DEVRES_REPORT_TOP); i++)
+		pr_info("devres: %-31s %8zu bytes, %u devices\n",
+			usage[i].name, usage[i].bytes, usage[i].devices);
+
+	kfree(usage);
+	return 0;
+}
+/* after the deferred probes of late_initcall() */
+late_initcall_sync(devres_usage_init);
+#endif /* CONFIG_DEVRES_ACCOUNTING */
@@ -666,6 +666,40 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+static ssize_t hc_threshold_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(zram->hc_threshold));
+}
+
+static ssize_t hc_threshold_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int threshold;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &threshold);
+	if (ret)
+		return ret;
+
+	if (threshold >= PAGE_SIZE)
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change hc_threshold for initialized device\n");
+		return -EBUSY;
+	}
+
+	zram->hc_threshold = threshold;
+	up_write(&zram->init_lock);
+	return len;
+}
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -738,15 +772,16 @@ static ssize_t mm_stat_show(struct device *dev,
 static ssize_t debug_stat_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
-	int version = 1;
+	int version = 2;
 	struct zram *zram = dev_to_zram(dev);
 	ssize_t ret;
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-			"version: %d\n%8llu\n",
+			"version: %d\n%8llu %8llu\n",
 			version,
-			(u64)atomic64_read(&zram->stats.writestall));
+			(u64)atomic64_read(&zram->stats.writestall),
+			(u64)atomic64_read(&zram->stats.hc_pages));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -973,6 +1008,25 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 		return ret;
 	}
 
+	/*
+	 * Poorly compressing pages end up in the large, sparsely packed
+	 * size classes.  Give lz4hc a try on those, it spends more CPU
+	 * but often moves the page down to a smaller class.
+	 */
+	if (zram->hc_comp && comp_len > zram->hc_threshold) {
+		struct zcomp_strm *hstrm = zcomp_stream_get(zram->hc_comp);
+		unsigned int hc_len;
+
+		src = kmap_atomic(page);
+		if (!zcomp_compress(hstrm, src, &hc_len) && hc_len < comp_len) {
+			memcpy(zstrm->buffer, hstrm->buffer, hc_len);
+			comp_len = hc_len;
+			atomic64_inc(&zram->stats.hc_pages);
+		}
+		kunmap_atomic(src);
+		zcomp_stream_put(zram->hc_comp);
+	}
+
 	if (unlikely(comp_len > max_zpage_size)) {
 		if (zram_wb_enabled(zram) && allow_wb) {
 			zcomp_stream_put(zram->comp);
@@ -1310,7 +1364,7 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 
 static void zram_reset_device(struct zram *zram)
 {
-	struct zcomp *comp;
+	struct zcomp *comp, *hc_comp;
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -1323,6 +1377,8 @@ static void zram_reset_device(struct zram *zram)
 	}
 
 	comp = zram->comp;
+	hc_comp = zram->hc_comp;
+	zram->hc_comp = NULL;
 	disksize = zram->disksize;
 	zram->disksize = 0;
 
@@ -1334,6 +1390,8 @@ static void zram_reset_device(struct zram *zram)
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
+	if (hc_comp)
+		zcomp_destroy(hc_comp);
 	reset_bdev(zram);
 }
 
@@ -1371,6 +1429,15 @@ static ssize_t disksize_store(struct device *dev,
 	}
 
 	zram->comp = comp;
+
+	if (zram->hc_threshold && !strcmp(zram->compressor, "lz4")) {
+		comp = zcomp_create("lz4hc");
+		if (IS_ERR(comp))
+			pr_warn("Cannot initialise lz4hc, hc_threshold ignored\n");
+		else
+			zram->hc_comp = comp;
+	}
+
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 	zram_revalidate_disk(zram);
@@ -1460,6 +1527,7 @@ static DEVICE_ATTR_WO(mem_limit);
 static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RW(hc_threshold);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 #endif
@@ -1473,6 +1541,7 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_hc_threshold.attr,
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 #endif
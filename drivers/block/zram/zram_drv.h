@@ -91,12 +91,19 @@ struct zram_stats {
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
+	atomic64_t hc_pages;		/* no. of pages stored by lz4hc */
 };
 
 struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
 	struct zcomp *comp;
+	/*
+	 * lz4hc recompresses pages lz4 leaves above hc_threshold bytes,
+	 * its output is read back by the lz4 decompressor
+	 */
+	struct zcomp *hc_comp;
+	unsigned int hc_threshold;
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -44,6 +44,8 @@
 #include <linux/string.h>
 #include <linux/signal.h>
 #include <linux/ioctl.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/of.h>
 #include <linux/serdev.h>
 #include <linux/skbuff.h>
@@ -62,6 +64,14 @@
 #define HCILL_WAKE_UP_IND	0x32
 #define HCILL_WAKE_UP_ACK	0x33
 
+/* TI vendor command changing the UART baud rate of the chip */
+#define HCI_VS_UPDATE_UART_HCI_BAUDRATE	0xff36
+
+/* TI vendor command setting the HCILL timers, in units of 1.25 ms */
+#define HCI_VS_HCILL_PARAMETERS		0xfd2b
+#define HCILL_RETRANSMIT_TIMEOUT	400	/* 500 ms */
+#define HCILL_RTS_PULSE_WIDTH		150	/* us */
+
 /* HCILL receiver States */
 #define HCILL_W4_PACKET_TYPE	0
 #define HCILL_W4_EVENT_HDR	1
@@ -81,6 +91,15 @@ struct hcill_cmd {
 	u8 cmd;
 } __packed;
 
+struct hcill_params {
+	__le16 inactivity_timeout;
+	__le16 retransmit_timeout;
+	u8 rts_pulse_width;
+} __packed;
+
+static unsigned int idle_timeout;
+static unsigned int oper_speed;
+
 struct ll_device {
 	struct hci_uart hu;
 	struct serdev_device *serdev;
@@ -96,6 +115,14 @@ struct ll_struct {
 	spinlock_t hcill_lock;		/* HCILL state lock	*/
 	unsigned long hcill_state;	/* HCILL power state	*/
 	struct sk_buff_head tx_wait_q;	/* HCILL wait queue	*/
+
+	/* statistics, protected by hcill_lock */
+	unsigned long host_wakeups;	/* wake ups we started	*/
+	unsigned long dev_wakeups;	/* wake ups the chip started */
+	unsigned long sleeps;		/* sleep indications acked */
+	unsigned long tx_deferred;	/* frames held while waking */
+	unsigned long tx_batches;	/* wait queue flushes	*/
+	struct dentry *debugfs;
 };
 
 /*
@@ -208,10 +235,18 @@ static int ll_close(struct hci_uart *hu)
  */
 static void __ll_do_awake(struct ll_struct *ll)
 {
-	struct sk_buff *skb = NULL;
-
-	while ((skb = skb_dequeue(&ll->tx_wait_q)))
-		skb_queue_tail(&ll->txq, skb);
+	/*
+	 * hand over everything queued while waking up in one go, under both
+	 * queue locks since ll_flush() purges them without the hcill_lock
+	 */
+	spin_lock(&ll->tx_wait_q.lock);
+	if (!skb_queue_empty(&ll->tx_wait_q)) {
+		spin_lock_nested(&ll->txq.lock, SINGLE_DEPTH_NESTING);
+		skb_queue_splice_tail_init(&ll->tx_wait_q, &ll->txq);
+		spin_unlock(&ll->txq.lock);
+		ll->tx_batches++;
+	}
+	spin_unlock(&ll->tx_wait_q.lock);
 
 	ll->hcill_state = HCILL_AWAKE;
 }
@@ -249,6 +284,7 @@ static void ll_device_want_to_wakeup(struct hci_uart *hu)
 			BT_ERR("cannot acknowledge device wake up");
 			goto out;
 		}
+		ll->dev_wakeups++;
 		break;
 	default:
 		/* any other state is illegal */
@@ -291,6 +327,7 @@ static void ll_device_want_to_sleep(struct hci_uart *hu)
 
 	/* update state */
 	ll->hcill_state = HCILL_ASLEEP;
+	ll->sleeps++;
 
 out:
 	spin_unlock_irqrestore(&ll->hcill_lock, flags);
@@ -350,17 +387,20 @@ static int ll_enqueue(struct hci_uart *hu, struct sk_buff *skb)
 		BT_DBG("device asleep, waking up and queueing packet");
 		/* save packet for later */
 		skb_queue_tail(&ll->tx_wait_q, skb);
+		ll->tx_deferred++;
 		/* awake device */
 		if (send_hcill_cmd(HCILL_WAKE_UP_IND, hu) < 0) {
 			BT_ERR("cannot wake up device");
 			break;
 		}
 		ll->hcill_state = HCILL_ASLEEP_TO_AWAKE;
+		ll->host_wakeups++;
 		break;
 	case HCILL_ASLEEP_TO_AWAKE:
 		BT_DBG("device waking up, queueing packet");
 		/* transient state; just keep packet for later */
 		skb_queue_tail(&ll->tx_wait_q, skb);
+		ll->tx_deferred++;
 		break;
 	default:
 		BT_ERR("illegal hcill state: %ld (losing packet)", ll->hcill_state);
@@ -533,6 +573,41 @@ static struct sk_buff *ll_dequeue(struct hci_uart *hu)
 	return skb_dequeue(&ll->txq);
 }
 
+static int ll_stats_show(struct seq_file *s, void *data)
+{
+	static const char * const states[] = {
+		[HCILL_ASLEEP]		= "asleep",
+		[HCILL_ASLEEP_TO_AWAKE]	= "waking",
+		[HCILL_AWAKE]		= "awake",
+		[HCILL_AWAKE_TO_ASLEEP]	= "going to sleep",
+	};
+	struct ll_struct *ll = s->private;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ll->hcill_lock, flags);
+	seq_printf(s, "state: %s\n", states[ll->hcill_state]);
+	seq_printf(s, "host wake ups: %lu\n", ll->host_wakeups);
+	seq_printf(s, "device wake ups: %lu\n", ll->dev_wakeups);
+	seq_printf(s, "sleeps: %lu\n", ll->sleeps);
+	seq_printf(s, "deferred frames: %lu\n", ll->tx_deferred);
+	seq_printf(s, "deferred batches: %lu\n", ll->tx_batches);
+	spin_unlock_irqrestore(&ll->hcill_lock, flags);
+
+	return 0;
+}
+
+static int ll_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ll_stats_show, inode->i_private);
+}
+
+static const struct file_operations ll_stats_fops = {
+	.open		= ll_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 #if IS_ENABLED(CONFIG_SERIAL_DEV_BUS)
 static int read_local_version(struct hci_dev *hdev)
 {
@@ -620,7 +695,7 @@ static int download_firmware(struct ll_device *lldev)
 		case ACTION_SEND_COMMAND:	/* action send */
 			bt_dev_dbg(lldev->hu.hdev, "S");
 			cmd = (struct hci_command *)action_ptr;
-			if (cmd->opcode == 0xff36) {
+			if (cmd->opcode == HCI_VS_UPDATE_UART_HCI_BAUDRATE) {
 				/* ignore remote change
 				 * baud rate HCI VS command
 				 */
@@ -659,15 +734,87 @@ static int download_firmware(struct ll_device *lldev)
 	return err;
 }
 
+/*
+ * Move chip and UART to a new baud rate. The chip switches once it has
+ * sent the command complete event, so RTS is held off while the host side
+ * is reprogrammed: nothing the chip sends at the new rate can be lost or
+ * garbled in between. Reading the version afterwards verifies the link.
+ */
+static int ll_set_oper_speed(struct hci_uart *hu, unsigned int speed)
+{
+	__le32 param = cpu_to_le32(speed);
+	struct sk_buff *skb;
+
+	skb = __hci_cmd_sync(hu->hdev, HCI_VS_UPDATE_UART_HCI_BAUDRATE,
+			     sizeof(param), &param, HCI_INIT_TIMEOUT);
+	if (IS_ERR(skb))
+		return PTR_ERR(skb);
+	kfree_skb(skb);
+
+	hci_uart_set_flow_control(hu, true);
+	if (hu->serdev)
+		serdev_device_set_baudrate(hu->serdev, speed);
+	else
+		hci_uart_set_baudrate(hu, speed);
+	hci_uart_set_flow_control(hu, false);
+
+	skb = __hci_cmd_sync(hu->hdev, HCI_OP_READ_LOCAL_VERSION, 0, NULL,
+			     HCI_INIT_TIMEOUT);
+	if (IS_ERR(skb)) {
+		bt_dev_err(hu->hdev, "no response at %u baud", speed);
+		return PTR_ERR(skb);
+	}
+	kfree_skb(skb);
+
+	bt_dev_info(hu->hdev, "running at %u baud", speed);
+
+	return 0;
+}
+
+/* Override the idle time after which the chip goes to sleep */
+static void ll_set_idle_timeout(struct hci_uart *hu)
+{
+	struct hcill_params params = {
+		.inactivity_timeout = cpu_to_le16(min_t(unsigned int,
+				DIV_ROUND_UP(idle_timeout * 4, 5), 0xffff)),
+		.retransmit_timeout = cpu_to_le16(HCILL_RETRANSMIT_TIMEOUT),
+		.rts_pulse_width = HCILL_RTS_PULSE_WIDTH,
+	};
+	struct sk_buff *skb;
+
+	if (!idle_timeout)
+		return;
+
+	skb = __hci_cmd_sync(hu->hdev, HCI_VS_HCILL_PARAMETERS,
+			     sizeof(params), &params, HCI_INIT_TIMEOUT);
+	if (IS_ERR(skb))
+		bt_dev_warn(hu->hdev, "setting HCILL idle timeout failed (%ld)",
+			    PTR_ERR(skb));
+	else
+		kfree_skb(skb);
+}
+
 static int ll_setup(struct hci_uart *hu)
 {
 	int err, retry = 3;
+	struct ll_struct *ll = hu->priv;
 	struct ll_device *lldev;
 	struct serdev_device *serdev = hu->serdev;
 	u32 speed;
 
-	if (!serdev)
-		return 0;
+	if (!ll->debugfs && hu->hdev->debugfs)
+		ll->debugfs = debugfs_create_file("hcill_stats", 0444,
+						  hu->hdev->debugfs, ll,
+						  &ll_stats_fops);
+
+	/*
+	 * chips attached through the line discipline are set up by hciattach,
+	 * only the idle timeout and the speed are left to do
+	 */
+	if (!serdev) {
+		ll_set_idle_timeout(hu);
+		return oper_speed ? ll_set_oper_speed(hu, oper_speed) : 0;
+	}
 
 	lldev = serdev_device_get_drvdata(serdev);
 
@@ -691,6 +838,8 @@ static int ll_setup(struct hci_uart *hu)
 	if (err)
 		return err;
 
+	ll_set_idle_timeout(hu);
+
 	/* Operational speed if any */
 	if (hu->oper_speed)
 		speed = hu->oper_speed;
@@ -699,13 +848,8 @@ static int ll_setup(struct hci_uart *hu)
 	else
 		speed = 0;
 
-	if (speed) {
-		struct sk_buff *skb = __hci_cmd_sync(hu->hdev, 0xff36, sizeof(speed), &speed, HCI_INIT_TIMEOUT);
-		if (!IS_ERR(skb)) {
-			kfree_skb(skb);
-			serdev_device_set_baudrate(serdev, speed);
-		}
-	}
+	if (speed)
+		return ll_set_oper_speed(hu, speed);
 
 	return 0;
 }
@@ -800,3 +944,9 @@ int __exit ll_deinit(void)
 
 	return hci_uart_unregister_proto(&llp);
 }
+
+module_param(idle_timeout, uint, 0644);
+MODULE_PARM_DESC(idle_timeout, "HCILL inactivity time before the chip sleeps, in ms (0 = firmware default)");
+
+module_param(oper_speed, uint, 0644);
+MODULE_PARM_DESC(oper_speed, "Baud rate to switch line discipline attached chips to (0 = keep)");
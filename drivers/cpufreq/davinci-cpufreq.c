@@ -25,11 +25,25 @@
 #include <linux/clk.h>
 #include <linux/platform_device.h>
 #include <linux/export.h>
+#include <linux/ktime.h>
 
 #include <mach/hardware.h>
 #include <mach/cpufreq.h>
 #include <mach/common.h>
 
+/*
+ * Time measurement across the target() function yields ~1500-1800us
+ * time taken with no drivers on notification list. This is what is
+ * assumed when the platform does not know better.
+ */
+#define DAVINCI_CPUFREQ_DEFAULT_LATENCY	(2000 * NSEC_PER_USEC)
+
+/*
+ * Governors are not allowed to switch more often than once every this many
+ * transition latencies, so switching never takes more than 5% of the time.
+ */
+#define DAVINCI_CPUFREQ_DELAY_FACTOR	20
+
 struct davinci_cpufreq {
 	struct device *dev;
 	struct clk *armclk;
@@ -38,37 +52,65 @@ struct davinci_cpufreq {
 };
 static struct davinci_cpufreq cpufreq;
 
+/*
+ * Keeps the advertised transition latency at the worst switch seen so far,
+ * notifiers included.
+ */
+static void davinci_account_latency(struct cpufreq_policy *policy,
+				    ktime_t start)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (ns <= policy->cpuinfo.transition_latency)
+		return;
+
+	policy->cpuinfo.transition_latency = min_t(u64, ns, UINT_MAX);
+	dev_dbg(cpufreq.dev, "transition latency now %u us\n",
+		policy->cpuinfo.transition_latency / NSEC_PER_USEC);
+}
+
 static int davinci_target(struct cpufreq_policy *policy, unsigned int idx)
 {
 	struct davinci_cpufreq_config *pdata = cpufreq.dev->platform_data;
 	struct clk *armclk = cpufreq.armclk;
-	unsigned int old_freq, new_freq;
+	struct cpufreq_freqs freqs;
+	ktime_t start;
 	int ret = 0;
 
-	old_freq = policy->cur;
-	new_freq = pdata->freq_table[idx].frequency;
+	freqs.old = policy->cur;
+	freqs.new = pdata->freq_table[idx].frequency;
+
+	start = ktime_get();
 
-	/* if moving to higher frequency, up the voltage beforehand */
-	if (pdata->set_voltage && new_freq > old_freq) {
+	/*
+	 * The notifiers hold off peripherals clocked from the PLL until the
+	 * switch is done, so only the PLL and the "async" clock change while
+	 * they are quiesced. The regulator may sit behind one of those
+	 * peripherals, and its ramp would stall I/O for no reason, so the
+	 * voltage is raised before and lowered after the notification window.
+	 */
+	if (pdata->set_voltage && freqs.new > freqs.old) {
 		ret = pdata->set_voltage(idx);
 		if (ret)
 			return ret;
 	}
 
-	ret = clk_set_rate(armclk, new_freq * 1000);
-	if (ret)
-		return ret;
+	cpufreq_freq_transition_begin(policy, &freqs);
 
-	if (cpufreq.asyncclk) {
+	ret = clk_set_rate(armclk, freqs.new * 1000);
+	if (!ret && cpufreq.asyncclk)
 		ret = clk_set_rate(cpufreq.asyncclk, cpufreq.asyncrate);
-		if (ret)
-			return ret;
-	}
+
+	cpufreq_freq_transition_end(policy, &freqs, ret);
+	if (ret)
+		return ret;
 
 	/* if moving to lower freq, lower the voltage after lowering freq */
-	if (pdata->set_voltage && new_freq < old_freq)
+	if (pdata->set_voltage && freqs.new < freqs.old)
 		pdata->set_voltage(idx);
 
+	davinci_account_latency(policy, start);
+
 	return 0;
 }
 
@@ -77,6 +119,7 @@ static int davinci_cpu_init(struct cpufreq_policy *policy)
 	int result = 0;
 	struct davinci_cpufreq_config *pdata = cpufreq.dev->platform_data;
 	struct cpufreq_frequency_table *freq_table = pdata->freq_table;
+	unsigned int latency;
 
 	if (policy->cpu != 0)
 		return -EINVAL;
@@ -90,17 +133,23 @@ static int davinci_cpu_init(struct cpufreq_policy *policy)
 
 	policy->clk = cpufreq.armclk;
 
+	/* pdata->init() may have added the regulator ramp to the estimate */
+	latency = pdata->transition_latency ?: DAVINCI_CPUFREQ_DEFAULT_LATENCY;
+
 	/*
-	 * Time measurement across the target() function yields ~1500-1800us
-	 * time taken with no drivers on notification list.
-	 * Setting the latency to 2000 us to accommodate addition of drivers
-	 * to pre/post change notification list.
+	 * schedutil picks its rate limit when it starts, so base it on the
+	 * platform's estimate rather than the worst case of 10 ms the core
+	 * derives for anything slower than 10 us.
 	 */
-	return cpufreq_generic_init(policy, freq_table, 2000 * 1000);
+	policy->transition_delay_us = DIV_ROUND_UP(latency, NSEC_PER_USEC) *
+				      DAVINCI_CPUFREQ_DELAY_FACTOR;
+
+	return cpufreq_generic_init(policy, freq_table, latency);
 }
 
 static struct cpufreq_driver davinci_driver = {
-	.flags		= CPUFREQ_STICKY | CPUFREQ_NEED_INITIAL_FREQ_CHECK,
+	.flags		= CPUFREQ_STICKY | CPUFREQ_NEED_INITIAL_FREQ_CHECK |
+			  CPUFREQ_ASYNC_NOTIFICATION,
 	.verify		= cpufreq_generic_frequency_table_verify,
 	.target_index	= davinci_target,
 	.get		= cpufreq_generic_get,
@@ -1,6 +1,7 @@
 #include <linux/delay.h>
 #include <linux/dmaengine.h>
 #include <linux/dma-mapping.h>
+#include <linux/legoev3_perf.h>
 #include <linux/platform_device.h>
 #include <linux/module.h>
 #include <linux/of.h>
@@ -8,9 +9,11 @@
 #include <linux/of_dma.h>
 #include <linux/of_irq.h>
 #include <linux/dmapool.h>
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/of_address.h>
 #include <linux/pm_runtime.h>
+#include <linux/seq_file.h>
 #include "dmaengine.h"
 
 #define DESC_TYPE	27
@@ -119,6 +122,19 @@ struct chan_queues {
 	u16 complete;
 };
 
+/*
+ * Completion counters, on the EV3 performance dashboard. @irqs and @polls
+ * are the passes of cppi41_drain_all() from the interrupt and from the
+ * pacing timer, @paced how often the interrupt was switched to polling.
+ */
+struct cppi41_stats {
+	u64 completions;
+	u64 bytes;
+	u64 irqs;
+	u64 polls;
+	u64 paced;
+};
+
 struct cppi41_dd {
 	struct dma_device ddev;
 
@@ -149,6 +165,20 @@ struct cppi41_dd {
 	unsigned int dma_tdfdq;
 
 	bool is_suspended;
+
+	/*
+	 * Interrupt pacing: once an interrupt completes pace_threshold
+	 * descriptors, the interrupt is disabled and the completion queues
+	 * are polled every pace_usecs until they calm down.
+	 */
+	struct hrtimer pace_timer;
+	spinlock_t pace_lock;		/* serializes draining */
+	unsigned int pace_threshold;
+	unsigned int pace_usecs;
+	bool paced;
+
+	struct cppi41_stats stats;	/* protected by pace_lock */
+	struct legoev3_perf_source perf;
 };
 
 static struct chan_queues am335x_usb_queues_tx[] = {
@@ -298,12 +328,20 @@ static u32 cppi41_pop_desc(struct cppi41_dd *cdd, unsigned queue_num)
 	return desc;
 }
 
-static irqreturn_t cppi41_irq(int irq, void *data)
+/*
+ * Most passes over the pending registers per interrupt. The completion
+ * callbacks usually queue the next packet right away, and at high speed it
+ * often completes before the handler returns.
+ */
+#define CPPI41_IRQ_MAX_PASSES	8
+
+/* Completes the descriptors of all pending completion queues */
+static unsigned int cppi41_drain(struct cppi41_dd *cdd)
 {
-	struct cppi41_dd *cdd = data;
 	u16 first_completion_queue = cdd->first_completion_queue;
 	u16 qmgr_num_pend = cdd->qmgr_num_pend;
 	struct cppi41_channel *c;
+	unsigned int done = 0;
 	int i;
 
 	for (i = QMGR_PENDING_SLOT_Q(first_completion_queue); i < qmgr_num_pend;
@@ -351,13 +389,185 @@ static irqreturn_t cppi41_irq(int irq, void *data)
 				len = pd_trans_len(c->desc->pd0);
 
 			c->residue = pd_trans_len(c->desc->pd6) - len;
+			cdd->stats.bytes += len;
 			dma_cookie_complete(&c->txd);
 			dmaengine_desc_get_callback_invoke(&c->txd, NULL);
+			done++;
 		}
 	}
+
+	return done;
+}
+
+static unsigned int cppi41_drain_all(struct cppi41_dd *cdd, bool polled)
+{
+	unsigned int done, total = 0;
+	int passes = 0;
+
+	spin_lock(&cdd->pace_lock);
+	/* look again for completions that came in while we were at it */
+	do {
+		done = cppi41_drain(cdd);
+		total += done;
+	} while (done && ++passes < CPPI41_IRQ_MAX_PASSES);
+	cdd->stats.completions += total;
+	if (polled)
+		cdd->stats.polls++;
+	else
+		cdd->stats.irqs++;
+	spin_unlock(&cdd->pace_lock);
+
+	return total;
+}
+
+static ktime_t cppi41_pace_interval(unsigned int usecs)
+{
+	return ns_to_ktime((u64)usecs * NSEC_PER_USEC);
+}
+
+static void cppi41_pace_start(struct cppi41_dd *cdd)
+{
+	/* the line may be shared, its other users wait for the poll too */
+	disable_irq_nosync(cdd->irq);
+	cdd->paced = true;
+	spin_lock(&cdd->pace_lock);
+	cdd->stats.paced++;
+	spin_unlock(&cdd->pace_lock);
+	hrtimer_start(&cdd->pace_timer, cppi41_pace_interval(cdd->pace_usecs),
+		      HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart cppi41_pace_poll(struct hrtimer *timer)
+{
+	struct cppi41_dd *cdd = container_of(timer, struct cppi41_dd,
+					     pace_timer);
+	unsigned int pace_usecs = READ_ONCE(cdd->pace_usecs);
+
+	if (!cdd->is_suspended && pace_usecs &&
+	    cppi41_drain_all(cdd, true) >= READ_ONCE(cdd->pace_threshold)) {
+		hrtimer_forward_now(timer, cppi41_pace_interval(pace_usecs));
+		return HRTIMER_RESTART;
+	}
+
+	/* quiet again, go back to one interrupt per completion */
+	cdd->paced = false;
+	enable_irq(cdd->irq);
+
+	return HRTIMER_NORESTART;
+}
+
+static irqreturn_t cppi41_irq(int irq, void *data)
+{
+	struct cppi41_dd *cdd = data;
+	unsigned int done;
+
+	done = cppi41_drain_all(cdd, false);
+	if (READ_ONCE(cdd->pace_usecs) && done &&
+	    done >= READ_ONCE(cdd->pace_threshold))
+		cppi41_pace_start(cdd);
+
 	return IRQ_HANDLED;
 }
 
+static ssize_t irq_pace_threshold_show(struct device *dev,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	struct cppi41_dd *cdd = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", cdd->pace_threshold);
+}
+
+static ssize_t irq_pace_threshold_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct cppi41_dd *cdd = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (!val)
+		return -EINVAL;
+
+	WRITE_ONCE(cdd->pace_threshold, val);
+
+	return count;
+}
+static DEVICE_ATTR_RW(irq_pace_threshold);
+
+static ssize_t irq_pace_usecs_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct cppi41_dd *cdd = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", cdd->pace_usecs);
+}
+
+/* 0 turns pacing off, the poll in progress then ends at its next run */
+static ssize_t irq_pace_usecs_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct cppi41_dd *cdd = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (val > USEC_PER_MSEC)
+		return -EINVAL;
+
+	WRITE_ONCE(cdd->pace_usecs, val);
+
+	return count;
+}
+static DEVICE_ATTR_RW(irq_pace_usecs);
+
+static struct attribute *cppi41_attrs[] = {
+	&dev_attr_irq_pace_threshold.attr,
+	&dev_attr_irq_pace_usecs.attr,
+	NULL
+};
+
+static const struct attribute_group cppi41_attr_group = {
+	.attrs = cppi41_attrs,
+};
+
+static void cppi41_perf_show(struct seq_file *s, void *data, u64 interval_ns)
+{
+	struct cppi41_dd *cdd = data;
+	struct cppi41_stats stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdd->pace_lock, flags);
+	stats = cdd->stats;
+	spin_unlock_irqrestore(&cdd->pace_lock, flags);
+
+	seq_printf(s, "completions: %llu, %llu/s\n", stats.completions,
+		   interval_ns ? div64_u64(stats.completions * NSEC_PER_SEC,
+					   interval_ns) : 0);
+	seq_printf(s, "bytes: %llu, %llu/s\n", stats.bytes,
+		   interval_ns ? div64_u64(stats.bytes * NSEC_PER_SEC,
+					   interval_ns) : 0);
+	seq_printf(s, "irqs: %llu\n", stats.irqs);
+	seq_printf(s, "polls: %llu\n", stats.polls);
+	seq_printf(s, "paced: %llu\n", stats.paced);
+}
+
+static void cppi41_perf_reset(void *data)
+{
+	struct cppi41_dd *cdd = data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cdd->pace_lock, flags);
+	memset(&cdd->stats, 0, sizeof(cdd->stats));
+	spin_unlock_irqrestore(&cdd->pace_lock, flags);
+}
+
 static dma_cookie_t cppi41_tx_submit(struct dma_async_tx_descriptor *tx)
 {
 	dma_cookie_t cookie;
@@ -1090,11 +1300,20 @@ static int cppi41_dma_probe(struct platform_device *pdev)
 		goto err_chans;
 	}
 
+	spin_lock_init(&cdd->pace_lock);
+	hrtimer_init(&cdd->pace_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cdd->pace_timer.function = cppi41_pace_poll;
+	cdd->pace_threshold = 4;
+	cdd->irq = irq;
+
 	ret = devm_request_irq(&pdev->dev, irq, cppi41_irq, IRQF_SHARED,
 			dev_name(dev), cdd);
 	if (ret)
 		goto err_chans;
-	cdd->irq = irq;
+
+	ret = devm_device_add_group(dev, &cppi41_attr_group);
+	if (ret)
+		goto err_chans;
 
 	ret = dma_async_device_register(&cdd->ddev);
 	if (ret)
@@ -1105,6 +1324,12 @@ static int cppi41_dma_probe(struct platform_device *pdev)
 	if (ret)
 		goto err_of;
 
+	strlcpy(cdd->perf.name, dev_name(dev), sizeof(cdd->perf.name));
+	cdd->perf.show = cppi41_perf_show;
+	cdd->perf.reset = cppi41_perf_reset;
+	cdd->perf.data = cdd;
+	legoev3_perf_register(&cdd->perf);
+
 	pm_runtime_mark_last_busy(dev);
 	pm_runtime_put_autosuspend(dev);
 
@@ -1131,9 +1356,12 @@ static int cppi41_dma_remove(struct platform_device *pdev)
 	if (error < 0)
 		dev_err(&pdev->dev, "%s could not pm_runtime_get: %i\n",
 			__func__, error);
+	legoev3_perf_unregister(&cdd->perf);
 	of_dma_controller_free(pdev->dev.of_node);
 	dma_async_device_unregister(&cdd->ddev);
 
+	if (hrtimer_cancel(&cdd->pace_timer) && cdd->paced)
+		enable_irq(cdd->irq);
 	devm_free_irq(&pdev->dev, cdd->irq, cdd);
 	deinit_cppi41(&pdev->dev, cdd);
 	pm_runtime_dont_use_autosuspend(&pdev->dev);
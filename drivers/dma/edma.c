@@ -13,15 +13,19 @@
  * GNU General Public License for more details.
  */
 
+#include <linux/debugfs.h>
 #include <linux/dmaengine.h>
 #include <linux/dma-mapping.h>
 #include <linux/edma.h>
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/legoev3_perf.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/of.h>
@@ -36,6 +40,9 @@
 #include "dmaengine.h"
 #include "virt-dma.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/edma.h>
+
 /* Offsets matching "struct edmacc_param" */
 #define PARM_OPT		0x00
 #define PARM_SRC		0x04
@@ -122,6 +129,11 @@
  * that are required for ASoC, otherwise DMA prep calls will
  * fail. Today davinci-pcm is the only user of this driver and
  * requires atleast 17 slots, so we setup the default to 20.
+ *
+ * Longer slave SG lists borrow the slots beyond these from the shared pool of
+ * the channel controller for the lifetime of the descriptor, so that the whole
+ * list is linked up front and completes with a single interrupt. Only when
+ * the pool runs dry is the list processed in batches of MAX_NR_SG.
  */
 #define MAX_NR_SG		20
 #define EDMA_MAX_SLOTS		MAX_NR_SG
@@ -199,11 +211,35 @@ struct edma_desc {
 	u32				residue;
 	u32				residue_stat;
 
+	/* total length, and when the descriptor was submitted and started */
+	u32				len;
+	ktime_t				submitted;
+	ktime_t				started;
+
+	/* slots borrowed from the pool for psets from MAX_NR_SG on */
+	int				nr_pool_slots;
+	int				*pool_slot;
+
 	struct edma_pset		pset[0];
 };
 
 struct edma_cc;
 
+/*
+ * Per channel counters, shown in debugfs. Latencies are in ns, from submit to
+ * start and from start to completion of non-cyclic descriptors.
+ */
+struct edma_chan_stats {
+	u64				descs;
+	u64				bytes;
+	u64				reloads;
+	u64				missed;
+	u64				wait_total;
+	u64				wait_max;
+	u64				run_total;
+	u64				run_max;
+};
+
 struct edma_tc {
 	struct device_node		*node;
 	u16				id;
@@ -218,9 +254,13 @@ struct edma_chan {
 	int				ch_num;
 	bool				alloced;
 	bool				hw_triggered;
+	/* queue from the platform data, EVENTQ_DEFAULT if none */
+	enum dma_event_q		eventq;
 	int				slot[EDMA_MAX_SLOTS];
 	int				missed;
 	struct dma_slave_config		cfg;
+	/* protected by vchan.lock */
+	struct edma_chan_stats		stats;
 };
 
 struct edma_cc {
@@ -253,6 +293,8 @@ struct edma_cc {
 	struct edma_chan		*slave_chans;
 	struct edma_tc			*tc_list;
 	int				dummy_slot;
+	struct dentry			*debugfs;
+	struct legoev3_perf_source	perf;
 };
 
 /* dummy param set used to (re)initialize parameter RAM slots */
@@ -743,9 +785,109 @@ static inline struct edma_desc *to_edma_desc(struct dma_async_tx_descriptor *tx)
 	return container_of(tx, struct edma_desc, vdesc.tx);
 }
 
+static dma_cookie_t edma_tx_submit(struct dma_async_tx_descriptor *tx)
+{
+	to_edma_desc(tx)->submitted = ktime_get();
+
+	return vchan_tx_submit(tx);
+}
+
+/* vchan_tx_prep() that also timestamps the submission for the statistics */
+static struct dma_async_tx_descriptor *edma_tx_prep(struct edma_chan *echan,
+						    struct edma_desc *edesc,
+						    unsigned long tx_flags)
+{
+	struct dma_async_tx_descriptor *tx;
+
+	edesc->len = edesc->residue;
+	tx = vchan_tx_prep(&echan->vchan, &edesc->vdesc, tx_flags);
+	tx->tx_submit = edma_tx_submit;
+
+	return tx;
+}
+
+static void edma_stats_add(u64 *total, u64 *max, u64 ns)
+{
+	*total += ns;
+	if (ns > *max)
+		*max = ns;
+}
+
+/* Accounts for a descriptor the hardware is about to start */
+static void edma_stats_start(struct edma_chan *echan, struct edma_desc *edesc)
+{
+	u64 ns;
+
+	edesc->started = ktime_get();
+	ns = ktime_to_ns(ktime_sub(edesc->started, edesc->submitted));
+	if (!edesc->cyclic)
+		edma_stats_add(&echan->stats.wait_total,
+			       &echan->stats.wait_max, ns);
+	trace_edma_desc_start(echan->ch_num, edesc->vdesc.tx.cookie,
+			      edesc->len, ns);
+}
+
+static void edma_stats_complete(struct edma_chan *echan,
+				struct edma_desc *edesc)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), edesc->started));
+
+	echan->stats.descs++;
+	echan->stats.bytes += edesc->len;
+	edma_stats_add(&echan->stats.run_total, &echan->stats.run_max, ns);
+	trace_edma_desc_complete(echan->ch_num, edesc->vdesc.tx.cookie,
+				 edesc->len, ns);
+}
+
+static void edma_free_pool_slots(struct edma_desc *edesc)
+{
+	int i;
+
+	for (i = 0; i < edesc->nr_pool_slots; i++)
+		edma_free_slot(edesc->echan->ecc, edesc->pool_slot[i]);
+	kfree(edesc->pool_slot);
+	edesc->nr_pool_slots = 0;
+	edesc->pool_slot = NULL;
+}
+
+/*
+ * Tries to borrow the slots for all psets beyond the channel's own ones, so
+ * that edma_execute() can link the whole SG list at once.
+ */
+static bool edma_alloc_pool_slots(struct edma_desc *edesc)
+{
+	struct edma_cc *ecc = edesc->echan->ecc;
+	int nr = edesc->pset_nr - MAX_NR_SG;
+	int slot;
+
+	edesc->pool_slot = kcalloc(nr, sizeof(*edesc->pool_slot), GFP_ATOMIC);
+	if (!edesc->pool_slot)
+		return false;
+
+	while (edesc->nr_pool_slots < nr) {
+		slot = edma_alloc_slot(ecc, EDMA_SLOT_ANY);
+		if (slot < 0) {
+			edma_free_pool_slots(edesc);
+			return false;
+		}
+		edesc->pool_slot[edesc->nr_pool_slots++] = slot;
+	}
+
+	return true;
+}
+
+static int edma_desc_slot(struct edma_chan *echan, struct edma_desc *edesc,
+			  int i)
+{
+	return i < MAX_NR_SG ? echan->slot[i] : edesc->pool_slot[i - MAX_NR_SG];
+}
+
 static void edma_desc_free(struct virt_dma_desc *vdesc)
 {
-	kfree(container_of(vdesc, struct edma_desc, vdesc));
+	struct edma_desc *edesc = container_of(vdesc, struct edma_desc, vdesc);
+
+	edma_free_pool_slots(edesc);
+	kfree(edesc);
 }
 
 /* Dispatch a queued descriptor to the controller (caller holds lock) */
@@ -755,7 +897,8 @@ static void edma_execute(struct edma_chan *echan)
 	struct virt_dma_desc *vdesc;
 	struct edma_desc *edesc;
 	struct device *dev = echan->vchan.chan.device->dev;
-	int i, j, left, nslots;
+	int i, j, left, nslots, slot;
+	bool first;
 
 	if (!echan->edesc) {
 		/* Setup is needed for the first transfer */
@@ -764,19 +907,25 @@ static void edma_execute(struct edma_chan *echan)
 			return;
 		list_del(&vdesc->node);
 		echan->edesc = to_edma_desc(&vdesc->tx);
+		edma_stats_start(echan, echan->edesc);
+	} else {
+		/* software reload of the next batch of an SG list */
+		echan->stats.reloads++;
 	}
 
 	edesc = echan->edesc;
 
 	/* Find out how many left */
+	first = !edesc->processed;
 	left = edesc->pset_nr - edesc->processed;
-	nslots = min(MAX_NR_SG, left);
+	nslots = min(MAX_NR_SG + edesc->nr_pool_slots, left);
 	edesc->sg_len = 0;
 
 	/* Write descriptor PaRAM set(s) */
 	for (i = 0; i < nslots; i++) {
 		j = i + edesc->processed;
-		edma_write_slot(ecc, echan->slot[i], &edesc->pset[j].param);
+		slot = edma_desc_slot(echan, edesc, i);
+		edma_write_slot(ecc, slot, &edesc->pset[j].param);
 		edesc->sg_len += edesc->pset[j].len;
 		dev_vdbg(dev,
 			 "\n pset[%d]:\n"
@@ -790,7 +939,7 @@ static void edma_execute(struct edma_chan *echan)
 			 "  bidx\t%08x\n"
 			 "  cidx\t%08x\n"
 			 "  lkrld\t%08x\n",
-			 j, echan->ch_num, echan->slot[i],
+			 j, echan->ch_num, slot,
 			 edesc->pset[j].param.opt,
 			 edesc->pset[j].param.src,
 			 edesc->pset[j].param.dst,
@@ -801,7 +950,8 @@ static void edma_execute(struct edma_chan *echan)
 			 edesc->pset[j].param.link_bcntrld);
 		/* Link to the previous slot if not the last set */
 		if (i != (nslots - 1))
-			edma_link(ecc, echan->slot[i], echan->slot[i + 1]);
+			edma_link(ecc, slot,
+				  edma_desc_slot(echan, edesc, i + 1));
 	}
 
 	edesc->processed += nslots;
@@ -812,11 +962,11 @@ static void edma_execute(struct edma_chan *echan)
 	 * events being absorbed and that's OK because we're done
 	 */
 	if (edesc->processed == edesc->pset_nr) {
+		slot = edma_desc_slot(echan, edesc, nslots - 1);
 		if (edesc->cyclic)
-			edma_link(ecc, echan->slot[nslots - 1], echan->slot[1]);
+			edma_link(ecc, slot, echan->slot[1]);
 		else
-			edma_link(ecc, echan->slot[nslots - 1],
-				  echan->ecc->dummy_slot);
+			edma_link(ecc, slot, echan->ecc->dummy_slot);
 	}
 
 	if (echan->missed) {
@@ -831,7 +981,7 @@ static void edma_execute(struct edma_chan *echan)
 		edma_start(echan);
 		edma_trigger_channel(echan);
 		echan->missed = 0;
-	} else if (edesc->processed <= MAX_NR_SG) {
+	} else if (first) {
 		dev_dbg(dev, "first transfer starting on channel %d\n",
 			echan->ch_num);
 		edma_start(echan);
@@ -858,7 +1008,8 @@ static int edma_terminate_all(struct dma_chan *chan)
 	if (echan->edesc) {
 		edma_stop(echan);
 		/* Move the cyclic channel back to default queue */
-		if (!echan->tc && echan->edesc->cyclic)
+		if (!echan->tc && echan->eventq == EVENTQ_DEFAULT &&
+		    echan->edesc->cyclic)
 			edma_assign_channel_eventq(echan, EVENTQ_DEFAULT);
 		/*
 		 * free the running request descriptor
@@ -1099,6 +1250,10 @@ static struct dma_async_tx_descriptor *edma_prep_slave_sg(
 		}
 	}
 
+	/* Link the whole list at once if the pool has enough slots */
+	if (sg_len > MAX_NR_SG)
+		edma_alloc_pool_slots(edesc);
+
 	/* Configure PaRAM sets for each SG */
 	for_each_sg(sgl, sg, sg_len, i) {
 		/* Get address for each SG */
@@ -1111,7 +1266,7 @@ static struct dma_async_tx_descriptor *edma_prep_slave_sg(
 				       dst_addr, burst, dev_width,
 				       sg_dma_len(sg), direction);
 		if (ret < 0) {
-			kfree(edesc);
+			edma_desc_free(&edesc->vdesc);
 			return NULL;
 		}
 
@@ -1121,7 +1276,7 @@ static struct dma_async_tx_descriptor *edma_prep_slave_sg(
 		if (i == sg_len - 1)
 			/* Enable completion interrupt */
 			edesc->pset[i].param.opt |= TCINTEN;
-		else if (!((i+1) % MAX_NR_SG))
+		else if (!edesc->nr_pool_slots && !((i+1) % MAX_NR_SG))
 			/*
 			 * Enable early completion interrupt for the
 			 * intermediateset. In this case the driver will be
@@ -1132,7 +1287,7 @@ static struct dma_async_tx_descriptor *edma_prep_slave_sg(
 	}
 	edesc->residue_stat = edesc->residue;
 
-	return vchan_tx_prep(&echan->vchan, &edesc->vdesc, tx_flags);
+	return edma_tx_prep(echan, edesc, tx_flags);
 }
 
 static struct dma_async_tx_descriptor *edma_prep_dma_memcpy(
@@ -1243,7 +1398,7 @@ static struct dma_async_tx_descriptor *edma_prep_dma_memcpy(
 		edesc->pset[1].param.opt |= TCINTEN;
 	}
 
-	return vchan_tx_prep(&echan->vchan, &edesc->vdesc, tx_flags);
+	return edma_tx_prep(echan, edesc, tx_flags);
 }
 
 static struct dma_async_tx_descriptor *edma_prep_dma_cyclic(
@@ -1398,10 +1553,10 @@ static struct dma_async_tx_descriptor *edma_prep_dma_cyclic(
 	}
 
 	/* Place the cyclic channel to highest priority queue */
-	if (!echan->tc)
+	if (!echan->tc && echan->eventq == EVENTQ_DEFAULT)
 		edma_assign_channel_eventq(echan, EVENTQ_0);
 
-	return vchan_tx_prep(&echan->vchan, &edesc->vdesc, tx_flags);
+	return edma_tx_prep(echan, edesc, tx_flags);
 }
 
 static void edma_completion_handler(struct edma_chan *echan)
@@ -1419,6 +1574,7 @@ static void edma_completion_handler(struct edma_chan *echan)
 		} else if (edesc->processed == edesc->pset_nr) {
 			edesc->residue = 0;
 			edma_stop(echan);
+			edma_stats_complete(echan, edesc);
 			vchan_cookie_complete(&edesc->vdesc);
 			echan->edesc = NULL;
 
@@ -1500,6 +1656,7 @@ static void edma_error_handler(struct edma_chan *echan)
 	spin_lock(&echan->vchan.lock);
 
 	err = edma_read_slot(ecc, echan->slot[0], &p);
+	echan->stats.missed++;
 
 	/*
 	 * Issue later based on missed flag which will be sure
@@ -1627,6 +1784,8 @@ static int edma_alloc_chan_resources(struct dma_chan *chan)
 
 	if (echan->tc) {
 		eventq_no = echan->tc->id;
+	} else if (echan->eventq != EVENTQ_DEFAULT) {
+		eventq_no = echan->eventq;
 	} else if (ecc->tc_list) {
 		/* memcpy channel */
 		echan->tc = &ecc->tc_list[ecc->info->default_queue];
@@ -1913,6 +2072,7 @@ static void edma_dma_init(struct edma_cc *ecc, bool legacy_mode)
 			vchan_init(&echan->vchan, s_ddev);
 
 		INIT_LIST_HEAD(&echan->node);
+		echan->eventq = EVENTQ_DEFAULT;
 		for (j = 0; j < EDMA_MAX_SLOTS; j++)
 			echan->slot[j] = -1;
 	}
@@ -2180,6 +2340,115 @@ static struct dma_chan *of_edma_xlate(struct of_phandle_args *dma_spec,
 }
 #endif
 
+#ifdef CONFIG_DEBUG_FS
+static void edma_stats_show(struct seq_file *s, struct edma_cc *ecc,
+			    u64 interval_ns)
+{
+	struct edma_chan_stats stats;
+	unsigned long flags;
+	int i;
+
+	seq_puts(s, "ch\tdescs\tbytes\treloads\tmissed\t"
+		    "wait avg/max (ns)\trun avg/max (ns)");
+	if (interval_ns)
+		seq_puts(s, "\tbusy (%)");
+	seq_putc(s, '\n');
+
+	for (i = 0; i < ecc->num_channels; i++) {
+		struct edma_chan *echan = &ecc->slave_chans[i];
+
+		spin_lock_irqsave(&echan->vchan.lock, flags);
+		stats = echan->stats;
+		spin_unlock_irqrestore(&echan->vchan.lock, flags);
+
+		if (!echan->alloced && !stats.descs)
+			continue;
+
+		seq_printf(s, "%d\t%llu\t%llu\t%llu\t%llu\t%llu/%llu\t%llu/%llu",
+			   i, stats.descs, stats.bytes, stats.reloads,
+			   stats.missed,
+			   stats.descs ? div64_u64(stats.wait_total,
+						   stats.descs) : 0,
+			   stats.wait_max,
+			   stats.descs ? div64_u64(stats.run_total,
+						   stats.descs) : 0,
+			   stats.run_max);
+		/* the share of the interval a descriptor was running */
+		if (interval_ns)
+			seq_printf(s, "\t%llu",
+				   div64_u64(stats.run_total * 100,
+					     interval_ns));
+		seq_putc(s, '\n');
+	}
+}
+
+static int edma_debugfs_show(struct seq_file *s, void *data)
+{
+	edma_stats_show(s, s->private, 0);
+
+	return 0;
+}
+
+static int edma_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, edma_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations edma_debugfs_operations = {
+	.open		= edma_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void edma_perf_show(struct seq_file *s, void *data, u64 interval_ns)
+{
+	edma_stats_show(s, data, interval_ns);
+}
+
+static void edma_perf_reset(void *data)
+{
+	struct edma_cc *ecc = data;
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < ecc->num_channels; i++) {
+		struct edma_chan *echan = &ecc->slave_chans[i];
+
+		spin_lock_irqsave(&echan->vchan.lock, flags);
+		memset(&echan->stats, 0, sizeof(echan->stats));
+		spin_unlock_irqrestore(&echan->vchan.lock, flags);
+	}
+}
+
+static void edma_init_debugfs(struct edma_cc *ecc)
+{
+	ecc->debugfs = debugfs_create_file(dev_name(ecc->dev), S_IRUGO, NULL,
+					   ecc, &edma_debugfs_operations);
+
+	/* the id is 0 for all controllers with DT, the name is unique */
+	strlcpy(ecc->perf.name, dev_name(ecc->dev), sizeof(ecc->perf.name));
+	ecc->perf.show = edma_perf_show;
+	ecc->perf.reset = edma_perf_reset;
+	ecc->perf.data = ecc;
+	legoev3_perf_register(&ecc->perf);
+}
+
+static void edma_exit_debugfs(struct edma_cc *ecc)
+{
+	legoev3_perf_unregister(&ecc->perf);
+	debugfs_remove(ecc->debugfs);
+}
+#else
+static inline void edma_init_debugfs(struct edma_cc *ecc)
+{
+}
+
+static inline void edma_exit_debugfs(struct edma_cc *ecc)
+{
+}
+#endif
+
 static int edma_probe(struct platform_device *pdev)
 {
 	struct edma_soc_info	*info = pdev->dev.platform_data;
@@ -2379,6 +2648,23 @@ static int edma_probe(struct platform_device *pdev)
 		edma_set_chmap(&ecc->slave_chans[i], ecc->dummy_slot);
 	}
 
+	/* Channels with a fixed queue, e.g. to keep them away from bulk I/O */
+	if (info->chan_queue_mapping) {
+		const s16 (*map)[2] = info->chan_queue_mapping;
+
+		for (i = 0; map[i][0] != -1; i++) {
+			if (map[i][0] >= ecc->num_channels ||
+			    map[i][1] >= ecc->num_tc) {
+				dev_warn(dev, "Bad queue %d for channel %d\n",
+					 map[i][1], map[i][0]);
+				continue;
+			}
+			ecc->slave_chans[map[i][0]].eventq = map[i][1];
+			edma_assign_channel_eventq(&ecc->slave_chans[map[i][0]],
+						   map[i][1]);
+		}
+	}
+
 	ecc->dma_slave.filter.map = info->slave_map;
 	ecc->dma_slave.filter.mapcnt = info->slavecnt;
 	ecc->dma_slave.filter.fn = edma_filter_fn;
@@ -2402,6 +2688,8 @@ static int edma_probe(struct platform_device *pdev)
 	if (node)
 		of_dma_controller_register(node, of_edma_xlate, ecc);
 
+	edma_init_debugfs(ecc);
+
 	dev_info(dev, "TI EDMA DMA engine driver\n");
 
 	return 0;
@@ -2427,6 +2715,7 @@ static int edma_remove(struct platform_device *pdev)
 	struct device *dev = &pdev->dev;
 	struct edma_cc *ecc = dev_get_drvdata(dev);
 
+	edma_exit_debugfs(ecc);
 	devm_free_irq(dev, ecc->ccint, ecc);
 	devm_free_irq(dev, ecc->ccerrint, ecc);
 
@@ -2485,6 +2774,9 @@ static int edma_pm_resume(struct device *dev)
 			/* Set up channel -> slot mapping for the entry slot */
 			edma_set_chmap(&echan[i], echan[i].slot[0]);
 		}
+
+		if (echan[i].eventq != EVENTQ_DEFAULT)
+			edma_assign_channel_eventq(&echan[i], echan[i].eventq);
 	}
 
 	return 0;
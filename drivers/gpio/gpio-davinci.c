@@ -24,6 +24,8 @@
 #include <linux/platform_data/gpio-davinci.h>
 #include <linux/irqchip/chained_irq.h>
 
+#include <asm/sram-text.h>
+
 struct davinci_gpio_regs {
 	u32	dir;
 	u32	out_data;
@@ -129,6 +131,44 @@ davinci_gpio_set(struct gpio_chip *chip, unsigned offset, int value)
 		       value ? &g->set_data : &g->clr_data);
 }
 
+/* The 32 bits of a gpiolib bitmap that belong to one register bank */
+static inline u32 davinci_gpio_bank_bits(const unsigned long *map,
+					 unsigned int bank)
+{
+	unsigned int offset = bank * 32;
+
+	return map[BIT_WORD(offset)] >> (offset % BITS_PER_LONG);
+}
+
+/*
+ * Set several output pins at once: in each bank, all the pins going high
+ * change with one SET_DATA write, and all those going low with one
+ * CLR_DATA write.
+ */
+static void
+davinci_gpio_set_multiple(struct gpio_chip *chip, unsigned long *mask,
+			  unsigned long *bits)
+{
+	struct davinci_gpio_controller *d = gpiochip_get_data(chip);
+	struct davinci_gpio_regs __iomem *g;
+	unsigned int bank, nbank = DIV_ROUND_UP(chip->ngpio, 32);
+	u32 bank_mask, set;
+
+	for (bank = 0; bank < nbank; bank++) {
+		bank_mask = davinci_gpio_bank_bits(mask, bank);
+		if (!bank_mask)
+			continue;
+
+		g = d->regs[bank];
+		set = davinci_gpio_bank_bits(bits, bank) & bank_mask;
+
+		if (set)
+			writel_relaxed(set, &g->set_data);
+		if (bank_mask & ~set)
+			writel_relaxed(bank_mask & ~set, &g->clr_data);
+	}
+}
+
 static struct davinci_gpio_platform_data *
 davinci_gpio_get_pdata(struct platform_device *pdev)
 {
@@ -217,6 +257,7 @@ static int davinci_gpio_probe(struct platform_device *pdev)
 	chips->chip.get = davinci_gpio_get;
 	chips->chip.direction_output = davinci_direction_out;
 	chips->chip.set = davinci_gpio_set;
+	chips->chip.set_multiple = davinci_gpio_set_multiple;
 
 	chips->chip.ngpio = ngpio;
 	chips->chip.base = bank_base;
@@ -304,49 +345,37 @@ static struct irq_chip gpio_irqchip = {
 	.flags		= IRQCHIP_SET_TYPE_MASKED,
 };
 
-static void gpio_irq_handler(struct irq_desc *desc)
+static void __sramfunc gpio_irq_handler(struct irq_desc *desc)
 {
 	struct davinci_gpio_regs __iomem *g;
-	u32 mask = 0xffff;
-	int bank_num;
-	struct davinci_gpio_controller *d;
 	struct davinci_gpio_irq_data *irqdata;
+	unsigned int shift;
 
 	irqdata = (struct davinci_gpio_irq_data *)irq_desc_get_handler_data(desc);
-	bank_num = irqdata->bank_num;
 	g = irqdata->regs;
-	d = irqdata->chip;
 
-	/* we only care about one bank */
-	if ((bank_num % 2) == 1)
-		mask <<= 16;
+	/* we only care about one bank, the odd ones are the upper half */
+	shift = (irqdata->bank_num % 2) * 16;
 
 	/* temporarily mask (level sensitive) parent IRQ */
 	chained_irq_enter(irq_desc_get_chip(desc), desc);
 	while (1) {
-		u32		status;
-		int		bit;
-		irq_hw_number_t hw_irq;
+		u32 status;
 
-		/* ack any irqs */
-		status = readl_relaxed(&g->intstat) & mask;
+		/* one status read per pass, all its irqs acked at once */
+		status = (readl_relaxed(&g->intstat) >> shift) & 0xffff;
 		if (!status)
 			break;
-		writel_relaxed(status, &g->intstat);
+		writel_relaxed(status << shift, &g->intstat);
 
-		/* now demux them to the right lowlevel handler */
-
-		while (status) {
-			bit = __ffs(status);
-			status &= ~BIT(bit);
-			/* Max number of gpios per controller is 144 so
-			 * hw_irq will be in [0..143]
-			 */
-			hw_irq = (bank_num / 2) * 32 + bit;
-
-			generic_handle_irq(
-				irq_find_mapping(d->irq_domain, hw_irq));
-		}
+		/*
+		 * Now demux them to the right lowlevel handler, the IRQs
+		 * were looked up in the domain when the bank was set up.
+		 */
+		do {
+			generic_handle_irq(irqdata->irqs[__ffs(status)]);
+			status &= status - 1;
+		} while (status);
 	}
 	chained_irq_exit(irq_desc_get_chip(desc), desc);
 	/* now it may re-trigger */
@@ -449,7 +478,7 @@ static const struct of_device_id davinci_gpio_ids[];
 static int davinci_gpio_irq_setup(struct platform_device *pdev)
 {
 	unsigned	gpio, bank;
-	int		irq;
+	int		irq, i;
 	int		ret;
 	struct clk	*clk;
 	u32		binten = 0;
@@ -588,6 +617,11 @@ static int davinci_gpio_irq_setup(struct platform_device *pdev)
 		irqdata->bank_num = bank;
 		irqdata->chip = chips;
 
+		/* the legacy domain maps all its GPIOs up front */
+		for (i = 0; i < 16 && gpio + i < ngpio; i++)
+			irqdata->irqs[i] = irq_find_mapping(irq_domain,
+							    gpio + i);
+
 		irq_set_chained_handler_and_data(bank_irq, gpio_irq_handler,
 						 irqdata);
 
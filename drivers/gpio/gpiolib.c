@@ -580,6 +580,7 @@ static int linehandle_create(struct gpio_device *gdev, void __user *ip)
  * @events: KFIFO for the GPIO events
  * @read_lock: mutex lock to protect reads from colliding with adding
  * new events to the FIFO
+ * @timestamp: time of the last interrupt, taken in hard IRQ context
  */
 struct lineevent_state {
 	struct gpio_device *gdev;
@@ -588,8 +589,9 @@ struct lineevent_state {
 	u32 eflags;
 	int irq;
 	wait_queue_head_t wait;
-	DECLARE_KFIFO(events, struct gpioevent_data, 16);
+	DECLARE_KFIFO(events, struct gpioevent_data, 64);
 	struct mutex read_lock;
+	u64 timestamp;
 };
 
 #define GPIOEVENT_REQUEST_VALID_FLAGS \
@@ -718,17 +720,17 @@ static const struct file_operations lineevent_fileops = {
 #endif
 };
 
-static irqreturn_t lineevent_irq_thread(int irq, void *p)
+static irqreturn_t lineevent_emit(struct lineevent_state *le, int level)
 {
-	struct lineevent_state *le = p;
 	struct gpioevent_data ge;
-	int ret, level;
+	int ret;
 
 	/* Do not leak kernel stack to userspace */
 	memset(&ge, 0, sizeof(ge));
 
-	ge.timestamp = ktime_get_real_ns();
-	level = gpiod_get_value_cansleep(le->desc);
+	/* nested threaded IRQs never run lineevent_irq_handler() */
+	ge.timestamp = le->timestamp ?: ktime_get_real_ns();
+	le->timestamp = 0;
 
 	if (le->eflags & GPIOEVENT_REQUEST_RISING_EDGE
 	    && le->eflags & GPIOEVENT_REQUEST_FALLING_EDGE) {
@@ -755,6 +757,31 @@ static irqreturn_t lineevent_irq_thread(int irq, void *p)
 	return IRQ_HANDLED;
 }
 
+static irqreturn_t lineevent_irq_thread(int irq, void *p)
+{
+	struct lineevent_state *le = p;
+
+	return lineevent_emit(le, gpiod_get_value_cansleep(le->desc));
+}
+
+/*
+ * Timestamp the edge as soon as it is seen, from the clocksource. Lines of
+ * chips that can be read without sleeping have their event queued right
+ * away too, so neither the time nor the level depends on when the IRQ
+ * thread gets scheduled.
+ */
+static irqreturn_t lineevent_irq_handler(int irq, void *p)
+{
+	struct lineevent_state *le = p;
+
+	le->timestamp = ktime_get_real_ns();
+
+	if (gpiod_cansleep(le->desc))
+		return IRQ_WAKE_THREAD;
+
+	return lineevent_emit(le, gpiod_get_value(le->desc));
+}
+
 static int lineevent_create(struct gpio_device *gdev, void __user *ip)
 {
 	struct gpioevent_request eventreq;
@@ -845,9 +872,9 @@ static int lineevent_create(struct gpio_device *gdev, void __user *ip)
 	init_waitqueue_head(&le->wait);
 	mutex_init(&le->read_lock);
 
-	/* Request a thread to read the events */
+	/* Lines on sleeping chips need a thread to read the events */
 	ret = request_threaded_irq(le->irq,
-			NULL,
+			lineevent_irq_handler,
 			lineevent_irq_thread,
 			irqflags,
 			le->label,
@@ -24,6 +24,7 @@
 #include <linux/completion.h>
 #include <linux/dma-mapping.h>
 #include <linux/of_graph.h>
+#include <linux/log2.h>
 #include <linux/math64.h>
 
 #include "tilcdc_drv.h"
@@ -32,6 +33,27 @@
 #define TILCDC_VBLANK_SAFETY_THRESHOLD_US	1000
 #define TILCDC_PALETTE_SIZE			32
 #define TILCDC_PALETTE_FIRST_ENTRY		0x4000
+#define TILCDC_FIFO_TH_MAX			6
+
+/*
+ * The LCDC competes with EDMA for DDR bandwidth, and with the panel's DMA
+ * settings the FIFO may underflow at high pixel clocks. These override them
+ * for modes with a pixel clock of at least dma_tune_min_clock.
+ */
+static unsigned int dma_burst_sz;
+module_param(dma_burst_sz, uint, 0644);
+MODULE_PARM_DESC(dma_burst_sz,
+		 "DMA burst size in words: 1, 2, 4, 8 or 16 (0 = panel default)");
+
+static int fifo_th = -1;
+module_param(fifo_th, int, 0644);
+MODULE_PARM_DESC(fifo_th,
+		 "DMA FIFO threshold, 0 (8 words) to 6 (512 words) (-1 = panel default)");
+
+static unsigned int dma_tune_min_clock;
+module_param(dma_tune_min_clock, uint, 0644);
+MODULE_PARM_DESC(dma_tune_min_clock,
+		 "Min pixel clock in kHz of the modes dma_burst_sz and fifo_th apply to");
 
 struct tilcdc_crtc {
 	struct drm_crtc base;
@@ -62,6 +84,7 @@ struct tilcdc_crtc {
 
 	int sync_lost_count;
 	bool frame_intact;
+	unsigned int underflow_count;
 	struct work_struct recover_work;
 
 	dma_addr_t palette_dma_handle;
@@ -309,6 +332,8 @@ static void tilcdc_crtc_set_mode(struct drm_crtc *crtc)
 	uint32_t reg, hbp, hfp, hsw, vbp, vfp, vsw;
 	struct drm_display_mode *mode = &crtc->state->adjusted_mode;
 	struct drm_framebuffer *fb = crtc->primary->state->fb;
+	uint32_t burst_sz, fifo_thr, burst;
+	int th;
 
 	if (WARN_ON(!info))
 		return;
@@ -316,9 +341,26 @@ static void tilcdc_crtc_set_mode(struct drm_crtc *crtc)
 	if (WARN_ON(!fb))
 		return;
 
+	burst_sz = info->dma_burst_sz;
+	fifo_thr = info->fifo_th;
+	if (mode->clock >= dma_tune_min_clock) {
+		burst = READ_ONCE(dma_burst_sz);
+		th = READ_ONCE(fifo_th);
+		if (burst > 16 || (burst && !is_power_of_2(burst)))
+			dev_warn(dev->dev, "invalid burst size %u\n", burst);
+		else if (burst)
+			burst_sz = burst;
+		if (th > TILCDC_FIFO_TH_MAX)
+			dev_warn(dev->dev, "invalid fifo threshold %d\n", th);
+		else if (th >= 0)
+			fifo_thr = th;
+	}
+
+	DBG("burst size %u, fifo threshold %u", burst_sz, fifo_thr);
+
 	/* Configure the Burst Size and fifo threshold of DMA: */
 	reg = tilcdc_read(dev, LCDC_DMA_CTRL_REG) & ~0x00000770;
-	switch (info->dma_burst_sz) {
+	switch (burst_sz) {
 	case 1:
 		reg |= LCDC_DMA_BURST_SIZE(LCDC_DMA_BURST_1);
 		break;
@@ -338,7 +380,7 @@ static void tilcdc_crtc_set_mode(struct drm_crtc *crtc)
 		dev_err(dev->dev, "invalid burst size\n");
 		return;
 	}
-	reg |= (info->fifo_th << 8);
+	reg |= (fifo_thr << 8);
 	tilcdc_write(dev, LCDC_DMA_CTRL_REG, reg);
 
 	/* Configure timings: */
@@ -897,6 +939,12 @@ void tilcdc_crtc_update_clk(struct drm_crtc *crtc)
 
 #define SYNC_LOST_COUNT_LIMIT 50
 
+/* Number of FIFO underflows since the crtc was created */
+unsigned int tilcdc_crtc_underflow_count(struct drm_crtc *crtc)
+{
+	return READ_ONCE(to_tilcdc_crtc(crtc)->underflow_count);
+}
+
 irqreturn_t tilcdc_crtc_irq(struct drm_crtc *crtc)
 {
 	struct tilcdc_crtc *tilcdc_crtc = to_tilcdc_crtc(crtc);
@@ -949,9 +997,11 @@ irqreturn_t tilcdc_crtc_irq(struct drm_crtc *crtc)
 			tilcdc_crtc->frame_intact = true;
 	}
 
-	if (stat & LCDC_FIFO_UNDERFLOW)
+	if (stat & LCDC_FIFO_UNDERFLOW) {
+		tilcdc_crtc->underflow_count++;
 		dev_err_ratelimited(dev->dev, "%s(0x%08x): FIFO underflow",
 				    __func__, stat);
+	}
 
 	if (stat & LCDC_PL_LOAD_DONE) {
 		complete(&tilcdc_crtc->palette_loaded);
@@ -503,8 +503,20 @@ static int tilcdc_mm_show(struct seq_file *m, void *arg)
 	return 0;
 }
 
+static int tilcdc_underflow_show(struct seq_file *m, void *arg)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct tilcdc_drm_private *priv = dev->dev_private;
+
+	seq_printf(m, "%u\n", tilcdc_crtc_underflow_count(priv->crtc));
+
+	return 0;
+}
+
 static struct drm_info_list tilcdc_debugfs_list[] = {
 		{ "regs", tilcdc_regs_show, 0 },
+		{ "underflow", tilcdc_underflow_show, 0 },
 		{ "mm",   tilcdc_mm_show,   0 },
 		{ "fb",   drm_fb_cma_debugfs_show, 0 },
 };
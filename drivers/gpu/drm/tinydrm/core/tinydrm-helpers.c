@@ -429,6 +429,42 @@ void _tinydrm_dbg_spi_message(struct spi_device *spi, struct spi_message *m)
 }
 EXPORT_SYMBOL(_tinydrm_dbg_spi_message);
 
+/*
+ * Queues all the chunks in one message, so the SPI core maps the whole buffer
+ * at once and the master can DMA it back to back.
+ */
+static int tinydrm_spi_transfer_one_msg(struct spi_device *spi, u32 speed_hz,
+					u8 bpw, const void *buf, size_t len,
+					size_t max_chunk)
+{
+	unsigned int i, num = DIV_ROUND_UP(len, max_chunk);
+	struct spi_transfer *tr;
+	struct spi_message m;
+	int ret;
+
+	tr = kcalloc(num, sizeof(*tr), GFP_KERNEL);
+	if (!tr)
+		return -ENOMEM;
+
+	spi_message_init(&m);
+	for (i = 0; i < num; i++) {
+		tr[i].tx_buf = buf;
+		tr[i].len = min(len, max_chunk);
+		tr[i].bits_per_word = bpw;
+		tr[i].speed_hz = speed_hz;
+		spi_message_add_tail(&tr[i], &m);
+
+		buf += tr[i].len;
+		len -= tr[i].len;
+	}
+
+	tinydrm_dbg_spi_message(spi, &m);
+	ret = spi_sync(spi, &m);
+	kfree(tr);
+
+	return ret;
+}
+
 /**
  * tinydrm_spi_transfer - SPI transfer helper
  * @spi: SPI device
@@ -443,6 +479,7 @@ EXPORT_SYMBOL(_tinydrm_dbg_spi_message);
  * SPI master driver doesn't support 16 bits per word, it swaps the bytes and
  * does a 8-bit transfer.
  * If @header is set, it is prepended to each SPI message.
+ * Without @header and byte swapping, all the chunks go in a single message.
  *
  * Returns:
  * Zero on success, negative error code on failure.
@@ -479,6 +516,11 @@ int tinydrm_spi_transfer(struct spi_device *spi, u32 speed_hz,
 		}
 	}
 
+	if (!header && !swap_buf && len > max_chunk)
+		return tinydrm_spi_transfer_one_msg(spi, speed_hz,
+						    tr.bits_per_word, buf, len,
+						    max_chunk);
+
 	spi_message_init(&m);
 	if (header)
 		spi_message_add_tail(header, &m);
@@ -9,12 +9,20 @@
  * (at your option) any later version.
  */
 
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/gpio/consumer.h>
+#include <linux/legoev3_perf.h>
 #include <linux/module.h>
 #include <linux/property.h>
+#include <linux/seq_file.h>
 #include <linux/spi/spi.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <video/mipi_display.h>
 
 #include <drm/tinydrm/mipi-dbi.h>
@@ -56,34 +64,273 @@
 
 static const u8 st7586_lookup[] = { 0x7, 0x4, 0x2, 0x0 };
 
-static void st7586_xrgb8888_to_gray332(u8 *dst, void *vaddr,
-				       struct drm_framebuffer *fb,
-				       struct drm_clip_rect *clip)
+static unsigned int max_fps = 30;
+module_param(max_fps, uint, 0644);
+MODULE_PARM_DESC(max_fps, "Max display updates per second (0 = unlimited)");
+
+/*
+ * Reading the write-combined framebuffer is slow on the CPU, so the packed
+ * framebuffer is copied by a DMA memcpy channel when there is one. Below this
+ * size, setting up the transfer and taking its interrupt costs more than it
+ * saves.
+ */
+static unsigned int dma_copy_min = 2048;
+module_param(dma_copy_min, uint, 0644);
+MODULE_PARM_DESC(dma_copy_min,
+		 "Min bytes copied from the framebuffer by DMA (0 = never)");
+
+#define ST7586_DMA_COPY_TIMEOUT_MS	100
+
+/* Smaller writes are not worth going asynchronous */
+#define ST7586_ASYNC_MIN_LEN	64
+
+/* Bucket 0 is below 1 us, bucket n from 2^(n - 1) us on */
+#define ST7586_STATS_BUCKETS	16
+
+/**
+ * struct st7586_stats - display update statistics, shown in debugfs
+ * @start: when counting started
+ * @flushes: updates that reached the panel
+ * @regions: windows written, more than @flushes when damage is split
+ * @bytes: pixel data bytes sent
+ * @unchanged: regions that matched the panel and were not sent
+ * @merged: updates held back by max_fps and merged into a later flush
+ * @dropped: updates ignored because the pipe was off or showed another
+ *	framebuffer
+ * @convert: time spent in st7586_buf_copy()
+ * @xfer: time from starting a memory write until it completed
+ */
+struct st7586_stats {
+	ktime_t start;
+	u64 flushes;
+	u64 regions;
+	u64 bytes;
+	u64 unchanged;
+	u64 merged;
+	u64 dropped;
+	u32 convert[ST7586_STATS_BUCKETS];
+	u32 xfer[ST7586_STATS_BUCKETS];
+};
+
+/**
+ * struct st7586_device - ST7586 panel
+ * @mipi: MIPI DBI device, its tx_buf is the first of the two flush buffers
+ * @line_buf: one framebuffer line, 4 bytes per pixel at most
+ * @tx_buf: the flush buffers, used in turn so that the next region can be
+ *	converted while the previous one is still being sent
+ * @cur: index in @tx_buf of the buffer to convert into next
+ * @command: the mipi_dbi command function, called once any pending memory
+ *	write has completed
+ * @msg: SPI message of the memory write in flight
+ * @xfers: transfers of @msg, one per SPI max transfer size chunk
+ * @done: completed when @msg has been sent
+ * @busy: @msg has been submitted and not waited for yet
+ * @error: first error of an asynchronous memory write, reported at the next
+ *	flush
+ * @flush_work: flushes @damage once the max_fps interval has passed
+ * @damage: bounding box of the damage held back since the last flush
+ * @damaged: @damage is valid
+ * @last_flush: jiffies of the last flush
+ * @copy_chan: DMA memcpy channel for packed framebuffer copies, or NULL
+ * @copy_done: completed when a DMA copy has finished
+ * @shadow: what the panel shows, in its own format
+ * @shadow_pitch: bytes per line of @shadow
+ * @shadow_valid: all of @shadow matches the panel
+ * @xfer_start: when the memory write in flight was started
+ * @xfer_end: when it completed
+ * @stats: update statistics
+ * @stats_lock: protects @stats
+ * @perf: @stats on the EV3 performance dashboard
+ *
+ * @busy, @error, @xfer_start, @xfer_end and the D/C line are protected by
+ * &mipi_dbi->cmdlock.
+ * @damage, @damaged, @last_flush and the @shadow fields are protected by
+ * &tinydrm_device->dirty_lock.
+ */
+struct st7586_device {
+	struct mipi_dbi mipi;
+	void *line_buf;
+	void *tx_buf[2];
+	unsigned int cur;
+	int (*command)(struct mipi_dbi *mipi, u8 cmd, u8 *param, size_t num);
+	struct spi_message msg;
+	struct spi_transfer *xfers;
+	struct completion done;
+	bool busy;
+	int error;
+	struct delayed_work flush_work;
+	struct drm_clip_rect damage;
+	bool damaged;
+	unsigned long last_flush;
+	struct dma_chan *copy_chan;
+	struct completion copy_done;
+	u8 *shadow;
+	unsigned int shadow_pitch;
+	bool shadow_valid;
+	ktime_t xfer_start;
+	ktime_t xfer_end;
+	struct st7586_stats stats;
+	spinlock_t stats_lock;
+	struct legoev3_perf_source perf;
+};
+
+static inline struct st7586_device *mipi_to_st7586(struct mipi_dbi *mipi)
 {
-	size_t len = (clip->x2 - clip->x1) * (clip->y2 - clip->y1);
-	unsigned int x, y;
-	u8 *src, *buf, val;
+	return container_of(mipi, struct st7586_device, mipi);
+}
 
-	buf = kmalloc(len, GFP_KERNEL);
-	if (!buf)
-		return;
+/* Counts a duration of whatever started at @start and ended at @end */
+static void st7586_stats_time(struct st7586_device *st7586, u32 *hist,
+			      ktime_t start, ktime_t end)
+{
+	s64 us = ktime_us_delta(end, start);
+	unsigned int i = us > 0 ? ilog2(us) + 1 : 0;
+
+	spin_lock(&st7586->stats_lock);
+	hist[min(i, ST7586_STATS_BUCKETS - 1)]++;
+	spin_unlock(&st7586->stats_lock);
+}
+
+#define st7586_stats_add(st7586, field, val)		\
+do {							\
+	spin_lock(&(st7586)->stats_lock);		\
+	(st7586)->stats.field += (val);			\
+	spin_unlock(&(st7586)->stats_lock);		\
+} while (0)
+
+/* Returns the 3-bit panel value of pixel @x of a line */
+static inline u8 st7586_pixel(const void *line, unsigned int x,
+			      unsigned int w, unsigned int cpp)
+{
+	unsigned int gray;
+	u32 pix;
+
+	/* the last byte of a line can reach past the framebuffer */
+	if (x >= w)
+		return st7586_lookup[3];
+
+	if (cpp == 1) {
+		gray = ((const u8 *)line)[x];
+	} else {
+		pix = ((const u32 *)line)[x];
+		/* ITU BT.601: Y = 0.299 R + 0.587 G + 0.114 B */
+		gray = (3 * ((pix >> 16) & 0xff) + 6 * ((pix >> 8) & 0xff) +
+			(pix & 0xff)) / 10;
+	}
+
+	return st7586_lookup[gray >> 6];
+}
 
-	tinydrm_xrgb8888_to_gray8(buf, vaddr, fb, clip);
-	src = buf;
+/*
+ * Converts XRGB8888 or R8 straight into the packed panel format, one line at
+ * a time. The clip must be aligned to multiples of 3 pixels.
+ */
+static void st7586_fb_to_gray332(u8 *dst, void *line, void *vaddr,
+				 struct drm_framebuffer *fb,
+				 struct drm_clip_rect *clip)
+{
+	unsigned int cpp = fb->format->cpp[0];
+	unsigned int w = min(clip->x2, fb->width) - clip->x1;
+	unsigned int x, y;
+	u8 val;
 
 	for (y = clip->y1; y < clip->y2; y++) {
-		for (x = clip->x1; x < clip->x2; x += 3) {
-			val = st7586_lookup[*src++ >> 6] << 5;
-			val |= st7586_lookup[*src++ >> 6] << 2;
-			val |= st7586_lookup[*src++ >> 6] >> 1;
+		/*
+		 * The cma memory is write-combined so reads are uncached.
+		 * Speed up by fetching one line at a time.
+		 */
+		memcpy(line, vaddr + y * fb->pitches[0] + clip->x1 * cpp,
+		       w * cpp);
+
+		for (x = 0; x < clip->x2 - clip->x1; x += 3) {
+			val = st7586_pixel(line, x, w, cpp) << 5;
+			val |= st7586_pixel(line, x + 1, w, cpp) << 2;
+			val |= st7586_pixel(line, x + 2, w, cpp) >> 1;
 			*dst++ = val;
 		}
 	}
+}
+
+/* The framebuffer is already in the panel format, only the rows are copied */
+static void st7586_packed_copy(u8 *dst, void *vaddr, struct drm_framebuffer *fb,
+			       struct drm_clip_rect *clip)
+{
+	unsigned int len = (clip->x2 - clip->x1) / 3;
+	unsigned int y;
+
+	for (y = clip->y1; y < clip->y2; y++) {
+		memcpy(dst, vaddr + y * fb->pitches[0] + clip->x1 / 3, len);
+		dst += len;
+	}
+}
+
+static void st7586_dma_copy_complete(void *param)
+{
+	struct st7586_device *st7586 = param;
+
+	complete(&st7586->copy_done);
+}
+
+/*
+ * Copies a packed clip that is contiguous in the framebuffer with the DMA
+ * memcpy channel. Returns a negative error code when the CPU should copy it
+ * instead.
+ */
+static int st7586_dma_copy(struct st7586_device *st7586, u8 *dst,
+			   struct drm_gem_cma_object *cma_obj,
+			   struct drm_framebuffer *fb,
+			   struct drm_clip_rect *clip)
+{
+	struct dma_chan *chan = st7586->copy_chan;
+	unsigned long timeout = msecs_to_jiffies(ST7586_DMA_COPY_TIMEOUT_MS);
+	unsigned int len = (clip->x2 - clip->x1) / 3;
+	size_t size = len * (clip->y2 - clip->y1);
+	struct dma_async_tx_descriptor *desc;
+	struct device *dma_dev;
+	dma_addr_t src, addr;
+	int ret = 0;
+
+	if (!chan || !dma_copy_min || size < dma_copy_min)
+		return -EINVAL;
+	/* one transfer with one interrupt, so rows must follow each other */
+	if (len != fb->pitches[0] && clip->y2 - clip->y1 > 1)
+		return -EINVAL;
+
+	dma_dev = chan->device->dev;
+	addr = dma_map_single(dma_dev, dst, size, DMA_FROM_DEVICE);
+	if (dma_mapping_error(dma_dev, addr))
+		return -ENOMEM;
+
+	src = cma_obj->paddr + fb->offsets[0] + clip->y1 * fb->pitches[0] +
+	      clip->x1 / 3;
+	desc = dmaengine_prep_dma_memcpy(chan, addr, src, size,
+					 DMA_PREP_INTERRUPT);
+	if (!desc) {
+		ret = -ENOMEM;
+		goto out_unmap;
+	}
 
-	kfree(buf);
+	reinit_completion(&st7586->copy_done);
+	desc->callback = st7586_dma_copy_complete;
+	desc->callback_param = st7586;
+	ret = dma_submit_error(dmaengine_submit(desc));
+	if (ret)
+		goto out_unmap;
+
+	dma_async_issue_pending(chan);
+	if (!wait_for_completion_timeout(&st7586->copy_done, timeout)) {
+		dmaengine_terminate_sync(chan);
+		ret = -ETIMEDOUT;
+	}
+
+out_unmap:
+	dma_unmap_single(dma_dev, addr, size, DMA_FROM_DEVICE);
+
+	return ret;
 }
 
-static int st7586_buf_copy(void *dst, struct drm_framebuffer *fb,
+static int st7586_buf_copy(struct mipi_dbi *mipi, void *dst,
+			   struct drm_framebuffer *fb,
 			   struct drm_clip_rect *clip)
 {
 	struct drm_gem_cma_object *cma_obj = drm_fb_cma_get_gem_obj(fb, 0);
@@ -98,7 +345,15 @@ static int st7586_buf_copy(void *dst, struct drm_framebuffer *fb,
 			return ret;
 	}
 
-	st7586_xrgb8888_to_gray332(dst, src, fb, clip);
+	if (fb->modifier == DRM_FORMAT_MOD_SITRONIX_ST7586_PACKED) {
+		/* imported buffers have no address of ours to copy from */
+		if (import_attach ||
+		    st7586_dma_copy(mipi_to_st7586(mipi), dst, cma_obj, fb,
+				    clip))
+			st7586_packed_copy(dst, src, fb, clip);
+	} else
+		st7586_fb_to_gray332(dst, mipi_to_st7586(mipi)->line_buf, src,
+				     fb, clip);
 
 	if (import_attach)
 		ret = dma_buf_end_cpu_access(import_attach->dmabuf,
@@ -107,6 +362,350 @@ static int st7586_buf_copy(void *dst, struct drm_framebuffer *fb,
 	return ret;
 }
 
+/*
+ * Each flushed region needs its own column and page address window, which
+ * takes three commands and a handful of short SPI messages. Setting up a
+ * message costs about as much as sending a few dozen bytes, so a window is
+ * counted as this many bytes when deciding whether to merge regions.
+ */
+#define ST7586_WINDOW_COST	64
+
+/* Above this many regions, merging is assumed to win */
+#define ST7586_MAX_REGIONS	8
+
+/* 3 pixels per byte, so grow clip to nearest multiple of 3 */
+static void st7586_align_clip(struct drm_clip_rect *clip)
+{
+	clip->x1 = rounddown(clip->x1, 3);
+	clip->x2 = roundup(clip->x2, 3);
+}
+
+static unsigned int st7586_clip_cost(const struct drm_clip_rect *clip)
+{
+	return (clip->x2 - clip->x1) / 3 * (clip->y2 - clip->y1) +
+	       ST7586_WINDOW_COST;
+}
+
+/*
+ * Damage often covers much more than what changed: fbdev deferred I/O only
+ * knows which pages were written and reports whole lines from the first to
+ * the last of them, and fbcon redraws lines that look the same. Compares the
+ * converted clip in @buf with the panel contents and shrinks it to the lines
+ * and columns that differ, moving the data to the start of @buf. Returns false
+ * if nothing changed at all.
+ */
+static bool st7586_trim_clip(struct st7586_device *st7586, u8 *buf,
+			     struct drm_clip_rect *clip)
+{
+	struct drm_mode_config *config = &st7586->mipi.tinydrm.drm->mode_config;
+	unsigned int len = (clip->x2 - clip->x1) / 3;
+	unsigned int first = len, last = 0, y1 = clip->y2, y2 = clip->y1;
+	unsigned int x, y, width;
+	u8 *row, *old;
+
+	for (y = clip->y1; y < clip->y2; y++) {
+		row = buf + (y - clip->y1) * len;
+		old = st7586->shadow + y * st7586->shadow_pitch + clip->x1 / 3;
+
+		if (st7586->shadow_valid && !memcmp(row, old, len))
+			continue;
+
+		y1 = min(y1, y);
+		y2 = y + 1;
+
+		for (x = 0; x < first && row[x] == old[x]; x++)
+			;
+		first = min(first, x);
+		for (x = len - 1; x > last && row[x] == old[x]; x--)
+			;
+		last = max(last, x);
+
+		memcpy(old, row, len);
+	}
+
+	if (!st7586->shadow_valid) {
+		/* the shadow is only of use once the whole panel was written */
+		st7586->shadow_valid = clip->x1 == 0 && clip->y1 == 0 &&
+				       clip->x2 >= config->max_width &&
+				       clip->y2 >= config->max_height;
+		return true;
+	}
+
+	if (y1 >= y2)
+		return false;
+
+	width = last - first + 1;
+	if (width != len || y1 != clip->y1) {
+		for (y = y1; y < y2; y++)
+			memmove(buf + (y - y1) * width,
+				buf + (y - clip->y1) * len + first, width);
+	}
+
+	clip->x1 += first * 3;
+	clip->x2 = clip->x1 + width * 3;
+	clip->y1 = y1;
+	clip->y2 = y2;
+
+	return true;
+}
+
+static void st7586_write_complete(void *context)
+{
+	struct st7586_device *st7586 = context;
+
+	st7586->xfer_end = ktime_get();
+	complete(&st7586->done);
+}
+
+/* Waits for the memory write in flight, with &mipi_dbi->cmdlock held */
+static void st7586_wait_write(struct st7586_device *st7586)
+{
+	if (!st7586->busy)
+		return;
+
+	wait_for_completion(&st7586->done);
+	st7586->busy = false;
+	st7586_stats_time(st7586, st7586->stats.xfer, st7586->xfer_start,
+			  st7586->xfer_end);
+	if (st7586->msg.status && !st7586->error)
+		st7586->error = st7586->msg.status;
+}
+
+/*
+ * Every command, including the ones sent through debugfs, first lets a
+ * pending memory write finish so that the D/C line is not switched under it.
+ */
+static int st7586_command(struct mipi_dbi *mipi, u8 cmd, u8 *param,
+			  size_t num)
+{
+	struct st7586_device *st7586 = mipi_to_st7586(mipi);
+
+	st7586_wait_write(st7586);
+
+	return st7586->command(mipi, cmd, param, num);
+}
+
+/*
+ * Sends the command byte like any other command, then submits the pixel data
+ * with spi_async() so that the caller can prepare the next region meanwhile.
+ */
+static int st7586_write_memory(struct st7586_device *st7586, u8 *buf,
+			       size_t len)
+{
+	struct mipi_dbi *mipi = &st7586->mipi;
+	struct spi_device *spi = mipi->spi;
+	size_t max_chunk = tinydrm_spi_max_transfer_size(spi, 0);
+	struct spi_transfer *tr = st7586->xfers;
+	ktime_t start;
+	int ret;
+
+	if (len <= ST7586_ASYNC_MIN_LEN) {
+		start = ktime_get();
+		ret = mipi_dbi_command_buf(mipi, MIPI_DCS_WRITE_MEMORY_START,
+					   buf, len);
+		st7586_stats_time(st7586, st7586->stats.xfer, start,
+				  ktime_get());
+		return ret;
+	}
+
+	mutex_lock(&mipi->cmdlock);
+
+	st7586->xfer_start = ktime_get();
+
+	ret = mipi->command(mipi, MIPI_DCS_WRITE_MEMORY_START, NULL, 0);
+	if (ret)
+		goto out_unlock;
+
+	gpiod_set_value_cansleep(mipi->dc, 1);
+
+	spi_message_init(&st7586->msg);
+	st7586->msg.complete = st7586_write_complete;
+	st7586->msg.context = st7586;
+
+	while (len) {
+		memset(tr, 0, sizeof(*tr));
+		tr->tx_buf = buf;
+		tr->len = min(len, max_chunk);
+		tr->bits_per_word = 8;
+		spi_message_add_tail(tr, &st7586->msg);
+
+		buf += tr->len;
+		len -= tr->len;
+		tr++;
+	}
+
+	reinit_completion(&st7586->done);
+	ret = spi_async(spi, &st7586->msg);
+	if (!ret)
+		st7586->busy = true;
+
+out_unlock:
+	mutex_unlock(&mipi->cmdlock);
+
+	return ret;
+}
+
+static int st7586_flush_clip(struct mipi_dbi *mipi, struct drm_framebuffer *fb,
+			     struct drm_clip_rect *clip)
+{
+	struct st7586_device *st7586 = mipi_to_st7586(mipi);
+	u8 *buf = st7586->tx_buf[st7586->cur];
+	ktime_t copy_start;
+	int start, end;
+	int ret;
+
+	DRM_DEBUG("Flushing [FB:%d] x1=%u, x2=%u, y1=%u, y2=%u\n", fb->base.id,
+		  clip->x1, clip->x2, clip->y1, clip->y2);
+
+	/* the other buffer may still be on its way to the panel */
+	copy_start = ktime_get();
+	ret = st7586_buf_copy(mipi, buf, fb, clip);
+	st7586_stats_time(st7586, st7586->stats.convert, copy_start,
+			  ktime_get());
+	if (ret)
+		return ret;
+
+	mutex_lock(&mipi->cmdlock);
+	st7586_wait_write(st7586);
+	ret = st7586->error;
+	st7586->error = 0;
+	mutex_unlock(&mipi->cmdlock);
+	if (ret) {
+		st7586->shadow_valid = false;
+		return ret;
+	}
+
+	/* not a byte to send for this clip */
+	if (!st7586_trim_clip(st7586, buf, clip)) {
+		st7586_stats_add(st7586, unchanged, 1);
+		return 0;
+	}
+
+	st7586->cur ^= 1;
+
+	/* Pixels are packed 3 per byte */
+	start = clip->x1 / 3;
+	end = clip->x2 / 3;
+
+	mipi_dbi_command(mipi, MIPI_DCS_SET_COLUMN_ADDRESS,
+			 (start >> 8) & 0xFF, start & 0xFF,
+			 (end >> 8) & 0xFF, (end - 1) & 0xFF);
+	mipi_dbi_command(mipi, MIPI_DCS_SET_PAGE_ADDRESS,
+			 (clip->y1 >> 8) & 0xFF, clip->y1 & 0xFF,
+			 (clip->y2 >> 8) & 0xFF, (clip->y2 - 1) & 0xFF);
+
+	ret = st7586_write_memory(st7586, buf,
+				  (end - start) * (clip->y2 - clip->y1));
+	if (ret) {
+		st7586->shadow_valid = false;
+	} else {
+		st7586_stats_add(st7586, regions, 1);
+		st7586_stats_add(st7586, bytes,
+				 (end - start) * (clip->y2 - clip->y1));
+	}
+
+	return ret;
+}
+
+/*
+ * Collects the damaged regions into @regions and returns how many there are,
+ * or 0 if a single window around all of them is cheaper or the clips can't be
+ * used as they are.
+ */
+static unsigned int st7586_split_clips(struct drm_clip_rect *regions,
+				       const struct drm_clip_rect *merged,
+				       struct drm_clip_rect *clips,
+				       unsigned int num_clips,
+				       unsigned int flags,
+				       struct drm_framebuffer *fb)
+{
+	unsigned int i, n = 0, step = 1, cost = 0;
+
+	if (!clips)
+		return 0;
+
+	/* copies come as (src, dst) pairs and only dst is damaged */
+	if (flags & DRM_MODE_FB_DIRTY_ANNOTATE_COPY)
+		step = 2;
+
+	if (num_clips / step < 2 || num_clips / step > ST7586_MAX_REGIONS)
+		return 0;
+
+	for (i = step - 1; i < num_clips; i += step) {
+		struct drm_clip_rect *clip = &regions[n++];
+
+		*clip = clips[i];
+		if (clip->x2 > fb->width || clip->y2 > fb->height ||
+		    clip->x1 >= clip->x2 || clip->y1 >= clip->y2)
+			return 0;
+
+		st7586_align_clip(clip);
+		cost += st7586_clip_cost(clip);
+	}
+
+	return cost < st7586_clip_cost(merged) ? n : 0;
+}
+
+static unsigned long st7586_flush_interval(void)
+{
+	unsigned int fps = READ_ONCE(max_fps);
+
+	return fps ? DIV_ROUND_UP(HZ, fps) : 0;
+}
+
+/* Called with &tinydrm_device->dirty_lock held */
+static void st7586_hold_damage(struct st7586_device *st7586,
+			       struct drm_clip_rect *clip)
+{
+	struct drm_clip_rect clips[2] = { st7586->damage, *clip };
+	struct drm_framebuffer *fb = st7586->mipi.tinydrm.pipe.plane.fb;
+	unsigned long next = st7586->last_flush + st7586_flush_interval();
+
+	st7586_stats_add(st7586, merged, 1);
+
+	if (st7586->damaged)
+		tinydrm_merge_clips(&st7586->damage, clips, 2, 0, fb->width,
+				    fb->height);
+	else
+		st7586->damage = *clip;
+	st7586->damaged = true;
+
+	schedule_delayed_work(&st7586->flush_work,
+			      time_after(next, jiffies) ? next - jiffies : 0);
+}
+
+static void st7586_flush_work(struct work_struct *work)
+{
+	struct st7586_device *st7586 = container_of(to_delayed_work(work),
+						    struct st7586_device,
+						    flush_work);
+	struct mipi_dbi *mipi = &st7586->mipi;
+	struct tinydrm_device *tdev = &mipi->tinydrm;
+	struct drm_framebuffer *fb;
+	int ret = 0;
+
+	mutex_lock(&tdev->dirty_lock);
+
+	fb = tdev->pipe.plane.fb;
+	if (st7586->damaged && mipi->enabled && fb) {
+		ret = st7586_flush_clip(mipi, fb, &st7586->damage);
+		st7586->last_flush = jiffies;
+		st7586_stats_add(st7586, flushes, 1);
+	}
+	st7586->damaged = false;
+
+	mutex_unlock(&tdev->dirty_lock);
+
+	if (ret)
+		dev_err_once(tdev->drm->dev, "Failed to update display %d\n",
+			     ret);
+}
+
+/*
+ * Updates come in at whatever rate clients like. At most max_fps of them reach
+ * the panel, the damage of the ones in between is held back and flushed as a
+ * single region by st7586_flush_work().
+ */
 static int st7586_fb_dirty(struct drm_framebuffer *fb,
 			   struct drm_file *file_priv, unsigned int flags,
 			   unsigned int color, struct drm_clip_rect *clips,
@@ -114,47 +713,43 @@ static int st7586_fb_dirty(struct drm_framebuffer *fb,
 {
 	struct tinydrm_device *tdev = fb->dev->dev_private;
 	struct mipi_dbi *mipi = mipi_dbi_from_tinydrm(tdev);
+	struct st7586_device *st7586 = mipi_to_st7586(mipi);
+	struct drm_clip_rect regions[ST7586_MAX_REGIONS];
 	struct drm_clip_rect clip;
-	int start, end;
+	unsigned int i, num_regions;
+	unsigned long next;
 	int ret = 0;
 
 	mutex_lock(&tdev->dirty_lock);
 
-	if (!mipi->enabled)
-		goto out_unlock;
-
 	/* fbdev can flush even when we're not interested */
-	if (tdev->pipe.plane.fb != fb)
+	if (!mipi->enabled || tdev->pipe.plane.fb != fb) {
+		st7586_stats_add(st7586, dropped, 1);
 		goto out_unlock;
+	}
 
 	tinydrm_merge_clips(&clip, clips, num_clips, flags, fb->width,
 			    fb->height);
+	st7586_align_clip(&clip);
 
-	/* 3 pixels per byte, so grow clip to nearest multiple of 3 */
-	clip.x1 = rounddown(clip.x1, 3);
-	clip.x2 = roundup(clip.x2, 3);
-
-	DRM_DEBUG("Flushing [FB:%d] x1=%u, x2=%u, y1=%u, y2=%u\n", fb->base.id,
-		  clip.x1, clip.x2, clip.y1, clip.y2);
-
-	ret = st7586_buf_copy(mipi->tx_buf, fb, &clip);
-	if (ret)
+	next = st7586->last_flush + st7586_flush_interval();
+	if (st7586->damaged || time_before(jiffies, next)) {
+		st7586_hold_damage(st7586, &clip);
 		goto out_unlock;
+	}
 
-	/* Pixels are packed 3 per byte */
-	start = clip.x1 / 3;
-	end = clip.x2 / 3;
+	st7586->last_flush = jiffies;
+	st7586_stats_add(st7586, flushes, 1);
 
-	mipi_dbi_command(mipi, MIPI_DCS_SET_COLUMN_ADDRESS,
-			 (start >> 8) & 0xFF, start & 0xFF,
-			 (end >> 8) & 0xFF, (end - 1) & 0xFF);
-	mipi_dbi_command(mipi, MIPI_DCS_SET_PAGE_ADDRESS,
-			 (clip.y1 >> 8) & 0xFF, clip.y1 & 0xFF,
-			 (clip.y2 >> 8) & 0xFF, (clip.y2 - 1) & 0xFF);
+	num_regions = st7586_split_clips(regions, &clip, clips, num_clips,
+					 flags, fb);
+	if (!num_regions) {
+		ret = st7586_flush_clip(mipi, fb, &clip);
+		goto out_unlock;
+	}
 
-	ret = mipi_dbi_command_buf(mipi, MIPI_DCS_WRITE_MEMORY_START,
-				   (u8 *)mipi->tx_buf,
-				   (end - start) * (clip.y2 - clip.y1));
+	for (i = 0; i < num_regions && !ret; i++)
+		ret = st7586_flush_clip(mipi, fb, &regions[i]);
 
 out_unlock:
 	mutex_unlock(&tdev->dirty_lock);
@@ -241,6 +836,10 @@ static void st7586_pipe_enable(struct drm_simple_display_pipe *pipe,
 
 	mipi->enabled = true;
 
+	/* the panel contents are gone, don't hold back the first frame */
+	mipi_to_st7586(mipi)->last_flush = jiffies - st7586_flush_interval();
+	mipi_to_st7586(mipi)->shadow_valid = false;
+
 	if (fb)
 		fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
 }
@@ -255,12 +854,23 @@ static void st7586_pipe_disable(struct drm_simple_display_pipe *pipe)
 	if (!mipi->enabled)
 		return;
 
-	mipi_dbi_command(mipi, MIPI_DCS_SET_DISPLAY_OFF);
+	mutex_lock(&tdev->dirty_lock);
 	mipi->enabled = false;
+	mipi_to_st7586(mipi)->damaged = false;
+	mutex_unlock(&tdev->dirty_lock);
+
+	cancel_delayed_work_sync(&mipi_to_st7586(mipi)->flush_work);
+
+	mipi_dbi_command(mipi, MIPI_DCS_SET_DISPLAY_OFF);
 }
 
+/*
+ * R8 is used as 8-bit grayscale, so userspace can skip the RGB conversion.
+ * With DRM_FORMAT_MOD_SITRONIX_ST7586_PACKED it holds the panel's own layout.
+ */
 static const u32 st7586_formats[] = {
 	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_R8,
 };
 
 static int st7586_init(struct device *dev, struct mipi_dbi *mipi,
@@ -268,16 +878,43 @@ static int st7586_init(struct device *dev, struct mipi_dbi *mipi,
 		struct drm_driver *driver, const struct drm_display_mode *mode,
 		unsigned int rotation)
 {
-	size_t bufsize = (mode->vdisplay + 2) / 3 * mode->hdisplay;
+	size_t bufsize = (mode->hdisplay + 2) / 3 * mode->vdisplay;
+	struct st7586_device *st7586 = mipi_to_st7586(mipi);
 	struct tinydrm_device *tdev = &mipi->tinydrm;
-	int ret;
+	size_t max_chunk = tinydrm_spi_max_transfer_size(mipi->spi, 0);
+	int i, ret;
 
 	mutex_init(&mipi->cmdlock);
 
-	mipi->tx_buf = devm_kmalloc(dev, bufsize, GFP_KERNEL);
-	if (!mipi->tx_buf)
+	for (i = 0; i < ARRAY_SIZE(st7586->tx_buf); i++) {
+		st7586->tx_buf[i] = devm_kmalloc(dev, bufsize, GFP_KERNEL);
+		if (!st7586->tx_buf[i])
+			return -ENOMEM;
+	}
+	mipi->tx_buf = st7586->tx_buf[0];
+
+	st7586->line_buf = devm_kmalloc(dev, mode->hdisplay * sizeof(u32),
+					GFP_KERNEL);
+	if (!st7586->line_buf)
+		return -ENOMEM;
+
+	st7586->shadow = devm_kmalloc(dev, bufsize, GFP_KERNEL);
+	if (!st7586->shadow)
+		return -ENOMEM;
+	st7586->shadow_pitch = (mode->hdisplay + 2) / 3;
+
+	st7586->xfers = devm_kcalloc(dev, DIV_ROUND_UP(bufsize, max_chunk),
+				     sizeof(*st7586->xfers), GFP_KERNEL);
+	if (!st7586->xfers)
 		return -ENOMEM;
 
+	init_completion(&st7586->done);
+	spin_lock_init(&st7586->stats_lock);
+	st7586->stats.start = ktime_get();
+	INIT_DELAYED_WORK(&st7586->flush_work, st7586_flush_work);
+	st7586->command = mipi->command;
+	mipi->command = st7586_command;
+
 	ret = devm_tinydrm_init(dev, tdev, &st7586_fb_funcs, driver);
 	if (ret)
 		return ret;
@@ -291,6 +928,7 @@ static int st7586_init(struct device *dev, struct mipi_dbi *mipi,
 		return ret;
 
 	tdev->drm->mode_config.preferred_depth = 32;
+	tdev->drm->mode_config.allow_fb_modifiers = true;
 	mipi->rotation = rotation;
 
 	drm_mode_config_reset(tdev->drm);
@@ -301,7 +939,27 @@ static int st7586_init(struct device *dev, struct mipi_dbi *mipi,
 	return 0;
 }
 
+static int st7586_pipe_check(struct drm_simple_display_pipe *pipe,
+			     struct drm_plane_state *plane_state,
+			     struct drm_crtc_state *crtc_state)
+{
+	struct drm_framebuffer *fb = plane_state->fb;
+
+	if (!fb)
+		return 0;
+
+	switch (fb->modifier) {
+	case DRM_FORMAT_MOD_LINEAR:
+		return 0;
+	case DRM_FORMAT_MOD_SITRONIX_ST7586_PACKED:
+		return fb->format->format == DRM_FORMAT_R8 ? 0 : -EINVAL;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct drm_simple_display_pipe_funcs st7586_pipe_funcs = {
+	.check		= st7586_pipe_check,
 	.enable		= st7586_pipe_enable,
 	.disable	= st7586_pipe_disable,
 	.update		= tinydrm_display_pipe_update,
@@ -312,6 +970,141 @@ static const struct drm_display_mode st7586_mode = {
 	TINYDRM_MODE(178, 128, 37, 27),
 };
 
+#ifdef CONFIG_DEBUG_FS
+
+static void st7586_stats_show_hist(struct seq_file *m, const char *name,
+				   const u32 *hist)
+{
+	unsigned int i;
+
+	seq_printf(m, "%s:\n", name);
+	seq_printf(m, "  <1us: %u\n", hist[0]);
+	for (i = 1; i < ST7586_STATS_BUCKETS - 1; i++)
+		seq_printf(m, "  %u-%uus: %u\n", 1 << (i - 1), 1 << i, hist[i]);
+	seq_printf(m, "  >=%uus: %u\n", 1 << (i - 1), hist[i]);
+}
+
+static void st7586_stats_print(struct seq_file *m,
+			       struct st7586_device *st7586)
+{
+	struct st7586_stats stats;
+	u64 ms;
+
+	spin_lock(&st7586->stats_lock);
+	stats = st7586->stats;
+	spin_unlock(&st7586->stats_lock);
+
+	ms = max_t(s64, ktime_ms_delta(ktime_get(), stats.start), 1);
+
+	seq_printf(m, "flushes: %llu\n", stats.flushes);
+	seq_printf(m, "fps: %llu.%llu\n", div64_u64(stats.flushes * 1000, ms),
+		   div64_u64(stats.flushes * 10000, ms) % 10);
+	seq_printf(m, "regions: %llu\n", stats.regions);
+	seq_printf(m, "bytes: %llu\n", stats.bytes);
+	seq_printf(m, "unchanged: %llu\n", stats.unchanged);
+	seq_printf(m, "merged: %llu\n", stats.merged);
+	seq_printf(m, "dropped: %llu\n", stats.dropped);
+	st7586_stats_show_hist(m, "convert", stats.convert);
+	st7586_stats_show_hist(m, "transfer", stats.xfer);
+}
+
+static void st7586_stats_reset(struct st7586_device *st7586)
+{
+	spin_lock(&st7586->stats_lock);
+	memset(&st7586->stats, 0, sizeof(st7586->stats));
+	st7586->stats.start = ktime_get();
+	spin_unlock(&st7586->stats_lock);
+}
+
+static int st7586_stats_show(struct seq_file *m, void *unused)
+{
+	st7586_stats_print(m, m->private);
+
+	return 0;
+}
+
+static int st7586_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, st7586_stats_show, inode->i_private);
+}
+
+/* Any write starts counting from zero */
+static ssize_t st7586_stats_write(struct file *file, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+
+	st7586_stats_reset(m->private);
+
+	return count;
+}
+
+static const struct file_operations st7586_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = st7586_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = st7586_stats_write,
+};
+
+static int st7586_debugfs_init(struct drm_minor *minor)
+{
+	struct tinydrm_device *tdev = minor->dev->dev_private;
+	struct mipi_dbi *mipi = mipi_dbi_from_tinydrm(tdev);
+	int ret;
+
+	ret = mipi_dbi_debugfs_init(minor);
+	if (ret)
+		return ret;
+
+	debugfs_create_file("stats", S_IRUGO | S_IWUSR, minor->debugfs_root,
+			    mipi_to_st7586(mipi), &st7586_stats_fops);
+
+	return 0;
+}
+
+/* fps is over the time since @stats.start, which is when they were reset */
+static void st7586_perf_show(struct seq_file *m, void *data, u64 interval_ns)
+{
+	st7586_stats_print(m, data);
+}
+
+static void st7586_perf_reset(void *data)
+{
+	st7586_stats_reset(data);
+}
+
+static void st7586_perf_unregister(void *data)
+{
+	struct st7586_device *st7586 = data;
+
+	legoev3_perf_unregister(&st7586->perf);
+}
+
+static int st7586_perf_init(struct device *dev, struct st7586_device *st7586)
+{
+	snprintf(st7586->perf.name, sizeof(st7586->perf.name), "st7586-%s",
+		 dev_name(dev));
+	st7586->perf.show = st7586_perf_show;
+	st7586->perf.reset = st7586_perf_reset;
+	st7586->perf.data = st7586;
+	/* the panel works without the dashboard */
+	legoev3_perf_register(&st7586->perf);
+
+	return devm_add_action_or_reset(dev, st7586_perf_unregister, st7586);
+}
+
+#else
+#define st7586_debugfs_init	NULL
+
+static inline int st7586_perf_init(struct device *dev,
+				   struct st7586_device *st7586)
+{
+	return 0;
+}
+#endif
+
 DEFINE_DRM_GEM_CMA_FOPS(st7586_fops);
 
 static struct drm_driver st7586_driver = {
@@ -320,7 +1113,7 @@ static struct drm_driver st7586_driver = {
 	.fops			= &st7586_fops,
 	TINYDRM_GEM_DRIVER_OPS,
 	.lastclose		= tinydrm_lastclose,
-	.debugfs_init		= mipi_dbi_debugfs_init,
+	.debugfs_init		= st7586_debugfs_init,
 	.name			= "st7586",
 	.desc			= "Sitronix ST7586",
 	.date			= "20170801",
@@ -340,19 +1133,52 @@ static const struct spi_device_id st7586_id[] = {
 };
 MODULE_DEVICE_TABLE(spi, st7586_id);
 
+static void st7586_release_copy_chan(void *data)
+{
+	struct st7586_device *st7586 = data;
+
+	dma_release_channel(st7586->copy_chan);
+}
+
+/* The DMA copy is optional, without a memcpy channel the CPU does it */
+static int st7586_request_copy_chan(struct device *dev,
+				    struct st7586_device *st7586)
+{
+	struct dma_chan *chan;
+	dma_cap_mask_t mask;
+
+	init_completion(&st7586->copy_done);
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_MEMCPY, mask);
+	chan = dma_request_chan_by_mask(&mask);
+	if (IS_ERR(chan)) {
+		if (PTR_ERR(chan) == -EPROBE_DEFER)
+			return -EPROBE_DEFER;
+		return 0;
+	}
+
+	st7586->copy_chan = chan;
+
+	return devm_add_action_or_reset(dev, st7586_release_copy_chan, st7586);
+}
+
 static int st7586_probe(struct spi_device *spi)
 {
 	struct device *dev = &spi->dev;
+	struct st7586_device *st7586;
 	struct tinydrm_device *tdev;
 	struct mipi_dbi *mipi;
 	struct gpio_desc *a0;
 	u32 rotation = 0;
 	int ret;
 
-	mipi = devm_kzalloc(dev, sizeof(*mipi), GFP_KERNEL);
-	if (!mipi)
+	st7586 = devm_kzalloc(dev, sizeof(*st7586), GFP_KERNEL);
+	if (!st7586)
 		return -ENOMEM;
 
+	mipi = &st7586->mipi;
+
 	mipi->reset = devm_gpiod_get(dev, "reset", GPIOD_OUT_HIGH);
 	if (IS_ERR(mipi->reset)) {
 		dev_err(dev, "Failed to get gpio 'reset'\n");
@@ -388,6 +1214,14 @@ static int st7586_probe(struct spi_device *spi)
 	if (ret)
 		return ret;
 
+	ret = st7586_request_copy_chan(dev, st7586);
+	if (ret)
+		return ret;
+
+	ret = st7586_perf_init(dev, st7586);
+	if (ret)
+		return ret;
+
 	tdev = &mipi->tinydrm;
 
 	ret = devm_tinydrm_register(tdev);
@@ -31,8 +31,11 @@
 #include <linux/interrupt.h>
 #include <linux/platform_device.h>
 #include <linux/io.h>
+#include <linux/iopoll.h>
 #include <linux/slab.h>
 #include <linux/cpufreq.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
 #include <linux/gpio.h>
 #include <linux/of_device.h>
 #include <linux/platform_data/i2c-davinci.h>
@@ -42,6 +45,10 @@
 #define DAVINCI_I2C_TIMEOUT	(1*HZ)
 #define DAVINCI_I2C_MAX_TRIES	2
 #define DAVINCI_I2C_OWN_ADDRESS	0x08
+/* time it takes BB to clear after a STOP we generated, worst case 10kHz */
+#define DAVINCI_I2C_BB_CLEAR_US	200
+/* shorter transfers are cheaper to do byte by byte from the ISR */
+#define DAVINCI_I2C_DMA_MIN_LEN	16
 #define I2C_DAVINCI_INTR_ALL    (DAVINCI_I2C_IMR_SCD | \
 				 DAVINCI_I2C_IMR_ARDY | \
 				 DAVINCI_I2C_IMR_NACK | \
@@ -133,7 +140,16 @@ struct davinci_i2c_dev {
 	int			irq;
 	int			stop;
 	u8			terminate;
+	/* the last transfer completed and released the bus with a STOP */
+	bool			bus_released;
 	struct i2c_adapter	adapter;
+	struct dma_chan		*dma_rx;
+	struct dma_chan		*dma_tx;
+	/* channel of the DMA transfer in flight, if any */
+	struct dma_chan		*dma_chan;
+	struct completion	dma_complete;
+	dma_addr_t		dma_addr;
+	size_t			dma_len;
 #ifdef CONFIG_CPU_FREQ
 	struct completion	xfr_complete;
 	struct notifier_block	freq_transition;
@@ -304,11 +320,17 @@ static void davinci_i2c_prepare_recovery(struct i2c_adapter *adap)
 	davinci_i2c_reset_ctrl(dev, 0);
 }
 
+/*
+ * Putting the module into reset keeps its configuration, so there is no
+ * need to go through i2c_davinci_init() and recompute the clock dividers.
+ */
 static void davinci_i2c_unprepare_recovery(struct i2c_adapter *adap)
 {
 	struct davinci_i2c_dev *dev = i2c_get_adapdata(adap);
 
-	i2c_davinci_init(dev);
+	/* Take the I2C module out of reset and enable interrupts again */
+	davinci_i2c_reset_ctrl(dev, 1);
+	davinci_i2c_write_reg(dev, DAVINCI_I2C_IMR_REG, I2C_DAVINCI_INTR_ALL);
 }
 
 static struct i2c_bus_recovery_info davinci_i2c_gpio_recovery_info = {
@@ -388,6 +410,18 @@ static struct i2c_bus_recovery_info davinci_i2c_scl_recovery_info = {
 static int i2c_davinci_wait_bus_not_busy(struct davinci_i2c_dev *dev)
 {
 	unsigned long timeout = jiffies + dev->adapter.timeout;
+	u16 stat;
+
+	/*
+	 * If we released the bus ourselves, BB only stays set for the bus
+	 * free time after our STOP: spin for it rather than sleeping for a
+	 * whole tick before every transfer.
+	 */
+	if (dev->bus_released &&
+	    !readw_poll_timeout_atomic(dev->base + DAVINCI_I2C_STR_REG, stat,
+				       !(stat & DAVINCI_I2C_STR_BB), 1,
+				       DAVINCI_I2C_BB_CLEAR_US))
+		return 0;
 
 	do {
 		if (!(davinci_i2c_read_reg(dev, DAVINCI_I2C_STR_REG) & DAVINCI_I2C_STR_BB))
@@ -408,6 +442,122 @@ static int i2c_davinci_wait_bus_not_busy(struct davinci_i2c_dev *dev)
 	return 0;
 }
 
+static void i2c_davinci_dma_callback(void *data)
+{
+	struct davinci_i2c_dev *dev = data;
+
+	complete(&dev->dma_complete);
+}
+
+/*
+ * Hand the remaining dev->buf_len bytes of the message to the DMA engine,
+ * which is paced by the controller's ICREVT/ICXEVT events. The ISR is then
+ * only involved for the status interrupts at the end of the transfer.
+ */
+static int i2c_davinci_dma_start(struct davinci_i2c_dev *dev, bool rd)
+{
+	struct dma_chan *chan = rd ? dev->dma_rx : dev->dma_tx;
+	enum dma_data_direction dir = rd ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	struct dma_async_tx_descriptor *desc;
+
+	if (!chan || dev->buf_len < DAVINCI_I2C_DMA_MIN_LEN ||
+	    !virt_addr_valid(dev->buf))
+		return -EINVAL;
+
+	dev->dma_addr = dma_map_single(chan->device->dev, dev->buf,
+				       dev->buf_len, dir);
+	if (dma_mapping_error(chan->device->dev, dev->dma_addr))
+		return -ENOMEM;
+
+	desc = dmaengine_prep_slave_single(chan, dev->dma_addr, dev->buf_len,
+					   rd ? DMA_DEV_TO_MEM : DMA_MEM_TO_DEV,
+					   DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc) {
+		dma_unmap_single(chan->device->dev, dev->dma_addr,
+				 dev->buf_len, dir);
+		return -EIO;
+	}
+
+	reinit_completion(&dev->dma_complete);
+	desc->callback = i2c_davinci_dma_callback;
+	desc->callback_param = dev;
+	dmaengine_submit(desc);
+	dma_async_issue_pending(chan);
+
+	dev->dma_chan = chan;
+	dev->dma_len = dev->buf_len;
+	dev->buf_len = 0;
+
+	return 0;
+}
+
+/*
+ * Returns true if the DMA transfer moved all bytes. It is aborted instead
+ * when the controller reported an error or timed out.
+ */
+static bool i2c_davinci_dma_finish(struct davinci_i2c_dev *dev, bool ok)
+{
+	struct dma_chan *chan = dev->dma_chan;
+	enum dma_data_direction dir =
+		chan == dev->dma_rx ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+
+	/* the last byte may still be in flight when ARDY/SCD comes in */
+	if (ok)
+		ok = wait_for_completion_timeout(&dev->dma_complete,
+						 dev->adapter.timeout);
+	if (!ok)
+		dmaengine_terminate_sync(chan);
+
+	dma_unmap_single(chan->device->dev, dev->dma_addr, dev->dma_len, dir);
+	dev->dma_chan = NULL;
+
+	return ok;
+}
+
+static int i2c_davinci_dma_init(struct davinci_i2c_dev *dev,
+				struct resource *mem)
+{
+	struct dma_slave_config cfg = {
+		.src_addr = mem->start + DAVINCI_I2C_DRR_REG,
+		.dst_addr = mem->start + DAVINCI_I2C_DXR_REG,
+		.src_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE,
+		.dst_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE,
+		.src_maxburst = 1,
+		.dst_maxburst = 1,
+	};
+	struct dma_chan *rx, *tx;
+
+	rx = dma_request_chan(dev->dev, "rx");
+	if (IS_ERR(rx))
+		return PTR_ERR(rx) == -EPROBE_DEFER ? -EPROBE_DEFER : 0;
+
+	tx = dma_request_chan(dev->dev, "tx");
+	if (IS_ERR(tx)) {
+		dma_release_channel(rx);
+		return PTR_ERR(tx) == -EPROBE_DEFER ? -EPROBE_DEFER : 0;
+	}
+
+	cfg.direction = DMA_DEV_TO_MEM;
+	dmaengine_slave_config(rx, &cfg);
+	cfg.direction = DMA_MEM_TO_DEV;
+	dmaengine_slave_config(tx, &cfg);
+
+	dev->dma_rx = rx;
+	dev->dma_tx = tx;
+	dev_dbg(dev->dev, "using DMA for transfers of %d bytes or more\n",
+		DAVINCI_I2C_DMA_MIN_LEN);
+
+	return 0;
+}
+
+static void i2c_davinci_dma_release(struct davinci_i2c_dev *dev)
+{
+	if (dev->dma_rx)
+		dma_release_channel(dev->dma_rx);
+	if (dev->dma_tx)
+		dma_release_channel(dev->dma_tx);
+}
+
 /*
  * Low level master read/write transaction. This function is called
  * from i2c_davinci_xfer.
@@ -420,6 +570,7 @@ i2c_davinci_xfer_msg(struct i2c_adapter *adap, struct i2c_msg *msg, int stop)
 	u32 flag;
 	u16 w;
 	unsigned long time_left;
+	bool dma_ok = true;
 
 	if (msg->addr == DAVINCI_I2C_OWN_ADDRESS) {
 		dev_warn(dev->dev, "transfer to own address aborted\n");
@@ -453,12 +604,9 @@ i2c_davinci_xfer_msg(struct i2c_adapter *adap, struct i2c_msg *msg, int stop)
 	if (msg->len == 0)
 		flag |= DAVINCI_I2C_MDR_RM;
 
-	/* Enable receive or transmit interrupts */
+	/* Disable receive and transmit interrupts until we know we need them */
 	w = davinci_i2c_read_reg(dev, DAVINCI_I2C_IMR_REG);
-	if (msg->flags & I2C_M_RD)
-		w |= DAVINCI_I2C_IMR_RRDY;
-	else
-		w |= DAVINCI_I2C_IMR_XRDY;
+	w &= ~(DAVINCI_I2C_IMR_RRDY | DAVINCI_I2C_IMR_XRDY);
 	davinci_i2c_write_reg(dev, DAVINCI_I2C_IMR_REG, w);
 
 	dev->terminate = 0;
@@ -482,6 +630,18 @@ i2c_davinci_xfer_msg(struct i2c_adapter *adap, struct i2c_msg *msg, int stop)
 		dev->buf_len--;
 	}
 
+	/*
+	 * Longer transfers go through DMA, the rest is moved a byte at a
+	 * time by the ISR on receive or transmit interrupts.
+	 */
+	if (i2c_davinci_dma_start(dev, msg->flags & I2C_M_RD)) {
+		if (msg->flags & I2C_M_RD)
+			w |= DAVINCI_I2C_IMR_RRDY;
+		else
+			w |= DAVINCI_I2C_IMR_XRDY;
+		davinci_i2c_write_reg(dev, DAVINCI_I2C_IMR_REG, w);
+	}
+
 	/* Set STT to begin transmit now DXR is loaded */
 	flag |= DAVINCI_I2C_MDR_STT;
 	if (stop && msg->len != 0)
@@ -490,6 +650,9 @@ i2c_davinci_xfer_msg(struct i2c_adapter *adap, struct i2c_msg *msg, int stop)
 
 	time_left = wait_for_completion_timeout(&dev->cmd_complete,
 						dev->adapter.timeout);
+	if (dev->dma_chan)
+		dma_ok = i2c_davinci_dma_finish(dev,
+						time_left && !dev->cmd_err);
 	if (!time_left) {
 		dev_err(dev->dev, "controller timed out\n");
 		i2c_recover_bus(adap);
@@ -508,6 +671,11 @@ i2c_davinci_xfer_msg(struct i2c_adapter *adap, struct i2c_msg *msg, int stop)
 		return -EREMOTEIO;
 	}
 
+	if (!dma_ok && !dev->cmd_err) {
+		dev_err(dev->dev, "DMA transfer did not complete\n");
+		return -EREMOTEIO;
+	}
+
 	/* no error */
 	if (likely(!dev->cmd_err))
 		return msg->len;
@@ -547,6 +715,8 @@ i2c_davinci_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 		return ret;
 	}
 
+	dev->bus_released = false;
+
 	for (i = 0; i < num; i++) {
 		ret = i2c_davinci_xfer_msg(adap, &msgs[i], (i == (num - 1)));
 		dev_dbg(dev->dev, "%s [%d/%d] ret: %d\n", __func__, i + 1, num,
@@ -555,6 +725,8 @@ i2c_davinci_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 			return ret;
 	}
 
+	dev->bus_released = true;
+
 #ifdef CONFIG_CPU_FREQ
 	complete(&dev->xfr_complete);
 #endif
@@ -770,6 +942,7 @@ static int davinci_i2c_probe(struct platform_device *pdev)
 	}
 
 	init_completion(&dev->cmd_complete);
+	init_completion(&dev->dma_complete);
 #ifdef CONFIG_CPU_FREQ
 	init_completion(&dev->xfr_complete);
 #endif
@@ -811,19 +984,23 @@ static int davinci_i2c_probe(struct platform_device *pdev)
 		goto err_unuse_clocks;
 	}
 
+	r = i2c_davinci_dma_init(dev, mem);
+	if (r)
+		goto err_unuse_clocks;
+
 	i2c_davinci_init(dev);
 
 	r = devm_request_irq(&pdev->dev, dev->irq, i2c_davinci_isr, 0,
 			pdev->name, dev);
 	if (r) {
 		dev_err(&pdev->dev, "failure requesting irq %i\n", dev->irq);
-		goto err_unuse_clocks;
+		goto err_release_dma;
 	}
 
 	r = i2c_davinci_cpufreq_register(dev);
 	if (r) {
 		dev_err(&pdev->dev, "failed to register cpufreq\n");
-		goto err_unuse_clocks;
+		goto err_release_dma;
 	}
 
 	adap = &dev->adapter;
@@ -847,10 +1024,12 @@ static int davinci_i2c_probe(struct platform_device *pdev)
 	adap->nr = pdev->id;
 	r = i2c_add_numbered_adapter(adap);
 	if (r)
-		goto err_unuse_clocks;
+		goto err_release_dma;
 
 	return 0;
 
+err_release_dma:
+	i2c_davinci_dma_release(dev);
 err_unuse_clocks:
 	clk_disable_unprepare(dev->clk);
 	dev->clk = NULL;
@@ -865,6 +1044,8 @@ static int davinci_i2c_remove(struct platform_device *pdev)
 
 	i2c_del_adapter(&dev->adapter);
 
+	i2c_davinci_dma_release(dev);
+
 	clk_disable_unprepare(dev->clk);
 	dev->clk = NULL;
 
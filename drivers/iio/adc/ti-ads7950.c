@@ -23,7 +23,9 @@
 
 #include <linux/acpi.h>
 #include <linux/bitops.h>
+#include <linux/completion.h>
 #include <linux/device.h>
+#include <linux/dma-mapping.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
@@ -33,10 +35,12 @@
 #include <linux/spi/spi.h>
 
 #include <linux/iio/buffer.h>
+#include <linux/iio/buffer_impl.h>
+#include <linux/iio/buffer-dma.h>
+#include <linux/iio/events.h>
 #include <linux/iio/iio.h>
 #include <linux/iio/sysfs.h>
 #include <linux/iio/trigger_consumer.h>
-#include <linux/iio/triggered_buffer.h>
 
 /*
  * In case of ACPI, we use the 5000 mV as default for the reference pin.
@@ -51,18 +55,61 @@
 
 #define TI_ADS7950_MAX_CHAN	16
 
+/* Most buffered scans averaged into each one pushed */
+#define TI_ADS7950_MAX_OVERSAMPLING	64
+
 #define TI_ADS7950_TIMESTAMP_SIZE (sizeof(int64_t) / sizeof(__be16))
 
 /* val = value, dec = left shift, bits = number of bits of the mask */
 #define TI_ADS7950_EXTRACT(val, dec, bits) \
 	(((val) >> (dec)) & ((1 << (bits)) - 1))
 
+/*
+ * The scans are written into the blocks of an IIO DMA buffer, which the
+ * application can map and read in place. The controller's DMA only fills
+ * rx_buf, so this is not a DMA buffer in the sense of dmaengine: the blocks
+ * are filled by the CPU when the scan is pushed to the buffers, along with
+ * any in-kernel consumers attached to the device.
+ */
+struct ti_ads7950_buffer {
+	struct iio_dma_buffer_queue queue;
+	/* blocks handed to the driver, the first one is being filled */
+	struct list_head	active;
+};
+
 struct ti_ads7950_state {
 	struct spi_device	*spi;
+	struct ti_ads7950_buffer *buffer;
 	struct spi_transfer	ring_xfer[TI_ADS7950_MAX_CHAN + 2];
 	struct spi_transfer	scan_single_xfer[3];
+	struct spi_transfer	scan_multi_xfer[TI_ADS7950_MAX_CHAN + 2];
 	struct spi_message	ring_msg;
 	struct spi_message	scan_single_msg;
+	struct spi_message	scan_multi_msg;
+
+	/* ring_msg is in flight, from the trigger until its completion */
+	unsigned long		ring_busy;
+	struct completion	ring_done;
+	s64			ring_timestamp;
+
+	unsigned int		oversampling;
+	unsigned int		os_count;
+	unsigned int		scan_len;
+	u32			os_acc[TI_ADS7950_MAX_CHAN];
+
+	/* latest buffered sample of each channel, for raw reads meanwhile */
+	u16			last_scan[TI_ADS7950_MAX_CHAN];
+	unsigned long		last_scan_valid;
+
+	/*
+	 * Threshold events, indexed by IIO_EV_DIR_RISING - 1 and
+	 * IIO_EV_DIR_FALLING - 1. An event fires when an armed threshold is
+	 * crossed and rearms once the value is back by the hysteresis.
+	 */
+	u16			thresh[2][TI_ADS7950_MAX_CHAN];
+	u16			hyst[TI_ADS7950_MAX_CHAN];
+	unsigned long		thresh_en[2];
+	unsigned long		thresh_armed[2];
 
 	struct regulator	*reg;
 	unsigned int		vref_mv;
@@ -98,6 +145,24 @@ enum ti_ads7950_id {
 	TI_ADS7961,
 };
 
+static const struct iio_event_spec ti_ads7950_events[] = {
+	{
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_RISING,
+		.mask_separate = BIT(IIO_EV_INFO_VALUE) |
+				 BIT(IIO_EV_INFO_ENABLE),
+	}, {
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_FALLING,
+		.mask_separate = BIT(IIO_EV_INFO_VALUE) |
+				 BIT(IIO_EV_INFO_ENABLE),
+	}, {
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_EITHER,
+		.mask_separate = BIT(IIO_EV_INFO_HYSTERESIS),
+	},
+};
+
 #define TI_ADS7950_V_CHAN(index, bits)				\
 {								\
 	.type = IIO_VOLTAGE,					\
@@ -105,9 +170,15 @@ enum ti_ads7950_id {
 	.channel = index,					\
 	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),		\
 	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),	\
+	.info_mask_shared_by_all =				\
+		BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO),		\
+	.info_mask_shared_by_all_available =			\
+		BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO),		\
 	.address = index,					\
 	.datasheet_name = "CH##index",				\
 	.scan_index = index,					\
+	.event_spec = ti_ads7950_events,			\
+	.num_event_specs = ARRAY_SIZE(ti_ads7950_events),	\
 	.scan_type = {						\
 		.sign = 'u',					\
 		.realbits = bits,				\
@@ -241,6 +312,122 @@ static const struct ti_ads7950_chip_info ti_ads7950_chip_info[] = {
 	},
 };
 
+static const int ti_ads7950_oversampling_avail[] = {
+	1, 2, 4, 8, 16, 32, TI_ADS7950_MAX_OVERSAMPLING,
+};
+
+/*
+ * Sums the scan into the per-channel accumulators and returns true when
+ * oversampling scans have been taken, with their averages in rx_buf. The
+ * channel address in the top bits of each word is the same in every scan, so
+ * averaging whole words leaves it intact.
+ */
+static bool ti_ads7950_decimate(struct ti_ads7950_state *st)
+{
+	unsigned int i;
+
+	if (st->oversampling == 1)
+		return true;
+
+	for (i = 0; i < st->scan_len; i++)
+		st->os_acc[i] += be16_to_cpu(st->rx_buf[i]);
+
+	if (++st->os_count < st->oversampling)
+		return false;
+
+	for (i = 0; i < st->scan_len; i++) {
+		u32 avg = DIV_ROUND_CLOSEST(st->os_acc[i], st->oversampling);
+
+		st->rx_buf[i] = cpu_to_be16(avg);
+		st->os_acc[i] = 0;
+	}
+	st->os_count = 0;
+
+	return true;
+}
+
+/*
+ * Checks the sample of channel @addr against its enabled thresholds. This
+ * runs for every scan pushed, so readers that only wait for a sensor to
+ * cross a level can sleep on the event interface instead of polling.
+ */
+static void ti_ads7950_check_thresh(struct iio_dev *indio_dev,
+				    unsigned int addr, unsigned int val,
+				    s64 timestamp)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+	unsigned int hyst = READ_ONCE(st->hyst[addr]);
+	unsigned int rising = READ_ONCE(st->thresh[0][addr]);
+	unsigned int falling = READ_ONCE(st->thresh[1][addr]);
+
+	if (test_bit(addr, &st->thresh_en[0])) {
+		if (val > rising &&
+		    test_and_clear_bit(addr, &st->thresh_armed[0]))
+			iio_push_event(indio_dev,
+				       IIO_UNMOD_EVENT_CODE(IIO_VOLTAGE, addr,
+							    IIO_EV_TYPE_THRESH,
+							    IIO_EV_DIR_RISING),
+				       timestamp);
+		else if (val + hyst <= rising)
+			set_bit(addr, &st->thresh_armed[0]);
+	}
+
+	if (test_bit(addr, &st->thresh_en[1])) {
+		if (val < falling &&
+		    test_and_clear_bit(addr, &st->thresh_armed[1]))
+			iio_push_event(indio_dev,
+				       IIO_UNMOD_EVENT_CODE(IIO_VOLTAGE, addr,
+							    IIO_EV_TYPE_THRESH,
+							    IIO_EV_DIR_FALLING),
+				       timestamp);
+		else if (val >= falling + hyst)
+			set_bit(addr, &st->thresh_armed[1]);
+	}
+}
+
+/*
+ * Remembers the scan for raw reads of the scanned channels, so that they are
+ * answered from the shared scan rather than converted on their own, and
+ * evaluates the threshold events.
+ */
+static void ti_ads7950_cache_scan(struct iio_dev *indio_dev)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+	const struct iio_scan_type *type = &indio_dev->channels[0].scan_type;
+	bool events = st->thresh_en[0] || st->thresh_en[1];
+	unsigned int i, addr;
+	u16 word;
+
+	for (i = 0; i < st->scan_len; i++) {
+		word = be16_to_cpu(st->rx_buf[i]);
+		addr = TI_ADS7950_EXTRACT(word, 12, 4);
+		WRITE_ONCE(st->last_scan[addr], word);
+		set_bit(addr, &st->last_scan_valid);
+
+		if (events)
+			ti_ads7950_check_thresh(indio_dev, addr,
+					TI_ADS7950_EXTRACT(word, type->shift,
+							   type->realbits),
+					st->ring_timestamp);
+	}
+}
+
+static void ti_ads7950_ring_complete(void *context)
+{
+	struct iio_dev *indio_dev = context;
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+
+	if (!st->ring_msg.status && ti_ads7950_decimate(st)) {
+		ti_ads7950_cache_scan(indio_dev);
+		iio_push_to_buffers_with_timestamp(indio_dev, st->rx_buf,
+						   st->ring_timestamp);
+	}
+
+	iio_trigger_notify_done(indio_dev->trig);
+	complete(&st->ring_done);
+	clear_bit(0, &st->ring_busy);
+}
+
 /*
  * ti_ads7950_update_scan_mode() setup the spi transfer buffer for the new
  * scan mask
@@ -257,6 +444,11 @@ static int ti_ads7950_update_scan_mode(struct iio_dev *indio_dev,
 		st->tx_buf[len++] = cpu_to_be16(cmd);
 	}
 
+	st->scan_len = len;
+	st->os_count = 0;
+	memset(st->os_acc, 0, sizeof(st->os_acc));
+	st->last_scan_valid = 0;
+
 	/* Data for the 1st channel is not returned until the 3rd transfer */
 	len += 2;
 	for (i = 0; i < len; i++) {
@@ -271,30 +463,207 @@ static int ti_ads7950_update_scan_mode(struct iio_dev *indio_dev,
 	st->ring_xfer[len - 1].cs_change = 0;
 
 	spi_message_init_with_transfers(&st->ring_msg, st->ring_xfer, len);
+	st->ring_msg.complete = ti_ads7950_ring_complete;
+	st->ring_msg.context = indio_dev;
 
 	return 0;
 }
 
+/*
+ * The scan is started right from the trigger interrupt and pushed from its
+ * completion, so there is no thread to wake up per sample. A trigger that
+ * fires while the previous scan is still running is dropped.
+ */
 static irqreturn_t ti_ads7950_trigger_handler(int irq, void *p)
 {
 	struct iio_poll_func *pf = p;
 	struct iio_dev *indio_dev = pf->indio_dev;
 	struct ti_ads7950_state *st = iio_priv(indio_dev);
-	int ret;
 
-	ret = spi_sync(st->spi, &st->ring_msg);
-	if (ret < 0)
+	if (test_and_set_bit(0, &st->ring_busy))
 		goto out;
 
-	iio_push_to_buffers_with_timestamp(indio_dev, st->rx_buf,
-					   iio_get_time_ns(indio_dev));
+	st->ring_timestamp = iio_get_time_ns(indio_dev);
+	reinit_completion(&st->ring_done);
+	if (!spi_async(st->spi, &st->ring_msg))
+		return IRQ_HANDLED;
 
+	clear_bit(0, &st->ring_busy);
 out:
 	iio_trigger_notify_done(indio_dev->trig);
 
 	return IRQ_HANDLED;
 }
 
+static int ti_ads7950_buffer_predisable(struct iio_dev *indio_dev)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+	int ret;
+
+	/* no new scan starts once the poll function is detached */
+	ret = iio_triggered_buffer_predisable(indio_dev);
+	if (test_bit(0, &st->ring_busy))
+		wait_for_completion(&st->ring_done);
+
+	return ret;
+}
+
+static const struct iio_buffer_setup_ops ti_ads7950_buffer_setup_ops = {
+	.postenable = iio_triggered_buffer_postenable,
+	.predisable = ti_ads7950_buffer_predisable,
+};
+
+static struct ti_ads7950_buffer *
+iio_buffer_to_ti_ads7950_buffer(struct iio_buffer *buffer)
+{
+	return container_of(buffer, struct ti_ads7950_buffer, queue.buffer);
+}
+
+/* Appends a scan to the current block, drops it if there is none */
+static int ti_ads7950_buffer_store(struct iio_buffer *buf, const void *data)
+{
+	struct ti_ads7950_buffer *buffer = iio_buffer_to_ti_ads7950_buffer(buf);
+	struct iio_dma_buffer_queue *queue = &buffer->queue;
+	struct iio_dma_buffer_block *block;
+	size_t len = buf->bytes_per_datum;
+	unsigned long flags;
+	bool full = false;
+
+	spin_lock_irqsave(&queue->list_lock, flags);
+	block = list_first_entry_or_null(&buffer->active,
+					 struct iio_dma_buffer_block, head);
+	if (block) {
+		memcpy(block->vaddr + block->bytes_used, data, len);
+		block->bytes_used += len;
+		if (block->bytes_used + len > block->size) {
+			list_del(&block->head);
+			full = true;
+		}
+	}
+	spin_unlock_irqrestore(&queue->list_lock, flags);
+
+	if (full)
+		iio_dma_buffer_block_done(block);
+
+	return 0;
+}
+
+static int ti_ads7950_buffer_submit(struct iio_dma_buffer_queue *queue,
+				    struct iio_dma_buffer_block *block)
+{
+	struct ti_ads7950_buffer *buffer =
+		iio_buffer_to_ti_ads7950_buffer(&queue->buffer);
+
+	block->bytes_used = 0;
+
+	spin_lock_irq(&queue->list_lock);
+	list_add_tail(&block->head, &buffer->active);
+	spin_unlock_irq(&queue->list_lock);
+
+	return 0;
+}
+
+/* Called after the last scan completed, see ti_ads7950_buffer_predisable() */
+static void ti_ads7950_buffer_abort(struct iio_dma_buffer_queue *queue)
+{
+	struct ti_ads7950_buffer *buffer =
+		iio_buffer_to_ti_ads7950_buffer(&queue->buffer);
+	struct iio_dma_buffer_block *block;
+
+	/* hand out the samples of the partially filled block */
+	spin_lock_irq(&queue->list_lock);
+	block = list_first_entry_or_null(&buffer->active,
+					 struct iio_dma_buffer_block, head);
+	if (block && block->bytes_used)
+		list_del(&block->head);
+	else
+		block = NULL;
+	spin_unlock_irq(&queue->list_lock);
+
+	if (block)
+		iio_dma_buffer_block_done(block);
+
+	iio_dma_buffer_block_list_abort(queue, &buffer->active);
+}
+
+static const struct iio_dma_buffer_ops ti_ads7950_dma_buffer_ops = {
+	.submit = ti_ads7950_buffer_submit,
+	.abort = ti_ads7950_buffer_abort,
+};
+
+static void ti_ads7950_buffer_release(struct iio_buffer *buf)
+{
+	struct ti_ads7950_buffer *buffer = iio_buffer_to_ti_ads7950_buffer(buf);
+
+	iio_dma_buffer_release(&buffer->queue);
+	kfree(buffer);
+}
+
+static const struct iio_buffer_access_funcs ti_ads7950_buffer_access = {
+	.store_to = ti_ads7950_buffer_store,
+	.read_first_n = iio_dma_buffer_read,
+	.set_bytes_per_datum = iio_dma_buffer_set_bytes_per_datum,
+	.set_length = iio_dma_buffer_set_length,
+	.request_update = iio_dma_buffer_request_update,
+	.enable = iio_dma_buffer_enable,
+	.disable = iio_dma_buffer_disable,
+	.data_available = iio_dma_buffer_data_available,
+	.release = ti_ads7950_buffer_release,
+	.ioctl = iio_dma_buffer_ioctl,
+	.mmap = iio_dma_buffer_mmap,
+
+	.modes = INDIO_BUFFER_TRIGGERED,
+	.flags = INDIO_BUFFER_FLAG_FIXED_WATERMARK,
+};
+
+static int ti_ads7950_buffer_setup(struct iio_dev *indio_dev)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+	struct device *dev = &st->spi->dev;
+	int ret;
+
+	/* the blocks are allocated as coherent memory of the SPI device */
+	if (!dev->coherent_dma_mask) {
+		ret = dma_coerce_mask_and_coherent(dev, DMA_BIT_MASK(32));
+		if (ret)
+			return ret;
+	}
+
+	st->buffer = kzalloc(sizeof(*st->buffer), GFP_KERNEL);
+	if (!st->buffer)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&st->buffer->active);
+	iio_dma_buffer_init(&st->buffer->queue, dev,
+			    &ti_ads7950_dma_buffer_ops);
+	st->buffer->queue.buffer.access = &ti_ads7950_buffer_access;
+
+	indio_dev->pollfunc = iio_alloc_pollfunc(&ti_ads7950_trigger_handler,
+						 NULL, IRQF_ONESHOT, indio_dev,
+						 "%s_consumer%d",
+						 indio_dev->name,
+						 indio_dev->id);
+	if (!indio_dev->pollfunc) {
+		iio_buffer_put(&st->buffer->queue.buffer);
+		return -ENOMEM;
+	}
+
+	iio_device_attach_buffer(indio_dev, &st->buffer->queue.buffer);
+	indio_dev->setup_ops = &ti_ads7950_buffer_setup_ops;
+	indio_dev->modes |= INDIO_BUFFER_TRIGGERED;
+
+	return 0;
+}
+
+static void ti_ads7950_buffer_cleanup(struct iio_dev *indio_dev)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+
+	iio_dealloc_pollfunc(indio_dev->pollfunc);
+	iio_dma_buffer_exit(&st->buffer->queue);
+	iio_buffer_put(&st->buffer->queue.buffer);
+}
+
 static int ti_ads7950_scan_direct(struct ti_ads7950_state *st, unsigned int ch)
 {
 	int ret, cmd;
@@ -309,6 +678,41 @@ static int ti_ads7950_scan_direct(struct ti_ads7950_state *st, unsigned int ch)
 	return be16_to_cpu(st->rx_buf[0]);
 }
 
+/*
+ * Converts the channels in one message, one after the other like a buffered
+ * scan. The words end up in rx_buf, in the order of @chans.
+ */
+static int ti_ads7950_scan_direct_multi(struct ti_ads7950_state *st,
+				struct iio_chan_spec const *const *chans,
+				unsigned int num)
+{
+	unsigned int i, len = num + 2;
+	int cmd, ch;
+
+	memset(st->scan_multi_xfer, 0, sizeof(st->scan_multi_xfer));
+	for (i = 0; i < num; i++) {
+		ch = chans[i]->address;
+		cmd = TI_ADS7950_CR_WRITE | TI_ADS7950_CR_CHAN(ch) |
+		      st->settings;
+		st->tx_buf[i] = cpu_to_be16(cmd);
+	}
+
+	/* Data for the 1st channel is not returned until the 3rd transfer */
+	for (i = 0; i < len; i++) {
+		if (i < num)
+			st->scan_multi_xfer[i].tx_buf = &st->tx_buf[i];
+		if (i >= 2)
+			st->scan_multi_xfer[i].rx_buf = &st->rx_buf[i - 2];
+		st->scan_multi_xfer[i].len = 2;
+		st->scan_multi_xfer[i].cs_change = i < len - 1;
+	}
+
+	spi_message_init_with_transfers(&st->scan_multi_msg,
+					st->scan_multi_xfer, len);
+
+	return spi_sync(st->spi, &st->scan_multi_msg);
+}
+
 static int ti_ads7950_get_range(struct ti_ads7950_state *st)
 {
 	int vref;
@@ -329,6 +733,29 @@ static int ti_ads7950_get_range(struct ti_ads7950_state *st)
 	return vref;
 }
 
+/*
+ * While buffered capture runs, a raw read of a channel in the scan returns
+ * its latest scanned sample instead of interrupting the scan.
+ */
+static int ti_ads7950_read_scanned(struct iio_dev *indio_dev,
+				   struct iio_chan_spec const *chan)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+	int ret = -EBUSY;
+
+	mutex_lock(&indio_dev->mlock);
+	if (iio_buffer_enabled(indio_dev) &&
+	    test_bit(chan->scan_index, indio_dev->active_scan_mask)) {
+		if (test_bit(chan->address, &st->last_scan_valid))
+			ret = READ_ONCE(st->last_scan[chan->address]);
+		else
+			ret = -EAGAIN;
+	}
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
 static int ti_ads7950_read_raw(struct iio_dev *indio_dev,
 			       struct iio_chan_spec const *chan,
 			       int *val, int *val2, long m)
@@ -340,11 +767,12 @@ static int ti_ads7950_read_raw(struct iio_dev *indio_dev,
 	case IIO_CHAN_INFO_RAW:
 
 		ret = iio_device_claim_direct_mode(indio_dev);
-		if (ret < 0)
-			return ret;
-
-		ret = ti_ads7950_scan_direct(st, chan->address);
-		iio_device_release_direct_mode(indio_dev);
+		if (ret == -EBUSY) {
+			ret = ti_ads7950_read_scanned(indio_dev, chan);
+		} else if (!ret) {
+			ret = ti_ads7950_scan_direct(st, chan->address);
+			iio_device_release_direct_mode(indio_dev);
+		}
 		if (ret < 0)
 			return ret;
 
@@ -364,13 +792,186 @@ static int ti_ads7950_read_raw(struct iio_dev *indio_dev,
 		*val2 = (1 << chan->scan_type.realbits) - 1;
 
 		return IIO_VAL_FRACTIONAL;
+	case IIO_CHAN_INFO_OVERSAMPLING_RATIO:
+		*val = st->oversampling;
+
+		return IIO_VAL_INT;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Several channels read together are converted in a single message, or come
+ * from the running buffered scan, so that they are sampled at the same time.
+ */
+static int ti_ads7950_read_raw_channels(struct iio_dev *indio_dev,
+				struct iio_chan_spec const *const *chans,
+				unsigned int num, int *vals)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+	const struct iio_chan_spec *chan;
+	unsigned int i;
+	int ret;
+
+	if (num > TI_ADS7950_MAX_CHAN)
+		return -EINVAL;
+
+	ret = iio_device_claim_direct_mode(indio_dev);
+	if (ret == -EBUSY) {
+		for (i = 0; i < num; i++) {
+			ret = ti_ads7950_read_scanned(indio_dev, chans[i]);
+			if (ret < 0)
+				return ret;
+			vals[i] = ret;
+		}
+	} else if (!ret) {
+		ret = ti_ads7950_scan_direct_multi(st, chans, num);
+		for (i = 0; !ret && i < num; i++)
+			vals[i] = be16_to_cpu(st->rx_buf[i]);
+		iio_device_release_direct_mode(indio_dev);
+	}
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < num; i++) {
+		chan = chans[i];
+		if (chan->address != TI_ADS7950_EXTRACT(vals[i], 12, 4))
+			return -EIO;
+
+		vals[i] = TI_ADS7950_EXTRACT(vals[i], chan->scan_type.shift,
+					     chan->scan_type.realbits);
+	}
+
+	return 0;
+}
+
+static int ti_ads7950_write_raw(struct iio_dev *indio_dev,
+				struct iio_chan_spec const *chan,
+				int val, int val2, long m)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+	int i, ret;
+
+	switch (m) {
+	case IIO_CHAN_INFO_OVERSAMPLING_RATIO:
+		for (i = 0; i < ARRAY_SIZE(ti_ads7950_oversampling_avail); i++)
+			if (val == ti_ads7950_oversampling_avail[i])
+				break;
+		if (i == ARRAY_SIZE(ti_ads7950_oversampling_avail) || val2)
+			return -EINVAL;
+
+		/* the ring accumulators must not change under a running scan */
+		ret = iio_device_claim_direct_mode(indio_dev);
+		if (ret < 0)
+			return ret;
+
+		st->oversampling = val;
+		iio_device_release_direct_mode(indio_dev);
+
+		return 0;
 	}
 
 	return -EINVAL;
 }
 
+static int ti_ads7950_read_avail(struct iio_dev *indio_dev,
+				 struct iio_chan_spec const *chan,
+				 const int **vals, int *type, int *length,
+				 long m)
+{
+	switch (m) {
+	case IIO_CHAN_INFO_OVERSAMPLING_RATIO:
+		*vals = ti_ads7950_oversampling_avail;
+		*type = IIO_VAL_INT;
+		*length = ARRAY_SIZE(ti_ads7950_oversampling_avail);
+
+		return IIO_AVAIL_LIST;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Threshold events are evaluated on buffered scans only: enable the buffer
+ * with the channels to watch and a trigger, and read the event interface.
+ * Values are in raw units.
+ */
+static int ti_ads7950_read_event_config(struct iio_dev *indio_dev,
+					const struct iio_chan_spec *chan,
+					enum iio_event_type type,
+					enum iio_event_direction dir)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+
+	return test_bit(chan->address, &st->thresh_en[dir - 1]);
+}
+
+static int ti_ads7950_write_event_config(struct iio_dev *indio_dev,
+					 const struct iio_chan_spec *chan,
+					 enum iio_event_type type,
+					 enum iio_event_direction dir,
+					 int state)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+
+	if (state) {
+		/* an already crossed threshold is reported right away */
+		set_bit(chan->address, &st->thresh_armed[dir - 1]);
+		set_bit(chan->address, &st->thresh_en[dir - 1]);
+	} else {
+		clear_bit(chan->address, &st->thresh_en[dir - 1]);
+	}
+
+	return 0;
+}
+
+static int ti_ads7950_read_event_value(struct iio_dev *indio_dev,
+				       const struct iio_chan_spec *chan,
+				       enum iio_event_type type,
+				       enum iio_event_direction dir,
+				       enum iio_event_info info,
+				       int *val, int *val2)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+
+	if (info == IIO_EV_INFO_HYSTERESIS)
+		*val = st->hyst[chan->address];
+	else
+		*val = st->thresh[dir - 1][chan->address];
+
+	return IIO_VAL_INT;
+}
+
+static int ti_ads7950_write_event_value(struct iio_dev *indio_dev,
+					const struct iio_chan_spec *chan,
+					enum iio_event_type type,
+					enum iio_event_direction dir,
+					enum iio_event_info info,
+					int val, int val2)
+{
+	struct ti_ads7950_state *st = iio_priv(indio_dev);
+
+	if (val < 0 || val >= BIT(chan->scan_type.realbits))
+		return -EINVAL;
+
+	if (info == IIO_EV_INFO_HYSTERESIS)
+		WRITE_ONCE(st->hyst[chan->address], val);
+	else
+		WRITE_ONCE(st->thresh[dir - 1][chan->address], val);
+
+	return 0;
+}
+
 static const struct iio_info ti_ads7950_info = {
 	.read_raw		= &ti_ads7950_read_raw,
+	.read_raw_channels	= ti_ads7950_read_raw_channels,
+	.write_raw		= &ti_ads7950_write_raw,
+	.read_avail		= &ti_ads7950_read_avail,
+	.read_event_config	= ti_ads7950_read_event_config,
+	.write_event_config	= ti_ads7950_write_event_config,
+	.read_event_value	= ti_ads7950_read_event_value,
+	.write_event_value	= ti_ads7950_write_event_value,
 	.update_scan_mode	= ti_ads7950_update_scan_mode,
 	.driver_module		= THIS_MODULE,
 };
@@ -392,6 +993,7 @@ static int ti_ads7950_probe(struct spi_device *spi)
 
 	st->spi = spi;
 	st->settings = TI_ADS7950_CR_MANUAL | TI_ADS7950_CR_RANGE_5V;
+	st->oversampling = 1;
 
 	info = &ti_ads7950_chip_info[spi_get_device_id(spi)->driver_data];
 
@@ -439,8 +1041,9 @@ static int ti_ads7950_probe(struct spi_device *spi)
 		return ret;
 	}
 
-	ret = iio_triggered_buffer_setup(indio_dev, NULL,
-					 &ti_ads7950_trigger_handler, NULL);
+	init_completion(&st->ring_done);
+
+	ret = ti_ads7950_buffer_setup(indio_dev);
 	if (ret) {
 		dev_err(&spi->dev, "Failed to setup triggered buffer\n");
 		goto error_disable_reg;
@@ -455,7 +1058,7 @@ static int ti_ads7950_probe(struct spi_device *spi)
 	return 0;
 
 error_cleanup_ring:
-	iio_triggered_buffer_cleanup(indio_dev);
+	ti_ads7950_buffer_cleanup(indio_dev);
 error_disable_reg:
 	regulator_disable(st->reg);
 
@@ -468,7 +1071,7 @@ static int ti_ads7950_remove(struct spi_device *spi)
 	struct ti_ads7950_state *st = iio_priv(indio_dev);
 
 	iio_device_unregister(indio_dev);
-	iio_triggered_buffer_cleanup(indio_dev);
+	ti_ads7950_buffer_cleanup(indio_dev);
 	regulator_disable(st->reg);
 
 	return 0;
@@ -13,6 +13,8 @@
 #include <linux/mutex.h>
 #include <linux/sched.h>
 #include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
 #include <linux/iio/buffer.h>
 #include <linux/iio/buffer_impl.h>
 #include <linux/iio/buffer-dma.h>
@@ -90,6 +92,12 @@
  * has special requirements that are not handled by the generic functions. If a
  * driver chooses to overload a callback it has to ensure that the generic
  * callback is called from within the custom callback.
+ *
+ * Instead of read(), applications can also map the fileio blocks and exchange
+ * them with the block ioctls, see include/uapi/linux/iio/buffer.h. A dequeued
+ * block is owned by the application until it enqueues it again. Each mapping
+ * holds a reference to its block, so the memory stays valid even when the
+ * block is replaced by the next request_update().
  */
 
 static void iio_buffer_block_release(struct kref *kref)
@@ -529,6 +537,227 @@ int iio_dma_buffer_read(struct iio_buffer *buffer, size_t n,
 }
 EXPORT_SYMBOL_GPL(iio_dma_buffer_read);
 
+static int iio_dma_buffer_block_id(struct iio_dma_buffer_queue *queue,
+	struct iio_dma_buffer_block *block)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(queue->fileio.blocks); i++) {
+		if (queue->fileio.blocks[i] == block)
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+static void iio_dma_buffer_block_info(struct iio_dma_buffer_queue *queue,
+	unsigned int id, struct iio_buffer_block *info)
+{
+	struct iio_dma_buffer_block *block = queue->fileio.blocks[id];
+
+	info->id = id;
+	info->size = block->size;
+	info->bytes_used = block->state == IIO_BLOCK_STATE_DEQUEUED ?
+		block->bytes_used : 0;
+	info->flags = 0;
+	info->offset = id * PAGE_ALIGN(queue->fileio.block_size);
+}
+
+static int iio_dma_buffer_query_block(struct iio_dma_buffer_queue *queue,
+	struct iio_buffer_block *info)
+{
+	int ret = 0;
+
+	mutex_lock(&queue->lock);
+	if (info->id < ARRAY_SIZE(queue->fileio.blocks) &&
+	    queue->fileio.blocks[info->id])
+		iio_dma_buffer_block_info(queue, info->id, info);
+	else
+		ret = -EINVAL;
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+
+static int iio_dma_buffer_enqueue_block(struct iio_dma_buffer_queue *queue,
+	unsigned int id)
+{
+	struct iio_dma_buffer_block *block;
+	int ret = 0;
+
+	mutex_lock(&queue->lock);
+
+	if (id >= ARRAY_SIZE(queue->fileio.blocks)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	block = queue->fileio.blocks[id];
+	if (!block || block->state != IIO_BLOCK_STATE_DEQUEUED ||
+	    block == queue->fileio.active_block) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	iio_dma_buffer_enqueue(queue, block);
+
+out_unlock:
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+
+static bool iio_dma_buffer_has_done(struct iio_dma_buffer_queue *queue)
+{
+	return !queue->ops || !list_empty_careful(&queue->outgoing);
+}
+
+static int iio_dma_buffer_dequeue_block(struct iio_dma_buffer_queue *queue,
+	struct iio_buffer_block *info, bool nonblock)
+{
+	struct iio_dma_buffer_block *block;
+	int ret;
+
+	for (;;) {
+		mutex_lock(&queue->lock);
+		if (!queue->ops) {
+			mutex_unlock(&queue->lock);
+			return -ENODEV;
+		}
+
+		block = iio_dma_buffer_dequeue(queue);
+		if (block) {
+			ret = iio_dma_buffer_block_id(queue, block);
+			if (ret >= 0) {
+				iio_dma_buffer_block_info(queue, ret, info);
+				ret = 0;
+			}
+			mutex_unlock(&queue->lock);
+			return ret;
+		}
+		mutex_unlock(&queue->lock);
+
+		if (nonblock)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(queue->buffer.pollq,
+			iio_dma_buffer_has_done(queue));
+		if (ret)
+			return ret;
+	}
+}
+
+/**
+ * iio_dma_buffer_ioctl() - DMA buffer ioctl callback
+ * @buffer: Buffer the ioctl is for
+ * @cmd: One of the IIO_BUFFER_BLOCK_*_IOCTL commands
+ * @arg: Userspace pointer to a struct iio_buffer_block
+ * @nonblock: Whether IIO_BUFFER_BLOCK_DEQUEUE_IOCTL may sleep
+ *
+ * Should be used as the ioctl callback for iio_buffer_access_ops struct for
+ * DMA buffers that support block access.
+ */
+long iio_dma_buffer_ioctl(struct iio_buffer *buffer, unsigned int cmd,
+	unsigned long arg, bool nonblock)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	void __user *uinfo = (void __user *)arg;
+	struct iio_buffer_block info;
+	int ret;
+
+	switch (cmd) {
+	case IIO_BUFFER_BLOCK_QUERY_IOCTL:
+		if (copy_from_user(&info, uinfo, sizeof(info)))
+			return -EFAULT;
+		ret = iio_dma_buffer_query_block(queue, &info);
+		break;
+	case IIO_BUFFER_BLOCK_ENQUEUE_IOCTL:
+		if (copy_from_user(&info, uinfo, sizeof(info)))
+			return -EFAULT;
+		return iio_dma_buffer_enqueue_block(queue, info.id);
+	case IIO_BUFFER_BLOCK_DEQUEUE_IOCTL:
+		ret = iio_dma_buffer_dequeue_block(queue, &info, nonblock);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (ret)
+		return ret;
+
+	if (copy_to_user(uinfo, &info, sizeof(info)))
+		return -EFAULT;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_ioctl);
+
+static void iio_dma_buffer_vm_open(struct vm_area_struct *vma)
+{
+	iio_buffer_block_get(vma->vm_private_data);
+}
+
+static void iio_dma_buffer_vm_close(struct vm_area_struct *vma)
+{
+	iio_buffer_block_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct iio_dma_buffer_vm_ops = {
+	.open = iio_dma_buffer_vm_open,
+	.close = iio_dma_buffer_vm_close,
+};
+
+/**
+ * iio_dma_buffer_mmap() - DMA buffer mmap callback
+ * @buffer: Buffer to map
+ * @vma: Area to map one of the blocks to
+ *
+ * The mmap offset selects the block, as reported by
+ * IIO_BUFFER_BLOCK_QUERY_IOCTL. Should be used as the mmap callback for
+ * iio_buffer_access_ops struct for DMA buffers that support block access.
+ */
+int iio_dma_buffer_mmap(struct iio_buffer *buffer,
+	struct vm_area_struct *vma)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	struct iio_dma_buffer_block *block = NULL;
+	size_t block_size;
+	int ret;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	mutex_lock(&queue->lock);
+
+	block_size = PAGE_ALIGN(queue->fileio.block_size);
+	if (block_size && offset % block_size == 0 &&
+	    offset / block_size < ARRAY_SIZE(queue->fileio.blocks))
+		block = queue->fileio.blocks[offset / block_size];
+
+	if (!block || vma->vm_end - vma->vm_start > PAGE_ALIGN(block->size)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	/* The offset only selects the block, map it from its start */
+	vma->vm_pgoff = 0;
+	ret = dma_mmap_coherent(queue->dev, vma, block->vaddr,
+		block->phys_addr, vma->vm_end - vma->vm_start);
+	if (ret)
+		goto out_unlock;
+
+	vma->vm_private_data = block;
+	vma->vm_ops = &iio_dma_buffer_vm_ops;
+	iio_buffer_block_get(block);
+
+out_unlock:
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_mmap);
+
 /**
  * iio_dma_buffer_data_available() - DMA buffer data_available callback
  * @buf: Buffer to check for data availability
@@ -116,6 +116,8 @@ static const struct iio_buffer_access_funcs iio_dmaengine_buffer_ops = {
 	.disable = iio_dma_buffer_disable,
 	.data_available = iio_dma_buffer_data_available,
 	.release = iio_dmaengine_buffer_release,
+	.ioctl = iio_dma_buffer_ioctl,
+	.mmap = iio_dma_buffer_mmap,
 
 	.modes = INDIO_BUFFER_HARDWARE,
 	.flags = INDIO_BUFFER_FLAG_FIXED_WATERMARK,
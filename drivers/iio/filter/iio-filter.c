@@ -0,0 +1,740 @@
+/*
+ * IIO filter stage driver
+ *
+ * Taps the buffer of another IIO device through a callback buffer, runs
+ * every channel through a median, moving average and first order IIR low
+ * pass filter chain, and offers the result as a derived IIO device. Each
+ * stage is configured per channel and turned off at length 1 or shift 0:
+ *
+ *   filter_median_len	median of the last 1-9 raw samples
+ *   filter_average_len	mean of the last 1-16 median outputs
+ *   filter_iir_shift	y += (x - y) / 2^shift, for shift 0-12
+ *
+ * Filtered values can be read from the buffer of the derived device, or
+ * just watched with rising and falling threshold events, so user space
+ * no longer has to copy out and filter every raw sample. The scale and
+ * offset of the parent channels apply unchanged.
+ *
+ * The parent device must be sampling, e.g. with a trigger assigned; the
+ * callback buffer runs while the derived buffer or any event is enabled.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/bitops.h>
+#include <linux/err.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/consumer.h>
+#include <linux/iio/events.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/kfifo_buf.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <asm/unaligned.h>
+
+#define IIO_FILTER_MAX_CHANNELS	16
+#define IIO_FILTER_MEDIAN_MAX	9
+#define IIO_FILTER_AVERAGE_MAX	16
+#define IIO_FILTER_IIR_SHIFT_MAX	12
+
+enum {
+	IIO_FILTER_MEDIAN_LEN,
+	IIO_FILTER_AVERAGE_LEN,
+	IIO_FILTER_IIR_SHIFT,
+};
+
+/* indices for the per direction threshold state */
+enum {
+	IIO_FILTER_RISING,
+	IIO_FILTER_FALLING,
+	IIO_FILTER_NUM_DIR
+};
+
+struct iio_filter_chan {
+	const struct iio_chan_spec *parent;
+	/* where the parent sample is in a scan from the callback buffer */
+	unsigned int offset;
+
+	unsigned int median_len;
+	unsigned int average_len;
+	unsigned int iir_shift;
+
+	int median_hist[IIO_FILTER_MEDIAN_MAX];
+	unsigned int median_pos;
+	unsigned int median_fill;
+	int average_hist[IIO_FILTER_AVERAGE_MAX];
+	unsigned int average_pos;
+	unsigned int average_fill;
+	s64 average_sum;
+	s64 iir_state;
+
+	int value;
+	bool valid;
+
+	int thresh[IIO_FILTER_NUM_DIR];
+	bool thresh_en[IIO_FILTER_NUM_DIR];
+};
+
+struct iio_filter {
+	struct iio_cb_buffer *cb_buffer;
+	struct iio_channel *parent;
+	struct iio_filter_chan *chan;
+	unsigned int num_chans;
+	unsigned long scan_mask[2];
+	/* filtered values and room for an aligned timestamp */
+	s32 *scan;
+
+	/* protects the settings below and starting the callback buffer */
+	struct mutex lock;
+	bool buffer_on;
+	bool running;
+
+	/* protects the filter state against the callback */
+	spinlock_t filter_lock;
+};
+
+static void iio_filter_reset_chan(struct iio_filter_chan *fc)
+{
+	fc->median_pos = 0;
+	fc->median_fill = 0;
+	fc->average_pos = 0;
+	fc->average_fill = 0;
+	fc->average_sum = 0;
+	fc->iir_state = 0;
+	fc->valid = false;
+}
+
+static int iio_filter_read_sample(const struct iio_chan_spec *chan,
+				  const u8 *data)
+{
+	const struct iio_scan_type *st = &chan->scan_type;
+	u32 raw;
+
+	switch (st->storagebits) {
+	case 8:
+		raw = *data;
+		break;
+	case 16:
+		if (st->endianness == IIO_BE)
+			raw = get_unaligned_be16(data);
+		else if (st->endianness == IIO_LE)
+			raw = get_unaligned_le16(data);
+		else
+			raw = *(const u16 *)data;
+		break;
+	default:
+		if (st->endianness == IIO_BE)
+			raw = get_unaligned_be32(data);
+		else if (st->endianness == IIO_LE)
+			raw = get_unaligned_le32(data);
+		else
+			raw = *(const u32 *)data;
+		break;
+	}
+
+	raw >>= st->shift;
+	if (st->sign == 's')
+		return sign_extend32(raw, st->realbits - 1);
+
+	return raw & GENMASK(st->realbits - 1, 0);
+}
+
+static int iio_filter_cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Runs one raw sample through the chain, called with filter_lock held. */
+static int iio_filter_apply(struct iio_filter_chan *fc, int x)
+{
+	if (fc->median_len > 1) {
+		int sorted[IIO_FILTER_MEDIAN_MAX];
+
+		fc->median_hist[fc->median_pos] = x;
+		if (++fc->median_pos >= fc->median_len)
+			fc->median_pos = 0;
+		if (fc->median_fill < fc->median_len)
+			fc->median_fill++;
+
+		memcpy(sorted, fc->median_hist,
+		       fc->median_fill * sizeof(*sorted));
+		sort(sorted, fc->median_fill, sizeof(*sorted),
+		     iio_filter_cmp_int, NULL);
+		x = sorted[fc->median_fill / 2];
+	}
+
+	if (fc->average_len > 1) {
+		if (fc->average_fill < fc->average_len)
+			fc->average_fill++;
+		else
+			fc->average_sum -= fc->average_hist[fc->average_pos];
+		fc->average_hist[fc->average_pos] = x;
+		fc->average_sum += x;
+		if (++fc->average_pos >= fc->average_len)
+			fc->average_pos = 0;
+
+		x = div_s64(fc->average_sum, fc->average_fill);
+	}
+
+	if (fc->iir_shift) {
+		/* the state keeps 16 fractional bits */
+		if (!fc->valid)
+			fc->iir_state = (s64)x << 16;
+		else
+			fc->iir_state += (((s64)x << 16) - fc->iir_state)
+					 >> fc->iir_shift;
+		x = (fc->iir_state + (1 << 15)) >> 16;
+	}
+
+	return x;
+}
+
+static void iio_filter_check_thresh(struct iio_dev *indio_dev,
+				    struct iio_filter_chan *fc, int prev,
+				    bool prev_valid, s64 timestamp)
+{
+	const struct iio_chan_spec *chan = fc->parent;
+
+	if (!prev_valid)
+		return;
+
+	if (fc->thresh_en[IIO_FILTER_RISING] &&
+	    prev <= fc->thresh[IIO_FILTER_RISING] &&
+	    fc->value > fc->thresh[IIO_FILTER_RISING])
+		iio_push_event(indio_dev,
+			       IIO_UNMOD_EVENT_CODE(chan->type, chan->channel,
+						    IIO_EV_TYPE_THRESH,
+						    IIO_EV_DIR_RISING),
+			       timestamp);
+
+	if (fc->thresh_en[IIO_FILTER_FALLING] &&
+	    prev >= fc->thresh[IIO_FILTER_FALLING] &&
+	    fc->value < fc->thresh[IIO_FILTER_FALLING])
+		iio_push_event(indio_dev,
+			       IIO_UNMOD_EVENT_CODE(chan->type, chan->channel,
+						    IIO_EV_TYPE_THRESH,
+						    IIO_EV_DIR_FALLING),
+			       timestamp);
+}
+
+static int iio_filter_buffer_cb(const void *data, void *private)
+{
+	struct iio_dev *indio_dev = private;
+	struct iio_filter *filt = iio_priv(indio_dev);
+	s64 timestamp = iio_get_time_ns(indio_dev);
+	const u8 *scan = data;
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&filt->filter_lock, flags);
+	for (i = 0; i < filt->num_chans; i++) {
+		struct iio_filter_chan *fc = &filt->chan[i];
+		bool prev_valid = fc->valid;
+		int prev = fc->value;
+		int x;
+
+		x = iio_filter_read_sample(fc->parent, scan + fc->offset);
+		fc->value = iio_filter_apply(fc, x);
+		fc->valid = true;
+		filt->scan[i] = fc->value;
+
+		iio_filter_check_thresh(indio_dev, fc, prev, prev_valid,
+					timestamp);
+	}
+	spin_unlock_irqrestore(&filt->filter_lock, flags);
+
+	if (iio_buffer_enabled(indio_dev))
+		iio_push_to_buffers_with_timestamp(indio_dev, filt->scan,
+						   timestamp);
+
+	return 0;
+}
+
+/* Starts or stops the callback buffer as needed, with filt->lock held. */
+static int iio_filter_update(struct iio_filter *filt)
+{
+	bool run = filt->buffer_on;
+	unsigned long flags;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < filt->num_chans; i++)
+		run |= filt->chan[i].thresh_en[IIO_FILTER_RISING] ||
+		       filt->chan[i].thresh_en[IIO_FILTER_FALLING];
+
+	if (run == filt->running)
+		return 0;
+
+	if (run) {
+		spin_lock_irqsave(&filt->filter_lock, flags);
+		for (i = 0; i < filt->num_chans; i++)
+			iio_filter_reset_chan(&filt->chan[i]);
+		spin_unlock_irqrestore(&filt->filter_lock, flags);
+
+		ret = iio_channel_start_all_cb(filt->cb_buffer);
+		if (ret)
+			return ret;
+	} else {
+		iio_channel_stop_all_cb(filt->cb_buffer);
+	}
+	filt->running = run;
+
+	return 0;
+}
+
+static int iio_filter_read_raw(struct iio_dev *indio_dev,
+			       struct iio_chan_spec const *chan,
+			       int *val, int *val2, long mask)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	struct iio_channel *parent = &filt->parent[chan->scan_index];
+	struct iio_filter_chan *fc = &filt->chan[chan->scan_index];
+	unsigned long flags;
+	bool valid;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		/* the latest filtered value, or a raw sample when idle */
+		spin_lock_irqsave(&filt->filter_lock, flags);
+		valid = fc->valid;
+		*val = fc->value;
+		spin_unlock_irqrestore(&filt->filter_lock, flags);
+		if (valid)
+			return IIO_VAL_INT;
+		return iio_read_channel_raw(parent, val);
+	case IIO_CHAN_INFO_SCALE:
+		return iio_read_channel_scale(parent, val, val2);
+	case IIO_CHAN_INFO_OFFSET:
+		return iio_read_channel_offset(parent, val, val2);
+	}
+
+	return -EINVAL;
+}
+
+static int iio_filter_read_event_config(struct iio_dev *indio_dev,
+					const struct iio_chan_spec *chan,
+					enum iio_event_type type,
+					enum iio_event_direction dir)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	struct iio_filter_chan *fc = &filt->chan[chan->scan_index];
+
+	return fc->thresh_en[dir == IIO_EV_DIR_RISING ? IIO_FILTER_RISING
+						       : IIO_FILTER_FALLING];
+}
+
+static int iio_filter_write_event_config(struct iio_dev *indio_dev,
+					 const struct iio_chan_spec *chan,
+					 enum iio_event_type type,
+					 enum iio_event_direction dir,
+					 int state)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	struct iio_filter_chan *fc = &filt->chan[chan->scan_index];
+	int d = dir == IIO_EV_DIR_RISING ? IIO_FILTER_RISING
+					 : IIO_FILTER_FALLING;
+	bool old;
+	int ret;
+
+	mutex_lock(&filt->lock);
+	old = fc->thresh_en[d];
+	fc->thresh_en[d] = state;
+	ret = iio_filter_update(filt);
+	if (ret)
+		fc->thresh_en[d] = old;
+	mutex_unlock(&filt->lock);
+
+	return ret;
+}
+
+static int iio_filter_read_event_value(struct iio_dev *indio_dev,
+				       const struct iio_chan_spec *chan,
+				       enum iio_event_type type,
+				       enum iio_event_direction dir,
+				       enum iio_event_info info,
+				       int *val, int *val2)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	struct iio_filter_chan *fc = &filt->chan[chan->scan_index];
+
+	*val = fc->thresh[dir == IIO_EV_DIR_RISING ? IIO_FILTER_RISING
+						   : IIO_FILTER_FALLING];
+
+	return IIO_VAL_INT;
+}
+
+static int iio_filter_write_event_value(struct iio_dev *indio_dev,
+					const struct iio_chan_spec *chan,
+					enum iio_event_type type,
+					enum iio_event_direction dir,
+					enum iio_event_info info,
+					int val, int val2)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	struct iio_filter_chan *fc = &filt->chan[chan->scan_index];
+	unsigned long flags;
+
+	spin_lock_irqsave(&filt->filter_lock, flags);
+	fc->thresh[dir == IIO_EV_DIR_RISING ? IIO_FILTER_RISING
+					    : IIO_FILTER_FALLING] = val;
+	spin_unlock_irqrestore(&filt->filter_lock, flags);
+
+	return 0;
+}
+
+static const struct iio_info iio_filter_info = {
+	.driver_module = THIS_MODULE,
+	.read_raw = iio_filter_read_raw,
+	.read_event_config = iio_filter_read_event_config,
+	.write_event_config = iio_filter_write_event_config,
+	.read_event_value = iio_filter_read_event_value,
+	.write_event_value = iio_filter_write_event_value,
+};
+
+static ssize_t iio_filter_read_param(struct iio_dev *indio_dev,
+				     uintptr_t private,
+				     struct iio_chan_spec const *chan,
+				     char *buf)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	struct iio_filter_chan *fc = &filt->chan[chan->scan_index];
+	unsigned int val;
+
+	switch (private) {
+	case IIO_FILTER_MEDIAN_LEN:
+		val = fc->median_len;
+		break;
+	case IIO_FILTER_AVERAGE_LEN:
+		val = fc->average_len;
+		break;
+	default:
+		val = fc->iir_shift;
+		break;
+	}
+
+	return sprintf(buf, "%u\n", val);
+}
+
+static ssize_t iio_filter_write_param(struct iio_dev *indio_dev,
+				      uintptr_t private,
+				      struct iio_chan_spec const *chan,
+				      const char *buf, size_t len)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	struct iio_filter_chan *fc = &filt->chan[chan->scan_index];
+	unsigned long flags;
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	switch (private) {
+	case IIO_FILTER_MEDIAN_LEN:
+		if (!val || val > IIO_FILTER_MEDIAN_MAX)
+			return -EINVAL;
+		break;
+	case IIO_FILTER_AVERAGE_LEN:
+		if (!val || val > IIO_FILTER_AVERAGE_MAX)
+			return -EINVAL;
+		break;
+	default:
+		if (val > IIO_FILTER_IIR_SHIFT_MAX)
+			return -EINVAL;
+		break;
+	}
+
+	/* the history no longer fits the chain, start over */
+	spin_lock_irqsave(&filt->filter_lock, flags);
+	switch (private) {
+	case IIO_FILTER_MEDIAN_LEN:
+		fc->median_len = val;
+		break;
+	case IIO_FILTER_AVERAGE_LEN:
+		fc->average_len = val;
+		break;
+	default:
+		fc->iir_shift = val;
+		break;
+	}
+	iio_filter_reset_chan(fc);
+	spin_unlock_irqrestore(&filt->filter_lock, flags);
+
+	return len;
+}
+
+static const struct iio_chan_spec_ext_info iio_filter_ext_info[] = {
+	{
+		.name = "filter_median_len",
+		.shared = IIO_SEPARATE,
+		.read = iio_filter_read_param,
+		.write = iio_filter_write_param,
+		.private = IIO_FILTER_MEDIAN_LEN,
+	},
+	{
+		.name = "filter_average_len",
+		.shared = IIO_SEPARATE,
+		.read = iio_filter_read_param,
+		.write = iio_filter_write_param,
+		.private = IIO_FILTER_AVERAGE_LEN,
+	},
+	{
+		.name = "filter_iir_shift",
+		.shared = IIO_SEPARATE,
+		.read = iio_filter_read_param,
+		.write = iio_filter_write_param,
+		.private = IIO_FILTER_IIR_SHIFT,
+	},
+	{ }
+};
+
+static const struct iio_event_spec iio_filter_events[] = {
+	{
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_RISING,
+		.mask_separate = BIT(IIO_EV_INFO_VALUE) |
+				 BIT(IIO_EV_INFO_ENABLE),
+	},
+	{
+		.type = IIO_EV_TYPE_THRESH,
+		.dir = IIO_EV_DIR_FALLING,
+		.mask_separate = BIT(IIO_EV_INFO_VALUE) |
+				 BIT(IIO_EV_INFO_ENABLE),
+	},
+};
+
+static int iio_filter_buffer_preenable(struct iio_dev *indio_dev)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	int ret;
+
+	mutex_lock(&filt->lock);
+	filt->buffer_on = true;
+	ret = iio_filter_update(filt);
+	if (ret)
+		filt->buffer_on = false;
+	mutex_unlock(&filt->lock);
+
+	return ret;
+}
+
+static int iio_filter_buffer_postdisable(struct iio_dev *indio_dev)
+{
+	struct iio_filter *filt = iio_priv(indio_dev);
+	int ret;
+
+	mutex_lock(&filt->lock);
+	filt->buffer_on = false;
+	ret = iio_filter_update(filt);
+	mutex_unlock(&filt->lock);
+
+	return ret;
+}
+
+static const struct iio_buffer_setup_ops iio_filter_buffer_setup_ops = {
+	.preenable = iio_filter_buffer_preenable,
+	.postdisable = iio_filter_buffer_postdisable,
+};
+
+static void iio_filter_release_cb(void *data)
+{
+	iio_channel_release_all_cb(data);
+}
+
+/* After unregistering, events may still keep the callback buffer going. */
+static void iio_filter_stop(void *data)
+{
+	struct iio_filter *filt = data;
+
+	if (filt->running)
+		iio_channel_stop_all_cb(filt->cb_buffer);
+}
+
+static bool iio_filter_parent_has_info(const struct iio_chan_spec *chan,
+				       enum iio_chan_info_enum type)
+{
+	return (chan->info_mask_separate | chan->info_mask_shared_by_type |
+		chan->info_mask_shared_by_dir |
+		chan->info_mask_shared_by_all) & BIT(type);
+}
+
+static int iio_filter_scan_index_cmp(const void *a, const void *b)
+{
+	const struct iio_filter_chan *x = a, *y = b;
+
+	return x->parent->scan_index - y->parent->scan_index;
+}
+
+static int iio_filter_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct iio_chan_spec *chans;
+	struct iio_filter_chan *sorted;
+	struct iio_buffer *buffer;
+	struct iio_filter *filt;
+	struct iio_dev *indio_dev;
+	unsigned int i, n, offset;
+	int ret;
+
+	indio_dev = devm_iio_device_alloc(dev, sizeof(*filt));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	filt = iio_priv(indio_dev);
+	mutex_init(&filt->lock);
+	spin_lock_init(&filt->filter_lock);
+
+	filt->cb_buffer = iio_channel_get_all_cb(dev, iio_filter_buffer_cb,
+						 indio_dev);
+	if (IS_ERR(filt->cb_buffer)) {
+		ret = PTR_ERR(filt->cb_buffer);
+		/*
+		 * A missing DT provider already gives -EPROBE_DEFER, so here
+		 * -ENODEV means there are no io-channels. Without DT, the
+		 * provider may just not have registered its maps yet.
+		 */
+		if (ret != -ENODEV)
+			return ret;
+		if (!dev->of_node)
+			return -EPROBE_DEFER;
+		dev_err(dev, "no io-channels\n");
+		return ret;
+	}
+
+	ret = devm_add_action_or_reset(dev, iio_filter_release_cb,
+				       filt->cb_buffer);
+	if (ret)
+		return ret;
+
+	filt->parent = iio_channel_cb_get_channels(filt->cb_buffer);
+	for (n = 0; filt->parent[n].indio_dev; n++) {
+		const struct iio_chan_spec *chan = filt->parent[n].channel;
+
+		if (chan->scan_index < 0 ||
+		    chan->scan_type.storagebits > 32 ||
+		    chan->scan_type.storagebits % 8) {
+			dev_err(dev, "channel %u can't be buffered\n", n);
+			return -EINVAL;
+		}
+	}
+	if (!n || n > IIO_FILTER_MAX_CHANNELS) {
+		dev_err(dev, "need 1 to %d channels\n",
+			IIO_FILTER_MAX_CHANNELS);
+		return -EINVAL;
+	}
+	filt->num_chans = n;
+
+	filt->chan = devm_kcalloc(dev, n, sizeof(*filt->chan), GFP_KERNEL);
+	sorted = devm_kcalloc(dev, n, sizeof(*sorted), GFP_KERNEL);
+	chans = devm_kcalloc(dev, n + 1, sizeof(*chans), GFP_KERNEL);
+	filt->scan = devm_kzalloc(dev, ALIGN(n * sizeof(s32), sizeof(s64)) +
+				  sizeof(s64), GFP_KERNEL);
+	if (!filt->chan || !sorted || !chans || !filt->scan)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		const struct iio_chan_spec *parent = filt->parent[i].channel;
+		struct iio_filter_chan *fc = &filt->chan[i];
+		struct iio_chan_spec *chan = &chans[i];
+
+		fc->parent = parent;
+		fc->median_len = 1;
+		fc->average_len = 1;
+
+		chan->type = parent->type;
+		chan->indexed = parent->indexed;
+		chan->channel = parent->channel;
+		chan->info_mask_separate = BIT(IIO_CHAN_INFO_RAW);
+		if (iio_filter_parent_has_info(parent, IIO_CHAN_INFO_SCALE))
+			chan->info_mask_separate |= BIT(IIO_CHAN_INFO_SCALE);
+		if (iio_filter_parent_has_info(parent, IIO_CHAN_INFO_OFFSET))
+			chan->info_mask_separate |= BIT(IIO_CHAN_INFO_OFFSET);
+		chan->scan_index = i;
+		chan->scan_type.sign = 's';
+		chan->scan_type.realbits = 32;
+		chan->scan_type.storagebits = 32;
+		chan->scan_type.endianness = IIO_CPU;
+		chan->ext_info = iio_filter_ext_info;
+		chan->event_spec = iio_filter_events;
+		chan->num_event_specs = ARRAY_SIZE(iio_filter_events);
+	}
+	chans[n].type = IIO_TIMESTAMP;
+	chans[n].channel = -1;
+	chans[n].scan_index = n;
+	chans[n].scan_type.sign = 's';
+	chans[n].scan_type.realbits = 64;
+	chans[n].scan_type.storagebits = 64;
+
+	/*
+	 * The callback buffer gets the parent channels in scan order, each
+	 * aligned to its own size, which needn't be the order they were
+	 * listed in.
+	 */
+	for (i = 0; i < n; i++)
+		sorted[i].parent = filt->parent[i].channel;
+	sort(sorted, n, sizeof(*sorted), iio_filter_scan_index_cmp, NULL);
+	for (i = 0, offset = 0; i < n; i++) {
+		const struct iio_chan_spec *parent = sorted[i].parent;
+		unsigned int bytes = parent->scan_type.storagebits / 8;
+		unsigned int j;
+
+		offset = ALIGN(offset, bytes);
+		for (j = 0; j < n; j++)
+			if (filt->chan[j].parent == parent)
+				filt->chan[j].offset = offset;
+		offset += bytes;
+	}
+	devm_kfree(dev, sorted);
+
+	/* always push all channels, the core demuxes what was enabled */
+	filt->scan_mask[0] = GENMASK(n - 1, 0);
+
+	indio_dev->name = dev_name(dev);
+	indio_dev->dev.parent = dev;
+	indio_dev->info = &iio_filter_info;
+	indio_dev->modes = INDIO_DIRECT_MODE | INDIO_BUFFER_SOFTWARE;
+	indio_dev->channels = chans;
+	indio_dev->num_channels = n + 1;
+	indio_dev->available_scan_masks = filt->scan_mask;
+	indio_dev->setup_ops = &iio_filter_buffer_setup_ops;
+
+	buffer = devm_iio_kfifo_allocate(dev);
+	if (!buffer)
+		return -ENOMEM;
+	iio_device_attach_buffer(indio_dev, buffer);
+
+	ret = devm_add_action_or_reset(dev, iio_filter_stop, filt);
+	if (ret)
+		return ret;
+
+	return devm_iio_device_register(dev, indio_dev);
+}
+
+static const struct of_device_id iio_filter_match[] = {
+	{ .compatible = "io-channel-filter" },
+	{ /* sentinel */ },
+};
+MODULE_DEVICE_TABLE(of, iio_filter_match);
+
+static struct platform_driver iio_filter_driver = {
+	.probe = iio_filter_probe,
+	.driver = {
+		.name = "iio-filter",
+		.of_match_table = iio_filter_match,
+	},
+};
+module_platform_driver(iio_filter_driver);
+
+MODULE_DESCRIPTION("IIO median, average and IIR filter stage");
+MODULE_LICENSE("GPL v2");
@@ -28,6 +28,9 @@
 #include <linux/iio/buffer.h>
 #include <linux/iio/buffer_impl.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/iio.h>
+
 static const char * const iio_endian_prefix[] = {
 	[IIO_BE] = "be",
 	[IIO_LE] = "le",
@@ -157,6 +160,8 @@ ssize_t iio_buffer_read_first_n_outer(struct file *filp, char __user *buf,
 	} while (ret == 0);
 	remove_wait_queue(&rb->pollq, &wait);
 
+	trace_iio_buffer_read(indio_dev, ret);
+
 	return ret;
 }
 
@@ -184,6 +189,48 @@ unsigned int iio_buffer_poll(struct file *filp,
 	return 0;
 }
 
+/**
+ * iio_buffer_ioctl() - buffer block access ioctls
+ * @indio_dev:	The IIO device
+ * @filp:	File structure pointer for the char device
+ * @cmd:	ioctl command
+ * @arg:	ioctl argument
+ *
+ * Return: -EINVAL if the buffer doesn't do block access, else the result of
+ *	   the buffer's ioctl callback.
+ */
+long iio_buffer_ioctl(struct iio_dev *indio_dev, struct file *filp,
+		      unsigned int cmd, unsigned long arg)
+{
+	struct iio_buffer *rb = indio_dev->buffer;
+
+	if (!rb || !rb->access->ioctl)
+		return -EINVAL;
+
+	return rb->access->ioctl(rb, cmd, arg, filp->f_flags & O_NONBLOCK);
+}
+
+/**
+ * iio_buffer_mmap() - chrdev mmap for buffer block access
+ * @filp:	File structure pointer for the char device
+ * @vma:	Area the application wants the buffer mapped at
+ *
+ * Return: 0 on success, -ENODEV if the buffer can't be mapped.
+ */
+int iio_buffer_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct iio_dev *indio_dev = filp->private_data;
+	struct iio_buffer *rb = indio_dev->buffer;
+
+	if (!indio_dev->info)
+		return -ENODEV;
+
+	if (!rb || !rb->access->mmap)
+		return -ENODEV;
+
+	return rb->access->mmap(rb, vma);
+}
+
 /**
  * iio_buffer_wakeup_poll - Wakes up the buffer waitqueue
  * @indio_dev: The IIO device
@@ -1395,6 +1442,8 @@ int iio_push_to_buffers(struct iio_dev *indio_dev, const void *data)
 	int ret;
 	struct iio_buffer *buf;
 
+	trace_iio_buffer_push(indio_dev);
+
 	list_for_each_entry(buf, &indio_dev->buffer_list, buffer_list) {
 		ret = iio_push_to_buffer(buf, data);
 		if (ret < 0)
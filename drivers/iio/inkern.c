@@ -716,6 +716,93 @@ int iio_read_channel_processed(struct iio_channel *chan, int *val)
 }
 EXPORT_SYMBOL_GPL(iio_read_channel_processed);
 
+/* Most channels read by a single read_raw_channels() call */
+#define IIO_READ_CHANNELS_MAX	16
+
+/*
+ * Reads the channels in one read_raw_channels() call if they share a device
+ * that has it, -EOPNOTSUPP if they don't. Called with the info_exist_lock of
+ * that device held.
+ */
+static int iio_channels_read_batch(struct iio_channel *const *chans,
+				   unsigned int num, int *vals, bool processed)
+{
+	struct iio_chan_spec const *specs[IIO_READ_CHANNELS_MAX];
+	struct iio_dev *indio_dev = chans[0]->indio_dev;
+	unsigned int i;
+	int ret;
+
+	if (!indio_dev->info->read_raw_channels || num > ARRAY_SIZE(specs))
+		return -EOPNOTSUPP;
+
+	for (i = 0; i < num; i++) {
+		if (chans[i]->indio_dev != indio_dev ||
+		    !iio_channel_has_info(chans[i]->channel, IIO_CHAN_INFO_RAW))
+			return -EOPNOTSUPP;
+		specs[i] = chans[i]->channel;
+	}
+
+	ret = indio_dev->info->read_raw_channels(indio_dev, specs, num, vals);
+	if (ret < 0 || !processed)
+		return ret;
+
+	for (i = 0; i < num; i++) {
+		ret = iio_convert_raw_to_processed_unlocked(chans[i], vals[i],
+							    &vals[i], 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int iio_read_channels(struct iio_channel *const *chans,
+			     unsigned int num, int *vals, bool processed)
+{
+	struct iio_dev *indio_dev;
+	unsigned int i;
+	int ret;
+
+	if (!num)
+		return 0;
+
+	indio_dev = chans[0]->indio_dev;
+	mutex_lock(&indio_dev->info_exist_lock);
+	if (indio_dev->info == NULL)
+		ret = -ENODEV;
+	else
+		ret = iio_channels_read_batch(chans, num, vals, processed);
+	mutex_unlock(&indio_dev->info_exist_lock);
+
+	if (ret != -EOPNOTSUPP)
+		return ret < 0 ? ret : 0;
+
+	for (i = 0; i < num; i++) {
+		if (processed)
+			ret = iio_read_channel_processed(chans[i], &vals[i]);
+		else
+			ret = iio_read_channel_raw(chans[i], &vals[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int iio_read_channels_raw(struct iio_channel *const *chans, unsigned int num,
+			  int *vals)
+{
+	return iio_read_channels(chans, num, vals, false);
+}
+EXPORT_SYMBOL_GPL(iio_read_channels_raw);
+
+int iio_read_channels_processed(struct iio_channel *const *chans,
+				unsigned int num, int *vals)
+{
+	return iio_read_channels(chans, num, vals, true);
+}
+EXPORT_SYMBOL_GPL(iio_read_channels_processed);
+
 int iio_read_channel_scale(struct iio_channel *chan, int *val, int *val2)
 {
 	return iio_read_channel_attribute(chan, val, val2, IIO_CHAN_INFO_SCALE);
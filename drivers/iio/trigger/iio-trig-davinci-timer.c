@@ -0,0 +1,203 @@
+/*
+ * IIO trigger paced by the DaVinci loop timer
+ *
+ * Like the hrtimer trigger, but the period comes from a spare timer64 half
+ * running in periodic mode instead of from an hrtimer. The trigger fires
+ * straight from the timer interrupt, exactly one period after the previous
+ * one, without going through the hrtimer code or reprogramming the system
+ * clockevent on every sample.
+ *
+ * There is only one loop timer, so only one trigger can be created, and
+ * not while /dev/davinci-looptimer or DMA sound playback uses the timer.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+
+#include <linux/iio/iio.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/sw_trigger.h>
+
+#include <mach/time.h>
+
+/* default sampling frequency - 100Hz */
+#define DAVINCI_TIMER_DEFAULT_SAMPLING_FREQUENCY 100
+
+struct iio_davinci_timer_info {
+	struct iio_sw_trigger swt;
+	struct mutex lock;
+	unsigned int sampling_frequency;
+	bool enabled;
+};
+
+static struct config_item_type iio_davinci_timer_type = {
+	.ct_owner = THIS_MODULE,
+};
+
+static
+ssize_t iio_davinci_timer_show_freq(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct iio_trigger *trig = to_iio_trigger(dev);
+	struct iio_davinci_timer_info *info = iio_trigger_get_drvdata(trig);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", info->sampling_frequency);
+}
+
+static
+ssize_t iio_davinci_timer_store_freq(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t len)
+{
+	struct iio_trigger *trig = to_iio_trigger(dev);
+	struct iio_davinci_timer_info *info = iio_trigger_get_drvdata(trig);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	if (!val)
+		return -EINVAL;
+
+	mutex_lock(&info->lock);
+	/* a running timer takes the new period right away */
+	if (info->enabled)
+		ret = davinci_looptimer_start(val);
+	if (!ret)
+		info->sampling_frequency = val;
+	mutex_unlock(&info->lock);
+
+	return ret ? ret : len;
+}
+
+static DEVICE_ATTR(sampling_frequency, S_IRUGO | S_IWUSR,
+		   iio_davinci_timer_show_freq, iio_davinci_timer_store_freq);
+
+static struct attribute *iio_davinci_timer_attrs[] = {
+	&dev_attr_sampling_frequency.attr,
+	NULL
+};
+
+static const struct attribute_group iio_davinci_timer_attr_group = {
+	.attrs = iio_davinci_timer_attrs,
+};
+
+static const struct attribute_group *iio_davinci_timer_attr_groups[] = {
+	&iio_davinci_timer_attr_group,
+	NULL
+};
+
+/* Called from the loop timer interrupt */
+static void iio_davinci_timer_trig_handler(void *data)
+{
+	struct iio_davinci_timer_info *info = data;
+
+	iio_trigger_poll(info->swt.trigger);
+}
+
+static int iio_trig_davinci_timer_set_state(struct iio_trigger *trig,
+					    bool state)
+{
+	struct iio_davinci_timer_info *info = iio_trigger_get_drvdata(trig);
+	int ret = 0;
+
+	mutex_lock(&info->lock);
+	if (state)
+		ret = davinci_looptimer_start(info->sampling_frequency);
+	else
+		davinci_looptimer_stop();
+	if (!ret)
+		info->enabled = state;
+	mutex_unlock(&info->lock);
+
+	return ret;
+}
+
+static const struct iio_trigger_ops iio_davinci_timer_trigger_ops = {
+	.owner = THIS_MODULE,
+	.set_trigger_state = iio_trig_davinci_timer_set_state,
+};
+
+static struct iio_sw_trigger *iio_trig_davinci_timer_probe(const char *name)
+{
+	struct iio_davinci_timer_info *trig_info;
+	int ret;
+
+	trig_info = kzalloc(sizeof(*trig_info), GFP_KERNEL);
+	if (!trig_info)
+		return ERR_PTR(-ENOMEM);
+
+	trig_info->swt.trigger = iio_trigger_alloc("%s", name);
+	if (!trig_info->swt.trigger) {
+		ret = -ENOMEM;
+		goto err_free_trig_info;
+	}
+
+	iio_trigger_set_drvdata(trig_info->swt.trigger, trig_info);
+	trig_info->swt.trigger->ops = &iio_davinci_timer_trigger_ops;
+	trig_info->swt.trigger->dev.groups = iio_davinci_timer_attr_groups;
+
+	mutex_init(&trig_info->lock);
+	trig_info->sampling_frequency =
+		DAVINCI_TIMER_DEFAULT_SAMPLING_FREQUENCY;
+
+	ret = davinci_looptimer_request_irq(iio_davinci_timer_trig_handler,
+					    trig_info);
+	if (ret)
+		goto err_free_trigger;
+
+	ret = iio_trigger_register(trig_info->swt.trigger);
+	if (ret)
+		goto err_free_irq;
+
+	iio_swt_group_init_type_name(&trig_info->swt, name,
+				     &iio_davinci_timer_type);
+	return &trig_info->swt;
+err_free_irq:
+	davinci_looptimer_free_irq();
+err_free_trigger:
+	iio_trigger_free(trig_info->swt.trigger);
+err_free_trig_info:
+	kfree(trig_info);
+
+	return ERR_PTR(ret);
+}
+
+static int iio_trig_davinci_timer_remove(struct iio_sw_trigger *swt)
+{
+	struct iio_davinci_timer_info *trig_info;
+
+	trig_info = iio_trigger_get_drvdata(swt->trigger);
+
+	iio_trigger_unregister(swt->trigger);
+
+	/* stop the timer after unreg to make sure no one restarts it */
+	davinci_looptimer_free_irq();
+	iio_trigger_free(swt->trigger);
+	kfree(trig_info);
+
+	return 0;
+}
+
+static const struct iio_sw_trigger_ops iio_trig_davinci_timer_ops = {
+	.probe		= iio_trig_davinci_timer_probe,
+	.remove		= iio_trig_davinci_timer_remove,
+};
+
+static struct iio_sw_trigger_type iio_trig_davinci_timer = {
+	.name = "davinci-timer",
+	.owner = THIS_MODULE,
+	.ops = &iio_trig_davinci_timer_ops,
+};
+
+module_iio_sw_trigger_driver(iio_trig_davinci_timer);
+
+MODULE_DESCRIPTION("DaVinci timer64 periodic trigger for the IIO subsystem");
+MODULE_LICENSE("GPL v2");
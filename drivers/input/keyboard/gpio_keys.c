@@ -35,6 +35,7 @@ struct gpio_button_data {
 	const struct gpio_keys_button *button;
 	struct input_dev *input;
 	struct gpio_desc *gpiod;
+	struct gpio_keys_drvdata *ddata;
 
 	unsigned short *code;
 
@@ -43,6 +44,9 @@ struct gpio_button_data {
 
 	struct delayed_work work;
 	unsigned int software_debounce;	/* in msecs, for GPIO-driven buttons */
+	unsigned long debounce_deadline;
+	bool debounce_pending;
+	bool debounce_due;		/* only used by the debounce work */
 
 	unsigned int irq;
 	spinlock_t lock;
@@ -51,11 +55,22 @@ struct gpio_button_data {
 	bool suspended;
 };
 
+/*
+ * Software debounce of all GPIO buttons of a device shares one delayed
+ * work. Each edge just pushes the deadline of its button out; the scan
+ * reports every button whose deadline has passed in a single input frame
+ * and rearms for the earliest one left, so a set of buttons that are
+ * pressed together costs one wakeup rather than one per button.
+ */
 struct gpio_keys_drvdata {
 	const struct gpio_keys_platform_data *pdata;
 	struct input_dev *input;
 	struct mutex disable_lock;
 	unsigned short *keymap;
+	struct delayed_work debounce_work;
+	spinlock_t debounce_lock;	/* protects the debounce state */
+	unsigned long debounce_at;
+	bool debounce_scheduled;
 	struct gpio_button_data data[0];
 };
 
@@ -144,10 +159,14 @@ static void gpio_keys_disable_button(struct gpio_button_data *bdata)
 		 */
 		disable_irq(bdata->irq);
 
-		if (bdata->gpiod)
+		if (bdata->gpiod) {
 			cancel_delayed_work_sync(&bdata->work);
-		else
+			spin_lock_irq(&bdata->ddata->debounce_lock);
+			bdata->debounce_pending = false;
+			spin_unlock_irq(&bdata->ddata->debounce_lock);
+		} else {
 			del_timer_sync(&bdata->release_timer);
+		}
 
 		bdata->disabled = true;
 	}
@@ -377,7 +396,6 @@ static void gpio_keys_gpio_report_event(struct gpio_button_data *bdata)
 	} else {
 		input_event(input, type, *bdata->code, state);
 	}
-	input_sync(input);
 }
 
 static void gpio_keys_gpio_work_func(struct work_struct *work)
@@ -386,11 +404,79 @@ static void gpio_keys_gpio_work_func(struct work_struct *work)
 		container_of(work, struct gpio_button_data, work.work);
 
 	gpio_keys_gpio_report_event(bdata);
+	input_sync(bdata->input);
 
 	if (bdata->button->wakeup)
 		pm_relax(bdata->input->dev.parent);
 }
 
+/* Called with ddata->debounce_lock held */
+static void gpio_keys_debounce_schedule(struct gpio_keys_drvdata *ddata,
+					unsigned long deadline)
+{
+	if (ddata->debounce_scheduled &&
+	    !time_before(deadline, ddata->debounce_at))
+		return;
+
+	ddata->debounce_at = deadline;
+	ddata->debounce_scheduled = true;
+	mod_delayed_work(system_wq, &ddata->debounce_work,
+			 time_after(deadline, jiffies) ?
+				deadline - jiffies : 0);
+}
+
+static void gpio_keys_debounce_work_func(struct work_struct *work)
+{
+	struct gpio_keys_drvdata *ddata =
+		container_of(work, struct gpio_keys_drvdata,
+			     debounce_work.work);
+	unsigned long now = jiffies, next = 0;
+	bool more = false, relax = false, stay_awake = false;
+	int i;
+
+	spin_lock_irq(&ddata->debounce_lock);
+	ddata->debounce_scheduled = false;
+	for (i = 0; i < ddata->pdata->nbuttons; i++) {
+		struct gpio_button_data *bdata = &ddata->data[i];
+
+		bdata->debounce_due = false;
+		if (!bdata->debounce_pending)
+			continue;
+
+		if (!time_before(now, bdata->debounce_deadline)) {
+			bdata->debounce_pending = false;
+			bdata->debounce_due = true;
+			continue;
+		}
+
+		if (!more || time_before(bdata->debounce_deadline, next)) {
+			next = bdata->debounce_deadline;
+			more = true;
+		}
+		if (bdata->button->wakeup)
+			stay_awake = true;
+	}
+	if (more)
+		gpio_keys_debounce_schedule(ddata, next);
+	spin_unlock_irq(&ddata->debounce_lock);
+
+	for (i = 0; i < ddata->pdata->nbuttons; i++) {
+		struct gpio_button_data *bdata = &ddata->data[i];
+
+		if (!bdata->debounce_due)
+			continue;
+
+		gpio_keys_gpio_report_event(bdata);
+		if (bdata->button->wakeup)
+			relax = true;
+	}
+	input_sync(ddata->input);
+
+	/* the device stays awake while any wakeup button is pending */
+	if (relax && !stay_awake)
+		pm_relax(ddata->input->dev.parent);
+}
+
 static irqreturn_t gpio_keys_gpio_isr(int irq, void *dev_id)
 {
 	struct gpio_button_data *bdata = dev_id;
@@ -412,9 +498,19 @@ static irqreturn_t gpio_keys_gpio_isr(int irq, void *dev_id)
 		}
 	}
 
-	mod_delayed_work(system_wq,
-			 &bdata->work,
-			 msecs_to_jiffies(bdata->software_debounce));
+	if (bdata->software_debounce) {
+		struct gpio_keys_drvdata *ddata = bdata->ddata;
+		unsigned long flags;
+
+		spin_lock_irqsave(&ddata->debounce_lock, flags);
+		bdata->debounce_deadline = jiffies +
+			msecs_to_jiffies(bdata->software_debounce);
+		bdata->debounce_pending = true;
+		gpio_keys_debounce_schedule(ddata, bdata->debounce_deadline);
+		spin_unlock_irqrestore(&ddata->debounce_lock, flags);
+	} else {
+		mod_delayed_work(system_wq, &bdata->work, 0);
+	}
 
 	return IRQ_HANDLED;
 }
@@ -495,6 +591,7 @@ static int gpio_keys_setup_key(struct platform_device *pdev,
 
 	bdata->input = input;
 	bdata->button = button;
+	bdata->ddata = ddata;
 	spin_lock_init(&bdata->lock);
 
 	if (child) {
@@ -635,6 +732,13 @@ static void gpio_keys_report_state(struct gpio_keys_drvdata *ddata)
 	input_sync(input);
 }
 
+static void gpio_keys_quiesce_debounce(void *data)
+{
+	struct gpio_keys_drvdata *ddata = data;
+
+	cancel_delayed_work_sync(&ddata->debounce_work);
+}
+
 static int gpio_keys_open(struct input_dev *input)
 {
 	struct gpio_keys_drvdata *ddata = input_get_drvdata(input);
@@ -778,6 +882,13 @@ static int gpio_keys_probe(struct platform_device *pdev)
 	ddata->pdata = pdata;
 	ddata->input = input;
 	mutex_init(&ddata->disable_lock);
+	spin_lock_init(&ddata->debounce_lock);
+	INIT_DELAYED_WORK(&ddata->debounce_work, gpio_keys_debounce_work_func);
+
+	/* registered first, so it runs after all button IRQs are freed */
+	error = devm_add_action(dev, gpio_keys_quiesce_debounce, ddata);
+	if (error)
+		return error;
 
 	platform_set_drvdata(pdev, ddata);
 	input_set_drvdata(input, ddata);
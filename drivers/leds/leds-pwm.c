@@ -69,6 +69,54 @@ static int led_pwm_set(struct led_classdev *led_cdev,
 	return 0;
 }
 
+/*
+ * Let the PWM itself blink the LED: one PWM period is one blink, with the
+ * duty cycle as the on time. This needs a PWM that can run periods of a
+ * second or so (eCAP can, eHRPWM only up to a fraction of that); when the
+ * PWM refuses the period the core falls back to its software blink timer.
+ * Any later brightness change restores the normal PWM period.
+ */
+static int led_pwm_blink_set(struct led_classdev *led_cdev,
+			     unsigned long *delay_on,
+			     unsigned long *delay_off)
+{
+	struct led_pwm_data *led_dat =
+		container_of(led_cdev, struct led_pwm_data, cdev);
+	unsigned long on = *delay_on, off = *delay_off;
+	unsigned int period, duty;
+	int ret;
+
+	if (!on && !off)
+		on = off = 500;
+
+	/* steady on or off is left to the core */
+	if (!on || !off)
+		return -EINVAL;
+
+	if (on > UINT_MAX / NSEC_PER_MSEC - off)
+		return -EINVAL;
+
+	period = (on + off) * NSEC_PER_MSEC;
+	duty = on * NSEC_PER_MSEC;
+	if (led_dat->active_low)
+		duty = period - duty;
+
+	ret = pwm_config(led_dat->pwm, duty, period);
+	if (ret)
+		return ret;
+
+	ret = pwm_enable(led_dat->pwm);
+	if (ret) {
+		__led_pwm_set(led_dat);
+		return ret;
+	}
+
+	*delay_on = on;
+	*delay_off = off;
+
+	return 0;
+}
+
 static inline size_t sizeof_pwm_leds_priv(int num_leds)
 {
 	return sizeof(struct led_pwm_priv) +
@@ -107,6 +155,7 @@ static int led_pwm_add(struct device *dev, struct led_pwm_priv *priv,
 	}
 
 	led_data->cdev.brightness_set_blocking = led_pwm_set;
+	led_data->cdev.blink_set = led_pwm_blink_set;
 
 	/*
 	 * FIXME: pwm_apply_args() should be removed when switching to the
@@ -13,10 +13,14 @@
  */
 
 #include <linux/clk.h>
+#include <linux/completion.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/err.h>
 #include <linux/io.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_platform.h>
 #include <linux/platform_device.h>
@@ -83,6 +87,8 @@
 				EW(EW_MAX) | SS(SS_MAX) | \
 				ASIZE_MAX)
 
+#define AEMIF_DMA_TIMEOUT_MS	1000
+
 /**
  * struct aemif_cs_data: structure to hold cs parameters
  * @cs: chip-select number
@@ -119,6 +125,10 @@ struct aemif_cs_data {
  * @num_cs: number of assigned chip-selects
  * @cs_offset: start number of cs nodes
  * @cs_data: array of chip-select settings
+ * @lock: protects @num_cs, @cs_data and the DMA fields against the exported
+ *	functions
+ * @dma_chan: memcpy channel of aemif_read_dma(), requested on first use
+ * @dma_done: completed when a DMA read has finished
  */
 struct aemif_device {
 	void __iomem *base;
@@ -127,8 +137,13 @@ struct aemif_device {
 	u8 num_cs;
 	int cs_offset;
 	struct aemif_cs_data cs_data[NUM_CS];
+	struct mutex lock;
+	struct dma_chan *dma_chan;
+	struct completion dma_done;
 };
 
+static struct platform_driver aemif_driver;
+
 /**
  * aemif_calc_rate - calculate timing data.
  * @pdev: platform device to calculate for
@@ -320,6 +335,175 @@ static int of_aemif_parse_abus_config(struct platform_device *pdev,
 	return 0;
 }
 
+/* The AEMIF that @dev, one of the devices it populated, is attached to */
+static struct platform_device *aemif_get_parent(struct device *dev)
+{
+	if (!dev->parent || dev->parent->driver != &aemif_driver.driver)
+		return NULL;
+
+	return to_platform_device(dev->parent);
+}
+
+/**
+ * aemif_set_cs_timings - program the timings of a chip-select at run time
+ * @dev: device on the AEMIF bus
+ * @cs: chip-select number, as in ti,cs-chipselect
+ * @timings: timings required by the device
+ *
+ * Lets the driver of a device on the bus, like an FPGA or a NAND flash that
+ * knows its own timings, replace the conservative ones from the device tree.
+ * Each timing is rounded up to whole cycles of the current AEMIF clock.
+ *
+ * Returns 0 on success, -EINVAL if the timings can't be programmed, or
+ * -ENODEV if @dev isn't on an AEMIF.
+ */
+int aemif_set_cs_timings(struct device *dev, unsigned int cs,
+			 const struct aemif_cs_timings *timings)
+{
+	struct platform_device *pdev = aemif_get_parent(dev);
+	struct aemif_device *aemif;
+	struct aemif_cs_data *data, old;
+	int i, ret;
+
+	aemif = pdev ? platform_get_drvdata(pdev) : NULL;
+	if (!aemif)
+		return -ENODEV;
+
+	if (cs < aemif->cs_offset || cs - aemif->cs_offset >= NUM_CS)
+		return -EINVAL;
+
+	if (timings->ta > U8_MAX || timings->rhold > U8_MAX ||
+	    timings->rstrobe > U16_MAX || timings->rsetup > U8_MAX ||
+	    timings->whold > U8_MAX || timings->wstrobe > U16_MAX ||
+	    timings->wsetup > U8_MAX)
+		return -EINVAL;
+
+	mutex_lock(&aemif->lock);
+
+	for (i = 0; i < aemif->num_cs; i++)
+		if (aemif->cs_data[i].cs == cs)
+			break;
+
+	/* a chip-select without a node in the device tree */
+	if (i == aemif->num_cs) {
+		if (aemif->num_cs >= NUM_CS) {
+			ret = -EINVAL;
+			goto out_unlock;
+		}
+		aemif->cs_data[i].cs = cs;
+		aemif_get_hw_params(pdev, aemif->num_cs++);
+	}
+
+	data = &aemif->cs_data[i];
+	old = *data;
+
+	data->ta = timings->ta;
+	data->rhold = timings->rhold;
+	data->rstrobe = timings->rstrobe;
+	data->rsetup = timings->rsetup;
+	data->whold = timings->whold;
+	data->wstrobe = timings->wstrobe;
+	data->wsetup = timings->wsetup;
+
+	aemif->clk_rate = clk_get_rate(aemif->clk) / MSEC_PER_SEC;
+	ret = aemif_config_abus(pdev, i);
+	if (ret)
+		*data = old;
+
+out_unlock:
+	mutex_unlock(&aemif->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(aemif_set_cs_timings);
+
+static void aemif_dma_complete(void *param)
+{
+	struct aemif_device *aemif = param;
+
+	complete(&aemif->dma_done);
+}
+
+/**
+ * aemif_read_dma - read a block from an asynchronous device by DMA
+ * @dev: device on the AEMIF bus
+ * @buf: kernel buffer to read into, must be DMA capable
+ * @src: physical address to read from, in one of the chip-select windows
+ * @len: number of bytes to read
+ *
+ * Bulk reads with memcpy_fromio() keep the CPU stalled on every access of
+ * the slow bus. This has a DMA memcpy channel (EDMA on DaVinci) do them in
+ * bursts instead, and sleeps until the data is there.
+ *
+ * Returns 0 on success or a negative error code, in which case the caller
+ * should read with the CPU. There is -ENODEV when no channel is available.
+ */
+int aemif_read_dma(struct device *dev, void *buf, phys_addr_t src, size_t len)
+{
+	unsigned long timeout = msecs_to_jiffies(AEMIF_DMA_TIMEOUT_MS);
+	struct platform_device *pdev = aemif_get_parent(dev);
+	struct dma_async_tx_descriptor *desc;
+	struct aemif_device *aemif;
+	struct dma_chan *chan;
+	struct device *dma_dev;
+	dma_cap_mask_t mask;
+	dma_addr_t addr;
+	int ret;
+
+	aemif = pdev ? platform_get_drvdata(pdev) : NULL;
+	if (!aemif)
+		return -ENODEV;
+
+	mutex_lock(&aemif->lock);
+
+	if (!aemif->dma_chan) {
+		dma_cap_zero(mask);
+		dma_cap_set(DMA_MEMCPY, mask);
+		chan = dma_request_chan_by_mask(&mask);
+		if (IS_ERR(chan)) {
+			ret = -ENODEV;
+			goto out_unlock;
+		}
+		aemif->dma_chan = chan;
+	}
+
+	chan = aemif->dma_chan;
+	dma_dev = chan->device->dev;
+	addr = dma_map_single(dma_dev, buf, len, DMA_FROM_DEVICE);
+	if (dma_mapping_error(dma_dev, addr)) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	desc = dmaengine_prep_dma_memcpy(chan, addr, src, len,
+					 DMA_PREP_INTERRUPT);
+	if (!desc) {
+		ret = -ENOMEM;
+		goto out_unmap;
+	}
+
+	reinit_completion(&aemif->dma_done);
+	desc->callback = aemif_dma_complete;
+	desc->callback_param = aemif;
+	ret = dma_submit_error(dmaengine_submit(desc));
+	if (ret)
+		goto out_unmap;
+
+	dma_async_issue_pending(chan);
+	if (!wait_for_completion_timeout(&aemif->dma_done, timeout)) {
+		dmaengine_terminate_sync(chan);
+		ret = -ETIMEDOUT;
+	}
+
+out_unmap:
+	dma_unmap_single(dma_dev, addr, len, DMA_FROM_DEVICE);
+out_unlock:
+	mutex_unlock(&aemif->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(aemif_read_dma);
+
 static const struct of_device_id aemif_of_match[] = {
 	{ .compatible = "ti,davinci-aemif", },
 	{ .compatible = "ti,da850-aemif", },
@@ -350,6 +534,8 @@ static int aemif_probe(struct platform_device *pdev)
 	dev_lookup = pdata ? pdata->dev_lookup : NULL;
 
 	platform_set_drvdata(pdev, aemif);
+	mutex_init(&aemif->lock);
+	init_completion(&aemif->dma_done);
 
 	aemif->clk = devm_clk_get(dev, NULL);
 	if (IS_ERR(aemif->clk)) {
@@ -414,6 +600,8 @@ static int aemif_remove(struct platform_device *pdev)
 {
 	struct aemif_device *aemif = platform_get_drvdata(pdev);
 
+	if (aemif->dma_chan)
+		dma_release_channel(aemif->dma_chan);
 	clk_disable_unprepare(aemif->clk);
 	return 0;
 }
@@ -266,6 +266,79 @@ static ssize_t force_ro_store(struct device *dev, struct device_attribute *attr,
 	return ret;
 }
 
+/* Longest write combining window accepted, in milliseconds */
+#define MMC_BLK_MAX_WRITE_WINDOW	1000
+
+static ssize_t write_window_ms_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	int ret;
+
+	ret = snprintf(buf, PAGE_SIZE, "%u\n",
+		       jiffies_to_msecs(md->queue.write_window));
+	mmc_blk_put(md);
+	return ret;
+}
+
+static ssize_t write_window_ms_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct mmc_blk_data *md;
+	struct request_queue *q;
+	unsigned int ms;
+
+	if (kstrtouint(buf, 0, &ms))
+		return -EINVAL;
+	if (ms > MMC_BLK_MAX_WRITE_WINDOW)
+		return -EINVAL;
+
+	md = mmc_blk_get(dev_to_disk(dev));
+	q = md->queue.queue;
+	spin_lock_irq(q->queue_lock);
+	md->queue.write_window = msecs_to_jiffies(ms);
+	spin_unlock_irq(q->queue_lock);
+	mmc_blk_put(md);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(write_window_ms);
+
+/* Average size in bytes of the read and of the write requests issued */
+static ssize_t avg_req_size_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	struct mmc_queue *mq = &md->queue;
+	u64 rd = 0, wr = 0;
+	int ret;
+
+	spin_lock_irq(mq->queue->queue_lock);
+	if (mq->rd_reqs)
+		rd = div64_u64(mq->rd_bytes, mq->rd_reqs);
+	if (mq->wr_reqs)
+		wr = div64_u64(mq->wr_bytes, mq->wr_reqs);
+	spin_unlock_irq(mq->queue->queue_lock);
+
+	ret = snprintf(buf, PAGE_SIZE, "%llu %llu\n", rd, wr);
+	mmc_blk_put(md);
+	return ret;
+}
+
+static DEVICE_ATTR_RO(avg_req_size);
+
+static struct attribute *mmc_blk_queue_attrs[] = {
+	&dev_attr_write_window_ms.attr,
+	&dev_attr_avg_req_size.attr,
+	NULL,
+};
+
+static const struct attribute_group mmc_blk_queue_attr_group = {
+	.attrs = mmc_blk_queue_attrs,
+};
+
 static int mmc_blk_open(struct block_device *bdev, fmode_t mode)
 {
 	struct mmc_blk_data *md = mmc_blk_get(bdev->bd_disk);
@@ -889,7 +962,7 @@ static int mmc_sd_num_wr_blocks(struct mmc_card *card, u32 *written_blocks)
 	return 0;
 }
 
-static int card_busy_detect(struct mmc_card *card, unsigned int timeout_ms,
+static int __card_busy_detect(struct mmc_card *card, unsigned int timeout_ms,
 		bool hw_busy_detect, struct request *req, bool *gen_err)
 {
 	unsigned long timeout = jiffies + msecs_to_jiffies(timeout_ms);
@@ -937,6 +1010,19 @@ static int card_busy_detect(struct mmc_card *card, unsigned int timeout_ms,
 	return err;
 }
 
+static int card_busy_detect(struct mmc_card *card, unsigned int timeout_ms,
+		bool hw_busy_detect, struct request *req, bool *gen_err)
+{
+	ktime_t start = ktime_get();
+	int err;
+
+	err = __card_busy_detect(card, timeout_ms, hw_busy_detect, req,
+				 gen_err);
+	mmc_account_busy(card->host, start);
+
+	return err;
+}
+
 static int send_stop(struct mmc_card *card, unsigned int timeout_ms,
 		struct request *req, bool *gen_err, u32 *stop_status)
 {
@@ -2269,6 +2355,8 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 		mmc_cleanup_queue(&md->queue);
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
+			sysfs_remove_group(&disk_to_dev(md->disk)->kobj,
+					   &mmc_blk_queue_attr_group);
 			if ((md->area_type & MMC_BLK_DATA_AREA_BOOT) &&
 					card->ext_csd.boot_ro_lockable)
 				device_remove_file(disk_to_dev(md->disk),
@@ -2308,6 +2396,11 @@ static int mmc_add_disk(struct mmc_blk_data *md)
 	if (ret)
 		goto force_ro_fail;
 
+	ret = sysfs_create_group(&disk_to_dev(md->disk)->kobj,
+				 &mmc_blk_queue_attr_group);
+	if (ret)
+		goto queue_attr_fail;
+
 	if ((md->area_type & MMC_BLK_DATA_AREA_BOOT) &&
 	     card->ext_csd.boot_ro_lockable) {
 		umode_t mode;
@@ -2331,6 +2424,9 @@ static int mmc_add_disk(struct mmc_blk_data *md)
 	return ret;
 
 power_ro_lock_fail:
+	sysfs_remove_group(&disk_to_dev(md->disk)->kobj,
+			   &mmc_blk_queue_attr_group);
+queue_attr_fail:
 	device_remove_file(disk_to_dev(md->disk), &md->force_ro);
 force_ro_fail:
 	del_gendisk(md->disk);
@@ -133,6 +133,43 @@ void mmc_command_done(struct mmc_host *host, struct mmc_request *mrq)
 }
 EXPORT_SYMBOL(mmc_command_done);
 
+static void mmc_request_account(struct mmc_host *host,
+				struct mmc_request *mrq)
+{
+	struct mmc_host_stats *stats = &host->stats;
+	struct mmc_data *data = mrq->data;
+	unsigned long *lat = stats->lat_cmd;
+	s64 us;
+
+	if (mrq->cmd->error || (mrq->sbc && mrq->sbc->error) ||
+	    (data && data->error) || (mrq->stop && mrq->stop->error))
+		stats->errors++;
+
+	if (data && (data->flags & MMC_DATA_READ)) {
+		stats->bytes_read += data->bytes_xfered;
+		lat = stats->lat_read;
+	} else if (data) {
+		stats->bytes_written += data->bytes_xfered;
+		lat = stats->lat_write;
+	}
+
+	us = ktime_us_delta(ktime_get(), mrq->start_time);
+	if (us <= 0)
+		lat[0]++;
+	else if (us >= 1LL << (MMC_STATS_LAT_BUCKETS - 2))
+		lat[MMC_STATS_LAT_BUCKETS - 1]++;
+	else
+		lat[fls(us)]++;
+}
+
+/* Adds a busy poll of the card that began at @start to the statistics */
+void mmc_account_busy(struct mmc_host *host, ktime_t start)
+{
+	host->stats.busy_waits++;
+	host->stats.busy_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+EXPORT_SYMBOL(mmc_account_busy);
+
 /**
  *	mmc_request_done - finish processing an MMC request
  *	@host: MMC host which completed request
@@ -177,6 +214,7 @@ void mmc_request_done(struct mmc_host *host, struct mmc_request *mrq)
 	 */
 	if (!err || !cmd->retries || mmc_card_removed(host->card)) {
 		mmc_should_fail_request(host, mrq);
+		mmc_request_account(host, mrq);
 
 		if (!host->ongoing_mrq)
 			led_trigger_event(host->led, LED_OFF);
@@ -222,6 +260,8 @@ static void __mmc_start_request(struct mmc_host *host, struct mmc_request *mrq)
 {
 	int err;
 
+	mrq->start_time = ktime_get();
+
 	/* Assumes host controller has been runtime resumed by mmc_claim_host */
 	err = mmc_retune(host);
 	if (err) {
@@ -83,6 +83,9 @@ int mmc_attach_sdio(struct mmc_host *host);
 /* Module parameters */
 extern bool use_spi_crc;
 
+/* Request statistics */
+void mmc_account_busy(struct mmc_host *host, ktime_t start);
+
 /* Debugfs information for hosts and cards */
 void mmc_add_host_debugfs(struct mmc_host *host);
 void mmc_remove_host_debugfs(struct mmc_host *host);
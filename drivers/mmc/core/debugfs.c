@@ -236,6 +236,64 @@ static int mmc_clock_opt_set(void *data, u64 val)
 DEFINE_SIMPLE_ATTRIBUTE(mmc_clock_fops, mmc_clock_opt_get, mmc_clock_opt_set,
 	"%llu\n");
 
+static void mmc_stats_show_lat(struct seq_file *s, const char *name,
+			       const unsigned long *lat)
+{
+	int i;
+
+	seq_printf(s, "%s:", name);
+	for (i = 0; i < MMC_STATS_LAT_BUCKETS; i++)
+		seq_printf(s, " %lu", lat[i]);
+	seq_putc(s, '\n');
+}
+
+static int mmc_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_host *host = s->private;
+	struct mmc_host_stats *stats = &host->stats;
+	int i;
+
+	seq_printf(s, "bytes read:\t%llu\n", stats->bytes_read);
+	seq_printf(s, "bytes written:\t%llu\n", stats->bytes_written);
+	seq_printf(s, "errors:\t\t%lu\n", stats->errors);
+	seq_printf(s, "busy waits:\t%lu\n", stats->busy_waits);
+	seq_printf(s, "busy time:\t%llu us\n", div_u64(stats->busy_ns, 1000));
+
+	seq_puts(s, "latency (us):\t<1");
+	for (i = 1; i < MMC_STATS_LAT_BUCKETS - 1; i++)
+		seq_printf(s, " <%lu", 1UL << i);
+	seq_printf(s, " >=%lu\n", 1UL << (MMC_STATS_LAT_BUCKETS - 2));
+	mmc_stats_show_lat(s, "read", stats->lat_read);
+	mmc_stats_show_lat(s, "write", stats->lat_write);
+	mmc_stats_show_lat(s, "cmd", stats->lat_cmd);
+
+	return 0;
+}
+
+static int mmc_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_stats_show, inode->i_private);
+}
+
+/* Writing anything clears the statistics */
+static ssize_t mmc_stats_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct mmc_host *host = file_inode(file)->i_private;
+
+	memset(&host->stats, 0, sizeof(host->stats));
+
+	return count;
+}
+
+static const struct file_operations mmc_stats_fops = {
+	.open		= mmc_stats_open,
+	.read		= seq_read,
+	.write		= mmc_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void mmc_add_host_debugfs(struct mmc_host *host)
 {
 	struct dentry *root;
@@ -258,6 +316,10 @@ void mmc_add_host_debugfs(struct mmc_host *host)
 			&mmc_clock_fops))
 		goto err_node;
 
+	if (!debugfs_create_file("stats", S_IRUSR | S_IWUSR, root, host,
+			&mmc_stats_fops))
+		goto err_node;
+
 #ifdef CONFIG_FAIL_MMC_REQUEST
 	if (fail_request)
 		setup_fault_attr(&fail_default_attr, fail_request);
@@ -529,6 +529,7 @@ int __mmc_switch(struct mmc_card *card, u8 set, u8 index, u8 value,
 	struct mmc_command cmd = {};
 	bool use_r1b_resp = use_busy_signal;
 	unsigned char old_timing = host->ios.timing;
+	ktime_t start;
 
 	mmc_retune_hold(host);
 
@@ -576,7 +577,9 @@ int __mmc_switch(struct mmc_card *card, u8 set, u8 index, u8 value,
 		goto out_tim;
 
 	/* Let's try to poll to find out when the command is completed. */
+	start = ktime_get();
 	err = mmc_poll_for_busy(card, timeout_ms, send_status, retry_crc_err);
+	mmc_account_busy(host, start);
 	if (err)
 		goto out;
 
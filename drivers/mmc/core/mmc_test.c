@@ -44,6 +44,13 @@
  */
 #define TEST_AREA_MAX_SIZE (128 * 1024 * 1024)
 
+/*
+ * Limits for the benchmark: the largest transfer size measured, and the
+ * number of transfers per measurement.
+ */
+#define BENCH_MAX_TFR		(1024 * 1024)
+#define BENCH_MAX_COUNT		1024
+
 /**
  * struct mmc_test_pages - pages allocated by 'alloc_pages()'.
  * @page: first page in the allocation
@@ -96,6 +103,7 @@ struct mmc_test_area {
  * @ts: time values of transfer
  * @rate: calculated transfer rate
  * @iops: I/O operations per second (times 100)
+ * @label: kind of transfer measured, if the test case names it
  */
 struct mmc_test_transfer_result {
 	struct list_head link;
@@ -104,6 +112,7 @@ struct mmc_test_transfer_result {
 	struct timespec ts;
 	unsigned int rate;
 	unsigned int iops;
+	const char *label;
 };
 
 /**
@@ -142,6 +151,7 @@ struct mmc_test_dbgfs_file {
  * @highmem: buffer for highmem tests
  * @area: information for performance tests
  * @gr: pointer to results of current testcase
+ * @label: label given to the transfer results saved
  */
 struct mmc_test_card {
 	struct mmc_card	*card;
@@ -153,6 +163,7 @@ struct mmc_test_card {
 #endif
 	struct mmc_test_area		area;
 	struct mmc_test_general_result	*gr;
+	const char			*label;
 };
 
 enum mmc_test_prep_media {
@@ -559,6 +570,7 @@ static void mmc_test_save_transfer_result(struct mmc_test_card *test,
 	tr->ts = ts;
 	tr->rate = rate;
 	tr->iops = iops;
+	tr->label = test->label;
 
 	list_add_tail(&tr->link, &test->gr->tr_lst);
 }
@@ -2566,6 +2578,89 @@ static int mmc_test_cmds_during_write_cmd23_nonblock(struct mmc_test_card *test)
 	return mmc_test_cmds_during_tfr(test, 1, 1, 1);
 }
 
+/*
+ * One benchmark measurement: count transfers of sz bytes, either one after
+ * the other from the start of the test area, or at pseudo-random addresses
+ * spread over the card like mmc_test_rnd_perf() does.
+ */
+static int mmc_test_bench_io(struct mmc_test_card *test, int write,
+			     int random, unsigned long sz)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned int dev_addr, rnd_addr, range1, range2, ssz = sz >> 9;
+	unsigned int i, count;
+	struct timespec ts1, ts2;
+	int ret;
+
+	count = clamp_t(unsigned int, t->max_sz / sz, 1, BENCH_MAX_COUNT);
+
+	rnd_addr = mmc_test_capacity(test->card) / 4;
+	range1 = rnd_addr / test->card->pref_erase;
+	range2 = range1 / ssz;
+
+	ret = mmc_test_area_map(test, sz, 0, 0);
+	if (ret)
+		return ret;
+
+	dev_addr = t->dev_addr;
+	getnstimeofday(&ts1);
+	for (i = 0; i < count; i++) {
+		if (random)
+			dev_addr = rnd_addr +
+				   test->card->pref_erase *
+				   mmc_test_rnd_num(range1) +
+				   ssz * mmc_test_rnd_num(range2);
+		ret = mmc_test_area_transfer(test, dev_addr, write);
+		if (ret)
+			return ret;
+		if (!random)
+			dev_addr += ssz;
+	}
+	getnstimeofday(&ts2);
+
+	mmc_test_print_avg_rate(test, sz, count, &ts1, &ts2);
+
+	return 0;
+}
+
+/*
+ * Fixed benchmark suite: sequential and random reads and writes of every
+ * power-of-two size from 512 bytes to 1 MiB, or to the largest transfer the
+ * host allows. The random addresses always come from the same seed, so runs
+ * on different cards, hosts or kernels do the same I/O. Each result is
+ * labelled in the "test" file with the kind of transfer measured.
+ */
+static int mmc_test_benchmark(struct mmc_test_card *test)
+{
+	static const struct {
+		const char *label;
+		int write;
+		int random;
+	} passes[] = {
+		{ "seq_read",	0, 0 },
+		{ "seq_write",	1, 0 },
+		{ "rnd_read",	0, 1 },
+		{ "rnd_write",	1, 1 },
+	};
+	struct mmc_test_area *t = &test->area;
+	unsigned long sz, max_sz = min_t(unsigned long, t->max_tfr,
+					 BENCH_MAX_TFR);
+	int i, ret = 0;
+
+	rnd_next = 1;
+
+	for (i = 0; i < ARRAY_SIZE(passes) && !ret; i++) {
+		test->label = passes[i].label;
+		for (sz = 512; sz <= max_sz && !ret; sz <<= 1)
+			ret = mmc_test_bench_io(test, passes[i].write,
+						passes[i].random, sz);
+	}
+
+	test->label = NULL;
+
+	return ret;
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -2935,6 +3030,13 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.run = mmc_test_cmds_during_write_cmd23_nonblock,
 		.cleanup = mmc_test_area_cleanup,
 	},
+
+	{
+		.name = "Benchmark: sequential and random read/write 512B to 1MiB",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_benchmark,
+		.cleanup = mmc_test_area_cleanup,
+	},
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -3073,11 +3175,14 @@ static int mtf_test_show(struct seq_file *sf, void *data)
 		seq_printf(sf, "Test %d: %d\n", gr->testcase + 1, gr->result);
 
 		list_for_each_entry(tr, &gr->tr_lst, link) {
-			seq_printf(sf, "%u %d %lu.%09lu %u %u.%02u\n",
+			seq_printf(sf, "%u %d %lu.%09lu %u %u.%02u",
 				tr->count, tr->sectors,
 				(unsigned long)tr->ts.tv_sec,
 				(unsigned long)tr->ts.tv_nsec,
 				tr->rate, tr->iops / 100, tr->iops % 100);
+			if (tr->label)
+				seq_printf(sf, " %s", tr->label);
+			seq_putc(sf, '\n');
 		}
 	}
 
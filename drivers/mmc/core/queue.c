@@ -38,6 +38,50 @@ static int mmc_prep_request(struct request_queue *q, struct request *req)
 	return BLKPREP_OK;
 }
 
+/*
+ * Write combining window: when the card is idle and only asynchronous
+ * writes are waiting, leave them in the elevator for up to write_window
+ * jiffies so that more writes can merge into them before they are issued.
+ * Fetching a request would take it off the elevator and end merging, hence
+ * only the block layer's request counts are looked at. Reads and other
+ * synchronous requests end the window at once. Returns the number of
+ * jiffies left to wait, 0 to go ahead. Called with the queue lock held.
+ */
+static unsigned long mmc_queue_hold_writes(struct mmc_queue *mq)
+{
+	struct request_queue *q = mq->queue;
+
+	if (!mq->write_window || mq->qcnt || kthread_should_stop() ||
+	    !q->nr_rqs[BLK_RW_ASYNC] || q->nr_rqs[BLK_RW_SYNC]) {
+		mq->write_hold = 0;
+		return 0;
+	}
+
+	if (!mq->write_hold)
+		mq->write_hold = jiffies + mq->write_window;
+
+	if (time_after_eq(jiffies, mq->write_hold))
+		return 0;
+
+	return mq->write_hold - jiffies;
+}
+
+static void mmc_queue_account(struct mmc_queue *mq, struct request *req)
+{
+	switch (req_op(req)) {
+	case REQ_OP_READ:
+		mq->rd_reqs++;
+		mq->rd_bytes += blk_rq_bytes(req);
+		break;
+	case REQ_OP_WRITE:
+		mq->wr_reqs++;
+		mq->wr_bytes += blk_rq_bytes(req);
+		break;
+	default:
+		break;
+	}
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
@@ -48,11 +92,19 @@ static int mmc_queue_thread(void *d)
 
 	down(&mq->thread_sem);
 	do {
-		struct request *req;
+		struct request *req = NULL;
+		unsigned long hold;
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		req = blk_fetch_request(q);
+		hold = mmc_queue_hold_writes(mq);
+		if (!hold) {
+			req = blk_fetch_request(q);
+			if (req) {
+				mq->write_hold = 0;
+				mmc_queue_account(mq, req);
+			}
+		}
 		mq->asleep = false;
 		cntx->is_waiting_last_req = false;
 		cntx->is_new_req = false;
@@ -78,7 +130,10 @@ static int mmc_queue_thread(void *d)
 				break;
 			}
 			up(&mq->thread_sem);
-			schedule();
+			if (hold)
+				schedule_timeout(hold);
+			else
+				schedule();
 			down(&mq->thread_sem);
 		}
 	} while (1);
@@ -72,6 +72,14 @@ struct mmc_queue {
 	 * associated mmc_queue_req data.
 	 */
 	int			qcnt;
+	/* write combining window, see mmc_queue_hold_writes() */
+	unsigned long		write_window;
+	unsigned long		write_hold;
+	/* requests fetched so far, for the average request size */
+	unsigned long		rd_reqs;
+	unsigned long		wr_reqs;
+	u64			rd_bytes;
+	u64			wr_bytes;
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
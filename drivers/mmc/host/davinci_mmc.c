@@ -37,6 +37,9 @@
 #include <linux/of_device.h>
 #include <linux/mmc/slot-gpio.h>
 #include <linux/interrupt.h>
+#include <linux/debugfs.h>
+#include <linux/legoev3_perf.h>
+#include <linux/seq_file.h>
 
 #include <linux/platform_data/mmc-davinci.h>
 
@@ -148,21 +151,30 @@
 #define MMCSD_INIT_CLOCK		200000
 
 /*
- * One scatterlist dma "segment" is at most MAX_CCNT rw_threshold units,
+ * One scatterlist dma "segment" is at most MAX_CCNT FIFO threshold units,
  * and we handle up to MAX_NR_SG segments.  MMC_BLOCK_BOUNCE kicks in only
  * for drivers with max_segs == 1, making the segments bigger (64KB)
  * than the page or two that's otherwise typical. nr_sg (passed from
  * platform data) == 16 gives at least the same throughput boost, using
  * EDMA transfer linkage instead of spending CPU time copying pages.
+ * The EDMA driver links longer lists into a single chain too, so allow
+ * enough segments for the largest requests the block layer builds.
  */
 #define MAX_CCNT	((1 << 16) - 1)
 
-#define MAX_NR_SG	16
+#define MAX_NR_SG	64
 
-static unsigned rw_threshold = 32;
+/*
+ * The FIFO threshold, which is also the DMA burst, is picked per transfer:
+ * the largest of 64 (version 2 controllers only) and 32 bytes that is no
+ * bigger than rw_threshold and evenly divides every segment.
+ */
+#define MIN_RW_THRESHOLD	32
+
+static unsigned rw_threshold = 64;
 module_param(rw_threshold, uint, S_IRUGO);
 MODULE_PARM_DESC(rw_threshold,
-		"Read/Write threshold. Default = 32");
+		"Maximum read/write threshold, 32 or 64. Default = 64");
 
 static unsigned poll_threshold = 128;
 module_param(poll_threshold, uint, S_IRUGO);
@@ -174,8 +186,8 @@ module_param(poll_loopcount, uint, S_IRUGO);
 MODULE_PARM_DESC(poll_loopcount,
 		 "Maximum polling loop count. Default = 32");
 
-static unsigned __initdata use_dma = 1;
-module_param(use_dma, uint, 0);
+static unsigned use_dma = 1;
+module_param(use_dma, uint, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(use_dma, "Whether to use DMA or not. Default = 1");
 
 struct mmc_davinci_host {
@@ -194,6 +206,9 @@ struct mmc_davinci_host {
 #define DAVINCI_MMC_DATADIR_WRITE	2
 	unsigned char data_dir;
 
+	/* FIFO threshold and DMA burst of the current transfer */
+	unsigned int rw_threshold;
+
 	/* buffer is used during PIO of one scatterlist segment, and
 	 * is updated along with buffer_bytes_left.  bytes_left applies
 	 * to all N blocks of the PIO transfer.
@@ -207,6 +222,7 @@ struct mmc_davinci_host {
 	bool use_dma;
 	bool do_dma;
 	bool sdio_int;
+	spinlock_t sdio_lock;	/* protects sdio_int and SDIOIEN */
 	bool active_request;
 
 	/* For PIO we walk scatterlists one segment at a time. */
@@ -219,6 +235,15 @@ struct mmc_davinci_host {
 	unsigned ns_in_one_cycle;
 	/* Number of sg segments */
 	u8 nr_sg;
+
+	/* data transfers done by DMA and by PIO, shown in debugfs */
+	u32 dma_xfers;
+	u32 pio_xfers;
+	/* completed data, on the performance dashboard */
+	u64 bytes_read;
+	u64 bytes_written;
+	u32 data_errors;
+	struct legoev3_perf_source perf;
 #ifdef CONFIG_CPU_FREQ
 	struct notifier_block	freq_transition;
 #endif
@@ -226,6 +251,24 @@ struct mmc_davinci_host {
 
 static irqreturn_t mmc_davinci_irq(int irq, void *dev_id);
 
+/*
+ * Hand a card interrupt to the SDIO core. It stays masked until the function
+ * drivers ran and the core acknowledged it through ->ack_sdio_irq().
+ */
+static void mmc_davinci_signal_sdio_irq(struct mmc_davinci_host *host)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&host->sdio_lock, flags);
+	host->sdio_int = false;
+	writel(readl(host->base + DAVINCI_SDIOIEN) & ~SDIOIEN_IOINTEN,
+	       host->base + DAVINCI_SDIOIEN);
+	writel(SDIOIST_IOINT, host->base + DAVINCI_SDIOIST);
+	spin_unlock_irqrestore(&host->sdio_lock, flags);
+
+	sdio_signal_irq(host->mmc);
+}
+
 /* PIO only */
 static void mmc_davinci_sg_to_buf(struct mmc_davinci_host *host)
 {
@@ -252,7 +295,7 @@ static void davinci_fifo_data_trans(struct mmc_davinci_host *host,
 	host->buffer_bytes_left -= n;
 	host->bytes_left -= n;
 
-	/* NOTE:  we never transfer more than rw_threshold bytes
+	/* NOTE:  we never transfer more than FIFO threshold bytes
 	 * to/from the fifo here; there's no I/O overlap.
 	 * This also assumes that access width( i.e. ACCWD) is 4 bytes
 	 */
@@ -374,7 +417,7 @@ static void mmc_davinci_start_command(struct mmc_davinci_host *host,
 	 * FIFO should be populated with 32 bytes i.e. whatever is the FIFO size
 	 */
 	if (!host->do_dma && (host->data_dir == DAVINCI_MMC_DATADIR_WRITE))
-		davinci_fifo_data_trans(host, rw_threshold);
+		davinci_fifo_data_trans(host, host->rw_threshold);
 
 	writel(cmd->arg, host->base + DAVINCI_MMCARGHL);
 	writel(cmd_reg,  host->base + DAVINCI_MMCCMD);
@@ -423,7 +466,7 @@ static int mmc_davinci_send_dma_request(struct mmc_davinci_host *host,
 			.dst_addr = host->mem_res->start + DAVINCI_MMCDXR,
 			.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
 			.dst_maxburst =
-				rw_threshold / DMA_SLAVE_BUSWIDTH_4_BYTES,
+				host->rw_threshold / DMA_SLAVE_BUSWIDTH_4_BYTES,
 		};
 		chan = host->dma_tx;
 		dmaengine_slave_config(host->dma_tx, &dma_tx_conf);
@@ -445,7 +488,7 @@ static int mmc_davinci_send_dma_request(struct mmc_davinci_host *host,
 			.src_addr = host->mem_res->start + DAVINCI_MMCDRR,
 			.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
 			.src_maxburst =
-				rw_threshold / DMA_SLAVE_BUSWIDTH_4_BYTES,
+				host->rw_threshold / DMA_SLAVE_BUSWIDTH_4_BYTES,
 		};
 		chan = host->dma_rx;
 		dmaengine_slave_config(host->dma_rx, &dma_rx_conf);
@@ -474,11 +517,15 @@ static int mmc_davinci_start_dma_transfer(struct mmc_davinci_host *host,
 		struct mmc_data *data)
 {
 	int i;
-	int mask = rw_threshold - 1;
+	int mask = host->rw_threshold - 1;
 	int ret = 0;
 
-	host->sg_len = dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
-				  mmc_get_dma_dir(data));
+	/* mapped by mmc_davinci_pre_req() while the previous one ran? */
+	if (data->host_cookie)
+		host->sg_len = data->host_cookie;
+	else
+		host->sg_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+					  data->sg_len, mmc_get_dma_dir(data));
 
 	/* no individual DMA segment should need a partial FIFO */
 	for (i = 0; i < host->sg_len; i++) {
@@ -486,6 +533,7 @@ static int mmc_davinci_start_dma_transfer(struct mmc_davinci_host *host,
 			dma_unmap_sg(mmc_dev(host->mmc),
 				     data->sg, data->sg_len,
 				     mmc_get_dma_dir(data));
+			data->host_cookie = 0;
 			return -1;
 		}
 	}
@@ -496,7 +544,7 @@ static int mmc_davinci_start_dma_transfer(struct mmc_davinci_host *host,
 	return ret;
 }
 
-static void __init_or_module
+static void
 davinci_release_dma_channels(struct mmc_davinci_host *host)
 {
 	if (!host->use_dma)
@@ -506,7 +554,7 @@ davinci_release_dma_channels(struct mmc_davinci_host *host)
 	dma_release_channel(host->dma_rx);
 }
 
-static int __init davinci_acquire_dma_channels(struct mmc_davinci_host *host)
+static int davinci_acquire_dma_channels(struct mmc_davinci_host *host)
 {
 	host->dma_tx = dma_request_chan(mmc_dev(host->mmc), "tx");
 	if (IS_ERR(host->dma_tx)) {
@@ -526,15 +574,45 @@ static int __init davinci_acquire_dma_channels(struct mmc_davinci_host *host)
 
 /*----------------------------------------------------------------------*/
 
+static unsigned int
+mmc_davinci_rw_threshold(struct mmc_davinci_host *host, struct mmc_data *data)
+{
+	struct scatterlist *sg;
+	unsigned int len;
+	int i;
+
+	if (host->version != MMC_CTLR_VERSION_2 || rw_threshold < 64 || !data)
+		return MIN_RW_THRESHOLD;
+
+	len = data->blocks * data->blksz;
+	for_each_sg(data->sg, sg, data->sg_len, i)
+		len |= sg->length;
+
+	return (len & (64 - 1)) ? MIN_RW_THRESHOLD : 64;
+}
+
+/* would mmc_davinci_prepare_data() try DMA for this transfer? */
+static bool mmc_davinci_want_dma(struct mmc_davinci_host *host,
+				 struct mmc_data *data)
+{
+	unsigned int len = data->blocks * data->blksz;
+
+	return host->use_dma && use_dma && len > poll_threshold &&
+		!(len & (mmc_davinci_rw_threshold(host, data) - 1));
+}
+
 static void
 mmc_davinci_prepare_data(struct mmc_davinci_host *host, struct mmc_request *req)
 {
-	int fifo_lev = (rw_threshold == 32) ? MMCFIFOCTL_FIFOLEV : 0;
+	int fifo_lev;
 	int timeout;
 	struct mmc_data *data = req->data;
 
+	host->rw_threshold = mmc_davinci_rw_threshold(host, data);
 	if (host->version == MMC_CTLR_VERSION_2)
-		fifo_lev = (rw_threshold == 64) ? MMCFIFOCTL_FIFOLEV : 0;
+		fifo_lev = (host->rw_threshold == 64) ? MMCFIFOCTL_FIFOLEV : 0;
+	else
+		fifo_lev = MMCFIFOCTL_FIFOLEV;
 
 	host->data = data;
 	if (data == NULL) {
@@ -583,13 +661,28 @@ mmc_davinci_prepare_data(struct mmc_davinci_host *host, struct mmc_request *req)
 	 *
 	 * While we *could* change that, unusual block sizes are rarely
 	 * used.  The occasional fallback to PIO should't hurt.
+	 *
+	 * Transfers small enough for the polling loop, such as SCR or
+	 * switch status reads, are quicker in PIO than setting up DMA.
 	 */
-	if (host->use_dma && (host->bytes_left & (rw_threshold - 1)) == 0
+	if (mmc_davinci_want_dma(host, data)
 			&& mmc_davinci_start_dma_transfer(host, data) == 0) {
 		/* zero this to ensure we take no PIO paths */
 		host->bytes_left = 0;
+		host->dma_xfers++;
 	} else {
-		/* Revert to CPU Copy */
+		/*
+		 * Revert to CPU Copy. The buffers may still be mapped if
+		 * the DMA submission failed, or if pre_req() mapped them
+		 * before DMA was turned off.
+		 */
+		if (host->do_dma || data->host_cookie)
+			dma_unmap_sg(mmc_dev(host->mmc), data->sg,
+				     data->sg_len, mmc_get_dma_dir(data));
+		data->host_cookie = 0;
+		host->do_dma = 0;
+
+		host->pio_xfers++;
 		host->sg_len = data->sg_len;
 		host->sg = host->data->sg;
 		mmc_davinci_sg_to_buf(host);
@@ -623,78 +716,62 @@ static void mmc_davinci_request(struct mmc_host *mmc, struct mmc_request *req)
 	mmc_davinci_start_command(host, req->cmd);
 }
 
-static unsigned int calculate_freq_for_card(struct mmc_davinci_host *host,
-	unsigned int mmc_req_freq)
+/*
+ * The card clock is the module clock divided by 2 * (CLKRT + 1). Pick the
+ * fastest of those rates that does not exceed the one asked for.
+ */
+static unsigned int mmc_davinci_clk_div(struct mmc_davinci_host *host,
+					unsigned int freq)
 {
-	unsigned int mmc_freq = 0, mmc_pclk = 0, mmc_push_pull_divisor = 0;
-
-	mmc_pclk = host->mmc_input_clk;
-	if (mmc_req_freq && mmc_pclk > (2 * mmc_req_freq))
-		mmc_push_pull_divisor = ((unsigned int)mmc_pclk
-				/ (2 * mmc_req_freq)) - 1;
-	else
-		mmc_push_pull_divisor = 0;
+	unsigned int div;
 
-	mmc_freq = (unsigned int)mmc_pclk
-		/ (2 * (mmc_push_pull_divisor + 1));
+	if (!freq)
+		return MMCCLK_CLKRT_MASK;
 
-	if (mmc_freq > mmc_req_freq)
-		mmc_push_pull_divisor = mmc_push_pull_divisor + 1;
-	/* Convert ns to clock cycles */
-	if (mmc_req_freq <= 400000)
-		host->ns_in_one_cycle = (1000000) / (((mmc_pclk
-				/ (2 * (mmc_push_pull_divisor + 1)))/1000));
-	else
-		host->ns_in_one_cycle = (1000000) / (((mmc_pclk
-				/ (2 * (mmc_push_pull_divisor + 1)))/1000000));
+	div = DIV_ROUND_UP(host->mmc_input_clk, 2 * freq);
 
-	return mmc_push_pull_divisor;
+	return clamp(div, 1U, MMCCLK_CLKRT_MASK + 1U) - 1;
 }
 
 static void calculate_clk_divider(struct mmc_host *mmc, struct mmc_ios *ios)
 {
-	unsigned int open_drain_freq = 0, mmc_pclk = 0;
-	unsigned int mmc_push_pull_freq = 0;
 	struct mmc_davinci_host *host = mmc_priv(mmc);
+	unsigned int freq, div, rate;
+	u32 temp;
 
-	if (ios->bus_mode == MMC_BUSMODE_OPENDRAIN) {
-		u32 temp;
-
-		/* Ignoring the init clock value passed for fixing the inter
-		 * operability with different cards.
-		 */
-		open_drain_freq = ((unsigned int)mmc_pclk
-				/ (2 * MMCSD_INIT_CLOCK)) - 1;
+	/* Ignoring the init clock value passed for fixing the inter
+	 * operability with different cards.
+	 */
+	if (ios->bus_mode == MMC_BUSMODE_OPENDRAIN)
+		freq = MMCSD_INIT_CLOCK;
+	else
+		freq = ios->clock;
 
-		if (open_drain_freq > 0xFF)
-			open_drain_freq = 0xFF;
+	div = mmc_davinci_clk_div(host, freq);
+	rate = host->mmc_input_clk / (2 * (div + 1));
 
-		temp = readl(host->base + DAVINCI_MMCCLK) & ~MMCCLK_CLKRT_MASK;
-		temp |= open_drain_freq;
-		writel(temp, host->base + DAVINCI_MMCCLK);
+	/* Convert ns to clock cycles */
+	host->ns_in_one_cycle = DIV_ROUND_UP(NSEC_PER_SEC, rate);
+	mmc->actual_clock = rate;
 
-		/* Convert ns to clock cycles */
-		host->ns_in_one_cycle = (1000000) / (MMCSD_INIT_CLOCK/1000);
-	} else {
-		u32 temp;
-		mmc_push_pull_freq = calculate_freq_for_card(host, ios->clock);
+	temp = readl(host->base + DAVINCI_MMCCLK);
+	if ((temp & MMCCLK_CLKRT_MASK) == div && (temp & MMCCLK_CLKEN))
+		return;
 
-		if (mmc_push_pull_freq > 0xFF)
-			mmc_push_pull_freq = 0xFF;
+	dev_dbg(mmc_dev(mmc), "card clock %u Hz (%u Hz requested)\n",
+		rate, freq);
 
-		temp = readl(host->base + DAVINCI_MMCCLK) & ~MMCCLK_CLKEN;
-		writel(temp, host->base + DAVINCI_MMCCLK);
+	temp &= ~MMCCLK_CLKEN;
+	writel(temp, host->base + DAVINCI_MMCCLK);
 
-		udelay(10);
+	udelay(10);
 
-		temp = readl(host->base + DAVINCI_MMCCLK) & ~MMCCLK_CLKRT_MASK;
-		temp |= mmc_push_pull_freq;
-		writel(temp, host->base + DAVINCI_MMCCLK);
+	temp = (temp & ~MMCCLK_CLKRT_MASK) | div;
+	writel(temp, host->base + DAVINCI_MMCCLK);
 
-		writel(temp | MMCCLK_CLKEN, host->base + DAVINCI_MMCCLK);
+	writel(temp | MMCCLK_CLKEN, host->base + DAVINCI_MMCCLK);
 
-		udelay(10);
-	}
+	udelay(10);
 }
 
 static void mmc_davinci_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
@@ -781,6 +858,13 @@ mmc_davinci_xfer_done(struct mmc_davinci_host *host, struct mmc_data *data)
 {
 	host->data = NULL;
 
+	if (data->error)
+		host->data_errors++;
+	else if (data->flags & MMC_DATA_WRITE)
+		host->bytes_written += data->bytes_xfered;
+	else
+		host->bytes_read += data->bytes_xfered;
+
 	if (host->mmc->caps & MMC_CAP_SDIO_IRQ) {
 		/*
 		 * SDIO Interrupt Detection work-around as suggested by
@@ -788,17 +872,17 @@ mmc_davinci_xfer_done(struct mmc_davinci_host *host, struct mmc_data *data)
 		 * 2.1.6): Signal SDIO interrupt only if it is enabled by core
 		 */
 		if (host->sdio_int && !(readl(host->base + DAVINCI_SDIOST0) &
-					SDIOST0_DAT1_HI)) {
-			writel(SDIOIST_IOINT, host->base + DAVINCI_SDIOIST);
-			mmc_signal_sdio_irq(host->mmc);
-		}
+					SDIOST0_DAT1_HI))
+			mmc_davinci_signal_sdio_irq(host);
 	}
 
 	if (host->do_dma) {
 		davinci_abort_dma(host);
 
-		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
-			     mmc_get_dma_dir(data));
+		/* mmc_davinci_post_req() unmaps what pre_req() mapped */
+		if (!data->host_cookie)
+			dma_unmap_sg(mmc_dev(host->mmc), data->sg,
+				     data->sg_len, mmc_get_dma_dir(data));
 		host->do_dma = false;
 	}
 	host->data_dir = DAVINCI_MMC_DATADIR_NONE;
@@ -869,8 +953,7 @@ static irqreturn_t mmc_davinci_sdio_irq(int irq, void *dev_id)
 	if (status & SDIOIST_IOINT) {
 		dev_dbg(mmc_dev(host->mmc),
 			"SDIO interrupt status %x\n", status);
-		writel(status | SDIOIST_IOINT, host->base + DAVINCI_SDIOIST);
-		mmc_signal_sdio_irq(host->mmc);
+		mmc_davinci_signal_sdio_irq(host);
 	}
 	return IRQ_HANDLED;
 }
@@ -916,7 +999,7 @@ static irqreturn_t mmc_davinci_irq(int irq, void *dev_id)
 		writel(0, host->base + DAVINCI_MMCIM);
 
 		do {
-			davinci_fifo_data_trans(host, rw_threshold);
+			davinci_fifo_data_trans(host, host->rw_threshold);
 			status = readl(host->base + DAVINCI_MMCST0);
 			qstatus |= status;
 		} while (host->bytes_left &&
@@ -935,7 +1018,7 @@ static irqreturn_t mmc_davinci_irq(int irq, void *dev_id)
 		/* All blocks sent/received, and CRC checks passed */
 		if (data != NULL) {
 			if ((host->do_dma == 0) && (host->bytes_left > 0)) {
-				/* if datasize < rw_threshold
+				/* if datasize < FIFO threshold
 				 * no RX ints are generated
 				 */
 				davinci_fifo_data_trans(host, host->bytes_left);
@@ -1045,29 +1128,77 @@ static int mmc_davinci_get_ro(struct mmc_host *mmc)
 static void mmc_davinci_enable_sdio_irq(struct mmc_host *mmc, int enable)
 {
 	struct mmc_davinci_host *host = mmc_priv(mmc);
+	unsigned long flags;
 
 	if (enable) {
+		/* the card may have asserted DAT1 while it was masked */
 		if (!(readl(host->base + DAVINCI_SDIOST0) & SDIOST0_DAT1_HI)) {
-			writel(SDIOIST_IOINT, host->base + DAVINCI_SDIOIST);
-			mmc_signal_sdio_irq(host->mmc);
-		} else {
-			host->sdio_int = true;
-			writel(readl(host->base + DAVINCI_SDIOIEN) |
-			       SDIOIEN_IOINTEN, host->base + DAVINCI_SDIOIEN);
+			mmc_davinci_signal_sdio_irq(host);
+			return;
 		}
+
+		spin_lock_irqsave(&host->sdio_lock, flags);
+		host->sdio_int = true;
+		writel(readl(host->base + DAVINCI_SDIOIEN) | SDIOIEN_IOINTEN,
+		       host->base + DAVINCI_SDIOIEN);
+		spin_unlock_irqrestore(&host->sdio_lock, flags);
 	} else {
+		spin_lock_irqsave(&host->sdio_lock, flags);
 		host->sdio_int = false;
 		writel(readl(host->base + DAVINCI_SDIOIEN) & ~SDIOIEN_IOINTEN,
 		       host->base + DAVINCI_SDIOIEN);
+		spin_unlock_irqrestore(&host->sdio_lock, flags);
 	}
 }
 
+static void mmc_davinci_ack_sdio_irq(struct mmc_host *mmc)
+{
+	mmc_davinci_enable_sdio_irq(mmc, 1);
+}
+
+/*
+ * Map the next request for DMA while the current one is still running,
+ * so that the cache maintenance isn't part of the gap between the two.
+ * The number of mapped segments is kept in host_cookie.
+ */
+static void mmc_davinci_pre_req(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct mmc_davinci_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data)
+		return;
+
+	data->host_cookie = 0;
+	if (!mmc_davinci_want_dma(host, data))
+		return;
+
+	data->host_cookie = dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+				       mmc_get_dma_dir(data));
+}
+
+static void mmc_davinci_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				 int err)
+{
+	struct mmc_data *data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		     mmc_get_dma_dir(data));
+	data->host_cookie = 0;
+}
+
 static const struct mmc_host_ops mmc_davinci_ops = {
 	.request	= mmc_davinci_request,
+	.pre_req	= mmc_davinci_pre_req,
+	.post_req	= mmc_davinci_post_req,
 	.set_ios	= mmc_davinci_set_ios,
 	.get_cd		= mmc_davinci_get_cd,
 	.get_ro		= mmc_davinci_get_ro,
 	.enable_sdio_irq = mmc_davinci_enable_sdio_irq,
+	.ack_sdio_irq	= mmc_davinci_ack_sdio_irq,
 };
 
 /*----------------------------------------------------------------------*/
@@ -1085,7 +1216,8 @@ static int mmc_davinci_cpufreq_transition(struct notifier_block *nb,
 	mmc = host->mmc;
 	mmc_pclk = clk_get_rate(host->clk);
 
-	if (val == CPUFREQ_POSTCHANGE) {
+	/* The card clock only changes if the module clock did */
+	if (val == CPUFREQ_POSTCHANGE && mmc_pclk != host->mmc_input_clk) {
 		spin_lock_irqsave(&mmc->lock, flags);
 		host->mmc_input_clk = mmc_pclk;
 		calculate_clk_divider(mmc, &mmc->ios);
@@ -1118,7 +1250,7 @@ static inline void mmc_davinci_cpufreq_deregister(struct mmc_davinci_host *host)
 {
 }
 #endif
-static void __init init_mmcsd_host(struct mmc_davinci_host *host)
+static void init_mmcsd_host(struct mmc_davinci_host *host)
 {
 
 	mmc_davinci_reset_ctrl(host, 1);
@@ -1201,7 +1333,52 @@ static int mmc_davinci_parse_pdata(struct mmc_host *mmc)
 	return 0;
 }
 
-static int __init davinci_mmcsd_probe(struct platform_device *pdev)
+/* KiB/s of @bytes over @interval_ns */
+static u64 mmc_davinci_perf_rate(u64 bytes, u64 interval_ns)
+{
+	return interval_ns ? div64_u64(bytes * (NSEC_PER_SEC / 1024),
+				       interval_ns) : 0;
+}
+
+static void mmc_davinci_perf_show(struct seq_file *s, void *data,
+				  u64 interval_ns)
+{
+	struct mmc_davinci_host *host = data;
+	u64 bytes_read = READ_ONCE(host->bytes_read);
+	u64 bytes_written = READ_ONCE(host->bytes_written);
+
+	seq_printf(s, "dma_xfers: %u\n", READ_ONCE(host->dma_xfers));
+	seq_printf(s, "pio_xfers: %u\n", READ_ONCE(host->pio_xfers));
+	seq_printf(s, "errors: %u\n", READ_ONCE(host->data_errors));
+	seq_printf(s, "read: %llu bytes, %llu KiB/s\n", bytes_read,
+		   mmc_davinci_perf_rate(bytes_read, interval_ns));
+	seq_printf(s, "written: %llu bytes, %llu KiB/s\n", bytes_written,
+		   mmc_davinci_perf_rate(bytes_written, interval_ns));
+}
+
+/* A transfer that completes meanwhile may or may not be counted. */
+static void mmc_davinci_perf_reset(void *data)
+{
+	struct mmc_davinci_host *host = data;
+
+	WRITE_ONCE(host->dma_xfers, 0);
+	WRITE_ONCE(host->pio_xfers, 0);
+	WRITE_ONCE(host->data_errors, 0);
+	WRITE_ONCE(host->bytes_read, 0);
+	WRITE_ONCE(host->bytes_written, 0);
+}
+
+static void mmc_davinci_perf_init(struct mmc_davinci_host *host)
+{
+	strlcpy(host->perf.name, mmc_hostname(host->mmc),
+		sizeof(host->perf.name));
+	host->perf.show = mmc_davinci_perf_show;
+	host->perf.reset = mmc_davinci_perf_reset;
+	host->perf.data = host;
+	legoev3_perf_register(&host->perf);
+}
+
+static int davinci_mmcsd_probe(struct platform_device *pdev)
 {
 	const struct of_device_id *match;
 	struct mmc_davinci_host *host = NULL;
@@ -1230,6 +1407,7 @@ static int __init davinci_mmcsd_probe(struct platform_device *pdev)
 
 	host = mmc_priv(mmc);
 	host->mmc = mmc;	/* Important */
+	spin_lock_init(&host->sdio_lock);
 
 	host->mem_res = mem;
 	host->base = devm_ioremap(&pdev->dev, mem->start, mem_size);
@@ -1289,6 +1467,16 @@ static int __init davinci_mmcsd_probe(struct platform_device *pdev)
 	if (id_entry)
 		host->version = id_entry->driver_data;
 
+	/*
+	 * The v2 controller can clock cards at up to 50 MHz, so let the core
+	 * switch cards that support it to high-speed timing when the module
+	 * clock and any board limit allow more than the default 25 MHz.
+	 */
+	if (host->version == MMC_CTLR_VERSION_2 &&
+	    host->mmc_input_clk / 2 > 25000000 &&
+	    (!mmc->f_max || mmc->f_max > 25000000))
+		mmc->caps |= MMC_CAP_SD_HIGHSPEED | MMC_CAP_MMC_HIGHSPEED;
+
 	mmc->ops = &mmc_davinci_ops;
 	mmc->ocr_avail = MMC_VDD_32_33 | MMC_VDD_33_34;
 
@@ -1296,10 +1484,10 @@ static int __init davinci_mmcsd_probe(struct platform_device *pdev)
 	 * Each hw_seg uses one EDMA parameter RAM slot, always one
 	 * channel and then usually some linked slots.
 	 */
-	mmc->max_segs		= MAX_NR_SG;
+	mmc->max_segs		= host->nr_sg;
 
-	/* EDMA limit per hw segment (one or two MBytes) */
-	mmc->max_seg_size	= MAX_CCNT * rw_threshold;
+	/* EDMA limit per hw segment, at the smallest FIFO threshold */
+	mmc->max_seg_size	= MAX_CCNT * MIN_RW_THRESHOLD;
 
 	/* MMC/SD controller limits for multiblock requests */
 	mmc->max_blk_size	= 4095;  /* BLEN is 12 bits */
@@ -1332,12 +1520,24 @@ static int __init davinci_mmcsd_probe(struct platform_device *pdev)
 		ret = devm_request_irq(&pdev->dev, host->sdio_irq,
 				       mmc_davinci_sdio_irq, 0,
 				       mmc_hostname(mmc), host);
-		if (!ret)
+		if (!ret) {
 			mmc->caps |= MMC_CAP_SDIO_IRQ;
+			/* card interrupts run from a work item, no kthread */
+			mmc->caps2 |= MMC_CAP2_SDIO_IRQ_NOTHREAD;
+		}
 	}
 
 	rename_region(mem, mmc_hostname(mmc));
 
+	/* the core removes these along with its debugfs directory */
+	if (mmc->debugfs_root) {
+		debugfs_create_u32("dma_xfers", S_IRUSR, mmc->debugfs_root,
+				   &host->dma_xfers);
+		debugfs_create_u32("pio_xfers", S_IRUSR, mmc->debugfs_root,
+				   &host->pio_xfers);
+	}
+	mmc_davinci_perf_init(host);
+
 	dev_info(mmc_dev(host->mmc), "Using %s, %d-bit mode\n",
 		host->use_dma ? "DMA" : "PIO",
 		(mmc->caps & MMC_CAP_4_BIT_DATA) ? 4 : 1);
@@ -1361,10 +1561,11 @@ static int __init davinci_mmcsd_probe(struct platform_device *pdev)
 	return ret;
 }
 
-static int __exit davinci_mmcsd_remove(struct platform_device *pdev)
+static int davinci_mmcsd_remove(struct platform_device *pdev)
 {
 	struct mmc_davinci_host *host = platform_get_drvdata(pdev);
 
+	legoev3_perf_unregister(&host->perf);
 	mmc_remove_host(host->mmc);
 	mmc_davinci_cpufreq_deregister(host);
 	davinci_release_dma_channels(host);
@@ -1413,12 +1614,14 @@ static struct platform_driver davinci_mmcsd_driver = {
 		.name	= "davinci_mmc",
 		.pm	= davinci_mmcsd_pm_ops,
 		.of_match_table = davinci_mmc_dt_ids,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
-	.remove		= __exit_p(davinci_mmcsd_remove),
+	.probe		= davinci_mmcsd_probe,
+	.remove		= davinci_mmcsd_remove,
 	.id_table	= davinci_mmc_devtype,
 };
 
-module_platform_driver_probe(davinci_mmcsd_driver, davinci_mmcsd_probe);
+module_platform_driver(davinci_mmcsd_driver);
 
 MODULE_AUTHOR("Texas Instruments India");
 MODULE_LICENSE("GPL");
@@ -220,7 +220,30 @@ static void slc_bump(struct slcan *sl)
 
 	sl->dev->stats.rx_packets++;
 	sl->dev->stats.rx_bytes += cf.can_dlc;
-	netif_rx_ni(skb);
+	/* slcan_receive_buf() runs the softirq once for the whole chunk */
+	netif_rx(skb);
+}
+
+/* Store a run of pdu characters that contains no end of pdu */
+static void slcan_unesc_run(struct slcan *sl, const unsigned char *cp,
+			    int count)
+{
+	int room;
+
+	if (test_bit(SLF_ERROR, &sl->flags))
+		return;
+
+	room = SLC_MTU - sl->rcount;
+	if (count > room) {
+		memcpy(sl->rbuff + sl->rcount, cp, room);
+		sl->rcount = SLC_MTU;
+		sl->dev->stats.rx_over_errors++;
+		set_bit(SLF_ERROR, &sl->flags);
+		return;
+	}
+
+	memcpy(sl->rbuff + sl->rcount, cp, count);
+	sl->rcount += count;
 }
 
 /* parse tty input stream */
@@ -471,16 +494,42 @@ static void slcan_receive_buf(struct tty_struct *tty,
 	if (!sl || sl->magic != SLCAN_MAGIC || !netif_running(sl->dev))
 		return;
 
+	local_bh_disable();
+
 	/* Read the characters out of the buffer */
-	while (count--) {
-		if (fp && *fp++) {
+	while (count) {
+		int n;
+
+		if (fp && *fp) {
 			if (!test_and_set_bit(SLF_ERROR, &sl->flags))
 				sl->dev->stats.rx_errors++;
+			fp++;
 			cp++;
+			count--;
+			continue;
+		}
+
+		/* copy everything up to the end of the pdu in one go */
+		for (n = 0; n < count; n++) {
+			if (cp[n] == '\r' || cp[n] == '\a' || (fp && fp[n]))
+				break;
+		}
+		if (n) {
+			slcan_unesc_run(sl, cp, n);
+			cp += n;
+			if (fp)
+				fp += n;
+			count -= n;
 			continue;
 		}
+
 		slcan_unesc(sl, *cp++);
+		if (fp)
+			fp++;
+		count--;
 	}
+
+	local_bh_enable();
 }
 
 /************************************
@@ -1195,6 +1195,25 @@ struct rtl8723bu_c2h {
 
 struct rtl8xxxu_fileops;
 
+/*
+ * Per-URB counters, exported through debugfs. They are only updated from
+ * the URB submit and completion paths and are not otherwise synchronized.
+ */
+struct rtl8xxxu_urb_stats {
+	u32 tx_submitted;
+	u32 tx_completed;
+	u32 tx_failed;
+	u32 tx_no_urb;
+	u32 tx_queue_stops;
+	u32 tx_vo_frames;
+	u32 tx_vo_late;
+	u32 tx_vo_max_us;
+	u32 rx_urbs;
+	u32 rx_failed;
+	u32 rx_frames;
+	u32 rx_max_frames;
+};
+
 struct rtl8xxxu_priv {
 	struct ieee80211_hw *hw;
 	struct usb_device *udev;
@@ -1204,6 +1223,7 @@ struct rtl8xxxu_priv {
 	struct list_head tx_urb_free_list;
 	int tx_urb_free_count;
 	bool tx_stopped;
+	bool tx_vo_stopped;
 
 	spinlock_t rx_urb_lock;
 	struct list_head rx_urb_pending_list;
@@ -1211,6 +1231,16 @@ struct rtl8xxxu_priv {
 	bool shutdown;
 	struct work_struct rx_urb_wq;
 
+	/* Completed RX URB buffers, parsed in NAPI context */
+	struct sk_buff_head rx_queue;
+	struct napi_struct napi;
+	struct net_device napi_dev;
+
+	int tx_urbs;
+	int tx_urb_low_water;
+	int tx_urb_high_water;
+	struct rtl8xxxu_urb_stats stats;
+
 	u8 mac_addr[ETH_ALEN];
 	char chip_name[8];
 	char chip_vendor[8];
@@ -1311,6 +1341,8 @@ struct rtl8xxxu_tx_urb {
 	struct urb urb;
 	struct ieee80211_hw *hw;
 	struct list_head list;
+	ktime_t submitted;
+	u16 ac;
 };
 
 struct rtl8xxxu_fileops {
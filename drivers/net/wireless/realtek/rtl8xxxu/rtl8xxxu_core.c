@@ -36,6 +36,8 @@
 #include <linux/wireless.h>
 #include <linux/firmware.h>
 #include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <net/mac80211.h>
 #include "rtl8xxxu.h"
 #include "rtl8xxxu_regs.h"
@@ -47,6 +49,8 @@ static bool rtl8xxxu_ht40_2g;
 static bool rtl8xxxu_dma_aggregation;
 static int rtl8xxxu_dma_agg_timeout = -1;
 static int rtl8xxxu_dma_agg_pages = -1;
+static int rtl8xxxu_tx_urbs = 64;
+static int rtl8xxxu_vo_budget_us = 10000;
 
 MODULE_AUTHOR("Jes Sorensen <Jes.Sorensen@gmail.com>");
 MODULE_DESCRIPTION("RTL8XXXu USB mac80211 Wireless LAN Driver");
@@ -71,13 +75,16 @@ module_param_named(dma_agg_timeout, rtl8xxxu_dma_agg_timeout, int, 0600);
 MODULE_PARM_DESC(dma_agg_timeout, "Set DMA aggregation timeout (range 1-127)");
 module_param_named(dma_agg_pages, rtl8xxxu_dma_agg_pages, int, 0600);
 MODULE_PARM_DESC(dma_agg_pages, "Set DMA aggregation pages (range 1-127, 0 to disable)");
+module_param_named(tx_urbs, rtl8xxxu_tx_urbs, int, 0600);
+MODULE_PARM_DESC(tx_urbs, "Number of TX URBs in flight (range 16-256)");
+module_param_named(vo_budget_us, rtl8xxxu_vo_budget_us, int, 0600);
+MODULE_PARM_DESC(vo_budget_us, "Voice TX completion time counted as late (us)");
 
 #define USB_VENDOR_ID_REALTEK		0x0bda
 #define RTL8XXXU_RX_URBS		32
 #define RTL8XXXU_RX_URB_PENDING_WATER	8
-#define RTL8XXXU_TX_URBS		64
-#define RTL8XXXU_TX_URB_LOW_WATER	25
-#define RTL8XXXU_TX_URB_HIGH_WATER	32
+#define RTL8XXXU_MIN_TX_URBS		16
+#define RTL8XXXU_MAX_TX_URBS		256
 
 static int rtl8xxxu_submit_rx_urb(struct rtl8xxxu_priv *priv,
 				  struct rtl8xxxu_rx_urb *rx_urb);
@@ -4427,12 +4434,12 @@ void rtl8xxxu_gen1_init_aggregation(struct rtl8xxxu_priv *priv)
 
 	page_thresh = (priv->fops->rx_agg_buf_size / 512);
 	if (rtl8xxxu_dma_agg_pages >= 0) {
-		if (rtl8xxxu_dma_agg_pages <= page_thresh)
-			timeout = page_thresh;
-		else if (rtl8xxxu_dma_agg_pages <= 6)
+		if (rtl8xxxu_dma_agg_pages < 6)
 			dev_err(&priv->udev->dev,
 				"%s: dma_agg_pages=%i too small, minium is 6\n",
 				__func__, rtl8xxxu_dma_agg_pages);
+		else if (rtl8xxxu_dma_agg_pages <= page_thresh)
+			page_thresh = rtl8xxxu_dma_agg_pages;
 		else
 			dev_err(&priv->udev->dev,
 				"%s: dma_agg_pages=%i larger than limit %i\n",
@@ -4652,11 +4659,18 @@ static void rtl8xxxu_free_tx_resources(struct rtl8xxxu_priv *priv)
 	spin_unlock_irqrestore(&priv->tx_urb_lock, flags);
 }
 
+/*
+ * Only the VI, BE and BK queues are stopped at the low water mark; the
+ * URBs below it are kept for the VO queue, which only stops once the pool
+ * is empty. A bulk transfer filling the pool then no longer holds up frames
+ * tagged for low latency (priority 6 or 7, e.g. DSCP CS6).
+ */
 static struct rtl8xxxu_tx_urb *
-rtl8xxxu_alloc_tx_urb(struct rtl8xxxu_priv *priv)
+rtl8xxxu_alloc_tx_urb(struct rtl8xxxu_priv *priv, u16 ac)
 {
 	struct rtl8xxxu_tx_urb *tx_urb;
 	unsigned long flags;
+	int i;
 
 	spin_lock_irqsave(&priv->tx_urb_lock, flags);
 	tx_urb = list_first_entry_or_null(&priv->tx_urb_free_list,
@@ -4664,10 +4678,17 @@ rtl8xxxu_alloc_tx_urb(struct rtl8xxxu_priv *priv)
 	if (tx_urb) {
 		list_del(&tx_urb->list);
 		priv->tx_urb_free_count--;
-		if (priv->tx_urb_free_count < RTL8XXXU_TX_URB_LOW_WATER &&
+		tx_urb->ac = ac;
+		if (priv->tx_urb_free_count < priv->tx_urb_low_water &&
 		    !priv->tx_stopped) {
 			priv->tx_stopped = true;
-			ieee80211_stop_queues(priv->hw);
+			priv->stats.tx_queue_stops++;
+			for (i = IEEE80211_AC_VI; i < priv->hw->queues; i++)
+				ieee80211_stop_queue(priv->hw, i);
+		}
+		if (!priv->tx_urb_free_count && !priv->tx_vo_stopped) {
+			priv->tx_vo_stopped = true;
+			ieee80211_stop_queue(priv->hw, IEEE80211_AC_VO);
 		}
 	}
 
@@ -4680,6 +4701,7 @@ static void rtl8xxxu_free_tx_urb(struct rtl8xxxu_priv *priv,
 				 struct rtl8xxxu_tx_urb *tx_urb)
 {
 	unsigned long flags;
+	int i;
 
 	INIT_LIST_HEAD(&tx_urb->list);
 
@@ -4687,10 +4709,15 @@ static void rtl8xxxu_free_tx_urb(struct rtl8xxxu_priv *priv,
 
 	list_add(&tx_urb->list, &priv->tx_urb_free_list);
 	priv->tx_urb_free_count++;
-	if (priv->tx_urb_free_count > RTL8XXXU_TX_URB_HIGH_WATER &&
+	if (priv->tx_vo_stopped) {
+		priv->tx_vo_stopped = false;
+		ieee80211_wake_queue(priv->hw, IEEE80211_AC_VO);
+	}
+	if (priv->tx_urb_free_count > priv->tx_urb_high_water &&
 	    priv->tx_stopped) {
 		priv->tx_stopped = false;
-		ieee80211_wake_queues(priv->hw);
+		for (i = IEEE80211_AC_VI; i < priv->hw->queues; i++)
+			ieee80211_wake_queue(priv->hw, i);
 	}
 
 	spin_unlock_irqrestore(&priv->tx_urb_lock, flags);
@@ -4717,6 +4744,19 @@ static void rtl8xxxu_tx_complete(struct urb *urb)
 
 	if (!urb->status)
 		tx_info->flags |= IEEE80211_TX_STAT_ACK;
+	else
+		priv->stats.tx_failed++;
+	priv->stats.tx_completed++;
+
+	if (tx_urb->ac == IEEE80211_AC_VO) {
+		u32 us = ktime_us_delta(ktime_get(), tx_urb->submitted);
+
+		priv->stats.tx_vo_frames++;
+		if (us > priv->stats.tx_vo_max_us)
+			priv->stats.tx_vo_max_us = us;
+		if (us > rtl8xxxu_vo_budget_us)
+			priv->stats.tx_vo_late++;
+	}
 
 	ieee80211_tx_status_irqsafe(hw, skb);
 
@@ -4937,9 +4977,10 @@ static void rtl8xxxu_tx(struct ieee80211_hw *hw,
 		goto error;
 	}
 
-	tx_urb = rtl8xxxu_alloc_tx_urb(priv);
+	tx_urb = rtl8xxxu_alloc_tx_urb(priv, skb_get_queue_mapping(skb));
 	if (!tx_urb) {
 		dev_warn(dev, "%s: Unable to allocate tx urb\n", __func__);
+		priv->stats.tx_no_urb++;
 		goto error;
 	}
 
@@ -5024,12 +5065,15 @@ static void rtl8xxxu_tx(struct ieee80211_hw *hw,
 			  skb->data, skb->len, rtl8xxxu_tx_complete, skb);
 
 	usb_anchor_urb(&tx_urb->urb, &priv->tx_anchor);
+	tx_urb->submitted = ktime_get();
 	ret = usb_submit_urb(&tx_urb->urb, GFP_ATOMIC);
 	if (ret) {
 		usb_unanchor_urb(&tx_urb->urb);
 		rtl8xxxu_free_tx_urb(priv, tx_urb);
+		priv->stats.tx_failed++;
 		goto error;
 	}
+	priv->stats.tx_submitted++;
 	return;
 error:
 	dev_kfree_skb(skb);
@@ -5209,10 +5253,11 @@ int rtl8xxxu_parse_rxdesc16(struct rtl8xxxu_priv *priv, struct sk_buff *skb)
 	__le32 *_rx_desc_le;
 	u32 *_rx_desc;
 	int drvinfo_sz, desc_shift;
-	int i, pkt_cnt, pkt_len, urb_len, pkt_offset;
+	int i, pkt_cnt, pkt_len, urb_len, pkt_offset, frames;
 
 	urb_len = skb->len;
 	pkt_cnt = 0;
+	frames = 0;
 
 	do {
 		rx_desc = (struct rtl8xxxu_rxdesc16 *)skb->data;
@@ -5279,7 +5324,8 @@ int rtl8xxxu_parse_rxdesc16(struct rtl8xxxu_priv *priv, struct sk_buff *skb)
 		rx_status->freq = hw->conf.chandef.chan->center_freq;
 		rx_status->band = hw->conf.chandef.chan->band;
 
-		ieee80211_rx_irqsafe(hw, skb);
+		ieee80211_rx_napi(hw, NULL, skb, &priv->napi);
+		frames++;
 
 		skb = next_skb;
 		if (skb)
@@ -5289,6 +5335,10 @@ int rtl8xxxu_parse_rxdesc16(struct rtl8xxxu_priv *priv, struct sk_buff *skb)
 		urb_len -= pkt_offset;
 	} while (skb && urb_len > 0 && pkt_cnt > 0);
 
+	priv->stats.rx_frames += frames;
+	if (frames > priv->stats.rx_max_frames)
+		priv->stats.rx_max_frames = frames;
+
 	return RX_TYPE_DATA_PKT;
 }
 
@@ -5349,7 +5399,10 @@ int rtl8xxxu_parse_rxdesc24(struct rtl8xxxu_priv *priv, struct sk_buff *skb)
 	rx_status->freq = hw->conf.chandef.chan->center_freq;
 	rx_status->band = hw->conf.chandef.chan->band;
 
-	ieee80211_rx_irqsafe(hw, skb);
+	ieee80211_rx_napi(hw, NULL, skb, &priv->napi);
+	priv->stats.rx_frames++;
+	if (!priv->stats.rx_max_frames)
+		priv->stats.rx_max_frames = 1;
 	return RX_TYPE_DATA_PKT;
 }
 
@@ -5365,13 +5418,18 @@ static void rtl8xxxu_rx_complete(struct urb *urb)
 	skb_put(skb, urb->actual_length);
 
 	if (urb->status == 0) {
-		priv->fops->parse_rx_desc(priv, skb);
+		priv->stats.rx_urbs++;
+		skb_queue_tail(&priv->rx_queue, skb);
+		napi_schedule(&priv->napi);
 
 		skb = NULL;
 		rx_urb->urb.context = NULL;
 		rtl8xxxu_queue_rx_urb(priv, rx_urb);
 	} else {
 		dev_dbg(dev, "%s: status %i\n",	__func__, urb->status);
+		if (urb->status != -ENOENT && urb->status != -ECONNRESET &&
+		    urb->status != -ESHUTDOWN)
+			priv->stats.rx_failed++;
 		goto cleanup;
 	}
 	return;
@@ -5382,6 +5440,41 @@ static void rtl8xxxu_rx_complete(struct urb *urb)
 	return;
 }
 
+/*
+ * The URB completion handler only queues the received buffers, they are
+ * de-muxed and handed to mac80211 here so that GRO can merge the frames
+ * of an aggregate. The budget is counted in 802.11 frames, a buffer is
+ * always parsed completely even if that overshoots the budget slightly.
+ */
+static int rtl8xxxu_poll(struct napi_struct *napi, int budget)
+{
+	struct rtl8xxxu_priv *priv =
+		container_of(napi, struct rtl8xxxu_priv, napi);
+	struct sk_buff *skb;
+	int done = 0;
+	u32 frames;
+
+	while (done < budget) {
+		skb = skb_dequeue(&priv->rx_queue);
+		if (!skb)
+			break;
+
+		frames = priv->stats.rx_frames;
+		priv->fops->parse_rx_desc(priv, skb);
+		done += max_t(u32, priv->stats.rx_frames - frames, 1);
+	}
+
+	if (done >= budget)
+		return budget;
+
+	napi_complete_done(napi, done);
+	/* Catch buffers queued after the last dequeue */
+	if (!skb_queue_empty(&priv->rx_queue))
+		napi_schedule(napi);
+
+	return done;
+}
+
 static int rtl8xxxu_submit_rx_urb(struct rtl8xxxu_priv *priv,
 				  struct rtl8xxxu_rx_urb *rx_urb)
 {
@@ -5791,6 +5884,8 @@ static int rtl8xxxu_start(struct ieee80211_hw *hw)
 	init_usb_anchor(&priv->tx_anchor);
 	init_usb_anchor(&priv->int_anchor);
 
+	napi_enable(&priv->napi);
+
 	priv->fops->enable_rf(priv);
 	if (priv->usb_interrupts) {
 		ret = rtl8xxxu_submit_int_urb(hw);
@@ -5798,7 +5893,16 @@ static int rtl8xxxu_start(struct ieee80211_hw *hw)
 			goto exit;
 	}
 
-	for (i = 0; i < RTL8XXXU_TX_URBS; i++) {
+	priv->tx_urbs = clamp(rtl8xxxu_tx_urbs, RTL8XXXU_MIN_TX_URBS,
+			      RTL8XXXU_MAX_TX_URBS);
+	/*
+	 * Keep the water marks at the same ratio as the original fixed
+	 * 25/32 of 64 URBs, so mac80211 is throttled once most are in flight.
+	 */
+	priv->tx_urb_low_water = priv->tx_urbs * 2 / 5;
+	priv->tx_urb_high_water = priv->tx_urbs / 2;
+
+	for (i = 0; i < priv->tx_urbs; i++) {
 		tx_urb = kmalloc(sizeof(struct rtl8xxxu_tx_urb), GFP_KERNEL);
 		if (!tx_urb) {
 			if (!i)
@@ -5814,6 +5918,7 @@ static int rtl8xxxu_start(struct ieee80211_hw *hw)
 	}
 
 	priv->tx_stopped = false;
+	priv->tx_vo_stopped = false;
 
 	spin_lock_irqsave(&priv->rx_urb_lock, flags);
 	priv->shutdown = false;
@@ -5842,6 +5947,9 @@ static int rtl8xxxu_start(struct ieee80211_hw *hw)
 
 	rtl8xxxu_write32(priv, REG_OFDM0_XA_AGC_CORE1, 0x6954341e);
 
+	if (ret)
+		napi_disable(&priv->napi);
+
 	return ret;
 
 error_out:
@@ -5852,6 +5960,8 @@ static int rtl8xxxu_start(struct ieee80211_hw *hw)
 	rtl8xxxu_write16(priv, REG_RXFLTMAP2, 0x0000);
 	rtl8xxxu_write16(priv, REG_RXFLTMAP0, 0x0000);
 
+	napi_disable(&priv->napi);
+
 	return ret;
 }
 
@@ -5874,6 +5984,9 @@ static void rtl8xxxu_stop(struct ieee80211_hw *hw)
 	if (priv->usb_interrupts)
 		usb_kill_anchored_urbs(&priv->int_anchor);
 
+	napi_disable(&priv->napi);
+	skb_queue_purge(&priv->rx_queue);
+
 	rtl8xxxu_write8(priv, REG_TXPAUSE, 0xff);
 
 	priv->fops->disable_rf(priv);
@@ -5981,6 +6094,44 @@ static int rtl8xxxu_parse_usb(struct rtl8xxxu_priv *priv,
 	return ret;
 }
 
+static int rtl8xxxu_urb_stats_show(struct seq_file *s, void *data)
+{
+	struct rtl8xxxu_priv *priv = s->private;
+	struct rtl8xxxu_urb_stats *stats = &priv->stats;
+
+	seq_printf(s, "tx_urbs: %i (free %i, low %i, high %i)\n",
+		   priv->tx_urbs, priv->tx_urb_free_count,
+		   priv->tx_urb_low_water, priv->tx_urb_high_water);
+	seq_printf(s, "tx_submitted: %u\n", stats->tx_submitted);
+	seq_printf(s, "tx_completed: %u\n", stats->tx_completed);
+	seq_printf(s, "tx_failed: %u\n", stats->tx_failed);
+	seq_printf(s, "tx_no_urb: %u\n", stats->tx_no_urb);
+	seq_printf(s, "tx_queue_stops: %u\n", stats->tx_queue_stops);
+	seq_printf(s, "tx_vo_frames: %u (late %u, max %u us, budget %i us)\n",
+		   stats->tx_vo_frames, stats->tx_vo_late,
+		   stats->tx_vo_max_us, rtl8xxxu_vo_budget_us);
+	seq_printf(s, "rx_aggregation: %s\n",
+		   priv->rx_buf_aggregation ? "on" : "off");
+	seq_printf(s, "rx_urbs: %u\n", stats->rx_urbs);
+	seq_printf(s, "rx_failed: %u\n", stats->rx_failed);
+	seq_printf(s, "rx_frames: %u\n", stats->rx_frames);
+	seq_printf(s, "rx_max_frames_per_urb: %u\n", stats->rx_max_frames);
+
+	return 0;
+}
+
+static int rtl8xxxu_urb_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rtl8xxxu_urb_stats_show, inode->i_private);
+}
+
+static const struct file_operations rtl8xxxu_urb_stats_fops = {
+	.open		= rtl8xxxu_urb_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int rtl8xxxu_probe(struct usb_interface *interface,
 			  const struct usb_device_id *id)
 {
@@ -6056,6 +6207,10 @@ static int rtl8xxxu_probe(struct usb_interface *interface,
 	INIT_LIST_HEAD(&priv->rx_urb_pending_list);
 	spin_lock_init(&priv->rx_urb_lock);
 	INIT_WORK(&priv->rx_urb_wq, rtl8xxxu_rx_urb_work);
+	skb_queue_head_init(&priv->rx_queue);
+	init_dummy_netdev(&priv->napi_dev);
+	ieee80211_napi_add(hw, &priv->napi, &priv->napi_dev, rtl8xxxu_poll,
+			   NAPI_POLL_WEIGHT);
 
 	usb_set_intfdata(interface, hw);
 
@@ -6144,12 +6299,16 @@ static int rtl8xxxu_probe(struct usb_interface *interface,
 		goto exit;
 	}
 
+	debugfs_create_file("urb_stats", 0400, hw->wiphy->debugfsdir, priv,
+			    &rtl8xxxu_urb_stats_fops);
+
 	return 0;
 
 exit:
 	usb_set_intfdata(interface, NULL);
 
 	if (priv) {
+		netif_napi_del(&priv->napi);
 		kfree(priv->fw_data);
 		mutex_destroy(&priv->usb_buf_mutex);
 		mutex_destroy(&priv->h2c_mutex);
@@ -6177,6 +6336,7 @@ static void rtl8xxxu_disconnect(struct usb_interface *interface)
 
 	dev_info(&priv->udev->dev, "disconnecting\n");
 
+	netif_napi_del(&priv->napi);
 	kfree(priv->fw_data);
 	mutex_destroy(&priv->usb_buf_mutex);
 	mutex_destroy(&priv->h2c_mutex);
@@ -19,12 +19,38 @@
 #include <linux/mfd/da8xx-cfgchip.h>
 #include <linux/mfd/syscon.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/phy/phy.h>
 #include <linux/platform_device.h>
 #include <linux/regmap.h>
+#include <linux/workqueue.h>
 
 #define PHY_INIT_BITS	(CFGCHIP2_SESENDEN | CFGCHIP2_VBDTCTEN)
 
+/*
+ * A USB 2.0 PHY in peripheral mode has nothing to do without VBUS. It is then
+ * powered down with its clock gated, and only the VBUS comparator enabled by
+ * PHY_INIT_BITS is polled to power it up again when a host is plugged in.
+ */
+static unsigned int idle_poll_ms = 500;
+module_param(idle_poll_ms, uint, 0644);
+MODULE_PARM_DESC(idle_poll_ms,
+		 "VBUS poll interval of the idle USB 2.0 PHY (0 = never power down)");
+
+/**
+ * struct da8xx_usb_phy - the two DA8xx USB PHYs
+ * @phy_provider: of phy provider
+ * @usb11_phy: USB 1.1 PHY of the OHCI
+ * @usb20_phy: USB 2.0 PHY of the MUSB
+ * @usb11_clk: clock of @usb11_phy
+ * @usb20_clk: clock of @usb20_phy
+ * @regmap: CFGCHIP registers
+ * @lock: protects the fields below
+ * @usb20_mode: mode set by the MUSB
+ * @usb20_on: @usb20_phy is powered on by its consumer
+ * @usb20_idle: @usb20_phy is powered down nonetheless while there is no VBUS
+ * @vbus_work: polls VBUS while @usb20_phy is on in peripheral mode
+ */
 struct da8xx_usb_phy {
 	struct phy_provider	*phy_provider;
 	struct phy		*usb11_phy;
@@ -32,6 +58,11 @@ struct da8xx_usb_phy {
 	struct clk		*usb11_clk;
 	struct clk		*usb20_clk;
 	struct regmap		*regmap;
+	struct mutex		lock;
+	enum phy_mode		usb20_mode;
+	bool			usb20_on;
+	bool			usb20_idle;
+	struct delayed_work	vbus_work;
 };
 
 static int da8xx_usb11_phy_power_on(struct phy *phy)
@@ -66,9 +97,8 @@ static const struct phy_ops da8xx_usb11_phy_ops = {
 	.owner		= THIS_MODULE,
 };
 
-static int da8xx_usb20_phy_power_on(struct phy *phy)
+static int da8xx_usb20_phy_enable(struct da8xx_usb_phy *d_phy)
 {
-	struct da8xx_usb_phy *d_phy = phy_get_drvdata(phy);
 	int ret;
 
 	ret = clk_prepare_enable(d_phy->usb20_clk);
@@ -80,14 +110,90 @@ static int da8xx_usb20_phy_power_on(struct phy *phy)
 	return 0;
 }
 
-static int da8xx_usb20_phy_power_off(struct phy *phy)
+static void da8xx_usb20_phy_disable(struct da8xx_usb_phy *d_phy)
 {
-	struct da8xx_usb_phy *d_phy = phy_get_drvdata(phy);
-
 	regmap_write_bits(d_phy->regmap, CFGCHIP(2), CFGCHIP2_OTGPWRDN,
 			  CFGCHIP2_OTGPWRDN);
 
 	clk_disable_unprepare(d_phy->usb20_clk);
+}
+
+/*
+ * Powers the USB 2.0 PHY down while it is on in peripheral mode without VBUS,
+ * and back up when VBUS shows up. Called with &da8xx_usb_phy->lock held.
+ */
+static void da8xx_usb20_phy_update_idle(struct da8xx_usb_phy *d_phy)
+{
+	unsigned int poll_ms = READ_ONCE(idle_poll_ms);
+	bool idle = false;
+	u32 val;
+
+	if (d_phy->usb20_on && d_phy->usb20_mode == PHY_MODE_USB_DEVICE &&
+	    poll_ms) {
+		regmap_read(d_phy->regmap, CFGCHIP(2), &val);
+		idle = !(val & CFGCHIP2_VBUSSENSE);
+		schedule_delayed_work(&d_phy->vbus_work,
+				      msecs_to_jiffies(poll_ms));
+	}
+
+	if (idle == d_phy->usb20_idle)
+		return;
+
+	if (idle) {
+		da8xx_usb20_phy_disable(d_phy);
+	} else if (da8xx_usb20_phy_enable(d_phy)) {
+		dev_err(&d_phy->usb20_phy->dev, "Failed to wake up\n");
+		return;
+	}
+
+	dev_dbg(&d_phy->usb20_phy->dev, "%s\n", idle ? "idle" : "awake");
+	d_phy->usb20_idle = idle;
+}
+
+static void da8xx_usb20_phy_vbus_work(struct work_struct *work)
+{
+	struct da8xx_usb_phy *d_phy = container_of(to_delayed_work(work),
+						   struct da8xx_usb_phy,
+						   vbus_work);
+
+	mutex_lock(&d_phy->lock);
+	da8xx_usb20_phy_update_idle(d_phy);
+	mutex_unlock(&d_phy->lock);
+}
+
+static int da8xx_usb20_phy_power_on(struct phy *phy)
+{
+	struct da8xx_usb_phy *d_phy = phy_get_drvdata(phy);
+	int ret;
+
+	ret = da8xx_usb20_phy_enable(d_phy);
+	if (ret)
+		return ret;
+
+	mutex_lock(&d_phy->lock);
+	d_phy->usb20_on = true;
+	d_phy->usb20_idle = false;
+	da8xx_usb20_phy_update_idle(d_phy);
+	mutex_unlock(&d_phy->lock);
+
+	return 0;
+}
+
+static int da8xx_usb20_phy_power_off(struct phy *phy)
+{
+	struct da8xx_usb_phy *d_phy = phy_get_drvdata(phy);
+
+	mutex_lock(&d_phy->lock);
+	d_phy->usb20_on = false;
+	mutex_unlock(&d_phy->lock);
+
+	cancel_delayed_work_sync(&d_phy->vbus_work);
+
+	mutex_lock(&d_phy->lock);
+	if (!d_phy->usb20_idle)
+		da8xx_usb20_phy_disable(d_phy);
+	d_phy->usb20_idle = false;
+	mutex_unlock(&d_phy->lock);
 
 	return 0;
 }
@@ -114,6 +220,11 @@ static int da8xx_usb20_phy_set_mode(struct phy *phy, enum phy_mode mode)
 	regmap_write_bits(d_phy->regmap, CFGCHIP(2), CFGCHIP2_OTGMODE_MASK,
 			  val);
 
+	mutex_lock(&d_phy->lock);
+	d_phy->usb20_mode = mode;
+	da8xx_usb20_phy_update_idle(d_phy);
+	mutex_unlock(&d_phy->lock);
+
 	return 0;
 }
 
@@ -152,6 +263,10 @@ static int da8xx_usb_phy_probe(struct platform_device *pdev)
 	if (!d_phy)
 		return -ENOMEM;
 
+	mutex_init(&d_phy->lock);
+	d_phy->usb20_mode = PHY_MODE_USB_OTG;
+	INIT_DELAYED_WORK(&d_phy->vbus_work, da8xx_usb20_phy_vbus_work);
+
 	if (node)
 		d_phy->regmap = syscon_regmap_lookup_by_compatible(
 							"ti,da830-cfgchip");
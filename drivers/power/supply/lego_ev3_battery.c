@@ -23,11 +23,22 @@
 #include <linux/of_device.h>
 #include <linux/platform_device.h>
 #include <linux/power_supply.h>
+#include <linux/workqueue.h>
+
+static unsigned int update_interval_ms = 1000;
+module_param(update_interval_ms, uint, 0644);
+MODULE_PARM_DESC(update_interval_ms,
+		 "Interval between cached battery readings in milliseconds");
+
+/* weight of a new reading in the cached average, as a power of two */
+#define LEGO_EV3_BATTERY_FILTER_SHIFT	2
 
 struct lego_ev3_battery {
 	struct iio_channel *iio_v;
 	struct iio_channel *iio_i;
 	struct iio_cb_buffer *iio_cb;
+	unsigned int v_idx;
+	unsigned int i_idx;
 	struct gpio_desc *rechargeable_gpio;
 	struct power_supply *psy;
 	int technology;
@@ -35,6 +46,11 @@ struct lego_ev3_battery {
 	int v_min;
 	int v_now;
 	int c_now;
+	struct delayed_work work;
+	/* filtered readings in uV and uA, valid once have_sample is set */
+	int v_avg;
+	int c_avg;
+	bool have_sample;
 };
 
 static int lego_ev3_battery_get_property(struct power_supply *psy,
@@ -42,34 +58,15 @@ static int lego_ev3_battery_get_property(struct power_supply *psy,
 					 union power_supply_propval *val)
 {
 	struct lego_ev3_battery *batt = power_supply_get_drvdata(psy);
-	int ret, val2;
 
 	switch (psp) {
 	case POWER_SUPPLY_PROP_TECHNOLOGY:
 		val->intval = batt->technology;
 		break;
 	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
-		/* battery voltage is iio channel * 2 + Vce of transistor */
-		ret = iio_read_channel_processed(batt->iio_v, &val->intval);
-		if (ret == -EBUSY)
-			val->intval = batt->v_now;
-		else if (ret == -ENODEV || ret == -EAGAIN)
-			return ret;
-		else if (ret < 0)
-			return -ENODATA;
-		val->intval *= 2000;
-		val->intval += 200000;
-		/* plus adjust for shunt resistor drop */
-		ret = iio_read_channel_processed(batt->iio_i, &val2);
-		if (ret == -EBUSY)
-			val2 = batt->c_now;
-		else if (ret == -ENODEV || ret == -EAGAIN)
-			return ret;
-		else if (ret < 0)
-			return -ENODATA;
-		val2 *= 1000;
-		val2 /= 15;
-		val->intval += val2;
+		if (!READ_ONCE(batt->have_sample))
+			return -EAGAIN;
+		val->intval = READ_ONCE(batt->v_avg);
 		break;
 	case POWER_SUPPLY_PROP_VOLTAGE_MAX_DESIGN:
 		val->intval = batt->v_max;
@@ -78,16 +75,9 @@ static int lego_ev3_battery_get_property(struct power_supply *psy,
 		val->intval = batt->v_min;
 		break;
 	case POWER_SUPPLY_PROP_CURRENT_NOW:
-		/* battery current is iio channel / 15 / 0.05 ohms */
-		ret = iio_read_channel_processed(batt->iio_i, &val->intval);
-		if (ret == -EBUSY)
-			val->intval = batt->c_now;
-		else if (ret == -ENODEV || ret == -EAGAIN)
-			return ret;
-		else if (ret < 0)
-			return -ENODATA;
-		val->intval *= 20000;
-		val->intval /= 15;
+		if (!READ_ONCE(batt->have_sample))
+			return -EAGAIN;
+		val->intval = READ_ONCE(batt->c_avg);
 		break;
 	case POWER_SUPPLY_PROP_SCOPE:
 		val->intval = POWER_SUPPLY_SCOPE_SYSTEM;
@@ -152,6 +142,17 @@ static enum power_supply_property lego_ev3_battery_props[] = {
 	POWER_SUPPLY_PROP_SCOPE,
 };
 
+/*
+ * Each reading is reported with power_supply_changed(), but userspace only
+ * gets a uevent when the battery moved noticeably, at most every 10 seconds.
+ */
+static const struct power_supply_uevent_threshold
+lego_ev3_battery_thresholds[] = {
+	{ POWER_SUPPLY_PROP_TECHNOLOGY,		0 },
+	{ POWER_SUPPLY_PROP_VOLTAGE_NOW,	50000 },
+	{ POWER_SUPPLY_PROP_CURRENT_NOW,	50000 },
+};
+
 static const struct power_supply_desc lego_ev3_battery_desc = {
 	.name			= "lego-ev3-battery",
 	.type			= POWER_SUPPLY_TYPE_BATTERY,
@@ -160,6 +161,9 @@ static const struct power_supply_desc lego_ev3_battery_desc = {
 	.get_property		= lego_ev3_battery_get_property,
 	.set_property		= lego_ev3_battery_set_property,
 	.property_is_writeable	= lego_ev3_battery_property_is_writeable,
+	.uevent_min_interval_ms	= 10000,
+	.uevent_thresholds	= lego_ev3_battery_thresholds,
+	.num_uevent_thresholds	= ARRAY_SIZE(lego_ev3_battery_thresholds),
 };
 
 static int lego_ev3_battery_iio_cb(const void *data, void *private)
@@ -173,12 +177,113 @@ static int lego_ev3_battery_iio_cb(const void *data, void *private)
 	 * To do this properly, we should be reading the iio_channel structs
 	 * to determine how to properly decode the data.
 	 */
-	batt->c_now =  ((raw[0] & 0xFFF) * 5002) >> 12;
-	batt->v_now =  ((raw[1] & 0xFFF) * 5002) >> 12;
+	batt->c_now =  ((raw[batt->i_idx] & 0xFFF) * 5002) >> 12;
+	batt->v_now =  ((raw[batt->v_idx] & 0xFFF) * 5002) >> 12;
 
 	return 0;
 }
 
+/*
+ * The callback buffer scans all of the io-channels of the battery node, which
+ * may also list the input and output port pins so that the ADC converts
+ * everything in a single scan per period. Other consumers then read their pins
+ * from that scan. The samples are handed to the callback in scan_index order,
+ * so this finds the position of @chan among them.
+ */
+static int lego_ev3_battery_scan_pos(struct lego_ev3_battery *batt,
+				     struct iio_channel *chan)
+{
+	struct iio_channel *c = iio_channel_cb_get_channels(batt->iio_cb);
+	bool found = false;
+	int pos = 0;
+
+	for (; c->indio_dev; c++) {
+		if (c->channel == chan->channel)
+			found = true;
+		else if (c->channel->scan_index < chan->channel->scan_index)
+			pos++;
+	}
+
+	return found ? pos : -EINVAL;
+}
+
+/*
+ * Reads the voltage and the current in mV, sampled together in one
+ * conversion. The ADC answers from its running scan when there is one, and
+ * the callback keeps the latest samples of that scan anyway.
+ */
+static int lego_ev3_battery_read(struct lego_ev3_battery *batt, int *v,
+				 int *c)
+{
+	struct iio_channel *chans[] = { batt->iio_v, batt->iio_i };
+	int vals[ARRAY_SIZE(chans)];
+	int ret;
+
+	ret = iio_read_channels_processed(chans, ARRAY_SIZE(chans), vals);
+	if (ret == -EBUSY) {
+		*v = READ_ONCE(batt->v_now);
+		*c = READ_ONCE(batt->c_now);
+		return 0;
+	}
+	if (ret < 0)
+		return ret;
+
+	*v = vals[0];
+	*c = vals[1];
+
+	return 0;
+}
+
+static int lego_ev3_battery_filter(int avg, int val)
+{
+	return avg + (val - avg) / (1 << LEGO_EV3_BATTERY_FILTER_SHIFT);
+}
+
+/*
+ * Property reads return the cached readings, which are only refreshed at
+ * update_interval_ms, so polling the power supply class does not add ADC
+ * traffic.
+ */
+static void lego_ev3_battery_work(struct work_struct *work)
+{
+	struct lego_ev3_battery *batt = container_of(to_delayed_work(work),
+						     struct lego_ev3_battery,
+						     work);
+	int v, c, ret;
+
+	ret = lego_ev3_battery_read(batt, &v, &c);
+	if (ret)
+		goto out;
+
+	/* battery current is iio channel / 15 / 0.05 ohms */
+	c = c * 20000 / 15;
+	/*
+	 * battery voltage is iio channel * 2 + Vce of transistor plus the
+	 * shunt resistor drop
+	 */
+	v = v * 2000 + 200000 + c / 20;
+
+	if (batt->have_sample) {
+		v = lego_ev3_battery_filter(batt->v_avg, v);
+		c = lego_ev3_battery_filter(batt->c_avg, c);
+	}
+	WRITE_ONCE(batt->v_avg, v);
+	WRITE_ONCE(batt->c_avg, c);
+	WRITE_ONCE(batt->have_sample, true);
+	power_supply_changed(batt->psy);
+
+out:
+	schedule_delayed_work(&batt->work,
+			      msecs_to_jiffies(max(update_interval_ms, 1U)));
+}
+
+static void lego_ev3_battery_cancel_work(void *data)
+{
+	struct lego_ev3_battery *batt = data;
+
+	cancel_delayed_work_sync(&batt->work);
+}
+
 static void lego_ev3_battery_release_all_cb(void *data)
 {
 	struct iio_cb_buffer *iio_cb = data;
@@ -231,6 +336,20 @@ static int lego_ev3_battery_probe(struct platform_device *pdev)
 
 	devm_add_action(dev, lego_ev3_battery_release_all_cb, batt->iio_cb);
 
+	err = lego_ev3_battery_scan_pos(batt, batt->iio_v);
+	if (err < 0) {
+		dev_err(dev, "Voltage channel is not scanned\n");
+		return err;
+	}
+	batt->v_idx = err;
+
+	err = lego_ev3_battery_scan_pos(batt, batt->iio_i);
+	if (err < 0) {
+		dev_err(dev, "Current channel is not scanned\n");
+		return err;
+	}
+	batt->i_idx = err;
+
 	batt->rechargeable_gpio = devm_gpiod_get(dev, "rechargeable", GPIOD_IN);
 	err = PTR_ERR_OR_ZERO(batt->rechargeable_gpio);
 	if (err) {
@@ -274,6 +393,13 @@ static int lego_ev3_battery_probe(struct platform_device *pdev)
 
 	devm_add_action(dev, lego_ev3_battery_stop_all_cb, batt->iio_cb);
 
+	INIT_DELAYED_WORK(&batt->work, lego_ev3_battery_work);
+	err = devm_add_action_or_reset(dev, lego_ev3_battery_cancel_work, batt);
+	if (err)
+		return err;
+
+	schedule_delayed_work(&batt->work, 0);
+
 	return 0;
 }
 
@@ -33,6 +33,8 @@ static struct device_type power_supply_dev_type;
 
 #define POWER_SUPPLY_DEFERRED_REGISTER_TIME	msecs_to_jiffies(10)
 
+#define POWER_SUPPLY_UEVENT_THRESHOLDS_MAX	8
+
 static bool __power_supply_is_supplied_by(struct power_supply *supplier,
 					 struct power_supply *supply)
 {
@@ -72,6 +74,75 @@ static int __power_supply_changed_work(struct device *dev, void *data)
 	return 0;
 }
 
+static bool power_supply_uevent_limited(struct power_supply *psy)
+{
+	return psy->desc->uevent_min_interval_ms ||
+	       psy->desc->num_uevent_thresholds;
+}
+
+/*
+ * Tells whether one of the threshold properties moved enough since the last
+ * uevent, and if so remembers their values for the next one.
+ */
+static bool power_supply_uevent_wanted(struct power_supply *psy)
+{
+	const struct power_supply_uevent_threshold *t;
+	union power_supply_propval val;
+	bool wanted = !psy->uevent_sent || !psy->desc->num_uevent_thresholds;
+	int values[POWER_SUPPLY_UEVENT_THRESHOLDS_MAX];
+	size_t i, num = psy->desc->num_uevent_thresholds;
+
+	for (i = 0; i < num; i++) {
+		t = &psy->desc->uevent_thresholds[i];
+		if (power_supply_get_property(psy, t->psp, &val)) {
+			/* can't tell, let userspace have a look */
+			val.intval = psy->uevent_values[i];
+			wanted = true;
+		}
+		values[i] = val.intval;
+		if (abs(val.intval - psy->uevent_values[i]) >= max(t->delta, 1))
+			wanted = true;
+	}
+
+	if (wanted)
+		memcpy(psy->uevent_values, values, num * sizeof(*values));
+
+	return wanted;
+}
+
+static void power_supply_uevent_work(struct work_struct *work)
+{
+	struct power_supply *psy = container_of(work, struct power_supply,
+						uevent_work.work);
+
+	if (!power_supply_uevent_wanted(psy))
+		return;
+
+	kobject_uevent(&psy->dev.kobj, KOBJ_CHANGE);
+	psy->uevent_last = jiffies;
+	psy->uevent_sent = true;
+}
+
+/* Sends the change uevent, no sooner than uevent_min_interval_ms allows */
+static void power_supply_changed_uevent(struct power_supply *psy)
+{
+	unsigned long next, delay = 0;
+
+	if (!power_supply_uevent_limited(psy)) {
+		kobject_uevent(&psy->dev.kobj, KOBJ_CHANGE);
+		return;
+	}
+
+	next = psy->uevent_last +
+	       msecs_to_jiffies(psy->desc->uevent_min_interval_ms);
+	if (psy->uevent_sent && time_before(jiffies, next))
+		delay = next - jiffies;
+
+	/* a uevent already pending covers this change as well */
+	queue_delayed_work(system_power_efficient_wq, &psy->uevent_work,
+			   delay);
+}
+
 static void power_supply_changed_work(struct work_struct *work)
 {
 	unsigned long flags;
@@ -96,7 +167,7 @@ static void power_supply_changed_work(struct work_struct *work)
 		power_supply_update_leds(psy);
 		atomic_notifier_call_chain(&power_supply_notifier,
 				PSY_EVENT_PROP_CHANGED, psy);
-		kobject_uevent(&psy->dev.kobj, KOBJ_CHANGE);
+		power_supply_changed_uevent(psy);
 		spin_lock_irqsave(&psy->changed_lock, flags);
 	}
 
@@ -849,7 +920,12 @@ __power_supply_register(struct device *parent,
 		pr_warn("%s: Expected proper parent device for '%s'\n",
 			__func__, desc->name);
 
-	psy = kzalloc(sizeof(*psy), GFP_KERNEL);
+	if (WARN_ON(desc->num_uevent_thresholds >
+		    POWER_SUPPLY_UEVENT_THRESHOLDS_MAX))
+		return ERR_PTR(-EINVAL);
+
+	psy = kzalloc(sizeof(*psy) + desc->num_uevent_thresholds *
+		      sizeof(*psy->uevent_values), GFP_KERNEL);
 	if (!psy)
 		return ERR_PTR(-ENOMEM);
 
@@ -877,6 +953,7 @@ __power_supply_register(struct device *parent,
 	INIT_WORK(&psy->changed_work, power_supply_changed_work);
 	INIT_DELAYED_WORK(&psy->deferred_register_work,
 			  power_supply_deferred_register_work);
+	INIT_DELAYED_WORK(&psy->uevent_work, power_supply_uevent_work);
 
 	rc = power_supply_check_supplies(psy);
 	if (rc) {
@@ -1073,6 +1150,7 @@ void power_supply_unregister(struct power_supply *psy)
 	WARN_ON(atomic_dec_return(&psy->use_cnt));
 	cancel_work_sync(&psy->changed_work);
 	cancel_delayed_work_sync(&psy->deferred_register_work);
+	cancel_delayed_work_sync(&psy->uevent_work);
 	sysfs_remove_link(&psy->dev.kobj, "powers");
 	power_supply_remove_triggers(psy);
 	psy_unregister_cooler(psy);
@@ -32,6 +32,9 @@
 
 #include <dt-bindings/pwm/pwm.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/pwm.h>
+
 #define MAX_PWMS 1024
 
 static DEFINE_MUTEX(pwm_lookup_lock);
@@ -532,10 +535,71 @@ int pwm_apply_state(struct pwm_device *pwm, struct pwm_state *state)
 		}
 	}
 
+	trace_pwm_apply(pwm, state);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(pwm_apply_state);
 
+/**
+ * pwm_apply_states() - atomically apply new states to several PWMs
+ * @pwms: PWM devices
+ * @states: new states, one per entry of @pwms
+ * @num: number of PWM devices
+ *
+ * When all PWMs belong to the same chip and its driver supports it, the new
+ * states take effect in the same PWM period, e.g. to keep the two motors of
+ * a differential drive in step. Otherwise the states are applied one PWM at
+ * a time, in order.
+ *
+ * Returns: 0 on success or a negative error code on failure.
+ */
+int pwm_apply_states(struct pwm_device **pwms, struct pwm_state *states,
+		     unsigned int num)
+{
+	struct pwm_chip *chip;
+	unsigned int i;
+	int err;
+
+	if (!pwms || !states || !num)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		if (!pwms[i] || !states[i].period ||
+		    states[i].duty_cycle > states[i].period)
+			return -EINVAL;
+
+		if (pwms[i]->chip != pwms[0]->chip)
+			break;
+	}
+
+	chip = pwms[0]->chip;
+
+	if (i == num && chip->ops->apply_multiple) {
+		err = chip->ops->apply_multiple(chip, pwms, states, num);
+		if (!err) {
+			for (i = 0; i < num; i++) {
+				pwms[i]->state = states[i];
+				trace_pwm_apply(pwms[i], &states[i]);
+			}
+
+			return 0;
+		}
+
+		if (err != -ENOTSUPP)
+			return err;
+	}
+
+	for (i = 0; i < num; i++) {
+		err = pwm_apply_state(pwms[i], &states[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(pwm_apply_states);
+
 /**
  * pwm_capture() - capture and report a PWM signal
  * @pwm: PWM device
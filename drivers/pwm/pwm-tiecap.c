@@ -21,6 +21,7 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/io.h>
+#include <linux/iopoll.h>
 #include <linux/err.h>
 #include <linux/clk.h>
 #include <linux/pm_runtime.h>
@@ -32,11 +33,22 @@
 #define CAP2			0x0C
 #define CAP3			0x10
 #define CAP4			0x14
+#define ECCTL1			0x28
+#define ECCTL1_CAPLDEN		BIT(8)
+#define ECCTL1_CAP4POL_FALL	BIT(6)
+#define ECCTL1_CAP2POL_FALL	BIT(2)
 #define ECCTL2			0x2A
 #define ECCTL2_APWM_POL_LOW	BIT(10)
 #define ECCTL2_APWM_MODE	BIT(9)
 #define ECCTL2_SYNC_SEL_DISA	(BIT(7) | BIT(6))
 #define ECCTL2_TSCTR_FREERUN	BIT(4)
+#define ECCTL2_REARM		BIT(3)
+#define ECCTL2_STOP_WRAP_CEVT4	(BIT(2) | BIT(1))
+#define ECCTL2_ONESHOT		BIT(0)
+#define ECFLG			0x2E
+#define ECFLG_CEVT4		BIT(4)
+#define ECCLR			0x30
+#define ECCLR_ALL		0xFF
 
 struct ecap_context {
 	u32 cap3;
@@ -181,6 +193,65 @@ static void ecap_pwm_disable(struct pwm_chip *chip, struct pwm_device *pwm)
 	pm_runtime_put_sync(pc->chip.dev);
 }
 
+/*
+ * Time stamp one rising, falling, rising, falling edge sequence of the input
+ * in the four capture registers and derive period and duty cycle from them.
+ * The module is shared with APWM output mode, so this only works while the
+ * PWM output is disabled.
+ */
+static int ecap_pwm_capture(struct pwm_chip *chip, struct pwm_device *pwm,
+			    struct pwm_capture *result, unsigned long timeout)
+{
+	struct ecap_pwm_chip *pc = to_ecap_pwm_chip(chip);
+	u32 cap1, cap2, cap3;
+	u16 ecctl2, flags;
+	u64 c;
+	int ret;
+
+	if (pwm_is_enabled(pwm))
+		return -EBUSY;
+
+	pm_runtime_get_sync(pc->chip.dev);
+
+	ecctl2 = readw(pc->mmio_base + ECCTL2);
+
+	/* Absolute time stamps, rising edges in CAP1/3, falling in CAP2/4 */
+	writew(ECCTL1_CAPLDEN | ECCTL1_CAP2POL_FALL | ECCTL1_CAP4POL_FALL,
+	       pc->mmio_base + ECCTL1);
+	writew(ECCLR_ALL, pc->mmio_base + ECCLR);
+
+	/* One shot capture mode, stopping after the fourth event */
+	writew(ECCTL2_SYNC_SEL_DISA | ECCTL2_TSCTR_FREERUN |
+	       ECCTL2_STOP_WRAP_CEVT4 | ECCTL2_ONESHOT | ECCTL2_REARM,
+	       pc->mmio_base + ECCTL2);
+
+	ret = readw_poll_timeout(pc->mmio_base + ECFLG, flags,
+				 flags & ECFLG_CEVT4, USEC_PER_MSEC,
+				 timeout * USEC_PER_MSEC);
+	if (!ret) {
+		cap1 = readl(pc->mmio_base + CAP1);
+		cap2 = readl(pc->mmio_base + CAP2);
+		cap3 = readl(pc->mmio_base + CAP3);
+
+		c = (u64)(cap3 - cap1) * NSEC_PER_SEC;
+		do_div(c, pc->clk_rate);
+		result->period = c;
+
+		c = (u64)(cap2 - cap1) * NSEC_PER_SEC;
+		do_div(c, pc->clk_rate);
+		result->duty_cycle = c;
+	}
+
+	/* Stop the counter and go back to the APWM configuration */
+	writew(0, pc->mmio_base + ECCTL1);
+	writew(ECCLR_ALL, pc->mmio_base + ECCLR);
+	writew(ecctl2 & ~ECCTL2_TSCTR_FREERUN, pc->mmio_base + ECCTL2);
+
+	pm_runtime_put_sync(pc->chip.dev);
+
+	return ret;
+}
+
 static void ecap_pwm_free(struct pwm_chip *chip, struct pwm_device *pwm)
 {
 	if (pwm_is_enabled(pwm)) {
@@ -195,6 +266,7 @@ static const struct pwm_ops ecap_pwm_ops = {
 	.set_polarity = ecap_pwm_set_polarity,
 	.enable = ecap_pwm_enable,
 	.disable = ecap_pwm_disable,
+	.capture = ecap_pwm_capture,
 	.owner = THIS_MODULE,
 };
 
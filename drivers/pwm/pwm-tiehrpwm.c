@@ -56,9 +56,19 @@
 #define PERIOD_MAX		0xFFFF
 
 /* compare module registers */
+#define CMPCTL			0x0E
 #define CMPA			0x12
 #define CMPB			0x14
 
+#define CMPCTL_SHDWBMODE_IMDT	BIT(6)
+#define CMPCTL_SHDWAMODE_IMDT	BIT(4)
+#define CMPCTL_LOADBMODE_MASK	(BIT(3) | BIT(2))
+#define CMPCTL_LOADBMODE_ZRO	0
+#define CMPCTL_LOADAMODE_MASK	(BIT(1) | BIT(0))
+#define CMPCTL_LOADAMODE_ZRO	0
+#define CMPCTL_LOADAMODE_FRZ	(BIT(1) | BIT(0))
+#define CMPCTL_LOADBMODE_FRZ	(BIT(3) | BIT(2))
+
 /* Action qualifier module registers */
 #define AQCTLA			0x16
 #define AQCTLB			0x18
@@ -126,6 +136,8 @@ struct ehrpwm_pwm_chip {
 	unsigned long clk_rate;
 	void __iomem *mmio_base;
 	unsigned long period_cycles[NUM_PWM_CHANNEL];
+	/* prescaler the time base was last set up with, 0 if never */
+	u16 ps_divval;
 	enum pwm_polarity polarity[NUM_PWM_CHANNEL];
 	struct clk *tbclk;
 	struct ehrpwm_context ctx;
@@ -241,6 +253,13 @@ static int ehrpwm_pwm_config(struct pwm_chip *chip, struct pwm_device *pwm,
 	unsigned int i, cmp_reg;
 	unsigned long long c;
 
+	if (pwm->hwpwm == 1)
+		/* Channel 1 configured with compare B register */
+		cmp_reg = CMPB;
+	else
+		/* Channel 0 configured with compare A register */
+		cmp_reg = CMPA;
+
 	if (period_ns > NSEC_PER_SEC)
 		return -ERANGE;
 
@@ -280,6 +299,21 @@ static int ehrpwm_pwm_config(struct pwm_chip *chip, struct pwm_device *pwm,
 		}
 	}
 
+	/*
+	 * Only the duty cycle changes: the time base already runs with this
+	 * period, so just write the compare register. It is shadowed and
+	 * loaded when the counter wraps, so the output never sees a cycle
+	 * with a partial update.
+	 */
+	if (pc->ps_divval && pc->period_cycles[pwm->hwpwm] == period_cycles) {
+		pm_runtime_get_sync(chip->dev);
+		ehrpwm_write(pc->mmio_base, cmp_reg,
+			     duty_cycles / pc->ps_divval);
+		pm_runtime_put_sync(chip->dev);
+
+		return 0;
+	}
+
 	pc->period_cycles[pwm->hwpwm] = period_cycles;
 
 	/* Configure clock prescaler to support Low frequency PWM wave */
@@ -291,31 +325,28 @@ static int ehrpwm_pwm_config(struct pwm_chip *chip, struct pwm_device *pwm,
 
 	pm_runtime_get_sync(chip->dev);
 
-	/* Update clock prescaler values */
-	ehrpwm_modify(pc->mmio_base, TBCTL, TBCTL_CLKDIV_MASK, tb_divval);
+	/*
+	 * Update clock prescaler values, configure shadow loading on Period
+	 * register and the ehrpwm counter for up-count mode, in one go.
+	 */
+	ehrpwm_modify(pc->mmio_base, TBCTL,
+		      TBCTL_CLKDIV_MASK | TBCTL_PRDLD_MASK | TBCTL_CTRMODE_MASK,
+		      tb_divval | TBCTL_PRDLD_SHDW | TBCTL_CTRMODE_UP);
 
 	/* Update period & duty cycle with presacler division */
 	period_cycles = period_cycles / ps_divval;
 	duty_cycles = duty_cycles / ps_divval;
 
-	/* Configure shadow loading on Period register */
-	ehrpwm_modify(pc->mmio_base, TBCTL, TBCTL_PRDLD_MASK, TBCTL_PRDLD_SHDW);
-
 	ehrpwm_write(pc->mmio_base, TBPRD, period_cycles);
 
-	/* Configure ehrpwm counter for up-count mode */
-	ehrpwm_modify(pc->mmio_base, TBCTL, TBCTL_CTRMODE_MASK,
-		      TBCTL_CTRMODE_UP);
-
-	if (pwm->hwpwm == 1)
-		/* Channel 1 configured with compare B register */
-		cmp_reg = CMPB;
-	else
-		/* Channel 0 configured with compare A register */
-		cmp_reg = CMPA;
+	/* Both compare registers shadowed, loaded when the counter is zero */
+	ehrpwm_write(pc->mmio_base, CMPCTL,
+		     CMPCTL_LOADBMODE_ZRO | CMPCTL_LOADAMODE_ZRO);
 
 	ehrpwm_write(pc->mmio_base, cmp_reg, duty_cycles);
 
+	pc->ps_divval = ps_divval;
+
 	pm_runtime_put_sync(chip->dev);
 
 	return 0;
@@ -420,12 +451,64 @@ static void ehrpwm_pwm_free(struct pwm_chip *chip, struct pwm_device *pwm)
 	pc->period_cycles[pwm->hwpwm] = 0;
 }
 
+/*
+ * Update the duty cycles of both channels in the same period: shadow loads
+ * are frozen while CMPA and CMPB are written and re-armed together, so the
+ * next counter wrap picks up both values. Only duty cycle changes can be
+ * applied this way, anything else goes through the regular callbacks.
+ */
+static int ehrpwm_pwm_apply_multiple(struct pwm_chip *chip,
+				     struct pwm_device **pwms,
+				     struct pwm_state *states,
+				     unsigned int num)
+{
+	struct ehrpwm_pwm_chip *pc = to_ehrpwm_pwm_chip(chip);
+	u16 cmp[NUM_PWM_CHANNEL] = { };
+	unsigned long long c;
+	unsigned int i;
+
+	if (!pc->ps_divval)
+		return -ENOTSUPP;
+
+	for (i = 0; i < num; i++) {
+		struct pwm_device *pwm = pwms[i];
+
+		if (states[i].period != pwm->state.period ||
+		    states[i].polarity != pwm->state.polarity ||
+		    states[i].enabled != pwm->state.enabled ||
+		    !pc->period_cycles[pwm->hwpwm])
+			return -ENOTSUPP;
+
+		c = pc->clk_rate;
+		c = c * states[i].duty_cycle;
+		do_div(c, NSEC_PER_SEC);
+		cmp[pwm->hwpwm] = (unsigned long)c / pc->ps_divval;
+	}
+
+	pm_runtime_get_sync(chip->dev);
+
+	ehrpwm_write(pc->mmio_base, CMPCTL,
+		     CMPCTL_LOADBMODE_FRZ | CMPCTL_LOADAMODE_FRZ);
+
+	for (i = 0; i < num; i++)
+		ehrpwm_write(pc->mmio_base, pwms[i]->hwpwm ? CMPB : CMPA,
+			     cmp[pwms[i]->hwpwm]);
+
+	ehrpwm_write(pc->mmio_base, CMPCTL,
+		     CMPCTL_LOADBMODE_ZRO | CMPCTL_LOADAMODE_ZRO);
+
+	pm_runtime_put_sync(chip->dev);
+
+	return 0;
+}
+
 static const struct pwm_ops ehrpwm_pwm_ops = {
 	.free = ehrpwm_pwm_free,
 	.config = ehrpwm_pwm_config,
 	.set_polarity = ehrpwm_pwm_set_polarity,
 	.enable = ehrpwm_pwm_enable,
 	.disable = ehrpwm_pwm_disable,
+	.apply_multiple = ehrpwm_pwm_apply_multiple,
 	.owner = THIS_MODULE,
 };
 
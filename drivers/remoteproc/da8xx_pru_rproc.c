@@ -0,0 +1,544 @@
+/*
+ * Remote processor driver for the DA8XX PRU subsystem
+ *
+ * The PRUSS of the DA850/AM1808/OMAP-L138 contains two 32-bit PRU cores with
+ * 4K of instruction RAM and 512 bytes of data RAM each, and an interrupt
+ * controller (INTC) the cores use to signal each other and the ARM. Each
+ * core is registered as its own remote processor, so soft peripherals that
+ * need tight timing can be loaded as regular ELF firmware and talk to the
+ * kernel over rpmsg instead of being bit-banged from the ARM.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+#include <linux/bitops.h>
+#include <linux/clk.h>
+#include <linux/da8xx_pru_rproc.h>
+#include <linux/err.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/platform_device.h>
+#include <linux/remoteproc.h>
+#include <linux/sizes.h>
+
+#include "remoteproc_internal.h"
+
+static char *da8xx_pru0_fw_name = "rproc-pru0-fw";
+module_param(da8xx_pru0_fw_name, charp, S_IRUGO);
+MODULE_PARM_DESC(da8xx_pru0_fw_name,
+		 "Name of PRU0 firmware file in /lib/firmware (if not specified defaults to 'rproc-pru0-fw')");
+
+static char *da8xx_pru1_fw_name = "rproc-pru1-fw";
+module_param(da8xx_pru1_fw_name, charp, S_IRUGO);
+MODULE_PARM_DESC(da8xx_pru1_fw_name,
+		 "Name of PRU1 firmware file in /lib/firmware (if not specified defaults to 'rproc-pru1-fw')");
+
+#define DA8XX_PRU_NUM_CORES		2
+
+/* PRUSS memory map, as offsets from the start of the subsystem */
+#define DA8XX_PRU_DRAM(n)		((n) * 0x2000)
+#define DA8XX_PRU_DRAM_SIZE		DA8XX_PRU_RPROC_DRAM_SIZE
+#define DA8XX_PRUSS_INTC		0x4000
+#define DA8XX_PRU_CTRL(n)		(0x7000 + (n) * 0x800)
+#define DA8XX_PRU_IRAM(n)		(0x8000 + (n) * 0x4000)
+#define DA8XX_PRU_IRAM_SIZE		SZ_4K
+
+/*
+ * Device addresses as seen in the firmware ELF files: the instruction RAM is
+ * linked at 0x20000000 to keep it apart from the data RAM at 0, which is how
+ * the GNU pru-elf toolchain lays out the two address spaces of the core.
+ */
+#define DA8XX_PRU_IMEM_DA		0x20000000
+#define DA8XX_PRU_DMEM_DA		0x0
+
+/* PRU control registers */
+#define DA8XX_PRU_CONTROL		0x00
+#define DA8XX_PRU_CONTROL_SOFT_RST_N	BIT(0)
+#define DA8XX_PRU_CONTROL_ENABLE	BIT(1)
+#define DA8XX_PRU_CONTROL_PCRESETVAL(pc)	((pc) << 16)
+
+/* PRUSS INTC registers */
+#define DA8XX_PRUSS_INTC_GER		0x0010
+#define DA8XX_PRUSS_INTC_SISR		0x0020
+#define DA8XX_PRUSS_INTC_SICR		0x0024
+#define DA8XX_PRUSS_INTC_EISR		0x0028
+#define DA8XX_PRUSS_INTC_EICR		0x002c
+#define DA8XX_PRUSS_INTC_HIEISR		0x0034
+#define DA8XX_PRUSS_INTC_HIDISR		0x0038
+#define DA8XX_PRUSS_INTC_SRSR(n)	(0x0200 + (n) * 4)
+#define DA8XX_PRUSS_INTC_SECR(n)	(0x0280 + (n) * 4)
+#define DA8XX_PRUSS_INTC_CMR(n)		(0x0400 + (n) * 4)
+#define DA8XX_PRUSS_INTC_HMR(n)		(0x0800 + (n) * 4)
+#define DA8XX_PRUSS_INTC_SIPR(n)	(0x0d00 + (n) * 4)
+#define DA8XX_PRUSS_INTC_SITR(n)	(0x0d80 + (n) * 4)
+
+/*
+ * System events 32..35 are the ones the PRUs can raise themselves by writing
+ * to R31. Each core gets one event towards the ARM and one from it:
+ *
+ *   PRUn -> ARM: event 32 + 2n, channel 2 + n, host 2 + n (PRU_EVTOUTn)
+ *   ARM -> PRUn: event 33 + 2n, channel n, host n (R31 bit 30 + n on PRUn)
+ *
+ * Firmware signals the ARM by writing (BIT(5) | 2n) to R31, and polls
+ * R31 bit 30 + n for kicks from the ARM.
+ */
+#define DA8XX_PRU_EVT_TO_HOST(n)	(32 + 2 * (n))
+#define DA8XX_PRU_EVT_FROM_HOST(n)	(33 + 2 * (n))
+#define DA8XX_PRU_CHAN_TO_HOST(n)	(2 + (n))
+#define DA8XX_PRU_CHAN_FROM_HOST(n)	(n)
+
+/**
+ * struct da8xx_pru - state of one PRU core
+ * @rproc: rproc handle
+ * @pruss: the subsystem this core belongs to
+ * @id: index of the core, 0 or 1
+ * @ctrl: virt ptr to the core's control registers
+ * @iram: virt ptr to the core's instruction RAM
+ * @dram: virt ptr to the core's data RAM
+ * @irq: irq # the core's PRU_EVTOUT line is routed to
+ * @event_handler: called on PRU to ARM events, for firmware without vrings
+ * @event_data: argument of @event_handler
+ */
+struct da8xx_pru {
+	struct rproc *rproc;
+	struct da8xx_pruss *pruss;
+	int id;
+	void __iomem *ctrl;
+	void __iomem *iram;
+	void __iomem *dram;
+	int irq;
+	void (*event_handler)(void *data);
+	void *event_data;
+};
+
+/**
+ * struct da8xx_pruss - state of the PRU subsystem
+ * @base: virt ptr to the start of the subsystem
+ * @intc: virt ptr to the INTC registers
+ * @clk: the subsystem's LPSC clock
+ * @pru: the two cores
+ */
+struct da8xx_pruss {
+	void __iomem *base;
+	void __iomem *intc;
+	struct clk *clk;
+	struct da8xx_pru *pru[DA8XX_PRU_NUM_CORES];
+};
+
+/* there is only one PRUSS, this is it once it has been probed */
+static struct da8xx_pruss *da8xx_pruss;
+static DEFINE_MUTEX(da8xx_pruss_lock);
+
+/**
+ * handle_event() - inbound virtqueue message workqueue function
+ *
+ * As for the DSP, there is no payload telling which virtqueue was kicked,
+ * so all of them are polled.
+ */
+static irqreturn_t handle_event(int irq, void *p)
+{
+	struct rproc *rproc = p;
+	struct da8xx_pru *pru = rproc->priv;
+	void (*event_handler)(void *data) = READ_ONCE(pru->event_handler);
+
+	if (event_handler)
+		event_handler(pru->event_data);
+
+	rproc_vq_interrupt(rproc, 0);
+	rproc_vq_interrupt(rproc, 1);
+
+	return IRQ_HANDLED;
+}
+
+static irqreturn_t da8xx_pru_rproc_callback(int irq, void *p)
+{
+	struct rproc *rproc = p;
+	struct da8xx_pru *pru = rproc->priv;
+	void __iomem *intc = pru->pruss->intc;
+	unsigned int event = DA8XX_PRU_EVT_TO_HOST(pru->id);
+
+	if (!(readl(intc + DA8XX_PRUSS_INTC_SRSR(1)) & BIT(event - 32)))
+		return IRQ_NONE;
+
+	writel(event, intc + DA8XX_PRUSS_INTC_SICR);
+
+	return IRQ_WAKE_THREAD;
+}
+
+static int da8xx_pru_rproc_start(struct rproc *rproc)
+{
+	struct device *dev = rproc->dev.parent;
+	struct da8xx_pru *pru = rproc->priv;
+	u32 pc;
+
+	if (rproc->bootaddr < DA8XX_PRU_IMEM_DA ||
+	    rproc->bootaddr >= DA8XX_PRU_IMEM_DA + DA8XX_PRU_IRAM_SIZE ||
+	    rproc->bootaddr & 0x3) {
+		dev_err(dev, "%s: invalid boot address 0x%x\n", rproc->name,
+			rproc->bootaddr);
+		return -EINVAL;
+	}
+
+	/* the program counter counts 32-bit instructions, not bytes */
+	pc = (rproc->bootaddr - DA8XX_PRU_IMEM_DA) / 4;
+
+	writel(DA8XX_PRU_CONTROL_PCRESETVAL(pc) | DA8XX_PRU_CONTROL_ENABLE |
+	       DA8XX_PRU_CONTROL_SOFT_RST_N, pru->ctrl + DA8XX_PRU_CONTROL);
+
+	return 0;
+}
+
+static int da8xx_pru_rproc_stop(struct rproc *rproc)
+{
+	struct da8xx_pru *pru = rproc->priv;
+
+	/* halt the core and put it back in reset */
+	writel(0, pru->ctrl + DA8XX_PRU_CONTROL);
+
+	return 0;
+}
+
+/* kick a virtqueue */
+static void da8xx_pru_rproc_kick(struct rproc *rproc, int vqid)
+{
+	struct da8xx_pru *pru = rproc->priv;
+
+	writel(DA8XX_PRU_EVT_FROM_HOST(pru->id),
+	       pru->pruss->intc + DA8XX_PRUSS_INTC_SISR);
+}
+
+static void *da8xx_pru_rproc_da_to_va(struct rproc *rproc, u64 da, int len)
+{
+	struct da8xx_pru *pru = rproc->priv;
+
+	if (len <= 0)
+		return NULL;
+
+	if (da >= DA8XX_PRU_IMEM_DA &&
+	    da + len <= DA8XX_PRU_IMEM_DA + DA8XX_PRU_IRAM_SIZE)
+		return (__force void *)(pru->iram + (da - DA8XX_PRU_IMEM_DA));
+
+	if (da + len <= DA8XX_PRU_DMEM_DA + DA8XX_PRU_DRAM_SIZE)
+		return (__force void *)(pru->dram + (da - DA8XX_PRU_DMEM_DA));
+
+	return NULL;
+}
+
+static const struct rproc_ops da8xx_pru_rproc_ops = {
+	.start = da8xx_pru_rproc_start,
+	.stop = da8xx_pru_rproc_stop,
+	.kick = da8xx_pru_rproc_kick,
+	.da_to_va = da8xx_pru_rproc_da_to_va,
+};
+
+/**
+ * da8xx_pru_rproc_get() - get the remote processor of a PRU core
+ * @id: index of the core, 0 or 1
+ *
+ * Like rproc_get_by_phandle(), but for boards that register the PRUSS
+ * without a device tree node. The reference must be dropped again with
+ * rproc_put().
+ *
+ * Returns the rproc or NULL if the PRUSS hasn't been probed.
+ */
+struct rproc *da8xx_pru_rproc_get(unsigned int id)
+{
+	struct rproc *rproc = NULL;
+
+	if (id >= DA8XX_PRU_NUM_CORES)
+		return NULL;
+
+	mutex_lock(&da8xx_pruss_lock);
+	if (da8xx_pruss) {
+		rproc = da8xx_pruss->pru[id]->rproc;
+		/* prevent underlying implementation from being removed */
+		if (try_module_get(THIS_MODULE))
+			get_device(&rproc->dev);
+		else
+			rproc = NULL;
+	}
+	mutex_unlock(&da8xx_pruss_lock);
+
+	return rproc;
+}
+EXPORT_SYMBOL_GPL(da8xx_pru_rproc_get);
+
+/**
+ * da8xx_pru_rproc_dram() - get the data RAM of a PRU core
+ * @rproc: rproc handle of the core
+ *
+ * The data RAM is DA8XX_PRU_RPROC_DRAM_SIZE bytes long and stays accessible
+ * while the core is stopped, so it can be set up before rproc_boot().
+ */
+void __iomem *da8xx_pru_rproc_dram(struct rproc *rproc)
+{
+	struct da8xx_pru *pru = rproc->priv;
+
+	return pru->dram;
+}
+EXPORT_SYMBOL_GPL(da8xx_pru_rproc_dram);
+
+/**
+ * da8xx_pru_rproc_set_event_handler() - handle PRU to ARM events
+ * @rproc: rproc handle of the core
+ * @handler: called from the irq thread on each event, or NULL to remove it
+ * @data: argument of @handler
+ *
+ * This is for firmware that talks to its kernel driver through the data RAM
+ * instead of virtio rings. Once this returns after removing the handler, it
+ * isn't running anymore.
+ */
+void da8xx_pru_rproc_set_event_handler(struct rproc *rproc,
+				       void (*handler)(void *data),
+				       void *data)
+{
+	struct da8xx_pru *pru = rproc->priv;
+
+	if (handler) {
+		pru->event_data = data;
+		WRITE_ONCE(pru->event_handler, handler);
+	} else {
+		WRITE_ONCE(pru->event_handler, NULL);
+		synchronize_irq(pru->irq);
+	}
+}
+EXPORT_SYMBOL_GPL(da8xx_pru_rproc_set_event_handler);
+
+/* route system @event to @chan, one byte per event in the CMRs */
+static void da8xx_pruss_intc_map(struct da8xx_pruss *pruss,
+				 unsigned int event, unsigned int chan)
+{
+	void __iomem *reg = pruss->intc + DA8XX_PRUSS_INTC_CMR(event / 4);
+	unsigned int shift = (event % 4) * 8;
+	u32 val;
+
+	val = readl(reg);
+	val &= ~(0xffU << shift);
+	val |= chan << shift;
+	writel(val, reg);
+
+	/* channels are mapped one to one onto host interrupts */
+	reg = pruss->intc + DA8XX_PRUSS_INTC_HMR(chan / 4);
+	shift = (chan % 4) * 8;
+	val = readl(reg);
+	val &= ~(0xffU << shift);
+	val |= chan << shift;
+	writel(val, reg);
+
+	/* events raised through R31 are active high pulses */
+	val = readl(pruss->intc + DA8XX_PRUSS_INTC_SIPR(event / 32));
+	writel(val | BIT(event % 32),
+	       pruss->intc + DA8XX_PRUSS_INTC_SIPR(event / 32));
+	val = readl(pruss->intc + DA8XX_PRUSS_INTC_SITR(event / 32));
+	writel(val & ~BIT(event % 32),
+	       pruss->intc + DA8XX_PRUSS_INTC_SITR(event / 32));
+
+	writel(BIT(event % 32),
+	       pruss->intc + DA8XX_PRUSS_INTC_SECR(event / 32));
+	writel(event, pruss->intc + DA8XX_PRUSS_INTC_EISR);
+	writel(chan, pruss->intc + DA8XX_PRUSS_INTC_HIEISR);
+}
+
+static void da8xx_pruss_intc_init(struct da8xx_pruss *pruss)
+{
+	int i;
+
+	writel(0, pruss->intc + DA8XX_PRUSS_INTC_GER);
+
+	for (i = 0; i < DA8XX_PRU_NUM_CORES; i++) {
+		da8xx_pruss_intc_map(pruss, DA8XX_PRU_EVT_TO_HOST(i),
+				     DA8XX_PRU_CHAN_TO_HOST(i));
+		da8xx_pruss_intc_map(pruss, DA8XX_PRU_EVT_FROM_HOST(i),
+				     DA8XX_PRU_CHAN_FROM_HOST(i));
+	}
+
+	writel(1, pruss->intc + DA8XX_PRUSS_INTC_GER);
+}
+
+static void da8xx_pruss_intc_exit(struct da8xx_pruss *pruss)
+{
+	int i;
+
+	for (i = 0; i < DA8XX_PRU_NUM_CORES; i++) {
+		writel(DA8XX_PRU_EVT_TO_HOST(i),
+		       pruss->intc + DA8XX_PRUSS_INTC_EICR);
+		writel(DA8XX_PRU_EVT_FROM_HOST(i),
+		       pruss->intc + DA8XX_PRUSS_INTC_EICR);
+		writel(DA8XX_PRU_CHAN_TO_HOST(i),
+		       pruss->intc + DA8XX_PRUSS_INTC_HIDISR);
+		writel(DA8XX_PRU_CHAN_FROM_HOST(i),
+		       pruss->intc + DA8XX_PRUSS_INTC_HIDISR);
+	}
+
+	writel(0, pruss->intc + DA8XX_PRUSS_INTC_GER);
+}
+
+static int da8xx_pru_rproc_add(struct platform_device *pdev,
+			       struct da8xx_pruss *pruss, int id)
+{
+	static const char * const names[] = { "pru0", "pru1" };
+	const char *fw_name[] = { da8xx_pru0_fw_name, da8xx_pru1_fw_name };
+	struct device *dev = &pdev->dev;
+	struct da8xx_pru *pru;
+	struct rproc *rproc;
+	int irq;
+	int ret;
+
+	/* PRU_EVTOUT0 and PRU_EVTOUT1 are the first two irq resources */
+	irq = platform_get_irq(pdev, id);
+	if (irq < 0) {
+		dev_err(dev, "platform_get_irq(pdev, %d) error: %d\n", id, irq);
+		return irq;
+	}
+
+	rproc = rproc_alloc(dev, names[id], &da8xx_pru_rproc_ops, fw_name[id],
+			    sizeof(*pru));
+	if (!rproc)
+		return -ENOMEM;
+
+	pru = rproc->priv;
+	pru->rproc = rproc;
+	pru->pruss = pruss;
+	pru->id = id;
+	pru->ctrl = pruss->base + DA8XX_PRU_CTRL(id);
+	pru->iram = pruss->base + DA8XX_PRU_IRAM(id);
+	pru->dram = pruss->base + DA8XX_PRU_DRAM(id);
+	pru->irq = irq;
+	rproc->has_iommu = false;
+
+	/* the core must be held in reset until da8xx_pru_rproc_start() */
+	writel(0, pru->ctrl + DA8XX_PRU_CONTROL);
+
+	ret = devm_request_threaded_irq(dev, irq, da8xx_pru_rproc_callback,
+					handle_event, IRQF_ONESHOT,
+					names[id], rproc);
+	if (ret) {
+		dev_err(dev, "devm_request_threaded_irq error: %d\n", ret);
+		goto free_rproc;
+	}
+
+	ret = rproc_add(rproc);
+	if (ret) {
+		dev_err(dev, "rproc_add failed: %d\n", ret);
+		goto free_irq;
+	}
+
+	pruss->pru[id] = pru;
+
+	return 0;
+
+free_irq:
+	devm_free_irq(dev, irq, rproc);
+free_rproc:
+	rproc_free(rproc);
+	return ret;
+}
+
+static void da8xx_pru_rproc_del(struct platform_device *pdev,
+				struct da8xx_pru *pru)
+{
+	/*
+	 * Free the irq before the rproc, otherwise an interrupt could sneak
+	 * in and find it gone.
+	 */
+	devm_free_irq(&pdev->dev, pru->irq, pru->rproc);
+
+	rproc_del(pru->rproc);
+	rproc_free(pru->rproc);
+}
+
+static int da8xx_pru_rproc_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct da8xx_pruss *pruss;
+	struct resource *res;
+	int ret;
+	int i;
+
+	pruss = devm_kzalloc(dev, sizeof(*pruss), GFP_KERNEL);
+	if (!pruss)
+		return -ENOMEM;
+
+	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	pruss->base = devm_ioremap_resource(dev, res);
+	if (IS_ERR(pruss->base))
+		return PTR_ERR(pruss->base);
+	pruss->intc = pruss->base + DA8XX_PRUSS_INTC;
+
+	pruss->clk = devm_clk_get(dev, "pruss");
+	if (IS_ERR(pruss->clk)) {
+		dev_err(dev, "clk_get error: %ld\n", PTR_ERR(pruss->clk));
+		return PTR_ERR(pruss->clk);
+	}
+
+	/* the INTC has to keep running while the cores are stopped */
+	ret = clk_prepare_enable(pruss->clk);
+	if (ret)
+		return ret;
+
+	da8xx_pruss_intc_init(pruss);
+
+	platform_set_drvdata(pdev, pruss);
+
+	for (i = 0; i < DA8XX_PRU_NUM_CORES; i++) {
+		ret = da8xx_pru_rproc_add(pdev, pruss, i);
+		if (ret)
+			goto del_rprocs;
+	}
+
+	mutex_lock(&da8xx_pruss_lock);
+	da8xx_pruss = pruss;
+	mutex_unlock(&da8xx_pruss_lock);
+
+	return 0;
+
+del_rprocs:
+	while (--i >= 0)
+		da8xx_pru_rproc_del(pdev, pruss->pru[i]);
+	da8xx_pruss_intc_exit(pruss);
+	clk_disable_unprepare(pruss->clk);
+	return ret;
+}
+
+static int da8xx_pru_rproc_remove(struct platform_device *pdev)
+{
+	struct da8xx_pruss *pruss = platform_get_drvdata(pdev);
+	int i;
+
+	mutex_lock(&da8xx_pruss_lock);
+	da8xx_pruss = NULL;
+	mutex_unlock(&da8xx_pruss_lock);
+
+	for (i = DA8XX_PRU_NUM_CORES - 1; i >= 0; i--)
+		da8xx_pru_rproc_del(pdev, pruss->pru[i]);
+
+	da8xx_pruss_intc_exit(pruss);
+	clk_disable_unprepare(pruss->clk);
+
+	return 0;
+}
+
+static const struct of_device_id da8xx_pru_rproc_of_match[] __maybe_unused = {
+	{ .compatible = "ti,da850-pruss-rproc", },
+	{ /* sentinel */ },
+};
+MODULE_DEVICE_TABLE(of, da8xx_pru_rproc_of_match);
+
+static struct platform_driver da8xx_pru_rproc_driver = {
+	.probe = da8xx_pru_rproc_probe,
+	.remove = da8xx_pru_rproc_remove,
+	.driver = {
+		.name = "da8xx-pru-rproc",
+		.of_match_table = of_match_ptr(da8xx_pru_rproc_of_match),
+	},
+};
+
+module_platform_driver(da8xx_pru_rproc_driver);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("DA8XX PRU subsystem remote processor driver");
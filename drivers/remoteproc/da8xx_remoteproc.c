@@ -88,10 +88,16 @@ struct da8xx_rproc {
 static irqreturn_t handle_event(int irq, void *p)
 {
 	struct rproc *rproc = (struct rproc *)p;
+	irqreturn_t ret;
 
-	/* Process incoming buffers on all our vrings */
-	rproc_vq_interrupt(rproc, 0);
-	rproc_vq_interrupt(rproc, 1);
+	/*
+	 * Process incoming buffers on all our vrings, until the DSP stops
+	 * adding more, so a burst of messages only takes one interrupt.
+	 */
+	do {
+		ret = rproc_vq_interrupt(rproc, 0);
+		ret |= rproc_vq_interrupt(rproc, 1);
+	} while (ret == IRQ_HANDLED);
 
 	return IRQ_HANDLED;
 }
@@ -148,7 +154,7 @@ static int da8xx_rproc_start(struct rproc *rproc)
 
 	writel(rproc->bootaddr, drproc->bootreg);
 
-	clk_enable(dsp_clk);
+	/* the clock has been on since probe, for loading the memories */
 	davinci_clk_reset_deassert(dsp_clk);
 
 	return 0;
@@ -158,8 +164,8 @@ static int da8xx_rproc_stop(struct rproc *rproc)
 {
 	struct da8xx_rproc *drproc = rproc->priv;
 
+	/* keep the clock, the next firmware is loaded before start() */
 	davinci_clk_reset_assert(drproc->dsp_clk);
-	clk_disable(drproc->dsp_clk);
 
 	return 0;
 }
@@ -169,14 +175,55 @@ static void da8xx_rproc_kick(struct rproc *rproc, int vqid)
 {
 	struct da8xx_rproc *drproc = (struct da8xx_rproc *)rproc->priv;
 
+	/*
+	 * The DSP clears CHIPSIG2 before it looks at its vrings, so while
+	 * the previous kick is still pending, it will see the new buffers
+	 * anyway and kicks can be batched into that one.
+	 */
+	if (readl(drproc->chipsig) & SYSCFG_CHIPSIG2)
+		return;
+
 	/* Interrupt remote proc */
 	writel(SYSCFG_CHIPSIG2, drproc->chipsig);
 }
 
+/*
+ * The internal memories can be addressed both through their local addresses
+ * and through their global ones, firmware may use either.
+ */
+static void *da8xx_rproc_da_to_va(struct rproc *rproc, u64 da, int len)
+{
+	struct da8xx_rproc *drproc = (struct da8xx_rproc *)rproc->priv;
+	struct da8xx_rproc_mem *mem;
+	u64 offset;
+	int i;
+
+	if (len <= 0)
+		return NULL;
+
+	for (i = 0; i < drproc->num_mems; i++) {
+		mem = &drproc->mem[i];
+
+		if (da >= mem->dev_addr &&
+		    da + len <= mem->dev_addr + mem->size)
+			offset = da - mem->dev_addr;
+		else if (da >= mem->bus_addr &&
+			 da + len <= mem->bus_addr + mem->size)
+			offset = da - mem->bus_addr;
+		else
+			continue;
+
+		return (__force void *)(mem->cpu_addr + offset);
+	}
+
+	return NULL;
+}
+
 static const struct rproc_ops da8xx_rproc_ops = {
 	.start = da8xx_rproc_start,
 	.stop = da8xx_rproc_stop,
 	.kick = da8xx_rproc_kick,
+	.da_to_va = da8xx_rproc_da_to_va,
 };
 
 static int da8xx_rproc_get_internal_memories(struct platform_device *pdev,
@@ -282,6 +329,8 @@ static int da8xx_rproc_probe(struct platform_device *pdev)
 	drproc->rproc = rproc;
 	drproc->dsp_clk = dsp_clk;
 	rproc->has_iommu = false;
+	/* vrings at a fixed address go into the DSP's internal memories */
+	rproc->local_vrings = true;
 
 	ret = da8xx_rproc_get_internal_memories(pdev, drproc);
 	if (ret)
@@ -307,6 +356,18 @@ static int da8xx_rproc_probe(struct platform_device *pdev)
 	if (ret)
 		goto free_rproc;
 
+	/*
+	 * The firmware, its resource table and the vrings are written into
+	 * the DSP's L1/L2 memories before da8xx_rproc_start() is called, and
+	 * these can't be accessed while the LPSC is disabled. So the clock is
+	 * on from here on, with the DSP held in reset until start().
+	 */
+	ret = clk_prepare_enable(drproc->dsp_clk);
+	if (ret) {
+		dev_err(dev, "enabling the DSP clock failed: %d\n", ret);
+		goto free_rproc;
+	}
+
 	drproc->chipsig = chipsig;
 	drproc->bootreg = bootreg;
 	drproc->ack_fxn = irq_data->chip->irq_ack;
@@ -316,11 +377,13 @@ static int da8xx_rproc_probe(struct platform_device *pdev)
 	ret = rproc_add(rproc);
 	if (ret) {
 		dev_err(dev, "rproc_add failed: %d\n", ret);
-		goto free_rproc;
+		goto disable_clk;
 	}
 
 	return 0;
 
+disable_clk:
+	clk_disable_unprepare(drproc->dsp_clk);
 free_rproc:
 	rproc_free(rproc);
 free_mem:
@@ -343,6 +406,7 @@ static int da8xx_rproc_remove(struct platform_device *pdev)
 	disable_irq(drproc->irq);
 
 	rproc_del(rproc);
+	clk_disable_unprepare(drproc->dsp_clk);
 	rproc_free(rproc);
 	if (dev->of_node)
 		of_reserved_mem_device_release(dev);
@@ -19,21 +19,28 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/platform_device.h>
+#include <linux/pm_runtime.h>
 #include <linux/err.h>
 #include <linux/clk.h>
 #include <linux/dmaengine.h>
 #include <linux/dma-mapping.h>
+#include <linux/legoev3_perf.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/spi/spi.h>
 #include <linux/spi/spi_bitbang.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 
 #include <linux/platform_data/spi-davinci.h>
 
 #define CS_DEFAULT	0xFF
 
+/* idle time before the module clock is gated, in ms */
+#define SPI_AUTOSUSPEND_DELAY	100
+
 #define SPIFMT_PHASE_MASK	BIT(16)
 #define SPIFMT_POLARITY_MASK	BIT(17)
 #define SPIFMT_DISTIMER_MASK	BIT(18)
@@ -111,6 +118,32 @@
 
 #define DMA_MIN_BYTES	16
 
+/*
+ * Transfers that take less than this on the wire are polled for: waiting for
+ * the interrupt and the context switch back would cost more than that.
+ */
+#define POLL_MAX_NS	(20 * NSEC_PER_USEC)
+
+/* Most transfers a single chained DMA may cover */
+#define DMA_MAX_CHAIN	64
+
+/*
+ * Transfer counters, on the EV3 performance dashboard. @xfers counts every
+ * transfer, @dma_runs the DMAs they were sent with, so a chain of transfers
+ * adds its length to @xfers and @chained but one to @dma_runs. @words are
+ * what an ADC on the bus counts as samples.
+ */
+struct davinci_spi_stats {
+	u64			xfers;
+	u64			words;
+	u64			bytes;
+	u64			dma_runs;
+	u64			chained;
+	u64			irq;
+	u64			polled;
+	u64			errors;
+};
+
 /* SPI Controller driver's private data. */
 struct davinci_spi {
 	struct spi_bitbang	bitbang;
@@ -130,14 +163,25 @@ struct davinci_spi {
 	struct dma_chan		*dma_rx;
 	struct dma_chan		*dma_tx;
 
+	/* cur_msg transfers up to chain_end were sent by a chained DMA */
+	struct spi_message	*chain_msg;
+	struct spi_transfer	*chain_end;
+
 	struct davinci_spi_platform_data pdata;
 
 	void			(*get_rx)(u32 rx_data, struct davinci_spi *);
 	u32			(*get_tx)(struct davinci_spi *);
 
 	u8			*bytes_per_word;
+	/* word time of the current transfer, set up by setup_transfer */
+	unsigned int		word_ns;
 
 	u8			prescaler_limit;
+
+	/* written by the transfer code only, the lock is for the readers */
+	struct davinci_spi_stats stats;
+	spinlock_t		stats_lock;
+	struct legoev3_perf_source perf;
 };
 
 static struct davinci_spi_config davinci_spi_default_cfg;
@@ -210,12 +254,19 @@ static void davinci_spi_chipselect(struct spi_device *spi, int value)
 	struct davinci_spi *dspi;
 	struct davinci_spi_platform_data *pdata;
 	struct davinci_spi_config *spicfg = spi->controller_data;
+	struct device *dev = spi->master->dev.parent;
 	u8 chip_sel = spi->chip_select;
 	u16 spidat1 = CS_DEFAULT;
 
 	dspi = spi_master_get_devdata(spi->master);
 	pdata = &dspi->pdata;
 
+	/* spi_setup() also deasserts chip select, outside of any message */
+	if (pm_runtime_get_sync(dev) < 0) {
+		pm_runtime_put_noidle(dev);
+		return;
+	}
+
 	/* program delay transfers if tx_delay is non zero */
 	if (spicfg->wdelay)
 		spidat1 |= SPIDAT1_WDEL;
@@ -238,6 +289,9 @@ static void davinci_spi_chipselect(struct spi_device *spi, int value)
 	}
 
 	iowrite16(spidat1, dspi->base + SPIDAT1 + 2);
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
 }
 
 /**
@@ -322,6 +376,9 @@ static int davinci_spi_setup_transfer(struct spi_device *spi,
 
 	spifmt = (prescale << SPIFMT_PRESCALE_SHIFT) | (bits_per_word & 0x1f);
 
+	dspi->word_ns = DIV_ROUND_UP_ULL((u64)bits_per_word * (prescale + 1) *
+					 NSEC_PER_SEC, clk_get_rate(dspi->clk));
+
 	if (spi->mode & SPI_LSB_FIRST)
 		spifmt |= SPIFMT_SHIFTDIR_MASK;
 
@@ -429,6 +486,13 @@ static int davinci_spi_setup(struct spi_device *spi)
 	dspi = spi_master_get_devdata(spi->master);
 	pdata = &dspi->pdata;
 
+	retval = pm_runtime_get_sync(master->dev.parent);
+	if (retval < 0) {
+		pm_runtime_put_noidle(master->dev.parent);
+		return retval;
+	}
+	retval = 0;
+
 	if (!(spi->mode & SPI_NO_CS)) {
 		if (np && (master->cs_gpios != NULL) && (spi->cs_gpio >= 0)) {
 			retval = gpio_direction_output(
@@ -446,7 +510,7 @@ static int davinci_spi_setup(struct spi_device *spi)
 		if (retval) {
 			dev_err(&spi->dev, "GPIO %d setup failed (%d)\n",
 				spi->cs_gpio, retval);
-			return retval;
+			goto out;
 		}
 
 		if (internal_cs)
@@ -461,7 +525,12 @@ static int davinci_spi_setup(struct spi_device *spi)
 	else
 		clear_io_bits(dspi->base + SPIGCR1, SPIGCR1_LOOPBACK_MASK);
 
-	return davinci_spi_of_setup(spi);
+	retval = davinci_spi_of_setup(spi);
+out:
+	pm_runtime_mark_last_busy(master->dev.parent);
+	pm_runtime_put_autosuspend(master->dev.parent);
+
+	return retval;
 }
 
 static void davinci_spi_cleanup(struct spi_device *spi)
@@ -585,6 +654,133 @@ static void davinci_spi_dma_tx_callback(void *data)
 		complete(&dspi->done);
 }
 
+static bool davinci_spi_can_chain(struct spi_transfer *prev,
+				  struct spi_transfer *t, int data_type)
+{
+	return !prev->cs_change && !prev->delay_usecs && t->len &&
+		!(t->len % data_type) &&
+		t->bits_per_word == prev->bits_per_word &&
+		t->speed_hz == prev->speed_hz &&
+		virt_addr_valid(t->rx_buf) &&
+		(!t->tx_buf || virt_addr_valid(t->tx_buf));
+}
+
+/*
+ * Counts the transfers, starting with @t, that can go out as one DMA while
+ * chip select stays asserted: same word size and clock, no CS change or delay
+ * in between and buffers the DMA API can map. The first one needs lowmem
+ * buffers too, whether or not the SPI core mapped it.
+ */
+static unsigned int davinci_spi_chain_len(struct spi_master *master,
+					  struct spi_transfer *t,
+					  int data_type, size_t *len)
+{
+	struct spi_transfer *prev = t;
+	unsigned int n = 1;
+
+	*len = t->len;
+
+	if (!virt_addr_valid(t->rx_buf) ||
+	    (t->tx_buf && !virt_addr_valid(t->tx_buf)))
+		return 0;
+
+	while (n < DMA_MAX_CHAIN && !spi_transfer_is_last(master, prev)) {
+		t = list_next_entry(prev, transfer_list);
+		if (!davinci_spi_can_chain(prev, t, data_type))
+			break;
+
+		*len += t->len;
+		prev = t;
+		n++;
+	}
+
+	return n;
+}
+
+static int davinci_spi_map_chain(struct davinci_spi *dspi,
+				 struct spi_transfer *t, unsigned int n,
+				 struct sg_table *tx_sgt,
+				 struct sg_table *rx_sgt)
+{
+	struct device *tx_dev = dspi->dma_tx->device->dev;
+	struct device *rx_dev = dspi->dma_rx->device->dev;
+	struct scatterlist *tx_sg, *rx_sg;
+	unsigned int i;
+	int ret;
+
+	ret = sg_alloc_table(tx_sgt, n, GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	ret = sg_alloc_table(rx_sgt, n, GFP_KERNEL);
+	if (ret)
+		goto free_tx;
+
+	tx_sg = tx_sgt->sgl;
+	rx_sg = rx_sgt->sgl;
+	for (i = 0; i < n; i++) {
+		/* like single transfers, rx-only ones clock out rx_buf */
+		sg_set_buf(tx_sg, t->tx_buf ? t->tx_buf : t->rx_buf, t->len);
+		sg_set_buf(rx_sg, t->rx_buf, t->len);
+
+		tx_sg = sg_next(tx_sg);
+		rx_sg = sg_next(rx_sg);
+		t = list_next_entry(t, transfer_list);
+	}
+
+	ret = -ENOMEM;
+	tx_sgt->nents = dma_map_sg(tx_dev, tx_sgt->sgl, n, DMA_TO_DEVICE);
+	if (!tx_sgt->nents)
+		goto free_rx;
+
+	rx_sgt->nents = dma_map_sg(rx_dev, rx_sgt->sgl, n, DMA_FROM_DEVICE);
+	if (!rx_sgt->nents)
+		goto unmap_tx;
+
+	return 0;
+
+unmap_tx:
+	dma_unmap_sg(tx_dev, tx_sgt->sgl, n, DMA_TO_DEVICE);
+free_rx:
+	sg_free_table(rx_sgt);
+free_tx:
+	sg_free_table(tx_sgt);
+
+	return ret;
+}
+
+static void davinci_spi_unmap_chain(struct davinci_spi *dspi,
+				    struct sg_table *tx_sgt,
+				    struct sg_table *rx_sgt)
+{
+	dma_unmap_sg(dspi->dma_rx->device->dev, rx_sgt->sgl, rx_sgt->orig_nents,
+		     DMA_FROM_DEVICE);
+	dma_unmap_sg(dspi->dma_tx->device->dev, tx_sgt->sgl, tx_sgt->orig_nents,
+		     DMA_TO_DEVICE);
+	sg_free_table(rx_sgt);
+	sg_free_table(tx_sgt);
+}
+
+static void davinci_spi_count(struct davinci_spi *dspi, unsigned int chain,
+			      bool use_dma, bool poll, unsigned int words,
+			      size_t len)
+{
+	struct davinci_spi_stats *stats = &dspi->stats;
+
+	spin_lock(&dspi->stats_lock);
+	stats->xfers += chain ?: 1;
+	stats->words += words;
+	stats->bytes += len;
+	if (use_dma)
+		stats->dma_runs++;
+	else if (poll)
+		stats->polled++;
+	else
+		stats->irq++;
+	stats->chained += chain;
+	spin_unlock(&dspi->stats_lock);
+}
+
 /**
  * davinci_spi_bufs - functions which will handle transfer data
  * @spi: spi device on which data transfer to be done
@@ -593,6 +789,12 @@ static void davinci_spi_dma_tx_callback(void *data)
  * This function will put data to be transferred into data register
  * of SPI controller and then wait until the completion will be marked
  * by the IRQ Handler.
+ *
+ * In DMA mode, @t and the transfers following it in the same message are
+ * sent as a single scatter-gather DMA whenever chip select stays asserted
+ * between them, so that a message of many small transfers costs one
+ * interrupt instead of one per word. The transfers covered that way are
+ * then only acknowledged when the bitbang core gets to them.
  */
 static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 {
@@ -602,20 +804,53 @@ static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 	u32 errors = 0;
 	struct davinci_spi_config *spicfg;
 	struct davinci_spi_platform_data *pdata;
+	struct spi_master *master = spi->master;
+	struct sg_table *tx_sgt = &t->tx_sg, *rx_sgt = &t->rx_sg;
+	struct sg_table chain_tx_sgt, chain_rx_sgt;
+	unsigned int chain = 0;
+	size_t len = t->len;
+	bool use_dma, poll;
 	unsigned uninitialized_var(rx_buf_count);
 
-	dspi = spi_master_get_devdata(spi->master);
+	dspi = spi_master_get_devdata(master);
 	pdata = &dspi->pdata;
 	spicfg = (struct davinci_spi_config *)spi->controller_data;
 	if (!spicfg)
 		spicfg = &davinci_spi_default_cfg;
 
+	if (dspi->chain_end) {
+		if (dspi->chain_msg == master->cur_msg) {
+			if (t == dspi->chain_end)
+				dspi->chain_end = NULL;
+			return t->len;
+		}
+		dspi->chain_end = NULL;
+	}
+
 	/* convert len to words based on bits_per_word */
 	data_type = dspi->bytes_per_word[spi->chip_select];
 
+	if (spicfg->io_type == SPI_IO_TYPE_DMA && dspi->dma_rx &&
+	    !spi_transfer_is_last(master, t)) {
+		chain = davinci_spi_chain_len(master, t, data_type, &len);
+		if (chain < 2 || len < DMA_MIN_BYTES ||
+		    davinci_spi_map_chain(dspi, t, chain, &chain_tx_sgt,
+					  &chain_rx_sgt)) {
+			chain = 0;
+			len = t->len;
+		} else {
+			tx_sgt = &chain_tx_sgt;
+			rx_sgt = &chain_rx_sgt;
+		}
+	}
+	use_dma = chain || davinci_spi_can_dma(master, spi, t);
+	poll = spicfg->io_type == SPI_IO_TYPE_POLL ||
+		(!use_dma &&
+		 (u64)(len / data_type) * dspi->word_ns < POLL_MAX_NS);
+
 	dspi->tx = t->tx_buf;
 	dspi->rx = t->rx_buf;
-	dspi->wcount = t->len / data_type;
+	dspi->wcount = len / data_type;
 	dspi->rcount = dspi->wcount;
 
 	spidat1 = ioread32(dspi->base + SPIDAT1);
@@ -625,8 +860,8 @@ static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 
 	reinit_completion(&dspi->done);
 
-	if (!davinci_spi_can_dma(spi->master, spi, t)) {
-		if (spicfg->io_type != SPI_IO_TYPE_POLL)
+	if (!use_dma) {
+		if (!poll)
 			set_io_bits(dspi->base + SPIINT, SPIINT_MASKINT);
 		/* start the transfer */
 		dspi->wcount--;
@@ -654,12 +889,12 @@ static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 		dmaengine_slave_config(dspi->dma_tx, &dma_tx_conf);
 
 		rxdesc = dmaengine_prep_slave_sg(dspi->dma_rx,
-				t->rx_sg.sgl, t->rx_sg.nents, DMA_DEV_TO_MEM,
+				rx_sgt->sgl, rx_sgt->nents, DMA_DEV_TO_MEM,
 				DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
 		if (!rxdesc)
 			goto err_desc;
 
-		if (!t->tx_buf) {
+		if (!chain && !t->tx_buf) {
 			/* To avoid errors when doing rx-only transfers with
 			 * many SG entries (> 20), use the rx buffer as the
 			 * dummy tx buffer so that dma reloads are done at the
@@ -670,7 +905,7 @@ static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 		}
 
 		txdesc = dmaengine_prep_slave_sg(dspi->dma_tx,
-				t->tx_sg.sgl, t->tx_sg.nents, DMA_MEM_TO_DEV,
+				tx_sgt->sgl, tx_sgt->nents, DMA_MEM_TO_DEV,
 				DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
 		if (!txdesc)
 			goto err_desc;
@@ -693,7 +928,7 @@ static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 	}
 
 	/* Wait for the transfer to complete */
-	if (spicfg->io_type != SPI_IO_TYPE_POLL) {
+	if (!poll) {
 		if (wait_for_completion_timeout(&dspi->done, HZ) == 0)
 			errors = SPIFLG_TIMEOUT_MASK;
 	} else {
@@ -706,16 +941,30 @@ static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 	}
 
 	clear_io_bits(dspi->base + SPIINT, SPIINT_MASKALL);
-	if (davinci_spi_can_dma(spi->master, spi, t))
+	if (use_dma)
 		clear_io_bits(dspi->base + SPIINT, SPIINT_DMA_REQ_EN);
 
 	clear_io_bits(dspi->base + SPIGCR1, SPIGCR1_SPIENA_MASK);
 	set_io_bits(dspi->base + SPIGCR1, SPIGCR1_POWERDOWN_MASK);
 
+	if (chain) {
+		if (errors || dspi->rcount || dspi->wcount) {
+			dmaengine_terminate_sync(dspi->dma_rx);
+			dmaengine_terminate_sync(dspi->dma_tx);
+		}
+		davinci_spi_unmap_chain(dspi, tx_sgt, rx_sgt);
+	}
+
 	/*
 	 * Check for bit error, desync error,parity error,timeout error and
 	 * receive overflow errors
 	 */
+	if (errors || dspi->rcount != 0 || dspi->wcount != 0) {
+		spin_lock(&dspi->stats_lock);
+		dspi->stats.errors++;
+		spin_unlock(&dspi->stats_lock);
+	}
+
 	if (errors) {
 		ret = davinci_spi_check_error(dspi, errors);
 		WARN(!ret, "%s: error reported but no error found!\n",
@@ -728,9 +977,21 @@ static int davinci_spi_bufs(struct spi_device *spi, struct spi_transfer *t)
 		return -EIO;
 	}
 
+	davinci_spi_count(dspi, chain, use_dma, poll, len / data_type, len);
+
+	if (chain) {
+		dspi->chain_msg = master->cur_msg;
+		dspi->chain_end = list_next_entry(t, transfer_list);
+		while (--chain > 1)
+			dspi->chain_end = list_next_entry(dspi->chain_end,
+							  transfer_list);
+	}
+
 	return t->len;
 
 err_desc:
+	if (chain)
+		davinci_spi_unmap_chain(dspi, tx_sgt, rx_sgt);
 	return ret;
 }
 
@@ -880,6 +1141,54 @@ static int spi_davinci_get_pdata(struct platform_device *pdev,
 }
 #endif
 
+static u64 davinci_spi_perf_rate(u64 count, u64 interval_ns)
+{
+	return interval_ns ? div64_u64(count * NSEC_PER_SEC, interval_ns) : 0;
+}
+
+static void davinci_spi_perf_show(struct seq_file *s, void *data,
+				  u64 interval_ns)
+{
+	struct davinci_spi *dspi = data;
+	struct davinci_spi_stats stats;
+
+	spin_lock(&dspi->stats_lock);
+	stats = dspi->stats;
+	spin_unlock(&dspi->stats_lock);
+
+	seq_printf(s, "xfers: %llu, %llu/s\n", stats.xfers,
+		   davinci_spi_perf_rate(stats.xfers, interval_ns));
+	seq_printf(s, "words: %llu, %llu/s\n", stats.words,
+		   davinci_spi_perf_rate(stats.words, interval_ns));
+	seq_printf(s, "bytes: %llu, %llu/s\n", stats.bytes,
+		   davinci_spi_perf_rate(stats.bytes, interval_ns));
+	seq_printf(s, "dma: %llu (%llu chained xfers)\n", stats.dma_runs,
+		   stats.chained);
+	seq_printf(s, "irq: %llu\n", stats.irq);
+	seq_printf(s, "polled: %llu\n", stats.polled);
+	seq_printf(s, "errors: %llu\n", stats.errors);
+}
+
+static void davinci_spi_perf_reset(void *data)
+{
+	struct davinci_spi *dspi = data;
+
+	spin_lock(&dspi->stats_lock);
+	memset(&dspi->stats, 0, sizeof(dspi->stats));
+	spin_unlock(&dspi->stats_lock);
+}
+
+static void davinci_spi_perf_init(struct spi_master *master,
+				  struct davinci_spi *dspi)
+{
+	strlcpy(dspi->perf.name, dev_name(&master->dev),
+		sizeof(dspi->perf.name));
+	dspi->perf.show = davinci_spi_perf_show;
+	dspi->perf.reset = davinci_spi_perf_reset;
+	dspi->perf.data = dspi;
+	legoev3_perf_register(&dspi->perf);
+}
+
 /**
  * davinci_spi_probe - probe function for SPI Master Controller
  * @pdev: platform_device structure which contains plateform specific data
@@ -976,6 +1285,7 @@ static int davinci_spi_probe(struct platform_device *pdev)
 	master->setup = davinci_spi_setup;
 	master->cleanup = davinci_spi_cleanup;
 	master->can_dma = davinci_spi_can_dma;
+	master->auto_runtime_pm = true;
 
 	dspi->bitbang.chipselect = davinci_spi_chipselect;
 	dspi->bitbang.setup_transfer = davinci_spi_setup_transfer;
@@ -1022,6 +1332,7 @@ static int davinci_spi_probe(struct platform_device *pdev)
 	dspi->get_tx = davinci_spi_tx_buf_u8;
 
 	init_completion(&dspi->done);
+	spin_lock_init(&dspi->stats_lock);
 
 	/* Reset In/OUT SPI module */
 	iowrite32(0, dspi->base + SPIGCR0);
@@ -1044,14 +1355,34 @@ static int davinci_spi_probe(struct platform_device *pdev)
 	set_io_bits(dspi->base + SPIGCR1, SPIGCR1_MASTER_MASK);
 	set_io_bits(dspi->base + SPIGCR1, SPIGCR1_POWERDOWN_MASK);
 
+	/*
+	 * The module keeps its registers while its clock is gated, so the
+	 * runtime PM callbacks only need to turn the clock off and on.
+	 */
+	pm_runtime_set_autosuspend_delay(&pdev->dev, SPI_AUTOSUSPEND_DELAY);
+	pm_runtime_use_autosuspend(&pdev->dev);
+	pm_runtime_get_noresume(&pdev->dev);
+	pm_runtime_set_active(&pdev->dev);
+	pm_runtime_enable(&pdev->dev);
+
 	ret = spi_bitbang_start(&dspi->bitbang);
 	if (ret)
-		goto free_dma;
+		goto disable_rpm;
+
+	davinci_spi_perf_init(master, dspi);
+
+	pm_runtime_mark_last_busy(&pdev->dev);
+	pm_runtime_put_autosuspend(&pdev->dev);
 
 	dev_info(&pdev->dev, "Controller at 0x%p\n", dspi->base);
 
 	return ret;
 
+disable_rpm:
+	pm_runtime_disable(&pdev->dev);
+	pm_runtime_set_suspended(&pdev->dev);
+	pm_runtime_put_noidle(&pdev->dev);
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
 free_dma:
 	if (dspi->dma_rx) {
 		dma_release_channel(dspi->dma_rx);
@@ -1082,8 +1413,14 @@ static int davinci_spi_remove(struct platform_device *pdev)
 	master = platform_get_drvdata(pdev);
 	dspi = spi_master_get_devdata(master);
 
+	legoev3_perf_unregister(&dspi->perf);
 	spi_bitbang_stop(&dspi->bitbang);
 
+	pm_runtime_get_sync(&pdev->dev);
+	pm_runtime_disable(&pdev->dev);
+	pm_runtime_put_noidle(&pdev->dev);
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
+
 	clk_disable_unprepare(dspi->clk);
 	spi_master_put(master);
 
@@ -1095,10 +1432,36 @@ static int davinci_spi_remove(struct platform_device *pdev)
 	return 0;
 }
 
+#ifdef CONFIG_PM
+static int davinci_spi_runtime_suspend(struct device *dev)
+{
+	struct spi_master *master = dev_get_drvdata(dev);
+	struct davinci_spi *dspi = spi_master_get_devdata(master);
+
+	clk_disable(dspi->clk);
+
+	return 0;
+}
+
+static int davinci_spi_runtime_resume(struct device *dev)
+{
+	struct spi_master *master = dev_get_drvdata(dev);
+	struct davinci_spi *dspi = spi_master_get_devdata(master);
+
+	return clk_enable(dspi->clk);
+}
+#endif
+
+static const struct dev_pm_ops davinci_spi_pm_ops = {
+	SET_RUNTIME_PM_OPS(davinci_spi_runtime_suspend,
+			   davinci_spi_runtime_resume, NULL)
+};
+
 static struct platform_driver davinci_spi_driver = {
 	.driver = {
 		.name = "spi_davinci",
 		.of_match_table = of_match_ptr(davinci_spi_of_match),
+		.pm = &davinci_spi_pm_ops,
 	},
 	.probe = davinci_spi_probe,
 	.remove = davinci_spi_remove,
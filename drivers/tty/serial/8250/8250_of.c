@@ -27,6 +27,7 @@
 struct of_serial_info {
 	struct clk *clk;
 	struct reset_control *rst;
+	struct uart_8250_dma dma;
 	int type;
 	int line;
 };
@@ -228,6 +229,15 @@ static int of_platform_serial_probe(struct platform_device *ofdev)
 	if (of_property_read_bool(ofdev->dev.of_node, "auto-flow-control"))
 		port8250.capabilities |= UART_CAP_AFE;
 
+	/*
+	 * Use the generic 8250 DMA support when the node describes "rx" and
+	 * "tx" channels. The port falls back to PIO at startup if they can't
+	 * be had.
+	 */
+	if (IS_ENABLED(CONFIG_SERIAL_8250_DMA) &&
+	    of_property_read_bool(ofdev->dev.of_node, "dmas"))
+		port8250.dma = &info->dma;
+
 	ret = serial8250_register_8250_port(&port8250);
 	if (ret < 0)
 		goto err_dispose;
@@ -2651,8 +2651,14 @@ serial8250_do_set_termios(struct uart_port *port, struct ktermios *termios,
 	up->lcr = cval;					/* Save computed LCR */
 
 	if (up->capabilities & UART_CAP_FIFO && port->fifosize > 1) {
-		/* NOTE: If fifo_bug is not set, a user can set RX_trigger. */
-		if ((baud < 2400 && !up->dma) || up->fifo_bug) {
+		unsigned int lowlat_baud = up->rx_lowlat_baud ?: 2400;
+
+		/*
+		 * NOTE: If fifo_bug is not set, a user can set RX_trigger.
+		 * At low baud rates the RX timeout of four character times
+		 * is long, so interrupt on every byte instead.
+		 */
+		if ((baud < lowlat_baud && !up->dma) || up->fifo_bug) {
 			up->fcr &= ~UART_FCR_TRIGGER_MASK;
 			up->fcr |= UART_FCR_TRIGGER_1;
 		}
@@ -3037,8 +3043,48 @@ static DEVICE_ATTR(rx_trig_bytes, S_IRUSR | S_IWUSR | S_IRGRP,
 		   serial8250_get_attr_rx_trig_bytes,
 		   serial8250_set_attr_rx_trig_bytes);
 
+static ssize_t serial8250_get_attr_rx_lowlat_baud(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tty_port *port = dev_get_drvdata(dev);
+	struct uart_state *state = container_of(port, struct uart_state, port);
+	struct uart_8250_port *up = up_to_u8250p(state->uart_port);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", up->rx_lowlat_baud ?: 2400);
+}
+
+/*
+ * Below this baud rate the RX trigger is forced to its minimum, so short
+ * replies are not held back by the RX timeout. Applies from the next
+ * termios change, as the baud rate is only known there.
+ */
+static ssize_t serial8250_set_attr_rx_lowlat_baud(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tty_port *port = dev_get_drvdata(dev);
+	struct uart_state *state = container_of(port, struct uart_state, port);
+	struct uart_8250_port *up = up_to_u8250p(state->uart_port);
+	unsigned int baud;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &baud);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&port->mutex);
+	up->rx_lowlat_baud = baud;
+	mutex_unlock(&port->mutex);
+
+	return count;
+}
+
+static DEVICE_ATTR(rx_lowlat_baud, S_IRUSR | S_IWUSR | S_IRGRP,
+		   serial8250_get_attr_rx_lowlat_baud,
+		   serial8250_set_attr_rx_lowlat_baud);
+
 static struct attribute *serial8250_dev_attrs[] = {
 	&dev_attr_rx_trig_bytes.attr,
+	&dev_attr_rx_lowlat_baud.attr,
 	NULL,
 	};
 
@@ -19,6 +19,7 @@
 /* #define VERBOSE_DEBUG */
 
 #include <linux/blkdev.h>
+#include <linux/dma-mapping.h>
 #include <linux/pagemap.h>
 #include <linux/export.h>
 #include <linux/hid.h>
@@ -206,6 +207,20 @@ struct ffs_buffer {
 	char storage[];
 };
 
+/*
+ * DMA buffer mapped into user space with mmap(2) on an endpoint file.
+ * I/O on a single range inside such a mapping is done straight from and
+ * into the buffer, without a bounce buffer or a copy.  The buffer lives
+ * as long as it is mapped or in use by a request.
+ */
+struct ffs_dma_buffer {
+	struct kref ref;
+	struct device *dev;
+	void *cpu;
+	dma_addr_t dma;
+	size_t size;
+};
+
 /*  ffs_io_data structure ***************************************************/
 
 struct ffs_io_data {
@@ -216,6 +231,7 @@ struct ffs_io_data {
 	struct iov_iter data;
 	const void *to_free;
 	char *buf;
+	struct ffs_dma_buffer *dma_buf;
 
 	struct mm_struct *mm;
 	struct work_struct work;
@@ -750,6 +766,76 @@ static ssize_t ffs_copy_to_iter(void *data, int data_len, struct iov_iter *iter)
 	return ret;
 }
 
+static void ffs_dma_buffer_release(struct kref *ref)
+{
+	struct ffs_dma_buffer *buf = container_of(ref, struct ffs_dma_buffer,
+						  ref);
+
+	dma_free_coherent(buf->dev, buf->size, buf->cpu, buf->dma);
+	put_device(buf->dev);
+	kfree(buf);
+}
+
+static void ffs_dma_buffer_put(struct ffs_dma_buffer *buf)
+{
+	kref_put(&buf->ref, ffs_dma_buffer_release);
+}
+
+static void ffs_dma_vm_open(struct vm_area_struct *vma)
+{
+	struct ffs_dma_buffer *buf = vma->vm_private_data;
+
+	kref_get(&buf->ref);
+}
+
+static void ffs_dma_vm_close(struct vm_area_struct *vma)
+{
+	ffs_dma_buffer_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct ffs_dma_vm_ops = {
+	.open =		ffs_dma_vm_open,
+	.close =	ffs_dma_vm_close,
+};
+
+/*
+ * Look for a DMA buffer of this endpoint covering all of @len bytes of
+ * @iter, which must be a single user space range.  On success a reference
+ * to the buffer is returned, and @cpu and @dma are set to the start of the
+ * range in it.
+ */
+static struct ffs_dma_buffer *ffs_dma_buffer_find(struct file *file,
+						  struct iov_iter *iter,
+						  size_t len, char **cpu,
+						  dma_addr_t *dma)
+{
+	struct ffs_dma_buffer *buf = NULL;
+	struct vm_area_struct *vma;
+	unsigned long start, offset;
+
+	if (!iter_is_iovec(iter) || iter->nr_segs != 1 || !len ||
+	    iov_iter_count(iter) != len)
+		return NULL;
+
+	start = (unsigned long)iter->iov->iov_base + iter->iov_offset;
+
+	down_read(&current->mm->mmap_sem);
+	vma = find_vma(current->mm, start);
+	if (!vma || vma->vm_ops != &ffs_dma_vm_ops ||
+	    file_inode(vma->vm_file) != file_inode(file) ||
+	    start < vma->vm_start || len > vma->vm_end - start)
+		goto out;
+
+	buf = vma->vm_private_data;
+	offset = (vma->vm_pgoff << PAGE_SHIFT) + start - vma->vm_start;
+	*cpu = buf->cpu + offset;
+	*dma = buf->dma + offset;
+	kref_get(&buf->ref);
+out:
+	up_read(&current->mm->mmap_sem);
+	return buf;
+}
+
 static void ffs_user_copy_worker(struct work_struct *work)
 {
 	struct ffs_io_data *io_data = container_of(work, struct ffs_io_data,
@@ -758,7 +844,7 @@ static void ffs_user_copy_worker(struct work_struct *work)
 					 io_data->req->actual;
 	bool kiocb_has_eventfd = io_data->kiocb->ki_flags & IOCB_EVENTFD;
 
-	if (io_data->read && ret > 0) {
+	if (io_data->read && ret > 0 && !io_data->dma_buf) {
 		mm_segment_t oldfs = get_fs();
 
 		set_fs(USER_DS);
@@ -777,7 +863,10 @@ static void ffs_user_copy_worker(struct work_struct *work)
 
 	if (io_data->read)
 		kfree(io_data->to_free);
-	kfree(io_data->buf);
+	if (io_data->dma_buf)
+		ffs_dma_buffer_put(io_data->dma_buf);
+	else
+		kfree(io_data->buf);
 	kfree(io_data);
 }
 
@@ -878,9 +967,11 @@ static ssize_t __ffs_epfile_read_data(struct ffs_epfile *epfile,
 static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 {
 	struct ffs_epfile *epfile = file->private_data;
+	struct ffs_dma_buffer *dma_buf = NULL;
 	struct usb_request *req;
 	struct ffs_ep *ep;
 	char *data = NULL;
+	dma_addr_t dma = 0;
 	ssize_t ret, data_len = -EINVAL;
 	int halt;
 
@@ -949,15 +1040,23 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 			data_len = usb_ep_align_maybe(gadget, ep->ep, data_len);
 		spin_unlock_irq(&epfile->ffs->eps_lock);
 
-		data = kmalloc(data_len, GFP_KERNEL);
-		if (unlikely(!data)) {
-			ret = -ENOMEM;
-			goto error_mutex;
-		}
-		if (!io_data->read &&
-		    !copy_from_iter_full(data, data_len, &io_data->data)) {
-			ret = -EFAULT;
-			goto error_mutex;
+		dma_buf = ffs_dma_buffer_find(file, &io_data->data, data_len,
+					      &data, &dma);
+		if (dma_buf) {
+			if (!io_data->read)
+				iov_iter_advance(&io_data->data, data_len);
+		} else {
+			data = kmalloc(data_len, GFP_KERNEL);
+			if (unlikely(!data)) {
+				ret = -ENOMEM;
+				goto error_mutex;
+			}
+			if (!io_data->read &&
+			    !copy_from_iter_full(data, data_len,
+						 &io_data->data)) {
+				ret = -EFAULT;
+				goto error_mutex;
+			}
 		}
 	}
 
@@ -987,17 +1086,24 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 	} else if (!io_data->aio) {
 		DECLARE_COMPLETION_ONSTACK(done);
 		bool interrupted = false;
+		dma_addr_t old_dma;
 
 		req = ep->req;
 		req->buf      = data;
 		req->length   = data_len;
 
+		old_dma = req->dma;
+		if (dma_buf)
+			req->dma = dma;
+
 		req->context  = &done;
 		req->complete = ffs_epfile_io_complete;
 
 		ret = usb_ep_queue(ep->ep, req, GFP_ATOMIC);
-		if (unlikely(ret < 0))
+		if (unlikely(ret < 0)) {
+			req->dma = old_dma;
 			goto error_lock;
+		}
 
 		spin_unlock_irq(&epfile->ffs->eps_lock);
 
@@ -1011,22 +1117,30 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 			usb_ep_dequeue(ep->ep, req);
 			interrupted = ep->status < 0;
 		}
+		req->dma = old_dma;
 
-		if (interrupted)
+		if (interrupted) {
 			ret = -EINTR;
-		else if (io_data->read && ep->status > 0)
+		} else if (io_data->read && ep->status > 0 && dma_buf) {
+			iov_iter_advance(&io_data->data, ep->status);
+			ret = ep->status;
+		} else if (io_data->read && ep->status > 0) {
 			ret = __ffs_epfile_read_data(epfile, data, ep->status,
 						     &io_data->data);
-		else
+		} else {
 			ret = ep->status;
+		}
 		goto error_mutex;
 	} else if (!(req = usb_ep_alloc_request(ep->ep, GFP_ATOMIC))) {
 		ret = -ENOMEM;
 	} else {
 		req->buf      = data;
 		req->length   = data_len;
+		if (dma_buf)
+			req->dma = dma;
 
 		io_data->buf = data;
+		io_data->dma_buf = dma_buf;
 		io_data->ep = ep->ep;
 		io_data->req = req;
 		io_data->ffs = epfile->ffs;
@@ -1046,6 +1160,7 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 		 * by ffs_user_copy_worker.
 		 */
 		data = NULL;
+		dma_buf = NULL;
 	}
 
 error_lock:
@@ -1053,7 +1168,56 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 error_mutex:
 	mutex_unlock(&epfile->mutex);
 error:
-	kfree(data);
+	if (dma_buf)
+		ffs_dma_buffer_put(dma_buf);
+	else
+		kfree(data);
+	return ret;
+}
+
+static int ffs_epfile_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ffs_epfile *epfile = file->private_data;
+	size_t size = vma->vm_end - vma->vm_start;
+	struct usb_gadget *gadget = epfile->ffs->gadget;
+	struct ffs_dma_buffer *buf;
+	int ret;
+
+	ENTER();
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+	if (!gadget)
+		return -ENODEV;
+
+	buf = kzalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	kref_init(&buf->ref);
+	buf->dev = get_device(gadget->dev.parent);
+	buf->size = size;
+	buf->cpu = dma_alloc_coherent(buf->dev, size, &buf->dma, GFP_KERNEL);
+	if (!buf->cpu) {
+		ret = -ENOMEM;
+		goto err_put;
+	}
+
+	ret = dma_mmap_coherent(buf->dev, vma, buf->cpu, buf->dma, size);
+	if (ret)
+		goto err_free;
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND;
+	vma->vm_ops = &ffs_dma_vm_ops;
+	vma->vm_private_data = buf;
+
+	return 0;
+
+err_free:
+	dma_free_coherent(buf->dev, size, buf->cpu, buf->dma);
+err_put:
+	put_device(buf->dev);
+	kfree(buf);
 	return ret;
 }
 
@@ -1113,6 +1277,7 @@ static ssize_t ffs_epfile_write_iter(struct kiocb *kiocb, struct iov_iter *from)
 	p->kiocb = kiocb;
 	p->data = *from;
 	p->mm = current->mm;
+	p->dma_buf = NULL;
 
 	kiocb->private = p;
 
@@ -1158,6 +1323,7 @@ static ssize_t ffs_epfile_read_iter(struct kiocb *kiocb, struct iov_iter *to)
 		p->to_free = NULL;
 	}
 	p->mm = current->mm;
+	p->dma_buf = NULL;
 
 	kiocb->private = p;
 
@@ -1273,6 +1439,7 @@ static const struct file_operations ffs_epfile_operations = {
 	.open =		ffs_epfile_open,
 	.write_iter =	ffs_epfile_write_iter,
 	.read_iter =	ffs_epfile_read_iter,
+	.mmap =		ffs_epfile_mmap,
 	.release =	ffs_epfile_release,
 	.unlocked_ioctl =	ffs_epfile_ioctl,
 };
@@ -26,6 +26,9 @@
 
 #define HIDG_MINORS	4
 
+/* Most IN requests queued at once, see the in_qlen option */
+#define HIDG_IN_QLEN_MAX	16
+
 static int major, minors;
 static struct class *hidg_class;
 static DEFINE_IDA(hidg_ida);
@@ -57,9 +60,11 @@ struct f_hidg {
 
 	/* send report */
 	spinlock_t			write_spinlock;
-	bool				write_pending;
 	wait_queue_head_t		write_queue;
-	struct usb_request		*req;
+	struct list_head		in_req_free;
+	unsigned int			in_qlen;
+	bool				in_enabled;
+	unsigned int			interval;
 
 	int				minor;
 	struct cdev			cdev;
@@ -319,18 +324,26 @@ static ssize_t f_hidg_read(struct file *file, char __user *buffer,
 	return count;
 }
 
+/*
+ * Up to in_qlen reports are queued on the IN endpoint at once, so a writer
+ * never waits for the host to poll the previous report. Idle requests are
+ * kept in in_req_free while the endpoint is enabled and freed otherwise.
+ */
 static void f_hidg_req_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct f_hidg *hidg = (struct f_hidg *)ep->driver_data;
 	unsigned long flags;
 
-	if (req->status != 0) {
+	if (req->status != 0 && req->status != -ESHUTDOWN) {
 		ERROR(hidg->func.config->cdev,
 			"End Point Request ERROR: %d\n", req->status);
 	}
 
 	spin_lock_irqsave(&hidg->write_spinlock, flags);
-	hidg->write_pending = 0;
+	if (hidg->in_enabled)
+		list_add_tail(&req->list, &hidg->in_req_free);
+	else
+		free_ep_req(ep, req);
 	spin_unlock_irqrestore(&hidg->write_spinlock, flags);
 	wake_up(&hidg->write_queue);
 }
@@ -348,7 +361,7 @@ static ssize_t f_hidg_write(struct file *file, const char __user *buffer,
 
 	spin_lock_irqsave(&hidg->write_spinlock, flags);
 
-#define WRITE_COND (!hidg->write_pending)
+#define WRITE_COND (!list_empty(&hidg->in_req_free))
 try_again:
 	/* write queue */
 	while (!WRITE_COND) {
@@ -363,8 +376,8 @@ static ssize_t f_hidg_write(struct file *file, const char __user *buffer,
 		spin_lock_irqsave(&hidg->write_spinlock, flags);
 	}
 
-	hidg->write_pending = 1;
-	req = hidg->req;
+	req = list_first_entry(&hidg->in_req_free, struct usb_request, list);
+	list_del(&req->list);
 	count  = min_t(unsigned, count, hidg->report_length);
 
 	spin_unlock_irqrestore(&hidg->write_spinlock, flags);
@@ -374,13 +387,13 @@ static ssize_t f_hidg_write(struct file *file, const char __user *buffer,
 		ERROR(hidg->func.config->cdev,
 			"copy_from_user error\n");
 		status = -EINVAL;
-		goto release_write_pending;
+		goto release_req;
 	}
 
 	spin_lock_irqsave(&hidg->write_spinlock, flags);
 
 	/* when our function has been disabled by host */
-	if (!hidg->req) {
+	if (!hidg->in_enabled) {
 		free_ep_req(hidg->in_ep, req);
 		/*
 		 * TODO
@@ -399,17 +412,22 @@ static ssize_t f_hidg_write(struct file *file, const char __user *buffer,
 	if (status < 0) {
 		ERROR(hidg->func.config->cdev,
 			"usb_ep_queue error on int endpoint %zd\n", status);
-		goto release_write_pending_unlocked;
+		goto release_req_unlocked;
 	} else {
 		status = count;
 	}
 	spin_unlock_irqrestore(&hidg->write_spinlock, flags);
 
 	return status;
-release_write_pending:
+release_req:
 	spin_lock_irqsave(&hidg->write_spinlock, flags);
-release_write_pending_unlocked:
-	hidg->write_pending = 0;
+	if (!hidg->in_enabled) {
+		free_ep_req(hidg->in_ep, req);
+		goto release_unlock;
+	}
+release_req_unlocked:
+	list_add(&req->list, &hidg->in_req_free);
+release_unlock:
 	spin_unlock_irqrestore(&hidg->write_spinlock, flags);
 
 	wake_up(&hidg->write_queue);
@@ -609,13 +627,33 @@ static int hidg_setup(struct usb_function *f,
 	return status;
 }
 
+/* Disable the IN endpoint, its requests are freed as they come back */
+static void hidg_in_disable(struct f_hidg *hidg)
+{
+	struct usb_request *req, *next;
+	unsigned long flags;
+	LIST_HEAD(reqs);
+
+	spin_lock_irqsave(&hidg->write_spinlock, flags);
+	hidg->in_enabled = false;
+	list_splice_init(&hidg->in_req_free, &reqs);
+	spin_unlock_irqrestore(&hidg->write_spinlock, flags);
+
+	usb_ep_disable(hidg->in_ep);
+
+	list_for_each_entry_safe(req, next, &reqs, list) {
+		list_del(&req->list);
+		free_ep_req(hidg->in_ep, req);
+	}
+}
+
 static void hidg_disable(struct usb_function *f)
 {
 	struct f_hidg *hidg = func_to_hidg(f);
 	struct f_hidg_req_list *list, *next;
 	unsigned long flags;
 
-	usb_ep_disable(hidg->in_ep);
+	hidg_in_disable(hidg);
 	usb_ep_disable(hidg->out_ep);
 
 	spin_lock_irqsave(&hidg->read_spinlock, flags);
@@ -625,30 +663,22 @@ static void hidg_disable(struct usb_function *f)
 		kfree(list);
 	}
 	spin_unlock_irqrestore(&hidg->read_spinlock, flags);
-
-	spin_lock_irqsave(&hidg->write_spinlock, flags);
-	if (!hidg->write_pending) {
-		free_ep_req(hidg->in_ep, hidg->req);
-		hidg->write_pending = 1;
-	}
-
-	hidg->req = NULL;
-	spin_unlock_irqrestore(&hidg->write_spinlock, flags);
 }
 
 static int hidg_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 {
 	struct usb_composite_dev		*cdev = f->config->cdev;
 	struct f_hidg				*hidg = func_to_hidg(f);
-	struct usb_request			*req_in = NULL;
+	struct usb_request			*req_in, *next;
 	unsigned long				flags;
+	LIST_HEAD(reqs_in);
 	int i, status = 0;
 
 	VDBG(cdev, "hidg_set_alt intf:%d alt:%d\n", intf, alt);
 
 	if (hidg->in_ep != NULL) {
 		/* restart endpoint */
-		usb_ep_disable(hidg->in_ep);
+		hidg_in_disable(hidg);
 
 		status = config_ep_by_speed(f->config->cdev->gadget, f,
 					    hidg->in_ep);
@@ -663,10 +693,16 @@ static int hidg_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 		}
 		hidg->in_ep->driver_data = hidg;
 
-		req_in = hidg_alloc_ep_req(hidg->in_ep, hidg->report_length);
-		if (!req_in) {
-			status = -ENOMEM;
-			goto disable_ep_in;
+		for (i = 0; i < hidg->in_qlen; i++) {
+			req_in = hidg_alloc_ep_req(hidg->in_ep,
+						   hidg->report_length);
+			if (!req_in) {
+				status = -ENOMEM;
+				goto free_req_in;
+			}
+			req_in->complete = f_hidg_req_complete;
+			req_in->context = hidg;
+			list_add_tail(&req_in->list, &reqs_in);
 		}
 	}
 
@@ -714,8 +750,8 @@ static int hidg_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 
 	if (hidg->in_ep != NULL) {
 		spin_lock_irqsave(&hidg->write_spinlock, flags);
-		hidg->req = req_in;
-		hidg->write_pending = 0;
+		list_splice_tail(&reqs_in, &hidg->in_req_free);
+		hidg->in_enabled = true;
 		spin_unlock_irqrestore(&hidg->write_spinlock, flags);
 
 		wake_up(&hidg->write_queue);
@@ -724,10 +760,11 @@ static int hidg_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 disable_out_ep:
 	usb_ep_disable(hidg->out_ep);
 free_req_in:
-	if (req_in)
+	list_for_each_entry_safe(req_in, next, &reqs_in, list) {
+		list_del(&req_in->list);
 		free_ep_req(hidg->in_ep, req_in);
+	}
 
-disable_ep_in:
 	if (hidg->in_ep)
 		usb_ep_disable(hidg->in_ep);
 
@@ -789,6 +826,16 @@ static int hidg_bind(struct usb_configuration *c, struct usb_function *f)
 	hidg_hs_in_ep_desc.wMaxPacketSize = cpu_to_le16(hidg->report_length);
 	hidg_fs_in_ep_desc.wMaxPacketSize = cpu_to_le16(hidg->report_length);
 	hidg_ss_out_ep_desc.wMaxPacketSize = cpu_to_le16(hidg->report_length);
+	if (hidg->interval) {
+		/* in frames at full speed, 2^(n - 1) microframes above */
+		hidg_fs_in_ep_desc.bInterval = hidg->interval;
+		hidg_fs_out_ep_desc.bInterval = hidg->interval;
+		hidg_hs_in_ep_desc.bInterval = min(ilog2(hidg->interval) + 4,
+						   16);
+		hidg_hs_out_ep_desc.bInterval = hidg_hs_in_ep_desc.bInterval;
+		hidg_ss_in_ep_desc.bInterval = hidg_hs_in_ep_desc.bInterval;
+		hidg_ss_out_ep_desc.bInterval = hidg_hs_in_ep_desc.bInterval;
+	}
 	hidg_ss_out_comp_desc.wBytesPerInterval =
 				cpu_to_le16(hidg->report_length);
 	hidg_hs_out_ep_desc.wMaxPacketSize = cpu_to_le16(hidg->report_length);
@@ -817,8 +864,8 @@ static int hidg_bind(struct usb_configuration *c, struct usb_function *f)
 		goto fail;
 
 	spin_lock_init(&hidg->write_spinlock);
-	hidg->write_pending = 1;
-	hidg->req = NULL;
+	INIT_LIST_HEAD(&hidg->in_req_free);
+	hidg->in_enabled = false;
 	spin_lock_init(&hidg->read_spinlock);
 	init_waitqueue_head(&hidg->write_queue);
 	init_waitqueue_head(&hidg->read_queue);
@@ -845,8 +892,6 @@ static int hidg_bind(struct usb_configuration *c, struct usb_function *f)
 	usb_free_all_descriptors(f);
 fail:
 	ERROR(f->config->cdev, "hidg_bind FAILED\n");
-	if (hidg->req != NULL)
-		free_ep_req(hidg->in_ep, hidg->req);
 
 	return status;
 }
@@ -928,6 +973,8 @@ CONFIGFS_ATTR(f_hid_opts_, name)
 F_HID_OPT(subclass, 8, 255);
 F_HID_OPT(protocol, 8, 255);
 F_HID_OPT(report_length, 16, 65535);
+F_HID_OPT(interval, 8, 255);
+F_HID_OPT(in_qlen, 8, HIDG_IN_QLEN_MAX);
 
 static ssize_t f_hid_opts_report_desc_show(struct config_item *item, char *page)
 {
@@ -987,6 +1034,8 @@ static struct configfs_attribute *hid_attrs[] = {
 	&f_hid_opts_attr_subclass,
 	&f_hid_opts_attr_protocol,
 	&f_hid_opts_attr_report_length,
+	&f_hid_opts_attr_interval,
+	&f_hid_opts_attr_in_qlen,
 	&f_hid_opts_attr_report_desc,
 	&f_hid_opts_attr_dev,
 	NULL,
@@ -1105,6 +1154,8 @@ static struct usb_function *hidg_alloc(struct usb_function_instance *fi)
 	hidg->bInterfaceSubClass = opts->subclass;
 	hidg->bInterfaceProtocol = opts->protocol;
 	hidg->report_length = opts->report_length;
+	hidg->interval = opts->interval;
+	hidg->in_qlen = opts->in_qlen ?: 1;
 	hidg->report_desc_length = opts->report_desc_length;
 	if (opts->report_desc) {
 		hidg->report_desc = kmemdup(opts->report_desc,
@@ -737,6 +737,14 @@ static int do_read(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Written data is only queued in the page cache.  Start writing it back
+ * once this much has piled up, so that the medium is busy while the next
+ * buffers arrive over USB instead of everything being flushed at once on
+ * SYNCHRONIZE CACHE or when memory runs low.
+ */
+#define FSG_WRITE_BEHIND	(16 * FSG_BUFLEN)
+
 static int do_write(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = common->curlun;
@@ -900,6 +908,12 @@ static int do_write(struct fsg_common *common)
 		amount_left_to_write -= nwritten;
 		common->residue -= nwritten;
 
+		curlun->write_behind += nwritten;
+		if (curlun->write_behind >= FSG_WRITE_BEHIND) {
+			filemap_flush(curlun->filp->f_mapping);
+			curlun->write_behind = 0;
+		}
+
 		/* If an error occurred, report it and its position */
 		if (nwritten < amount) {
 			curlun->sense_data = SS_WRITE_ERROR;
@@ -94,6 +94,9 @@ struct f_midi {
 	int index;
 	char *id;
 	unsigned int buflen, qlen;
+	/* Number of IN requests, and whether to send them right away */
+	unsigned int in_qlen;
+	bool low_latency;
 	/* This fifo is used as a buffer ring for pre-allocated IN usb_requests */
 	DECLARE_KFIFO_PTR(in_req_fifo, struct usb_request *);
 	spinlock_t transmit_lock;
@@ -606,7 +609,7 @@ static void f_midi_transmit_byte(struct usb_request *req,
 static int f_midi_do_transmit(struct f_midi *midi, struct usb_ep *ep)
 {
 	struct usb_request *req = NULL;
-	unsigned int len, i;
+	unsigned int len, i, buflen;
 	bool active = false;
 	int err;
 
@@ -629,6 +632,16 @@ static int f_midi_do_transmit(struct f_midi *midi, struct usb_ep *ep)
 	if (req->length > 0)
 		return 0;
 
+	/*
+	 * In low latency mode a request is never more than one packet, so
+	 * what comes in while it is on the bus goes out in the next one
+	 * instead of waiting behind a long transfer.
+	 */
+	buflen = midi->buflen;
+	if (midi->low_latency)
+		buflen = min_t(unsigned int, buflen,
+			       usb_endpoint_maxp(ep->desc));
+
 	for (i = midi->in_last_port; i < midi->in_ports; ++i) {
 		struct gmidi_in_port *port = midi->in_ports_array + i;
 		struct snd_rawmidi_substream *substream = port->substream;
@@ -636,7 +649,7 @@ static int f_midi_do_transmit(struct f_midi *midi, struct usb_ep *ep)
 		if (!port->active || !substream)
 			continue;
 
-		while (req->length + 3 < midi->buflen) {
+		while (req->length + 3 < buflen) {
 			uint8_t b;
 
 			if (snd_rawmidi_transmit(substream, &b, 1) != 1) {
@@ -736,7 +749,16 @@ static void f_midi_in_trigger(struct snd_rawmidi_substream *substream, int up)
 
 	VDBG(midi, "%s() %d\n", __func__, up);
 	midi->in_ports_array[substream->number].active = up;
-	if (up)
+	if (!up)
+		return;
+
+	/*
+	 * The trigger runs without the rawmidi lock held, so the bytes can
+	 * be queued from here instead of a tasklet run later.
+	 */
+	if (midi->low_latency)
+		f_midi_transmit(midi);
+	else
 		tasklet_hi_schedule(&midi->tasklet);
 }
 
@@ -1129,6 +1151,8 @@ CONFIGFS_ATTR(f_midi_opts_, name);
 F_MIDI_OPT(index, true, SNDRV_CARDS);
 F_MIDI_OPT(buflen, false, 0);
 F_MIDI_OPT(qlen, false, 0);
+F_MIDI_OPT(in_qlen, false, 0);
+F_MIDI_OPT(low_latency, true, 1);
 F_MIDI_OPT(in_ports, true, MAX_PORTS);
 F_MIDI_OPT(out_ports, true, MAX_PORTS);
 
@@ -1184,6 +1208,8 @@ static struct configfs_attribute *midi_attrs[] = {
 	&f_midi_opts_attr_index,
 	&f_midi_opts_attr_buflen,
 	&f_midi_opts_attr_qlen,
+	&f_midi_opts_attr_in_qlen,
+	&f_midi_opts_attr_low_latency,
 	&f_midi_opts_attr_in_ports,
 	&f_midi_opts_attr_out_ports,
 	&f_midi_opts_attr_id,
@@ -1310,10 +1336,12 @@ static struct usb_function *f_midi_alloc(struct usb_function_instance *fi)
 	midi->index = opts->index;
 	midi->buflen = opts->buflen;
 	midi->qlen = opts->qlen;
+	midi->in_qlen = opts->in_qlen ? opts->in_qlen : opts->qlen;
+	midi->low_latency = opts->low_latency;
 	midi->in_last_port = 0;
 	midi->free_ref = 1;
 
-	status = kfifo_alloc(&midi->in_req_fifo, midi->qlen, GFP_KERNEL);
+	status = kfifo_alloc(&midi->in_req_fifo, midi->in_qlen, GFP_KERNEL);
 	if (status)
 		goto setup_fail;
 
@@ -76,9 +76,12 @@ struct f_ncm {
 	struct sk_buff			*skb_tx_data;
 	struct sk_buff			*skb_tx_ndp;
 	u16				ndp_dgram_count;
+	u16				tx_max_dpe;
 	bool				timer_force_tx;
 	struct tasklet_struct		tx_tasklet;
 	struct hrtimer			task_timer;
+	u64				tx_coalesce_ns;
+	struct f_ncm_tx_stats		*tx_stats;
 
 	bool				timer_stopping;
 };
@@ -110,17 +113,19 @@ static inline unsigned ncm_bitrate(struct usb_gadget *g)
 #define NTB_DEFAULT_IN_SIZE	16384
 #define NTB_OUT_SIZE		16384
 
-/* Allocation for storing the NDP, 32 should suffice for a
- * 16k packet. This allows a maximum of 32 * 507 Byte packets to
- * be transmitted in a single 16kB skb, though when sending full size
- * packets this limit will be plenty.
- * Smaller packets are not likely to be trying to maximize the
- * throughput and will be mstly sending smaller infrequent frames.
+/* Allocation for storing the NDP. At least 32 entries are reserved, which
+ * is plenty for full size packets. Streams of small datagrams are allowed
+ * one entry per TX_MIN_DGRAM_SIZE bytes of the NTB the host accepts, so
+ * that they are limited by the NTB size rather than by the entry count.
  */
 #define TX_MAX_NUM_DPE		32
+#define TX_MIN_DGRAM_SIZE	64
 
-/* Delay for the transmit to wait before sending an unfilled NTB frame. */
-#define TX_TIMEOUT_NSECS	300000
+/* Default delay for the transmit to wait before sending an unfilled NTB,
+ * rounded up to whole (micro)frames of the connection.
+ */
+#define TX_COALESCE_USECS	250
+#define TX_COALESCE_MAX_USECS	10000
 
 #define FORMATS_SUPPORTED	(USB_CDC_NCM_NTB16_SUPPORTED |	\
 				 USB_CDC_NCM_NTB32_SUPPORTED)
@@ -866,6 +871,26 @@ static int ncm_setup(struct usb_function *f, const struct usb_ctrlrequest *ctrl)
 }
 
 
+static u16 ncm_tx_max_dpe(struct f_ncm *ncm)
+{
+	return max_t(u16, TX_MAX_NUM_DPE,
+		     ncm->port.fixed_in_len / TX_MIN_DGRAM_SIZE);
+}
+
+static u64 ncm_tx_coalesce_ns(struct f_ncm *ncm, struct usb_gadget *g)
+{
+	struct f_ncm_opts *opts;
+	u32 frame_ns;
+	u64 ns;
+
+	opts = container_of(ncm->port.func.fi, struct f_ncm_opts, func_inst);
+	frame_ns = g->speed >= USB_SPEED_HIGH ? 125 * NSEC_PER_USEC
+					      : NSEC_PER_MSEC;
+	ns = (u64)opts->tx_coalesce_usecs * NSEC_PER_USEC;
+
+	return DIV_ROUND_UP_ULL(ns, frame_ns) * frame_ns;
+}
+
 static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 {
 	struct f_ncm		*ncm = func_to_ncm(f);
@@ -926,6 +951,8 @@ static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 			ncm->port.is_zlp_ok =
 				gadget_is_zlp_supported(cdev->gadget);
 			ncm->port.cdc_filter = DEFAULT_FILTER;
+			ncm->tx_coalesce_ns = ncm_tx_coalesce_ns(ncm,
+								cdev->gadget);
 			DBG(cdev, "activate ncm\n");
 			net = gether_connect(&ncm->port);
 			if (IS_ERR(net))
@@ -988,6 +1015,8 @@ static struct sk_buff *package_for_tx(struct f_ncm *ncm)
 	/* Set the final NDP wLength */
 	new_len = opts->ndp_size +
 			(ncm->ndp_dgram_count * dgram_idx_len);
+	/* don't count the zeroed entry */
+	ncm->tx_stats->datagrams += ncm->ndp_dgram_count - 1;
 	ncm->ndp_dgram_count = 0;
 	/* Increment from start to wLength */
 	ntb_iter = (void *) ncm->skb_tx_ndp->data;
@@ -1012,6 +1041,9 @@ static struct sk_buff *package_for_tx(struct f_ncm *ncm)
 	/* Insert zero'd datagram. */
 	skb_put_zero(skb2, dgram_idx_len);
 
+	ncm->tx_stats->ntbs++;
+	ncm->tx_stats->bytes += skb2->len;
+
 	return skb2;
 }
 
@@ -1054,11 +1086,15 @@ static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 		 * NOTE: Assume maximum align for speed of calculation.
 		 */
 		if (ncm->skb_tx_data
-		    && (ncm->ndp_dgram_count >= TX_MAX_NUM_DPE
+		    && (ncm->ndp_dgram_count >= ncm->tx_max_dpe
 		    || (ncm->skb_tx_data->len +
 		    div + rem + skb->len +
 		    ncm->skb_tx_ndp->len + ndp_align + (2 * dgram_idx_len))
 		    > max_size)) {
+			if (ncm->ndp_dgram_count >= ncm->tx_max_dpe)
+				ncm->tx_stats->flush_dpe++;
+			else
+				ncm->tx_stats->flush_full++;
 			skb2 = package_for_tx(ncm);
 			if (!skb2)
 				goto err;
@@ -1082,13 +1118,13 @@ static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 			/* wHeaderLength */
 			put_unaligned_le16(opts->nth_size, ntb_data++);
 
-			/* Allocate an skb for storing the NDP,
-			 * TX_MAX_NUM_DPE should easily suffice for a
-			 * 16k packet.
+			/* Allocate an skb for storing the NDP, sized for
+			 * as many entries as the NTB can take datagrams.
 			 */
+			ncm->tx_max_dpe = ncm_tx_max_dpe(ncm);
 			ncm->skb_tx_ndp = alloc_skb((int)(opts->ndp_size
 						    + opts->dpe_size
-						    * TX_MAX_NUM_DPE),
+						    * ncm->tx_max_dpe),
 						    GFP_ATOMIC);
 			if (!ncm->skb_tx_ndp)
 				goto err;
@@ -1104,11 +1140,16 @@ static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 			ncm->ndp_dgram_count = 1;
 
 			/* Note: we skip opts->next_ndp_index */
-		}
 
-		/* Delay the timer. */
-		hrtimer_start(&ncm->task_timer, TX_TIMEOUT_NSECS,
-			      HRTIMER_MODE_REL);
+			/*
+			 * Start the coalescing timer with the NTB, so that
+			 * a steady trickle of datagrams doesn't hold back
+			 * the first one until the NTB is full.
+			 */
+			hrtimer_start(&ncm->task_timer,
+				      ns_to_ktime(ncm->tx_coalesce_ns),
+				      HRTIMER_MODE_REL);
+		}
 
 		/* Add the datagram position entries */
 		ntb_ndp = skb_put_zero(ncm->skb_tx_ndp, dgram_idx_len);
@@ -1131,6 +1172,7 @@ static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 
 	} else if (ncm->skb_tx_data && ncm->timer_force_tx) {
 		/* If the tx was requested because of a timeout then send */
+		ncm->tx_stats->flush_timer++;
 		skb2 = package_for_tx(ncm);
 		if (!skb2)
 			goto err;
@@ -1560,11 +1602,63 @@ USB_ETHERNET_CONFIGFS_ITEM_ATTR_QMULT(ncm);
 /* f_ncm_opts_ifname */
 USB_ETHERNET_CONFIGFS_ITEM_ATTR_IFNAME(ncm);
 
+static ssize_t ncm_opts_tx_coalesce_usecs_show(struct config_item *item,
+					       char *page)
+{
+	struct f_ncm_opts *opts = to_f_ncm_opts(item);
+	unsigned int usecs;
+
+	mutex_lock(&opts->lock);
+	usecs = opts->tx_coalesce_usecs;
+	mutex_unlock(&opts->lock);
+
+	return sprintf(page, "%u\n", usecs);
+}
+
+static ssize_t ncm_opts_tx_coalesce_usecs_store(struct config_item *item,
+						const char *page, size_t len)
+{
+	struct f_ncm_opts *opts = to_f_ncm_opts(item);
+	unsigned int usecs;
+	int ret;
+
+	ret = kstrtouint(page, 0, &usecs);
+	if (ret)
+		return ret;
+	if (usecs > TX_COALESCE_MAX_USECS)
+		return -EINVAL;
+
+	/* takes effect when the host next activates the data interface */
+	mutex_lock(&opts->lock);
+	opts->tx_coalesce_usecs = usecs;
+	mutex_unlock(&opts->lock);
+
+	return len;
+}
+
+CONFIGFS_ATTR(ncm_opts_, tx_coalesce_usecs);
+
+static ssize_t ncm_opts_tx_stats_show(struct config_item *item, char *page)
+{
+	struct f_ncm_opts *opts = to_f_ncm_opts(item);
+	struct f_ncm_tx_stats *stats = &opts->tx_stats;
+
+	return sprintf(page,
+		       "ntbs %lu\ndatagrams %lu\nbytes %lu\n"
+		       "flush_full %lu\nflush_dpe %lu\nflush_timer %lu\n",
+		       stats->ntbs, stats->datagrams, stats->bytes,
+		       stats->flush_full, stats->flush_dpe, stats->flush_timer);
+}
+
+CONFIGFS_ATTR_RO(ncm_opts_, tx_stats);
+
 static struct configfs_attribute *ncm_attrs[] = {
 	&ncm_opts_attr_dev_addr,
 	&ncm_opts_attr_host_addr,
 	&ncm_opts_attr_qmult,
 	&ncm_opts_attr_ifname,
+	&ncm_opts_attr_tx_coalesce_usecs,
+	&ncm_opts_attr_tx_stats,
 	NULL,
 };
 
@@ -1594,6 +1688,7 @@ static struct usb_function_instance *ncm_alloc_inst(void)
 	if (!opts)
 		return ERR_PTR(-ENOMEM);
 	mutex_init(&opts->lock);
+	opts->tx_coalesce_usecs = TX_COALESCE_USECS;
 	opts->func_inst.free_func_inst = ncm_free_inst;
 	opts->net = gether_setup_default();
 	if (IS_ERR(opts->net)) {
@@ -1664,6 +1759,7 @@ static struct usb_function *ncm_alloc(struct usb_function_instance *fi)
 	spin_lock_init(&ncm->lock);
 	ncm_reset_values(ncm);
 	ncm->port.ioport = netdev_priv(opts->net);
+	ncm->tx_stats = &opts->tx_stats;
 	mutex_unlock(&opts->lock);
 	ncm->port.is_fixed = true;
 	ncm->port.supports_multi_frame = true;
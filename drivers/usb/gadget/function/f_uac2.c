@@ -304,6 +304,27 @@ static struct uac2_iso_endpoint_descriptor as_iso_out_desc = {
 	.wLockDelay = 0,
 };
 
+/* STD AS ISO IN Feedback Endpoint of the OUT one, 10.14 samples per frame */
+static struct usb_endpoint_descriptor fs_epout_fback_desc = {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+
+	.bEndpointAddress = USB_DIR_IN,
+	.bmAttributes = USB_ENDPOINT_XFER_ISOC | USB_ENDPOINT_USAGE_FEEDBACK,
+	.wMaxPacketSize = cpu_to_le16(3),
+	.bInterval = 1,
+};
+
+/* 16.16 samples per microframe */
+static struct usb_endpoint_descriptor hs_epout_fback_desc = {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+
+	.bmAttributes = USB_ENDPOINT_XFER_ISOC | USB_ENDPOINT_USAGE_FEEDBACK,
+	.wMaxPacketSize = cpu_to_le16(4),
+	.bInterval = 4,
+};
+
 /* Audio Streaming IN Interface - Alt0 */
 static struct usb_interface_descriptor std_as_in_if0_desc = {
 	.bLength = sizeof std_as_in_if0_desc,
@@ -381,65 +402,72 @@ static struct uac2_iso_endpoint_descriptor as_iso_in_desc = {
 	.wLockDelay = 0,
 };
 
-static struct usb_descriptor_header *fs_audio_desc[] = {
-	(struct usb_descriptor_header *)&iad_desc,
-	(struct usb_descriptor_header *)&std_ac_if_desc,
-
-	(struct usb_descriptor_header *)&ac_hdr_desc,
-	(struct usb_descriptor_header *)&in_clk_src_desc,
-	(struct usb_descriptor_header *)&out_clk_src_desc,
-	(struct usb_descriptor_header *)&usb_out_it_desc,
-	(struct usb_descriptor_header *)&io_in_it_desc,
-	(struct usb_descriptor_header *)&usb_in_ot_desc,
-	(struct usb_descriptor_header *)&io_out_ot_desc,
-
-	(struct usb_descriptor_header *)&std_as_out_if0_desc,
-	(struct usb_descriptor_header *)&std_as_out_if1_desc,
+/* Room for every descriptor above, the feedback endpoint and a NULL */
+#define UAC2_AUDIO_DESC_MAX	23
 
-	(struct usb_descriptor_header *)&as_out_hdr_desc,
-	(struct usb_descriptor_header *)&as_out_fmt1_desc,
-	(struct usb_descriptor_header *)&fs_epout_desc,
-	(struct usb_descriptor_header *)&as_iso_out_desc,
-
-	(struct usb_descriptor_header *)&std_as_in_if0_desc,
-	(struct usb_descriptor_header *)&std_as_in_if1_desc,
-
-	(struct usb_descriptor_header *)&as_in_hdr_desc,
-	(struct usb_descriptor_header *)&as_in_fmt1_desc,
-	(struct usb_descriptor_header *)&fs_epin_desc,
-	(struct usb_descriptor_header *)&as_iso_in_desc,
-	NULL,
-};
+static struct usb_descriptor_header *fs_audio_desc[UAC2_AUDIO_DESC_MAX];
+static struct usb_descriptor_header *hs_audio_desc[UAC2_AUDIO_DESC_MAX];
 
-static struct usb_descriptor_header *hs_audio_desc[] = {
-	(struct usb_descriptor_header *)&iad_desc,
-	(struct usb_descriptor_header *)&std_ac_if_desc,
-
-	(struct usb_descriptor_header *)&ac_hdr_desc,
-	(struct usb_descriptor_header *)&in_clk_src_desc,
-	(struct usb_descriptor_header *)&out_clk_src_desc,
-	(struct usb_descriptor_header *)&usb_out_it_desc,
-	(struct usb_descriptor_header *)&io_in_it_desc,
-	(struct usb_descriptor_header *)&usb_in_ot_desc,
-	(struct usb_descriptor_header *)&io_out_ot_desc,
-
-	(struct usb_descriptor_header *)&std_as_out_if0_desc,
-	(struct usb_descriptor_header *)&std_as_out_if1_desc,
-
-	(struct usb_descriptor_header *)&as_out_hdr_desc,
-	(struct usb_descriptor_header *)&as_out_fmt1_desc,
-	(struct usb_descriptor_header *)&hs_epout_desc,
-	(struct usb_descriptor_header *)&as_iso_out_desc,
-
-	(struct usb_descriptor_header *)&std_as_in_if0_desc,
-	(struct usb_descriptor_header *)&std_as_in_if1_desc,
+static void setup_headers(struct usb_descriptor_header **headers,
+			  struct usb_endpoint_descriptor *epout_desc,
+			  struct usb_endpoint_descriptor *epout_fback_desc,
+			  struct usb_endpoint_descriptor *epin_desc)
+{
+	int i = 0;
+
+	headers[i++] = (struct usb_descriptor_header *)&iad_desc;
+	headers[i++] = (struct usb_descriptor_header *)&std_ac_if_desc;
+
+	headers[i++] = (struct usb_descriptor_header *)&ac_hdr_desc;
+	headers[i++] = (struct usb_descriptor_header *)&in_clk_src_desc;
+	headers[i++] = (struct usb_descriptor_header *)&out_clk_src_desc;
+	headers[i++] = (struct usb_descriptor_header *)&usb_out_it_desc;
+	headers[i++] = (struct usb_descriptor_header *)&io_in_it_desc;
+	headers[i++] = (struct usb_descriptor_header *)&usb_in_ot_desc;
+	headers[i++] = (struct usb_descriptor_header *)&io_out_ot_desc;
+
+	headers[i++] = (struct usb_descriptor_header *)&std_as_out_if0_desc;
+	headers[i++] = (struct usb_descriptor_header *)&std_as_out_if1_desc;
+
+	headers[i++] = (struct usb_descriptor_header *)&as_out_hdr_desc;
+	headers[i++] = (struct usb_descriptor_header *)&as_out_fmt1_desc;
+	headers[i++] = (struct usb_descriptor_header *)epout_desc;
+	headers[i++] = (struct usb_descriptor_header *)&as_iso_out_desc;
+	if (epout_fback_desc)
+		headers[i++] =
+			(struct usb_descriptor_header *)epout_fback_desc;
+
+	headers[i++] = (struct usb_descriptor_header *)&std_as_in_if0_desc;
+	headers[i++] = (struct usb_descriptor_header *)&std_as_in_if1_desc;
+
+	headers[i++] = (struct usb_descriptor_header *)&as_in_hdr_desc;
+	headers[i++] = (struct usb_descriptor_header *)&as_in_fmt1_desc;
+	headers[i++] = (struct usb_descriptor_header *)epin_desc;
+	headers[i++] = (struct usb_descriptor_header *)&as_iso_in_desc;
+	headers[i] = NULL;
+}
 
-	(struct usb_descriptor_header *)&as_in_hdr_desc,
-	(struct usb_descriptor_header *)&as_in_fmt1_desc,
-	(struct usb_descriptor_header *)&hs_epin_desc,
-	(struct usb_descriptor_header *)&as_iso_in_desc,
-	NULL,
-};
+/*
+ * The capture endpoint is asynchronous when it has a feedback endpoint,
+ * telling the host how fast the gadget actually consumes the samples, and
+ * adaptive otherwise.
+ */
+static void setup_descriptor(const struct f_uac2_opts *opts)
+{
+	u8 sync = opts->c_fback ? USB_ENDPOINT_SYNC_ASYNC :
+				  USB_ENDPOINT_SYNC_ADAPTIVE;
+
+	fs_epout_desc.bmAttributes = USB_ENDPOINT_XFER_ISOC | sync;
+	hs_epout_desc.bmAttributes = USB_ENDPOINT_XFER_ISOC | sync;
+	std_as_out_if1_desc.bNumEndpoints = opts->c_fback ? 2 : 1;
+
+	setup_headers(fs_audio_desc, &fs_epout_desc,
+		      opts->c_fback ? &fs_epout_fback_desc : NULL,
+		      &fs_epin_desc);
+	setup_headers(hs_audio_desc, &hs_epout_desc,
+		      opts->c_fback ? &hs_epout_fback_desc : NULL,
+		      &hs_epin_desc);
+}
 
 struct cntrl_cur_lay3 {
 	__u32	dCUR;
@@ -467,6 +495,11 @@ static void set_ep_max_packet_size(const struct f_uac2_opts *uac2_opts,
 		chmask = uac2_opts->c_chmask;
 		srate = uac2_opts->c_srate;
 		ssize = uac2_opts->c_ssize;
+
+		/* Leave room for the host speeding up on our feedback */
+		if (uac2_opts->c_fback)
+			srate += DIV_ROUND_UP(srate * UAC_FBACK_PITCH_RANGE,
+					      UAC_FBACK_PITCH_UNITY);
 	}
 
 	max_packet_size = num_channels(chmask) * ssize *
@@ -566,6 +599,17 @@ afunc_bind(struct usb_configuration *cfg, struct usb_function *fn)
 		return ret;
 	}
 
+	if (uac2_opts->c_fback) {
+		agdev->in_ep_fback = usb_ep_autoconfig(gadget,
+						       &fs_epout_fback_desc);
+		if (!agdev->in_ep_fback) {
+			dev_err(dev, "%s:%d Error!\n", __func__, __LINE__);
+			return -ENODEV;
+		}
+		hs_epout_fback_desc.bEndpointAddress =
+			fs_epout_fback_desc.bEndpointAddress;
+	}
+
 	agdev->in_ep = usb_ep_autoconfig(gadget, &fs_epin_desc);
 	if (!agdev->in_ep) {
 		dev_err(dev, "%s:%d Error!\n", __func__, __LINE__);
@@ -582,6 +626,8 @@ afunc_bind(struct usb_configuration *cfg, struct usb_function *fn)
 	hs_epout_desc.bEndpointAddress = fs_epout_desc.bEndpointAddress;
 	hs_epin_desc.bEndpointAddress = fs_epin_desc.bEndpointAddress;
 
+	setup_descriptor(uac2_opts);
+
 	ret = usb_assign_descriptors(fn, fs_audio_desc, hs_audio_desc, NULL,
 				     NULL);
 	if (ret)
@@ -911,6 +957,7 @@ UAC2_ATTRIBUTE(c_chmask);
 UAC2_ATTRIBUTE(c_srate);
 UAC2_ATTRIBUTE(c_ssize);
 UAC2_ATTRIBUTE(req_number);
+UAC2_ATTRIBUTE(c_fback);
 
 static struct configfs_attribute *f_uac2_attrs[] = {
 	&f_uac2_opts_attr_p_chmask,
@@ -920,6 +967,7 @@ static struct configfs_attribute *f_uac2_attrs[] = {
 	&f_uac2_opts_attr_c_srate,
 	&f_uac2_opts_attr_c_ssize,
 	&f_uac2_opts_attr_req_number,
+	&f_uac2_opts_attr_c_fback,
 	NULL,
 };
 
@@ -958,6 +1006,7 @@ static struct usb_function_instance *afunc_alloc_inst(void)
 	opts->c_srate = UAC2_DEF_CSRATE;
 	opts->c_ssize = UAC2_DEF_CSSIZE;
 	opts->req_number = UAC2_DEF_REQ_NUM;
+	opts->c_fback = UAC2_DEF_CFBACK;
 	return &opts->func_inst;
 }
 
@@ -24,6 +24,7 @@
  */
 
 #include <linux/module.h>
+#include <linux/backing-dev.h>
 #include <linux/blkdev.h>
 #include <linux/file.h>
 #include <linux/fs.h>
@@ -185,6 +186,7 @@ int fsg_lun_open(struct fsg_lun *curlun, const char *filename)
 	struct file			*filp = NULL;
 	int				rc = -EINVAL;
 	struct inode			*inode = NULL;
+	struct backing_dev_info		*bdi;
 	loff_t				size;
 	loff_t				num_sectors;
 	loff_t				min_sectors;
@@ -260,6 +262,17 @@ int fsg_lun_open(struct fsg_lun *curlun, const char *filename)
 		goto out;
 	}
 
+	/*
+	 * Hosts read the medium sequentially in large chunks, so give the
+	 * backing file the doubled read-ahead window POSIX_FADV_SEQUENTIAL
+	 * would.  That keeps reads from the medium ahead of the USB
+	 * transfers instead of each buffer waiting for its own read.
+	 */
+	bdi = inode_to_bdi(inode->i_mapping->host);
+	spin_lock(&filp->f_lock);
+	filp->f_ra.ra_pages = bdi->ra_pages * 2;
+	spin_unlock(&filp->f_lock);
+
 	if (fsg_lun_is_open(curlun))
 		fsg_lun_close(curlun);
 
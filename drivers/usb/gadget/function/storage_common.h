@@ -116,6 +116,8 @@ struct fsg_lun {
 	unsigned int	blkbits; /* Bits of logical block size
 						       of bound block device */
 	unsigned int	blksize; /* logical block size of bound block device */
+	unsigned int	write_behind; /* bytes written since writeback was
+					 last started */
 	struct device	dev;
 	const char	*name;		/* "lun.name" */
 	const char	**name_pfx;	/* "function.name" */
@@ -22,7 +22,9 @@
  */
 
 #include <linux/module.h>
+#include <asm/unaligned.h>
 #include <sound/core.h>
+#include <sound/control.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
 
@@ -57,6 +59,10 @@ struct uac_rtd_params {
 	unsigned max_psize;	/* MaxPacketSize of endpoint */
 	struct uac_req *ureq;
 
+	/* Capture only: feedback request and the pitch it reports */
+	struct usb_request *req_fback;
+	unsigned int pitch;
+
 	spinlock_t lock;
 };
 
@@ -185,6 +191,49 @@ static void u_audio_iso_complete(struct usb_ep *ep, struct usb_request *req)
 		snd_pcm_period_elapsed(substream);
 }
 
+/*
+ * Full speed feedback is 10.14 samples per frame in three bytes, high speed
+ * feedback 16.16 samples per microframe in four.
+ */
+static void u_audio_set_fback(struct uac_rtd_params *prm,
+			      struct usb_request *req)
+{
+	struct g_audio *audio_dev = prm->uac->audio_dev;
+	u64 ff = (u64)audio_dev->params.c_srate * READ_ONCE(prm->pitch);
+
+	if (audio_dev->gadget->speed == USB_SPEED_FULL) {
+		ff = DIV_ROUND_CLOSEST_ULL(ff << 14,
+					   1000U * UAC_FBACK_PITCH_UNITY);
+		req->length = 3;
+	} else {
+		ff = DIV_ROUND_CLOSEST_ULL(ff << 13,
+					   1000U * UAC_FBACK_PITCH_UNITY);
+		req->length = 4;
+	}
+
+	/* The buffer has room for four bytes either way */
+	put_unaligned_le32(ff, req->buf);
+}
+
+static void u_audio_iso_fback_complete(struct usb_ep *ep,
+				       struct usb_request *req)
+{
+	struct uac_rtd_params *prm = req->context;
+
+	/* i/f shutting down */
+	if (!prm->ep_enabled || req->status == -ESHUTDOWN)
+		return;
+
+	if (req->status)
+		pr_debug("%s: iso_complete status(%d) %d/%d\n",
+			__func__, req->status, req->actual, req->length);
+
+	u_audio_set_fback(prm, req);
+
+	if (usb_ep_queue(ep, req, GFP_ATOMIC))
+		dev_err(prm->uac->card->dev, "%d Error!\n", __LINE__);
+}
+
 static int uac_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 {
 	struct snd_uac_chip *uac = snd_pcm_substream_chip(substream);
@@ -365,6 +414,61 @@ static const struct snd_pcm_ops uac_pcm_ops = {
 	.prepare = uac_pcm_null,
 };
 
+static int u_audio_pitch_info(struct snd_kcontrol *kcontrol,
+			      struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = 1;
+	uinfo->value.integer.min = UAC_FBACK_PITCH_UNITY -
+				   UAC_FBACK_PITCH_RANGE;
+	uinfo->value.integer.max = UAC_FBACK_PITCH_UNITY +
+				   UAC_FBACK_PITCH_RANGE;
+	uinfo->value.integer.step = 1;
+
+	return 0;
+}
+
+static int u_audio_pitch_get(struct snd_kcontrol *kcontrol,
+			     struct snd_ctl_elem_value *ucontrol)
+{
+	struct uac_rtd_params *prm = snd_kcontrol_chip(kcontrol);
+
+	ucontrol->value.integer.value[0] = READ_ONCE(prm->pitch);
+
+	return 0;
+}
+
+static int u_audio_pitch_put(struct snd_kcontrol *kcontrol,
+			     struct snd_ctl_elem_value *ucontrol)
+{
+	struct uac_rtd_params *prm = snd_kcontrol_chip(kcontrol);
+	long val = ucontrol->value.integer.value[0];
+
+	if (val < UAC_FBACK_PITCH_UNITY - UAC_FBACK_PITCH_RANGE ||
+	    val > UAC_FBACK_PITCH_UNITY + UAC_FBACK_PITCH_RANGE)
+		return -EINVAL;
+
+	if (val == READ_ONCE(prm->pitch))
+		return 0;
+
+	/* Picked up by the next feedback packet */
+	WRITE_ONCE(prm->pitch, val);
+
+	return 1;
+}
+
+/*
+ * Whatever drains the capture stream at the rate of the real sink adjusts
+ * this, e.g. from the fill level of its buffers; the host then follows.
+ */
+static const struct snd_kcontrol_new u_audio_pitch_ctl = {
+	.iface = SNDRV_CTL_ELEM_IFACE_PCM,
+	.name = "Capture Pitch 1000000",
+	.info = u_audio_pitch_info,
+	.get = u_audio_pitch_get,
+	.put = u_audio_pitch_put,
+};
+
 static inline void free_ep(struct uac_rtd_params *prm, struct usb_ep *ep)
 {
 	struct snd_uac_chip *uac = prm->uac;
@@ -432,6 +536,33 @@ int u_audio_start_capture(struct g_audio *audio_dev)
 			dev_err(dev, "%s:%d Error!\n", __func__, __LINE__);
 	}
 
+	ep = audio_dev->in_ep_fback;
+	if (!ep || prm->req_fback)
+		return 0;
+
+	config_ep_by_speed(gadget, &audio_dev->func, ep);
+	usb_ep_enable(ep);
+
+	req = usb_ep_alloc_request(ep, GFP_ATOMIC);
+	if (req == NULL)
+		return -ENOMEM;
+
+	req->buf = kzalloc(sizeof(u32), GFP_ATOMIC);
+	if (!req->buf) {
+		usb_ep_free_request(ep, req);
+		return -ENOMEM;
+	}
+
+	prm->req_fback = req;
+
+	req->zero = 0;
+	req->context = prm;
+	req->complete = u_audio_iso_fback_complete;
+	u_audio_set_fback(prm, req);
+
+	if (usb_ep_queue(ep, req, GFP_ATOMIC))
+		dev_err(dev, "%s:%d Error!\n", __func__, __LINE__);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(u_audio_start_capture);
@@ -439,8 +570,22 @@ EXPORT_SYMBOL_GPL(u_audio_start_capture);
 void u_audio_stop_capture(struct g_audio *audio_dev)
 {
 	struct snd_uac_chip *uac = audio_dev->uac;
+	struct uac_rtd_params *prm = &uac->c_prm;
+	struct usb_ep *ep = audio_dev->in_ep_fback;
 
-	free_ep(&uac->c_prm, audio_dev->out_ep);
+	/* Clears ep_enabled, so the feedback request is not queued again */
+	free_ep(prm, audio_dev->out_ep);
+
+	if (!prm->req_fback)
+		return;
+
+	usb_ep_dequeue(ep, prm->req_fback);
+	kfree(prm->req_fback->buf);
+	usb_ep_free_request(ep, prm->req_fback);
+	prm->req_fback = NULL;
+
+	if (usb_ep_disable(ep))
+		dev_err(uac->card->dev, "%s:%d Error!\n", __func__, __LINE__);
 }
 EXPORT_SYMBOL_GPL(u_audio_stop_capture);
 
@@ -548,6 +693,7 @@ int g_audio_setup(struct g_audio *g_audio, const char *pcm_name,
 
 		uac->c_prm.uac = uac;
 		prm->max_psize = g_audio->out_ep_maxpsize;
+		prm->pitch = UAC_FBACK_PITCH_UNITY;
 
 		prm->ureq = kcalloc(params->req_number, sizeof(struct uac_req),
 				GFP_KERNEL);
@@ -618,6 +764,13 @@ int g_audio_setup(struct g_audio *g_audio, const char *pcm_name,
 	snd_pcm_lib_preallocate_pages_for_all(pcm, SNDRV_DMA_TYPE_CONTINUOUS,
 		snd_dma_continuous_data(GFP_KERNEL), 0, BUFF_SIZE_MAX);
 
+	if (c_chmask && g_audio->in_ep_fback) {
+		err = snd_ctl_add(card, snd_ctl_new1(&u_audio_pitch_ctl,
+						     &uac->c_prm));
+		if (err < 0)
+			goto snd_fail;
+	}
+
 	err = snd_card_register(card);
 
 	if (!err)
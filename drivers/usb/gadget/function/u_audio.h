@@ -21,6 +21,13 @@
 
 #include <linux/usb/composite.h>
 
+/*
+ * Capture pitch reported on the feedback endpoint, in parts per million of
+ * the nominal capture rate, and how far it may move away from it
+ */
+#define UAC_FBACK_PITCH_UNITY	1000000
+#define UAC_FBACK_PITCH_RANGE	5000
+
 struct uac_params {
 	/* playback */
 	int p_chmask;	/* channel mask */
@@ -41,6 +48,8 @@ struct g_audio {
 
 	struct usb_ep *in_ep;
 	struct usb_ep *out_ep;
+	/* Feedback endpoint of out_ep, NULL if capture is adaptive */
+	struct usb_ep *in_ep_fback;
 
 	/* Max packet size for all in_ep possible speeds */
 	unsigned int in_ep_maxpsize;
@@ -53,6 +53,13 @@
  * blocks and still have efficient handling. */
 #define GETHER_MAX_ETH_FRAME_LEN 15412
 
+/* The link is at most a few MB/s, and so a thousand packets queued in front
+ * of it as on real ethernet are most of a second of latency, and a lot of
+ * memory on small devices.  Together with byte queue limits on the USB
+ * requests this leaves the queueing to the qdisc (fq_codel if configured).
+ */
+#define GETHER_TX_QUEUE_LEN	100
+
 struct eth_dev {
 	/* lock is held while accessing port_usb
 	 */
@@ -67,6 +74,7 @@ struct eth_dev {
 	atomic_t		tx_qlen;
 
 	struct sk_buff_head	rx_frames;
+	struct page_frag_cache	rx_frag;	/* guarded by req_lock */
 
 	unsigned		qmult;
 
@@ -93,6 +101,9 @@ struct eth_dev {
 
 #define DEFAULT_QLEN	2	/* double buffering by default */
 
+/* headroom of RX buffers taken from the page fragment pool */
+#define RX_FRAG_HEADROOM	(NET_SKB_PAD + NET_IP_ALIGN)
+
 /* for dual-speed hardware, use deeper queues at high/super speed */
 static inline int qlen(struct usb_gadget *gadget, unsigned qmult)
 {
@@ -175,11 +186,58 @@ static void defer_kevent(struct eth_dev *dev, int flag)
 
 static void rx_complete(struct usb_ep *ep, struct usb_request *req);
 
+/*
+ * RX buffers that fit in a page, which covers Ethernet frames at the usual
+ * MTUs but not NCM's fixed size NTBs, are carved out of a per-device pool
+ * of pages instead of being full skbs.  The pages are recycled as soon as
+ * the stack frees the frames built around them; the skb itself is only
+ * built once the buffer holds a frame.  Which kind a request carries
+ * follows from its length, which does not change between rx_submit() and
+ * rx_complete().
+ */
+static unsigned int rx_frag_truesize(unsigned int len)
+{
+	return SKB_DATA_ALIGN(RX_FRAG_HEADROOM + len) +
+		SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+}
+
+static bool rx_is_frag(struct usb_request *req)
+{
+	return rx_frag_truesize(req->length) <= PAGE_SIZE;
+}
+
+static void rx_free_buf(struct usb_request *req)
+{
+	if (rx_is_frag(req))
+		skb_free_frag(req->context);
+	else
+		dev_kfree_skb_any(req->context);
+}
+
+static struct sk_buff *rx_frag_build_skb(struct eth_dev *dev,
+					 struct usb_request *req)
+{
+	void		*buf = req->context;
+	struct sk_buff	*skb;
+
+	skb = build_skb(buf, rx_frag_truesize(req->length));
+	if (!skb) {
+		skb_free_frag(buf);
+		return NULL;
+	}
+
+	skb_reserve(skb, req->buf - buf);
+	skb->dev = dev->net;
+
+	return skb;
+}
+
 static int
 rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 {
 	struct usb_gadget *g = dev->gadget;
-	struct sk_buff	*skb;
+	struct sk_buff	*skb = NULL;
+	void		*buf = NULL;
 	int		retval = -ENOMEM;
 	size_t		size = 0;
 	struct usb_ep	*out;
@@ -219,23 +277,42 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	if (dev->port_usb->is_fixed)
 		size = max_t(size_t, size, dev->port_usb->fixed_out_len);
 
-	skb = __netdev_alloc_skb(dev->net, size + NET_IP_ALIGN, gfp_flags);
-	if (skb == NULL) {
-		DBG(dev, "no rx skb\n");
-		goto enomem;
-	}
-
-	/* Some platforms perform better when IP packets are aligned,
-	 * but on at least one, checksumming fails otherwise.  Note:
-	 * RNDIS headers involve variable numbers of LE32 values.
-	 */
-	if (likely(!dev->no_skb_reserve))
-		skb_reserve(skb, NET_IP_ALIGN);
-
-	req->buf = skb->data;
 	req->length = size;
 	req->complete = rx_complete;
-	req->context = skb;
+
+	if (rx_is_frag(req)) {
+		spin_lock_irqsave(&dev->req_lock, flags);
+		buf = page_frag_alloc(&dev->rx_frag, rx_frag_truesize(size),
+				      GFP_ATOMIC);
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		if (buf == NULL) {
+			DBG(dev, "no rx buffer\n");
+			goto enomem;
+		}
+
+		req->buf = buf + NET_SKB_PAD;
+		if (likely(!dev->no_skb_reserve))
+			req->buf += NET_IP_ALIGN;
+		req->context = buf;
+	} else {
+		skb = __netdev_alloc_skb(dev->net, size + NET_IP_ALIGN,
+					 gfp_flags);
+		if (skb == NULL) {
+			DBG(dev, "no rx skb\n");
+			goto enomem;
+		}
+
+		/* Some platforms perform better when IP packets are
+		 * aligned, but on at least one, checksumming fails
+		 * otherwise.  Note: RNDIS headers involve variable numbers
+		 * of LE32 values.
+		 */
+		if (likely(!dev->no_skb_reserve))
+			skb_reserve(skb, NET_IP_ALIGN);
+
+		req->buf = skb->data;
+		req->context = skb;
+	}
 
 	retval = usb_ep_queue(out, req, gfp_flags);
 	if (retval == -ENOMEM)
@@ -245,6 +322,8 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 		DBG(dev, "rx submit --> %d\n", retval);
 		if (skb)
 			dev_kfree_skb_any(skb);
+		if (buf)
+			skb_free_frag(buf);
 		spin_lock_irqsave(&dev->req_lock, flags);
 		list_add(&req->list, &dev->rx_reqs);
 		spin_unlock_irqrestore(&dev->req_lock, flags);
@@ -254,7 +333,7 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 
 static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct sk_buff	*skb = req->context, *skb2;
+	struct sk_buff	*skb = NULL, *skb2;
 	struct eth_dev	*dev = ep->driver_data;
 	int		status = req->status;
 
@@ -262,6 +341,15 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 
 	/* normal completion */
 	case 0:
+		if (rx_is_frag(req)) {
+			skb = rx_frag_build_skb(dev, req);
+			if (!skb) {
+				dev->net->stats.rx_dropped++;
+				break;
+			}
+		} else {
+			skb = req->context;
+		}
 		skb_put(skb, req->actual);
 
 		if (dev->unwrap) {
@@ -317,7 +405,7 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 		DBG(dev, "rx %s reset\n", ep->name);
 		defer_kevent(dev, WORK_RX_MEMORY);
 quiesce:
-		dev_kfree_skb_any(skb);
+		rx_free_buf(req);
 		goto clean;
 
 	/* data overrun */
@@ -328,11 +416,10 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 	default:
 		dev->net->stats.rx_errors++;
 		DBG(dev, "rx status %d\n", status);
+		rx_free_buf(req);
 		break;
 	}
 
-	if (skb)
-		dev_kfree_skb_any(skb);
 	if (!netif_running(dev->net)) {
 clean:
 		spin_lock(&dev->req_lock);
@@ -441,6 +528,7 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct sk_buff	*skb = req->context;
 	struct eth_dev	*dev = ep->driver_data;
+	unsigned int	bytes = skb->len;
 
 	switch (req->status) {
 	default:
@@ -462,6 +550,7 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	spin_unlock(&dev->req_lock);
 
 	atomic_dec(&dev->tx_qlen);
+	netdev_completed_queue(dev->net, 1, bytes);
 	if (netif_carrier_ok(dev->net))
 		netif_wake_queue(dev->net);
 }
@@ -583,10 +672,13 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 
 	req->length = length;
 
+	/* account before queueing, the request may complete right away */
+	netdev_sent_queue(net, skb->len);
 	retval = usb_ep_queue(in, req, GFP_ATOMIC);
 	switch (retval) {
 	default:
 		DBG(dev, "tx queue err %d\n", retval);
+		netdev_completed_queue(net, 1, skb->len);
 		break;
 	case 0:
 		netif_trans_update(net);
@@ -618,6 +710,7 @@ static void eth_start(struct eth_dev *dev, gfp_t gfp_flags)
 
 	/* and open the tx floodgates */
 	atomic_set(&dev->tx_qlen, 0);
+	netdev_reset_queue(dev->net);
 	netif_wake_queue(dev->net);
 }
 
@@ -785,6 +878,7 @@ struct eth_dev *gether_setup_name(struct usb_gadget *g,
 	net->netdev_ops = &eth_netdev_ops;
 
 	net->ethtool_ops = &ops;
+	net->tx_queue_len = GETHER_TX_QUEUE_LEN;
 
 	/* MTU range: 14 - 15412 */
 	net->min_mtu = ETH_HLEN;
@@ -846,6 +940,7 @@ struct net_device *gether_setup_name_default(const char *netname)
 	net->netdev_ops = &eth_netdev_ops;
 
 	net->ethtool_ops = &ops;
+	net->tx_queue_len = GETHER_TX_QUEUE_LEN;
 	SET_NETDEV_DEVTYPE(net, &gadget_type);
 
 	return net;
@@ -1023,6 +1118,9 @@ void gether_cleanup(struct eth_dev *dev)
 
 	unregister_netdev(dev->net);
 	flush_work(&dev->work);
+	if (dev->rx_frag.va)
+		__page_frag_cache_drain(virt_to_head_page(dev->rx_frag.va),
+					dev->rx_frag.pagecnt_bias);
 	free_netdev(dev->net);
 }
 EXPORT_SYMBOL_GPL(gether_cleanup);
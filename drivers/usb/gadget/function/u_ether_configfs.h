@@ -118,21 +118,17 @@
 		u8 val;							\
 		int ret;						\
 									\
-		mutex_lock(&opts->lock);				\
-		if (opts->refcnt) {					\
-			ret = -EBUSY;					\
-			goto out;					\
-		}							\
-									\
 		ret = kstrtou8(page, 0, &val);				\
 		if (ret)						\
-			goto out;					\
+			return ret;					\
+		if (!val)						\
+			return -EINVAL;					\
 									\
+		/* used from the next time the link comes up */	\
+		mutex_lock(&opts->lock);				\
 		gether_set_qmult(opts->net, val);			\
-		ret = len;						\
-out:									\
 		mutex_unlock(&opts->lock);				\
-		return ret;						\
+		return len;						\
 	}								\
 									\
 	CONFIGFS_ATTR(_f_##_opts_, qmult)
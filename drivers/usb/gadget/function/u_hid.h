@@ -24,6 +24,10 @@ struct f_hid_opts {
 	unsigned char			subclass;
 	unsigned char			protocol;
 	unsigned short			report_length;
+	/* polling interval in ms, 0 for the defaults */
+	unsigned char			interval;
+	/* IN reports queued at once, 0 for 1 */
+	unsigned char			in_qlen;
 	unsigned short			report_desc_length;
 	unsigned char			*report_desc;
 	bool				report_desc_alloc;
@@ -27,6 +27,8 @@ struct f_midi_opts {
 	unsigned int			out_ports;
 	unsigned int			buflen;
 	unsigned int			qlen;
+	unsigned int			in_qlen;
+	unsigned int			low_latency;
 
 	/*
 	 * Protect the data form concurrent access by read/write
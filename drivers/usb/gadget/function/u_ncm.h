@@ -18,11 +18,29 @@
 
 #include <linux/usb/composite.h>
 
+/*
+ * NTB transmit statistics; the flush counters say why each NTB was closed:
+ * no room left for the next datagram, out of datagram pointer entries, or
+ * the coalescing timer expired.
+ */
+struct f_ncm_tx_stats {
+	unsigned long			ntbs;
+	unsigned long			datagrams;
+	unsigned long			bytes;
+	unsigned long			flush_full;
+	unsigned long			flush_dpe;
+	unsigned long			flush_timer;
+};
+
 struct f_ncm_opts {
 	struct usb_function_instance	func_inst;
 	struct net_device		*net;
 	bool				bound;
 
+	/* how long a partly filled NTB may wait for more datagrams */
+	unsigned int			tx_coalesce_usecs;
+	struct f_ncm_tx_stats		tx_stats;
+
 	/*
 	 * Read/write access to configfs attributes is handled by configfs.
 	 *
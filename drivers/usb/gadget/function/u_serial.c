@@ -29,6 +29,8 @@
 #include <linux/module.h>
 #include <linux/console.h>
 #include <linux/kthread.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "u_serial.h"
 
@@ -75,11 +77,14 @@
  *	tty_struct->driver_data ... gserial
  */
 
-/* RX and TX queues can buffer QUEUE_SIZE packets before they hit the
- * next layer of buffering.  For TX that's a circular buffer; for RX
- * consider it a NOP.  A third layer is provided by the TTY code.
+/* RX and TX queues can buffer queue_size requests of up to req_packets
+ * packets each before they hit the next layer of buffering.  For TX
+ * that's a circular buffer; for RX consider it a NOP.  A third layer is
+ * provided by the TTY code.  Both are sampled when the I/O starts.
  */
 #define QUEUE_SIZE		16
+#define QUEUE_SIZE_MAX		64
+#define REQ_PACKETS_MAX		16
 #define WRITE_BUF_SIZE		8192		/* TX only */
 #define GS_CONSOLE_BUF_SIZE	8192
 
@@ -132,6 +137,19 @@ struct gs_port {
 
 	/* REVISIT this state ... */
 	struct usb_cdc_line_coding port_line_coding;	/* 8-N-1 etc */
+
+	/* I/O geometry, fixed while connected */
+	unsigned		queue_size;
+	unsigned		req_packets;
+
+	/* statistics, guarded by port_lock */
+	u64			rx_bytes;
+	u64			tx_bytes;
+	unsigned long		rx_reqs;
+	unsigned long		tx_reqs;
+	unsigned long		rx_throttled;
+
+	struct dentry		*debugfs;
 };
 
 static struct portmaster {
@@ -139,6 +157,17 @@ static struct portmaster {
 	struct gs_port	*port;
 } ports[MAX_U_SERIAL_PORTS];
 
+static unsigned queue_size = QUEUE_SIZE;
+module_param(queue_size, uint, 0644);
+MODULE_PARM_DESC(queue_size, "USB requests per direction and port (1-64)");
+
+static unsigned req_packets = 1;
+module_param(req_packets, uint, 0644);
+MODULE_PARM_DESC(req_packets,
+		 "max packets per USB request, for bulk throughput (1-16)");
+
+static struct dentry *gs_debugfs_root;
+
 #define GS_CLOSE_TIMEOUT		15		/* seconds */
 
 
@@ -388,11 +417,12 @@ __acquires(&port->port_lock)
 		struct usb_request	*req;
 		int			len;
 
-		if (port->write_started >= QUEUE_SIZE)
+		if (port->write_started >= port->queue_size)
 			break;
 
 		req = list_entry(pool->next, struct usb_request, list);
-		len = gs_send_packet(port, req->buf, in->maxpacket);
+		len = gs_send_packet(port, req->buf,
+				     in->maxpacket * port->req_packets);
 		if (len == 0) {
 			wake_up_interruptible(&port->drain_wait);
 			break;
@@ -461,12 +491,12 @@ __acquires(&port->port_lock)
 		if (!tty)
 			break;
 
-		if (port->read_started >= QUEUE_SIZE)
+		if (port->read_started >= port->queue_size)
 			break;
 
 		req = list_entry(pool->next, struct usb_request, list);
 		list_del(&req->list);
-		req->length = out->maxpacket;
+		req->length = out->maxpacket * port->req_packets;
 
 		/* drop lock while we call out; the controller driver
 		 * may need to call us back (e.g. for disconnect)
@@ -497,8 +527,9 @@ __acquires(&port->port_lock)
  *
  * If the RX queue becomes full enough that no usb_request is queued,
  * the OUT endpoint may begin NAKing as soon as its FIFO fills up.
- * So QUEUE_SIZE packets plus however many the FIFO holds (usually two)
- * can be buffered before the TTY layer's buffers (currently 64 KB).
+ * So queue_size requests plus however many packets the FIFO holds
+ * (usually two) can be buffered before the TTY layer's buffers (currently
+ * 64 KB).  Everything queued is inserted before a single flip buffer push.
  */
 static void gs_rx_push(unsigned long _port)
 {
@@ -517,8 +548,10 @@ static void gs_rx_push(unsigned long _port)
 		req = list_first_entry(queue, struct usb_request, list);
 
 		/* leave data queued if tty was rx throttled */
-		if (tty && tty_throttled(tty))
+		if (tty && tty_throttled(tty)) {
+			port->rx_throttled++;
 			break;
+		}
 
 		switch (req->status) {
 		case -ESHUTDOWN:
@@ -552,6 +585,7 @@ static void gs_rx_push(unsigned long _port)
 
 			count = tty_insert_flip_string(&port->port, packet,
 					size);
+			port->rx_bytes += count;
 			if (count)
 				do_push = true;
 			if (count != size) {
@@ -566,6 +600,7 @@ static void gs_rx_push(unsigned long _port)
 
 		list_move(&req->list, &port->read_pool);
 		port->read_started--;
+		port->rx_reqs++;
 	}
 
 	/* Push from tty to ldisc; this is handled by a workqueue,
@@ -627,6 +662,8 @@ static void gs_write_complete(struct usb_ep *ep, struct usb_request *req)
 		/* FALL THROUGH */
 	case 0:
 		/* normal completion */
+		port->tx_bytes += req->actual;
+		port->tx_reqs++;
 		gs_start_tx(port);
 		break;
 
@@ -653,20 +690,22 @@ static void gs_free_requests(struct usb_ep *ep, struct list_head *head,
 	}
 }
 
-static int gs_alloc_requests(struct usb_ep *ep, struct list_head *head,
+static int gs_alloc_requests(struct gs_port *port, struct usb_ep *ep,
+		struct list_head *head,
 		void (*fn)(struct usb_ep *, struct usb_request *),
 		int *allocated)
 {
 	int			i;
 	struct usb_request	*req;
-	int n = allocated ? QUEUE_SIZE - *allocated : QUEUE_SIZE;
+	int n = port->queue_size - *allocated;
 
-	/* Pre-allocate up to QUEUE_SIZE transfers, but if we can't
+	/* Pre-allocate up to queue_size transfers, but if we can't
 	 * do quite that many this time, don't fail ... we just won't
 	 * be as speedy as we might otherwise be.
 	 */
 	for (i = 0; i < n; i++) {
-		req = gs_alloc_req(ep, ep->maxpacket, GFP_ATOMIC);
+		req = gs_alloc_req(ep, ep->maxpacket * port->req_packets,
+				   GFP_ATOMIC);
 		if (!req)
 			return list_empty(head) ? -ENOMEM : 0;
 		req->complete = fn;
@@ -699,13 +738,21 @@ static int gs_start_io(struct gs_port *port)
 	 * configurations may use different endpoints with a given port;
 	 * and high speed vs full speed changes packet sizes too.
 	 */
-	status = gs_alloc_requests(ep, head, gs_read_complete,
+	if (!port->read_allocated && !port->write_allocated) {
+		port->queue_size = clamp_t(unsigned, queue_size, 1,
+					   QUEUE_SIZE_MAX);
+		port->req_packets = clamp_t(unsigned, req_packets, 1,
+					    REQ_PACKETS_MAX);
+	}
+
+	status = gs_alloc_requests(port, ep, head, gs_read_complete,
 		&port->read_allocated);
 	if (status)
 		return status;
 
-	status = gs_alloc_requests(port->port_usb->in, &port->write_pool,
-			gs_write_complete, &port->write_allocated);
+	status = gs_alloc_requests(port, port->port_usb->in,
+			&port->write_pool, gs_write_complete,
+			&port->write_allocated);
 	if (status) {
 		gs_free_requests(ep, head, &port->read_allocated);
 		return status;
@@ -1282,6 +1329,35 @@ static void gserial_console_exit(void)
 
 #endif
 
+static int gs_stats_show(struct seq_file *s, void *unused)
+{
+	struct gs_port	*port = s->private;
+
+	spin_lock_irq(&port->port_lock);
+	seq_printf(s, "queue_size: %u\n", port->queue_size);
+	seq_printf(s, "req_packets: %u\n", port->req_packets);
+	seq_printf(s, "rx_bytes: %llu\n", port->rx_bytes);
+	seq_printf(s, "rx_reqs: %lu\n", port->rx_reqs);
+	seq_printf(s, "rx_throttled: %lu\n", port->rx_throttled);
+	seq_printf(s, "tx_bytes: %llu\n", port->tx_bytes);
+	seq_printf(s, "tx_reqs: %lu\n", port->tx_reqs);
+	spin_unlock_irq(&port->port_lock);
+
+	return 0;
+}
+
+static int gs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, gs_stats_show, inode->i_private);
+}
+
+static const struct file_operations gs_stats_fops = {
+	.open		= gs_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int
 gs_port_alloc(unsigned port_num, struct usb_cdc_line_coding *coding)
 {
@@ -1314,6 +1390,15 @@ gs_port_alloc(unsigned port_num, struct usb_cdc_line_coding *coding)
 	port->port_num = port_num;
 	port->port_line_coding = *coding;
 
+	if (gs_debugfs_root) {
+		char name[16];
+
+		snprintf(name, sizeof(name), "ttyGS%u", port_num);
+		port->debugfs = debugfs_create_file(name, 0444,
+						    gs_debugfs_root, port,
+						    &gs_stats_fops);
+	}
+
 	ports[port_num].port = port;
 out:
 	mutex_unlock(&ports[port_num].lock);
@@ -1332,6 +1417,7 @@ static int gs_closed(struct gs_port *port)
 
 static void gserial_free_port(struct gs_port *port)
 {
+	debugfs_remove(port->debugfs);
 	tasklet_kill(&port->push);
 	/* wait for old opens to finish */
 	wait_event(port->close_wait, gs_closed(port));
@@ -1587,6 +1673,11 @@ static int userial_init(void)
 			MAX_U_SERIAL_PORTS,
 			(MAX_U_SERIAL_PORTS == 1) ? "" : "s");
 
+	/* per-port statistics; not having them is no reason to fail */
+	gs_debugfs_root = debugfs_create_dir("u_serial", NULL);
+	if (IS_ERR(gs_debugfs_root))
+		gs_debugfs_root = NULL;
+
 	return status;
 fail:
 	put_tty_driver(gs_tty_driver);
@@ -1597,6 +1688,7 @@ module_init(userial_init);
 
 static void userial_cleanup(void)
 {
+	debugfs_remove_recursive(gs_debugfs_root);
 	tty_unregister_driver(gs_tty_driver);
 	put_tty_driver(gs_tty_driver);
 	gs_tty_driver = NULL;
@@ -117,6 +117,8 @@ struct uvc_video {
 	unsigned int req_size;
 	struct usb_request *req[UVC_NUM_REQUESTS];
 	__u8 *req_buffer[UVC_NUM_REQUESTS];
+	struct scatterlist *req_sg[UVC_NUM_REQUESTS];
+	unsigned int req_sgs;
 	struct list_head req_free;
 	spinlock_t req_lock;
 
@@ -6,6 +6,7 @@
 
 #include <linux/kernel.h>
 #include <linux/poll.h>
+#include <linux/scatterlist.h>
 #include <linux/videodev2.h>
 #include <media/videobuf2-v4l2.h>
 
@@ -34,6 +35,11 @@ struct uvc_buffer {
 	void *mem;
 	unsigned int length;
 	unsigned int bytesused;
+
+	/* With use_sg, the pages and the position reached in them */
+	struct sg_table *sgt;
+	struct scatterlist *sg;
+	unsigned int sg_offset;
 };
 
 #define UVC_QUEUE_DISCONNECTED		(1 << 0)
@@ -48,6 +54,9 @@ struct uvc_video_queue {
 
 	unsigned int buf_used;
 
+	/* Requests point to the buffer pages instead of copies of the data */
+	bool use_sg;
+
 	spinlock_t irqlock;	/* Protects flags and irqqueue */
 	struct list_head irqqueue;
 };
@@ -57,8 +66,8 @@ static inline int uvc_queue_streaming(struct uvc_video_queue *queue)
 	return vb2_is_streaming(&queue->queue);
 }
 
-int uvcg_queue_init(struct uvc_video_queue *queue, enum v4l2_buf_type type,
-		    struct mutex *lock);
+int uvcg_queue_init(struct uvc_video_queue *queue, struct device *dev,
+		    enum v4l2_buf_type type, struct mutex *lock);
 
 void uvcg_free_buffers(struct uvc_video_queue *queue);
 
@@ -29,7 +29,7 @@
 
 static int
 uvc_video_encode_header(struct uvc_video *video, struct uvc_buffer *buf,
-		u8 *data, int len)
+		struct usb_request *req, u8 *data, int len)
 {
 	data[0] = 2;
 	data[1] = UVC_STREAM_EOH | video->fid;
@@ -37,27 +37,78 @@ uvc_video_encode_header(struct uvc_video *video, struct uvc_buffer *buf,
 	if (buf->bytesused - video->queue.buf_used <= len - 2)
 		data[1] |= UVC_STREAM_EOF;
 
+	/* The header is the only part of the request kept in req->buf. */
+	if (video->queue.use_sg)
+		sg_set_buf(&req->sg[req->num_sgs++], data, 2);
+
 	return 2;
 }
 
+/*
+ * Point the request to the next nbytes of the buffer pages, continuing from
+ * where the previous request stopped.
+ */
+static unsigned int
+uvc_video_encode_sg(struct uvc_video *video, struct uvc_buffer *buf,
+		struct usb_request *req, unsigned int nbytes)
+{
+	struct scatterlist *sg = &req->sg[req->num_sgs];
+	unsigned int done = 0, part;
+
+	while (done < nbytes && buf->sg &&
+	       req->num_sgs < video->req_sgs) {
+		part = min(nbytes - done, buf->sg->length - buf->sg_offset);
+		sg_set_page(sg++, sg_page(buf->sg), part,
+			    buf->sg->offset + buf->sg_offset);
+		req->num_sgs++;
+		done += part;
+
+		buf->sg_offset += part;
+		if (buf->sg_offset == buf->sg->length) {
+			buf->sg = sg_next(buf->sg);
+			buf->sg_offset = 0;
+		}
+	}
+
+	if (req->num_sgs)
+		sg_mark_end(&req->sg[req->num_sgs - 1]);
+
+	return done;
+}
+
 static int
 uvc_video_encode_data(struct uvc_video *video, struct uvc_buffer *buf,
-		u8 *data, int len)
+		struct usb_request *req, u8 *data, int len)
 {
 	struct uvc_video_queue *queue = &video->queue;
 	unsigned int nbytes;
 	void *mem;
 
-	/* Copy video data to the USB buffer. */
-	mem = buf->mem + queue->buf_used;
 	nbytes = min((unsigned int)len, buf->bytesused - queue->buf_used);
 
-	memcpy(data, mem, nbytes);
+	if (queue->use_sg) {
+		nbytes = uvc_video_encode_sg(video, buf, req, nbytes);
+	} else {
+		/* Copy video data to the USB buffer. */
+		mem = buf->mem + queue->buf_used;
+		memcpy(data, mem, nbytes);
+	}
 	queue->buf_used += nbytes;
 
 	return nbytes;
 }
 
+/* Start filling a request, see uvc_video_encode_header() */
+static void
+uvc_video_encode_start(struct uvc_video *video, struct usb_request *req)
+{
+	if (!video->queue.use_sg)
+		return;
+
+	sg_init_table(req->sg, video->req_sgs);
+	req->num_sgs = 0;
+}
+
 static void
 uvc_video_encode_bulk(struct usb_request *req, struct uvc_video *video,
 		struct uvc_buffer *buf)
@@ -66,9 +117,11 @@ uvc_video_encode_bulk(struct usb_request *req, struct uvc_video *video,
 	int len = video->req_size;
 	int ret;
 
+	uvc_video_encode_start(video, req);
+
 	/* Add a header at the beginning of the payload. */
 	if (video->payload_size == 0) {
-		ret = uvc_video_encode_header(video, buf, mem, len);
+		ret = uvc_video_encode_header(video, buf, req, mem, len);
 		video->payload_size += ret;
 		mem += ret;
 		len -= ret;
@@ -76,7 +129,7 @@ uvc_video_encode_bulk(struct usb_request *req, struct uvc_video *video,
 
 	/* Process video data. */
 	len = min((int)(video->max_payload_size - video->payload_size), len);
-	ret = uvc_video_encode_data(video, buf, mem, len);
+	ret = uvc_video_encode_data(video, buf, req, mem, len);
 
 	video->payload_size += ret;
 	len -= ret;
@@ -106,13 +159,15 @@ uvc_video_encode_isoc(struct usb_request *req, struct uvc_video *video,
 	int len = video->req_size;
 	int ret;
 
+	uvc_video_encode_start(video, req);
+
 	/* Add the header. */
-	ret = uvc_video_encode_header(video, buf, mem, len);
+	ret = uvc_video_encode_header(video, buf, req, mem, len);
 	mem += ret;
 	len -= ret;
 
 	/* Process video data. */
-	ret = uvc_video_encode_data(video, buf, mem, len);
+	ret = uvc_video_encode_data(video, buf, req, mem, len);
 	len -= ret;
 
 	req->length = video->req_size - len;
@@ -225,6 +280,9 @@ uvc_video_free_requests(struct uvc_video *video)
 			kfree(video->req_buffer[i]);
 			video->req_buffer[i] = NULL;
 		}
+
+		kfree(video->req_sg[i]);
+		video->req_sg[i] = NULL;
 	}
 
 	INIT_LIST_HEAD(&video->req_free);
@@ -245,16 +303,28 @@ uvc_video_alloc_requests(struct uvc_video *video)
 		 * max_t(unsigned int, video->ep->maxburst, 1)
 		 * (video->ep->mult);
 
+	/* the header, then the pages the data can straddle */
+	video->req_sgs = DIV_ROUND_UP(req_size, PAGE_SIZE) + 2;
+
 	for (i = 0; i < UVC_NUM_REQUESTS; ++i) {
 		video->req_buffer[i] = kmalloc(req_size, GFP_KERNEL);
 		if (video->req_buffer[i] == NULL)
 			goto error;
 
+		if (video->queue.use_sg) {
+			video->req_sg[i] = kmalloc_array(video->req_sgs,
+						sizeof(*video->req_sg[i]),
+						GFP_KERNEL);
+			if (video->req_sg[i] == NULL)
+				goto error;
+		}
+
 		video->req[i] = usb_ep_alloc_request(video->ep, GFP_KERNEL);
 		if (video->req[i] == NULL)
 			goto error;
 
 		video->req[i]->buf = video->req_buffer[i];
+		video->req[i]->sg = video->req_sg[i];
 		video->req[i]->length = 0;
 		video->req[i]->complete = uvc_video_complete;
 		video->req[i]->context = video;
@@ -379,7 +449,7 @@ int uvcg_video_enable(struct uvc_video *video, int enable)
 /*
  * Initialize the UVC video stream.
  */
-int uvcg_video_init(struct uvc_video *video)
+int uvcg_video_init(struct uvc_video *video, struct usb_gadget *gadget)
 {
 	INIT_LIST_HEAD(&video->req_free);
 	spin_lock_init(&video->req_lock);
@@ -391,8 +461,9 @@ int uvcg_video_init(struct uvc_video *video)
 	video->imagesize = 320 * 240 * 2;
 
 	/* Initialize the video buffers queue. */
-	uvcg_queue_init(&video->queue, V4L2_BUF_TYPE_VIDEO_OUTPUT,
-			&video->mutex);
+	uvcg_queue_init(&video->queue,
+			gadget->sg_supported ? gadget->dev.parent : NULL,
+			V4L2_BUF_TYPE_VIDEO_OUTPUT, &video->mutex);
 	return 0;
 }
 
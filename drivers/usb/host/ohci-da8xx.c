@@ -553,6 +553,7 @@ static struct platform_driver ohci_hcd_da8xx_driver = {
 	.driver		= {
 		.name	= DRV_NAME,
 		.of_match_table = of_match_ptr(da8xx_ohci_ids),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 };
 
@@ -32,6 +32,7 @@
 #include <linux/init.h>
 #include <linux/timer.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 #include <linux/usb.h>
 #include <linux/usb/otg.h>
 #include <linux/usb/hcd.h>
@@ -82,6 +83,13 @@ static void ohci_dump(struct ohci_hcd *ohci);
 static void ohci_stop(struct usb_hcd *hcd);
 static void io_watchdog_func(unsigned long _ohci);
 
+/* HID devices like gamepads care more about latency than bus bandwidth */
+static unsigned int intr_lowlat_interval;
+module_param (intr_lowlat_interval, uint, 0644);
+MODULE_PARM_DESC (intr_lowlat_interval,
+	"poll short-interval interrupt endpoints at least every N frames, "
+	"without delaying their completion IRQs (0 = off)");
+
 #include "ohci-hub.c"
 #include "ohci-dbg.c"
 #include "ohci-mem.c"
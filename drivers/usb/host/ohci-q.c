@@ -393,6 +393,21 @@ static void ed_deschedule (struct ohci_hcd *ohci, struct ed *ed)
 
 /*-------------------------------------------------------------------------*/
 
+/* low latency mode for short-interval interrupt endpoints like HID
+ * gamepads: poll them more often and never delay their completions.
+ * Hubs and other slow status endpoints are left alone.
+ */
+static int ed_lowlat_interval(struct ed *ed, int interval)
+{
+	unsigned	max = min(intr_lowlat_interval, 32U);
+
+	if (!max || interval > 16)
+		return interval;
+
+	ed->low_latency = 1;
+	return min(interval, (int) rounddown_pow_of_two(max));
+}
+
 /* get and maybe (re)init an endpoint. init _should_ be done only as part
  * of enumeration, usb_set_configuration() or usb_set_interface().
  */
@@ -454,6 +469,9 @@ static struct ed *ed_get (
 					info |= ED_ISO;
 				else if (interval > 32)	/* iso can be bigger */
 					interval = 32;
+				if (ed->type == PIPE_INTERRUPT)
+					interval = ed_lowlat_interval(ed,
+							interval);
 				ed->interval = interval;
 				ed->load = usb_calc_bus_time (
 					udev->speed, !is_out,
@@ -532,10 +550,12 @@ td_fill (struct ohci_hcd *ohci, u32 info,
 	 *
 	 * NOTE: could delay interrupts even for the last TD, and get fewer
 	 * interrupts ... increasing per-urb latency by sharing interrupts.
-	 * Drivers that queue bulk urbs may request that behavior.
+	 * Drivers that queue bulk urbs may request that behavior, low
+	 * latency interrupt endpoints ignore it.
 	 */
 	if (index != (urb_priv->length - 1)
-			|| (urb->transfer_flags & URB_NO_INTERRUPT))
+			|| ((urb->transfer_flags & URB_NO_INTERRUPT)
+				&& !urb_priv->ed->low_latency))
 		info |= TD_DI_SET (6);
 
 	/* use this td as the next dummy */
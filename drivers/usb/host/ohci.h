@@ -58,6 +58,7 @@ struct ed {
 #define ED_OPER		0x02		/* IS linked to hc */
 
 	u8			type;		/* PIPE_{BULK,...} */
+	u8			low_latency;	/* intr: no IRQ delay */
 
 	/* periodic scheduling params (for intr and iso) */
 	u8			branch;
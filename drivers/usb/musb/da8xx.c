@@ -680,6 +680,7 @@ static struct platform_driver da8xx_driver = {
 		.name	= "musb-da8xx",
 		.pm = &da8xx_pm_ops,
 		.of_match_table = of_match_ptr(da8xx_id_table),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 };
 
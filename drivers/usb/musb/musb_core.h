@@ -342,6 +342,17 @@ struct musb {
 	struct list_head	control;	/* of musb_qh */
 	struct list_head	in_bulk;	/* of musb_qh */
 	struct list_head	out_bulk;	/* of musb_qh */
+
+	/* host side endpoint contention, P: musb->lock:
+	 * bulk qhs given their own ep or sharing bulk_ep, NAK timeouts
+	 * on bulk_ep per direction, periodic qhs that got no ep
+	 */
+	struct {
+		unsigned long	dedicated;
+		unsigned long	muxed;
+		unsigned long	nak_rotations[2];	/* [is_in] */
+		unsigned long	alloc_failed;
+	} bulk_stats;
 	struct list_head	pending_list;	/* pending work list */
 
 	struct timer_list	otg_timer;
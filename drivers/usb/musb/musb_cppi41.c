@@ -9,8 +9,6 @@
 #include "musb_core.h"
 #include "musb_trace.h"
 
-#define RNDIS_REG(x) (0x80 + ((x - 1) * 4))
-
 #define EP_MODE_AUTOREQ_NONE		0
 #define EP_MODE_AUTOREQ_ALL_NEOP	1
 #define EP_MODE_AUTOREQ_ALWAYS		3
@@ -21,6 +19,7 @@
 
 #define USB_CTRL_TX_MODE	0x70
 #define USB_CTRL_RX_MODE	0x74
+#define USB_CTRL_RNDIS		0x80
 #define USB_CTRL_AUTOREQ	0xd0
 #define USB_TDOWN		0xd8
 
@@ -29,6 +28,7 @@
 #define DA8XX_USB_MODE		0x10
 #define DA8XX_USB_AUTOREQ	0x14
 #define DA8XX_USB_TEARDOWN	0x1c
+#define DA8XX_USB_RNDIS		0x50
 
 #define DA8XX_DMA_NUM_CHANNELS 4
 
@@ -44,6 +44,8 @@ struct cppi41_dma_controller {
 
 	u32 tdown_reg;
 	u32 autoreq_reg;
+	u32 rndis_reg;
+	bool rx_gen_rndis;
 
 	void (*set_dma_mode)(struct cppi41_dma_channel *cppi41_channel,
 			     unsigned int mode);
@@ -247,8 +249,13 @@ static void cppi41_dma_callback(void *private_data,
 	trace_musb_cppi41_gb(cppi41_channel);
 	update_rx_toggle(cppi41_channel);
 
+	/*
+	 * A short packet ends the transfer; in generic RNDIS mode it shows up
+	 * as less than the programmed length.
+	 */
 	if (cppi41_channel->transferred == cppi41_channel->total_len ||
-			transferred < cppi41_channel->packet_sz)
+			transferred < cppi41_channel->packet_sz ||
+			transferred < cppi41_channel->prog_len)
 		cppi41_channel->prog_len = 0;
 
 	if (cppi41_channel->is_tx) {
@@ -407,6 +414,15 @@ static void cppi41_set_autoreq_mode(struct cppi41_dma_channel *cppi41_channel,
 		    controller->autoreq_reg, new_mode);
 }
 
+static void cppi41_set_rndis_size(struct cppi41_dma_channel *cppi41_channel,
+		u32 len)
+{
+	struct cppi41_dma_controller *controller = cppi41_channel->controller;
+	u32 reg = controller->rndis_reg + (cppi41_channel->port_num - 1) * 4;
+
+	musb_writel(controller->controller.musb->ctrl_base, reg, len);
+}
+
 static bool cppi41_configure_channel(struct dma_channel *channel,
 				u16 packet_sz, u8 mode,
 				dma_addr_t dma_addr, u32 len)
@@ -416,7 +432,6 @@ static bool cppi41_configure_channel(struct dma_channel *channel,
 	struct dma_chan *dc = cppi41_channel->dc;
 	struct dma_async_tx_descriptor *dma_desc;
 	enum dma_transfer_direction direction;
-	struct musb *musb = cppi41_channel->controller->controller.musb;
 	unsigned use_gen_rndis = 0;
 
 	cppi41_channel->buf_addr = dma_addr;
@@ -426,17 +441,20 @@ static bool cppi41_configure_channel(struct dma_channel *channel,
 	cppi41_channel->tx_zlp = (cppi41_channel->is_tx && mode) ? 1 : 0;
 
 	/*
-	 * Due to AM335x' Advisory 1.0.13 we are not allowed to transfer more
-	 * than max packet size at a time.
+	 * Due to AM335x' Advisory 1.0.13 we are not allowed to receive more
+	 * than max packet size at a time. DA8xx is not affected, so it lets
+	 * the hardware split whole multiples of the packet size on RX as well
+	 * and only interrupts once per transfer or on a short packet.
 	 */
 	if (cppi41_channel->is_tx)
 		use_gen_rndis = 1;
+	else if (controller->rx_gen_rndis && !(len % packet_sz))
+		use_gen_rndis = 1;
 
 	if (use_gen_rndis) {
 		/* RNDIS mode */
 		if (len > packet_sz) {
-			musb_writel(musb->ctrl_base,
-				RNDIS_REG(cppi41_channel->port_num), len);
+			cppi41_set_rndis_size(cppi41_channel, len);
 			/* gen rndis */
 			controller->set_dma_mode(cppi41_channel,
 					EP_MODE_DMA_GEN_RNDIS);
@@ -445,8 +463,7 @@ static bool cppi41_configure_channel(struct dma_channel *channel,
 			cppi41_set_autoreq_mode(cppi41_channel,
 					EP_MODE_AUTOREQ_ALL_NEOP);
 		} else {
-			musb_writel(musb->ctrl_base,
-					RNDIS_REG(cppi41_channel->port_num), 0);
+			cppi41_set_rndis_size(cppi41_channel, 0);
 			controller->set_dma_mode(cppi41_channel,
 					EP_MODE_DMA_TRANSPARENT);
 			cppi41_set_autoreq_mode(cppi41_channel,
@@ -775,11 +792,14 @@ cppi41_dma_controller_create(struct musb *musb, void __iomem *base)
 	if (musb->io.quirks & MUSB_DA8XX) {
 		controller->tdown_reg = DA8XX_USB_TEARDOWN;
 		controller->autoreq_reg = DA8XX_USB_AUTOREQ;
+		controller->rndis_reg = DA8XX_USB_RNDIS;
+		controller->rx_gen_rndis = true;
 		controller->set_dma_mode = da8xx_set_dma_mode;
 		controller->num_channels = DA8XX_DMA_NUM_CHANNELS;
 	} else {
 		controller->tdown_reg = USB_TDOWN;
 		controller->autoreq_reg = USB_CTRL_AUTOREQ;
+		controller->rndis_reg = USB_CTRL_RNDIS;
 		controller->set_dma_mode = cppi41_set_dma_mode;
 		controller->num_channels = MUSB_DMA_NUM_CHANNELS;
 	}
@@ -359,6 +359,43 @@ static const struct file_operations musb_softconnect_fops = {
 	.release		= single_release,
 };
 
+static int musb_bulk_stats_show(struct seq_file *s, void *unused)
+{
+	struct musb		*musb = s->private;
+	struct list_head	*pos;
+	unsigned int		in = 0, out = 0;
+	unsigned long		flags;
+
+	spin_lock_irqsave(&musb->lock, flags);
+	list_for_each(pos, &musb->in_bulk)
+		in++;
+	list_for_each(pos, &musb->out_bulk)
+		out++;
+
+	seq_printf(s, "dedicated:     %lu\n", musb->bulk_stats.dedicated);
+	seq_printf(s, "muxed:         %lu\n", musb->bulk_stats.muxed);
+	seq_printf(s, "shared in:     %u queues, %lu NAK rotations\n",
+		   in, musb->bulk_stats.nak_rotations[1]);
+	seq_printf(s, "shared out:    %u queues, %lu NAK rotations\n",
+		   out, musb->bulk_stats.nak_rotations[0]);
+	seq_printf(s, "alloc failed:  %lu\n", musb->bulk_stats.alloc_failed);
+	spin_unlock_irqrestore(&musb->lock, flags);
+
+	return 0;
+}
+
+static int musb_bulk_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, musb_bulk_stats_show, inode->i_private);
+}
+
+static const struct file_operations musb_bulk_stats_fops = {
+	.open			= musb_bulk_stats_open,
+	.read			= seq_read,
+	.llseek			= seq_lseek,
+	.release		= single_release,
+};
+
 int musb_init_debugfs(struct musb *musb)
 {
 	struct dentry		*root;
@@ -392,6 +429,13 @@ int musb_init_debugfs(struct musb *musb)
 		goto err1;
 	}
 
+	file = debugfs_create_file("bulk_stats", S_IRUGO, root, musb,
+			&musb_bulk_stats_fops);
+	if (!file) {
+		ret = -ENOMEM;
+		goto err1;
+	}
+
 	musb->debugfs_root = root;
 
 	return 0;
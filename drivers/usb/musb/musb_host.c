@@ -95,6 +95,23 @@
  * of transfers between endpoints, or anything clever.
  */
 
+/*
+ * Bulk queues only get an endpoint of their own while at least this many
+ * others stay free in that direction, so that devices with several bulk
+ * pipes (e.g. WLAN adapters) don't leave nothing for their interrupt
+ * endpoints on controllers with few FIFOs.  Beyond that they share
+ * bulk_ep, taking turns whenever the one running NAKs for bulk_nak_ms.
+ */
+static unsigned int bulk_reserve = 1;
+module_param(bulk_reserve, uint, 0644);
+MODULE_PARM_DESC(bulk_reserve,
+		 "endpoints per direction kept free of dedicated bulk queues");
+
+static unsigned int bulk_nak_ms = 2;
+module_param(bulk_nak_ms, uint, 0644);
+MODULE_PARM_DESC(bulk_nak_ms,
+		 "NAK time after which a shared bulk queue yields (ms)");
+
 struct musb *hcd_to_musb(struct usb_hcd *hcd)
 {
 	return *(struct musb **) hcd->hcd_priv;
@@ -953,6 +970,17 @@ static void musb_ep_program(struct musb *musb, u8 epnum,
 	}
 }
 
+/* NAKLIMIT m times bulk transfers out after 2^(m-1) (micro)frames */
+static u8 musb_bulk_nak_limit(enum usb_device_speed speed)
+{
+	unsigned int frames = bulk_nak_ms;
+
+	if (speed == USB_SPEED_HIGH)
+		frames *= 8;
+
+	return clamp_t(unsigned int, ilog2(max(frames, 1U)) + 1, 2, 16);
+}
+
 /* Schedule next QH from musb->in_bulk/out_bulk and move the current qh to
  * the end; avoids starvation for other endpoints.
  */
@@ -1003,6 +1031,7 @@ static void musb_bulk_nak_timeout(struct musb *musb, struct musb_hw_ep *ep,
 			dma->actual_len = 0L;
 		}
 		musb_save_toggle(cur_qh, is_in, urb);
+		musb->bulk_stats.nak_rotations[is_in]++;
 
 		if (is_in) {
 			/* move cur_qh to end of queue */
@@ -2060,6 +2089,7 @@ static int musb_schedule(
 	int			idle = 0;
 	int			best_diff;
 	int			best_end, epnum;
+	unsigned int		nr_free = 0;
 	struct musb_hw_ep	*hw_ep = NULL;
 	struct list_head	*head = NULL;
 	u8			toggle;
@@ -2096,6 +2126,8 @@ static int musb_schedule(
 		if (hw_ep == musb->bulk_ep)
 			continue;
 
+		nr_free++;
+
 		if (is_in)
 			diff = hw_ep->max_packet_sz_rx;
 		else
@@ -2128,6 +2160,10 @@ static int musb_schedule(
 			best_end = epnum;
 		}
 	}
+	/* keep some endpoints for periodic transfers still to come */
+	if (qh->type == USB_ENDPOINT_XFER_BULK && nr_free <= bulk_reserve)
+		best_end = -1;
+
 	/* use bulk reserved ep1 if no other ep is free */
 	if (best_end < 0 && qh->type == USB_ENDPOINT_XFER_BULK) {
 		hw_ep = musb->bulk_ep;
@@ -2140,14 +2176,14 @@ static int musb_schedule(
 		 * multiplexed. This scheme does not work in high speed to full
 		 * speed scenario as NAK interrupts are not coming from a
 		 * full speed device connected to a high speed device.
-		 * NAK timeout interval is 8 (128 uframe or 16ms) for HS and
-		 * 4 (8 frame or 8ms) for FS device.
+		 * NAK timeout interval follows bulk_nak_ms.
 		 */
 		if (qh->dev)
-			qh->intv_reg =
-				(USB_SPEED_HIGH == qh->dev->speed) ? 8 : 4;
+			qh->intv_reg = musb_bulk_nak_limit(qh->dev->speed);
+		musb->bulk_stats.muxed++;
 		goto success;
 	} else if (best_end < 0) {
+		musb->bulk_stats.alloc_failed++;
 		dev_err(musb->controller,
 				"%s hwep alloc failed for %dx%d\n",
 				musb_ep_xfertype_string(qh->type),
@@ -2158,6 +2194,8 @@ static int musb_schedule(
 	idle = 1;
 	qh->mux = 0;
 	hw_ep = musb->endpoints + best_end;
+	if (qh->type == USB_ENDPOINT_XFER_BULK)
+		musb->bulk_stats.dedicated++;
 	musb_dbg(musb, "qh %p periodic slot %d", qh, best_end);
 success:
 	if (head) {
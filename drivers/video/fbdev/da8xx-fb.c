@@ -173,6 +173,12 @@ struct da8xx_fb_par {
 	 * and channel 1.
 	 */
 	unsigned int		which_dma_channel_done;
+	/*
+	 * A pan has written the new frame to channel flip_channel, which
+	 * starts to scan it out once the other channel is done.
+	 */
+	bool			flip_pending;
+	unsigned int		flip_channel;
 #ifdef CONFIG_CPU_FREQ
 	struct notifier_block	freq_transition;
 #endif
@@ -683,6 +689,18 @@ static int fb_setcolreg(unsigned regno, unsigned red, unsigned green,
 		}
 	}
 
+	/*
+	 * Only version 1 takes the bpp of true-color modes from the palette.
+	 * Version 2 has it in the raster control register, so the palette DMA
+	 * and the restart of the frame DMA channels that follows it are
+	 * skipped and data loading is started right away.
+	 */
+	if (update_hw && info->fix.visual == FB_VISUAL_TRUECOLOR &&
+	    lcd_revision == LCD_VERSION_2) {
+		lcd_blit(LOAD_DATA, par);
+		return 0;
+	}
+
 	/* Update the palette in the h/w as needed. */
 	if (update_hw)
 		lcd_blit(LOAD_PALETTE, par);
@@ -829,6 +847,31 @@ static int lcd_init(struct da8xx_fb_par *par, const struct lcd_ctrl_config *cfg,
 	return 0;
 }
 
+/*
+ * Called from the interrupt handlers at the end of the frame of @channel. The
+ * other channel now scans out, so @channel is reloaded with the current
+ * buffer. Should a pan have set up the other channel, its frame is on screen
+ * from now on.
+ */
+static void lcd_frame_done(struct da8xx_fb_par *par, unsigned int channel)
+{
+	spin_lock(&par->lock_for_chan_update);
+	par->which_dma_channel_done = channel;
+	if (channel) {
+		lcdc_write(par->dma_start, LCD_DMA_FRM_BUF_BASE_ADDR_1_REG);
+		lcdc_write(par->dma_end, LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
+	} else {
+		lcdc_write(par->dma_start, LCD_DMA_FRM_BUF_BASE_ADDR_0_REG);
+		lcdc_write(par->dma_end, LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG);
+	}
+	if (par->flip_channel != channel)
+		par->flip_pending = false;
+	spin_unlock(&par->lock_for_chan_update);
+
+	par->vsync_flag = 1;
+	wake_up_interruptible(&par->vsync_wait);
+}
+
 /* IRQ handler for version 2 of LCDC */
 static irqreturn_t lcdc_irq_handler_rev02(int irq, void *arg)
 {
@@ -858,25 +901,11 @@ static irqreturn_t lcdc_irq_handler_rev02(int irq, void *arg)
 	} else {
 		lcdc_write(stat, LCD_MASKED_STAT_REG);
 
-		if (stat & LCD_END_OF_FRAME0) {
-			par->which_dma_channel_done = 0;
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_0_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
-		}
+		if (stat & LCD_END_OF_FRAME0)
+			lcd_frame_done(par, 0);
 
-		if (stat & LCD_END_OF_FRAME1) {
-			par->which_dma_channel_done = 1;
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_1_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
-		}
+		if (stat & LCD_END_OF_FRAME1)
+			lcd_frame_done(par, 1);
 
 		/* Set only when controller is disabled and at the end of
 		 * active frame
@@ -923,25 +952,11 @@ static irqreturn_t lcdc_irq_handler_rev01(int irq, void *arg)
 	} else {
 		lcdc_write(stat, LCD_STAT_REG);
 
-		if (stat & LCD_END_OF_FRAME0) {
-			par->which_dma_channel_done = 0;
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_0_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_0_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
-		}
+		if (stat & LCD_END_OF_FRAME0)
+			lcd_frame_done(par, 0);
 
-		if (stat & LCD_END_OF_FRAME1) {
-			par->which_dma_channel_done = 1;
-			lcdc_write(par->dma_start,
-				   LCD_DMA_FRM_BUF_BASE_ADDR_1_REG);
-			lcdc_write(par->dma_end,
-				   LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
-			par->vsync_flag = 1;
-			wake_up_interruptible(&par->vsync_wait);
-		}
+		if (stat & LCD_END_OF_FRAME1)
+			lcd_frame_done(par, 1);
 	}
 
 	return IRQ_HANDLED;
@@ -1214,6 +1229,10 @@ static int cfb_blank(int blank, struct fb_info *info)
 /*
  * Set new x,y offsets in the virtual display for the visible area and switch
  * to the new mode.
+ *
+ * The new frame goes to the DMA channel that is idle, so it is shown from the
+ * end of the frame being scanned out on and never torn. With FB_ACTIVATE_VBL
+ * this waits until then, after which the previous buffer can be drawn into.
  */
 static int da8xx_pan_display(struct fb_var_screeninfo *var,
 			     struct fb_info *fbi)
@@ -1225,6 +1244,7 @@ static int da8xx_pan_display(struct fb_var_screeninfo *var,
 	unsigned int end;
 	unsigned int start;
 	unsigned long irq_flags;
+	long wait;
 
 	if (var->xoffset != fbi->var.xoffset ||
 			var->yoffset != fbi->var.yoffset) {
@@ -1255,12 +1275,25 @@ static int da8xx_pan_display(struct fb_var_screeninfo *var,
 				lcdc_write(par->dma_end,
 					   LCD_DMA_FRM_BUF_CEILING_ADDR_1_REG);
 			}
+			par->flip_pending = true;
+			par->flip_channel = par->which_dma_channel_done;
 			spin_unlock_irqrestore(&par->lock_for_chan_update,
 					irq_flags);
 		}
 	}
 
-	return ret;
+	if (ret || !(var->activate & FB_ACTIVATE_VBL))
+		return ret;
+
+	wait = wait_event_interruptible_timeout(par->vsync_wait,
+						!READ_ONCE(par->flip_pending),
+						par->vsync_timeout);
+	if (wait < 0)
+		return wait;
+	if (wait == 0)
+		return -ETIMEDOUT;
+
+	return 0;
 }
 
 static int da8xxfb_set_par(struct fb_info *info)
@@ -1464,6 +1497,8 @@ static int fb_probe(struct platform_device *device)
 
 	da8xx_fb_var.grayscale =
 	    lcd_cfg->panel_shade == MONOCHROME ? 1 : 0;
+	/* the second buffer is there for flipping */
+	da8xx_fb_var.yres_virtual = lcdc_info->yres * LCD_NUM_BUFFERS;
 	da8xx_fb_var.bits_per_pixel = lcd_cfg->bpp;
 
 	/* Initialize fbinfo */
@@ -20,7 +20,12 @@
 #include <linux/io.h>
 #include <linux/device.h>
 #include <linux/clk.h>
+#include <linux/davinci_wdt.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
 
 #define MODULE_NAME "DAVINCI-WDT: "
 
@@ -56,18 +61,183 @@
 
 static int heartbeat;
 
+/* How often the kernel feeders are checked while the watchdog runs */
+static unsigned int check_ms = 100;
+module_param(check_ms, uint, 0644);
+MODULE_PARM_DESC(check_ms, "Kernel feeder check interval in ms, default 100");
+
 /*
  * struct to hold data for each WDT device
  * @base - base io address of WD device
  * @clk - source clock of WDT
  * @wdd - hold watchdog device as is in WDT core
+ * @lock - keeps the two writes of a service sequence together
+ * @check_timer - checks the kernel feeders and services the watchdog for them
+ * @pretimeout_timer - fires wdd.pretimeout seconds before the watchdog bites,
+ *	the timer itself has no interrupt in watchdog mode
+ * @debugfs - debugfs directory
  */
 struct davinci_wdt_device {
 	void __iomem		*base;
 	struct clk		*clk;
 	struct watchdog_device	wdd;
+	spinlock_t		lock;
+	struct hrtimer		check_timer;
+	struct hrtimer		pretimeout_timer;
+	struct dentry		*debugfs;
 };
 
+/* Feeders can register before the watchdog probes */
+static LIST_HEAD(davinci_wdt_feeders);
+static DEFINE_SPINLOCK(davinci_wdt_feeders_lock);
+static bool davinci_wdt_stalled;
+
+/**
+ * davinci_wdt_add_feeder - make the watchdog depend on a kernel loop
+ * @feeder: the loop, with @name and @max_interval_us set
+ *
+ * The loop must call davinci_wdt_feed() at least every @max_interval_us from
+ * now on.
+ */
+void davinci_wdt_add_feeder(struct davinci_wdt_feeder *feeder)
+{
+	unsigned long flags;
+
+	feeder->last_ns = 0;
+	feeder->count = 0;
+	feeder->max_us = 0;
+	feeder->seen_count = 0;
+	feeder->seen_ns = ktime_get_mono_fast_ns();
+	feeder->stalled = false;
+
+	spin_lock_irqsave(&davinci_wdt_feeders_lock, flags);
+	list_add_tail(&feeder->list, &davinci_wdt_feeders);
+	spin_unlock_irqrestore(&davinci_wdt_feeders_lock, flags);
+}
+EXPORT_SYMBOL_GPL(davinci_wdt_add_feeder);
+
+/**
+ * davinci_wdt_remove_feeder - stop depending on a kernel loop
+ * @feeder: the loop
+ */
+void davinci_wdt_remove_feeder(struct davinci_wdt_feeder *feeder)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&davinci_wdt_feeders_lock, flags);
+	list_del(&feeder->list);
+	spin_unlock_irqrestore(&davinci_wdt_feeders_lock, flags);
+}
+EXPORT_SYMBOL_GPL(davinci_wdt_remove_feeder);
+
+/**
+ * davinci_wdt_feed - tell the watchdog that a kernel loop is alive
+ * @feeder: the loop
+ *
+ * Only records the time and counts, the watchdog itself is serviced by the
+ * periodic check. This takes no locks and only does single word stores the
+ * check looks at, so it can be called from any context, FIQ handlers
+ * included, as long as the calls of one feeder don't race each other.
+ */
+void davinci_wdt_feed(struct davinci_wdt_feeder *feeder)
+{
+	u64 now = ktime_get_mono_fast_ns();
+	u32 us;
+
+	if (feeder->last_ns) {
+		us = min_t(u64, div_u64(now - feeder->last_ns, NSEC_PER_USEC),
+			   U32_MAX);
+		WRITE_ONCE(feeder->last_us, us);
+		if (us > feeder->max_us)
+			WRITE_ONCE(feeder->max_us, us);
+	}
+	feeder->last_ns = now;
+	WRITE_ONCE(feeder->count, feeder->count + 1);
+}
+EXPORT_SYMBOL_GPL(davinci_wdt_feed);
+
+/*
+ * Returns 1 if all kernel feeders are alive, 0 if there are none, and -1 if
+ * one of them has stalled.
+ */
+static int davinci_wdt_check_feeders(struct davinci_wdt_device *davinci_wdt)
+{
+	struct davinci_wdt_feeder *feeder;
+	u64 now = ktime_get_mono_fast_ns();
+	unsigned long flags;
+	int ret = 0;
+	u32 count;
+
+	spin_lock_irqsave(&davinci_wdt_feeders_lock, flags);
+	list_for_each_entry(feeder, &davinci_wdt_feeders, list) {
+		count = READ_ONCE(feeder->count);
+		if (count != feeder->seen_count) {
+			feeder->seen_count = count;
+			feeder->seen_ns = now;
+			feeder->stalled = false;
+		} else if (now - feeder->seen_ns >
+			   (u64)feeder->max_interval_us * NSEC_PER_USEC) {
+			if (!feeder->stalled)
+				dev_crit(davinci_wdt->wdd.parent,
+					 "%s stalled\n", feeder->name);
+			feeder->stalled = true;
+		}
+
+		if (feeder->stalled)
+			ret = -1;
+		else if (!ret)
+			ret = 1;
+	}
+	davinci_wdt_stalled = ret < 0;
+	spin_unlock_irqrestore(&davinci_wdt_feeders_lock, flags);
+
+	return ret;
+}
+
+static void davinci_wdt_service(struct davinci_wdt_device *davinci_wdt)
+{
+	struct watchdog_device *wdd = &davinci_wdt->wdd;
+	unsigned long flags;
+
+	spin_lock_irqsave(&davinci_wdt->lock, flags);
+	/* put watchdog in service state */
+	iowrite32(WDKEY_SEQ0, davinci_wdt->base + WDTCR);
+	/* put watchdog in active state */
+	iowrite32(WDKEY_SEQ1, davinci_wdt->base + WDTCR);
+	spin_unlock_irqrestore(&davinci_wdt->lock, flags);
+
+	if (wdd->pretimeout)
+		hrtimer_start(&davinci_wdt->pretimeout_timer,
+			      ktime_set(wdd->timeout - wdd->pretimeout, 0),
+			      HRTIMER_MODE_REL);
+	else
+		hrtimer_try_to_cancel(&davinci_wdt->pretimeout_timer);
+}
+
+static enum hrtimer_restart davinci_wdt_check(struct hrtimer *timer)
+{
+	struct davinci_wdt_device *davinci_wdt =
+		container_of(timer, struct davinci_wdt_device, check_timer);
+
+	if (davinci_wdt_check_feeders(davinci_wdt) > 0)
+		davinci_wdt_service(davinci_wdt);
+
+	hrtimer_forward_now(timer, ms_to_ktime(max(READ_ONCE(check_ms), 1U)));
+
+	return HRTIMER_RESTART;
+}
+
+static enum hrtimer_restart davinci_wdt_pretimeout(struct hrtimer *timer)
+{
+	struct davinci_wdt_device *davinci_wdt =
+		container_of(timer, struct davinci_wdt_device,
+			     pretimeout_timer);
+
+	watchdog_notify_pretimeout(&davinci_wdt->wdd);
+
+	return HRTIMER_NORESTART;
+}
+
 static int davinci_wdt_start(struct watchdog_device *wdd)
 {
 	u32 tgcr;
@@ -101,6 +271,15 @@ static int davinci_wdt_start(struct watchdog_device *wdd)
 	iowrite32(WDKEY_SEQ0 | WDEN, davinci_wdt->base + WDTCR);
 	/* put watchdog in active state */
 	iowrite32(WDKEY_SEQ1 | WDEN, davinci_wdt->base + WDTCR);
+
+	/* the watchdog can't be stopped, neither can the checks */
+	if (!hrtimer_active(&davinci_wdt->check_timer))
+		hrtimer_start(&davinci_wdt->check_timer, ms_to_ktime(check_ms),
+			      HRTIMER_MODE_REL);
+	if (wdd->pretimeout)
+		hrtimer_start(&davinci_wdt->pretimeout_timer,
+			      ktime_set(wdd->timeout - wdd->pretimeout, 0),
+			      HRTIMER_MODE_REL);
 	return 0;
 }
 
@@ -108,10 +287,11 @@ static int davinci_wdt_ping(struct watchdog_device *wdd)
 {
 	struct davinci_wdt_device *davinci_wdt = watchdog_get_drvdata(wdd);
 
-	/* put watchdog in service state */
-	iowrite32(WDKEY_SEQ0, davinci_wdt->base + WDTCR);
-	/* put watchdog in active state */
-	iowrite32(WDKEY_SEQ1, davinci_wdt->base + WDTCR);
+	/* a stalled kernel loop is not rescued from userspace */
+	if (READ_ONCE(davinci_wdt_stalled))
+		return 0;
+
+	davinci_wdt_service(davinci_wdt);
 	return 0;
 }
 
@@ -141,7 +321,7 @@ static unsigned int davinci_wdt_get_timeleft(struct watchdog_device *wdd)
 }
 
 static const struct watchdog_info davinci_wdt_info = {
-	.options = WDIOF_KEEPALIVEPING,
+	.options = WDIOF_KEEPALIVEPING | WDIOF_PRETIMEOUT,
 	.identity = "DaVinci/Keystone Watchdog",
 };
 
@@ -153,6 +333,49 @@ static const struct watchdog_ops davinci_wdt_ops = {
 	.get_timeleft	= davinci_wdt_get_timeleft,
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int davinci_wdt_feeders_show(struct seq_file *m, void *unused)
+{
+	struct davinci_wdt_feeder *feeder;
+	unsigned long flags;
+
+	seq_puts(m, "name count last_us max_us max_interval_us stalled\n");
+
+	spin_lock_irqsave(&davinci_wdt_feeders_lock, flags);
+	list_for_each_entry(feeder, &davinci_wdt_feeders, list)
+		seq_printf(m, "%s %u %u %u %u %d\n", feeder->name,
+			   READ_ONCE(feeder->count), READ_ONCE(feeder->last_us),
+			   READ_ONCE(feeder->max_us), feeder->max_interval_us,
+			   feeder->stalled);
+	spin_unlock_irqrestore(&davinci_wdt_feeders_lock, flags);
+
+	return 0;
+}
+
+static int davinci_wdt_feeders_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, davinci_wdt_feeders_show, inode->i_private);
+}
+
+static const struct file_operations davinci_wdt_feeders_fops = {
+	.open		= davinci_wdt_feeders_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void davinci_wdt_debugfs_init(struct davinci_wdt_device *davinci_wdt)
+{
+	davinci_wdt->debugfs = debugfs_create_dir("davinci_wdt", NULL);
+	debugfs_create_file("feeders", S_IRUGO, davinci_wdt->debugfs,
+			    davinci_wdt, &davinci_wdt_feeders_fops);
+}
+#else
+static inline void davinci_wdt_debugfs_init(struct davinci_wdt_device *wdt)
+{
+}
+#endif
+
 static int davinci_wdt_probe(struct platform_device *pdev)
 {
 	int ret = 0;
@@ -181,6 +404,14 @@ static int davinci_wdt_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, davinci_wdt);
 
+	spin_lock_init(&davinci_wdt->lock);
+	hrtimer_init(&davinci_wdt->check_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	davinci_wdt->check_timer.function = davinci_wdt_check;
+	hrtimer_init(&davinci_wdt->pretimeout_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	davinci_wdt->pretimeout_timer.function = davinci_wdt_pretimeout;
+
 	wdd			= &davinci_wdt->wdd;
 	wdd->info		= &davinci_wdt_info;
 	wdd->ops		= &davinci_wdt_ops;
@@ -209,6 +440,8 @@ static int davinci_wdt_probe(struct platform_device *pdev)
 		goto err_clk_disable;
 	}
 
+	davinci_wdt_debugfs_init(davinci_wdt);
+
 	return 0;
 
 err_clk_disable:
@@ -221,7 +454,10 @@ static int davinci_wdt_remove(struct platform_device *pdev)
 {
 	struct davinci_wdt_device *davinci_wdt = platform_get_drvdata(pdev);
 
+	debugfs_remove_recursive(davinci_wdt->debugfs);
 	watchdog_unregister_device(&davinci_wdt->wdd);
+	hrtimer_cancel(&davinci_wdt->check_timer);
+	hrtimer_cancel(&davinci_wdt->pretimeout_timer);
 	clk_disable_unprepare(davinci_wdt->clk);
 
 	return 0;
@@ -42,6 +42,7 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/hrtimer.h>
 #include <net/busy_poll.h>
 
 /*
@@ -226,6 +227,16 @@ struct eventpoll {
 	int visited;
 	struct list_head visited_list_link;
 
+	/*
+	 * Wakeup coalescing, set with EPIOCSCOALESCE: waiters are held back
+	 * until coalesce_min items are ready or coalesce_timer has expired
+	 * since the first of them was queued. Protected by ->lock.
+	 */
+	unsigned int coalesce_min;
+	ktime_t coalesce_timeout;
+	struct hrtimer coalesce_timer;
+	bool coalesce_expired;
+
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	/* used to track busy poll napi_id */
 	unsigned int napi_id;
@@ -390,6 +401,45 @@ static inline int ep_events_available(struct eventpoll *ep)
 	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
 }
 
+/*
+ * Tells whether a wakeup of the sys_epoll_wait() waiters should be held
+ * back because fewer than the requested number of items are ready, and
+ * arms the coalescing timer if so. Must be called with "ep->lock" held.
+ */
+static bool ep_coalesce_hold(struct eventpoll *ep)
+{
+	struct list_head *pos;
+	unsigned int n = 0;
+
+	if (ep->coalesce_min <= 1 || ep->coalesce_expired)
+		return false;
+
+	list_for_each(pos, &ep->rdllist)
+		if (++n >= ep->coalesce_min)
+			return false;
+
+	if (!hrtimer_active(&ep->coalesce_timer))
+		hrtimer_start(&ep->coalesce_timer, ep->coalesce_timeout,
+			      HRTIMER_MODE_REL);
+
+	return true;
+}
+
+static enum hrtimer_restart ep_coalesce_timer_fn(struct hrtimer *timer)
+{
+	struct eventpoll *ep = container_of(timer, struct eventpoll,
+					    coalesce_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	ep->coalesce_expired = true;
+	if (waitqueue_active(&ep->wq))
+		wake_up_locked(&ep->wq);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
 #ifdef CONFIG_NET_RX_BUSY_POLL
 static bool ep_busy_loop_end(void *p, unsigned long start_time)
 {
@@ -749,7 +799,7 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		 * Wake up (if active) both the eventpoll wait list and
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
-		if (waitqueue_active(&ep->wq))
+		if (waitqueue_active(&ep->wq) && !ep_coalesce_hold(ep))
 			wake_up_locked(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
@@ -823,6 +873,8 @@ static void ep_free(struct eventpoll *ep)
 	struct rb_node *rbp;
 	struct epitem *epi;
 
+	hrtimer_cancel(&ep->coalesce_timer);
+
 	/* We need to release all tasks waiting for these file */
 	if (waitqueue_active(&ep->poll_wait))
 		ep_poll_safewake(&ep->poll_wait);
@@ -980,6 +1032,45 @@ static void ep_show_fdinfo(struct seq_file *m, struct file *f)
 }
 #endif
 
+static long ep_eventpoll_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct eventpoll *ep = file->private_data;
+	void __user *argp = (void __user *)arg;
+	struct epoll_coalesce ec;
+
+	switch (cmd) {
+	case EPIOCSCOALESCE:
+		if (copy_from_user(&ec, argp, sizeof(ec)))
+			return -EFAULT;
+		if (ec.min_events > EP_MAX_EVENTS ||
+		    (ec.min_events > 1 && !ec.timeout_us))
+			return -EINVAL;
+
+		spin_lock_irq(&ep->lock);
+		ep->coalesce_min = ec.min_events;
+		ep->coalesce_timeout = ns_to_ktime((u64)ec.timeout_us *
+						   NSEC_PER_USEC);
+		/* let waiters held back under the old settings through */
+		ep->coalesce_expired = true;
+		if (waitqueue_active(&ep->wq))
+			wake_up_locked(&ep->wq);
+		spin_unlock_irq(&ep->lock);
+
+		hrtimer_cancel(&ep->coalesce_timer);
+		return 0;
+	case EPIOCGCOALESCE:
+		spin_lock_irq(&ep->lock);
+		ec.min_events = ep->coalesce_min;
+		ec.timeout_us = ktime_to_us(ep->coalesce_timeout);
+		spin_unlock_irq(&ep->lock);
+
+		return copy_to_user(argp, &ec, sizeof(ec)) ? -EFAULT : 0;
+	}
+
+	return -ENOTTY;
+}
+
 /* File callbacks that implement the eventpoll file behaviour */
 static const struct file_operations eventpoll_fops = {
 #ifdef CONFIG_PROC_FS
@@ -987,6 +1078,8 @@ static const struct file_operations eventpoll_fops = {
 #endif
 	.release	= ep_eventpoll_release,
 	.poll		= ep_eventpoll_poll,
+	.unlocked_ioctl	= ep_eventpoll_ioctl,
+	.compat_ioctl	= ep_eventpoll_ioctl,
 	.llseek		= noop_llseek,
 };
 
@@ -1043,6 +1136,8 @@ static int ep_alloc(struct eventpoll **pep)
 	ep->rbr = RB_ROOT_CACHED;
 	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
+	hrtimer_init(&ep->coalesce_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ep->coalesce_timer.function = ep_coalesce_timer_fn;
 
 	*pep = ep;
 
@@ -1210,7 +1305,8 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 				break;
 			}
 		}
-		wake_up_locked(&ep->wq);
+		if (!ep_coalesce_hold(ep))
+			wake_up_locked(&ep->wq);
 	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
@@ -1785,7 +1881,7 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 
 	spin_lock_irqsave(&ep->lock, flags);
 
-	if (!ep_events_available(ep)) {
+	if (!ep_events_available(ep) || ep_coalesce_hold(ep)) {
 		/*
 		 * Busy poll timed out.  Drop NAPI ID for now, we can add
 		 * it back in when we have moved a socket with a valid NAPI
@@ -1818,7 +1914,8 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 				res = -EINTR;
 				break;
 			}
-			if (ep_events_available(ep) || timed_out)
+			if ((ep_events_available(ep) &&
+			     !ep_coalesce_hold(ep)) || timed_out)
 				break;
 			if (signal_pending(current)) {
 				res = -EINTR;
@@ -1839,6 +1936,12 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
+	/* the next batch starts coalescing from scratch */
+	if (eavail && ep->coalesce_min > 1) {
+		ep->coalesce_expired = false;
+		hrtimer_try_to_cancel(&ep->coalesce_timer);
+	}
+
 	spin_unlock_irqrestore(&ep->lock, flags);
 
 	/*
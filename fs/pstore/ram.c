@@ -33,6 +33,7 @@
 #include <linux/slab.h>
 #include <linux/compiler.h>
 #include <linux/pstore_ram.h>
+#include <linux/rcupdate.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
 
@@ -56,6 +57,10 @@ static ulong ramoops_pmsg_size = MIN_MEM_SIZE;
 module_param_named(pmsg_size, ramoops_pmsg_size, ulong, 0400);
 MODULE_PARM_DESC(pmsg_size, "size of user space message log");
 
+static ulong ramoops_irqtrace_size;
+module_param_named(irqtrace_size, ramoops_irqtrace_size, ulong, 0400);
+MODULE_PARM_DESC(irqtrace_size, "size of FIQ/IRQ trace rings");
+
 static unsigned long long mem_address;
 module_param_hw(mem_address, ullong, other, 0400);
 MODULE_PARM_DESC(mem_address,
@@ -88,6 +93,7 @@ struct ramoops_context {
 	struct persistent_ram_zone *cprz;	/* Console zone */
 	struct persistent_ram_zone **fprzs;	/* Ftrace zones */
 	struct persistent_ram_zone *mprz;	/* PMSG zone */
+	struct persistent_ram_zone *tprz;	/* IRQ trace zone */
 	phys_addr_t phys_addr;
 	unsigned long size;
 	unsigned int memtype;
@@ -95,6 +101,7 @@ struct ramoops_context {
 	size_t console_size;
 	size_t ftrace_size;
 	size_t pmsg_size;
+	size_t irqtrace_size;
 	int dump_oops;
 	u32 flags;
 	struct persistent_ram_ecc_info ecc_info;
@@ -106,9 +113,15 @@ struct ramoops_context {
 	unsigned int max_ftrace_cnt;
 	unsigned int ftrace_read_cnt;
 	unsigned int pmsg_read_cnt;
+	unsigned int irqtrace_read_cnt;
 	struct pstore_info pstore;
 };
 
+#ifdef CONFIG_PSTORE_IRQTRACE
+struct ramoops_irqtrace *ramoops_irqtrace[RAMOOPS_IRQTRACE_NUM_RINGS];
+EXPORT_SYMBOL_GPL(ramoops_irqtrace);
+#endif
+
 static struct platform_device *dummy;
 static struct ramoops_platform_data *dummy_data;
 
@@ -120,6 +133,7 @@ static int ramoops_pstore_open(struct pstore_info *psi)
 	cxt->console_read_cnt = 0;
 	cxt->ftrace_read_cnt = 0;
 	cxt->pmsg_read_cnt = 0;
+	cxt->irqtrace_read_cnt = 0;
 	return 0;
 }
 
@@ -182,6 +196,90 @@ static bool prz_ok(struct persistent_ram_zone *prz)
 			   persistent_ram_ecc_string(prz, NULL, 0));
 }
 
+#define RAMOOPS_IRQTRACE_LINE	48
+
+static const char * const ramoops_irqtrace_names[] = {
+	[RAMOOPS_IRQTRACE_FIQ]	= "fiq",
+	[RAMOOPS_IRQTRACE_IRQ]	= "irq",
+};
+
+/* Returns the number of valid entries in a ring saved by the last boot */
+static u32 ramoops_irqtrace_valid(const struct ramoops_irqtrace *trace,
+				  size_t ring_size)
+{
+	u32 len = trace->mask + 1;
+
+	if (trace->sig != RAMOOPS_IRQTRACE_SIG || !is_power_of_2(len) ||
+	    len > (ring_size - sizeof(*trace)) / sizeof(trace->entries[0]))
+		return 0;
+
+	return min(trace->head, len);
+}
+
+/*
+ * Merges the saved rings into one text listing, oldest first. The rings are
+ * read back as they were when the system went down, so it does not matter
+ * that the writers never finished what they were doing.
+ */
+static ssize_t ramoops_irqtrace_format(struct persistent_ram_zone *prz,
+				       struct pstore_record *record)
+{
+	const struct ramoops_irqtrace *trace[RAMOOPS_IRQTRACE_NUM_RINGS];
+	u32 left[RAMOOPS_IRQTRACE_NUM_RINGS];
+	size_t ring_size, total = 0, len = 0;
+	char *old = persistent_ram_old(prz);
+	int i;
+
+	ring_size = round_down(persistent_ram_old_size(prz) /
+			       RAMOOPS_IRQTRACE_NUM_RINGS, sizeof(u32));
+	if (ring_size < sizeof(struct ramoops_irqtrace))
+		return 0;
+
+	for (i = 0; i < RAMOOPS_IRQTRACE_NUM_RINGS; i++) {
+		trace[i] = (void *)(old + i * ring_size);
+		left[i] = ramoops_irqtrace_valid(trace[i], ring_size);
+		total += left[i];
+	}
+
+	if (!total)
+		return 0;
+
+	total = (total + 1) * RAMOOPS_IRQTRACE_LINE;
+	record->buf = kmalloc(total, GFP_KERNEL);
+	if (!record->buf)
+		return -ENOMEM;
+
+	len += scnprintf(record->buf, total,
+			 "# ticks    src irq data0    data1\n");
+
+	for (;;) {
+		const struct ramoops_irqtrace_entry *entry, *next = NULL;
+		int ring = 0;
+
+		for (i = 0; i < RAMOOPS_IRQTRACE_NUM_RINGS; i++) {
+			if (!left[i])
+				continue;
+			entry = &trace[i]->entries[(trace[i]->head - left[i]) &
+						   trace[i]->mask];
+			if (!next || (s32)(entry->timestamp -
+					   next->timestamp) < 0) {
+				next = entry;
+				ring = i;
+			}
+		}
+		if (!next)
+			break;
+		left[ring]--;
+
+		len += scnprintf(record->buf + len, total - len,
+				 "%10u %s %3u %08x %08x\n", next->timestamp,
+				 ramoops_irqtrace_names[ring], next->irq,
+				 next->data[0], next->data[1]);
+	}
+
+	return len;
+}
+
 static ssize_t ftrace_log_combine(struct persistent_ram_zone *dest,
 				  struct persistent_ram_zone *src)
 {
@@ -280,6 +378,16 @@ static ssize_t ramoops_pstore_read(struct pstore_record *record)
 					   1, &record->id, &record->type,
 					   PSTORE_TYPE_PMSG, 0);
 
+	if (!prz_ok(prz)) {
+		prz = ramoops_get_next_prz(&cxt->tprz, &cxt->irqtrace_read_cnt,
+					   1, &record->id, &record->type,
+					   PSTORE_TYPE_IRQTRACE, 0);
+		size = prz_ok(prz) ? ramoops_irqtrace_format(prz, record) : 0;
+		if (size)
+			return size;
+		prz = NULL;
+	}
+
 	/* ftrace is last since it may want to dynamically allocate memory. */
 	if (!prz_ok(prz)) {
 		if (!(cxt->flags & RAMOOPS_FLAG_FTRACE_PER_CPU)) {
@@ -481,6 +589,10 @@ static int ramoops_pstore_erase(struct pstore_record *record)
 	case PSTORE_TYPE_PMSG:
 		prz = cxt->mprz;
 		break;
+	case PSTORE_TYPE_IRQTRACE:
+		/* the rings stay live, only drop the old copy */
+		persistent_ram_free_old(cxt->tprz);
+		return 0;
 	default:
 		return -EINVAL;
 	}
@@ -644,6 +756,85 @@ static int ramoops_init_prz(const char *name,
 	return 0;
 }
 
+static int ramoops_init_irqtrace(struct device *dev,
+				 struct ramoops_context *cxt,
+				 phys_addr_t *paddr)
+{
+	struct persistent_ram_ecc_info no_ecc = { };
+	size_t size, ring_size;
+	void *data;
+	u32 len;
+	int i;
+
+	if (!cxt->irqtrace_size)
+		return 0;
+
+	if (*paddr + cxt->irqtrace_size - cxt->phys_addr > cxt->size) {
+		dev_err(dev, "no room for irqtrace mem region (0x%zx@0x%llx) in (0x%lx@0x%llx)\n",
+			cxt->irqtrace_size, (unsigned long long)*paddr,
+			cxt->size, (unsigned long long)cxt->phys_addr);
+		return -ENOMEM;
+	}
+
+	/* the writers cannot keep ECC up to date */
+	cxt->tprz = persistent_ram_new(*paddr, cxt->irqtrace_size, 0, &no_ecc,
+				       cxt->memtype, PRZ_FLAG_NO_LOCK);
+	if (IS_ERR(cxt->tprz)) {
+		int err = PTR_ERR(cxt->tprz);
+
+		dev_err(dev, "failed to request irqtrace mem region (0x%zx@0x%llx): %d\n",
+			cxt->irqtrace_size, (unsigned long long)*paddr, err);
+		cxt->tprz = NULL;
+		return err;
+	}
+
+	data = persistent_ram_claim_raw(cxt->tprz, &size);
+	ring_size = round_down(size / RAMOOPS_IRQTRACE_NUM_RINGS, sizeof(u32));
+	if (!data || ring_size < sizeof(struct ramoops_irqtrace) +
+				 sizeof(struct ramoops_irqtrace_entry)) {
+		dev_err(dev, "irqtrace mem region too small\n");
+		persistent_ram_free(cxt->tprz);
+		cxt->tprz = NULL;
+		return -EINVAL;
+	}
+
+	len = (ring_size - sizeof(struct ramoops_irqtrace)) /
+	      sizeof(struct ramoops_irqtrace_entry);
+	len = rounddown_pow_of_two(len);
+
+	for (i = 0; i < RAMOOPS_IRQTRACE_NUM_RINGS; i++) {
+		struct ramoops_irqtrace *trace = data + i * ring_size;
+
+		trace->mask = len - 1;
+		trace->head = 0;
+		trace->sig = RAMOOPS_IRQTRACE_SIG;
+#ifdef CONFIG_PSTORE_IRQTRACE
+		WRITE_ONCE(ramoops_irqtrace[i], trace);
+#endif
+	}
+
+	*paddr += cxt->irqtrace_size;
+
+	return 0;
+}
+
+static void ramoops_free_irqtrace(struct ramoops_context *cxt)
+{
+#ifdef CONFIG_PSTORE_IRQTRACE
+	int i;
+
+	/*
+	 * The writers look the rings up once per interrupt, so once every
+	 * CPU has scheduled none of them can still be using the old ones.
+	 */
+	for (i = 0; i < RAMOOPS_IRQTRACE_NUM_RINGS; i++)
+		WRITE_ONCE(ramoops_irqtrace[i], NULL);
+	synchronize_sched();
+#endif
+	persistent_ram_free(cxt->tprz);
+	cxt->tprz = NULL;
+}
+
 static int ramoops_parse_dt_size(struct platform_device *pdev,
 				 const char *propname, u32 *value)
 {
@@ -699,6 +890,7 @@ static int ramoops_parse_dt(struct platform_device *pdev,
 	parse_size("console-size", pdata->console_size);
 	parse_size("ftrace-size", pdata->ftrace_size);
 	parse_size("pmsg-size", pdata->pmsg_size);
+	parse_size("irqtrace-size", pdata->irqtrace_size);
 	parse_size("ecc-size", pdata->ecc_info.ecc_size);
 	parse_size("flags", pdata->flags);
 
@@ -745,7 +937,8 @@ static int ramoops_probe(struct platform_device *pdev)
 	}
 
 	if (!pdata->mem_size || (!pdata->record_size && !pdata->console_size &&
-			!pdata->ftrace_size && !pdata->pmsg_size)) {
+			!pdata->ftrace_size && !pdata->pmsg_size &&
+			!pdata->irqtrace_size)) {
 		pr_err("The memory size and the record/console size must be "
 			"non-zero\n");
 		goto fail_out;
@@ -759,6 +952,11 @@ static int ramoops_probe(struct platform_device *pdev)
 		pdata->ftrace_size = rounddown_pow_of_two(pdata->ftrace_size);
 	if (pdata->pmsg_size && !is_power_of_2(pdata->pmsg_size))
 		pdata->pmsg_size = rounddown_pow_of_two(pdata->pmsg_size);
+	if (!IS_ENABLED(CONFIG_PSTORE_IRQTRACE))
+		pdata->irqtrace_size = 0;
+	if (pdata->irqtrace_size && !is_power_of_2(pdata->irqtrace_size))
+		pdata->irqtrace_size =
+			rounddown_pow_of_two(pdata->irqtrace_size);
 
 	cxt->size = pdata->mem_size;
 	cxt->phys_addr = pdata->mem_address;
@@ -767,6 +965,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	cxt->console_size = pdata->console_size;
 	cxt->ftrace_size = pdata->ftrace_size;
 	cxt->pmsg_size = pdata->pmsg_size;
+	cxt->irqtrace_size = pdata->irqtrace_size;
 	cxt->dump_oops = pdata->dump_oops;
 	cxt->flags = pdata->flags;
 	cxt->ecc_info = pdata->ecc_info;
@@ -774,7 +973,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	paddr = cxt->phys_addr;
 
 	dump_mem_sz = cxt->size - cxt->console_size - cxt->ftrace_size
-			- cxt->pmsg_size;
+			- cxt->pmsg_size - cxt->irqtrace_size;
 	err = ramoops_init_przs("dump", dev, cxt, &cxt->dprzs, &paddr,
 				dump_mem_sz, cxt->record_size,
 				&cxt->max_dump_cnt, 0, 0);
@@ -802,6 +1001,10 @@ static int ramoops_probe(struct platform_device *pdev)
 	if (err)
 		goto fail_init_mprz;
 
+	err = ramoops_init_irqtrace(dev, cxt, &paddr);
+	if (err)
+		goto fail_init_tprz;
+
 	cxt->pstore.data = cxt;
 	/*
 	 * Console can handle any buffer size, so prefer LOG_LINE_MAX. If we
@@ -845,6 +1048,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	ramoops_console_size = pdata->console_size;
 	ramoops_pmsg_size = pdata->pmsg_size;
 	ramoops_ftrace_size = pdata->ftrace_size;
+	ramoops_irqtrace_size = pdata->irqtrace_size;
 
 	pr_info("attached 0x%lx@0x%llx, ecc: %d/%d\n",
 		cxt->size, (unsigned long long)cxt->phys_addr,
@@ -856,6 +1060,8 @@ static int ramoops_probe(struct platform_device *pdev)
 	kfree(cxt->pstore.buf);
 fail_clear:
 	cxt->pstore.bufsize = 0;
+	ramoops_free_irqtrace(cxt);
+fail_init_tprz:
 	persistent_ram_free(cxt->mprz);
 fail_init_mprz:
 fail_init_fprz:
@@ -875,6 +1081,7 @@ static int ramoops_remove(struct platform_device *pdev)
 	kfree(cxt->pstore.buf);
 	cxt->pstore.bufsize = 0;
 
+	ramoops_free_irqtrace(cxt);
 	persistent_ram_free(cxt->mprz);
 	persistent_ram_free(cxt->cprz);
 	ramoops_free_przs(cxt);
@@ -916,6 +1123,7 @@ static void ramoops_register_dummy(void)
 	dummy_data->console_size = ramoops_console_size;
 	dummy_data->ftrace_size = ramoops_ftrace_size;
 	dummy_data->pmsg_size = ramoops_pmsg_size;
+	dummy_data->irqtrace_size = ramoops_irqtrace_size;
 	dummy_data->dump_oops = dump_oops;
 	dummy_data->flags = RAMOOPS_FLAG_FTRACE_PER_CPU;
 
@@ -389,6 +389,26 @@ void persistent_ram_zap(struct persistent_ram_zone *prz)
 	persistent_ram_update_header_ecc(prz);
 }
 
+/*
+ * Hands the data area of a zone without ECC to a caller that fills it in
+ * directly, from places where persistent_ram_write() cannot be used. The
+ * area is cleared and marked as completely used, so all of it is kept as
+ * the old log on the next boot.
+ */
+void *persistent_ram_claim_raw(struct persistent_ram_zone *prz, size_t *size)
+{
+	if (WARN_ON(prz->ecc_info.ecc_size))
+		return NULL;
+
+	memset_io(prz->buffer->data, 0, prz->buffer_size);
+	atomic_set(&prz->buffer->start, 0);
+	atomic_set(&prz->buffer->size, prz->buffer_size);
+
+	*size = prz->buffer_size;
+
+	return prz->buffer->data;
+}
+
 static void *persistent_ram_vmap(phys_addr_t start, size_t size,
 		unsigned int memtype)
 {
@@ -32,6 +32,7 @@
 #include <linux/string.h>
 #include <linux/buffer_head.h>
 #include <linux/bio.h>
+#include <linux/blkdev.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -78,6 +79,40 @@ static struct buffer_head *get_block_length(struct super_block *sb,
 	return bh;
 }
 
+/*
+ * Start reading the device blocks following a datablock so that they are
+ * cached by the time the next datablock is needed.  This is only done when
+ * datablocks are being read in filesystem order, the read-ahead is wasted
+ * on the random accesses of fragment and metadata lookups.
+ */
+static void squashfs_readahead(struct super_block *sb, u64 index, u64 next)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct buffer_head *bh;
+	struct blk_plug plug;
+	u64 end, cur_index, expected = msblk->readahead_next;
+
+	msblk->readahead_next = next;
+	if (index != expected)
+		return;
+
+	end = min_t(u64, next + (u64) msblk->block_size *
+		CONFIG_SQUASHFS_READAHEAD_BLOCKS, msblk->bytes_used);
+
+	blk_start_plug(&plug);
+	for (cur_index = next >> msblk->devblksize_log2;
+			cur_index << msblk->devblksize_log2 < end;
+			cur_index++) {
+		bh = sb_getblk(sb, cur_index);
+		if (bh == NULL)
+			break;
+		if (!buffer_uptodate(bh) && !buffer_locked(bh))
+			ll_rw_block(REQ_OP_READ, REQ_RAHEAD, 1, &bh);
+		put_bh(bh);
+	}
+	blk_finish_plug(&plug);
+}
+
 
 /*
  * Read and decompress a metadata block or datablock.  Length is non-zero
@@ -126,6 +161,9 @@ int squashfs_read_data(struct super_block *sb, u64 index, int length,
 			bytes += msblk->devblksize;
 		}
 		ll_rw_block(REQ_OP_READ, 0, b, bh);
+
+		if (CONFIG_SQUASHFS_READAHEAD_BLOCKS)
+			squashfs_readahead(sb, index, index + length);
 	} else {
 		/*
 		 * Metadata block.
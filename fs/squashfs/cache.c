@@ -85,6 +85,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			 * go to sleep waiting for one to become available.
 			 */
 			if (cache->unused == 0) {
+				cache->waits++;
 				cache->num_waiters++;
 				spin_unlock(&cache->lock);
 				wait_event(cache->wait_queue, cache->unused);
@@ -112,6 +113,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			 * Initialise chosen cache entry, and fill it in from
 			 * disk.
 			 */
+			cache->misses++;
 			cache->unused--;
 			entry->block = block;
 			entry->refcount = 1;
@@ -151,6 +153,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * for reuse.
 		 */
 		entry = &cache->entry[i];
+		cache->hits++;
 		if (entry->refcount == 0)
 			cache->unused--;
 		entry->refcount++;
@@ -215,11 +218,13 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 		return;
 
 	for (i = 0; i < cache->entries; i++) {
-		if (cache->entry[i].data) {
+		if (cache->entry[i].buffer)
+			kfree(cache->entry[i].buffer);
+		else if (cache->entry[i].data) {
 			for (j = 0; j < cache->pages; j++)
 				kfree(cache->entry[i].data[j]);
-			kfree(cache->entry[i].data);
 		}
+		kfree(cache->entry[i].data);
 		kfree(cache->entry[i].actor);
 	}
 
@@ -231,7 +236,9 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 /*
  * Initialise cache allocating the specified number of entries, each of
  * size block_size.  To avoid vmalloc fragmentation issues each entry
- * is allocated as a sequence of kmalloced PAGE_SIZE buffers.
+ * is allocated with kmalloc.  A physically contiguous buffer is tried
+ * first, as decompressors can then write into it directly, falling back
+ * to a sequence of PAGE_SIZE buffers if memory is fragmented.
  */
 struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	int block_size)
@@ -274,11 +281,20 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 			goto cleanup;
 		}
 
-		for (j = 0; j < cache->pages; j++) {
-			entry->data[j] = kmalloc(PAGE_SIZE, GFP_KERNEL);
-			if (entry->data[j] == NULL) {
-				ERROR("Failed to allocate %s buffer\n", name);
-				goto cleanup;
+		if (cache->pages > 1)
+			entry->buffer = kmalloc(cache->pages * PAGE_SIZE,
+				GFP_KERNEL | __GFP_NORETRY | __GFP_NOWARN);
+		if (entry->buffer) {
+			for (j = 0; j < cache->pages; j++)
+				entry->data[j] = entry->buffer + j * PAGE_SIZE;
+		} else {
+			for (j = 0; j < cache->pages; j++) {
+				entry->data[j] = kmalloc(PAGE_SIZE, GFP_KERNEL);
+				if (entry->data[j] == NULL) {
+					ERROR("Failed to allocate %s buffer\n",
+						name);
+					goto cleanup;
+				}
 			}
 		}
 
@@ -430,15 +446,15 @@ void *squashfs_read_table(struct super_block *sb, u64 block, int length)
 		goto failed;
 	}
 
+	for (i = 0; i < pages; i++, buffer += PAGE_SIZE)
+		data[i] = buffer;
+
 	actor = squashfs_page_actor_init(data, pages, length);
 	if (actor == NULL) {
 		res = -ENOMEM;
 		goto failed2;
 	}
 
-	for (i = 0; i < pages; i++, buffer += PAGE_SIZE)
-		data[i] = buffer;
-
 	res = squashfs_read_data(sb, block, length |
 		SQUASHFS_COMPRESSED_BIT_BLOCK, NULL, actor);
 
@@ -416,6 +416,9 @@ int squashfs_read_inode(struct inode *inode, long long ino)
 	} else
 		squashfs_i(inode)->xattr_count = 0;
 
+	if (S_ISREG(inode->i_mode) && squashfs_xattr_pinned(inode))
+		mapping_set_unevictable(&inode->i_data);
+
 	return 0;
 
 failed_read:
@@ -95,7 +95,7 @@ static int lz4_uncompress(struct squashfs_sb_info *msblk, void *strm,
 	struct squashfs_page_actor *output)
 {
 	struct squashfs_lz4 *stream = strm;
-	void *buff = stream->input, *data;
+	void *buff = stream->input, *data, *linear;
 	int avail, i, bytes = length, res;
 
 	for (i = 0; i < b; i++) {
@@ -107,6 +107,17 @@ static int lz4_uncompress(struct squashfs_sb_info *msblk, void *strm,
 		put_bh(bh[i]);
 	}
 
+	/*
+	 * LZ4 needs the whole output block contiguous, decompress straight
+	 * into it when the actor buffers are, to save a copy.
+	 */
+	linear = squashfs_actor_linear(output);
+	if (linear) {
+		res = LZ4_decompress_safe(stream->input, linear, length,
+			output->length);
+		return res < 0 ? -EIO : res;
+	}
+
 	res = LZ4_decompress_safe(stream->input, stream->output,
 		length, output->length);
 
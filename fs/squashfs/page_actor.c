@@ -50,6 +50,7 @@ struct squashfs_page_actor *squashfs_page_actor_init(void **buffer,
 
 	actor->length = length ? : pages * PAGE_SIZE;
 	actor->buffer = buffer;
+	actor->linear = squashfs_buffer_linear(buffer, pages);
 	actor->pages = pages;
 	actor->next_page = 0;
 	actor->squashfs_first_page = cache_first_page;
@@ -93,6 +94,7 @@ struct squashfs_page_actor *squashfs_page_actor_init_special(struct page **page,
 	actor->pages = pages;
 	actor->next_page = 0;
 	actor->pageaddr = NULL;
+	actor->linear = NULL;
 	actor->squashfs_first_page = direct_first_page;
 	actor->squashfs_next_page = direct_next_page;
 	actor->squashfs_finish_page = direct_finish_page;
@@ -8,9 +8,25 @@
  * the COPYING file in the top-level directory.
  */
 
+/*
+ * Return the start of the buffers if they are virtually contiguous, in
+ * which case decompressors can write the output in one go.
+ */
+static inline void *squashfs_buffer_linear(void **buffer, int pages)
+{
+	int i;
+
+	for (i = 1; i < pages; i++)
+		if (buffer[i] != buffer[0] + i * PAGE_SIZE)
+			return NULL;
+
+	return buffer[0];
+}
+
 #ifndef CONFIG_SQUASHFS_FILE_DIRECT
 struct squashfs_page_actor {
 	void	**page;
+	void	*linear;
 	int	pages;
 	int	length;
 	int	next_page;
@@ -26,6 +42,7 @@ static inline struct squashfs_page_actor *squashfs_page_actor_init(void **page,
 
 	actor->length = length ? : pages * PAGE_SIZE;
 	actor->page = page;
+	actor->linear = squashfs_buffer_linear(page, pages);
 	actor->pages = pages;
 	actor->next_page = 0;
 	return actor;
@@ -54,6 +71,7 @@ struct squashfs_page_actor {
 		struct page	**page;
 	};
 	void	*pageaddr;
+	void	*linear;
 	void    *(*squashfs_first_page)(struct squashfs_page_actor *);
 	void    *(*squashfs_next_page)(struct squashfs_page_actor *);
 	void    (*squashfs_finish_page)(struct squashfs_page_actor *);
@@ -78,4 +96,13 @@ static inline void squashfs_finish_page(struct squashfs_page_actor *actor)
 	actor->squashfs_finish_page(actor);
 }
 #endif
+
+/*
+ * Virtually contiguous output buffer of at least actor->length bytes, or
+ * NULL if the output has to be written a page at a time.
+ */
+static inline void *squashfs_actor_linear(struct squashfs_page_actor *actor)
+{
+	return actor->linear;
+}
 #endif
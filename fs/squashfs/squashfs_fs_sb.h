@@ -37,6 +37,9 @@ struct squashfs_cache {
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache_entry *entry;
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		waits;
 };
 
 struct squashfs_cache_entry {
@@ -50,6 +53,7 @@ struct squashfs_cache_entry {
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache	*cache;
 	void			**data;
+	void			*buffer;
 	struct squashfs_page_actor	*actor;
 };
 
@@ -76,5 +80,9 @@ struct squashfs_sb_info {
 	long long				bytes_used;
 	unsigned int				inodes;
 	int					xattr_ids;
+	u64					readahead_next;
+	int					metadata_cache_entries;
+	int					fragment_cache_entries;
+	struct dentry				*debugfs_stats;
 };
 #endif
@@ -38,6 +38,9 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -48,6 +51,118 @@
 
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
+static struct dentry *squashfs_debugfs_root;
+
+#define SQUASHFS_MAX_CACHED_BLKS	64
+
+enum {
+	Opt_metadata_cache, Opt_fragment_cache, Opt_err
+};
+
+static const match_table_t squashfs_tokens = {
+	{Opt_metadata_cache, "metadata_cache=%u"},
+	{Opt_fragment_cache, "fragment_cache=%u"},
+	{Opt_err, NULL}
+};
+
+/*
+ * Parse the mount options, which size the metadata and fragment caches.
+ * Unknown options are ignored, as Squashfs used to ignore all options.
+ */
+static int squashfs_parse_options(struct squashfs_sb_info *msblk, char *data)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int n;
+
+	msblk->metadata_cache_entries = SQUASHFS_CACHED_BLKS;
+	msblk->fragment_cache_entries = SQUASHFS_CACHED_FRAGMENTS;
+
+	if (!data)
+		return 0;
+
+	while ((p = strsep(&data, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		switch (match_token(p, squashfs_tokens, args)) {
+		case Opt_metadata_cache:
+			/*
+			 * The index cache in file.c assumes at least
+			 * SQUASHFS_CACHED_BLKS metadata blocks can be cached
+			 */
+			if (match_int(&args[0], &n) ||
+					n < SQUASHFS_CACHED_BLKS ||
+					n > SQUASHFS_MAX_CACHED_BLKS) {
+				ERROR("metadata_cache must be %d to %d\n",
+					SQUASHFS_CACHED_BLKS,
+					SQUASHFS_MAX_CACHED_BLKS);
+				return -EINVAL;
+			}
+			msblk->metadata_cache_entries = n;
+			break;
+		case Opt_fragment_cache:
+			if (match_int(&args[0], &n) || n < 1 ||
+					n > SQUASHFS_MAX_CACHED_BLKS) {
+				ERROR("fragment_cache must be 1 to %d\n",
+					SQUASHFS_MAX_CACHED_BLKS);
+				return -EINVAL;
+			}
+			msblk->fragment_cache_entries = n;
+			break;
+		default:
+			WARNING("ignoring unknown mount option \"%s\"\n", p);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+
+static void squashfs_show_cache(struct seq_file *m,
+	struct squashfs_cache *cache)
+{
+	unsigned long hits, misses, waits;
+
+	if (cache == NULL)
+		return;
+
+	spin_lock(&cache->lock);
+	hits = cache->hits;
+	misses = cache->misses;
+	waits = cache->waits;
+	spin_unlock(&cache->lock);
+
+	seq_printf(m, "%s: entries %d hits %lu misses %lu waits %lu\n",
+		cache->name, cache->entries, hits, misses, waits);
+}
+
+
+static int squashfs_stats_show(struct seq_file *m, void *v)
+{
+	struct squashfs_sb_info *msblk = m->private;
+
+	squashfs_show_cache(m, msblk->block_cache);
+	squashfs_show_cache(m, msblk->fragment_cache);
+	squashfs_show_cache(m, msblk->read_page);
+
+	return 0;
+}
+
+
+static int squashfs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, squashfs_stats_show, inode->i_private);
+}
+
+
+static const struct file_operations squashfs_stats_fops = {
+	.open = squashfs_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
 
 static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 	major, short minor, short id)
@@ -101,6 +216,10 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 
 	mutex_init(&msblk->meta_index_mutex);
 
+	err = squashfs_parse_options(msblk, data);
+	if (err)
+		goto failed_mount;
+
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
 	 * are not beyond filesystem end.  But as we're using
@@ -201,7 +320,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			msblk->metadata_cache_entries, SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
@@ -277,7 +396,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto check_directory_table;
 
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		msblk->fragment_cache_entries, msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -329,6 +448,10 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount;
 	}
 
+	if (squashfs_debugfs_root)
+		msblk->debugfs_stats = debugfs_create_file(sb->s_id, 0444,
+			squashfs_debugfs_root, msblk, &squashfs_stats_fops);
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -370,6 +493,21 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static int squashfs_show_options(struct seq_file *m, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	if (msblk->metadata_cache_entries != SQUASHFS_CACHED_BLKS)
+		seq_printf(m, ",metadata_cache=%d",
+			msblk->metadata_cache_entries);
+	if (msblk->fragment_cache_entries != SQUASHFS_CACHED_FRAGMENTS)
+		seq_printf(m, ",fragment_cache=%d",
+			msblk->fragment_cache_entries);
+
+	return 0;
+}
+
+
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	sync_filesystem(sb);
@@ -382,6 +520,7 @@ static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		debugfs_remove(sbi->debugfs_stats);
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
@@ -444,8 +583,13 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	squashfs_debugfs_root = debugfs_create_dir("squashfs", NULL);
+	if (IS_ERR(squashfs_debugfs_root))
+		squashfs_debugfs_root = NULL;
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		debugfs_remove(squashfs_debugfs_root);
 		destroy_inodecache();
 		return err;
 	}
@@ -459,6 +603,7 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	debugfs_remove(squashfs_debugfs_root);
 	destroy_inodecache();
 }
 
@@ -497,6 +642,7 @@ static const struct super_operations squashfs_super_ops = {
 	.alloc_inode = squashfs_alloc_inode,
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
+	.show_options = squashfs_show_options,
 	.put_super = squashfs_put_super,
 	.remount_fs = squashfs_remount
 };
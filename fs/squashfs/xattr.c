@@ -282,3 +282,19 @@ const struct xattr_handler *squashfs_xattr_handlers[] = {
 	NULL
 };
 
+#ifdef CONFIG_SQUASHFS_PIN_XATTR
+/*
+ * Regular files carrying a "trusted.squashfs.pin" xattr in the image keep
+ * their page cache off the evictable LRU, so hot shared libraries aren't
+ * decompressed over and over again under memory pressure.
+ */
+bool squashfs_xattr_pinned(struct inode *inode)
+{
+	if (!squashfs_i(inode)->xattr_count)
+		return false;
+
+	return squashfs_xattr_get(inode, SQUASHFS_XATTR_TRUSTED,
+				  "squashfs.pin", NULL, 0) >= 0;
+}
+#endif
+
@@ -44,3 +44,12 @@ static inline int squashfs_xattr_lookup(struct super_block *sb,
 #define squashfs_listxattr NULL
 #define squashfs_xattr_handlers NULL
 #endif
+
+#ifdef CONFIG_SQUASHFS_PIN_XATTR
+extern bool squashfs_xattr_pinned(struct inode *);
+#else
+static inline bool squashfs_xattr_pinned(struct inode *inode)
+{
+	return false;
+}
+#endif
@@ -78,6 +78,7 @@ static int zstd_uncompress(struct squashfs_sb_info *msblk, void *strm,
 	int k = 0;
 	ZSTD_inBuffer in_buf = { NULL, 0, 0 };
 	ZSTD_outBuffer out_buf = { NULL, 0, 0 };
+	void *linear = squashfs_actor_linear(output);
 
 	stream = ZSTD_initDStream(wksp->window_size, wksp->mem, wksp->mem_size);
 
@@ -88,6 +89,11 @@ static int zstd_uncompress(struct squashfs_sb_info *msblk, void *strm,
 
 	out_buf.size = PAGE_SIZE;
 	out_buf.dst = squashfs_first_page(output);
+	if (linear) {
+		/* Let zstd write the whole block in as few calls as possible */
+		out_buf.size = output->length;
+		out_buf.dst = linear;
+	}
 
 	do {
 		if (in_buf.pos == in_buf.size && k < b) {
@@ -101,7 +107,8 @@ static int zstd_uncompress(struct squashfs_sb_info *msblk, void *strm,
 		}
 
 		if (out_buf.pos == out_buf.size) {
-			out_buf.dst = squashfs_next_page(output);
+			out_buf.dst = linear ? NULL :
+				squashfs_next_page(output);
 			if (out_buf.dst == NULL) {
 				/* Shouldn't run out of pages
 				 * before stream is done.
@@ -0,0 +1,47 @@
+/*
+ * PRU subsystem remote processors of the DA8XX
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_DA8XX_PRU_RPROC_H
+#define _LINUX_DA8XX_PRU_RPROC_H
+
+#include <linux/types.h>
+
+struct rproc;
+
+/* Size of the data RAM of each PRU core */
+#define DA8XX_PRU_RPROC_DRAM_SIZE	512
+
+#if IS_ENABLED(CONFIG_DA8XX_PRU_REMOTEPROC)
+
+struct rproc *da8xx_pru_rproc_get(unsigned int id);
+void __iomem *da8xx_pru_rproc_dram(struct rproc *rproc);
+void da8xx_pru_rproc_set_event_handler(struct rproc *rproc,
+				       void (*handler)(void *data),
+				       void *data);
+
+#else
+
+static inline struct rproc *da8xx_pru_rproc_get(unsigned int id)
+{
+	return NULL;
+}
+
+static inline void __iomem *da8xx_pru_rproc_dram(struct rproc *rproc)
+{
+	return NULL;
+}
+
+static inline void
+da8xx_pru_rproc_set_event_handler(struct rproc *rproc,
+				  void (*handler)(void *data), void *data)
+{
+}
+
+#endif
+
+#endif /* _LINUX_DA8XX_PRU_RPROC_H */
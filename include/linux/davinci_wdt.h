@@ -0,0 +1,65 @@
+/*
+ * Kernel feeders of the DaVinci watchdog
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef LINUX_DAVINCI_WDT_H_
+#define LINUX_DAVINCI_WDT_H_
+
+#include <linux/list.h>
+#include <linux/types.h>
+
+/**
+ * struct davinci_wdt_feeder - kernel loop the watchdog depends on
+ * @name: Name shown in debugfs.
+ * @max_interval_us: Longest time between two feeds before the loop counts as
+ *	stalled.
+ * @list: Private, entry in the list of feeders.
+ * @last_ns: Private, time of the last feed.
+ * @count: Private, number of feeds.
+ * @last_us: Private, interval before the last feed.
+ * @max_us: Private, longest interval between two feeds.
+ * @seen_count: Private, @count at the last check it had changed.
+ * @seen_ns: Private, time of that check.
+ * @stalled: Private, the loop has not fed in time.
+ *
+ * While feeders are registered, the watchdog is serviced from the kernel for
+ * as long as all of them feed in time, whatever userspace does, and it bites
+ * once one of them stops. The private fields other than @list are only
+ * written by davinci_wdt_feed() and by the watchdog checks.
+ */
+struct davinci_wdt_feeder {
+	const char *name;
+	unsigned int max_interval_us;
+
+	struct list_head list;
+	u64 last_ns;
+	u32 count;
+	u32 last_us;
+	u32 max_us;
+	u32 seen_count;
+	u64 seen_ns;
+	bool stalled;
+};
+
+#if IS_ENABLED(CONFIG_DAVINCI_WATCHDOG)
+void davinci_wdt_add_feeder(struct davinci_wdt_feeder *feeder);
+void davinci_wdt_remove_feeder(struct davinci_wdt_feeder *feeder);
+void davinci_wdt_feed(struct davinci_wdt_feeder *feeder);
+#else
+static inline void davinci_wdt_add_feeder(struct davinci_wdt_feeder *feeder)
+{
+}
+
+static inline void davinci_wdt_remove_feeder(struct davinci_wdt_feeder *feeder)
+{
+}
+
+static inline void davinci_wdt_feed(struct davinci_wdt_feeder *feeder)
+{
+}
+#endif
+
+#endif /* LINUX_DAVINCI_WDT_H_ */
@@ -17,11 +17,7 @@
 struct iio_dma_buffer_queue;
 struct iio_dma_buffer_ops;
 struct device;
-
-struct iio_buffer_block {
-	u32 size;
-	u32 bytes_used;
-};
+struct vm_area_struct;
 
 /**
  * enum iio_block_state - State of a struct iio_dma_buffer_block
@@ -143,6 +139,10 @@ size_t iio_dma_buffer_data_available(struct iio_buffer *buffer);
 int iio_dma_buffer_set_bytes_per_datum(struct iio_buffer *buffer, size_t bpd);
 int iio_dma_buffer_set_length(struct iio_buffer *buffer, int length);
 int iio_dma_buffer_request_update(struct iio_buffer *buffer);
+long iio_dma_buffer_ioctl(struct iio_buffer *buffer, unsigned int cmd,
+	unsigned long arg, bool nonblock);
+int iio_dma_buffer_mmap(struct iio_buffer *buffer,
+	struct vm_area_struct *vma);
 
 int iio_dma_buffer_init(struct iio_dma_buffer_queue *queue,
 	struct device *dma_dev, const struct iio_dma_buffer_ops *ops);
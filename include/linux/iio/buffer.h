@@ -11,6 +11,7 @@
 #define _IIO_BUFFER_GENERIC_H_
 #include <linux/sysfs.h>
 #include <linux/iio/iio.h>
+#include <uapi/linux/iio/buffer.h>
 
 struct iio_buffer;
 
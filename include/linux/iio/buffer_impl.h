@@ -8,6 +8,7 @@
 
 struct iio_dev;
 struct iio_buffer;
+struct vm_area_struct;
 
 /**
  * INDIO_BUFFER_FLAG_FIXED_WATERMARK - Watermark level of the buffer can not be
@@ -32,6 +33,10 @@ struct iio_buffer;
  *                      device stops sampling. Calles are balanced with @enable.
  * @release:		called when the last reference to the buffer is dropped,
  *			should free all resources allocated by the buffer.
+ * @ioctl:		handles the block access ioctls of the character device,
+ *			see include/uapi/linux/iio/buffer.h. @nonblock is set
+ *			if the file was opened with O_NONBLOCK.
+ * @mmap:		maps the blocks of the buffer into the application.
  * @modes:		Supported operating modes by this buffer type
  * @flags:		A bitmask combination of INDIO_BUFFER_FLAG_*
  *
@@ -60,6 +65,10 @@ struct iio_buffer_access_funcs {
 
 	void (*release)(struct iio_buffer *buffer);
 
+	long (*ioctl)(struct iio_buffer *buffer, unsigned int cmd,
+		      unsigned long arg, bool nonblock);
+	int (*mmap)(struct iio_buffer *buffer, struct vm_area_struct *vma);
+
 	unsigned int modes;
 	unsigned int flags;
 };
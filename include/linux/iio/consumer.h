@@ -215,6 +215,35 @@ int iio_read_channel_average_raw(struct iio_channel *chan, int *val);
  */
 int iio_read_channel_processed(struct iio_channel *chan, int *val);
 
+/**
+ * iio_read_channels_raw() - read several channels at once
+ * @chans:		The channels being queried.
+ * @num:		Number of channels in @chans.
+ * @vals:		Values read back, in the order of @chans.
+ *
+ * Returns an error code or 0.
+ *
+ * If all channels belong to the same device and that device can read them
+ * together, they are sampled in a single conversion, so the values are
+ * coherent. Otherwise, the channels are read one after the other.
+ */
+int iio_read_channels_raw(struct iio_channel *const *chans, unsigned int num,
+			  int *vals);
+
+/**
+ * iio_read_channels_processed() - read processed values of several channels
+ * @chans:		The channels being queried.
+ * @num:		Number of channels in @chans.
+ * @vals:		Values read back, in the order of @chans.
+ *
+ * Returns an error code or 0.
+ *
+ * Like iio_read_channels_raw(), with the scale and offset of each channel
+ * applied as in iio_read_channel_processed().
+ */
+int iio_read_channels_processed(struct iio_channel *const *chans,
+				unsigned int num, int *vals);
+
 /**
  * iio_write_channel_raw() - write to a given channel
  * @chan:		The channel being queried.
@@ -386,6 +386,11 @@ struct iio_dev;
  *			max_len specifies maximum number of elements
  *			vals pointer can contain. val_len is used to return
  *			length of valid elements in vals.
+ * @read_raw_channels:	function to read the raw values of several
+ *			channels of the device at once, in a single conversion
+ *			when the hardware allows. chans holds num channels
+ *			and vals gets the num values in the same order.
+ *			Returns 0 or an error code.
  * @read_avail:		function to return the available values from the device.
  *			mask specifies which value. Note 0 means the available
  *			values for the channel in question.  Return value
@@ -442,6 +447,11 @@ struct iio_info {
 			int *val_len,
 			long mask);
 
+	int (*read_raw_channels)(struct iio_dev *indio_dev,
+			struct iio_chan_spec const *const *chans,
+			unsigned int num,
+			int *vals);
+
 	int (*read_avail)(struct iio_dev *indio_dev,
 			  struct iio_chan_spec const *chan,
 			  const int **vals,
@@ -0,0 +1,62 @@
+/*
+ * Performance dashboard for the LEGO MINDSTORMS EV3
+ *
+ * Drivers that keep performance counters register a source, which shows
+ * up as ev3/perf/<name> in debugfs. Reading ev3/perf/snapshot prints all
+ * sources at once and writing to ev3/perf/reset clears all of them, so that
+ * the counters of the whole system cover the same interval.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_LEGOEV3_PERF_H
+#define _LINUX_LEGOEV3_PERF_H
+
+#include <linux/list.h>
+#include <linux/types.h>
+
+struct dentry;
+struct seq_file;
+
+/**
+ * struct legoev3_perf_source - a set of counters on the dashboard
+ * @name: file name in ev3/perf and section title in the snapshot
+ * @show: prints the counters, one "key: value" or table per line.
+ *	@interval_ns is the time since they were last reset, for rates.
+ * @reset: clears the counters, may be NULL if there is nothing to clear
+ * @data: passed to @show and @reset
+ * @node: entry in the list of sources, private to the dashboard
+ * @dentry: the debugfs file, private to the dashboard
+ * @reset_ns: when @reset was last called, private to the dashboard
+ *
+ * @show and @reset are called from process context, with the dashboard
+ * mutex held, and take whatever lock protects the counters themselves.
+ */
+struct legoev3_perf_source {
+	char name[32];
+	void (*show)(struct seq_file *s, void *data, u64 interval_ns);
+	void (*reset)(void *data);
+	void *data;
+
+	struct list_head node;
+	struct dentry *dentry;
+	u64 reset_ns;
+};
+
+#ifdef CONFIG_LEGOEV3_PERF
+int legoev3_perf_register(struct legoev3_perf_source *src);
+void legoev3_perf_unregister(struct legoev3_perf_source *src);
+#else
+static inline int legoev3_perf_register(struct legoev3_perf_source *src)
+{
+	return 0;
+}
+
+static inline void legoev3_perf_unregister(struct legoev3_perf_source *src)
+{
+}
+#endif
+
+#endif /* _LINUX_LEGOEV3_PERF_H */
@@ -9,6 +9,7 @@
 #define LINUX_MMC_CORE_H
 
 #include <linux/completion.h>
+#include <linux/ktime.h>
 #include <linux/types.h>
 
 struct mmc_data;
@@ -168,6 +169,8 @@ struct mmc_request {
 	bool			cap_cmd_during_tfr;
 
 	int			tag;
+
+	ktime_t			start_time;	/* for statistics */
 };
 
 struct mmc_card;
@@ -255,6 +255,38 @@ struct mmc_supply {
 	struct regulator *vqmmc;	/* Optional Vccq supply */
 };
 
+/*
+ * Request latencies are counted in power-of-two microsecond buckets: bucket
+ * 0 for less than 1 us, bucket n for less than 2^n us, and the last one for
+ * everything slower.
+ */
+#define MMC_STATS_LAT_BUCKETS	20
+
+/**
+ * struct mmc_host_stats - request statistics of a host
+ * @bytes_read: data bytes transferred by read requests
+ * @bytes_written: data bytes transferred by write requests
+ * @errors: requests completed with an error in any of their commands
+ * @busy_waits: number of times the core polled the card for busy
+ * @busy_ns: time spent in those polls
+ * @lat_read: latency histogram of read requests
+ * @lat_write: latency histogram of write requests
+ * @lat_cmd: latency histogram of requests without data
+ *
+ * Updated as requests complete, without locking; they are shown and reset
+ * through the "stats" file in the host's debugfs directory.
+ */
+struct mmc_host_stats {
+	u64		bytes_read;
+	u64		bytes_written;
+	unsigned long	errors;
+	unsigned long	busy_waits;
+	u64		busy_ns;
+	unsigned long	lat_read[MMC_STATS_LAT_BUCKETS];
+	unsigned long	lat_write[MMC_STATS_LAT_BUCKETS];
+	unsigned long	lat_cmd[MMC_STATS_LAT_BUCKETS];
+};
+
 struct mmc_host {
 	struct device		*parent;
 	struct device		class_dev;
@@ -427,6 +459,8 @@ struct mmc_host {
 
 	unsigned int		actual_clock;	/* Actual HC clock rate */
 
+	struct mmc_host_stats	stats;
+
 	unsigned int		slotno;	/* used for sdio acpi binding */
 
 	int			dsr_req;	/* DSR value is valid */
@@ -81,6 +81,13 @@ struct edma_soc_info {
 	s8	(*queue_priority_mapping)[2];
 	const s16	(*xbar_chans)[2];
 
+	/*
+	 * {channel, event queue} pairs of channels that always use the given
+	 * queue instead of the default one, terminated with {-1, -1}. This
+	 * keeps latency sensitive streams off the queue carrying bulk traffic.
+	 */
+	const s16	(*chan_queue_mapping)[2];
+
 	const struct dma_slave_map *slave_map;
 	int slavecnt;
 };
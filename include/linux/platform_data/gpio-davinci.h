@@ -32,6 +32,8 @@ struct davinci_gpio_irq_data {
 	void __iomem			*regs;
 	struct davinci_gpio_controller	*chip;
 	int				bank_num;
+	/* Linux IRQ of each of the bank's 16 GPIOs, for the demux */
+	unsigned int			irqs[16];
 };
 
 struct davinci_gpio_controller {
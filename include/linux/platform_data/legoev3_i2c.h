@@ -43,4 +43,7 @@ struct i2c_legoev3_platform_data {
 
 extern const struct i2c_algorithm i2c_legoev3_algo;
 
+extern int legoev3_register_in_port_i2c(enum legoev3_input_port_id port_id);
+extern void legoev3_unregister_in_port_i2c(enum legoev3_input_port_id port_id);
+
 #endif /* _LINUX_I2C_LEGOEV3_H */
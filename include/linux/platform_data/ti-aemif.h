@@ -20,4 +20,43 @@ struct aemif_platform_data {
 	struct of_dev_auxdata *dev_lookup;
 };
 
+/**
+ * struct aemif_cs_timings - timings of an asynchronous device, all in ns
+ * @ta: minimum turn around time
+ * @rhold: read hold width
+ * @rstrobe: read strobe width
+ * @rsetup: read setup width
+ * @whold: write hold width
+ * @wstrobe: write strobe width
+ * @wsetup: write setup width
+ */
+struct aemif_cs_timings {
+	u32	ta;
+	u32	rhold;
+	u32	rstrobe;
+	u32	rsetup;
+	u32	whold;
+	u32	wstrobe;
+	u32	wsetup;
+};
+
+#if IS_ENABLED(CONFIG_TI_AEMIF)
+int aemif_set_cs_timings(struct device *dev, unsigned int cs,
+			 const struct aemif_cs_timings *timings);
+int aemif_read_dma(struct device *dev, void *buf, phys_addr_t src,
+		   size_t len);
+#else
+static inline int aemif_set_cs_timings(struct device *dev, unsigned int cs,
+				       const struct aemif_cs_timings *timings)
+{
+	return -ENODEV;
+}
+
+static inline int aemif_read_dma(struct device *dev, void *buf,
+				 phys_addr_t src, size_t len)
+{
+	return -ENODEV;
+}
+#endif
+
 #endif /* __TI_DAVINCI_AEMIF_DATA_H__ */
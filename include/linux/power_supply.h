@@ -193,6 +193,15 @@ struct power_supply_config {
 };
 
 /* Description of power supply */
+/*
+ * A change uevent is only worth sending if the property moved by at least
+ * delta since the last one. A delta of 0 means any change.
+ */
+struct power_supply_uevent_threshold {
+	enum power_supply_property psp;
+	int delta;
+};
+
 struct power_supply_desc {
 	const char *name;
 	enum power_supply_type type;
@@ -229,6 +238,16 @@ struct power_supply_desc {
 	bool no_thermal;
 	/* For APM emulation, think legacy userspace. */
 	int use_for_apm;
+
+	/*
+	 * Rate limiting of the change uevents, which make userspace re-read
+	 * all properties: at most one every uevent_min_interval_ms, and if
+	 * uevent_thresholds are given, only when one of these properties
+	 * moved by its delta. Notifiers and supplicants are not affected.
+	 */
+	unsigned int uevent_min_interval_ms;
+	const struct power_supply_uevent_threshold *uevent_thresholds;
+	size_t num_uevent_thresholds;
 };
 
 struct power_supply {
@@ -248,6 +267,9 @@ struct power_supply {
 	struct device dev;
 	struct work_struct changed_work;
 	struct delayed_work deferred_register_work;
+	struct delayed_work uevent_work;
+	unsigned long uevent_last;	/* jiffies */
+	bool uevent_sent;
 	spinlock_t changed_lock;
 	bool changed;
 	bool initialized;
@@ -269,6 +291,9 @@ struct power_supply {
 	struct led_trigger *charging_blink_full_solid_trig;
 	char *charging_blink_full_solid_trig_name;
 #endif
+
+	/* uevent_thresholds properties at the last uevent */
+	int uevent_values[];
 };
 
 /*
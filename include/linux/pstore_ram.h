@@ -77,6 +77,7 @@ void persistent_ram_save_old(struct persistent_ram_zone *prz);
 size_t persistent_ram_old_size(struct persistent_ram_zone *prz);
 void *persistent_ram_old(struct persistent_ram_zone *prz);
 void persistent_ram_free_old(struct persistent_ram_zone *prz);
+void *persistent_ram_claim_raw(struct persistent_ram_zone *prz, size_t *size);
 ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
 	char *str, size_t len);
 
@@ -96,9 +97,87 @@ struct ramoops_platform_data {
 	unsigned long	console_size;
 	unsigned long	ftrace_size;
 	unsigned long	pmsg_size;
+	unsigned long	irqtrace_size;
 	int		dump_oops;
 	u32		flags;
 	struct persistent_ram_ecc_info ecc_info;
 };
 
+/*
+ * IRQ trace zone
+ *
+ * Rings of fixed size records that are written straight from the FIQ
+ * handler and the IRQ entry code, without locks or ECC, so that the last
+ * interrupts before a hang or watchdog reset can be read back from
+ * irqtrace-ramoops-0 after the next boot. Each ring has exactly one writer
+ * context, which is what makes the lockless update safe on a single CPU.
+ */
+enum ramoops_irqtrace_ring {
+	RAMOOPS_IRQTRACE_FIQ,
+	RAMOOPS_IRQTRACE_IRQ,
+	RAMOOPS_IRQTRACE_NUM_RINGS
+};
+
+#define RAMOOPS_IRQTRACE_SIG	0x49525154 /* IRQT */
+
+/**
+ * struct ramoops_irqtrace_entry - one traced interrupt
+ * @timestamp:	free-running clocksource ticks at entry
+ * @irq:	hardware interrupt number
+ * @data:	status words chosen by the writer of the ring
+ */
+struct ramoops_irqtrace_entry {
+	u32 timestamp;
+	u32 irq;
+	u32 data[2];
+};
+
+struct ramoops_irqtrace {
+	u32 sig;
+	u32 mask;
+	u32 head;
+	u32 reserved;
+	struct ramoops_irqtrace_entry entries[0];
+};
+
+#ifdef CONFIG_PSTORE_IRQTRACE
+extern struct ramoops_irqtrace *ramoops_irqtrace[RAMOOPS_IRQTRACE_NUM_RINGS];
+
+/* Returns NULL until ramoops has set up the zone */
+static inline struct ramoops_irqtrace *
+ramoops_irqtrace_get(enum ramoops_irqtrace_ring ring)
+{
+	return READ_ONCE(ramoops_irqtrace[ring]);
+}
+
+static inline void ramoops_irqtrace_add(struct ramoops_irqtrace *trace,
+					u32 timestamp, u32 irq,
+					u32 data0, u32 data1)
+{
+	u32 head = trace->head;
+	struct ramoops_irqtrace_entry *entry =
+		&trace->entries[head & trace->mask];
+
+	entry->timestamp = timestamp;
+	entry->irq = irq;
+	entry->data[0] = data0;
+	entry->data[1] = data1;
+	/* the entry must be complete before it shows up as the newest one */
+	barrier();
+	WRITE_ONCE(trace->head, head + 1);
+}
+#else
+static inline struct ramoops_irqtrace *
+ramoops_irqtrace_get(enum ramoops_irqtrace_ring ring)
+{
+	return NULL;
+}
+
+static inline void ramoops_irqtrace_add(struct ramoops_irqtrace *trace,
+					u32 timestamp, u32 irq,
+					u32 data0, u32 data1)
+{
+}
+#endif
+
 #endif
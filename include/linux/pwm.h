@@ -254,6 +254,11 @@ pwm_set_relative_duty_cycle(struct pwm_state *state, unsigned int duty_cycle,
  * @get_state: get the current PWM state. This function is only
  *	       called once per PWM device when the PWM chip is
  *	       registered.
+ * @apply_multiple: optional hook to apply new states to several PWMs of
+ *		    the chip so that they all take effect in the same period.
+ *		    May return -ENOTSUPP for a combination of states it
+ *		    cannot apply atomically, in which case the core applies
+ *		    them one PWM at a time.
  * @dbg_show: optional routine to show contents in debugfs
  * @owner: helps prevent removal of modules exporting active PWMs
  */
@@ -272,6 +277,8 @@ struct pwm_ops {
 		     struct pwm_state *state);
 	void (*get_state)(struct pwm_chip *chip, struct pwm_device *pwm,
 			  struct pwm_state *state);
+	int (*apply_multiple)(struct pwm_chip *chip, struct pwm_device **pwms,
+			      struct pwm_state *states, unsigned int num);
 #ifdef CONFIG_DEBUG_FS
 	void (*dbg_show)(struct pwm_chip *chip, struct seq_file *s);
 #endif
@@ -318,6 +325,8 @@ struct pwm_capture {
 struct pwm_device *pwm_request(int pwm_id, const char *label);
 void pwm_free(struct pwm_device *pwm);
 int pwm_apply_state(struct pwm_device *pwm, struct pwm_state *state);
+int pwm_apply_states(struct pwm_device **pwms, struct pwm_state *states,
+		     unsigned int num);
 int pwm_adjust_config(struct pwm_device *pwm);
 
 /**
@@ -465,6 +474,12 @@ static inline int pwm_apply_state(struct pwm_device *pwm,
 	return -ENOTSUPP;
 }
 
+static inline int pwm_apply_states(struct pwm_device **pwms,
+				   struct pwm_state *states, unsigned int num)
+{
+	return -ENOTSUPP;
+}
+
 static inline int pwm_adjust_config(struct pwm_device *pwm)
 {
 	return -ENOTSUPP;
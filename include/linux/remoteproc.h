@@ -412,6 +412,9 @@ enum rproc_crash_type {
  * @table_ptr: pointer to the resource table in effect
  * @cached_table: copy of the resource table
  * @has_iommu: flag to indicate if remote processor is behind an MMU
+ * @local_vrings: vrings with a fixed device address are placed in the
+ *	remote processor's own memory, as found by ->da_to_va(), instead of
+ *	being allocated from DMA memory
  */
 struct rproc {
 	struct list_head node;
@@ -444,6 +447,7 @@ struct rproc {
 	struct resource_table *cached_table;
 	bool has_iommu;
 	bool auto_boot;
+	bool local_vrings;
 };
 
 /**
@@ -473,6 +477,8 @@ struct rproc_subdev {
  * @notifyid: rproc-specific unique vring index
  * @rvdev: remote vdev
  * @vq: the virtqueue of this vring
+ * @local: the vring is in the remote processor's memory, see
+ *	&rproc.local_vrings
  */
 struct rproc_vring {
 	void *va;
@@ -483,6 +489,7 @@ struct rproc_vring {
 	int notifyid;
 	struct rproc_vdev *rvdev;
 	struct virtqueue *vq;
+	bool local;
 };
 
 /**
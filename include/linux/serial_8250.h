@@ -100,6 +100,7 @@ struct uart_8250_port {
 	u32			capabilities;	/* port capabilities */
 	unsigned short		bugs;		/* port bugs */
 	bool			fifo_bug;	/* min RX trigger if enabled */
+	unsigned int		rx_lowlat_baud;	/* min RX trigger below */
 	unsigned int		tx_loadsz;	/* transmit fifo load size */
 	unsigned char		acr;
 	unsigned char		fcr;
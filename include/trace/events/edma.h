@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM edma
+
+#if !defined(_TRACE_EDMA_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_EDMA_H
+
+#include <linux/dmaengine.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(edma_desc,
+
+	TP_PROTO(int ch_num, dma_cookie_t cookie, u32 len, u64 ns),
+
+	TP_ARGS(ch_num, cookie, len, ns),
+
+	TP_STRUCT__entry(
+		__field(        int,            ch_num          )
+		__field(        dma_cookie_t,   cookie          )
+		__field(        u32,            len             )
+		__field(        u64,            ns              )
+	),
+
+	TP_fast_assign(
+		__entry->ch_num = ch_num;
+		__entry->cookie = cookie;
+		__entry->len = len;
+		__entry->ns = ns;
+	),
+
+	TP_printk("edma%d:%d cookie=%d len=%u %llu ns",
+		  (int)(__entry->ch_num >> 16), (int)(__entry->ch_num & 0xffff),
+		  (int)__entry->cookie, (unsigned int)__entry->len,
+		  (unsigned long long)__entry->ns)
+);
+
+/* the descriptor was started, @ns after it was submitted */
+DEFINE_EVENT(edma_desc, edma_desc_start,
+
+	TP_PROTO(int ch_num, dma_cookie_t cookie, u32 len, u64 ns),
+
+	TP_ARGS(ch_num, cookie, len, ns)
+
+);
+
+/* the descriptor completed, @ns after it was started */
+DEFINE_EVENT(edma_desc, edma_desc_complete,
+
+	TP_PROTO(int ch_num, dma_cookie_t cookie, u32 len, u64 ns),
+
+	TP_ARGS(ch_num, cookie, len, ns)
+
+);
+
+#endif /* _TRACE_EDMA_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
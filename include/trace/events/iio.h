@@ -0,0 +1,58 @@
+/*
+ * IIO buffer tracepoints
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM iio
+
+#if !defined(_TRACE_IIO_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_IIO_H
+
+#include <linux/iio/iio.h>
+#include <linux/tracepoint.h>
+
+/*
+ * iio_push_to_buffers(), a scan was handed to the buffers of the device
+ */
+TRACE_EVENT(iio_buffer_push,
+	TP_PROTO(struct iio_dev *indio_dev),
+	TP_ARGS(indio_dev),
+	TP_STRUCT__entry(
+		__field(int,		id)
+		__string(name,		indio_dev->name)
+	),
+	TP_fast_assign(
+		__entry->id = indio_dev->id;
+		__assign_str(name, indio_dev->name);
+	),
+	TP_printk("iio:device%d name=%s", __entry->id, __get_str(name))
+);
+
+/*
+ * iio_buffer_read_first_n_outer(), just before returning to the reader.
+ * ret is the number of bytes read or a negative error code.
+ */
+TRACE_EVENT(iio_buffer_read,
+	TP_PROTO(struct iio_dev *indio_dev, ssize_t ret),
+	TP_ARGS(indio_dev, ret),
+	TP_STRUCT__entry(
+		__field(int,		id)
+		__field(ssize_t,	ret)
+		__string(name,		indio_dev->name)
+	),
+	TP_fast_assign(
+		__entry->id = indio_dev->id;
+		__entry->ret = ret;
+		__assign_str(name, indio_dev->name);
+	),
+	TP_printk("iio:device%d name=%s ret=%zd", __entry->id,
+		  __get_str(name), __entry->ret)
+);
+
+#endif /* _TRACE_IIO_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,157 @@
+/*
+ * Tracepoints for the LEGO Mindstorms EV3 FIQ I2C and sound backend
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM legoev3_fiq
+
+#if !defined(_TRACE_LEGOEV3_FIQ_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LEGOEV3_FIQ_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * All timestamps are ticks of the DaVinci free-running counter, taken by the
+ * FIQ where it says so, so that latencies can be told apart from the delays
+ * of the status gpio interrupt.
+ */
+
+/*
+ * legoev3_fiq_start_xfer(), after the transaction was queued
+ */
+TRACE_EVENT(legoev3_fiq_i2c_start,
+	TP_PROTO(unsigned port, unsigned num_msg, unsigned wlen, unsigned rlen,
+		 unsigned queued, u32 timestamp),
+	TP_ARGS(port, num_msg, wlen, rlen, queued, timestamp),
+	TP_STRUCT__entry(
+		__field(u8,	port)
+		__field(u8,	num_msg)
+		__field(u16,	wlen)
+		__field(u16,	rlen)
+		__field(u8,	queued)
+		__field(u32,	timestamp)
+	),
+	TP_fast_assign(
+		__entry->port = port;
+		__entry->num_msg = num_msg;
+		__entry->wlen = wlen;
+		__entry->rlen = rlen;
+		__entry->queued = queued;
+		__entry->timestamp = timestamp;
+	),
+	TP_printk("port=%u msgs=%u wlen=%u rlen=%u queued=%u ts=%u",
+		  __entry->port, __entry->num_msg, __entry->wlen,
+		  __entry->rlen, __entry->queued, __entry->timestamp)
+);
+
+DECLARE_EVENT_CLASS(legoev3_fiq_i2c_done,
+	TP_PROTO(unsigned port, unsigned num_msg, unsigned wlen, unsigned rlen,
+		 int result, u32 queued_ts, u32 start_ts, u32 end_ts, u32 now),
+	TP_ARGS(port, num_msg, wlen, rlen, result, queued_ts, start_ts, end_ts,
+		now),
+	TP_STRUCT__entry(
+		__field(u8,	port)
+		__field(u8,	num_msg)
+		__field(u16,	wlen)
+		__field(u16,	rlen)
+		__field(int,	result)
+		__field(u32,	queued_ts)
+		__field(u32,	start_ts)
+		__field(u32,	end_ts)
+		__field(u32,	now)
+	),
+	TP_fast_assign(
+		__entry->port = port;
+		__entry->num_msg = num_msg;
+		__entry->wlen = wlen;
+		__entry->rlen = rlen;
+		__entry->result = result;
+		__entry->queued_ts = queued_ts;
+		__entry->start_ts = start_ts;
+		__entry->end_ts = end_ts;
+		__entry->now = now;
+	),
+	TP_printk("port=%u msgs=%u wlen=%u rlen=%u result=%d wait=%u bus=%u notify=%u",
+		  __entry->port, __entry->num_msg, __entry->wlen,
+		  __entry->rlen, __entry->result,
+		  __entry->start_ts - __entry->queued_ts,
+		  __entry->end_ts - __entry->start_ts,
+		  __entry->now - __entry->end_ts)
+);
+
+/*
+ * Status gpio interrupt, before complete() is called. wait is the time the
+ * transaction spent in the queue, bus the time the FIQ spent on it and
+ * notify the time until the interrupt got to it, all in ticks.
+ */
+DEFINE_EVENT(legoev3_fiq_i2c_done, legoev3_fiq_i2c_complete,
+	TP_PROTO(unsigned port, unsigned num_msg, unsigned wlen, unsigned rlen,
+		 int result, u32 queued_ts, u32 start_ts, u32 end_ts, u32 now),
+	TP_ARGS(port, num_msg, wlen, rlen, result, queued_ts, start_ts, end_ts,
+		now)
+);
+
+/*
+ * Same as legoev3_fiq_i2c_complete, only for transactions that were not
+ * acknowledged
+ */
+DEFINE_EVENT(legoev3_fiq_i2c_done, legoev3_fiq_i2c_nack,
+	TP_PROTO(unsigned port, unsigned num_msg, unsigned wlen, unsigned rlen,
+		 int result, u32 queued_ts, u32 start_ts, u32 end_ts, u32 now),
+	TP_ARGS(port, num_msg, wlen, rlen, result, queued_ts, start_ts, end_ts,
+		now)
+);
+
+/*
+ * legoev3_fiq_cancel_xfer(), pending is the number of transactions that were
+ * dropped without their complete() being called
+ */
+TRACE_EVENT(legoev3_fiq_i2c_cancel,
+	TP_PROTO(unsigned port, unsigned pending, bool active),
+	TP_ARGS(port, pending, active),
+	TP_STRUCT__entry(
+		__field(u8,	port)
+		__field(u8,	pending)
+		__field(bool,	active)
+	),
+	TP_fast_assign(
+		__entry->port = port;
+		__entry->pending = pending;
+		__entry->active = active;
+	),
+	TP_printk("port=%u pending=%u active=%d",
+		  __entry->port, __entry->pending, __entry->active)
+);
+
+/*
+ * Status gpio interrupt, before snd_pcm_period_elapsed() is called. The FIQ
+ * timestamp is the end of the period, or the point where it ran out of data
+ * when starved is set, i.e. an underrun.
+ */
+TRACE_EVENT(legoev3_fiq_period_elapsed,
+	TP_PROTO(unsigned long hw_frames, bool starved, u32 fiq_ts, u32 now),
+	TP_ARGS(hw_frames, starved, fiq_ts, now),
+	TP_STRUCT__entry(
+		__field(unsigned long,	hw_frames)
+		__field(bool,		starved)
+		__field(u32,		fiq_ts)
+		__field(u32,		now)
+	),
+	TP_fast_assign(
+		__entry->hw_frames = hw_frames;
+		__entry->starved = starved;
+		__entry->fiq_ts = fiq_ts;
+		__entry->now = now;
+	),
+	TP_printk("hw_frames=%lu starved=%d notify=%u",
+		  __entry->hw_frames, __entry->starved,
+		  __entry->now - __entry->fiq_ts)
+);
+
+#endif /* _TRACE_LEGOEV3_FIQ_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
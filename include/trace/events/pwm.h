@@ -0,0 +1,48 @@
+/*
+ * PWM tracepoints
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pwm
+
+#if !defined(_TRACE_PWM_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_PWM_H
+
+#include <linux/pwm.h>
+#include <linux/tracepoint.h>
+
+/*
+ * A new state was written to the hardware by pwm_apply_state() or
+ * pwm_apply_states()
+ */
+TRACE_EVENT(pwm_apply,
+	TP_PROTO(struct pwm_device *pwm, const struct pwm_state *state),
+	TP_ARGS(pwm, state),
+	TP_STRUCT__entry(
+		__string(chip,		dev_name(pwm->chip->dev))
+		__field(unsigned int,	hwpwm)
+		__field(unsigned int,	period)
+		__field(unsigned int,	duty_cycle)
+		__field(int,		polarity)
+		__field(bool,		enabled)
+	),
+	TP_fast_assign(
+		__assign_str(chip, dev_name(pwm->chip->dev));
+		__entry->hwpwm = pwm->hwpwm;
+		__entry->period = state->period;
+		__entry->duty_cycle = state->duty_cycle;
+		__entry->polarity = state->polarity;
+		__entry->enabled = state->enabled;
+	),
+	TP_printk("%s:%u period=%u duty_cycle=%u polarity=%d enabled=%d",
+		  __get_str(chip), __entry->hwpwm, __entry->period,
+		  __entry->duty_cycle, __entry->polarity, __entry->enabled)
+);
+
+#endif /* _TRACE_PWM_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -183,6 +183,8 @@ extern "C" {
 #define DRM_FORMAT_MOD_VENDOR_QCOM    0x05
 #define DRM_FORMAT_MOD_VENDOR_VIVANTE 0x06
 #define DRM_FORMAT_MOD_VENDOR_BROADCOM 0x07
+/* not allocated upstream, kept clear of the ids handed out there */
+#define DRM_FORMAT_MOD_VENDOR_SITRONIX 0xf0
 /* add more to the end as needed */
 
 #define DRM_FORMAT_RESERVED	      ((1ULL << 56) - 1)
@@ -403,6 +405,20 @@ extern "C" {
  */
 #define DRM_FORMAT_MOD_BROADCOM_VC4_T_TILED fourcc_mod_code(BROADCOM, 1)
 
+/*
+ * Sitronix ST7586 packed grayscale
+ *
+ * Only valid with DRM_FORMAT_R8. Each byte holds three pixels the way the
+ * ST7586 stores them in its display RAM in 4-level gray mode: the first pixel
+ * in bits 7-5, the second in bits 4-2 and the third in bits 1-0. The 3-bit
+ * fields are 0b000 (white), 0b010, 0b100 or 0b111 (black), the 2-bit field
+ * 0b00 (white), 0b01, 0b10 or 0b11 (black).
+ *
+ * A line takes DIV_ROUND_UP(width, 3) bytes from its start. The pitch must
+ * still be at least width bytes, as for plain R8.
+ */
+#define DRM_FORMAT_MOD_SITRONIX_ST7586_PACKED fourcc_mod_code(SITRONIX, 1)
+
 #if defined(__cplusplus)
 }
 #endif
@@ -18,6 +18,7 @@
 /* For O_CLOEXEC */
 #include <linux/fcntl.h>
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
@@ -78,6 +79,21 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * Wakeup coalescing for an epoll file descriptor: epoll_wait() does not
+ * return until at least min_events items are ready, or until timeout_us
+ * microseconds after the first of them became ready. A min_events of 0 or
+ * 1 turns coalescing off. The epoll_wait() timeout still applies.
+ */
+struct epoll_coalesce {
+	__u32 min_events;
+	__u32 timeout_us;
+};
+
+#define EPOLL_IOC_TYPE	0x8A
+#define EPIOCSCOALESCE	_IOW(EPOLL_IOC_TYPE, 0x10, struct epoll_coalesce)
+#define EPIOCGCOALESCE	_IOR(EPOLL_IOC_TYPE, 0x11, struct epoll_coalesce)
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/* industrial I/O - block based access to buffers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+#ifndef _UAPI_IIO_BUFFER_H_
+#define _UAPI_IIO_BUFFER_H_
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/**
+ * struct iio_buffer_block - Description of a buffer block
+ * @id:		index of the block, from 0 to the number of blocks minus one
+ * @size:	size of the block in bytes
+ * @bytes_used:	number of bytes holding samples, only valid for a dequeued
+ *		block
+ * @flags:	reserved, must be zero
+ * @offset:	offset to pass to mmap() on the buffer character device to
+ *		map the block
+ *
+ * Blocks of buffers that support it can be mapped into the application and
+ * the samples read in place. The blocks are exchanged between the kernel and
+ * the application with the ioctls below:
+ *
+ * IIO_BUFFER_BLOCK_QUERY_IOCTL fills in the description of the block @id.
+ *
+ * IIO_BUFFER_BLOCK_DEQUEUE_IOCTL hands the next block filled with samples to
+ * the application. It sleeps until one is available unless the file was
+ * opened with O_NONBLOCK, in which case it fails with EAGAIN.
+ *
+ * IIO_BUFFER_BLOCK_ENQUEUE_IOCTL gives block @id back to the kernel once the
+ * application is done with its samples.
+ *
+ * The blocks are allocated when the buffer is enabled and stay valid until it
+ * is enabled again with a different length or scan. Block access and read()
+ * should not be mixed on the same buffer.
+ */
+struct iio_buffer_block {
+	__u32	id;
+	__u32	size;
+	__u32	bytes_used;
+	__u32	flags;
+	__u64	offset;
+};
+
+#define IIO_BUFFER_BLOCK_QUERY_IOCTL _IOWR('i', 0xa2, struct iio_buffer_block)
+#define IIO_BUFFER_BLOCK_ENQUEUE_IOCTL _IOW('i', 0xa3, struct iio_buffer_block)
+#define IIO_BUFFER_BLOCK_DEQUEUE_IOCTL _IOR('i', 0xa4, struct iio_buffer_block)
+
+#endif /* _UAPI_IIO_BUFFER_H_ */
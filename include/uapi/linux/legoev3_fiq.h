@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Shared memory layout of the LEGO Mindstorms EV3 FIQ I2C backend
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _UAPI_LINUX_LEGOEV3_FIQ_H
+#define _UAPI_LINUX_LEGOEV3_FIQ_H
+
+#include <linux/types.h>
+
+#define LEGOEV3_FIQ_PERIODIC_NUM_PORTS	4
+#define LEGOEV3_FIQ_PERIODIC_MAX_LEN	32
+
+/**
+ * struct legoev3_fiq_periodic_slot - result of the periodic transfer of a port
+ * @seq: Incremented each time a transfer has finished. 0 means that there is
+ *	no data yet.
+ * @len: Number of bytes that are read by each transfer.
+ * @result: 0 or a negative error code for buf[0] and buf[1].
+ * @buf: The data. The latest transfer is in buf[seq & 1].
+ *
+ * The FIQ writes the back buffer, buf[(seq + 1) & 1], and then increments
+ * seq. To get a consistent copy, read seq, copy buf[seq & 1] and
+ * result[seq & 1], then read seq again and start over if it has changed.
+ */
+struct legoev3_fiq_periodic_slot {
+	__u32 seq;
+	__u32 len;
+	__s32 result[2];
+	__u8 buf[2][LEGOEV3_FIQ_PERIODIC_MAX_LEN];
+};
+
+/*
+ * Layout of the read-only page that can be mmap()ed from the "periodic"
+ * attribute of the legoev3-fiq platform device in sysfs.
+ */
+struct legoev3_fiq_periodic_page {
+	struct legoev3_fiq_periodic_slot port[LEGOEV3_FIQ_PERIODIC_NUM_PORTS];
+};
+
+#endif /* _UAPI_LINUX_LEGOEV3_FIQ_H */
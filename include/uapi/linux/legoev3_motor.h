@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Synchronized setpoint queue of the LEGO Mindstorms EV3 motor driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _UAPI_LINUX_LEGOEV3_MOTOR_H
+#define _UAPI_LINUX_LEGOEV3_MOTOR_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define LEGOEV3_MOTOR_NUM_PORTS		4
+#define LEGOEV3_MOTOR_QUEUE_LEN		64
+
+/* Modes, as in the "mode" attribute of the legoev3-motor devices */
+#define LEGOEV3_MOTOR_MODE_OFF		0
+#define LEGOEV3_MOTOR_MODE_BRAKE	1
+#define LEGOEV3_MOTOR_MODE_DUTY		2
+#define LEGOEV3_MOTOR_MODE_SPEED	3
+#define LEGOEV3_MOTOR_MODE_POSITION	4
+
+/**
+ * struct legoev3_motor_setpoint - new setpoint of one output port
+ * @port: The output port, 0 to LEGOEV3_MOTOR_NUM_PORTS - 1.
+ * @mode: One of the LEGOEV3_MOTOR_MODE_* values.
+ * @value: duty_cycle_sp, speed_sp or position_sp for the duty, speed and
+ *	position modes, ignored otherwise.
+ * @reserved: Must be 0.
+ */
+struct legoev3_motor_setpoint {
+	__u32 port;
+	__u32 mode;
+	__s32 value;
+	__u32 reserved;
+};
+
+/**
+ * struct legoev3_motor_cmd - setpoints to apply at the same time
+ * @time: When to apply them, in ticks of the DaVinci free-running counter
+ *	(see /dev/davinci-freerun). Times within 2^31 ticks in the past are
+ *	due right away.
+ * @num_setpoints: Number of entries used in @setpoints.
+ * @setpoints: The setpoints, at most one per port.
+ *
+ * All setpoints of a command are applied on the same regulation tick,
+ * before any of the motors is updated.
+ */
+struct legoev3_motor_cmd {
+	__u32 time;
+	__u32 num_setpoints;
+	struct legoev3_motor_setpoint setpoints[LEGOEV3_MOTOR_NUM_PORTS];
+};
+
+/* Drop the commands that are still pending before queueing the new ones */
+#define LEGOEV3_MOTOR_QUEUE_REPLACE	(1 << 0)
+
+/**
+ * struct legoev3_motor_queue - argument of LEGOEV3_MOTOR_IOC_QUEUE
+ * @cmds: User pointer to an array of struct legoev3_motor_cmd, in order of
+ *	time. Without LEGOEV3_MOTOR_QUEUE_REPLACE, the first one must not be
+ *	earlier than the last command that is still pending.
+ * @num_cmds: Number of commands in @cmds.
+ * @flags: LEGOEV3_MOTOR_QUEUE_* flags.
+ */
+struct legoev3_motor_queue {
+	__u64 cmds;
+	__u32 num_cmds;
+	__u32 flags;
+};
+
+#define LEGOEV3_MOTOR_IOC_MAGIC		0xE3
+#define LEGOEV3_MOTOR_IOC_QUEUE		_IOW(LEGOEV3_MOTOR_IOC_MAGIC, 1, \
+					     struct legoev3_motor_queue)
+#define LEGOEV3_MOTOR_IOC_FLUSH		_IO(LEGOEV3_MOTOR_IOC_MAGIC, 2)
+
+#endif /* _UAPI_LINUX_LEGOEV3_MOTOR_H */
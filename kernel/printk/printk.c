@@ -42,6 +42,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/workqueue.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
@@ -1680,6 +1681,32 @@ static size_t log_output(int facility, int level, enum log_flags lflags, const c
 	return log_store(facility, level, lflags, 0, dict, dictlen, text, text_len);
 }
 
+/*
+ * With console_defer set, messages less severe than KERN_ERR only go to the
+ * log buffer and a worker pushes them to the consoles later, in process
+ * context. A slow serial console then no longer holds up the caller, which
+ * may well be sitting in an irqs-off section. Errors and worse, oopses and
+ * anything printed during early boot or shutdown are still written out
+ * right away, flushing whatever was deferred before them.
+ */
+static bool __read_mostly console_defer;
+module_param(console_defer, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(console_defer,
+		 "print non-urgent kernel messages to the console from a worker");
+
+static void defer_console_output(void);
+
+static bool console_output_deferred(int level)
+{
+	if (!console_defer || oops_in_progress)
+		return false;
+
+	if (system_state < SYSTEM_SCHEDULING || system_state > SYSTEM_RUNNING)
+		return false;
+
+	return level > LOGLEVEL_ERR;
+}
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1747,7 +1774,9 @@ asmlinkage int vprintk_emit(int facility, int level,
 	logbuf_unlock_irqrestore(flags);
 
 	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	if (!in_sched && console_output_deferred(level)) {
+		defer_console_output();
+	} else if (!in_sched) {
 		/*
 		 * Try to acquire and then immediately release the console
 		 * semaphore.  The release will print out buffers and wake up
@@ -2682,9 +2711,19 @@ late_initcall(printk_late_init);
  */
 #define PRINTK_PENDING_WAKEUP	0x01
 #define PRINTK_PENDING_OUTPUT	0x02
+#define PRINTK_PENDING_DEFER	0x04
 
 static DEFINE_PER_CPU(int, printk_pending);
 
+static void console_defer_work_func(struct work_struct *work)
+{
+	/* console_unlock() may reschedule between records from here */
+	console_lock();
+	console_unlock();
+}
+
+static DECLARE_WORK(console_defer_work, console_defer_work_func);
+
 static void wake_up_klogd_work_func(struct irq_work *irq_work)
 {
 	int pending = __this_cpu_xchg(printk_pending, 0);
@@ -2695,6 +2734,9 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 			console_unlock();
 	}
 
+	if (pending & PRINTK_PENDING_DEFER)
+		schedule_work(&console_defer_work);
+
 	if (pending & PRINTK_PENDING_WAKEUP)
 		wake_up_interruptible(&log_wait);
 }
@@ -2714,6 +2756,18 @@ void wake_up_klogd(void)
 	preempt_enable();
 }
 
+/*
+ * Queueing the work directly could deadlock on workqueue or scheduler locks
+ * held by the printk caller, so go through the irq_work first.
+ */
+static void defer_console_output(void)
+{
+	preempt_disable();
+	__this_cpu_or(printk_pending, PRINTK_PENDING_DEFER);
+	irq_work_queue(this_cpu_ptr(&wake_up_klogd_work));
+	preempt_enable();
+}
+
 int vprintk_deferred(const char *fmt, va_list args)
 {
 	int r;
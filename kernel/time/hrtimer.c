@@ -33,6 +33,7 @@
 
 #include <linux/cpu.h>
 #include <linux/export.h>
+#include <linux/moduleparam.h>
 #include <linux/percpu.h>
 #include <linux/hrtimer.h>
 #include <linux/notifier.h>
@@ -526,6 +527,37 @@ static int __init setup_hrtimer_hres(char *str)
 
 __setup("highres=", setup_hrtimer_hres);
 
+/*
+ * Grouping window for timers started without a slack range, such as the
+ * ones behind timerfds. Their hard expiry is rounded up to the next
+ * multiple of the window on CLOCK_MONOTONIC, so closely spaced timers
+ * expire from a single interrupt instead of reprogramming the clock event
+ * device for each of them. Timers may then expire up to this late. Timers
+ * of real-time tasks and timers started from interrupt context are left
+ * alone. 0 turns it off.
+ */
+static unsigned int hrtimer_batch_ns __read_mostly;
+module_param_named(batch_ns, hrtimer_batch_ns, uint, 0644);
+
+static u64 hrtimer_batch_range(struct hrtimer_clock_base *base, ktime_t tim,
+			       u64 delta_ns)
+{
+	unsigned int window = READ_ONCE(hrtimer_batch_ns);
+	ktime_t expires = ktime_sub(tim, base->offset);
+	u32 rem;
+
+	if (!window || delta_ns || expires <= 0 || in_interrupt() ||
+	    rt_task(current) || dl_task(current))
+		return delta_ns;
+
+	div_u64_rem(expires, window, &rem);
+	if (!rem)
+		return delta_ns;
+
+	base->cpu_base->nr_batched++;
+	return window - rem;
+}
+
 /*
  * hrtimer_high_res_enabled - query, if the highres mode is enabled
  */
@@ -584,6 +616,7 @@ hrtimer_force_reprogram(struct hrtimer_cpu_base *cpu_base, int skip_equal)
 	if (cpu_base->hang_detected)
 		return;
 
+	cpu_base->nr_reprograms++;
 	tick_program_event(cpu_base->expires_next, 1);
 }
 
@@ -646,6 +679,7 @@ static void hrtimer_reprogram(struct hrtimer *timer,
 	 * events which are already in the past.
 	 */
 	cpu_base->expires_next = expires;
+	cpu_base->nr_reprograms++;
 	tick_program_event(expires, 1);
 }
 
@@ -729,6 +763,11 @@ static inline int hrtimer_reprogram(struct hrtimer *timer,
 }
 static inline void hrtimer_init_hres(struct hrtimer_cpu_base *base) { }
 static inline void retrigger_next_event(void *arg) { }
+static inline u64 hrtimer_batch_range(struct hrtimer_clock_base *base,
+				      ktime_t tim, u64 delta_ns)
+{
+	return delta_ns;
+}
 
 #endif /* CONFIG_HIGH_RES_TIMERS */
 
@@ -958,6 +997,7 @@ void hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 		tim = ktime_add_safe(tim, base->get_time());
 
 	tim = hrtimer_update_lowres(timer, tim, mode);
+	delta_ns = hrtimer_batch_range(base, tim, delta_ns);
 
 	hrtimer_set_expires_range_ns(timer, tim, delta_ns);
 
@@ -158,6 +158,8 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 	P(nr_retries);
 	P(nr_hangs);
 	P(max_hang_time);
+	P(nr_reprograms);
+	P(nr_batched);
 #endif
 #undef P
 #undef P_ns
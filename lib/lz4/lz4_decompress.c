@@ -188,7 +188,8 @@ static FORCE_INLINE int LZ4_decompress_generic(
 			break;
 		}
 
-		LZ4_wildCopy(op, ip, cpy);
+		/* literals come from the input, they never overlap */
+		LZ4_wildCopyNoOverlap(op, ip, cpy);
 		ip += length;
 		op = cpy;
 
@@ -313,7 +314,9 @@ static FORCE_INLINE int LZ4_decompress_generic(
 		} else {
 			LZ4_copy8(op, match);
 
-			if (length > 16)
+			if (length > 16 && offset >= length)
+				LZ4_wildCopyNoOverlap(op + 8, match + 8, cpy);
+			else if (length > 16)
 				LZ4_wildCopy(op + 8, match + 8, cpy);
 		}
 
@@ -67,6 +67,17 @@ typedef uintptr_t uptrval;
 #define LZ4_LITTLE_ENDIAN 0
 #endif
 
+/*
+ * On 32-bit CPUs without efficient unaligned access (e.g. ARMv5) every
+ * get_unaligned()/put_unaligned() is split into byte accesses, so copies
+ * are done with aligned words or the architecture's memcpy() instead.
+ */
+#if LZ4_ARCH64 || defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+#define LZ4_SLOW_UNALIGNED 0
+#else
+#define LZ4_SLOW_UNALIGNED 1
+#endif
+
 /*-************************************
  *	Constants
  **************************************/
@@ -139,8 +150,18 @@ static FORCE_INLINE void LZ4_copy8(void *dst, const void *src)
 
 	put_unaligned(a, (U64 *)dst);
 #else
-	U32 a = get_unaligned((const U32 *)src);
-	U32 b = get_unaligned((const U32 *)src + 1);
+	U32 a, b;
+
+	if (LZ4_SLOW_UNALIGNED && !(((uptrval)dst | (uptrval)src) & 3)) {
+		a = ((const U32 *)src)[0];
+		b = ((const U32 *)src)[1];
+		((U32 *)dst)[0] = a;
+		((U32 *)dst)[1] = b;
+		return;
+	}
+
+	a = get_unaligned((const U32 *)src);
+	b = get_unaligned((const U32 *)src + 1);
 
 	put_unaligned(a, (U32 *)dst);
 	put_unaligned(b, (U32 *)dst + 1);
@@ -165,6 +186,25 @@ static FORCE_INLINE void LZ4_wildCopy(void *dstPtr,
 	} while (d < e);
 }
 
+/*
+ * LZ4_wildCopy() for source and destination ranges which don't overlap,
+ * including the up to 7 bytes written beyond dstEnd.  Longer runs are
+ * handed to memcpy(), which copies with load/store multiple and handles
+ * misalignment without byte accesses.
+ */
+static FORCE_INLINE void LZ4_wildCopyNoOverlap(void *dstPtr,
+	const void *srcPtr, void *dstEnd)
+{
+	size_t const length = (BYTE *)dstEnd - (BYTE *)dstPtr;
+
+	if (LZ4_SLOW_UNALIGNED && length > 16) {
+		memcpy(dstPtr, srcPtr, (length + 7) & ~(size_t)7);
+		return;
+	}
+
+	LZ4_wildCopy(dstPtr, srcPtr, dstEnd);
+}
+
 static FORCE_INLINE unsigned int LZ4_NbCommonBytes(register size_t val)
 {
 #if LZ4_LITTLE_ENDIAN
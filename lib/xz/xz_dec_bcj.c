@@ -264,10 +264,31 @@ static size_t bcj_ia64(struct xz_dec_bcj *s, uint8_t *buf, size_t size)
 #ifdef XZ_DEC_ARM
 static size_t bcj_arm(struct xz_dec_bcj *s, uint8_t *buf, size_t size)
 {
-	size_t i;
+	size_t i = 0;
 	uint32_t addr;
+	uint32_t instr;
 
-	for (i = 0; i + 4 <= size; i += 4) {
+	/*
+	 * The output buffers of squashfs and most other users are word
+	 * aligned, so the instructions can be loaded and stored whole. Only
+	 * the low 24 bits of the shifted offset survive, so the top byte
+	 * does not need to be masked off before the subtraction.
+	 */
+	if (((uintptr_t)buf & 3) == 0) {
+		for (; i + 4 <= size; i += 4) {
+			instr = get_le32(buf + i);
+			if ((instr >> 24) != 0xEB)
+				continue;
+
+			addr = (instr << 2) - (s->pos + (uint32_t)i + 8);
+			put_le32(0xEB000000 | ((addr >> 2) & 0x00FFFFFF),
+				 buf + i);
+		}
+
+		return i;
+	}
+
+	for (; i + 4 <= size; i += 4) {
 		if (buf[i + 3] == 0xEB) {
 			addr = (uint32_t)buf[i] | ((uint32_t)buf[i + 1] << 8)
 					| ((uint32_t)buf[i + 2] << 16);
@@ -41,6 +41,7 @@
 #		define memzero(buf, size) memset(buf, 0, size)
 #	endif
 #	define get_le32(p) le32_to_cpup((const uint32_t *)(p))
+#	define put_le32(v, p) (*(uint32_t *)(p) = cpu_to_le32(v))
 #else
 	/*
 	 * For userspace builds, use a separate header to define the required
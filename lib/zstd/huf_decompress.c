@@ -886,6 +886,10 @@ static const algo_time_t algoTime[16 /* Quantization */][3 /* single, double, qu
 *   Assumption : 0 < cSrcSize < dstSize <= 128 KB */
 U32 HUF_selectDecoder(size_t dstSize, size_t cSrcSize)
 {
+#ifdef HUF_FORCE_DECOMPRESS_X2
+	/* the timings above assume that the 16 KB X4 table stays cached */
+	return 0;
+#else
 	/* decoder timing evaluation */
 	U32 const Q = (U32)(cSrcSize * 16 / dstSize); /* Q < 16 since dstSize > cSrcSize */
 	U32 const D256 = (U32)(dstSize >> 8);
@@ -894,6 +898,7 @@ U32 HUF_selectDecoder(size_t dstSize, size_t cSrcSize)
 	DTime1 += DTime1 >> 3; /* advantage to algorithm using less memory, for cache eviction */
 
 	return DTime1 < DTime0;
+#endif
 }
 
 typedef size_t (*decompressionAlgo)(void *dst, size_t dstSize, const void *cSrc, size_t cSrcSize);
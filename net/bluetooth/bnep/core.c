@@ -295,6 +295,41 @@ static u8 __bnep_rx_hlen[] = {
 	ETH_ALEN + 2  /* BNEP_COMPRESSED_DST_ONLY */
 };
 
+/*
+ * Builds the ether header into the headroom freed by pulling the BNEP
+ * header, so the payload is handed up where it is. That needs an skb that
+ * we own outright and a payload whose network header ends up aligned;
+ * anything else takes the copying path.
+ */
+static bool bnep_rx_in_place(struct sk_buff *skb, u8 type, struct ethhdr *eh)
+{
+	if (skb_cloned(skb) || skb_headroom(skb) < ETH_HLEN)
+		return false;
+
+	if (!IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) &&
+	    !IS_ALIGNED((unsigned long)skb->data, 4))
+		return false;
+
+	/* The compressed addresses may overlap the pushed header */
+	switch (type & BNEP_TYPE_MASK) {
+	case BNEP_COMPRESSED_SRC_ONLY:
+		memcpy(eh->h_source, skb_mac_header(skb), ETH_ALEN);
+		break;
+
+	case BNEP_COMPRESSED_DST_ONLY:
+		memcpy(eh->h_dest, skb_mac_header(skb), ETH_ALEN);
+		break;
+
+	case BNEP_GENERAL:
+		memcpy(eh->h_dest, skb_mac_header(skb), ETH_ALEN * 2);
+		break;
+	}
+
+	memcpy(skb_push(skb, ETH_HLEN), eh, ETH_HLEN);
+
+	return true;
+}
+
 static int bnep_rx_frame(struct bnep_session *s, struct sk_buff *skb)
 {
 	struct net_device *dev = s->dev;
@@ -361,6 +396,15 @@ static int bnep_rx_frame(struct bnep_session *s, struct sk_buff *skb)
 		s->eh.h_proto = get_unaligned((__be16 *) (skb->data - 2));
 	}
 
+	if ((type & BNEP_TYPE_MASK) != BNEP_CONTROL) {
+		struct ethhdr eh = s->eh;
+
+		if (bnep_rx_in_place(skb, type, &eh)) {
+			nskb = skb;
+			goto deliver;
+		}
+	}
+
 	/* We have to alloc new skb and copy data here :(. Because original skb
 	 * may not be modified and because of the alignment requirements. */
 	nskb = alloc_skb(2 + ETH_HLEN + skb->len, GFP_KERNEL);
@@ -397,6 +441,7 @@ static int bnep_rx_frame(struct bnep_session *s, struct sk_buff *skb)
 	skb_copy_from_linear_data(skb, __skb_put(nskb, skb->len), skb->len);
 	kfree_skb(skb);
 
+deliver:
 	dev->stats.rx_packets++;
 	nskb->ip_summed = CHECKSUM_NONE;
 	nskb->protocol  = eth_type_trans(nskb, dev);
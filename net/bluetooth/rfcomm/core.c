@@ -41,6 +41,7 @@ static bool disable_cfc;
 static bool l2cap_ertm;
 static int channel_mtu = -1;
 static unsigned int l2cap_mtu = RFCOMM_MAX_L2CAP_MTU;
+static unsigned int rx_credits = RFCOMM_MAX_CREDITS;
 
 static struct task_struct *rfcomm_thread;
 
@@ -572,6 +573,51 @@ int rfcomm_dlc_send(struct rfcomm_dlc *d, struct sk_buff *skb)
 	return len;
 }
 
+/*
+ * Append data to the last frame still waiting in the TX queue, as long as
+ * it fits into the MTU and the frame's buffer. Small writes issued while
+ * the link is busy or out of credits then go out as one frame, costing one
+ * credit instead of one each. Returns the number of bytes taken.
+ */
+int rfcomm_dlc_append(struct rfcomm_dlc *d, const u8 *data, int len)
+{
+	struct rfcomm_hdr *hdr;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int hlen, plen;
+
+	spin_lock_irqsave(&d->tx_queue.lock, flags);
+
+	skb = skb_peek_tail(&d->tx_queue);
+	if (!skb)
+		goto out;
+
+	hdr = (void *) skb->data;
+	hlen = (hdr->len & 0x01) ? 3 : 4;
+	plen = skb->len - hlen - 1;
+
+	/*
+	 * the old FCS byte is trimmed but a new one is appended behind the
+	 * data, so only the tailroom is free; a longer header needs one more
+	 * byte of headroom
+	 */
+	len = min3(len, (int) d->mtu - plen, (int) skb_tailroom(skb));
+	if (len <= 0 || skb_headroom(skb) < 1) {
+		len = 0;
+		goto out;
+	}
+
+	skb_pull(skb, hlen);
+	skb_trim(skb, plen);
+	skb_put_data(skb, data, len);
+	rfcomm_make_uih(skb, d->addr);
+
+out:
+	spin_unlock_irqrestore(&d->tx_queue.lock, flags);
+
+	return len;
+}
+
 void rfcomm_dlc_send_noerror(struct rfcomm_dlc *d, struct sk_buff *skb)
 {
 	int len = skb->len;
@@ -1371,7 +1417,9 @@ static int rfcomm_apply_pn(struct rfcomm_dlc *d, int cr, struct rfcomm_pn *pn)
 
 	if ((pn->flow_ctrl == 0xf0 && s->cfc != RFCOMM_CFC_DISABLED) ||
 						pn->flow_ctrl == 0xe0) {
-		d->cfc = RFCOMM_CFC_ENABLED;
+		/* d->cfc is the receive window we keep topped up */
+		d->cfc = clamp_t(unsigned int, rx_credits,
+				 RFCOMM_DEFAULT_CREDITS, 255);
 		d->tx_credits = pn->credits;
 	} else {
 		d->cfc = RFCOMM_CFC_DISABLED;
@@ -2249,6 +2297,9 @@ MODULE_PARM_DESC(channel_mtu, "Default MTU for the RFCOMM channel");
 module_param(l2cap_mtu, uint, 0644);
 MODULE_PARM_DESC(l2cap_mtu, "Default MTU for the L2CAP connection");
 
+module_param(rx_credits, uint, 0644);
+MODULE_PARM_DESC(rx_credits, "Receive credit window with credit based flow control (7-255)");
+
 module_param(l2cap_ertm, bool, 0644);
 MODULE_PARM_DESC(l2cap_ertm, "Use L2CAP ERTM mode for connection");
 
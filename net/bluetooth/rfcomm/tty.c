@@ -789,10 +789,18 @@ static int rfcomm_tty_write(struct tty_struct *tty, const unsigned char *buf, in
 
 	BT_DBG("tty %p count %d", tty, count);
 
+	/* Top up a frame that is still queued before starting a new one */
+	if (dlc->state == BT_CONNECTED) {
+		sent = rfcomm_dlc_append(dlc, buf, count);
+		count -= sent;
+	}
+
 	while (count) {
 		size = min_t(uint, count, dlc->mtu);
 
-		skb = rfcomm_wmalloc(dev, size + RFCOMM_SKB_RESERVE, GFP_ATOMIC);
+		/* Allocate a full MTU so later writes can be appended */
+		skb = rfcomm_wmalloc(dev, dlc->mtu + RFCOMM_SKB_RESERVE,
+				     GFP_ATOMIC);
 		if (!skb)
 			break;
 
@@ -655,6 +655,7 @@ static void _prb_refresh_rx_retire_blk_timer(struct tpacket_kbdq_core *pkc)
 	mod_timer(&pkc->retire_blk_timer,
 			jiffies + pkc->tov_in_jiffies);
 	pkc->last_kactive_blk_num = pkc->kactive_blk_num;
+	pkc->retire_blk_timer_idle = 0;
 }
 
 /*
@@ -714,8 +715,13 @@ static void prb_retire_rx_blk_timer_expired(unsigned long data)
 	if (pkc->last_kactive_blk_num == pkc->kactive_blk_num) {
 		if (!frozen) {
 			if (!BLOCK_NUM_PKTS(pbd)) {
-				/* An empty block. Just refresh the timer. */
-				goto refresh_timer;
+				/*
+				 * An empty block. Let the timer rest until
+				 * the first packet lands in it, so an idle
+				 * ring doesn't wake the CPU every tov.
+				 */
+				pkc->retire_blk_timer_idle = 1;
+				goto out;
 			}
 			prb_retire_current_block(pkc, po, TP_STATUS_BLK_TMO);
 			if (!prb_dispatch_next_block(pkc, po))
@@ -1046,6 +1052,10 @@ static void prb_fill_curr_block(char *curr,
 	BLOCK_NUM_PKTS(pbd) += 1;
 	atomic_inc(&pkc->blk_fill_in_prog);
 	prb_run_all_ft_ops(pkc, ppd);
+
+	/* The block was idle with its timer stopped, start the tov now */
+	if (unlikely(pkc->retire_blk_timer_idle) && !pkc->delete_blk_timer)
+		_prb_refresh_rx_retire_blk_timer(pkc);
 }
 
 /* Assumes caller has the sk->rx_queue.lock */
@@ -46,6 +46,8 @@ struct tpacket_kbdq_core {
 
 	unsigned short  retire_blk_tov;
 	unsigned short  version;
+	/* retire timer left stopped on an empty block, see tpacket_rcv */
+	unsigned char	retire_blk_timer_idle;
 	unsigned long	tov_in_jiffies;
 
 	/* timer to retire an outstanding block */
@@ -0,0 +1,819 @@
+/*
+ * LEGO MINDSTORMS EV3 speaker driver
+ *
+ * The speaker is driven by ePWM0 output B through an amplifier. Samples are
+ * written to the duty cycle by the legoev3-fiq FIQ handler, once every
+ * int_period PWM periods, straight from the ALSA buffer, so playback needs
+ * neither DMA nor a timer interrupt of its own.
+ *
+ * If the device has a "tx" DMA channel and the loop timer is available,
+ * the FIQ is not used for playback either. The samples are converted to
+ * duty cycle values when the application commits them, and the timer
+ * paces an EDMA cyclic transfer of those into the compare register, like
+ * the McASP does with edma-pcm. Playback then costs no CPU time per sample.
+ *
+ * Beeps don't need the FIQ at all: for SND_TONE and SND_BELL events of the
+ * input device, the PWM is simply set to a square wave at the requested
+ * frequency.
+ *
+ * This program is free software; you may redistribute and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/err.h>
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/input.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/pwm.h>
+#include <linux/workqueue.h>
+
+#include <sound/control.h>
+#include <sound/core.h>
+#include <sound/initval.h>
+#include <sound/legoev3.h>
+#include <sound/pcm.h>
+
+#include <mach/legoev3-fiq.h>
+#include <mach/time.h>
+
+#define DRIVER_NAME	"snd-legoev3"
+
+#define LEGOEV3_VOLUME_MAX	256
+#define LEGOEV3_BUFFER_MAX	(64 * 1024)
+#define LEGOEV3_BELL_HZ		1000
+/* PWM carrier for DMA playback, independent of the sample rate */
+#define LEGOEV3_DMA_PWM_NS	15625
+/* edma can't do more periods than this in one cyclic transfer */
+#define LEGOEV3_DMA_PERIODS_MAX	19
+
+static int index = SNDRV_DEFAULT_IDX1;
+module_param(index, int, 0444);
+MODULE_PARM_DESC(index, "Index value for the EV3 speaker.");
+
+static char *id = SNDRV_DEFAULT_STR1;
+module_param(id, charp, 0444);
+MODULE_PARM_DESC(id, "ID string for the EV3 speaker.");
+
+static unsigned int int_period = 1;
+module_param(int_period, uint, 0644);
+MODULE_PARM_DESC(int_period, "PWM periods per sample (1-3, 0 means 1).");
+
+static unsigned int fiq_rate_max = 24000;
+module_param(fiq_rate_max, uint, 0644);
+MODULE_PARM_DESC(fiq_rate_max,
+		 "Decimate in the FIQ above this rate (0 to disable).");
+
+/**
+ * struct snd_legoev3 - driver data
+ * @dev: the platform device
+ * @card: the sound card
+ * @pwm: ePWM0 output B
+ * @amp_gpiod: amplifier enable, may be NULL
+ * @input: input device for SND_TONE and SND_BELL
+ * @tone_work: applies @tone_hz, since the PWM can't be set up atomically
+ * @tone_hz: requested tone frequency, 0 for silence
+ * @lock: serializes use of the PWM between PCM playback and tones
+ * @substream: the open playback substream, which takes precedence over
+ *	tones
+ * @volume: PCM volume, also sets the duty cycle of tones
+ * @pwm_on: the PWM and the amplifier are enabled
+ * @dma: DMA channel for playback without the FIQ, or NULL
+ * @cookie: the running cyclic transfer
+ * @duty_area: duty cycle values, one u16 per frame of the ALSA buffer
+ * @duty_addr: DMA address of @duty_area
+ * @duty_bytes: size of @duty_area
+ * @duty_full: PWM period in ticks, i.e. a duty value of 100%
+ * @converted: application position up to which @duty_area is filled in
+ */
+struct snd_legoev3 {
+	struct device *dev;
+	struct snd_card *card;
+	struct pwm_device *pwm;
+	struct gpio_desc *amp_gpiod;
+	struct input_dev *input;
+	struct work_struct tone_work;
+	unsigned int tone_hz;
+	struct mutex lock;
+	struct snd_pcm_substream *substream;
+	int volume;
+	bool pwm_on;
+	struct dma_chan *dma;
+	dma_cookie_t cookie;
+	u16 *duty_area;
+	dma_addr_t duty_addr;
+	size_t duty_bytes;
+	unsigned int duty_full;
+	snd_pcm_uframes_t converted;
+};
+
+static const struct snd_pcm_hardware snd_legoev3_playback_hw = {
+	.info			= SNDRV_PCM_INFO_MMAP |
+				  SNDRV_PCM_INFO_MMAP_VALID |
+				  SNDRV_PCM_INFO_INTERLEAVED |
+				  SNDRV_PCM_INFO_BLOCK_TRANSFER,
+	.formats		= SNDRV_PCM_FMTBIT_U8 | SNDRV_PCM_FMTBIT_S16_LE,
+	.rates			= SNDRV_PCM_RATE_CONTINUOUS |
+				  SNDRV_PCM_RATE_8000_48000,
+	.rate_min		= 8000,
+	.rate_max		= 48000,
+	.channels_min		= 1,
+	.channels_max		= 2,
+	.buffer_bytes_max	= LEGOEV3_BUFFER_MAX,
+	/* the FIQ reports every period itself, so they can be tiny */
+	.period_bytes_min	= 32,
+	.period_bytes_max	= LEGOEV3_BUFFER_MAX / 2,
+	.periods_min		= 2,
+	.periods_max		= 1024,
+};
+
+/* Called from the legoev3-fiq status interrupt */
+static void snd_legoev3_period_elapsed(void *context)
+{
+	snd_pcm_period_elapsed(context);
+}
+
+/* Called with chip->lock held */
+static int snd_legoev3_pwm_on(struct snd_legoev3 *chip, unsigned int duty_ns,
+			      unsigned int period_ns)
+{
+	int ret;
+
+	ret = pwm_config(chip->pwm, duty_ns, period_ns);
+	if (ret || chip->pwm_on)
+		return ret;
+
+	ret = pwm_enable(chip->pwm);
+	if (ret)
+		return ret;
+	gpiod_set_value_cansleep(chip->amp_gpiod, 1);
+	chip->pwm_on = true;
+
+	return 0;
+}
+
+/* Called with chip->lock held */
+static void snd_legoev3_pwm_off(struct snd_legoev3 *chip)
+{
+	if (!chip->pwm_on)
+		return;
+
+	gpiod_set_value_cansleep(chip->amp_gpiod, 0);
+	pwm_disable(chip->pwm);
+	chip->pwm_on = false;
+}
+
+static void snd_legoev3_tone_work(struct work_struct *work)
+{
+	struct snd_legoev3 *chip = container_of(work, struct snd_legoev3,
+						tone_work);
+	unsigned int hz = READ_ONCE(chip->tone_hz);
+	unsigned int period_ns, duty_ns;
+
+	mutex_lock(&chip->lock);
+	if (chip->substream)
+		goto out;
+
+	if (!hz) {
+		snd_legoev3_pwm_off(chip);
+		goto out;
+	}
+
+	/* no per-sample FIQ, the PWM makes the tone by itself */
+	legoev3_fiq_ehrpwm_int_disable();
+
+	/* a square wave, quieter for a shorter pulse */
+	period_ns = DIV_ROUND_CLOSEST(NSEC_PER_SEC, hz);
+	duty_ns = (u64)period_ns * chip->volume / (2 * LEGOEV3_VOLUME_MAX);
+	if (snd_legoev3_pwm_on(chip, duty_ns, period_ns))
+		dev_warn(chip->dev, "Failed to play %u Hz tone\n", hz);
+out:
+	mutex_unlock(&chip->lock);
+}
+
+static int snd_legoev3_input_event(struct input_dev *dev, unsigned int type,
+				   unsigned int code, int value)
+{
+	struct snd_legoev3 *chip = input_get_drvdata(dev);
+
+	if (type != EV_SND)
+		return -EINVAL;
+
+	switch (code) {
+	case SND_BELL:
+		value = value ? LEGOEV3_BELL_HZ : 0;
+		break;
+	case SND_TONE:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	/* same audible range as the PC speaker */
+	if (value <= 20 || value >= 32767)
+		value = 0;
+
+	WRITE_ONCE(chip->tone_hz, value);
+	schedule_work(&chip->tone_work);
+
+	return 0;
+}
+
+static void snd_legoev3_tone_cleanup(void *data)
+{
+	struct snd_legoev3 *chip = data;
+
+	cancel_work_sync(&chip->tone_work);
+	mutex_lock(&chip->lock);
+	snd_legoev3_pwm_off(chip);
+	mutex_unlock(&chip->lock);
+}
+
+static int snd_legoev3_pcm_open(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int ret;
+
+	runtime->hw = snd_legoev3_playback_hw;
+	if (chip->dma) {
+		/* ack() must see every appl_ptr update to convert the data */
+		runtime->hw.info |= SNDRV_PCM_INFO_SYNC_APPLPTR;
+		runtime->hw.periods_max = LEGOEV3_DMA_PERIODS_MAX;
+		ret = davinci_looptimer_dma_request();
+		if (ret)
+			return ret;
+	}
+
+	/* cut off any tone, the stream owns the PWM until it is closed */
+	mutex_lock(&chip->lock);
+	chip->substream = substream;
+	chip->tone_hz = 0;
+	snd_legoev3_pwm_off(chip);
+	mutex_unlock(&chip->lock);
+
+	return 0;
+}
+
+static int snd_legoev3_pcm_close(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+
+	legoev3_fiq_ehrpwm_int_disable();
+	mutex_lock(&chip->lock);
+	snd_legoev3_pwm_off(chip);
+	chip->substream = NULL;
+	mutex_unlock(&chip->lock);
+
+	if (chip->dma)
+		davinci_looptimer_dma_release();
+
+	return 0;
+}
+
+static int snd_legoev3_pcm_hw_params(struct snd_pcm_substream *substream,
+				     struct snd_pcm_hw_params *hw_params)
+{
+	return snd_pcm_lib_malloc_pages(substream,
+					params_buffer_bytes(hw_params));
+}
+
+static int snd_legoev3_pcm_hw_free(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+
+	legoev3_fiq_ehrpwm_int_disable();
+	mutex_lock(&chip->lock);
+	snd_legoev3_pwm_off(chip);
+	mutex_unlock(&chip->lock);
+
+	return snd_pcm_lib_free_pages(substream);
+}
+
+/*
+ * Sets the PWM up for the stream and hands the buffer to the FIQ. Prepare
+ * may sleep, unlike trigger, so this is also where the PWM and the amplifier
+ * are switched on. The output sits at mid scale until trigger starts the FIQ.
+ *
+ * Above fiq_rate_max, the PWM runs at the sample rate and the FIQ averages
+ * up to three frames per interrupt instead, so music at 44.1 or 48 kHz
+ * needs neither userspace resampling nor an FIQ per frame.
+ */
+static int snd_legoev3_pcm_prepare(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	unsigned int periods = clamp(int_period, 1U, 3U);
+	unsigned int decimate = 1;
+	unsigned int period_ns;
+	int ret;
+
+	legoev3_fiq_ehrpwm_int_disable();
+
+	if (fiq_rate_max && runtime->rate > fiq_rate_max) {
+		decimate = min(DIV_ROUND_UP(runtime->rate, fiq_rate_max), 3U);
+		periods = 1;
+	}
+	ret = legoev3_fiq_ehrpwm_set_decimate(decimate);
+	if (ret)
+		return ret;
+
+	period_ns = DIV_ROUND_CLOSEST(NSEC_PER_SEC, runtime->rate * periods);
+	mutex_lock(&chip->lock);
+	ret = snd_legoev3_pwm_on(chip, period_ns / 2, period_ns);
+	mutex_unlock(&chip->lock);
+	if (ret)
+		return ret;
+
+	return legoev3_fiq_ehrpwm_prepare(substream, chip->volume, periods,
+					  snd_legoev3_period_elapsed,
+					  substream);
+}
+
+static int snd_legoev3_pcm_trigger(struct snd_pcm_substream *substream,
+				   int cmd)
+{
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+		return legoev3_fiq_ehrpwm_int_enable();
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		return legoev3_fiq_ehrpwm_int_disable();
+	default:
+		return -EINVAL;
+	}
+}
+
+static snd_pcm_uframes_t
+snd_legoev3_pcm_pointer(struct snd_pcm_substream *substream)
+{
+	return bytes_to_frames(substream->runtime,
+			       legoev3_fiq_ehrpwm_get_playback_ptr());
+}
+
+static const struct snd_pcm_ops snd_legoev3_playback_ops = {
+	.open		= snd_legoev3_pcm_open,
+	.close		= snd_legoev3_pcm_close,
+	.ioctl		= snd_pcm_lib_ioctl,
+	.hw_params	= snd_legoev3_pcm_hw_params,
+	.hw_free	= snd_legoev3_pcm_hw_free,
+	.prepare	= snd_legoev3_pcm_prepare,
+	.trigger	= snd_legoev3_pcm_trigger,
+	.pointer	= snd_legoev3_pcm_pointer,
+};
+
+static void snd_legoev3_dma_complete(void *context)
+{
+	snd_pcm_period_elapsed(context);
+}
+
+static int snd_legoev3_dma_hw_params(struct snd_pcm_substream *substream,
+				     struct snd_pcm_hw_params *hw_params)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+	struct device *dma_dev = chip->dma->device->dev;
+	size_t duty_bytes = params_buffer_size(hw_params) * sizeof(u16);
+	int ret;
+
+	ret = snd_pcm_lib_malloc_pages(substream,
+				       params_buffer_bytes(hw_params));
+	if (ret < 0)
+		return ret;
+
+	if (chip->duty_area && chip->duty_bytes != duty_bytes) {
+		dma_free_coherent(dma_dev, chip->duty_bytes, chip->duty_area,
+				  chip->duty_addr);
+		chip->duty_area = NULL;
+	}
+	if (!chip->duty_area) {
+		chip->duty_area = dma_alloc_coherent(dma_dev, duty_bytes,
+						     &chip->duty_addr,
+						     GFP_KERNEL);
+		if (!chip->duty_area) {
+			snd_pcm_lib_free_pages(substream);
+			return -ENOMEM;
+		}
+		chip->duty_bytes = duty_bytes;
+	}
+
+	return ret;
+}
+
+static int snd_legoev3_dma_hw_free(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+
+	dmaengine_synchronize(chip->dma);
+	if (chip->duty_area) {
+		dma_free_coherent(chip->dma->device->dev, chip->duty_bytes,
+				  chip->duty_area, chip->duty_addr);
+		chip->duty_area = NULL;
+	}
+
+	mutex_lock(&chip->lock);
+	snd_legoev3_pwm_off(chip);
+	mutex_unlock(&chip->lock);
+
+	return snd_pcm_lib_free_pages(substream);
+}
+
+/* Fills in @count duty values from frame @pos of the ALSA buffer on. */
+static void snd_legoev3_dma_convert(struct snd_legoev3 *chip,
+				    struct snd_pcm_runtime *runtime,
+				    snd_pcm_uframes_t pos,
+				    snd_pcm_uframes_t count)
+{
+	u8 *src = runtime->dma_area + frames_to_bytes(runtime, pos);
+	u16 *dst = chip->duty_area + pos;
+	unsigned int full = chip->duty_full;
+	int volume = chip->volume;
+	s16 *src16 = (s16 *)src;
+	int sample;
+
+	while (count--) {
+		if (runtime->format == SNDRV_PCM_FORMAT_U8) {
+			sample = (*src++ - 0x80) << 8;
+		} else if (runtime->channels == 2) {
+			sample = (src16[0] + src16[1]) >> 1;
+			src16 += 2;
+		} else {
+			sample = *src16++;
+		}
+		sample = (sample * volume) >> 8;
+		*dst++ = ((sample + 0x8000) * full) >> 16;
+	}
+}
+
+/*
+ * Called under the stream lock whenever the application moves appl_ptr,
+ * including mmap commits thanks to SNDRV_PCM_INFO_SYNC_APPLPTR.
+ */
+static int snd_legoev3_dma_ack(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t appl_ptr = runtime->control->appl_ptr;
+	snd_pcm_sframes_t count = appl_ptr - chip->converted;
+	snd_pcm_uframes_t pos, len;
+
+	if (count < 0)
+		count += runtime->boundary;
+	/* a rewind, or more than a buffer: only the last buffer matters */
+	if (count > runtime->buffer_size)
+		count = runtime->buffer_size;
+
+	pos = (appl_ptr - count) % runtime->buffer_size;
+	while (count > 0) {
+		len = min_t(snd_pcm_uframes_t, count,
+			    runtime->buffer_size - pos);
+		snd_legoev3_dma_convert(chip, runtime, pos, len);
+		count -= len;
+		pos = 0;
+	}
+	chip->converted = appl_ptr;
+
+	return 0;
+}
+
+static int snd_legoev3_dma_prepare(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct dma_slave_config config = {
+		.direction	= DMA_MEM_TO_DEV,
+		.dst_addr	= legoev3_fiq_ehrpwm_get_duty_reg(),
+		.dst_addr_width	= DMA_SLAVE_BUSWIDTH_2_BYTES,
+		.dst_maxburst	= 1,
+	};
+	snd_pcm_uframes_t i;
+	int ret;
+
+	if (!config.dst_addr)
+		return -ENODEV;
+
+	mutex_lock(&chip->lock);
+	ret = snd_legoev3_pwm_on(chip, LEGOEV3_DMA_PWM_NS / 2,
+				 LEGOEV3_DMA_PWM_NS);
+	mutex_unlock(&chip->lock);
+	if (ret)
+		return ret;
+
+	ret = dmaengine_slave_config(chip->dma, &config);
+	if (ret)
+		return ret;
+
+	/* start out silent, ack() fills in whatever is written from now on */
+	chip->duty_full = legoev3_fiq_ehrpwm_get_period_ticks();
+	for (i = 0; i < runtime->buffer_size; i++)
+		chip->duty_area[i] = chip->duty_full / 2;
+	chip->converted = runtime->control->appl_ptr;
+
+	return 0;
+}
+
+static int snd_legoev3_dma_trigger(struct snd_pcm_substream *substream,
+				   int cmd)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct dma_async_tx_descriptor *desc;
+	int ret;
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+		desc = dmaengine_prep_dma_cyclic(chip->dma, chip->duty_addr,
+				runtime->buffer_size * sizeof(u16),
+				runtime->period_size * sizeof(u16),
+				DMA_MEM_TO_DEV, DMA_PREP_INTERRUPT);
+		if (!desc)
+			return -ENOMEM;
+		desc->callback = snd_legoev3_dma_complete;
+		desc->callback_param = substream;
+		chip->cookie = dmaengine_submit(desc);
+		dma_async_issue_pending(chip->dma);
+
+		ret = davinci_looptimer_start(runtime->rate);
+		if (ret)
+			dmaengine_terminate_async(chip->dma);
+		return ret;
+	case SNDRV_PCM_TRIGGER_STOP:
+		davinci_looptimer_stop();
+		return dmaengine_terminate_async(chip->dma);
+	default:
+		return -EINVAL;
+	}
+}
+
+static snd_pcm_uframes_t
+snd_legoev3_dma_pointer(struct snd_pcm_substream *substream)
+{
+	struct snd_legoev3 *chip = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct dma_tx_state state;
+	snd_pcm_uframes_t pos = 0;
+
+	if (dmaengine_tx_status(chip->dma, chip->cookie, &state) ==
+	    DMA_IN_PROGRESS && state.residue &&
+	    state.residue <= chip->duty_bytes)
+		pos = (chip->duty_bytes - state.residue) / sizeof(u16);
+
+	return pos < runtime->buffer_size ? pos : 0;
+}
+
+static const struct snd_pcm_ops snd_legoev3_dma_playback_ops = {
+	.open		= snd_legoev3_pcm_open,
+	.close		= snd_legoev3_pcm_close,
+	.ioctl		= snd_pcm_lib_ioctl,
+	.hw_params	= snd_legoev3_dma_hw_params,
+	.hw_free	= snd_legoev3_dma_hw_free,
+	.prepare	= snd_legoev3_dma_prepare,
+	.trigger	= snd_legoev3_dma_trigger,
+	.pointer	= snd_legoev3_dma_pointer,
+	.ack		= snd_legoev3_dma_ack,
+};
+
+static void snd_legoev3_release_dma(void *data)
+{
+	dma_release_channel(data);
+}
+
+/* DMA playback is optional, the FIQ is used if there is no channel */
+static int snd_legoev3_get_dma(struct platform_device *pdev,
+			       struct snd_legoev3 *chip)
+{
+	struct dma_chan *chan;
+
+	if (!IS_ENABLED(CONFIG_DAVINCI_LOOP_TIMER))
+		return 0;
+
+	chan = dma_request_chan(&pdev->dev, "tx");
+	if (IS_ERR(chan)) {
+		if (PTR_ERR(chan) == -EPROBE_DEFER)
+			return -EPROBE_DEFER;
+		return 0;
+	}
+
+	chip->dma = chan;
+
+	return devm_add_action_or_reset(&pdev->dev, snd_legoev3_release_dma,
+					chan);
+}
+
+static int snd_legoev3_volume_info(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = 1;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = LEGOEV3_VOLUME_MAX;
+
+	return 0;
+}
+
+static int snd_legoev3_volume_get(struct snd_kcontrol *kcontrol,
+				  struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_legoev3 *chip = snd_kcontrol_chip(kcontrol);
+
+	ucontrol->value.integer.value[0] = chip->volume;
+
+	return 0;
+}
+
+static int snd_legoev3_volume_put(struct snd_kcontrol *kcontrol,
+				  struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_legoev3 *chip = snd_kcontrol_chip(kcontrol);
+	long volume = ucontrol->value.integer.value[0];
+
+	if (volume < 0 || volume > LEGOEV3_VOLUME_MAX)
+		return -EINVAL;
+	if (volume == chip->volume)
+		return 0;
+
+	chip->volume = volume;
+	legoev3_fiq_ehrpwm_set_volume(volume);
+
+	return 1;
+}
+
+static const struct snd_kcontrol_new snd_legoev3_volume_control = {
+	.iface	= SNDRV_CTL_ELEM_IFACE_MIXER,
+	.name	= "PCM Playback Volume",
+	.info	= snd_legoev3_volume_info,
+	.get	= snd_legoev3_volume_get,
+	.put	= snd_legoev3_volume_put,
+};
+
+static int snd_legoev3_get_amp_gpio(struct platform_device *pdev,
+				    struct snd_legoev3 *chip)
+{
+	struct snd_legoev3_platform_data *pdata = dev_get_platdata(&pdev->dev);
+	int ret;
+
+	if (!pdata) {
+		chip->amp_gpiod = devm_gpiod_get_optional(&pdev->dev, "enable",
+							  GPIOD_OUT_LOW);
+		return PTR_ERR_OR_ZERO(chip->amp_gpiod);
+	}
+
+	ret = devm_gpio_request_one(&pdev->dev, pdata->amp_gpio,
+				    GPIOF_OUT_INIT_LOW, "speaker amplifier");
+	if (ret)
+		return ret;
+	chip->amp_gpiod = gpio_to_desc(pdata->amp_gpio);
+
+	return 0;
+}
+
+static void snd_legoev3_release_fiq(void *data)
+{
+	legoev3_fiq_ehrpwm_release();
+}
+
+static int snd_legoev3_probe(struct platform_device *pdev)
+{
+	struct snd_legoev3 *chip;
+	struct snd_card *card;
+	struct snd_pcm *pcm;
+	int ret;
+
+	/*
+	 * Not the card's private data: the input device may still send events
+	 * after snd_card_free() in remove, until devres unregisters it.
+	 */
+	chip = devm_kzalloc(&pdev->dev, sizeof(*chip), GFP_KERNEL);
+	if (!chip)
+		return -ENOMEM;
+	chip->dev = &pdev->dev;
+	chip->volume = LEGOEV3_VOLUME_MAX;
+	mutex_init(&chip->lock);
+	INIT_WORK(&chip->tone_work, snd_legoev3_tone_work);
+
+	chip->pwm = devm_pwm_get(&pdev->dev, NULL);
+	if (IS_ERR(chip->pwm)) {
+		ret = PTR_ERR(chip->pwm);
+		if (ret != -EPROBE_DEFER)
+			dev_err(&pdev->dev, "Failed to get pwm: %d\n", ret);
+		return ret;
+	}
+
+	ret = snd_legoev3_get_amp_gpio(pdev, chip);
+	if (ret) {
+		if (ret != -EPROBE_DEFER)
+			dev_err(&pdev->dev, "Failed to get amplifier gpio\n");
+		return ret;
+	}
+
+	/* the FIQ backend is a platform device of its own, maybe not up yet */
+	ret = legoev3_fiq_ehrpwm_request();
+	if (ret == -ENODEV)
+		return -EPROBE_DEFER;
+	if (ret)
+		return ret;
+	ret = devm_add_action_or_reset(&pdev->dev, snd_legoev3_release_fiq,
+				       NULL);
+	if (ret)
+		return ret;
+
+	ret = snd_legoev3_get_dma(pdev, chip);
+	if (ret)
+		return ret;
+
+	/* runs after the input device is gone */
+	ret = devm_add_action_or_reset(&pdev->dev, snd_legoev3_tone_cleanup,
+				       chip);
+	if (ret)
+		return ret;
+
+	chip->input = devm_input_allocate_device(&pdev->dev);
+	if (!chip->input)
+		return -ENOMEM;
+	chip->input->name = "EV3 speaker";
+	chip->input->phys = "legoev3/input0";
+	chip->input->id.bustype = BUS_HOST;
+	chip->input->evbit[0] = BIT_MASK(EV_SND);
+	chip->input->sndbit[0] = BIT_MASK(SND_BELL) | BIT_MASK(SND_TONE);
+	chip->input->event = snd_legoev3_input_event;
+	input_set_drvdata(chip->input, chip);
+
+	ret = snd_card_new(&pdev->dev, index, id, THIS_MODULE, 0, &card);
+	if (ret)
+		return ret;
+	card->private_data = chip;
+	chip->card = card;
+
+	ret = snd_pcm_new(card, "EV3 speaker", 0, 1, 0, &pcm);
+	if (ret)
+		goto err_free_card;
+	pcm->private_data = chip;
+	strcpy(pcm->name, "EV3 speaker");
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK,
+			chip->dma ? &snd_legoev3_dma_playback_ops
+				  : &snd_legoev3_playback_ops);
+	snd_pcm_lib_preallocate_pages_for_all(pcm, SNDRV_DMA_TYPE_CONTINUOUS,
+			snd_dma_continuous_data(GFP_KERNEL),
+			LEGOEV3_BUFFER_MAX, LEGOEV3_BUFFER_MAX);
+
+	ret = snd_ctl_add(card, snd_ctl_new1(&snd_legoev3_volume_control,
+					     chip));
+	if (ret)
+		goto err_free_card;
+
+	strcpy(card->driver, "legoev3");
+	strcpy(card->shortname, "EV3 speaker");
+	strcpy(card->longname, "LEGO MINDSTORMS EV3 speaker");
+
+	ret = snd_card_register(card);
+	if (ret)
+		goto err_free_card;
+
+	ret = input_register_device(chip->input);
+	if (ret)
+		goto err_free_card;
+
+	platform_set_drvdata(pdev, card);
+
+	return 0;
+
+err_free_card:
+	snd_card_free(card);
+
+	return ret;
+}
+
+static int snd_legoev3_remove(struct platform_device *pdev)
+{
+	snd_card_free(platform_get_drvdata(pdev));
+
+	return 0;
+}
+
+#ifdef CONFIG_OF
+static const struct of_device_id snd_legoev3_of_match[] = {
+	{ .compatible = "lego,ev3-sound" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, snd_legoev3_of_match);
+#endif
+
+static struct platform_driver snd_legoev3_driver = {
+	.probe	= snd_legoev3_probe,
+	.remove	= snd_legoev3_remove,
+	.driver	= {
+		.name		= DRIVER_NAME,
+		.of_match_table	= of_match_ptr(snd_legoev3_of_match),
+	},
+};
+module_platform_driver(snd_legoev3_driver);
+
+MODULE_DESCRIPTION("LEGO MINDSTORMS EV3 speaker driver");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("platform:" DRIVER_NAME);
@@ -43,6 +43,11 @@
 
 #define MCASP_MAX_AFIFO_DEPTH	64
 
+static bool afifo_auto = true;
+module_param(afifo_auto, bool, 0644);
+MODULE_PARM_DESC(afifo_auto,
+		 "Size AFIFO events from the period, not just tx/rx-num-evt");
+
 static u32 context_regs[] = {
 	DAVINCI_MCASP_TXFMCTL_REG,
 	DAVINCI_MCASP_RXFMCTL_REG,
@@ -99,6 +104,9 @@ struct davinci_mcasp {
 	u8	txnumevt;
 	u8	rxnumevt;
 
+	/* underruns and overruns reported by the McASP */
+	atomic_t xruns[2];
+
 	bool	dat_port;
 
 	/* Used for comstraint setting on the second stream */
@@ -318,6 +326,7 @@ static irqreturn_t davinci_mcasp_tx_irq_handler(int irq, void *data)
 	if (stat & XUNDRN & irq_mask) {
 		dev_warn(mcasp->dev, "Transmit buffer underflow\n");
 		handled_mask |= XUNDRN;
+		atomic_inc(&mcasp->xruns[SNDRV_PCM_STREAM_PLAYBACK]);
 
 		substream = mcasp->substreams[SNDRV_PCM_STREAM_PLAYBACK];
 		if (substream) {
@@ -353,6 +362,7 @@ static irqreturn_t davinci_mcasp_rx_irq_handler(int irq, void *data)
 	if (stat & ROVRN & irq_mask) {
 		dev_warn(mcasp->dev, "Receive buffer overflow\n");
 		handled_mask |= ROVRN;
+		atomic_inc(&mcasp->xruns[SNDRV_PCM_STREAM_CAPTURE]);
 
 		substream = mcasp->substreams[SNDRV_PCM_STREAM_CAPTURE];
 		if (substream) {
@@ -750,6 +760,24 @@ static int davinci_config_channel_size(struct davinci_mcasp *mcasp,
 	return 0;
 }
 
+/*
+ * Calculate the optimal AFIFO depth for platform side:
+ * The number of words for numevt need to be in steps of active
+ * serializers, and a period needs to be a whole number of events.
+ */
+static int mcasp_fit_numevt(int numevt, int active_serializers,
+			    int period_words)
+{
+	numevt = (numevt / active_serializers) * active_serializers;
+
+	while (period_words % numevt && numevt > 0)
+		numevt -= active_serializers;
+	if (numevt <= 0)
+		numevt = active_serializers;
+
+	return numevt;
+}
+
 static int mcasp_common_hw_param(struct davinci_mcasp *mcasp, int stream,
 				 int period_words, int channels)
 {
@@ -759,7 +787,7 @@ static int mcasp_common_hw_param(struct davinci_mcasp *mcasp, int stream,
 	u8 rx_ser = 0;
 	u8 slots = mcasp->tdm_slots;
 	u8 max_active_serializers = (channels + slots - 1) / slots;
-	int active_serializers, numevt;
+	int active_serializers, numevt, deep;
 	u32 reg;
 	/* Default configuration */
 	if (mcasp->version < MCASP_VERSION_3)
@@ -836,17 +864,21 @@ static int mcasp_common_hw_param(struct davinci_mcasp *mcasp, int stream,
 		return -EINVAL;
 	}
 
+	numevt = mcasp_fit_numevt(numevt, active_serializers, period_words);
+
 	/*
-	 * Calculate the optimal AFIFO depth for platform side:
-	 * The number of words for numevt need to be in steps of active
-	 * serializers.
+	 * Deeper events mean fewer, longer DMA bursts, so by default go up
+	 * to half the AFIFO. Any deeper and the TX event would only fire
+	 * once the FIFO has run empty, or the RX event once it is full,
+	 * with no slack left for the DMA to respond. The configured numevt
+	 * is the least that is used.
 	 */
-	numevt = (numevt / active_serializers) * active_serializers;
-
-	while (period_words % numevt && numevt > 0)
-		numevt -= active_serializers;
-	if (numevt <= 0)
-		numevt = active_serializers;
+	if (afifo_auto) {
+		deep = mcasp_fit_numevt(max_t(int, numevt,
+					      MCASP_MAX_AFIFO_DEPTH / 2),
+					active_serializers, period_words);
+		numevt = max(numevt, deep);
+	}
 
 	mcasp_mod_bits(mcasp, reg, active_serializers, NUMDMA_MASK);
 	mcasp_mod_bits(mcasp, reg, NUMEVT(numevt), NUMEVT_MASK);
@@ -1350,10 +1382,40 @@ static void davinci_mcasp_shutdown(struct snd_pcm_substream *substream,
 		mcasp->channels = 0;
 }
 
+/*
+ * Reports the words held in the AFIFO, so that the delay seen by
+ * applications includes them. With deep AFIFO events this is up to
+ * MCASP_MAX_AFIFO_DEPTH words, which matters for A/V sync and for
+ * userspace drift compensation against another clock.
+ */
+static snd_pcm_sframes_t
+davinci_mcasp_delay(struct snd_pcm_substream *substream,
+		    struct snd_soc_dai *cpu_dai)
+{
+	struct davinci_mcasp *mcasp = snd_soc_dai_get_drvdata(cpu_dai);
+	u32 fifo_use;
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		if (!mcasp->txnumevt)
+			return 0;
+		fifo_use = mcasp_get_reg(mcasp, mcasp->fifo_base +
+					 MCASP_WFIFOSTS_OFFSET);
+	} else {
+		if (!mcasp->rxnumevt)
+			return 0;
+		fifo_use = mcasp_get_reg(mcasp, mcasp->fifo_base +
+					 MCASP_RFIFOSTS_OFFSET);
+	}
+
+	/* partial frames in the FIFO don't count */
+	return fifo_use / substream->runtime->channels;
+}
+
 static const struct snd_soc_dai_ops davinci_mcasp_dai_ops = {
 	.startup	= davinci_mcasp_startup,
 	.shutdown	= davinci_mcasp_shutdown,
 	.trigger	= davinci_mcasp_trigger,
+	.delay		= davinci_mcasp_delay,
 	.hw_params	= davinci_mcasp_hw_params,
 	.set_fmt	= davinci_mcasp_set_dai_fmt,
 	.set_clkdiv	= davinci_mcasp_set_clkdiv,
@@ -1786,6 +1848,26 @@ static u32 davinci_mcasp_rxdma_offset(struct davinci_mcasp_pdata *pdata)
 	return offset;
 }
 
+static ssize_t xruns_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct davinci_mcasp *mcasp = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d %d\n",
+		       atomic_read(&mcasp->xruns[SNDRV_PCM_STREAM_PLAYBACK]),
+		       atomic_read(&mcasp->xruns[SNDRV_PCM_STREAM_CAPTURE]));
+}
+static DEVICE_ATTR_RO(xruns);
+
+static struct attribute *davinci_mcasp_attrs[] = {
+	&dev_attr_xruns.attr,
+	NULL
+};
+
+static const struct attribute_group davinci_mcasp_attr_group = {
+	.attrs = davinci_mcasp_attrs,
+};
+
 static int davinci_mcasp_probe(struct platform_device *pdev)
 {
 	struct snd_dmaengine_dai_dma_data *dma_data;
@@ -1993,6 +2075,11 @@ static int davinci_mcasp_probe(struct platform_device *pdev)
 
 	mcasp_reparent_fck(pdev);
 
+	/* playback and capture xruns, as counted by the error interrupts */
+	ret = devm_device_add_group(&pdev->dev, &davinci_mcasp_attr_group);
+	if (ret)
+		goto err;
+
 	ret = devm_snd_soc_register_component(&pdev->dev,
 					&davinci_mcasp_component,
 					&davinci_mcasp_dai[pdata->op_mode], 1);
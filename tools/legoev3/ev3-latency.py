@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+#
+# Sensor to actuator latency summary for the LEGO MINDSTORMS EV3
+#
+# Reads the text output of ftrace (/sys/kernel/debug/tracing/trace or
+# "trace-cmd report") and follows each sensor sample through the stages of
+# the control loop:
+#
+#   sample   legoev3_fiq:legoev3_fiq_i2c_complete, or iio:iio_buffer_push
+#            with --sensor iio
+#   read     iio:iio_buffer_read, when user space picked the scan up
+#   mark     optional, "ev3: <label>" written to trace_marker by the
+#            control program, e.g. once it has computed the new command
+#   actuate  pwm:pwm_apply, the new duty cycle reached the eHRPWM/eCAP
+#
+# A chain starts at every sample, so a response is always measured from the
+# newest sample before it, and ends at the first actuation after it. Stages
+# that do not show up are skipped. For FIQ I2C samples the time the
+# transaction waited in the queue, spent on the bus and took to get to the
+# status gpio interrupt is reported as well; these are recorded by the FIQ in
+# ticks of the DaVinci free-running counter, and "total" starts at the end of
+# the transaction on the bus rather than at the interrupt.
+#
+# On DaVinci sched_clock() is that same counter, so the default "local"
+# trace clock and the FIQ timestamps are on one timebase. Typical session:
+#
+#   cd /sys/kernel/debug/tracing
+#   echo 1 > events/legoev3_fiq/legoev3_fiq_i2c_complete/enable
+#   echo 1 > events/iio/enable
+#   echo 1 > events/pwm/pwm_apply/enable
+#   (run the robot)
+#   ev3-latency.py --pwm ehrpwm trace
+#
+# With --json the summary is printed as one JSON object instead of a table.
+
+import argparse
+import json
+import re
+import sys
+
+LINE_RE = re.compile(r'^\s*(?P<task>.+?)-(?P<pid>\d+)\s+(\(\s*\S+\)\s+)?'
+                     r'\[(?P<cpu>\d+)\]\s+(?P<flags>\S{4,5}\s+)?'
+                     r'(?P<ts>\d+\.\d+):\s+(?P<event>\w+):\s+(?P<args>.*)$')
+FIELD_RE = re.compile(r'(\w+)=(\S+)')
+MARK_RE = re.compile(r'ev3:\s*(\S+)')
+
+STAGES = ('sample', 'read', 'mark', 'actuate')
+
+
+class Stats:
+    def __init__(self):
+        self.values = []
+
+    def add(self, us):
+        self.values.append(us)
+
+    def summary(self):
+        v = sorted(self.values)
+        n = len(v)
+        return {
+            'count': n,
+            'min_us': v[0],
+            'mean_us': sum(v) / n,
+            'p50_us': v[n // 2],
+            'p99_us': v[min(n - 1, (n * 99) // 100)],
+            'max_us': v[-1],
+        }
+
+
+def classify(event, fields, args, opts):
+    """Returns (stage, label) for an interesting event, or None."""
+    if event == 'legoev3_fiq_i2c_complete' and opts.sensor == 'i2c':
+        if opts.port is None or int(fields.get('port', -1)) == opts.port:
+            return 'sample', 'i2c'
+    elif event == 'iio_buffer_push' and opts.sensor == 'iio':
+        if opts.iio is None or opts.iio in args:
+            return 'sample', 'iio'
+    elif event == 'iio_buffer_read':
+        if (opts.iio is None or opts.iio in args) and \
+           int(fields.get('ret', 0)) > 0:
+            return 'read', 'read'
+    elif event == 'tracing_mark_write':
+        m = MARK_RE.search(args)
+        if m:
+            return 'mark', m.group(1)
+    elif event == 'pwm_apply':
+        if opts.pwm is None or opts.pwm in args:
+            return 'actuate', 'pwm'
+    return None
+
+
+def parse(f, opts):
+    stats = {}
+    chain = None
+    tick_us = 1e6 / opts.tick_rate
+
+    def record(name, us):
+        stats.setdefault(name, Stats()).add(us)
+
+    for line in f:
+        m = LINE_RE.match(line)
+        if not m:
+            continue
+        ts = float(m.group('ts')) * 1e6
+        event = m.group('event')
+        args = m.group('args')
+        fields = dict(FIELD_RE.findall(args))
+        c = classify(event, fields, args, opts)
+        if c is None:
+            continue
+        stage, label = c
+
+        if stage == 'sample':
+            start = ts
+            if label == 'i2c':
+                for k in ('wait', 'bus', 'notify'):
+                    if k in fields:
+                        record('fiq_i2c_' + k, int(fields[k]) * tick_us)
+                # the data was there when the FIQ finished the transaction
+                start -= int(fields.get('notify', 0)) * tick_us
+            chain = {'start': start, 'last': ts, 'name': label,
+                     'stage': 0}
+            continue
+
+        if chain is None:
+            continue
+        idx = STAGES.index(stage)
+        # marks may repeat, the other stages only count once
+        if idx < chain['stage'] or (idx == chain['stage'] and
+                                    stage != 'mark'):
+            continue
+        record('%s->%s' % (chain['name'], label), ts - chain['last'])
+        chain['last'] = ts
+        chain['name'] = label
+        chain['stage'] = idx
+        if stage == 'actuate':
+            record('total', ts - chain['start'])
+            chain = None
+
+    return stats
+
+
+def main():
+    p = argparse.ArgumentParser(
+        description='Summarize EV3 sensor to actuator latency from ftrace')
+    p.add_argument('trace', nargs='?', type=argparse.FileType('r'),
+                   default=sys.stdin, help='ftrace text output')
+    p.add_argument('--sensor', choices=('i2c', 'iio'), default='i2c',
+                   help='event that starts a chain (default: i2c)')
+    p.add_argument('--port', type=int,
+                   help='only FIQ I2C samples from this port (0-3)')
+    p.add_argument('--iio', help='only IIO events whose text contains this, '
+                   'e.g. iio:device0 or ads7957')
+    p.add_argument('--pwm', help='only PWM events whose text contains this, '
+                   'e.g. ehrpwm or a chip:channel')
+    p.add_argument('--tick-rate', type=float, default=24e6,
+                   help='free-running counter rate in Hz (default: 24 MHz)')
+    p.add_argument('--json', action='store_true',
+                   help='print the summary as JSON')
+    opts = p.parse_args()
+
+    stats = parse(opts.trace, opts)
+    summary = {k: v.summary() for k, v in stats.items()}
+
+    if opts.json:
+        json.dump(summary, sys.stdout, indent=1, sort_keys=True)
+        print()
+        return
+
+    if not summary:
+        print('no complete sensor to actuator chains found', file=sys.stderr)
+        sys.exit(1)
+
+    print('%-24s %8s %10s %10s %10s %10s %10s' %
+          ('stage', 'count', 'min_us', 'mean_us', 'p50_us', 'p99_us',
+           'max_us'))
+    for k in sorted(summary, key=lambda k: (k == 'total', k)):
+        s = summary[k]
+        print('%-24s %8d %10.1f %10.1f %10.1f %10.1f %10.1f' %
+              (k, s['count'], s['min_us'], s['mean_us'], s['p50_us'],
+               s['p99_us'], s['max_us']))
+
+
+if __name__ == '__main__':
+    main()
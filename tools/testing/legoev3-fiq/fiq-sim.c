@@ -0,0 +1,974 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Host simulation of the LEGO MINDSTORMS EV3 FIQ backend
+ *
+ * arch/arm/mach-davinci/legoev3-fiq.c is built unchanged against the shims
+ * in include/ and driven by a simulated cp_intc, GPIO banks, free-running
+ * timer and sound eHRPWM. The FIQ timer fires every FIQ_TIMER_TICK_US of
+ * simulated time and the real legoev3_fiq_handler() dispatches it, so the
+ * I2C programs of legoev3_fiq_i2c_compile(), the queue, the periodic
+ * transfers, the status gpio notification and the ePWM sample path all run
+ * the same code as on the brick. Each input port has an NXT style I2C slave
+ * at address 0x01 that decodes the bit-banged waveform and answers register
+ * reads, optionally stretching the clock. With -f, the slave is unplugged
+ * in the middle of every fault_every'th transaction and comes back stuck
+ * holding SDA low, which takes bus recovery (-R) to get out of.
+ *
+ * Each test prints one line of key=value pairs, like legoev3-i2c-bench:
+ *
+ *   i2c       xfers transactions of a 1 byte register write and a size byte
+ *             read, back to back on each of ports ports
+ *   nack      the same to an address nobody answers
+ *   periodic  a periodic read every period_us for 1 simulated second
+ *   sound     play S16 mono for 1 simulated second
+ *
+ * sim_* figures are in simulated time and only change when the waveform
+ * does. fiqs is the number of FIQs, mmio_per_fiq the average number of
+ * peripheral register accesses per FIQ, which is what dominates the cost of
+ * the handler on the ARM926, and host_ns_per_fiq the wall clock time of the
+ * handler on the build machine, which is only good for comparing two builds
+ * on the same host. Any data mismatch or bus conflict makes the program
+ * exit with status 1.
+ *
+ * Usage: fiq-sim [-t test] [-n xfers] [-s size] [-p ports] [-d clock_div]
+ *                [-S stretch_ticks] [-r rate] [-P period_us]
+ *                [-R retries] [-f fault_every] [-x]
+ *
+ * -t is one of the tests above or "all" (the default), -x adds sound
+ * playback to the I2C tests to measure them under load.
+ */
+
+#include "../../../arch/arm/mach-davinci/legoev3-fiq.c"
+
+#include <getopt.h>
+#include <time.h>
+
+#define SIM_TICK_RATE		24000000
+#define SIM_TIMER_IRQ		IRQ_DA8XX_TINT34_1
+#define SIM_EHRPWM_IRQ		IRQ_DA8XX_EHRPWM0
+#define SIM_STATUS_GPIO		(8 * 16 + 12)
+#define SIM_SLAVE_ADDR		0x01
+#define SIM_NUM_GPIO_BANKS	5
+
+/* the pins of port n are GPn_0 (SDA) and GPn_1 (SCL) */
+#define SIM_SDA_PIN(port)	((port) * 16)
+#define SIM_SCL_PIN(port)	((port) * 16 + 1)
+
+static u64 sim_now_ns;
+static u64 sim_mmio;
+
+/* ------------------------------------------------------------------------ */
+/* GPIO */
+
+struct sim_gpio_bank {
+	u32 dir;	/* 1 is input */
+	u32 out;
+	u32 ext_low;	/* pins pulled low by the slaves */
+};
+
+static struct sim_gpio_bank sim_gpio[SIM_NUM_GPIO_BANKS];
+static u32 sim_gpio_regs[SIM_NUM_GPIO_BANKS * FIQ_GPIO_BANK_STRIDE / 4];
+static unsigned sim_conflicts;
+
+static u32 sim_gpio_in(int bank)
+{
+	struct sim_gpio_bank *g = &sim_gpio[bank];
+
+	/* the inputs have pull-ups, everything is open drain towards 0 */
+	return (g->out | g->dir) & ~g->ext_low;
+}
+
+static bool sim_gpio_get(int pin)
+{
+	int bank = pin >> 5;
+
+	return sim_gpio_in(bank) & BIT(pin & 31);
+}
+
+static void sim_gpio_set_ext(int pin, bool low)
+{
+	struct sim_gpio_bank *g = &sim_gpio[pin >> 5];
+
+	if (low)
+		g->ext_low |= BIT(pin & 31);
+	else
+		g->ext_low &= ~BIT(pin & 31);
+}
+
+static u32 sim_gpio_read(unsigned offset)
+{
+	int bank = offset / FIQ_GPIO_BANK_STRIDE;
+
+	switch (offset % FIQ_GPIO_BANK_STRIDE) {
+	case FIQ_GPIO_DIR:
+		return sim_gpio[bank].dir;
+	case FIQ_GPIO_SET_DATA:
+	case FIQ_GPIO_CLR_DATA:
+		return sim_gpio[bank].out;
+	case FIQ_GPIO_IN_DATA:
+		return sim_gpio_in(bank);
+	}
+
+	return 0;
+}
+
+static void sim_gpio_write(unsigned offset, u32 val)
+{
+	int bank = offset / FIQ_GPIO_BANK_STRIDE;
+
+	switch (offset % FIQ_GPIO_BANK_STRIDE) {
+	case FIQ_GPIO_DIR:
+		sim_gpio[bank].dir = val;
+		break;
+	case FIQ_GPIO_SET_DATA:
+		sim_gpio[bank].out |= val;
+		break;
+	case FIQ_GPIO_CLR_DATA:
+		sim_gpio[bank].out &= ~val;
+		break;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+/* cp_intc, only the indexed registers that the FIQ uses */
+
+static u8 sim_intc_regs[0x100];
+static bool sim_irq_enabled[FIQ_NUM_IRQ];
+static bool sim_irq_pending[FIQ_NUM_IRQ];
+
+static const int sim_irq_priority[] = { SIM_EHRPWM_IRQ, SIM_TIMER_IRQ };
+
+static u32 sim_intc_read(unsigned offset)
+{
+	int i, irq;
+
+	if (offset != GPIR)
+		return 0;
+	for (i = 0; i < ARRAY_SIZE(sim_irq_priority); i++) {
+		irq = sim_irq_priority[i];
+		if (sim_irq_pending[irq] && sim_irq_enabled[irq])
+			return irq;
+	}
+
+	return GPIR_NONE;
+}
+
+static void sim_intc_write(unsigned offset, u32 val)
+{
+	if (val >= FIQ_NUM_IRQ)
+		return;
+
+	switch (offset) {
+	case SICR:
+		sim_irq_pending[val] = false;
+		break;
+	case EISR:
+		sim_irq_enabled[val] = true;
+		break;
+	case EICR:
+		sim_irq_enabled[val] = false;
+		break;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+/* eHRPWM, plain 16-bit registers */
+
+static u16 sim_ehrpwm_regs[0x40];
+static u64 sim_duty_sum;
+static unsigned sim_duty_count;
+static unsigned sim_duty_over;
+
+/* ------------------------------------------------------------------------ */
+/* register access from legoev3-fiq.c */
+
+#define SIM_IN(addr, regs) \
+	((const u8 *)(addr) >= (const u8 *)(regs) && \
+	 (const u8 *)(addr) < (const u8 *)(regs) + sizeof(regs))
+#define SIM_OFFSET(addr, regs) ((const u8 *)(addr) - (const u8 *)(regs))
+
+u32 sim_readl(const volatile void __iomem *addr)
+{
+	sim_mmio++;
+	if (SIM_IN(addr, sim_gpio_regs))
+		return sim_gpio_read(SIM_OFFSET(addr, sim_gpio_regs));
+	if (SIM_IN(addr, sim_intc_regs))
+		return sim_intc_read(SIM_OFFSET(addr, sim_intc_regs));
+	fprintf(stderr, "fiq-sim: readl from unknown address %p\n", addr);
+	abort();
+}
+
+void sim_writel(u32 val, volatile void __iomem *addr)
+{
+	sim_mmio++;
+	if (SIM_IN(addr, sim_gpio_regs))
+		sim_gpio_write(SIM_OFFSET(addr, sim_gpio_regs), val);
+	else if (SIM_IN(addr, sim_intc_regs))
+		sim_intc_write(SIM_OFFSET(addr, sim_intc_regs), val);
+	else {
+		fprintf(stderr, "fiq-sim: writel to unknown address %p\n",
+			addr);
+		abort();
+	}
+}
+
+u16 sim_readw(const volatile void __iomem *addr)
+{
+	sim_mmio++;
+	if (!SIM_IN(addr, sim_ehrpwm_regs)) {
+		fprintf(stderr, "fiq-sim: readw from unknown address %p\n",
+			addr);
+		abort();
+	}
+
+	return sim_ehrpwm_regs[SIM_OFFSET(addr, sim_ehrpwm_regs) / 2];
+}
+
+void sim_writew(u16 val, volatile void __iomem *addr)
+{
+	unsigned offset;
+
+	sim_mmio++;
+	if (!SIM_IN(addr, sim_ehrpwm_regs)) {
+		fprintf(stderr, "fiq-sim: writew to unknown address %p\n",
+			addr);
+		abort();
+	}
+
+	offset = SIM_OFFSET(addr, sim_ehrpwm_regs);
+	if (offset == CMPB) {
+		sim_duty_sum += val;
+		sim_duty_count++;
+		if (val > sim_ehrpwm_regs[TBPRD / 2])
+			sim_duty_over++;
+	}
+	if (offset != ETCLR)
+		sim_ehrpwm_regs[offset / 2] = val;
+}
+
+u32 davinci_timer_read_freerun(void)
+{
+	return sim_now_ns * SIM_TICK_RATE / NSEC_PER_SEC;
+}
+
+u32 davinci_timer_read_fiqsource(void)
+{
+	return 0;
+}
+
+unsigned int davinci_timer_get_tick_rate(void)
+{
+	return SIM_TICK_RATE;
+}
+
+/* only referenced by the probe code */
+unsigned cp_intc_get_channel(unsigned hwirq)
+{
+	return 0;
+}
+
+void cp_intc_set_channel(unsigned hwirq, unsigned channel)
+{
+}
+
+void cp_intc_fiq_enable(void)
+{
+}
+
+struct gen_pool *sram_get_gen_pool(void)
+{
+	return NULL;
+}
+
+void *sram_alloc(size_t len, dma_addr_t *dma)
+{
+	return NULL;
+}
+
+void sram_free(void *addr, size_t len)
+{
+}
+
+/* ------------------------------------------------------------------------ */
+/* NXT style I2C slave */
+
+enum sim_slave_state {
+	SLAVE_IDLE,
+	SLAVE_ADDR,
+	SLAVE_WRITE,
+	SLAVE_READ,
+	SLAVE_IGNORE,
+	SLAVE_GONE,
+	SLAVE_STUCK,
+};
+
+struct sim_slave {
+	enum sim_slave_state state;
+	u8 regs[256];
+	u8 ptr;
+	u8 byte;
+	unsigned bit;
+	bool first_write;
+	bool master_ack;
+	bool sda_low;
+	bool prev_sda;
+	bool prev_scl;
+	unsigned stretch;
+	unsigned stretch_left;
+	unsigned starts;
+	bool unplug;
+};
+
+static struct sim_slave sim_slaves[NUM_EV3_PORT_IN];
+static unsigned sim_stretch_ticks;
+static unsigned sim_retries;
+static unsigned sim_fault_every;
+static unsigned sim_faults;
+
+static void sim_slave_drive(struct sim_slave *s, int port, bool low)
+{
+	s->sda_low = low;
+	sim_gpio_set_ext(SIM_SDA_PIN(port), low);
+}
+
+static void sim_slave_send_bit(struct sim_slave *s, int port)
+{
+	sim_slave_drive(s, port, !(s->byte & 0x80));
+	s->byte <<= 1;
+	s->bit++;
+}
+
+/*
+ * Holds SCL low after the ACK of the address and of each byte read, like a
+ * sensor that takes its time to fetch the data. The FIQ only waits for that
+ * before data bytes, so the slave doesn't stretch after a written byte that
+ * could be followed by a stop.
+ */
+static void sim_slave_stretch(struct sim_slave *s, int port)
+{
+	if (s->stretch) {
+		sim_gpio_set_ext(SIM_SCL_PIN(port), true);
+		s->stretch_left = s->stretch;
+	}
+}
+
+static void sim_slave_load(struct sim_slave *s, int port)
+{
+	s->byte = s->regs[s->ptr++];
+	s->bit = 0;
+	sim_slave_send_bit(s, port);
+}
+
+/* Runs after the outputs of each FIQ timer tick have been written. */
+static void sim_slave_step(struct sim_slave *s, int port)
+{
+	bool scl, sda, master_sda_high;
+	int bank = SIM_SDA_PIN(port) >> 5;
+
+	if (s->stretch_left && !--s->stretch_left)
+		sim_gpio_set_ext(SIM_SCL_PIN(port), false);
+
+	scl = sim_gpio_get(SIM_SCL_PIN(port));
+	sda = sim_gpio_get(SIM_SDA_PIN(port));
+
+	/*
+	 * The FIQ drives SDA high push-pull, so it must never fight the slave.
+	 * The tick that SCL falls on doesn't count, the slave lets go of the
+	 * last bit within its hold time.
+	 */
+	master_sda_high = !(sim_gpio[bank].dir & BIT(SIM_SDA_PIN(port) & 31)) &&
+			  (sim_gpio[bank].out & BIT(SIM_SDA_PIN(port) & 31));
+	if (master_sda_high && s->sda_low && (scl || !s->prev_scl))
+		sim_conflicts++;
+
+	if (scl && s->prev_scl && sda != s->prev_sda) {
+		if (s->state == SLAVE_GONE) {
+			/*
+			 * Plugged back in at the stop condition, out of step
+			 * with the master and holding SDA low for an ACK.
+			 */
+			if (sda) {
+				s->state = SLAVE_STUCK;
+				sim_slave_drive(s, port, true);
+			}
+		} else if (s->state == SLAVE_STUCK) {
+			/* waiting for the end of its ACK */
+		} else if (!sda) {
+			/* (repeated) start */
+			s->state = SLAVE_ADDR;
+			s->bit = 0;
+			s->byte = 0;
+			s->starts++;
+		} else {
+			s->state = SLAVE_IDLE;
+		}
+		if (s->state != SLAVE_STUCK)
+			sim_slave_drive(s, port, false);
+	} else if (scl && !s->prev_scl) {
+		switch (s->state) {
+		case SLAVE_ADDR:
+		case SLAVE_WRITE:
+			if (s->bit < 8) {
+				s->byte = s->byte << 1 | sda;
+				s->bit++;
+			}
+			break;
+		case SLAVE_READ:
+			if (s->bit == 9)
+				s->master_ack = !sda;
+			break;
+		default:
+			break;
+		}
+	} else if (!scl && s->prev_scl) {
+		switch (s->state) {
+		case SLAVE_ADDR:
+			if (s->bit == 8) {
+				if (s->byte >> 1 != SIM_SLAVE_ADDR) {
+					s->state = SLAVE_IGNORE;
+					break;
+				}
+				sim_slave_drive(s, port, true);
+				s->bit = 9;
+			} else if (s->bit == 9) {
+				sim_slave_drive(s, port, false);
+				if (s->unplug && !(s->byte & 1)) {
+					/* pulled out before the register */
+					s->unplug = false;
+					s->state = SLAVE_GONE;
+					sim_faults++;
+					break;
+				}
+				sim_slave_stretch(s, port);
+				if (s->byte & 1) {
+					s->state = SLAVE_READ;
+					sim_slave_load(s, port);
+				} else {
+					s->state = SLAVE_WRITE;
+					s->first_write = true;
+					s->bit = 0;
+					s->byte = 0;
+				}
+			}
+			break;
+		case SLAVE_WRITE:
+			if (s->bit == 8) {
+				if (s->first_write)
+					s->ptr = s->byte;
+				else
+					s->regs[s->ptr++] = s->byte;
+				s->first_write = false;
+				sim_slave_drive(s, port, true);
+				s->bit = 9;
+			} else if (s->bit == 9) {
+				sim_slave_drive(s, port, false);
+				s->bit = 0;
+				s->byte = 0;
+			}
+			break;
+		case SLAVE_READ:
+			if (s->bit < 8) {
+				sim_slave_send_bit(s, port);
+			} else if (s->bit == 8) {
+				/* let the master ACK */
+				sim_slave_drive(s, port, false);
+				s->bit = 9;
+			} else if (s->master_ack) {
+				sim_slave_stretch(s, port);
+				sim_slave_load(s, port);
+			} else {
+				s->state = SLAVE_IGNORE;
+			}
+			break;
+		case SLAVE_STUCK:
+			sim_slave_drive(s, port, false);
+			s->state = SLAVE_IDLE;
+			break;
+		default:
+			break;
+		}
+	}
+
+	s->prev_scl = sim_gpio_get(SIM_SCL_PIN(port));
+	s->prev_sda = sim_gpio_get(SIM_SDA_PIN(port));
+}
+
+/* ------------------------------------------------------------------------ */
+/* event loop */
+
+static struct legoev3_fiq_data *sim_fiq_data;
+static u64 sim_fiqs;
+static u64 sim_fiq_mmio;
+static u64 sim_fiq_host_ns;
+static u64 sim_next_timer_ns;
+static u64 sim_next_pwm_ns;
+static u64 sim_pwm_period_ns;
+static unsigned sim_pwm_count;
+static bool sim_status_level;
+
+static u64 sim_host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sim_fiq(void)
+{
+	u64 mmio = sim_mmio, start = sim_host_ns();
+
+	legoev3_fiq_handler();
+
+	sim_fiq_host_ns += sim_host_ns() - start;
+	sim_fiq_mmio += sim_mmio - mmio;
+	sim_fiqs++;
+}
+
+/* Advances to the next timer or ePWM event and handles it. */
+static void sim_step(void)
+{
+	bool timer = true;
+	int i;
+
+	if (sim_pwm_period_ns && sim_next_pwm_ns < sim_next_timer_ns)
+		timer = false;
+
+	if (timer) {
+		sim_now_ns = sim_next_timer_ns;
+		sim_next_timer_ns += FIQ_TIMER_TICK_US * NSEC_PER_USEC;
+		sim_irq_pending[SIM_TIMER_IRQ] = true;
+	} else {
+		sim_now_ns = sim_next_pwm_ns;
+		sim_next_pwm_ns += sim_pwm_period_ns;
+		/* ETPS: the event fires every INTPRD PWM periods */
+		if (++sim_pwm_count >= max(sim_ehrpwm_regs[ETPS / 2]
+					   & INTPRD_MASK, 1) &&
+		    sim_ehrpwm_regs[ETSEL / 2] & INTEN) {
+			sim_pwm_count = 0;
+			sim_irq_pending[SIM_EHRPWM_IRQ] = true;
+		}
+	}
+
+	if (sim_intc_read(GPIR) != GPIR_NONE)
+		sim_fiq();
+
+	if (timer) {
+		for (i = 0; i < NUM_EV3_PORT_IN; i++)
+			sim_slave_step(&sim_slaves[i], i);
+	}
+
+	/* the status gpio interrupt is taken as soon as the FIQ returns */
+	if (sim_gpio_get(SIM_STATUS_GPIO) && !sim_status_level)
+		legoev3_fiq_status_gpio_irq_callback(0, sim_fiq_data);
+	sim_status_level = sim_gpio_get(SIM_STATUS_GPIO);
+}
+
+static void sim_init(void)
+{
+	struct legoev3_fiq_data *fiq_data;
+	int i;
+
+	memset(sim_gpio, 0, sizeof(sim_gpio));
+	for (i = 0; i < SIM_NUM_GPIO_BANKS; i++)
+		sim_gpio[i].dir = ~0;
+	memset(sim_irq_enabled, 0, sizeof(sim_irq_enabled));
+	memset(sim_irq_pending, 0, sizeof(sim_irq_pending));
+	memset(sim_ehrpwm_regs, 0, sizeof(sim_ehrpwm_regs));
+	memset(sim_slaves, 0, sizeof(sim_slaves));
+	for (i = 0; i < NUM_EV3_PORT_IN; i++) {
+		int r;
+
+		for (r = 0; r < 256; r++)
+			sim_slaves[i].regs[r] = r * 7 + i;
+		sim_slaves[i].stretch = sim_stretch_ticks;
+		sim_slaves[i].prev_scl = sim_slaves[i].prev_sda = true;
+	}
+	sim_now_ns = 0;
+	sim_next_timer_ns = FIQ_TIMER_TICK_US * NSEC_PER_USEC;
+	sim_pwm_period_ns = 0;
+	sim_pwm_count = 0;
+	sim_fiqs = sim_fiq_mmio = sim_fiq_host_ns = 0;
+	sim_duty_sum = sim_duty_count = sim_duty_over = 0;
+	sim_conflicts = 0;
+	sim_faults = 0;
+	sim_status_level = false;
+
+	free(sim_fiq_data);
+	fiq_data = calloc(1, sizeof(*fiq_data));
+	if (!fiq_data) {
+		perror("fiq-sim");
+		exit(2);
+	}
+	fiq_data->gpio_base = (void __iomem *)sim_gpio_regs;
+	fiq_data->intc_base = (void __iomem *)sim_intc_regs;
+	fiq_data->ehrpwm_base = (void __iomem *)sim_ehrpwm_regs;
+	fiq_data->timer_irq = SIM_TIMER_IRQ;
+	fiq_data->ehrpwm_irq = SIM_EHRPWM_IRQ;
+	sim_fiq_data = legoev3_fiq_data = fiq_data;
+	legoev3_fiq_set_gpio(SIM_STATUS_GPIO, &fiq_data->status_gpio);
+	fiq_gpio_dir_out(&fiq_data->status_gpio, 0);
+	for (i = 0; i < NUM_EV3_PORT_IN; i++)
+		fiq_data->port_data[i].periodic.slot =
+			&fiq_data->periodic_fallback.port[i];
+	fiq_data->periodic_page = &fiq_data->periodic_fallback;
+	__legoev3_fiq_request_irq(fiq_data, SIM_TIMER_IRQ, 1,
+				  legoev3_fiq_timer_handler, fiq_data);
+	__legoev3_fiq_request_irq(fiq_data, SIM_EHRPWM_IRQ, 0,
+				  legoev3_fiq_ehrpwm_handler,
+				  &fiq_data->ehrpwm_data);
+	sim_mmio = 0;
+}
+
+/* The pins are set up the way the i2c-legoev3 driver requests them. */
+static void sim_request_port(int port, unsigned clock_div)
+{
+	struct legoev3_fiq_port_i2c_data *data;
+	int ret;
+
+	ret = legoev3_fiq_request_port(port, SIM_SDA_PIN(port),
+				       SIM_SCL_PIN(port));
+	if (ret) {
+		fprintf(stderr, "fiq-sim: request_port failed: %d\n", ret);
+		exit(2);
+	}
+	legoev3_fiq_set_clock_div(port, clock_div);
+	legoev3_fiq_set_retries(port, sim_retries);
+	if (sim_stretch_ticks)
+		legoev3_fiq_set_clock_stretch(port, 10 * FIQ_TIMER_TICK_US *
+					      (sim_stretch_ticks + 1));
+	data = &legoev3_fiq_data->port_data[port];
+	fiq_gpio_dir_out(&data->gpio[FIQ_I2C_PIN_SCL], 1);
+	fiq_gpio_dir_in(&data->gpio[FIQ_I2C_PIN_SDA]);
+}
+
+/* ------------------------------------------------------------------------ */
+/* sound */
+
+#define SIM_SOUND_PERIOD	256
+#define SIM_SOUND_PERIODS	4
+
+static struct snd_pcm_runtime sim_runtime;
+static struct snd_pcm_mmap_control sim_control;
+static struct snd_pcm_substream sim_substream = { .runtime = &sim_runtime };
+static s16 sim_sound_buf[SIM_SOUND_PERIOD * SIM_SOUND_PERIODS];
+static unsigned sim_periods;
+
+/* like ALSA with an application that always keeps the buffer full */
+static void sim_period_elapsed(void *context)
+{
+	sim_periods++;
+	sim_control.appl_ptr = legoev3_fiq_data->ehrpwm_data.hw_frames +
+			       sim_runtime.buffer_size;
+}
+
+static void sim_sound_start(unsigned rate)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sim_sound_buf); i++)
+		sim_sound_buf[i] = (i % 64) * 1024 - 32768;
+	sim_runtime.format = SNDRV_PCM_FORMAT_S16_LE;
+	sim_runtime.channels = 1;
+	sim_runtime.rate = rate;
+	sim_runtime.dma_area = (unsigned char *)sim_sound_buf;
+	sim_runtime.buffer_size = ARRAY_SIZE(sim_sound_buf);
+	sim_runtime.period_size = SIM_SOUND_PERIOD;
+	sim_runtime.boundary = sim_runtime.buffer_size << 16;
+	sim_runtime.control = &sim_control;
+	sim_control.appl_ptr = sim_runtime.buffer_size;
+	sim_periods = 0;
+
+	/* an 8-bit duty cycle at the sample rate, like snd-legoev3 */
+	sim_ehrpwm_regs[TBPRD / 2] = 255;
+	sim_pwm_period_ns = NSEC_PER_SEC / rate;
+	sim_next_pwm_ns = sim_now_ns + sim_pwm_period_ns;
+
+	if (legoev3_fiq_ehrpwm_request() ||
+	    legoev3_fiq_ehrpwm_prepare(&sim_substream, 256, 1,
+				       sim_period_elapsed, NULL)) {
+		fprintf(stderr, "fiq-sim: ePWM setup failed\n");
+		exit(2);
+	}
+	legoev3_fiq_ehrpwm_int_enable();
+	legoev3_fiq_enable(SIM_EHRPWM_IRQ);
+}
+
+/* ------------------------------------------------------------------------ */
+/* tests */
+
+struct sim_opts {
+	const char *test;
+	unsigned xfers;
+	unsigned size;
+	unsigned ports;
+	unsigned clock_div;
+	unsigned rate;
+	unsigned period_us;
+	bool sound;
+};
+
+struct sim_port {
+	int port;
+	u8 reg;
+	u8 rbuf[LEGOEV3_FIQ_PERIODIC_MAX_LEN];
+	struct i2c_msg msgs[2];
+	unsigned started;
+	unsigned done;
+	unsigned ok;
+	unsigned nack;
+	unsigned err;
+	unsigned bad;
+	bool busy;
+};
+
+static struct sim_port sim_ports[NUM_EV3_PORT_IN];
+
+static void sim_xfer_complete(int result, void *context)
+{
+	struct sim_port *p = context;
+	struct sim_slave *s = &sim_slaves[p->port];
+	unsigned len = p->msgs[1].len;
+
+	p->done++;
+	p->busy = false;
+	if (result == -ENXIO) {
+		p->nack++;
+	} else if (result) {
+		p->err++;
+	} else {
+		p->ok++;
+		if (memcmp(p->rbuf, &s->regs[p->reg], len))
+			p->bad++;
+	}
+}
+
+static void sim_xfer_start(struct sim_port *p, unsigned size, u16 addr)
+{
+	int ret;
+
+	p->reg = (p->started * 13) & 0x7f;
+	p->msgs[0] = (struct i2c_msg){ .addr = addr, .len = 1,
+				       .buf = &p->reg };
+	p->msgs[1] = (struct i2c_msg){ .addr = addr, .flags = I2C_M_RD,
+				       .len = size, .buf = p->rbuf };
+	memset(p->rbuf, 0, sizeof(p->rbuf));
+	if (sim_fault_every && p->started % sim_fault_every ==
+			       sim_fault_every - 1)
+		sim_slaves[p->port].unplug = true;
+	ret = legoev3_fiq_start_xfer(p->port, p->msgs, 2, sim_xfer_complete,
+				     p);
+	if (ret) {
+		p->err++;
+		p->done++;
+		return;
+	}
+	p->started++;
+	p->busy = true;
+}
+
+static void sim_report_fiq(void)
+{
+	printf(" fiqs=%llu mmio_per_fiq=%.1f host_ns_per_fiq=%.0f",
+	       (unsigned long long)sim_fiqs,
+	       sim_fiqs ? (double)sim_fiq_mmio / sim_fiqs : 0.0,
+	       sim_fiqs ? (double)sim_fiq_host_ns / sim_fiqs : 0.0);
+}
+
+static int sim_test_i2c(const struct sim_opts *o, bool nack)
+{
+	u16 addr = nack ? SIM_SLAVE_ADDR + 1 : SIM_SLAVE_ADDR;
+	unsigned ok = 0, nacks = 0, err = 0, bad = 0, done;
+	u64 start_ns;
+	int i, failed;
+
+	sim_init();
+	for (i = 0; i < o->ports; i++) {
+		sim_request_port(i, o->clock_div);
+		memset(&sim_ports[i], 0, sizeof(sim_ports[i]));
+		sim_ports[i].port = i;
+	}
+	if (o->sound)
+		sim_sound_start(o->rate);
+
+	start_ns = sim_now_ns;
+	do {
+		done = 0;
+		for (i = 0; i < o->ports; i++) {
+			struct sim_port *p = &sim_ports[i];
+
+			if (!p->busy && p->started < o->xfers)
+				sim_xfer_start(p, o->size, addr);
+			done += p->done;
+		}
+		sim_step();
+	} while (done < o->ports * o->xfers);
+
+	for (i = 0; i < o->ports; i++) {
+		ok += sim_ports[i].ok;
+		nacks += sim_ports[i].nack;
+		err += sim_ports[i].err;
+		bad += sim_ports[i].bad;
+	}
+
+	printf("fiq-sim: test=%s ports=%u size=%u clock_div=%u stretch=%u retries=%u sound=%d xfers=%u faults=%u ok=%u nack=%u err=%u bad=%u conflicts=%u sim_us=%llu xfers_per_s=%llu bytes_per_s=%llu",
+	       nack ? "nack" : "i2c", o->ports, o->size, o->clock_div,
+	       sim_stretch_ticks, sim_retries, o->sound, o->ports * o->xfers,
+	       sim_faults, ok, nacks, err, bad, sim_conflicts,
+	       (unsigned long long)((sim_now_ns - start_ns) / NSEC_PER_USEC),
+	       (unsigned long long)((u64)o->ports * o->xfers * NSEC_PER_SEC /
+				    (sim_now_ns - start_ns)),
+	       (unsigned long long)((u64)ok * o->size * NSEC_PER_SEC /
+				    (sim_now_ns - start_ns)));
+	sim_report_fiq();
+	printf("\n");
+
+	if (nack)
+		failed = ok || err || nacks != o->ports * o->xfers;
+	else
+		failed = nacks || err || bad || ok != o->ports * o->xfers;
+
+	return failed || sim_conflicts;
+}
+
+static int sim_test_periodic(const struct sim_opts *o)
+{
+	const struct legoev3_fiq_periodic_slot *slot;
+	u8 reg = 0x42, buf[LEGOEV3_FIQ_PERIODIC_MAX_LEN];
+	struct i2c_msg msgs[2] = {
+		{ .addr = SIM_SLAVE_ADDR, .len = 1, .buf = &reg },
+		{ .addr = SIM_SLAVE_ADDR, .flags = I2C_M_RD, .len = o->size,
+		  .buf = buf },
+	};
+	unsigned seq = 0;
+	int ret, bad;
+
+	sim_init();
+	sim_request_port(0, o->clock_div);
+	if (o->sound)
+		sim_sound_start(o->rate);
+	ret = legoev3_fiq_start_periodic(0, msgs, 2, o->period_us);
+	if (ret) {
+		fprintf(stderr, "fiq-sim: start_periodic failed: %d\n", ret);
+		return 1;
+	}
+
+	while (sim_now_ns < NSEC_PER_SEC)
+		sim_step();
+
+	slot = legoev3_fiq_get_periodic_slot(0);
+	ret = legoev3_fiq_read_periodic(0, buf, sizeof(buf), &seq);
+	bad = ret || memcmp(buf, &sim_slaves[0].regs[reg], o->size);
+
+	printf("fiq-sim: test=periodic size=%u clock_div=%u sound=%d period_us=%u transfers=%u result=%d bad=%d conflicts=%u",
+	       o->size, o->clock_div, o->sound, o->period_us, slot->seq, ret,
+	       bad, sim_conflicts);
+	sim_report_fiq();
+	printf("\n");
+
+	/* at most one transfer per period, back to back if they take longer */
+	return bad || sim_conflicts || !slot->seq ||
+	       slot->seq > USEC_PER_SEC / o->period_us + 1;
+}
+
+static int sim_test_sound(const struct sim_opts *o)
+{
+	unsigned expected;
+
+	sim_init();
+	sim_sound_start(o->rate);
+
+	while (sim_now_ns < NSEC_PER_SEC)
+		sim_step();
+
+	expected = o->rate / SIM_SOUND_PERIOD;
+	printf("fiq-sim: test=sound rate=%u periods=%u expected=%u duty_updates=%u duty_over=%u mean_duty=%.1f",
+	       o->rate, sim_periods, expected, sim_duty_count, sim_duty_over,
+	       sim_duty_count ? (double)sim_duty_sum / sim_duty_count : 0.0);
+	sim_report_fiq();
+	printf("\n");
+
+	return sim_periods + 1 < expected || sim_periods > expected ||
+	       sim_duty_over;
+}
+
+static void sim_usage(void)
+{
+	fprintf(stderr,
+		"usage: fiq-sim [-t i2c|nack|periodic|sound|all] [-n xfers] [-s size]\n"
+		"               [-p ports] [-d clock_div] [-S stretch_ticks] [-r rate]\n"
+		"               [-P period_us] [-R retries] [-f fault_every] [-x]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_opts o = {
+		.test		= "all",
+		.xfers		= 200,
+		.size		= 8,
+		.ports		= 1,
+		.clock_div	= 1,
+		.rate		= 22050,
+		.period_us	= 20000,
+	};
+	bool all;
+	int c, ret = 0;
+
+	while ((c = getopt(argc, argv, "t:n:s:p:d:S:r:P:R:f:xh")) != -1) {
+		switch (c) {
+		case 't':
+			o.test = optarg;
+			break;
+		case 'n':
+			o.xfers = atoi(optarg);
+			break;
+		case 's':
+			o.size = atoi(optarg);
+			break;
+		case 'p':
+			o.ports = atoi(optarg);
+			break;
+		case 'd':
+			o.clock_div = atoi(optarg);
+			break;
+		case 'S':
+			sim_stretch_ticks = atoi(optarg);
+			break;
+		case 'R':
+			sim_retries = atoi(optarg);
+			break;
+		case 'f':
+			sim_fault_every = atoi(optarg);
+			break;
+		case 'r':
+			o.rate = atoi(optarg);
+			break;
+		case 'P':
+			o.period_us = atoi(optarg);
+			break;
+		case 'x':
+			o.sound = true;
+			break;
+		default:
+			sim_usage();
+		}
+	}
+	if (!o.xfers || !o.size || o.size > LEGOEV3_FIQ_PERIODIC_MAX_LEN ||
+	    !o.ports || o.ports > NUM_EV3_PORT_IN || !o.clock_div ||
+	    o.rate < SIM_SOUND_PERIOD || !o.period_us)
+		sim_usage();
+
+	all = !strcmp(o.test, "all");
+	if (all || !strcmp(o.test, "i2c"))
+		ret |= sim_test_i2c(&o, false);
+	if (all || !strcmp(o.test, "nack"))
+		ret |= sim_test_i2c(&o, true);
+	if (all || !strcmp(o.test, "periodic"))
+		ret |= sim_test_periodic(&o);
+	if (all || !strcmp(o.test, "sound"))
+		ret |= sim_test_sound(&o);
+
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,2 @@
+#include <sim.h>
+#include "../../../../../include/uapi/linux/i2c.h"
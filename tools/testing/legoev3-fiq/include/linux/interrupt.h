@@ -0,0 +1,2 @@
+#include <sim.h>
+#include <mach/irqs.h>
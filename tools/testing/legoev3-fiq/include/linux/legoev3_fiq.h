@@ -0,0 +1 @@
+#include "../../../../../include/uapi/linux/legoev3_fiq.h"
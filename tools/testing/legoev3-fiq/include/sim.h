@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Just enough of the kernel API to build legoev3-fiq.c on the host
+ *
+ * Register accesses go to the simulated hardware in fiq-sim.c. Everything
+ * that is only used by the probe, sysfs and debugfs code is stubbed out,
+ * the simulator sets up struct legoev3_fiq_data itself.
+ */
+#ifndef _LEGOEV3_FIQ_SIM_H
+#define _LEGOEV3_FIQ_SIM_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <linux/types.h>
+
+typedef uint8_t u8;
+typedef int8_t s8;
+typedef uint16_t u16;
+typedef int16_t s16;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef u64 phys_addr_t;
+typedef u64 dma_addr_t;
+typedef u64 resource_size_t;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+typedef unsigned long pgprot_t;
+
+#define __iomem
+#define __init
+#define __exit
+#define __user
+#define __fiq_text
+#define __aligned(x)		__attribute__((aligned(x)))
+#define __always_unused	__attribute__((unused))
+#define __maybe_unused		__attribute__((unused))
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define barrier()		__asm__ __volatile__("" : : : "memory")
+#define READ_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, val)	(*(volatile typeof(x) *)&(x) = (val))
+
+#define BIT(nr)			(1UL << (nr))
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define ALIGN(x, a)		(((x) + (a) - 1) & ~((typeof(x))(a) - 1))
+#define PAGE_SHIFT		12
+#define PAGE_SIZE		(1UL << PAGE_SHIFT)
+#define PAGE_ALIGN(x)		ALIGN(x, PAGE_SIZE)
+#define NSEC_PER_USEC		1000ULL
+#define NSEC_PER_MSEC		1000000ULL
+#define NSEC_PER_SEC		1000000000ULL
+#define USEC_PER_SEC		1000000UL
+
+#define U8_MAX			((u8)~0U)
+#define U16_MAX			((u16)~0U)
+#define DIV_ROUND_CLOSEST(x, d)	(((x) + ((d) / 2)) / (d))
+#define WARN_ON(cond)		({ int __c = !!(cond); \
+				   if (__c) fprintf(stderr, "WARN_ON(%s)\n", \
+						    #cond); __c; })
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)		min((t)(a), (t)(b))
+#define max_t(t, a, b)		max((t)(a), (t)(b))
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline int fls(unsigned int x)
+{
+	return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_ALIAS(x)
+#define MODULE_PARM_DESC(p, d)
+#define module_param(name, type, perm)
+/* keeps the driver, and with it the probe code, referenced */
+#define module_platform_driver(drv) \
+	struct platform_driver *sim_platform_driver = &(drv)
+#define THIS_MODULE		NULL
+
+#define pr_err(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define dev_dbg(dev, fmt, ...)	do { } while (0)
+
+#define IS_ERR(ptr)		((unsigned long)(ptr) >= (unsigned long)-4095)
+#define PTR_ERR(ptr)		((long)(ptr))
+#define ERR_PTR(err)		((void *)(long)(err))
+#define ENOTSUPP		524
+
+/* memory */
+#define GFP_KERNEL		0
+#define kzalloc(size, gfp)	calloc(1, size)
+#define kcalloc(n, size, gfp)	calloc(n, size)
+#define kfree(ptr)		free(ptr)
+#define devm_kzalloc(dev, size, gfp)	calloc(1, size)
+
+/* the FIQ is never concurrent with the rest of the simulation */
+#define local_fiq_disable()	do { } while (0)
+#define local_fiq_enable()	do { } while (0)
+#define local_irq_save(flags)	do { (void)(flags); } while (0)
+#define local_irq_restore(flags) do { (void)(flags); } while (0)
+#define rcu_read_lock()		do { } while (0)
+#define rcu_read_unlock()	do { } while (0)
+#define synchronize_irq(irq)	do { } while (0)
+
+static inline int test_and_set_bit(int nr, unsigned long *addr)
+{
+	int old = !!(*addr & BIT(nr));
+
+	*addr |= BIT(nr);
+	return old;
+}
+
+/* simulated registers, see fiq-sim.c */
+u32 sim_readl(const volatile void __iomem *addr);
+void sim_writel(u32 val, volatile void __iomem *addr);
+u16 sim_readw(const volatile void __iomem *addr);
+void sim_writew(u16 val, volatile void __iomem *addr);
+
+#define __raw_readl(a)		sim_readl(a)
+#define __raw_writel(v, a)	sim_writel(v, a)
+#define __raw_readw(a)		sim_readw(a)
+#define __raw_writew(v, a)	sim_writew(v, a)
+#define readl(a)		sim_readl(a)
+#define writel(v, a)		sim_writel(v, a)
+
+/* mach/time.h */
+u32 davinci_timer_read_freerun(void);
+u32 davinci_timer_read_fiqsource(void);
+unsigned int davinci_timer_get_tick_rate(void);
+
+/* devices, only referenced by the probe code */
+struct device { void *platform_data; };
+struct resource { resource_size_t start, end; };
+struct platform_device {
+	const char *name;
+	int id;
+	struct device dev;
+};
+struct platform_driver {
+	int (*probe)(struct platform_device *);
+	int (*remove)(struct platform_device *);
+	struct { const char *name; void *owner; } driver;
+};
+#define dev_get_platdata(dev)	((dev)->platform_data)
+#define platform_set_drvdata(pdev, data) do { } while (0)
+#define platform_get_drvdata(pdev)	NULL
+struct clk;
+struct dentry;
+struct file;
+struct inode;
+struct kobject;
+struct seq_file;
+struct vm_area_struct {
+	unsigned long vm_start, vm_end, vm_pgoff, vm_flags;
+	pgprot_t vm_page_prot;
+};
+#define VM_WRITE		0x2
+#define VM_MAYWRITE		0x20
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *, struct file *);
+	ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+	ssize_t (*write)(struct file *, const char __user *, size_t,
+			 loff_t *);
+	loff_t (*llseek)(struct file *, loff_t, int);
+	int (*release)(struct inode *, struct file *);
+};
+struct attribute { const char *name; unsigned short mode; };
+struct bin_attribute {
+	struct attribute attr;
+	size_t size;
+	void *private;
+	ssize_t (*read)(struct file *, struct kobject *,
+			struct bin_attribute *, char *, loff_t, size_t);
+	int (*mmap)(struct file *, struct kobject *,
+		    struct bin_attribute *, struct vm_area_struct *);
+};
+#define seq_read		NULL
+#define seq_lseek		NULL
+#define single_release		NULL
+#define seq_printf(m, fmt, ...)	do { } while (0)
+#define seq_puts(m, s)		do { } while (0)
+#define single_open(f, show, data)	(-ENODEV)
+#define debugfs_create_dir(name, parent)	NULL
+#define debugfs_create_file(name, mode, parent, data, fops)	NULL
+#define debugfs_remove_recursive(d)	do { } while (0)
+#define device_create_bin_file(dev, attr)	0
+#define device_remove_bin_file(dev, attr)	do { } while (0)
+
+static inline ssize_t memory_read_from_buffer(void *to, size_t count,
+					      loff_t *ppos, const void *from,
+					      size_t available)
+{
+	return 0;
+}
+
+#define remap_pfn_range(vma, addr, pfn, size, prot)	(-ENODEV)
+#define pgprot_noncached(prot)	(prot)
+#define virt_to_phys(addr)	((phys_addr_t)(uintptr_t)(addr))
+
+#define devm_ioremap(dev, offset, size)	NULL
+#define devm_clk_get(dev, id)	ERR_PTR(-ENODEV)
+#define clk_prepare_enable(clk)	0
+#define clk_disable_unprepare(clk)	do { } while (0)
+#define clk_get_rate(clk)	0
+
+/* interrupts */
+typedef enum { IRQ_NONE, IRQ_HANDLED } irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int, void *);
+#define IRQF_TRIGGER_RISING	0x1
+static inline int request_irq(unsigned int irq, irq_handler_t handler,
+			      unsigned long flags, const char *name, void *dev)
+{
+	return 0;
+}
+#define devm_request_irq(dev, irq, handler, flags, name, data) \
+	request_irq(irq, handler, flags, name, data)
+#define free_irq(irq, dev)	do { } while (0)
+#define devm_free_irq(dev, irq, data)	do { } while (0)
+
+/* gpio */
+#define GPIOF_OUT_INIT_LOW	0
+#define gpio_request_one(gpio, flags, label)	0
+#define gpio_free(gpio)		do { } while (0)
+#define gpio_to_irq(gpio)	(gpio)
+
+/* arch/arm/kernel/fiq.c */
+typedef void (*fiq_c_handler_t)(void);
+struct fiq_handler { const char *name; };
+struct pt_regs;
+#define claim_fiq(fh)		0
+#define get_fiq_c_handler()	((fiq_c_handler_t)NULL)
+#define set_fiq_c_handler_stack(handler, stack)	do { } while (0)
+
+/* genalloc, the simulator has no SRAM pool */
+struct gen_pool;
+struct device_node;
+struct genpool_data_align { int align; };
+#define gen_pool_first_fit_align	NULL
+
+static inline unsigned long gen_pool_alloc_algo(struct gen_pool *pool,
+						size_t size, void *algo,
+						void *data)
+{
+	return 0;
+}
+
+#define gen_pool_free(pool, addr, size)	do { } while (0)
+#define gen_pool_virt_to_phys(pool, addr)	0
+#define flush_cache_all()	do { } while (0)
+
+/* pstore ramoops */
+struct ramoops_irqtrace;
+#define RAMOOPS_IRQTRACE_FIQ	0
+#define ramoops_irqtrace_get(type)	((struct ramoops_irqtrace *)NULL)
+
+static inline void ramoops_irqtrace_add(struct ramoops_irqtrace *trace,
+					u32 ts, u32 irq, u32 a, u32 b)
+{
+}
+
+/* hrtimer */
+enum hrtimer_restart { HRTIMER_NORESTART, HRTIMER_RESTART };
+struct hrtimer { enum hrtimer_restart (*function)(struct hrtimer *); };
+#define CLOCK_MONOTONIC		1
+#define HRTIMER_MODE_REL	0
+#define ms_to_ktime(ms)		((ktime_t)(ms) * NSEC_PER_MSEC)
+#define hrtimer_init(timer, clock, mode)	do { } while (0)
+#define hrtimer_start(timer, time, mode)	do { } while (0)
+#define hrtimer_cancel(timer)	0
+#define hrtimer_forward_now(timer, interval)	0
+
+/* tracepoints */
+static inline void sim_trace(int unused, ...)
+{
+}
+
+#define trace_legoev3_fiq_i2c_start(...)	sim_trace(0, __VA_ARGS__)
+#define trace_legoev3_fiq_i2c_complete(...)	sim_trace(0, __VA_ARGS__)
+#define trace_legoev3_fiq_i2c_nack(...)		sim_trace(0, __VA_ARGS__)
+#define trace_legoev3_fiq_i2c_cancel(...)	sim_trace(0, __VA_ARGS__)
+#define trace_legoev3_fiq_period_elapsed(...)	sim_trace(0, __VA_ARGS__)
+
+/* ALSA, only what the ePWM code uses */
+typedef unsigned long snd_pcm_uframes_t;
+typedef int snd_pcm_format_t;
+#define SNDRV_PCM_FORMAT_S16_LE	2
+#define SNDRV_PCM_FORMAT_U8	1
+struct snd_pcm_mmap_control { snd_pcm_uframes_t appl_ptr; };
+struct snd_pcm_runtime {
+	snd_pcm_format_t format;
+	unsigned int channels;
+	unsigned int rate;
+	unsigned char *dma_area;
+	snd_pcm_uframes_t buffer_size;
+	snd_pcm_uframes_t period_size;
+	snd_pcm_uframes_t boundary;
+	struct snd_pcm_mmap_control *control;
+};
+struct snd_pcm_substream { struct snd_pcm_runtime *runtime; };
+
+static inline size_t frames_to_bytes(struct snd_pcm_runtime *runtime,
+				     snd_pcm_uframes_t frames)
+{
+	size_t sample = runtime->format == SNDRV_PCM_FORMAT_U8 ? 1 : 2;
+
+	return frames * sample * runtime->channels;
+}
+
+static inline size_t snd_pcm_lib_buffer_bytes(struct snd_pcm_substream *s)
+{
+	return frames_to_bytes(s->runtime, s->runtime->buffer_size);
+}
+
+#endif /* _LEGOEV3_FIQ_SIM_H */